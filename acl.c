@@ -0,0 +1,422 @@
+/**
+ * @file acl.c
+ * @brief ACL compilation into per-field interval bitmaps, frame key
+ *        parsing and burst classification.
+ */
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "acl.h"
+
+/* Presence bits above the IPv4 and L4 values of a key. */
+#define KEY_IP     (1ull << 32)
+#define KEY_PROTO  (1ull << 8)
+#define KEY_PORT   (1ull << 16)
+
+/* ---------------------------------------------------------------------------
+ * Helpers
+ * --------------------------------------------------------------------------- */
+
+static inline uint64_t mac48(const uint8_t *mac)
+{
+    return (uint64_t)mac[0] << 40 | (uint64_t)mac[1] << 32 | (uint64_t)mac[2] << 24 |
+           (uint64_t)mac[3] << 16 | (uint64_t)mac[4] << 8 | mac[5];
+}
+
+static inline uint32_t prefix_mask(unsigned len)
+{
+    return len ? ~0u << (32 - len) : 0;
+}
+
+/* Single-writer counter update; readers sum with relaxed loads. */
+static inline void hit_add(uint64_t *c)
+{
+    __atomic_store_n(c, *c + 1, __ATOMIC_RELAXED);
+}
+
+/* Values of field @p f that rule @p r accepts, as [*lo, *hi]; 0 if it does
+ * not constrain @p f. */
+static int rule_range(const struct acl_rule *r, unsigned f, uint64_t *lo, uint64_t *hi)
+{
+    uint32_t m;
+
+    if (!(r->fields & (1u << f)))
+        return 0;
+    switch (f)
+    {
+    case ACL_F_ETHERTYPE:
+        *lo = *hi = r->ethertype;
+        break;
+    case ACL_F_PROTO:
+        *lo = *hi = KEY_PROTO | r->proto;
+        break;
+    case ACL_F_SPORT:
+        *lo = KEY_PORT | r->sport_lo;
+        *hi = KEY_PORT | r->sport_hi;
+        break;
+    case ACL_F_DPORT:
+        *lo = KEY_PORT | r->dport_lo;
+        *hi = KEY_PORT | r->dport_hi;
+        break;
+    case ACL_F_SRC_IP:
+        m = prefix_mask(r->src_len);
+        *lo = KEY_IP | (r->src_ip & m);
+        *hi = KEY_IP | (r->src_ip | ~m);
+        break;
+    case ACL_F_DST_IP:
+        m = prefix_mask(r->dst_len);
+        *lo = KEY_IP | (r->dst_ip & m);
+        *hi = KEY_IP | (r->dst_ip | ~m);
+        break;
+    case ACL_F_SRC_MAC:
+        *lo = *hi = mac48(r->src_mac);
+        break;
+    default:
+        *lo = *hi = mac48(r->dst_mac);
+        break;
+    }
+    return 1;
+}
+
+static int rule_valid(const struct acl_rule *r)
+{
+    return r->action <= ACL_DENY && !(r->fields & ~((1u << ACL_NFIELDS) - 1)) &&
+           r->src_len <= 32 && r->dst_len <= 32 &&
+           r->sport_lo <= r->sport_hi && r->dport_lo <= r->dport_hi;
+}
+
+static int cmp_seq(const void *a, const void *b)
+{
+    const struct acl_rule *x = a, *y = b;
+
+    return x->seq < y->seq ? -1 : x->seq > y->seq;
+}
+
+static int cmp_u64(const void *a, const void *b)
+{
+    uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+
+    return x < y ? -1 : x > y;
+}
+
+/* Index of the interval of field slot @p k that holds @p v.  Branch-free,
+ * so a lookup does not pay a misprediction per step. */
+static inline unsigned interval(const struct acl *a, unsigned k, uint64_t v)
+{
+    const uint64_t *b = a->bound[k];
+    unsigned len = a->nbounds[k];
+
+    /* b[0] is 0, so the last bound <= v always exists. */
+    while (len > 1)
+    {
+        unsigned half = len / 2;
+
+        b = b[half] <= v ? b + half : b;
+        len -= half;
+    }
+    return (unsigned)(b - a->bound[k]);
+}
+
+/* First rule set in every one of @p row[0..nfields), or a->nrules. */
+static inline unsigned intersect(const struct acl *a, const uint64_t *const *row)
+{
+    unsigned w, k;
+
+    /* No field constrained: every rule matches (0 is nrules if there are none). */
+    if (a->nfields == 0)
+        return 0;
+    for (w = 0; w < a->words; w++)
+    {
+        uint64_t x = row[0][w];
+
+        for (k = 1; k < a->nfields && x; k++)
+            x &= row[k][w];
+        if (x)
+            return w * 64 + (unsigned)__builtin_ctzll(x);
+    }
+    return a->nrules;
+}
+
+/* ---------------------------------------------------------------------------
+ * Compilation
+ * --------------------------------------------------------------------------- */
+
+/* Cut field @p f into intervals and fill its bitmaps as field slot @p k. */
+static int build_field(struct acl *a, unsigned k, unsigned f)
+{
+    uint64_t *pts;
+    unsigned n = 0;
+    unsigned i, j;
+
+    pts = malloc((2 * a->nrules + 1) * sizeof(*pts));
+    if (!pts)
+        return -ENOMEM;
+    pts[n++] = 0;
+    for (i = 0; i < a->nrules; i++)
+    {
+        uint64_t lo, hi;
+
+        if (rule_range(&a->rules[i], f, &lo, &hi))
+        {
+            pts[n++] = lo;
+            pts[n++] = hi + 1;
+        }
+    }
+    qsort(pts, n, sizeof(*pts), cmp_u64);
+    for (i = 1, j = 1; i < n; i++)
+    {
+        if (pts[i] != pts[j - 1])
+            pts[j++] = pts[i];
+    }
+    n = j;
+
+    a->field[k] = (uint8_t)f;
+    a->nbounds[k] = n;
+    a->bound[k] = pts;
+    a->bitmap[k] = calloc((size_t)n * a->words, sizeof(uint64_t));
+    if (!a->bitmap[k])
+        return -ENOMEM;
+
+    for (i = 0; i < a->nrules; i++)
+    {
+        uint64_t lo = 0, hi = UINT64_MAX;
+
+        rule_range(&a->rules[i], f, &lo, &hi);
+        for (j = 0; j < n; j++)
+        {
+            if (pts[j] >= lo && pts[j] <= hi)
+                a->bitmap[k][(size_t)j * a->words + i / 64] |= 1ull << (i % 64);
+        }
+    }
+    return 0;
+}
+
+/**
+ * acl_build() - Compile @p n rules into a classifier.
+ *
+ * @param rules           the list, in any order.
+ * @param default_action  action of a frame no rule matches.
+ * @param nshards         readers that classify concurrently; each passes its
+ *                        own shard index to acl_classify_burst().
+ *
+ * @return 0 and *@p out, -EINVAL for an invalid rule, a duplicate sequence
+ *         number or a bad argument, -ENOSPC for more than ACL_MAX_RULES
+ *         rules, or -ENOMEM.
+ */
+int acl_build(const struct acl_rule *rules, unsigned n, uint8_t default_action,
+              unsigned nshards, struct acl **out)
+{
+    struct acl *a;
+    unsigned used = 0;
+    unsigned i, f;
+    int err;
+
+    if ((n && !rules) || !out || nshards == 0 || default_action > ACL_DENY)
+        return -EINVAL;
+    if (n > ACL_MAX_RULES)
+        return -ENOSPC;
+    for (i = 0; i < n; i++)
+    {
+        if (!rule_valid(&rules[i]))
+            return -EINVAL;
+        used |= rules[i].fields;
+    }
+
+    a = calloc(1, sizeof(*a));
+    if (!a)
+        return -ENOMEM;
+    a->nrules = n;
+    a->words = n ? (n + 63) / 64 : 1;
+    a->nshards = nshards;
+    a->stride = (n + 1 + 7) & ~7u;
+    a->default_action = default_action;
+    a->rules = malloc((n ? n : 1) * sizeof(*a->rules));
+    a->action = malloc(n ? n : 1);
+    a->hits = aligned_alloc(64, (size_t)nshards * a->stride * sizeof(uint64_t));
+    a->base = calloc(a->stride, sizeof(uint64_t));
+    if (!a->rules || !a->action || !a->hits || !a->base)
+    {
+        acl_destroy(a);
+        return -ENOMEM;
+    }
+    memset(a->hits, 0, (size_t)nshards * a->stride * sizeof(uint64_t));
+
+    if (n)
+        memcpy(a->rules, rules, n * sizeof(*rules));
+    qsort(a->rules, n, sizeof(*a->rules), cmp_seq);
+    for (i = 0; i < n; i++)
+    {
+        if (i && a->rules[i].seq == a->rules[i - 1].seq)
+        {
+            acl_destroy(a);
+            return -EINVAL;
+        }
+        a->action[i] = a->rules[i].action;
+    }
+
+    for (f = 0; f < ACL_NFIELDS; f++)
+    {
+        if (!(used & (1u << f)))
+            continue;
+        err = build_field(a, a->nfields++, f);
+        if (err < 0)
+        {
+            acl_destroy(a);
+            return err;
+        }
+    }
+
+    *out = a;
+    return 0;
+}
+
+/**
+ * acl_destroy() - Free a classifier no reader uses any more.
+ */
+void acl_destroy(struct acl *a)
+{
+    unsigned k;
+
+    if (!a)
+        return;
+    for (k = 0; k < ACL_NFIELDS; k++)
+    {
+        free(a->bound[k]);
+        free(a->bitmap[k]);
+    }
+    free(a->action);
+    free(a->rules);
+    free(a->hits);
+    free(a->base);
+    free(a);
+}
+
+/* ---------------------------------------------------------------------------
+ * Classification
+ * --------------------------------------------------------------------------- */
+
+/**
+ * acl_key_parse() - Extract the ACL fields of an untagged Ethernet frame.
+ */
+void acl_key_parse(const uint8_t *frame, uint32_t len, struct acl_key *key)
+{
+    const uint8_t *ip = frame + 14;
+    unsigned ihl;
+
+    memset(key, 0, sizeof(*key));
+    if (len < 14)
+        return;
+    key->v[ACL_F_DST_MAC] = mac48(frame);
+    key->v[ACL_F_SRC_MAC] = mac48(frame + 6);
+    key->v[ACL_F_ETHERTYPE] = (uint64_t)frame[12] << 8 | frame[13];
+
+    if (key->v[ACL_F_ETHERTYPE] != 0x0800 || len < 14 + 20 || (ip[0] >> 4) != 4 ||
+        (ihl = (ip[0] & 0x0Fu) * 4) < 20)
+        return;
+    key->v[ACL_F_SRC_IP] = KEY_IP | (uint32_t)ip[12] << 24 | (uint32_t)ip[13] << 16 |
+                           (uint32_t)ip[14] << 8 | ip[15];
+    key->v[ACL_F_DST_IP] = KEY_IP | (uint32_t)ip[16] << 24 | (uint32_t)ip[17] << 16 |
+                           (uint32_t)ip[18] << 8 | ip[19];
+    key->v[ACL_F_PROTO] = KEY_PROTO | ip[9];
+
+    /* Ports only in the first fragment of TCP, UDP and SCTP. */
+    if (((ip[6] & 0x1F) | ip[7]) || len < 14 + ihl + 4 ||
+        (ip[9] != 6 && ip[9] != 17 && ip[9] != 132))
+        return;
+    key->v[ACL_F_SPORT] = KEY_PORT | (uint32_t)ip[ihl] << 8 | ip[ihl + 1];
+    key->v[ACL_F_DPORT] = KEY_PORT | (uint32_t)ip[ihl + 2] << 8 | ip[ihl + 3];
+}
+
+/**
+ * acl_classify() - Index of the first rule matching @p key, or -1.
+ *
+ * Counts nothing; for tests and the control path.
+ */
+int acl_classify(const struct acl *a, const struct acl_key *key)
+{
+    const uint64_t *row[ACL_NFIELDS];
+    unsigned k, r;
+
+    for (k = 0; k < a->nfields; k++)
+        row[k] = a->bitmap[k] + (size_t)interval(a, k, key->v[a->field[k]]) * a->words;
+    r = intersect(a, row);
+    return r < a->nrules ? (int)r : -1;
+}
+
+/**
+ * acl_classify_burst() - Classify @p n (at most 64) keys and count the hits
+ *                        in shard @p shard.
+ *
+ * @return a bitmap of the keys whose action is ACL_DENY.
+ */
+uint64_t acl_classify_burst(struct acl *a, const struct acl_key *keys, unsigned n,
+                            unsigned shard)
+{
+    const uint64_t *row[64][ACL_NFIELDS];
+    uint64_t *hits = a->hits + (size_t)shard * a->stride;
+    uint64_t deny = 0;
+    unsigned i, k;
+
+    if (n > 64)
+        n = 64;
+    for (k = 0; k < a->nfields; k++)
+    {
+        for (i = 0; i < n; i++)
+        {
+            row[i][k] = a->bitmap[k] + (size_t)interval(a, k, keys[i].v[a->field[k]]) * a->words;
+            __builtin_prefetch(row[i][k]);
+        }
+    }
+    for (i = 0; i < n; i++)
+    {
+        unsigned r = intersect(a, row[i]);
+        uint8_t act = r < a->nrules ? a->action[r] : a->default_action;
+
+        hit_add(&hits[r]);
+        if (act == ACL_DENY)
+            deny |= 1ull << i;
+    }
+    return deny;
+}
+
+/* ---------------------------------------------------------------------------
+ * Counters
+ * --------------------------------------------------------------------------- */
+
+/**
+ * acl_hits() - Frames matched by rule index @p rule (sorted by sequence
+ *              number), or by no rule for @p rule == nrules.
+ */
+uint64_t acl_hits(const struct acl *a, unsigned rule)
+{
+    uint64_t sum;
+    unsigned s;
+
+    if (rule > a->nrules)
+        return 0;
+    sum = a->base[rule];
+    for (s = 0; s < a->nshards; s++)
+        sum += __atomic_load_n(&a->hits[(size_t)s * a->stride + rule], __ATOMIC_RELAXED);
+    return sum;
+}
+
+/**
+ * acl_carry_hits() - Add the counters of @p from, which no reader may still
+ * use, to the rules of @p to with the same sequence numbers.
+ */
+void acl_carry_hits(struct acl *to, const struct acl *from)
+{
+    unsigned i;
+
+    for (i = 0; i < from->nrules; i++)
+    {
+        const struct acl_rule *r = bsearch(&from->rules[i], to->rules, to->nrules,
+                                           sizeof(*to->rules), cmp_seq);
+
+        if (r)
+            to->base[r - to->rules] += acl_hits(from, i);
+    }
+    to->base[to->nrules] += acl_hits(from, from->nrules);
+}
@@ -0,0 +1,123 @@
+/**
+ * @file acl.h
+ * @brief Ingress ACL classifier: ordered L2/L3/L4 rules compiled for
+ *        bitmap intersection.
+ *
+ * An ACL is a list of rules ordered by sequence number; the first rule a
+ * frame matches decides its action, and a frame no rule matches gets the
+ * list's default action.  acl_build() compiles a list into an immutable
+ * struct acl: every field some rule constrains has its value space cut
+ * into elementary intervals at the rules' bounds, and each interval
+ * carries a bitmap of the rules that accept it, in sequence order.  A
+ * lookup binary-searches each such field, ANDs the bitmaps and takes the
+ * lowest set bit, so its cost depends on the number of fields and the log
+ * of the number of bounds, and on the number of rules only through the
+ * bitmap width.  Ranges (L4 ports), prefixes (IPv4) and exact values
+ * (MACs, EtherType, protocol) are all intervals.  acl_classify_burst()
+ * searches one field for a whole burst before moving to the next, which
+ * keeps that field's bounds in cache, and prefetches the bitmap rows it
+ * found before intersecting them.
+ *
+ * IPv4 and L4 fields of a key carry a presence bit above the value, so a
+ * rule on them never matches a frame that lacks them (non-IPv4, or a
+ * non-first fragment for the ports).
+ *
+ * A built table only changes in its hit counters, so an ACL is updated by
+ * building a replacement and swapping a pointer; freeing the old table
+ * once no reader can hold it is up to the owner (see dataplane.c).  The
+ * counters are sharded by reader: shard k is written only by reader k and
+ * summed by acl_hits().  acl_carry_hits() adds the totals of a retired
+ * table to the rules of its replacement that have the same sequence
+ * number, so a rule's counter survives edits of its list.
+ */
+
+#ifndef ACL_H
+#define ACL_H
+
+#include <stdint.h>
+
+/** Rules of one list; also the bitmap width. */
+#define ACL_MAX_RULES   1024
+
+#define ACL_PERMIT      0
+#define ACL_DENY        1
+
+/** Fields of struct acl_key, in the order a lookup searches them. */
+enum acl_field
+{
+    ACL_F_ETHERTYPE,
+    ACL_F_PROTO,
+    ACL_F_DPORT,
+    ACL_F_SPORT,
+    ACL_F_DST_IP,
+    ACL_F_SRC_IP,
+    ACL_F_DST_MAC,
+    ACL_F_SRC_MAC,
+    ACL_NFIELDS
+};
+
+/** acl_rule.fields bits. */
+#define ACL_M_ETHERTYPE (1u << ACL_F_ETHERTYPE)
+#define ACL_M_PROTO     (1u << ACL_F_PROTO)
+#define ACL_M_DPORT     (1u << ACL_F_DPORT)
+#define ACL_M_SPORT     (1u << ACL_F_SPORT)
+#define ACL_M_DST_IP    (1u << ACL_F_DST_IP)
+#define ACL_M_SRC_IP    (1u << ACL_F_SRC_IP)
+#define ACL_M_DST_MAC   (1u << ACL_F_DST_MAC)
+#define ACL_M_SRC_MAC   (1u << ACL_F_SRC_MAC)
+
+/** One rule; only the fields named in @c fields are matched. */
+struct acl_rule
+{
+    uint32_t seq;               /**< position in the list; unique */
+    uint8_t  action;            /**< ACL_PERMIT or ACL_DENY */
+    uint8_t  proto;             /**< IPv4 protocol */
+    uint8_t  src_len;           /**< prefix lengths, 0..32 */
+    uint8_t  dst_len;
+    uint16_t fields;            /**< ACL_M_* */
+    uint16_t ethertype;
+    uint32_t src_ip;            /**< host order */
+    uint32_t dst_ip;
+    uint16_t sport_lo, sport_hi;
+    uint16_t dport_lo, dport_hi;
+    uint8_t  src_mac[6];
+    uint8_t  dst_mac[6];
+};
+
+/** Header fields of one frame, as filled by acl_key_parse(). */
+struct acl_key
+{
+    uint64_t v[ACL_NFIELDS];
+};
+
+struct acl
+{
+    unsigned         nrules;
+    unsigned         words;             /* bitmap words per interval */
+    unsigned         nshards;
+    unsigned         stride;            /* counters per shard */
+    uint8_t          default_action;
+    unsigned         nfields;           /* fields some rule constrains */
+    uint8_t          field[ACL_NFIELDS];
+    unsigned         nbounds[ACL_NFIELDS];
+    uint64_t        *bound[ACL_NFIELDS];  /* interval starts, ascending */
+    uint64_t        *bitmap[ACL_NFIELDS]; /* nbounds x words */
+    uint8_t         *action;            /* by rule index */
+    struct acl_rule *rules;             /* sorted by seq */
+    uint64_t        *hits;              /* nshards x stride; [nrules] = no match */
+    uint64_t        *base;              /* carried totals, stride entries */
+};
+
+int  acl_build(const struct acl_rule *rules, unsigned n, uint8_t default_action,
+               unsigned nshards, struct acl **out);
+void acl_destroy(struct acl *a);
+
+void acl_key_parse(const uint8_t *frame, uint32_t len, struct acl_key *key);
+int  acl_classify(const struct acl *a, const struct acl_key *key);
+uint64_t acl_classify_burst(struct acl *a, const struct acl_key *keys, unsigned n,
+                            unsigned shard);
+
+uint64_t acl_hits(const struct acl *a, unsigned rule);
+void     acl_carry_hits(struct acl *to, const struct acl *from);
+
+#endif /* ACL_H */
@@ -0,0 +1,436 @@
+/**
+ * @file bench_dp.c
+ * @brief Forwarding-rate benchmark for the user-space forwarding plane.
+ *
+ * Builds g0 <-> p0 and p1 <-> g1 veth pairs in a private network namespace,
+ * makes p0 and p1 members of one VLAN through vlan_api.h, lets the
+ * forwarding plane follow that membership (DP_F_FOLLOW_STATE) and blasts fixed-size IPv4/UDP frames of
+ * 256 different flows into g0 from a generator thread using its own TX
+ * ring.  The forwarding workers switch them p0 -> p1; with more than one
+ * worker the port's fanout group spreads the flows over them.  The run is
+ * repeated for 1..N workers, each time with the veths set to one queue per
+ * worker; with -x every worker count is run a second time with the ports
+ * on AF_XDP (DP_F_XDP), where each worker owns one RX queue instead of a
+ * fanout share.  The kernel picks the generator's TX queue, and so the
+ * receiving queue on p0, from the CPU it sends on, so over AF_XDP the
+ * flows only spread when the generator runs on several CPUs.  With -s N
+ * every run is repeated once more with p0 sampled 1 in N by the sFlow
+ * agent, exporting to a socket on loopback that nobody reads, so the
+ * difference in worker time per frame between the two rows is the cost of
+ * sampling.  Reported per run:
+ *
+ *   - frames forwarded per second of wall-clock time,
+ *   - frames forwarded per second of worker CPU time ("Mpps per core"),
+ *     which stays meaningful when the generator shares the CPUs, and
+ *   - worker CPU time per frame forwarded, in ns.
+ *
+ * Usage: bench_dp [-t seconds] [-l frame_len] [-w max_workers] [-c cpu,...] [-x] [-s rate]
+ */
+
+#define _GNU_SOURCE     /* unshare */
+
+#include <errno.h>
+#include <getopt.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <linux/ethtool.h>
+#include <linux/if.h>
+#include <linux/sockios.h>
+#include <netlink/netlink.h>
+#include <netlink/route/link.h>
+#include <netlink/route/link/veth.h>
+
+#include "dataplane.h"
+#include "dp_ring.h"
+#include "vlan_api.h"
+#include "vlan_state.h"
+
+#define BENCH_VLAN 100
+
+static atomic_int g_gen_stop;
+static unsigned   g_frame_len = 64;
+static uint64_t   g_generated;
+static struct sockaddr_in g_collector;   /* sFlow datagrams go here, unread */
+
+static int link_up(const char *name)
+{
+    struct ifreq ifr;
+    int fd = socket(AF_INET, SOCK_DGRAM, 0);
+    int ret = -1;
+
+    if (fd < 0)
+        return -1;
+    memset(&ifr, 0, sizeof(ifr));
+    strncpy(ifr.ifr_name, name, IFNAMSIZ - 1);
+    if (ioctl(fd, SIOCGIFFLAGS, &ifr) == 0)
+    {
+        ifr.ifr_flags |= IFF_UP;
+        ret = ioctl(fd, SIOCSIFFLAGS, &ifr);
+    }
+    if (ret == 0 && ioctl(fd, SIOCGIFINDEX, &ifr) == 0)
+        ret = ifr.ifr_ifindex;
+    close(fd);
+    return ret;
+}
+
+static void ip_checksum(uint8_t *ip)
+{
+    uint32_t sum = 0;
+    unsigned i;
+
+    for (i = 0; i < 20; i += 2)
+        sum += (uint32_t)(ip[i] << 8 | ip[i + 1]);
+    while (sum >> 16)
+        sum = (sum & 0xFFFF) + (sum >> 16);
+    ip[10] = (uint8_t)(~sum >> 8);
+    ip[11] = (uint8_t)~sum;
+}
+
+/* Create veth pair @p a / @p b with room for @p nqueues queues each way. */
+static int make_pair(struct nl_sock *sock, const char *a, const char *b, unsigned nqueues)
+{
+    struct rtnl_link *link, *peer;
+    int err;
+
+    link = rtnl_link_veth_alloc();
+    if (!link)
+        return -1;
+    peer = rtnl_link_veth_get_peer(link);
+    rtnl_link_set_name(link, a);
+    rtnl_link_set_name(peer, b);
+    rtnl_link_set_num_rx_queues(link, nqueues);
+    rtnl_link_set_num_tx_queues(link, nqueues);
+    rtnl_link_set_num_rx_queues(peer, nqueues);
+    rtnl_link_set_num_tx_queues(peer, nqueues);
+    err = rtnl_link_add(sock, link, NLM_F_CREATE | NLM_F_EXCL);
+    rtnl_link_put(peer);
+    rtnl_link_veth_release(link);
+    if (err < 0)
+        return -1;
+    return (link_up(a) > 0 && link_up(b) > 0) ? 0 : -1;
+}
+
+/* Use @p n of @p name's queues each way (ETHTOOL_SCHANNELS). */
+static int set_queues(const char *name, unsigned n)
+{
+    struct ethtool_channels ch = { .cmd = ETHTOOL_SCHANNELS, .rx_count = n, .tx_count = n };
+    struct ifreq ifr;
+    int fd = socket(AF_INET, SOCK_DGRAM, 0);
+    int ret;
+
+    if (fd < 0)
+        return -1;
+    memset(&ifr, 0, sizeof(ifr));
+    strncpy(ifr.ifr_name, name, IFNAMSIZ - 1);
+    ifr.ifr_data = (char *)&ch;
+    ret = ioctl(fd, SIOCETHTOOL, &ifr);
+    close(fd);
+    return ret;
+}
+
+static void *generator(void *arg)
+{
+    struct dp_ring *ring = arg;
+    uint8_t frame[DP_TX_MAX_LEN];
+    uint64_t n = 0;
+
+    /* Broadcast IPv4/UDP 10.0.0.1 -> 10.0.0.2; the source port picks the flow. */
+    memset(frame, 0, sizeof(frame));
+    memset(frame, 0xFF, 6);
+    frame[6] = 0x02; frame[11] = 0x01;
+    frame[12] = 0x08; frame[13] = 0x00;
+    frame[14] = 0x45;
+    frame[16] = (uint8_t)((g_frame_len - 14) >> 8);
+    frame[17] = (uint8_t)(g_frame_len - 14);
+    frame[22] = 64; frame[23] = 17;
+    frame[26] = 10; frame[29] = 1;
+    frame[30] = 10; frame[33] = 2;
+    frame[34] = 0x30;
+    frame[36] = 0x30; frame[37] = 0x39;
+    frame[38] = (uint8_t)((g_frame_len - 34) >> 8);
+    frame[39] = (uint8_t)(g_frame_len - 34);
+    ip_checksum(frame + 14);
+
+    while (!atomic_load(&g_gen_stop))
+    {
+        unsigned burst = 0;
+
+        while (burst < 64)
+        {
+            frame[35] = (uint8_t)(n + burst);
+            if (dp_ring_tx(ring, frame, g_frame_len) < 0)
+                break;
+            burst++;
+        }
+        n += burst;
+        if (dp_ring_tx_flush(ring) < 0 || burst == 0)
+            sched_yield();
+    }
+    g_generated = n;
+    return NULL;
+}
+
+/* Wait up to two seconds for the plane to attach p0 and p1; store their slots. */
+static int wait_ports(unsigned *in, unsigned *out)
+{
+    struct dp_port_info pi;
+    unsigned found, slot;
+    int tries;
+
+    for (tries = 0; tries < 200; tries++)
+    {
+        found = 0;
+        for (slot = 0; slot < DP_MAX_PORTS; slot++)
+        {
+            if (dp_get_port(slot, &pi) < 0)
+                continue;
+            if (strcmp(pi.name, "p0") == 0)
+            {
+                *in = slot;
+                found |= 1;
+            }
+            else if (strcmp(pi.name, "p1") == 0)
+            {
+                *out = slot;
+                found |= 2;
+            }
+        }
+        if (found == 3)
+            return 0;
+        usleep(10000);
+    }
+    return -1;
+}
+
+/* Export sFlow samples of p0, 1 in @p rate, to g_collector. */
+static int sflow_on(uint32_t rate)
+{
+    struct dp_sflow_cfg cfg;
+
+    memset(&cfg, 0, sizeof(cfg));
+    memcpy(cfg.collector, &g_collector.sin_addr, 4);
+    cfg.port = ntohs(g_collector.sin_port);
+    memcpy(cfg.agent, &g_collector.sin_addr, 4);
+    cfg.poll_s = 1;
+    if (dp_sflow_enable(&cfg) < 0 || dp_sflow_port("p0", rate) < 0)
+        return -1;
+    return 0;
+}
+
+/* Forward for @p seconds with @p nworkers workers and print one result row;
+ * with @p sflow p0 is sampled 1 in @p sflow. */
+static int run(unsigned nworkers, const int *cpus, unsigned flags, int g0, int seconds,
+               uint32_t sflow)
+{
+    struct dp_sflow_info si;
+    char rate[16] = "-";
+    struct dp_worker_stats w0, w1, one;
+    struct dp_port_info in, out;
+    struct dp_ring gen;
+    pthread_t thr;
+    double secs;
+    double cpu;
+    double spread = 1.0;
+    unsigned slot_in = 0, slot_out = 0;
+    unsigned k;
+
+    if (dp_init(DP_F_FOLLOW_STATE | flags, nworkers, cpus) < 0)
+    {
+        fprintf(stderr, "cannot start the forwarding plane\n");
+        return -1;
+    }
+    if (wait_ports(&slot_in, &slot_out) < 0)
+    {
+        fprintf(stderr, "p0 and p1 were not attached\n");
+        dp_shutdown();
+        return -1;
+    }
+    if (sflow && sflow_on(sflow) < 0)
+    {
+        fprintf(stderr, "cannot start sFlow sampling\n");
+        dp_shutdown();
+        return -1;
+    }
+    if (dp_ring_open(&gen, g0) < 0)
+    {
+        fprintf(stderr, "cannot open the generator ring\n");
+        dp_shutdown();
+        return -1;
+    }
+
+    atomic_store(&g_gen_stop, 0);
+    dp_get_worker_stats(&w0);
+    pthread_create(&thr, NULL, generator, &gen);
+    sleep((unsigned)seconds);
+    atomic_store(&g_gen_stop, 1);
+    pthread_join(thr, NULL);
+    usleep(100000);
+    dp_get_worker_stats(&w1);
+
+    dp_get_port(slot_in, &in);
+    dp_get_port(slot_out, &out);
+
+    /* Share of the busiest worker; 1/nworkers is a perfect spread. */
+    if (w1.packets > w0.packets)
+    {
+        uint64_t most = 0;
+
+        for (k = 0; k < nworkers; k++)
+        {
+            dp_get_worker(k, &one);
+            if (one.packets > most)
+                most = one.packets;
+        }
+        spread = (double)most / w1.packets;
+    }
+
+    secs = (w1.wall_ns - w0.wall_ns) / 1e9;
+    cpu  = (w1.cpu_ns - w0.cpu_ns) / 1e9;
+
+    if (sflow && dp_get_sflow(&si) == 0)
+        snprintf(rate, sizeof(rate), "1/%u:%llu", sflow, (unsigned long long)si.samples);
+
+    printf("%-7u  %-7s  %-10llu  %-10llu  %-9llu  %-9.1f  %-9.3f  %-8.2f  %-9.3f  %-9.2f  %-6.1f  %s\n",
+           nworkers, in.io == DP_IO_XDP_DRV ? "xdp-drv" : in.io == DP_IO_XDP_SKB ? "xdp-skb" : "tpacket",
+           (unsigned long long)g_generated,
+           (unsigned long long)in.stats.rx_packets,
+           (unsigned long long)out.stats.tx_packets,
+           (w1.bursts - w0.bursts) ? (double)(w1.packets - w0.packets) / (w1.bursts - w0.bursts) : 0.0,
+           (w1.packets - w0.packets) / secs / 1e6, cpu,
+           cpu > 0 ? (w1.packets - w0.packets) / cpu / 1e6 : 0.0, spread,
+           w1.packets > w0.packets ? cpu * 1e9 / (w1.packets - w0.packets) : 0.0, rate);
+
+    dp_ring_close(&gen);
+    dp_shutdown();
+    return 0;
+}
+
+int main(int argc, char *argv[])
+{
+    int cpus[DP_MAX_WORKERS];
+    unsigned ncpus = 0;
+    unsigned max_workers = 1;
+    unsigned n;
+    struct nl_sock *sock;
+    int xdp = 0;
+    int seconds = 5;
+    uint32_t sflow = 0;
+    socklen_t len = sizeof(g_collector);
+    int sink;
+    char *p, *end;
+    int g0;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "t:l:w:c:xs:h")) != -1)
+    {
+        switch (opt)
+        {
+        case 't':
+            seconds = atoi(optarg);
+            break;
+        case 'l':
+            g_frame_len = (unsigned)atoi(optarg);
+            break;
+        case 'w':
+            max_workers = (unsigned)atoi(optarg);
+            break;
+        case 'c':
+            for (p = optarg; *p && ncpus < DP_MAX_WORKERS; p = *end ? end + 1 : end)
+            {
+                cpus[ncpus++] = (int)strtol(p, &end, 10);
+                if (end == p)
+                    break;
+            }
+            break;
+        case 'x':
+            xdp = 1;
+            break;
+        case 's':
+            sflow = (uint32_t)strtoul(optarg, NULL, 10);
+            break;
+        default:
+            fprintf(stderr, "Usage: %s [-t seconds] [-l frame_len] [-w max_workers] [-c cpu,...] [-x] "
+                    "[-s rate]\n", argv[0]);
+            return opt == 'h' ? 0 : 1;
+        }
+    }
+    if (g_frame_len < 60 || g_frame_len > DP_TX_MAX_LEN)
+        g_frame_len = 64;
+    if (max_workers < 1 || max_workers > DP_MAX_WORKERS)
+        max_workers = 1;
+    if (sflow > SFLOW_RATE_MAX)
+        sflow = SFLOW_RATE_MAX;
+    if (ncpus && ncpus < max_workers)
+    {
+        fprintf(stderr, "-c names %u CPUs, -w needs %u\n", ncpus, max_workers);
+        return 1;
+    }
+
+    if (unshare(CLONE_NEWNET) < 0)
+    {
+        perror("unshare(CLONE_NEWNET)");
+        return 1;
+    }
+
+    sock = nl_socket_alloc();
+    if (!sock || nl_connect(sock, NETLINK_ROUTE) < 0 ||
+        make_pair(sock, "g0", "p0", max_workers) < 0 || make_pair(sock, "p1", "g1", max_workers) < 0)
+    {
+        fprintf(stderr, "cannot create veth pairs\n");
+        return 1;
+    }
+    nl_socket_free(sock);
+    g0 = link_up("g0");
+
+    g_collector.sin_family = AF_INET;
+    g_collector.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    sink = socket(AF_INET, SOCK_DGRAM, 0);
+    if (sflow && (link_up("lo") < 0 || sink < 0 ||
+                  bind(sink, (struct sockaddr *)&g_collector, sizeof(g_collector)) < 0 ||
+                  getsockname(sink, (struct sockaddr *)&g_collector, &len) < 0))
+    {
+        fprintf(stderr, "cannot open the sFlow collector socket\n");
+        return 1;
+    }
+
+    if (vlan_state_init() < 0 || create_vlan(BENCH_VLAN) < 0 ||
+        add_vlan_assignment(BENCH_VLAN, "p0") < 0 || add_vlan_assignment(BENCH_VLAN, "p1") < 0)
+    {
+        fprintf(stderr, "cannot set up VLAN %d\n", BENCH_VLAN);
+        return 1;
+    }
+
+    printf("frame length %u bytes, %d s per run, %ld online CPUs\n\n",
+           g_frame_len, seconds, sysconf(_SC_NPROCESSORS_ONLN));
+    printf("%-7s  %-7s  %-10s  %-10s  %-9s  %-9s  %-9s  %-8s  %-9s  %-9s  %-6s  %s\n",
+           "WORKERS", "IO", "GENERATED", "RX_P0", "TX_P1", "PER_BURST", "WALL_MPPS",
+           "CPU_S", "MPPS/CPU", "MAX_SHARE", "NS/PKT", "SFLOW:SAMPLES");
+    for (n = 1; n <= max_workers; n++)
+    {
+        /* One queue per worker, the shape AF_XDP needs; TPACKET does not care. */
+        if (set_queues("g0", n) < 0 || set_queues("p0", n) < 0 ||
+            set_queues("p1", n) < 0 || set_queues("g1", n) < 0)
+            fprintf(stderr, "cannot set %u queues: %s\n", n, strerror(errno));
+        if (run(n, ncpus ? cpus : NULL, 0, g0, seconds, 0) < 0)
+            return 1;
+        if (sflow && run(n, ncpus ? cpus : NULL, 0, g0, seconds, sflow) < 0)
+            return 1;
+        if (xdp && run(n, ncpus ? cpus : NULL, DP_F_XDP, g0, seconds, 0) < 0)
+            return 1;
+        if (xdp && sflow && run(n, ncpus ? cpus : NULL, DP_F_XDP, g0, seconds, sflow) < 0)
+            return 1;
+    }
+    if (sink >= 0)
+        close(sink);
+    vlan_state_shutdown();
+    return 0;
+}
@@ -0,0 +1,161 @@
+/**
+ * @file bench_lpm.c
+ * @brief Build-time and lookup-rate benchmark for the DIR-24-8 LPM table.
+ *
+ * Loads a synthetic full table (by default 1M prefixes) whose length mix
+ * follows a BGP table: about 60 % /24, most of the rest /16../23, and a
+ * few percent of /8../15 and half a percent of /25../32, which need tbl8
+ * groups.  Then:
+ *
+ *   - build:  wall time of all the lpm_add() calls, and the memory used,
+ *   - single: lpm_lookup() on random addresses inside the loaded prefixes,
+ *   - burst:  lpm_lookup_burst() on the same addresses in 64-address bursts,
+ *   - delete: wall time of deleting every prefix again.
+ *
+ * Addresses are spread over the whole table, so lookups mostly miss the
+ * cache the way they do under real traffic.  Cycles are read with the
+ * TSC, so the numbers are reference cycles.
+ *
+ * Usage: bench_lpm [-n prefixes] [-l lookups]
+ */
+
+#include <getopt.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <x86intrin.h>
+
+#include "lpm.h"
+
+#define BURST   64
+
+static double now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+static uint32_t rnd32(void)
+{
+    return (uint32_t)random() << 16 ^ (uint32_t)random();
+}
+
+/* Prefix length drawn from a BGP-like distribution. */
+static unsigned bgp_depth(void)
+{
+    unsigned r = (unsigned)random() % 1000;
+
+    if (r < 600)
+        return 24;
+    if (r < 950)
+        return 16 + r % 8;
+    if (r < 995)
+        return 8 + r % 8;
+    return 25 + r % 8;
+}
+
+int main(int argc, char *argv[])
+{
+    struct lpm_stats st;
+    struct lpm *t;
+    uint32_t *prefix, *addr, nh[BURST];
+    uint8_t *depth;
+    uint64_t start, cycles, miss, sink = 0;
+    unsigned nprefix = 1000000, nlookup = 10000000;
+    unsigned i;
+    double t0, build, del;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "n:l:h")) != -1)
+    {
+        switch (opt)
+        {
+        case 'n':
+            nprefix = (unsigned)atoi(optarg);
+            break;
+        case 'l':
+            nlookup = (unsigned)atoi(optarg);
+            break;
+        default:
+            fprintf(stderr, "Usage: %s [-n prefixes] [-l lookups]\n", argv[0]);
+            return opt == 'h' ? 0 : 1;
+        }
+    }
+    if (nprefix == 0)
+        nprefix = 1;
+    nlookup = (nlookup + BURST - 1) / BURST * BURST;
+
+    prefix = malloc(nprefix * sizeof(*prefix));
+    depth = malloc(nprefix);
+    addr = malloc(nlookup * sizeof(*addr));
+    t = lpm_create(nprefix, 1u << 14);
+    if (!prefix || !depth || !addr || !t)
+    {
+        fprintf(stderr, "out of memory\n");
+        return 1;
+    }
+
+    srandom(1);
+    for (i = 0; i < nprefix; i++)
+    {
+        depth[i] = (uint8_t)bgp_depth();
+        prefix[i] = rnd32() & ~0u << (32 - depth[i]);
+    }
+    for (i = 0; i < nlookup; i++)
+    {
+        unsigned k = (unsigned)random() % nprefix;
+
+        addr[i] = prefix[k] | (rnd32() & ~(~0u << (32 - depth[k])));
+    }
+
+    t0 = now();
+    for (i = 0; i < nprefix; i++)
+        lpm_add(t, prefix[i], depth[i], i & LPM_NH_MAX);
+    build = now() - t0;
+    lpm_get_stats(t, &st);
+
+    printf("%u prefixes: %u rules (%u duplicates or refused), %u/%u groups\n",
+           nprefix, st.rules, nprefix - st.rules, st.groups_used, st.groups);
+    printf("memory: %.1f MB%s\n", (double)st.bytes / (1 << 20),
+           st.hugepages ? " (tbl24 on hugepages)" : "");
+    printf("build:  %.3f s, %.0f adds/s\n", build, (double)nprefix / build);
+
+    start = __rdtsc();
+    for (i = 0; i < nlookup; i++)
+    {
+        uint32_t v;
+
+        if (lpm_lookup(t, addr[i], &v) == 0)
+            sink += v;
+    }
+    cycles = __rdtsc() - start;
+    printf("single: %.2f cyc/lookup\n", (double)cycles / nlookup);
+
+    start = __rdtsc();
+    for (i = 0; i < nlookup; i += BURST)
+    {
+        lpm_lookup_burst(t, &addr[i], BURST, nh, &miss);
+        sink += nh[0] + miss;
+    }
+    cycles = __rdtsc() - start;
+    printf("burst:  %.2f cyc/lookup\n", (double)cycles / nlookup);
+
+    t0 = now();
+    for (i = 0; i < nprefix; i++)
+        lpm_delete(t, prefix[i], depth[i]);
+    del = now() - t0;
+    lpm_get_stats(t, &st);
+    printf("delete: %.3f s, %u rules and %u groups left\n", del, st.rules, st.groups_used);
+
+    if (sink == 0)
+        fprintf(stderr, "unexpected misses\n");
+
+    lpm_destroy(t);
+    free(addr);
+    free(depth);
+    free(prefix);
+    return 0;
+}
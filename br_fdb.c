@@ -0,0 +1,453 @@
+/**
+ * @file br_fdb.c
+ * @brief Kernel bridge FDB programming, dumps and flushes (see br_fdb.h).
+ *
+ * Every call resolves the names it is given against the published link
+ * snapshot and works on its own Netlink socket, so calls need no lock of
+ * their own and run in parallel with each other and with provisioning.
+ */
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <linux/if_link.h>
+#include <linux/neighbour.h>
+#include <linux/netlink.h>
+#include <linux/rtnetlink.h>
+#include <netlink/attr.h>
+#include <netlink/msg.h>
+#include <netlink/netlink.h>
+
+#include "br_fdb.h"
+#include "nl_batch.h"
+#include "vlan_api.h"    /* NL_CALL_RET */
+#include "vlan_state.h"
+
+/* A bulk delete: every matching entry of a bridge (NTF_SELF) or of one of
+ * its ports (NTF_MASTER). */
+struct flush_target
+{
+    int     ifindex;
+    uint8_t ntf;
+    int     status;
+};
+
+struct dump_ctx
+{
+    int       bridge;               /* filters, 0 for any */
+    int       port;
+    br_fdb_fn fn;
+    void     *arg;
+    long      hz;                   /* NDA_CACHEINFO clock ticks per second */
+    int       n;
+};
+
+/* Entries collected by the flush fallback. */
+struct entry_list
+{
+    struct br_fdb_entry *e;
+    size_t               n;
+    size_t               cap;
+    int                  statics;
+};
+
+/* ---------------------------------------------------------------------------
+ * Helpers
+ * --------------------------------------------------------------------------- */
+
+static struct nl_msg *neigh_msg(int type, int flags, int ifindex, uint8_t ntf, uint16_t state,
+                                const uint8_t *mac)
+{
+    struct nl_msg *m = nlmsg_alloc_simple(type, flags);
+    struct ndmsg nd;
+
+    if (!m)
+        return NULL;
+    memset(&nd, 0, sizeof(nd));
+    nd.ndm_family  = AF_BRIDGE;
+    nd.ndm_ifindex = ifindex;
+    nd.ndm_state   = state;
+    nd.ndm_flags   = ntf;
+    if (nlmsg_append(m, &nd, sizeof(nd), NLMSG_ALIGNTO) < 0 ||
+        (mac && nla_put(m, NDA_LLADDR, 6, mac) < 0))
+    {
+        nlmsg_free(m);
+        return NULL;
+    }
+    return m;
+}
+
+/* Bulk delete of the dynamic (and, with @p statics, static) entries of
+ * target @p t; local entries are never matched. */
+static struct nl_msg *flush_msg(const struct flush_target *t, int statics)
+{
+    struct nl_msg *m = neigh_msg(RTM_DELNEIGH, NLM_F_BULK, t->ifindex, t->ntf, 0, NULL);
+
+    /* An entry matches if its state has none of the masked bits. */
+    if (m && nla_put_u16(m, NDA_NDM_STATE_MASK, statics ? NUD_PERMANENT
+                                                        : NUD_PERMANENT | NUD_NOARP) < 0)
+    {
+        nlmsg_free(m);
+        return NULL;
+    }
+    return m;
+}
+
+/* Ifindex of @p port if it is a member of Vlan<@p vid>, else -ENOENT (no
+ * such VLAN), -ENODEV (no such port) or -EINVAL (not a member). */
+static int member_ifindex(const struct vlan_snapshot *snap, uint16_t vid, const char *port)
+{
+    const struct vs_link *l;
+
+    if (!snap || vid < 1 || vid > 4094 || !snap->bridge_ifindex[vid])
+        return -ENOENT;
+    if ((l = vlan_snapshot_find_name(snap, port)) == NULL)
+        return -ENODEV;
+    return l->master == snap->bridge_ifindex[vid] ? l->ifindex : -EINVAL;
+}
+
+static int commit(struct nl_batch *nl, const char *what)
+{
+    size_t n = nl_batch_pending(nl);
+    int err;
+
+    NL_CALL_RET(err, nl_batch_commit(nl), "nl_batch_commit", "batch=%p, %s=%zu", (void *)nl,
+                what, n);
+    return err;
+}
+
+static int dump_cb(struct nl_msg *msg, void *arg)
+{
+    struct dump_ctx *c = arg;
+    struct nlmsghdr *h = nlmsg_hdr(msg);
+    struct ndmsg *nd = nlmsg_data(h);
+    struct nlattr *tb[NDA_MAX + 1];
+    const struct vlan_snapshot *snap;
+    const struct vs_link *l;
+    struct br_fdb_entry e;
+
+    if (h->nlmsg_type != RTM_NEWNEIGH || nlmsg_parse(h, sizeof(*nd), tb, NDA_MAX, NULL) < 0)
+        return NL_SKIP;
+    /* NTF_SELF entries are the address lists of the devices themselves. */
+    if (nd->ndm_family != AF_BRIDGE || (nd->ndm_flags & NTF_SELF) || !tb[NDA_MASTER] ||
+        !tb[NDA_LLADDR] || nla_len(tb[NDA_LLADDR]) != 6)
+        return NL_OK;
+
+    memset(&e, 0, sizeof(e));
+    e.bridge = (int)nla_get_u32(tb[NDA_MASTER]);
+    e.port = nd->ndm_ifindex;
+    /* Kernels before 4.3 ignore the dump filter. */
+    if ((c->bridge && e.bridge != c->bridge) || (c->port && e.port != c->port))
+        return NL_OK;
+    memcpy(e.mac, nla_data(tb[NDA_LLADDR]), 6);
+    e.type = nd->ndm_state & NUD_PERMANENT ? BR_FDB_LOCAL
+           : nd->ndm_state & NUD_NOARP     ? BR_FDB_STATIC : BR_FDB_DYNAMIC;
+    if (tb[NDA_CACHEINFO] && nla_len(tb[NDA_CACHEINFO]) >= (int)sizeof(struct nda_cacheinfo))
+        e.age_s = ((struct nda_cacheinfo *)nla_data(tb[NDA_CACHEINFO]))->ndm_updated / c->hz;
+    if (tb[NDA_VLAN])
+        e.vid = nla_get_u16(tb[NDA_VLAN]);
+
+    snap = vlan_state_read_begin();
+    if (snap && (l = vlan_snapshot_find_index(snap, e.bridge)) != NULL)
+    {
+        unsigned vid;
+
+        memcpy(e.bridge_name, l->name, IFNAMSIZ);
+        if (!e.vid && sscanf(l->name, "Vlan%u", &vid) == 1 && vid < VLAN_ID_SPACE &&
+            snap->bridge_ifindex[vid] == e.bridge)
+            e.vid = (uint16_t)vid;
+    }
+    if (snap && (l = vlan_snapshot_find_index(snap, e.port)) != NULL)
+        memcpy(e.port_name, l->name, IFNAMSIZ);
+    vlan_state_read_end();
+
+    c->fn(&e, c->arg);
+    c->n++;
+    return NL_OK;
+}
+
+/* Dump the entries of bridge @p bridge and / or port @p port (0 for any)
+ * to @p fn.  Returns the number of entries or -errno. */
+static int dump(int bridge, int port, br_fdb_fn fn, void *arg)
+{
+    struct dump_ctx c = { .bridge = bridge, .port = port, .fn = fn, .arg = arg };
+    struct nl_sock *sock;
+    struct nl_msg *msg;
+    struct ifinfomsg ifi;
+    int err;
+
+    c.hz = sysconf(_SC_CLK_TCK);
+    if (c.hz <= 0)
+        c.hz = 100;
+
+    if ((sock = nl_socket_alloc()) == NULL)
+        return -ENOMEM;
+    if ((msg = nlmsg_alloc_simple(RTM_GETNEIGH, NLM_F_DUMP)) == NULL)
+    {
+        nl_socket_free(sock);
+        return -ENOMEM;
+    }
+    /* The kernel takes the filter from an ifinfomsg header: the port in
+     * ifi_index, the bridge in IFLA_MASTER. */
+    memset(&ifi, 0, sizeof(ifi));
+    ifi.ifi_family = AF_BRIDGE;
+    ifi.ifi_index = port;
+    if (nlmsg_append(msg, &ifi, sizeof(ifi), NLMSG_ALIGNTO) < 0 ||
+        (bridge && nla_put_u32(msg, IFLA_MASTER, (uint32_t)bridge) < 0))
+        err = -ENOMEM;
+    else if (nl_connect(sock, NETLINK_ROUTE) < 0 ||
+             nl_socket_modify_cb(sock, NL_CB_VALID, NL_CB_CUSTOM, dump_cb, &c) < 0)
+        err = -EIO;
+    else
+    {
+        NL_CALL_RET(err, nl_send_auto(sock, msg), "nl_send_auto",
+                    "sock=%p, type=RTM_GETNEIGH, family=AF_BRIDGE, bridge=%d, port=%d",
+                    (void *)sock, bridge, port);
+        if (err >= 0)
+            err = nl_recvmsgs_default(sock);
+        err = err < 0 ? -EIO : c.n;
+    }
+    nlmsg_free(msg);
+    nl_socket_free(sock);
+    return err;
+}
+
+static void collect(const struct br_fdb_entry *e, void *arg)
+{
+    struct entry_list *list = arg;
+
+    if (e->type == BR_FDB_LOCAL || (e->type == BR_FDB_STATIC && !list->statics))
+        return;
+    if (list->n == list->cap)
+    {
+        size_t cap = list->cap ? list->cap * 2 : 256;
+        struct br_fdb_entry *p = realloc(list->e, cap * sizeof(*p));
+
+        if (!p)
+            return;
+        list->e = p;
+        list->cap = cap;
+    }
+    list->e[list->n++] = *e;
+}
+
+/* Flush target @p t on a kernel without bulk delete: dump its entries and
+ * delete them one by one in one batch. */
+static int flush_by_dump(struct nl_batch *nl, const struct flush_target *t, int statics)
+{
+    struct entry_list list = { .statics = statics };
+    size_t i;
+    int err;
+
+    err = t->ntf == NTF_SELF ? dump(t->ifindex, 0, collect, &list) : dump(0, t->ifindex, collect, &list);
+    for (i = 0; err >= 0 && i < list.n; i++)
+        err = nl_batch_add(nl, neigh_msg(RTM_DELNEIGH, 0, list.e[i].port,
+                                         list.e[i].port == list.e[i].bridge ? NTF_SELF : NTF_MASTER,
+                                         0, list.e[i].mac), NULL);
+    free(list.e);
+    if (err < 0)
+        return err;
+    /* An entry that aged out in the meantime is not an error. */
+    err = nl_batch_pending(nl) ? commit(nl, "deletes") : 0;
+    return err == -ENOENT ? 0 : err;
+}
+
+/* ---------------------------------------------------------------------------
+ * Public API
+ * --------------------------------------------------------------------------- */
+
+/**
+ * br_fdb_static() - Add (@p add) or delete static entries @p ops, in one
+ * batch.  Each entry's status says how it fared.
+ *
+ * Adding an address the bridge has learned turns it into a static entry;
+ * deleting removes the entry whatever its type.
+ *
+ * @return 0 if every entry succeeded, otherwise the first error:
+ *    -EINVAL      – VLAN ID outside [1..4094], or the port is not a member
+ *                   of the VLAN. \n
+ *    -ENOENT      – no Vlan<id> bridge (or, deleting, no such entry). \n
+ *    -ENODEV      – no such port. \n
+ *    -ENOMEM      – out of memory. \n
+ *    -errno       – refused by the kernel.
+ */
+int br_fdb_static(struct br_fdb_op *ops, size_t n, int add)
+{
+    const struct vlan_snapshot *snap;
+    struct nl_batch *nl;
+    size_t i;
+    int err;
+
+    if (!ops && n)
+        return -EINVAL;
+    if ((nl = nl_batch_alloc()) == NULL)
+        return -ENOMEM;
+
+    snap = vlan_state_read_begin();
+    for (i = 0; i < n; i++)
+    {
+        int port = ops[i].vid < 1 || ops[i].vid > 4094 ? -EINVAL
+                 : member_ifindex(snap, ops[i].vid, ops[i].port);
+
+        if (port >= 0)
+            port = nl_batch_add(nl, neigh_msg(add ? RTM_NEWNEIGH : RTM_DELNEIGH,
+                                              add ? NLM_F_CREATE | NLM_F_REPLACE : 0, port,
+                                              NTF_MASTER, add ? NUD_NOARP : 0, ops[i].mac),
+                                &ops[i].status);
+        if (port < 0)
+            ops[i].status = port;
+    }
+    vlan_state_read_end();
+
+    if (nl_batch_pending(nl))
+        (void)commit(nl, add ? "adds" : "deletes");
+    nl_batch_free(nl);
+
+    for (err = 0, i = 0; i < n && err == 0; i++)
+        err = ops[i].status;
+    return err;
+}
+
+/**
+ * br_fdb_dump() - Pass the entries of the Vlan<id> bridges that match
+ * filter @p f (NULL for all) to @p fn as the kernel returns them.
+ *
+ * The bridge's own addresses are included as BR_FDB_LOCAL entries; the
+ * address lists of the devices (NTF_SELF) are not.
+ *
+ * @return the number of entries, or
+ *    -EINVAL      – @p fn is NULL, a bad VLAN ID, or a VLAN whose bridge is
+ *                   not the bridge given. \n
+ *    -ENOENT      – no Vlan<id> bridge. \n
+ *    -ENODEV      – no such bridge or port. \n
+ *    -ENOMEM / -EIO.
+ */
+int br_fdb_dump(const struct br_fdb_filter *f, br_fdb_fn fn, void *arg)
+{
+    static const struct br_fdb_filter all;
+    const struct vlan_snapshot *snap;
+    int bridge = 0, port = 0;
+
+    if (!fn)
+        return -EINVAL;
+    if (!f)
+        f = &all;
+    if (f->vid > 4094)
+        return -EINVAL;
+
+    snap = vlan_state_read_begin();
+    if ((f->bridge[0] || f->port[0]) && !snap)
+        bridge = -ENODEV;
+    if (bridge == 0 && f->bridge[0])
+    {
+        const struct vs_link *l = vlan_snapshot_find_name(snap, f->bridge);
+
+        bridge = l ? l->ifindex : -ENODEV;
+    }
+    if (bridge >= 0 && f->vid)
+    {
+        int vb = snap ? snap->bridge_ifindex[f->vid] : 0;
+
+        bridge = !vb ? -ENOENT : bridge && bridge != vb ? -EINVAL : vb;
+    }
+    if (bridge >= 0 && f->port[0])
+    {
+        const struct vs_link *l = vlan_snapshot_find_name(snap, f->port);
+
+        port = l ? l->ifindex : -ENODEV;
+    }
+    vlan_state_read_end();
+
+    if (bridge < 0)
+        return bridge;
+    if (port < 0)
+        return port;
+    return dump(bridge, port, fn, arg);
+}
+
+/**
+ * br_fdb_flush() - Delete the learned entries of port @p port in VLAN
+ * @p vid, of every port of Vlan<@p vid> if @p port is NULL, of @p port
+ * if @p vid is 0, or of every Vlan<id> bridge if both are unset.  With
+ * @p statics the static entries go as well; local ones always stay.
+ *
+ * @return 0, or
+ *    -EINVAL      – VLAN ID above 4094, or @p port is not a member of the
+ *                   VLAN (or, without @p vid, of any). \n
+ *    -ENOENT      – no Vlan<id> bridge. \n
+ *    -ENODEV      – no such port. \n
+ *    -ENOMEM / -errno of the kernel.
+ */
+int br_fdb_flush(uint16_t vid, const char *port, int statics)
+{
+    const struct vlan_snapshot *snap;
+    struct flush_target *t;
+    struct nl_batch *nl;
+    unsigned i, n = 0;
+    int err = 0;
+
+    if (vid > 4094)
+        return -EINVAL;
+    if ((t = calloc(VLAN_ID_SPACE, sizeof(*t))) == NULL)
+        return -ENOMEM;
+
+    snap = vlan_state_read_begin();
+    if (port && vid)
+    {
+        t[n].ifindex = member_ifindex(snap, vid, port);
+        err = t[n].ifindex < 0 ? t[n].ifindex : 0;
+        t[n++].ntf = NTF_MASTER;
+    }
+    else if (port)
+    {
+        const struct vs_link *l = snap ? vlan_snapshot_find_name(snap, port) : NULL;
+
+        err = !l ? -ENODEV : !l->member_vlan ? -EINVAL : 0;
+        t[n].ifindex = l ? l->ifindex : 0;
+        t[n++].ntf = NTF_MASTER;
+    }
+    else if (vid)
+    {
+        err = snap && snap->bridge_ifindex[vid] ? 0 : -ENOENT;
+        t[n].ifindex = snap ? snap->bridge_ifindex[vid] : 0;
+        t[n++].ntf = NTF_SELF;
+    }
+    for (i = 1; !port && !vid && snap && i <= 4094; i++)
+    {
+        if (!snap->bridge_ifindex[i])
+            continue;
+        t[n].ifindex = snap->bridge_ifindex[i];
+        t[n++].ntf = NTF_SELF;
+    }
+    vlan_state_read_end();
+
+    if (err < 0 || n == 0)
+    {
+        free(t);
+        return err;
+    }
+    if ((nl = nl_batch_alloc()) == NULL)
+    {
+        free(t);
+        return -ENOMEM;
+    }
+
+    for (i = 0; i < n && err == 0; i++)
+        err = nl_batch_add(nl, flush_msg(&t[i], statics), &t[i].status);
+    if (err == 0)
+        (void)commit(nl, "bulk deletes");
+
+    /* Kernels before 5.19 treat the request as a single delete without an
+     * address and refuse it. */
+    for (i = 0; i < n && err == 0; i++)
+    {
+        if (t[i].status == -EINVAL || t[i].status == -EOPNOTSUPP)
+            t[i].status = flush_by_dump(nl, &t[i], statics);
+        err = t[i].status;
+    }
+    nl_batch_free(nl);
+    free(t);
+    return err;
+}
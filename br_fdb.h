@@ -0,0 +1,73 @@
+/**
+ * @file br_fdb.h
+ * @brief Static MAC entries, filtered dumps and flushes of the kernel FDB of
+ *        the Vlan<id> bridges.
+ *
+ * Without the user-space forwarding plane the Vlan<id> bridges learn in the
+ * kernel.  Static entries are RTM_NEWNEIGH / RTM_DELNEIGH requests of
+ * family AF_BRIDGE on the bridge port (NTF_MASTER), queued on one
+ * nl_batch.h batch per call so that thousands of entries cost a handful of
+ * round trips, with one status per entry.  Dumps ask the kernel for the
+ * entries of one bridge and / or port only and hand each entry to the
+ * caller as it is parsed, so a large table is never held in memory.
+ * Flushes use the kernel's bulk delete (NLM_F_BULK, Linux 5.19 and later):
+ * one request per bridge or port, whatever the number of entries.  On older
+ * kernels they fall back to a filtered dump followed by one batch of
+ * per-entry deletes.
+ *
+ * Each Vlan<id> bridge carries one VLAN untagged, so a VLAN is addressed
+ * by its bridge and entries carry no VID of their own.
+ */
+
+#ifndef BR_FDB_H
+#define BR_FDB_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <linux/if.h>
+
+/** One static entry of br_fdb_static(). */
+struct br_fdb_op
+{
+    uint8_t  mac[6];
+    uint16_t vid;                   /**< VLAN, i.e. the Vlan<id> bridge */
+    char     port[IFNAMSIZ];        /**< member port of that bridge */
+    int      status;                /**< out: 0 or a negative errno */
+};
+
+/** Entry type, from the kernel's NUD state. */
+enum br_fdb_type
+{
+    BR_FDB_DYNAMIC,                 /**< learned, ages out */
+    BR_FDB_STATIC,                  /**< added by the operator */
+    BR_FDB_LOCAL,                   /**< address of the bridge or a port */
+};
+
+/** One entry passed to a br_fdb_fn. */
+struct br_fdb_entry
+{
+    uint8_t          mac[6];
+    uint16_t         vid;           /**< VLAN of the Vlan<id> bridge, else 0 */
+    int              bridge;
+    int              port;          /**< == bridge for the bridge's own entries */
+    enum br_fdb_type type;
+    unsigned         age_s;         /**< since the entry was last refreshed */
+    char             bridge_name[IFNAMSIZ];
+    char             port_name[IFNAMSIZ];
+};
+
+typedef void (*br_fdb_fn)(const struct br_fdb_entry *e, void *arg);
+
+/** Dump filter; 0 / "" fields match everything. */
+struct br_fdb_filter
+{
+    char     bridge[IFNAMSIZ];
+    uint16_t vid;
+    char     port[IFNAMSIZ];
+};
+
+int br_fdb_static(struct br_fdb_op *ops, size_t n, int add);
+int br_fdb_dump(const struct br_fdb_filter *f, br_fdb_fn fn, void *arg);
+int br_fdb_flush(uint16_t vid, const char *port, int statics);
+
+#endif /* BR_FDB_H */
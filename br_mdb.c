@@ -0,0 +1,336 @@
+/**
+ * @file br_mdb.c
+ * @brief Kernel bridge MDB programming from IGMP / MLD snooping (see br_mdb.h).
+ *
+ * One thread owns the packet socket; it and the control calls share the
+ * snooper, the pending batch and the VLAN switches under g_mdb_lock.  The
+ * thread wakes for every burst of messages and at least once per
+ * SNOOP_TICK_MS to run the snooper's timers, then commits whatever joins
+ * and prunes that produced as one batch.
+ */
+
+#include <errno.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include <linux/filter.h>
+#include <linux/if_bridge.h>
+#include <linux/if_ether.h>
+#include <linux/if_packet.h>
+#include <linux/rtnetlink.h>
+#include <netlink/attr.h>
+#include <netlink/msg.h>
+#include <netlink/netlink.h>
+
+#include "br_mdb.h"
+#include "nl_batch.h"
+#include "vlan_api.h"    /* NL_CALL_RET */
+#include "vlan_state.h"
+
+/** Messages handled per pass of the thread before the timers run. */
+#define BR_MDB_RX_BUDGET  256
+
+static pthread_mutex_t  g_mdb_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct snoop    *g_snoop;
+static struct nl_batch *g_batch;
+static int              g_fd = -1;
+static pthread_t        g_thread;
+static int              g_started;
+static atomic_int       g_stop;
+
+/*
+ * IGMP (IPv4 protocol 2), or ICMPv6 directly or behind a hop-by-hop header;
+ * snoop_rx() sorts out the MLD types.
+ */
+static struct sock_filter g_filter[] =
+{
+    BPF_STMT(BPF_LD  | BPF_H | BPF_ABS, 12),                     /* 0: EtherType */
+    BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, ETH_P_IP, 0, 2),         /* 1 */
+    BPF_STMT(BPF_LD  | BPF_B | BPF_ABS, 14 + 9),                 /* 2: protocol */
+    BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, 2, 6, 7),                /* 3 */
+    BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, ETH_P_IPV6, 0, 6),       /* 4 */
+    BPF_STMT(BPF_LD  | BPF_B | BPF_ABS, 14 + 6),                 /* 5: next header */
+    BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, 58, 3, 0),               /* 6 */
+    BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, 0, 0, 3),                /* 7 */
+    BPF_STMT(BPF_LD  | BPF_B | BPF_ABS, 14 + 40),                /* 8: after hop-by-hop */
+    BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, 58, 0, 1),               /* 9 */
+    BPF_STMT(BPF_RET | BPF_K, 0xFFFF),                           /* 10: accept */
+    BPF_STMT(BPF_RET | BPF_K, 0),                                /* 11: drop */
+};
+
+/* ---------------------------------------------------------------------------
+ * Helpers
+ * --------------------------------------------------------------------------- */
+
+static uint64_t now_ms(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000 + (uint64_t)ts.tv_nsec / 1000000;
+}
+
+static struct nl_msg *mdb_msg(int type, int bridge, int port, const struct snoop_key *k)
+{
+    struct nl_msg *m = nlmsg_alloc_simple(type, type == RTM_NEWMDB ? NLM_F_CREATE | NLM_F_REPLACE : 0);
+    struct br_port_msg bpm;
+    struct br_mdb_entry e;
+
+    if (!m)
+        return NULL;
+    memset(&bpm, 0, sizeof(bpm));
+    bpm.family = AF_BRIDGE;
+    bpm.ifindex = bridge;
+    memset(&e, 0, sizeof(e));
+    e.ifindex = port;
+    e.state = MDB_PERMANENT;
+    if (k->family == AF_INET)
+    {
+        e.addr.proto = htons(ETH_P_IP);
+        memcpy(&e.addr.u.ip4, k->addr, 4);
+    }
+    else
+    {
+        e.addr.proto = htons(ETH_P_IPV6);
+        memcpy(&e.addr.u.ip6, k->addr, 16);
+    }
+    if (nlmsg_append(m, &bpm, sizeof(bpm), NLMSG_ALIGNTO) < 0 ||
+        nla_put(m, MDBA_SET_ENTRY, sizeof(e), &e) < 0)
+    {
+        nlmsg_free(m);
+        return NULL;
+    }
+    return m;
+}
+
+/* Snooper callback: queue the MDB change of a join or prune. */
+static void on_change(enum snoop_op op, const struct snoop_key *k, int port, void *arg)
+{
+    const struct vlan_snapshot *snap;
+    int bridge;
+
+    (void)arg;
+    if (op != SNOOP_JOIN && op != SNOOP_PRUNE)
+        return;
+    snap = vlan_state_read_begin();
+    bridge = snap ? snap->bridge_ifindex[k->vid] : 0;
+    vlan_state_read_end();
+    /* A deleted bridge took its entries with it. */
+    if (bridge > 0)
+        nl_batch_add(g_batch, mdb_msg(op == SNOOP_JOIN ? RTM_NEWMDB : RTM_DELMDB, bridge, port, k),
+                     NULL);
+}
+
+/* Send the queued changes; the caller holds g_mdb_lock. */
+static void mdb_flush(void)
+{
+    int _nl_err;
+
+    if (!nl_batch_pending(g_batch))
+        return;
+    NL_CALL_RET(_nl_err, nl_batch_commit(g_batch), "nl_batch_commit", "batch=%p (mdb)",
+                (void *)g_batch);
+    if (_nl_err < 0)
+        fprintf(stderr, "br_mdb: MDB update: %s\n", strerror(-_nl_err));
+}
+
+/* VLAN whose bridge @p ifindex is a port of, 0 if none. */
+static uint16_t port_vlan(int ifindex)
+{
+    const struct vlan_snapshot *snap = vlan_state_read_begin();
+    const struct vs_link *l = snap ? vlan_snapshot_find_index(snap, ifindex) : NULL;
+    uint16_t vid = l ? (uint16_t)l->member_vlan : 0;
+
+    vlan_state_read_end();
+    return vid;
+}
+
+static void *mdb_main(void *arg)
+{
+    struct pollfd pfd = { .fd = g_fd, .events = POLLIN };
+    uint8_t buf[2048];
+
+    (void)arg;
+    while (!atomic_load(&g_stop))
+    {
+        int ready = poll(&pfd, 1, SNOOP_TICK_MS) > 0;
+        unsigned budget = BR_MDB_RX_BUDGET;
+
+        pthread_mutex_lock(&g_mdb_lock);
+        while (ready && budget--)
+        {
+            struct sockaddr_ll sll;
+            socklen_t sl = sizeof(sll);
+            ssize_t n = recvfrom(g_fd, buf, sizeof(buf), MSG_DONTWAIT, (struct sockaddr *)&sll, &sl);
+            uint16_t vid;
+
+            if (n <= 0)
+                break;
+            if (sll.sll_pkttype == PACKET_OUTGOING || (vid = port_vlan(sll.sll_ifindex)) == 0)
+                continue;
+            snoop_rx(g_snoop, vid, sll.sll_ifindex, buf, (size_t)n, now_ms());
+        }
+        snoop_tick(g_snoop, now_ms());
+        mdb_flush();
+        pthread_mutex_unlock(&g_mdb_lock);
+    }
+    return NULL;
+}
+
+/* Open the filtered packet socket and start the thread; g_mdb_lock held. */
+static int mdb_start(void)
+{
+    struct sock_fprog prog = { .len = sizeof(g_filter) / sizeof(g_filter[0]), .filter = g_filter };
+    int err;
+
+    g_fd = socket(AF_PACKET, SOCK_RAW, htons(ETH_P_ALL));
+    if (g_fd < 0)
+        return -errno;
+    if (setsockopt(g_fd, SOL_SOCKET, SO_ATTACH_FILTER, &prog, sizeof(prog)) < 0)
+    {
+        err = -errno;
+        close(g_fd);
+        g_fd = -1;
+        return err;
+    }
+    atomic_store(&g_stop, 0);
+    if ((err = pthread_create(&g_thread, NULL, mdb_main, NULL)) != 0)
+    {
+        close(g_fd);
+        g_fd = -1;
+        return -err;
+    }
+    g_started = 1;
+    return 0;
+}
+
+/* ---------------------------------------------------------------------------
+ * Public API
+ * --------------------------------------------------------------------------- */
+
+/**
+ * br_mdb_vlan() - Start or stop snooping on the ports of Vlan<@p vid>.
+ *
+ * The first VLAN turned on starts the snooping thread.  Turning a VLAN off
+ * deletes the MDB entries it programmed.
+ *
+ * @return 0, -EINVAL for a VLAN ID outside [1..4094], -ENOMEM, or the
+ *         negative errno of opening the packet socket (-EPERM without
+ *         CAP_NET_RAW).
+ */
+int br_mdb_vlan(uint16_t vid, int on)
+{
+    int err = 0;
+
+    if (vid < 1 || vid > 4094)
+        return -EINVAL;
+
+    pthread_mutex_lock(&g_mdb_lock);
+    if (!g_snoop)
+    {
+        g_batch = nl_batch_alloc();
+        g_snoop = g_batch ? snoop_create(now_ms(), on_change, NULL) : NULL;
+        if (!g_snoop)
+        {
+            nl_batch_free(g_batch);
+            g_batch = NULL;
+            pthread_mutex_unlock(&g_mdb_lock);
+            return -ENOMEM;
+        }
+    }
+    if (on && !g_started)
+        err = mdb_start();
+    if (err == 0)
+    {
+        snoop_vlan_enable(g_snoop, vid, on);
+        mdb_flush();
+    }
+    pthread_mutex_unlock(&g_mdb_lock);
+    return err;
+}
+
+int br_mdb_vlan_enabled(uint16_t vid)
+{
+    int on;
+
+    pthread_mutex_lock(&g_mdb_lock);
+    on = g_snoop && snoop_vlan_enabled(g_snoop, vid);
+    pthread_mutex_unlock(&g_mdb_lock);
+    return on;
+}
+
+/**
+ * br_mdb_walk() - Pass the router ports and group memberships learned on
+ * the kernel bridges to @p fn (see snoop_walk()); ports are ifindexes.
+ *
+ * @return the number of entries.
+ */
+int br_mdb_walk(snoop_walk_fn fn, void *arg)
+{
+    int n = 0;
+
+    pthread_mutex_lock(&g_mdb_lock);
+    if (g_snoop)
+        n = snoop_walk(g_snoop, now_ms(), fn, arg);
+    pthread_mutex_unlock(&g_mdb_lock);
+    return n;
+}
+
+/**
+ * br_mdb_get_stats() - Message and table counters of the kernel snooper.
+ *
+ * @return 0, or -ENODEV if no VLAN was ever snooped.
+ */
+int br_mdb_get_stats(struct snoop_stats *st)
+{
+    int err = -ENODEV;
+
+    pthread_mutex_lock(&g_mdb_lock);
+    if (g_snoop)
+    {
+        snoop_get_stats(g_snoop, st);
+        err = 0;
+    }
+    pthread_mutex_unlock(&g_mdb_lock);
+    return err;
+}
+
+/**
+ * br_mdb_shutdown() - Stop the thread and delete every MDB entry it
+ * programmed.  Must run before vlan_state_shutdown().
+ */
+void br_mdb_shutdown(void)
+{
+    unsigned vid;
+
+    if (g_started)
+    {
+        atomic_store(&g_stop, 1);
+        pthread_join(g_thread, NULL);
+        close(g_fd);
+        g_fd = -1;
+        g_started = 0;
+    }
+
+    pthread_mutex_lock(&g_mdb_lock);
+    if (g_snoop)
+    {
+        for (vid = 1; vid <= 4094; vid++)
+        {
+            if (snoop_vlan_enabled(g_snoop, (uint16_t)vid))
+                snoop_vlan_enable(g_snoop, (uint16_t)vid, 0);
+        }
+        mdb_flush();
+        snoop_destroy(g_snoop);
+        nl_batch_free(g_batch);
+        g_snoop = NULL;
+        g_batch = NULL;
+    }
+    pthread_mutex_unlock(&g_mdb_lock);
+}
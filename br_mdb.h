@@ -0,0 +1,34 @@
+/**
+ * @file br_mdb.h
+ * @brief IGMP / MLD snooping on the kernel bridge backend, programmed as
+ *        bridge MDB entries.
+ *
+ * Without the user-space forwarding plane the Vlan<id> bridges forward in
+ * the kernel.  A snooping thread then receives the IGMP and MLD messages
+ * arriving on every bridge port through one packet socket with a classic
+ * BPF filter, feeds them to a snoop.h snooper keyed by port ifindex, and
+ * turns its joins and prunes into permanent MDB entries of the port's
+ * Vlan<id> bridge: RTM_NEWMDB / RTM_DELMDB requests queued on an
+ * nl_batch.h batch and sent together once per pass of the thread, so a
+ * burst of reports or a mass expiry costs one round trip.  The bridges'
+ * own multicast snooping must stay on (the kernel default) for the
+ * entries to take effect; the kernel keeps tracking router ports itself.
+ * The kernel refuses MDB entries on a bridge that is down; such joins are
+ * logged and stay unprogrammed until the membership expires and is learned
+ * again, so bring the bridges up before turning snooping on.
+ */
+
+#ifndef BR_MDB_H
+#define BR_MDB_H
+
+#include <stdint.h>
+
+#include "snoop.h"
+
+int  br_mdb_vlan(uint16_t vid, int on);
+int  br_mdb_vlan_enabled(uint16_t vid);
+int  br_mdb_walk(snoop_walk_fn fn, void *arg);
+int  br_mdb_get_stats(struct snoop_stats *st);
+void br_mdb_shutdown(void);
+
+#endif /* BR_MDB_H */
@@ -0,0 +1,399 @@
+/**
+ * @file cfg_load.c
+ * @brief Streaming configuration loader that turns VLAN commands into
+ *        Netlink batches.
+ *
+ * The file is mmap()ed and scanned line by line with memchr(); tokens are
+ * (pointer, length) pairs into the mapping, so the only copies made are the
+ * interface names handed to the batch and the lines given to the fallback
+ * handler.  Queued VLAN operations remember their line number so that kernel
+ * errors reported at commit time can still be attributed to a line.
+ *
+ * Ordering: queued operations are committed before any fallback command or
+ * nested "exec" runs, and vlan_batch_*() asks for a commit (-EAGAIN) before an
+ * operation that depends on a queued create/delete.  The net effect is the
+ * same as executing the file one line at a time.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <linux/if.h>
+
+#include "cfg_load.h"
+#include "vlan_api.h"
+
+#define CFG_MAX_TOKENS 8
+
+struct cfg_token
+{
+    const char *p;
+    size_t      len;
+};
+
+/* A queued VLAN operation awaiting its commit result. */
+struct cfg_pending
+{
+    unsigned    line;
+    int         status;
+};
+
+struct cfg_ctx
+{
+    struct vlan_batch  *batch;
+    cfg_fallback_fn     fallback;
+    struct cfg_stats   *stats;
+    const char         *path;      /* file the pending ops came from */
+    struct cfg_pending  pending[CFG_BATCH_OPS];
+    size_t              npending;
+};
+
+static int cfg_run_file(struct cfg_ctx *ctx, const char *path, int depth);
+
+/* ---------------------------------------------------------------------------
+ * Helpers
+ * --------------------------------------------------------------------------- */
+
+static void cfg_error(struct cfg_ctx *ctx, const char *path, unsigned line,
+                      const char *fmt, const char *arg)
+{
+    fprintf(stderr, "%s:%u: ", path, line);
+    fprintf(stderr, fmt, arg);
+    fputc('\n', stderr);
+
+    ctx->stats->errors++;
+    if (ctx->stats->first_error == 0)
+        ctx->stats->first_error = line;
+}
+
+static int tok_is(const struct cfg_token *t, const char *word)
+{
+    size_t n = strlen(word);
+
+    return t->len == n && memcmp(t->p, word, n) == 0;
+}
+
+/* Strict decimal VLAN ID; returns -1 for anything that is not 0..65535. */
+static int tok_vid(const struct cfg_token *t)
+{
+    unsigned v = 0;
+    size_t i;
+
+    if (t->len == 0 || t->len > 5)
+        return -1;
+    for (i = 0; i < t->len; i++)
+    {
+        if (t->p[i] < '0' || t->p[i] > '9')
+            return -1;
+        v = v * 10 + (unsigned)(t->p[i] - '0');
+    }
+    return v > 0xFFFF ? -1 : (int)v;
+}
+
+static int tokenize(const char *p, size_t len, struct cfg_token *tok)
+{
+    size_t i = 0;
+    int n = 0;
+
+    while (i < len)
+    {
+        while (i < len && (p[i] == ' ' || p[i] == '\t'))
+            i++;
+        if (i == len)
+            break;
+        if (n == CFG_MAX_TOKENS)
+            return CFG_MAX_TOKENS + 1;
+        tok[n].p = p + i;
+        while (i < len && p[i] != ' ' && p[i] != '\t')
+            i++;
+        tok[n].len = (size_t)(p + i - tok[n].p);
+        n++;
+    }
+    return n;
+}
+
+/*
+ * cfg_flush() - Commit the queued VLAN operations and report failures.
+ */
+static void cfg_flush(struct cfg_ctx *ctx)
+{
+    size_t i;
+
+    if (ctx->npending == 0)
+        return;
+
+    vlan_batch_commit(ctx->batch);
+    ctx->stats->transactions++;
+    ctx->stats->batched += ctx->npending;
+
+    for (i = 0; i < ctx->npending; i++)
+    {
+        if (ctx->pending[i].status < 0)
+            cfg_error(ctx, ctx->path, ctx->pending[i].line,
+                      "%s", strerror(-ctx->pending[i].status));
+    }
+    ctx->npending = 0;
+}
+
+/*
+ * cfg_queue() - Queue one VLAN operation, committing first when required.
+ *
+ * Return value: 1 if the line was recognised as a batchable command,
+ *               0 if it must go to the fallback handler (LAG members too)
+ */
+static int cfg_queue(struct cfg_ctx *ctx, const char *path, unsigned line,
+                     const struct cfg_token *tok, int ntok)
+{
+    char iface[IFNAMSIZ];
+    int member;
+    int vid;
+    int err;
+
+    if (ntok == 3 && tok_is(&tok[1], "vlan") &&
+        (tok_is(&tok[0], "create") || tok_is(&tok[0], "delete")))
+        member = 0;
+    else if (ntok == 5 && tok_is(&tok[1], "vlan") &&
+             ((tok_is(&tok[0], "add") && tok_is(&tok[3], "to")) ||
+              (tok_is(&tok[0], "remove") && tok_is(&tok[3], "from"))))
+        member = 1;
+    else
+        return 0;
+
+    vid = tok_vid(&tok[2]);
+    if (vid < 0)
+    {
+        cfg_error(ctx, path, line, "invalid VLAN ID", NULL);
+        return 1;
+    }
+
+    if (member)
+    {
+        if (tok[4].len >= IFNAMSIZ)
+        {
+            cfg_error(ctx, path, line, "interface name too long", NULL);
+            return 1;
+        }
+        memcpy(iface, tok[4].p, tok[4].len);
+        iface[tok[4].len] = '\0';
+
+        /* A LAG stands for its member ports: vlan_assign() via the handler. */
+        if (vlan_lag_members(iface, NULL, 0) >= 0)
+            return 0;
+    }
+
+    if (ctx->npending == CFG_BATCH_OPS)
+        cfg_flush(ctx);
+    ctx->path = path;
+
+    for (;;)
+    {
+        int *status = &ctx->pending[ctx->npending].status;
+
+        if (!member && tok[0].p[0] == 'c')
+            err = vlan_batch_create(ctx->batch, (uint16_t)vid, status);
+        else if (!member)
+            err = vlan_batch_delete(ctx->batch, (uint16_t)vid, status);
+        else if (tok[0].p[0] == 'a')
+            err = vlan_batch_add_member(ctx->batch, (uint16_t)vid, iface, status);
+        else
+            err = vlan_batch_remove_member(ctx->batch, (uint16_t)vid, iface, status);
+
+        if (err != -EAGAIN || ctx->npending == 0)
+            break;
+        cfg_flush(ctx);
+    }
+
+    if (err < 0)
+    {
+        cfg_error(ctx, path, line, "%s", strerror(-err));
+        return 1;
+    }
+
+    ctx->pending[ctx->npending++].line = line;
+    return 1;
+}
+
+/*
+ * cfg_line() - Handle one trimmed, non-empty, non-comment line.
+ */
+static void cfg_line(struct cfg_ctx *ctx, const char *path, unsigned line,
+                     const char *p, size_t len, int depth)
+{
+    struct cfg_token tok[CFG_MAX_TOKENS];
+    char buf[CFG_MAX_LINE + 1];
+    int ntok;
+
+    ctx->stats->commands++;
+
+    ntok = tokenize(p, len, tok);
+    if (ntok <= CFG_MAX_TOKENS && cfg_queue(ctx, path, line, tok, ntok))
+        return;
+
+    /* Everything below runs strictly after the queued operations. */
+    cfg_flush(ctx);
+
+    if (len > CFG_MAX_LINE)
+    {
+        cfg_error(ctx, path, line, "line too long", NULL);
+        return;
+    }
+    memcpy(buf, p, len);
+    buf[len] = '\0';
+
+    if (ntok == 2 && tok_is(&tok[0], "exec"))
+    {
+        if (depth + 1 >= CFG_MAX_DEPTH)
+        {
+            cfg_error(ctx, path, line, "exec nested too deeply", NULL);
+            return;
+        }
+        if (cfg_run_file(ctx, buf + (tok[1].p - p), depth + 1) < 0)
+            cfg_error(ctx, path, line, "cannot exec '%s'", buf + (tok[1].p - p));
+        return;
+    }
+
+    if (!ctx->fallback)
+    {
+        cfg_error(ctx, path, line, "unsupported command: %s", buf);
+        return;
+    }
+    ctx->stats->fallback++;
+    ctx->fallback(buf);
+}
+
+/*
+ * cfg_run_file() - Map and execute one file; nested "exec" recurses here.
+ *
+ * Return value: 0, or -errno if the file cannot be opened or mapped
+ */
+static int cfg_run_file(struct cfg_ctx *ctx, const char *path, int depth)
+{
+    struct stat st;
+    const char *map;
+    const char *p;
+    const char *end;
+    unsigned line = 0;
+    int fd;
+    int err;
+
+    fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+    {
+        err = -errno;
+        fprintf(stderr, "cfg_exec: cannot open %s: %s\n", path, strerror(errno));
+        return err;
+    }
+
+    if (fstat(fd, &st) < 0)
+    {
+        err = -errno;
+        close(fd);
+        return err;
+    }
+
+    if (st.st_size == 0)
+    {
+        close(fd);
+        return 0;
+    }
+
+    map = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED)
+    {
+        err = -errno;
+        fprintf(stderr, "cfg_exec: cannot map %s: %s\n", path, strerror(errno));
+        return err;
+    }
+    madvise((void *)map, (size_t)st.st_size, MADV_SEQUENTIAL);
+
+    end = map + st.st_size;
+    for (p = map; p < end; )
+    {
+        const char *nl = memchr(p, '\n', (size_t)(end - p));
+        const char *eol = nl ? nl : end;
+        const char *s = p;
+        const char *e = eol;
+
+        line++;
+        p = nl ? nl + 1 : end;
+
+        while (s < e && (*s == ' ' || *s == '\t'))
+            s++;
+        while (e > s && (e[-1] == ' ' || e[-1] == '\t' || e[-1] == '\r'))
+            e--;
+        if (s == e || *s == '#' || *s == '!')
+            continue;
+
+        cfg_line(ctx, path, line, s, (size_t)(e - s), depth);
+    }
+    ctx->stats->lines += line;
+
+    cfg_flush(ctx);
+    munmap((void *)map, (size_t)st.st_size);
+    return 0;
+}
+
+/* ---------------------------------------------------------------------------
+ * Public API
+ * --------------------------------------------------------------------------- */
+
+/**
+ * cfg_exec() - Execute a configuration file.
+ *
+ * @param path      File to load.
+ * @param fallback  Handler for commands other than VLAN create / delete /
+ *                  add / remove; NULL reports them as errors.
+ * @param stats     Optional; receives the counters of this load.
+ *
+ * @return
+ *    0        – every line succeeded. \n
+ *   -EIO      – at least one line failed (see @p stats and stderr). \n
+ *   -ENOMEM   – the Netlink batch could not be allocated. \n
+ *   -errno    – the file could not be opened or mapped.
+ */
+int cfg_exec(const char *path, cfg_fallback_fn fallback, struct cfg_stats *stats)
+{
+    struct cfg_ctx *ctx;
+    struct cfg_stats local;
+    struct timespec t0, t1;
+    int err;
+
+    if (!stats)
+        stats = &local;
+    memset(stats, 0, sizeof(*stats));
+
+    ctx = calloc(1, sizeof(*ctx));
+    if (!ctx)
+        return -ENOMEM;
+
+    ctx->batch = vlan_batch_alloc();
+    if (!ctx->batch)
+    {
+        free(ctx);
+        return -ENOMEM;
+    }
+    ctx->fallback = fallback;
+    ctx->stats = stats;
+
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    err = cfg_run_file(ctx, path, 0);
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+
+    stats->elapsed_ms = (t1.tv_sec  - t0.tv_sec)  * 1000.0
+                      + (t1.tv_nsec - t0.tv_nsec) / 1.0e6;
+
+    vlan_batch_free(ctx->batch);
+    free(ctx);
+
+    if (err < 0)
+        return err;
+    return stats->errors ? -EIO : 0;
+}
@@ -0,0 +1,46 @@
+/**
+ * @file cfg_load.h
+ * @brief Bulk configuration loader ("exec <path>" and the startup config).
+ *
+ * A configuration file holds one text command per line, in the same grammar
+ * as the control socket.  Blank lines and lines starting with '#' or '!' are
+ * ignored.  The file is mapped read-only and parsed in a single pass without
+ * per-line allocation; VLAN create / delete / add / remove commands are
+ * collected into Netlink batches (vlan_batch_*), every other command is
+ * passed to a fallback handler in file order.  Errors are reported as
+ * "<path>:<line>: <message>" and do not stop the load.
+ *
+ * A file may "exec" another file, up to CFG_MAX_DEPTH levels deep.
+ */
+
+#ifndef CFG_LOAD_H
+#define CFG_LOAD_H
+
+#include <stddef.h>
+
+/** VLAN operations queued before a batch is committed. */
+#define CFG_BATCH_OPS  1024
+/** Longest accepted line, excluding the terminator. */
+#define CFG_MAX_LINE   1024
+/** Maximum nesting of "exec" inside configuration files. */
+#define CFG_MAX_DEPTH  4
+
+/** Handler for commands the loader does not batch itself. */
+typedef void (*cfg_fallback_fn)(const char *cmd);
+
+/** Outcome of one cfg_exec() call, nested files included. */
+struct cfg_stats
+{
+    size_t   lines;          /**< lines read */
+    size_t   commands;       /**< non-comment, non-blank lines */
+    size_t   batched;        /**< VLAN operations sent in batches */
+    size_t   fallback;       /**< commands passed to the fallback handler */
+    size_t   transactions;   /**< batch commits that reached the kernel */
+    size_t   errors;         /**< lines that failed */
+    unsigned first_error;    /**< line number of the first failure, or 0 */
+    double   elapsed_ms;     /**< wall-clock time of the whole load */
+};
+
+int cfg_exec(const char *path, cfg_fallback_fn fallback, struct cfg_stats *stats);
+
+#endif /* CFG_LOAD_H */
@@ -0,0 +1,401 @@
+/**
+ * @file cmd_sched.c
+ * @brief Keyed worker pool for control-plane commands.
+ *
+ * One FIFO queue per worker thread.  A job whose keys hash to several queues
+ * is linked into each of them under a single submission lock, so any two jobs
+ * appear in the same relative order on every queue they share.  The worker
+ * that reaches the job last runs it; the others block until it has finished.
+ * Because the relative order is global, the oldest unfinished job is always
+ * at the head of all its queues and the pool cannot deadlock.
+ */
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "cmd_sched.h"
+
+struct sched_job;
+
+/** Link of a job into one queue; a job owns one node per queue it is on. */
+struct sched_node
+{
+    struct sched_job  *job;
+    struct sched_node *next;
+};
+
+struct sched_job
+{
+    sched_fn        fn;
+    void           *arg;
+    unsigned        nqueues;   /**< Queues this job is linked into.        */
+    unsigned        arrived;   /**< Workers that have reached the job.     */
+    unsigned        refs;      /**< Workers still holding the job.         */
+    int             done;
+    pthread_mutex_t lock;
+    pthread_cond_t  cond;
+    struct sched_node nodes[]; /**< @c nqueues entries.                    */
+};
+
+struct sched_queue
+{
+    pthread_mutex_t    lock;
+    pthread_cond_t     cond;
+    struct sched_node *head;
+    struct sched_node *tail;
+    pthread_t          thread;
+    unsigned           index;
+    struct sched_queue_stats stats;
+};
+
+static struct sched_queue g_queues[SCHED_MAX_QUEUES];
+static unsigned           g_nqueues;
+static atomic_int         g_stopping;
+static unsigned           g_rr;                /* round-robin for keyless jobs */
+
+/* Serialises multi-queue enqueues and tracks jobs still outstanding. */
+static pthread_mutex_t    g_submit_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t     g_idle_cond   = PTHREAD_COND_INITIALIZER;
+static uint64_t           g_pending;
+
+/* ---------------------------------------------------------------------------
+ * Internal helpers
+ * --------------------------------------------------------------------------- */
+
+/** FNV-1a over a byte string; used for interface keys. */
+static uint32_t fnv1a(const char *s)
+{
+    uint32_t h = 2166136261u;
+
+    while (*s)
+    {
+        h ^= (uint8_t)*s++;
+        h *= 16777619u;
+    }
+    return h;
+}
+
+/** Map a key onto a queue index (murmur3 finaliser for good spread). */
+static unsigned key_to_queue(uint32_t key)
+{
+    key ^= key >> 16;
+    key *= 0x85ebca6bu;
+    key ^= key >> 13;
+    key *= 0xc2b2ae35u;
+    key ^= key >> 16;
+    return key % g_nqueues;
+}
+
+static void job_release(struct sched_job *job)
+{
+    int last;
+
+    pthread_mutex_lock(&job->lock);
+    last = (--job->refs == 0);
+    pthread_mutex_unlock(&job->lock);
+
+    if (last)
+    {
+        pthread_cond_destroy(&job->cond);
+        pthread_mutex_destroy(&job->lock);
+        free(job);
+
+        pthread_mutex_lock(&g_submit_lock);
+        if (--g_pending == 0)
+            pthread_cond_broadcast(&g_idle_cond);
+        pthread_mutex_unlock(&g_submit_lock);
+    }
+}
+
+/**
+ * run_job() - Called by each worker that pops @p job off its queue.
+ *
+ * The last worker to arrive executes the job; earlier arrivals wait so that
+ * their queues do not advance past it.
+ */
+static void run_job(struct sched_job *job)
+{
+    int runner;
+
+    pthread_mutex_lock(&job->lock);
+    runner = (++job->arrived == job->nqueues);
+    if (!runner)
+    {
+        while (!job->done)
+            pthread_cond_wait(&job->cond, &job->lock);
+    }
+    pthread_mutex_unlock(&job->lock);
+
+    if (runner)
+    {
+        job->fn(job->arg);
+
+        pthread_mutex_lock(&job->lock);
+        job->done = 1;
+        pthread_cond_broadcast(&job->cond);
+        pthread_mutex_unlock(&job->lock);
+    }
+}
+
+static void *worker_main(void *arg)
+{
+    struct sched_queue *q = arg;
+    struct sched_node  *node;
+    struct sched_job   *job;
+
+    for (;;)
+    {
+        pthread_mutex_lock(&q->lock);
+        while (!q->head && !g_stopping)
+            pthread_cond_wait(&q->cond, &q->lock);
+        if (!q->head)
+        {
+            pthread_mutex_unlock(&q->lock);
+            break;
+        }
+        node = q->head;
+        q->head = node->next;
+        if (!q->head)
+            q->tail = NULL;
+        pthread_mutex_unlock(&q->lock);
+
+        job = node->job;
+        run_job(job);
+
+        pthread_mutex_lock(&q->lock);
+        q->stats.depth--;
+        q->stats.completed++;
+        pthread_mutex_unlock(&q->lock);
+
+        /* Last, so that sched_drain() only returns once stats are final. */
+        job_release(job);
+    }
+    return NULL;
+}
+
+/* ---------------------------------------------------------------------------
+ * Public API
+ * --------------------------------------------------------------------------- */
+
+/**
+ * sched_init() - Start the worker pool.
+ *
+ * @param nworkers  Number of worker threads / queues (clamped to
+ *                  [1..SCHED_MAX_QUEUES]).
+ *
+ * @return
+ *    0        – success. \n
+ *   -EALREADY – The pool is already running. \n
+ *   -EAGAIN   – A worker thread could not be created.
+ */
+int sched_init(unsigned nworkers)
+{
+    unsigned i;
+
+    if (g_nqueues)
+        return -EALREADY;
+
+    if (nworkers < 1)
+        nworkers = 1;
+    if (nworkers > SCHED_MAX_QUEUES)
+        nworkers = SCHED_MAX_QUEUES;
+
+    g_stopping = 0;
+    g_pending  = 0;
+    g_rr       = 0;
+    g_nqueues  = nworkers;
+
+    for (i = 0; i < nworkers; i++)
+    {
+        struct sched_queue *q = &g_queues[i];
+
+        memset(q, 0, sizeof(*q));
+        q->index = i;
+        pthread_mutex_init(&q->lock, NULL);
+        pthread_cond_init(&q->cond, NULL);
+
+        if (pthread_create(&q->thread, NULL, worker_main, q) != 0)
+        {
+            fprintf(stderr, "sched_init: failed to start worker %u\n", i);
+            g_nqueues = i;
+            sched_shutdown();
+            return -EAGAIN;
+        }
+    }
+
+    printf("Command scheduler started with %u worker(s)\n", nworkers);
+    return 0;
+}
+
+/**
+ * sched_shutdown() - Run every queued job to completion and stop the workers.
+ */
+void sched_shutdown(void)
+{
+    unsigned i;
+
+    atomic_store(&g_stopping, 1);
+
+    for (i = 0; i < g_nqueues; i++)
+    {
+        pthread_mutex_lock(&g_queues[i].lock);
+        pthread_cond_signal(&g_queues[i].cond);
+        pthread_mutex_unlock(&g_queues[i].lock);
+    }
+
+    for (i = 0; i < g_nqueues; i++)
+    {
+        pthread_join(g_queues[i].thread, NULL);
+        pthread_cond_destroy(&g_queues[i].cond);
+        pthread_mutex_destroy(&g_queues[i].lock);
+    }
+
+    g_nqueues = 0;
+}
+
+/**
+ * sched_submit() - Queue @p fn(@p arg) for execution on the worker pool.
+ *
+ * @param keys   Ordering keys (VLAN / interface / SCHED_KEY_ALL).  Jobs with
+ *               a common key run in submission order.  May be NULL if
+ *               @p nkeys is 0, in which case the job is unordered and is
+ *               spread round-robin (use this for read-only commands).
+ * @param nkeys  Number of entries in @p keys (0..SCHED_MAX_KEYS).
+ * @param fn     Job body; runs on a worker thread.
+ * @param arg    Opaque argument passed to @p fn.
+ *
+ * @return
+ *    0        – success; @p fn will run exactly once. \n
+ *   -EINVAL   – @p fn is NULL or @p nkeys is out of range. \n
+ *   -ESHUTDOWN – The pool is not running. \n
+ *   -ENOMEM   – Failed to allocate the job.
+ */
+int sched_submit(const uint32_t *keys, int nkeys, sched_fn fn, void *arg)
+{
+    uint64_t mask = 0;
+    struct sched_job *job;
+    unsigned nq;
+    unsigned i;
+    unsigned n;
+    int k;
+
+    if (!fn || nkeys < 0 || nkeys > SCHED_MAX_KEYS || (nkeys && !keys))
+        return -EINVAL;
+
+    if (!g_nqueues || g_stopping)
+        return -ESHUTDOWN;
+
+    for (k = 0; k < nkeys; k++)
+    {
+        if (keys[k] == SCHED_KEY_ALL)
+        {
+            mask = (g_nqueues == 64) ? ~0ULL : ((1ULL << g_nqueues) - 1);
+            break;
+        }
+        mask |= 1ULL << key_to_queue(keys[k]);
+    }
+
+    nq = mask ? (unsigned)__builtin_popcountll(mask) : 1;
+
+    job = calloc(1, sizeof(*job) + nq * sizeof(struct sched_node));
+    if (!job)
+        return -ENOMEM;
+
+    job->fn      = fn;
+    job->arg     = arg;
+    job->nqueues = nq;
+    job->refs    = nq;
+    pthread_mutex_init(&job->lock, NULL);
+    pthread_cond_init(&job->cond, NULL);
+
+    pthread_mutex_lock(&g_submit_lock);
+
+    if (!mask)
+        mask = 1ULL << (g_rr++ % g_nqueues);
+
+    g_pending++;
+
+    /* Ascending queue order under g_submit_lock keeps relative order global. */
+    for (i = 0, n = 0; i < g_nqueues; i++)
+    {
+        struct sched_queue *q;
+        struct sched_node *node;
+
+        if (!(mask & (1ULL << i)))
+            continue;
+
+        q = &g_queues[i];
+        node = &job->nodes[n++];
+        node->job  = job;
+        node->next = NULL;
+
+        pthread_mutex_lock(&q->lock);
+        if (q->tail)
+            q->tail->next = node;
+        else
+            q->head = node;
+        q->tail = node;
+        q->stats.submitted++;
+        if (++q->stats.depth > q->stats.max_depth)
+            q->stats.max_depth = q->stats.depth;
+        pthread_cond_signal(&q->cond);
+        pthread_mutex_unlock(&q->lock);
+    }
+
+    pthread_mutex_unlock(&g_submit_lock);
+    return 0;
+}
+
+/**
+ * sched_drain() - Block until every job submitted so far has finished.
+ */
+void sched_drain(void)
+{
+    pthread_mutex_lock(&g_submit_lock);
+    while (g_pending > 0)
+        pthread_cond_wait(&g_idle_cond, &g_submit_lock);
+    pthread_mutex_unlock(&g_submit_lock);
+}
+
+/**
+ * sched_queue_count() - Number of worker queues (0 if the pool is stopped).
+ */
+unsigned sched_queue_count(void)
+{
+    return g_nqueues;
+}
+
+/**
+ * sched_get_stats() - Snapshot the counters of one worker queue.
+ *
+ * @return 0 on success, -EINVAL if @p queue is out of range or @p out is NULL.
+ */
+int sched_get_stats(unsigned queue, struct sched_queue_stats *out)
+{
+    if (queue >= g_nqueues || !out)
+        return -EINVAL;
+
+    pthread_mutex_lock(&g_queues[queue].lock);
+    *out = g_queues[queue].stats;
+    pthread_mutex_unlock(&g_queues[queue].lock);
+    return 0;
+}
+
+/** Ordering key for commands that touch VLAN @p vlan_id. */
+uint32_t sched_key_vlan(uint16_t vlan_id)
+{
+    return (uint32_t)vlan_id;
+}
+
+/** Ordering key for commands that touch interface @p iface. */
+uint32_t sched_key_iface(const char *iface)
+{
+    /* Keep interface keys disjoint from the 1..4094 VLAN key space. */
+    uint32_t h = fnv1a(iface ? iface : "") | 0x10000u;
+
+    return (h == SCHED_KEY_ALL) ? (h - 1) : h;
+}
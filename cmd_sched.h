@@ -0,0 +1,49 @@
+/**
+ * @file cmd_sched.h
+ * @brief Keyed worker pool that executes control-plane commands concurrently
+ *        while preserving submission order per VLAN / interface.
+ *
+ * Every job is submitted with a small set of 32-bit keys (see sched_key_vlan()
+ * and sched_key_iface()).  Each key hashes to one of the worker queues; a job
+ * is appended to every queue its keys map to and runs once it has reached the
+ * head of all of them.  Jobs sharing a key therefore execute in submission
+ * order, while jobs on disjoint keys run in parallel on different workers.
+ * SCHED_KEY_ALL serialises a job against everything queued before it.
+ */
+
+#ifndef CMD_SCHED_H
+#define CMD_SCHED_H
+
+#include <stdint.h>
+
+/** Upper bound on the number of worker threads / queues. */
+#define SCHED_MAX_QUEUES 64
+
+/** Maximum number of keys a single job may carry. */
+#define SCHED_MAX_KEYS   4
+
+/** Key that conflicts with every queue (e.g. "rename interfaces"). */
+#define SCHED_KEY_ALL    0xFFFFFFFFu
+
+typedef void (*sched_fn)(void *arg);
+
+/** Per-queue counters reported by "show scheduler". */
+struct sched_queue_stats
+{
+    uint64_t submitted;   /**< Jobs ever appended to this queue.            */
+    uint64_t completed;   /**< Jobs that finished and left this queue.      */
+    uint32_t depth;       /**< Jobs currently queued or running.            */
+    uint32_t max_depth;   /**< High-water mark of @c depth.                 */
+};
+
+int      sched_init(unsigned nworkers);
+void     sched_shutdown(void);
+int      sched_submit(const uint32_t *keys, int nkeys, sched_fn fn, void *arg);
+void     sched_drain(void);
+unsigned sched_queue_count(void);
+int      sched_get_stats(unsigned queue, struct sched_queue_stats *out);
+
+uint32_t sched_key_vlan(uint16_t vlan_id);
+uint32_t sched_key_iface(const char *iface);
+
+#endif /* CMD_SCHED_H */
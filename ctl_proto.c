@@ -0,0 +1,589 @@
+/**
+ * @file ctl_proto.c
+ * @brief Binary control protocol: frame codec and batched execution.
+ *
+ * vbp_execute() turns a decoded batch into one scheduler job per operation.
+ * A bitmap operation queues all of its VIDs into one vlan_batch and commits
+ * them together, so a 4094-VID bitmap costs one Netlink round trip rather
+ * than 4094 jobs.  Jobs are keyed like their text equivalents (a bitmap that
+ * names more VLANs than a job can carry keys is serialised against
+ * everything), so binary and text commands on the same VLAN or interface
+ * stay ordered with respect to each other.  The job that completes last
+ * writes the status vector back to the client.
+ *
+ * Replies are serialized per connection and never wait for the client: a
+ * reply that does not fit into the socket's send buffer shuts the connection
+ * down, so a client that stops reading cannot stall the scheduler workers.
+ */
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+
+#include "ctl_proto.h"
+#include "cmd_sched.h"
+#include "vlan_api.h"
+
+/** One binary client connection, shared by its in-flight batches. */
+struct vbp_conn
+{
+    int             fd;       /**< dup() of the client socket.            */
+    pthread_mutex_t lock;     /**< Keeps the replies of batches whole.    */
+    int             dead;     /**< A reply was dropped; send no more.     */
+    atomic_int      refs;
+};
+
+/** Shared by all sub-jobs of one request frame. */
+struct vbp_batch
+{
+    struct vbp_conn *conn;
+    uint32_t    seq;
+    uint32_t    count;
+    atomic_int  pending;      /**< Outstanding sub-jobs (+1 while queuing). */
+    atomic_int  status[];     /**< First error per operation, 0 if none.  */
+};
+
+struct vbp_job
+{
+    struct vbp_batch *batch;
+    uint32_t          index;  /**< Operation this job belongs to.         */
+    uint8_t           opcode;
+    uint16_t          vid;    /**< Scalar opcodes only.                   */
+    char              iface[IFNAMSIZ];
+    uint8_t           bitmap[];  /**< VBP_BITMAP_LEN bytes, bitmap opcodes. */
+};
+
+/* ---------------------------------------------------------------------------
+ * Codec
+ * --------------------------------------------------------------------------- */
+
+static uint16_t get_u16(const uint8_t *p)
+{
+    return (uint16_t)((p[0] << 8) | p[1]);
+}
+
+static uint32_t get_u32(const uint8_t *p)
+{
+    return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) |
+           ((uint32_t)p[2] << 8)  |  (uint32_t)p[3];
+}
+
+static void put_u16(uint8_t *p, uint16_t v)
+{
+    p[0] = (uint8_t)(v >> 8);
+    p[1] = (uint8_t)v;
+}
+
+static void put_u32(uint8_t *p, uint32_t v)
+{
+    p[0] = (uint8_t)(v >> 24);
+    p[1] = (uint8_t)(v >> 16);
+    p[2] = (uint8_t)(v >> 8);
+    p[3] = (uint8_t)v;
+}
+
+static int opcode_has_bitmap(uint8_t op)
+{
+    return op >= VBP_OP_CREATE_VLAN_BITMAP && op <= VBP_OP_REMOVE_MEMBER_BITMAP;
+}
+
+static int bitmap_has(const uint8_t *bitmap, unsigned vid)
+{
+    return (bitmap[vid / 8] >> (vid % 8)) & 1;
+}
+
+static unsigned bitmap_weight(const uint8_t *bitmap)
+{
+    unsigned n = 0;
+    unsigned i;
+
+    for (i = 0; i < VBP_BITMAP_LEN; i++)
+        n += (unsigned)__builtin_popcount(bitmap[i]);
+    return n;
+}
+
+static int opcode_has_iface(uint8_t op)
+{
+    return op == VBP_OP_ADD_MEMBER || op == VBP_OP_REMOVE_MEMBER ||
+           op == VBP_OP_ADD_MEMBER_BITMAP || op == VBP_OP_REMOVE_MEMBER_BITMAP;
+}
+
+/**
+ * decode_op() - Validate one TLV value and fill @p op.
+ *
+ * @return 0 on success, -EPROTO if the value does not match the opcode.
+ */
+static int decode_op(uint8_t opcode, const uint8_t *val, uint16_t len,
+                     struct vbp_op *op)
+{
+    size_t fixed;
+    size_t name_len;
+
+    if (opcode < VBP_OP_CREATE_VLAN || opcode > VBP_OP_REMOVE_MEMBER_BITMAP)
+        return -EPROTO;
+
+    fixed = opcode_has_bitmap(opcode) ? VBP_BITMAP_LEN : 2;
+    if (len < fixed)
+        return -EPROTO;
+    name_len = len - fixed;
+
+    if (opcode_has_iface(opcode) ? (name_len < 1 || name_len >= IFNAMSIZ)
+                                 : (name_len != 0))
+        return -EPROTO;
+
+    memset(op, 0, sizeof(*op));
+    op->opcode = opcode;
+    if (opcode_has_bitmap(opcode))
+        op->bitmap = val;
+    else
+        op->vid = get_u16(val);
+
+    memcpy(op->iface, val + fixed, name_len);
+    if (memchr(op->iface, '\0', name_len))
+        return -EPROTO;
+    return 0;
+}
+
+/**
+ * vbp_parse_frame() - Decode one request frame from the start of @p buf.
+ *
+ * @param buf  Received bytes; bitmap pointers in @p out refer into it.
+ * @param len  Number of valid bytes in @p buf.
+ * @param out  Decoded frame; release with vbp_frame_free().
+ *
+ * @return
+ *   >0        – size of the frame consumed from @p buf. \n
+ *    0        – @p buf does not yet hold a complete frame. \n
+ *   -EPROTO   – Malformed frame; the connection should be dropped. \n
+ *   -E2BIG    – The frame names more than VBP_MAX_EXPANDED VIDs; drop the
+ *               connection as well. \n
+ *   -ENOMEM   – Failed to allocate the operation array.
+ */
+int vbp_parse_frame(const uint8_t *buf, size_t len, struct vbp_frame *out)
+{
+    const uint8_t *p;
+    const uint8_t *end;
+    uint32_t count;
+    uint32_t length;
+    uint32_t expanded = 0;
+    uint32_t i;
+
+    memset(out, 0, sizeof(*out));
+
+    if (len < 1)
+        return 0;
+    if (buf[0] != VBP_MAGIC)
+        return -EPROTO;
+    if (len < VBP_HDR_LEN)
+        return 0;
+
+    count  = get_u32(buf + 8);
+    length = get_u32(buf + 12);
+
+    if (buf[1] != VBP_VERSION || get_u16(buf + 2) != 0 ||
+        length > VBP_MAX_PAYLOAD || count > VBP_MAX_OPS)
+        return -EPROTO;
+
+    if (len < VBP_HDR_LEN + (size_t)length)
+        return 0;
+
+    out->seq   = get_u32(buf + 4);
+    out->count = count;
+    out->ops   = calloc(count ? count : 1, sizeof(struct vbp_op));
+    if (!out->ops)
+        return -ENOMEM;
+
+    p   = buf + VBP_HDR_LEN;
+    end = p + length;
+
+    for (i = 0; i < count; i++)
+    {
+        uint16_t vlen;
+
+        if (end - p < VBP_TLV_HDR_LEN)
+            goto bad;
+        vlen = get_u16(p + 2);
+        if (end - p - VBP_TLV_HDR_LEN < vlen ||
+            decode_op(p[0], p + VBP_TLV_HDR_LEN, vlen, &out->ops[i]) < 0)
+            goto bad;
+        p += VBP_TLV_HDR_LEN + vlen;
+
+        expanded += out->ops[i].bitmap ? bitmap_weight(out->ops[i].bitmap) : 1;
+        if (expanded > VBP_MAX_EXPANDED)
+        {
+            vbp_frame_free(out);
+            return -E2BIG;
+        }
+    }
+
+    if (p != end)
+        goto bad;
+
+    return (int)(VBP_HDR_LEN + length);
+
+bad:
+    vbp_frame_free(out);
+    return -EPROTO;
+}
+
+void vbp_frame_free(struct vbp_frame *frame)
+{
+    free(frame->ops);
+    frame->ops = NULL;
+    frame->count = 0;
+}
+
+/**
+ * vbp_put_header() - Encode a frame header into @p buf (VBP_HDR_LEN bytes).
+ *
+ * @return Number of bytes written.
+ */
+size_t vbp_put_header(uint8_t *buf, uint16_t flags, uint32_t seq,
+                      uint32_t count, uint32_t length)
+{
+    buf[0] = VBP_MAGIC;
+    buf[1] = VBP_VERSION;
+    put_u16(buf + 2, flags);
+    put_u32(buf + 4, seq);
+    put_u32(buf + 8, count);
+    put_u32(buf + 12, length);
+    return VBP_HDR_LEN;
+}
+
+/**
+ * vbp_put_op() - Encode one operation TLV into @p buf.
+ *
+ * @param vid     VLAN ID for scalar opcodes (ignored for bitmap opcodes).
+ * @param bitmap  VBP_BITMAP_LEN-byte bitmap for bitmap opcodes, else NULL.
+ * @param iface   Interface name for member opcodes, else NULL.
+ *
+ * @return Number of bytes written.
+ */
+size_t vbp_put_op(uint8_t *buf, uint8_t opcode, uint16_t vid,
+                  const uint8_t *bitmap, const char *iface)
+{
+    size_t name_len = (iface && opcode_has_iface(opcode)) ? strnlen(iface, IFNAMSIZ - 1) : 0;
+    size_t off = VBP_TLV_HDR_LEN;
+
+    buf[0] = opcode;
+    buf[1] = 0;
+
+    if (opcode_has_bitmap(opcode))
+    {
+        memcpy(buf + off, bitmap, VBP_BITMAP_LEN);
+        off += VBP_BITMAP_LEN;
+    }
+    else
+    {
+        put_u16(buf + off, vid);
+        off += 2;
+    }
+
+    memcpy(buf + off, iface, name_len);
+    off += name_len;
+
+    put_u16(buf + 2, (uint16_t)(off - VBP_TLV_HDR_LEN));
+    return off;
+}
+
+/* ---------------------------------------------------------------------------
+ * Execution
+ * --------------------------------------------------------------------------- */
+
+/**
+ * vbp_conn_new() - Start a binary protocol connection on @p fd.
+ *
+ * @return The connection (release with vbp_conn_put()), or NULL with errno
+ *         set if memory or a file descriptor is not available.
+ */
+struct vbp_conn *vbp_conn_new(int fd)
+{
+    struct vbp_conn *conn = calloc(1, sizeof(*conn));
+
+    if (!conn)
+        return NULL;
+    conn->fd = dup(fd);
+    if (conn->fd < 0)
+    {
+        free(conn);
+        return NULL;
+    }
+    pthread_mutex_init(&conn->lock, NULL);
+    atomic_store(&conn->refs, 1);
+    return conn;
+}
+
+/** vbp_conn_put() - Drop a reference; the last one closes the socket. */
+void vbp_conn_put(struct vbp_conn *conn)
+{
+    if (conn && atomic_fetch_sub(&conn->refs, 1) == 1)
+    {
+        close(conn->fd);
+        pthread_mutex_destroy(&conn->lock);
+        free(conn);
+    }
+}
+
+/*
+ * Send a whole reply or nothing.  A partial reply would leave the byte
+ * stream out of step, so any shortfall shuts the connection down instead;
+ * the event loop then sees the hangup and closes it.
+ */
+static void conn_send(struct vbp_conn *conn, const uint8_t *buf, size_t len, uint32_t seq)
+{
+    ssize_t n;
+
+    pthread_mutex_lock(&conn->lock);
+    if (!conn->dead)
+    {
+        do
+            n = send(conn->fd, buf, len, MSG_DONTWAIT | MSG_NOSIGNAL);
+        while (n < 0 && errno == EINTR);
+
+        if (n != (ssize_t)len)
+        {
+            fprintf(stderr, "vbp: cannot send reply for seq %u (%s), dropping client\n",
+                    seq, n < 0 ? strerror(errno) : "send buffer full");
+            conn->dead = 1;
+            shutdown(conn->fd, SHUT_RDWR);
+        }
+    }
+    pthread_mutex_unlock(&conn->lock);
+}
+
+static void batch_reply(struct vbp_batch *b)
+{
+    size_t len = VBP_HDR_LEN + 2 * (size_t)b->count;
+    uint8_t *buf = malloc(len);
+    uint32_t i;
+
+    if (buf)
+    {
+        vbp_put_header(buf, VBP_F_REPLY, b->seq, b->count, 2 * b->count);
+        for (i = 0; i < b->count; i++)
+            put_u16(buf + VBP_HDR_LEN + 2 * i,
+                    (uint16_t)(int16_t)atomic_load(&b->status[i]));
+
+        conn_send(b->conn, buf, len, b->seq);
+        free(buf);
+    }
+    else
+    {
+        fprintf(stderr, "vbp: out of memory building reply for seq %u\n", b->seq);
+    }
+
+    vbp_conn_put(b->conn);
+    free(b);
+}
+
+static void batch_put(struct vbp_batch *b)
+{
+    if (atomic_fetch_sub(&b->pending, 1) == 1)
+        batch_reply(b);
+}
+
+static void job_done(struct vbp_job *j, int ret)
+{
+    int expected = 0;
+
+    if (ret < 0)
+        atomic_compare_exchange_strong(&j->batch->status[j->index], &expected, ret);
+
+    batch_put(j->batch);
+    free(j);
+}
+
+static void vbp_job_fn(void *arg)
+{
+    struct vbp_job *j = arg;
+    int ret;
+
+    switch (j->opcode)
+    {
+    case VBP_OP_CREATE_VLAN:
+        ret = create_vlan(j->vid);
+        break;
+    case VBP_OP_DELETE_VLAN:
+        ret = delete_vlan(j->vid);
+        break;
+    case VBP_OP_ADD_MEMBER:
+        ret = vlan_assign(j->vid, j->iface, 1);
+        break;
+    case VBP_OP_REMOVE_MEMBER:
+        ret = vlan_assign(j->vid, j->iface, 0);
+        break;
+    default:
+        ret = -EOPNOTSUPP;
+        break;
+    }
+
+    job_done(j, ret);
+}
+
+static int bitmap_queue(struct vlan_batch *vb, const struct vbp_job *j,
+                        uint16_t vid, int *status)
+{
+    switch (j->opcode)
+    {
+    case VBP_OP_CREATE_VLAN_BITMAP:
+        return vlan_batch_create(vb, vid, status);
+    case VBP_OP_DELETE_VLAN_BITMAP:
+        return vlan_batch_delete(vb, vid, status);
+    case VBP_OP_ADD_MEMBER_BITMAP:
+        return vlan_batch_add_member(vb, vid, j->iface, status);
+    default:
+        return vlan_batch_remove_member(vb, vid, j->iface, status);
+    }
+}
+
+/*
+ * Run a bitmap operation as one vlan_batch.  A LAG stands for its member
+ * ports, which only vlan_assign() expands, so LAG members go VID by VID.
+ */
+static void vbp_bitmap_job_fn(void *arg)
+{
+    struct vbp_job *j = arg;
+    int lag = j->iface[0] && vlan_lag_members(j->iface, NULL, 0) >= 0;
+    struct vlan_batch *vb = lag ? NULL : vlan_batch_alloc();
+    int *status = calloc(VBP_BITMAP_LEN * 8, sizeof(int));
+    unsigned vid;
+    int ret = 0;
+
+    if ((!lag && !vb) || !status)
+    {
+        vlan_batch_free(vb);
+        free(status);
+        job_done(j, -ENOMEM);
+        return;
+    }
+
+    for (vid = 0; vid < VBP_BITMAP_LEN * 8; vid++)
+    {
+        int err;
+
+        if (!bitmap_has(j->bitmap, vid))
+            continue;
+
+        if (lag)
+        {
+            status[vid] = vlan_assign((uint16_t)vid, j->iface,
+                                      j->opcode == VBP_OP_ADD_MEMBER_BITMAP);
+            continue;
+        }
+
+        err = bitmap_queue(vb, j, (uint16_t)vid, &status[vid]);
+        if (err == -EAGAIN)
+        {
+            vlan_batch_commit(vb);
+            err = bitmap_queue(vb, j, (uint16_t)vid, &status[vid]);
+        }
+        if (err < 0)
+            status[vid] = err;
+    }
+
+    vlan_batch_commit(vb);
+    vlan_batch_free(vb);
+
+    for (vid = 0; vid < VBP_BITMAP_LEN * 8 && ret == 0; vid++)
+        ret = status[vid];
+    free(status);
+    job_done(j, ret);
+}
+
+static void submit_one(struct vbp_batch *b, uint32_t index, const struct vbp_op *op)
+{
+    int bitmap = opcode_has_bitmap(op->opcode);
+    struct vbp_job *j = calloc(1, sizeof(*j) + (bitmap ? VBP_BITMAP_LEN : 0));
+    uint32_t keys[SCHED_MAX_KEYS];
+    int nkeys = 0;
+    int all = 0;
+    int expected = 0;
+    unsigned vid;
+
+    if (!j)
+    {
+        atomic_compare_exchange_strong(&b->status[index], &expected, -ENOMEM);
+        return;
+    }
+
+    j->batch  = b;
+    j->index  = index;
+    j->opcode = op->opcode;
+    j->vid    = op->vid;
+    snprintf(j->iface, sizeof(j->iface), "%s", op->iface);
+
+    /* One key per VLAN touched, plus the interface's; a bitmap naming more
+     * VLANs than fit, or a name that may be a LAG when the job runs (a LAG
+     * stands for all of its member ports), is serialised against everything. */
+    if (op->iface[0] && vlan_lag_maybe(op->iface))
+        all = 1;
+    else if (op->iface[0])
+        keys[nkeys++] = sched_key_iface(op->iface);
+
+    if (bitmap)
+        memcpy(j->bitmap, op->bitmap, VBP_BITMAP_LEN);
+    else
+        keys[nkeys++] = sched_key_vlan(op->vid);
+
+    for (vid = 0; bitmap && !all && vid < VBP_BITMAP_LEN * 8; vid++)
+    {
+        if (!bitmap_has(op->bitmap, vid))
+            continue;
+        if (nkeys == SCHED_MAX_KEYS)
+            all = 1;
+        else
+            keys[nkeys++] = sched_key_vlan((uint16_t)vid);
+    }
+
+    if (all)
+    {
+        keys[0] = SCHED_KEY_ALL;
+        nkeys = 1;
+    }
+
+    atomic_fetch_add(&b->pending, 1);
+    if (sched_submit(keys, nkeys, bitmap ? vbp_bitmap_job_fn : vbp_job_fn, j) < 0)
+        (bitmap ? vbp_bitmap_job_fn : vbp_job_fn)(j);
+}
+
+/**
+ * vbp_execute() - Run a decoded batch and reply on @p conn when it completes.
+ *
+ * The operations are copied into scheduler jobs before returning, so the
+ * caller may release @p frame and the receive buffer right away.
+ *
+ * @return 0 on success, -ENOMEM on failure (no reply is sent in that case).
+ */
+int vbp_execute(struct vbp_conn *conn, struct vbp_frame *frame)
+{
+    struct vbp_batch *b;
+    uint32_t i;
+
+    b = calloc(1, sizeof(*b) + frame->count * sizeof(atomic_int));
+    if (!b)
+        return -ENOMEM;
+
+    atomic_fetch_add(&conn->refs, 1);
+    b->conn  = conn;
+    b->seq   = frame->seq;
+    b->count = frame->count;
+    atomic_store(&b->pending, 1);   /* released after the loop below */
+
+    for (i = 0; i < frame->count; i++)
+    {
+        const struct vbp_op *op = &frame->ops[i];
+
+        /* An empty bitmap names nothing and succeeds as is. */
+        if (!op->bitmap || bitmap_weight(op->bitmap) > 0)
+            submit_one(b, i, op);
+    }
+
+    batch_put(b);
+    return 0;
+}
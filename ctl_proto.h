@@ -0,0 +1,102 @@
+/**
+ * @file ctl_proto.h
+ * @brief Compact binary control protocol ("VBP") for high-rate clients.
+ *
+ * A connection whose first byte is VBP_MAGIC speaks this protocol instead of
+ * the text command grammar; both are accepted on the same listeners.  Every
+ * message carries a batch of operations and is answered with one reply whose
+ * payload is a vector of per-operation status codes.
+ *
+ * All multi-byte fields are in network byte order.
+ *
+ *   Header (16 bytes)
+ *     u8  magic    VBP_MAGIC
+ *     u8  version  VBP_VERSION
+ *     u16 flags    0 in requests, VBP_F_REPLY in replies
+ *     u32 seq      chosen by the client, echoed in the reply
+ *     u32 count    number of operations (requests) or statuses (replies)
+ *     u32 length   payload bytes following the header
+ *
+ *   Operation TLV (requests)
+ *     u8  opcode   VBP_OP_*
+ *     u8  reserved 0
+ *     u16 len      value bytes that follow
+ *     ...          value, see the opcode table below
+ *
+ *   Reply payload
+ *     s16 status[count]   0 or a negative errno, one per operation
+ *
+ * Opcode values:
+ *   CREATE_VLAN / DELETE_VLAN         u16 vid
+ *   ADD_MEMBER / REMOVE_MEMBER        u16 vid, interface name (no NUL)
+ *   *_BITMAP variants                 VBP_BITMAP_LEN-byte VID bitmap (bit n of
+ *                                     byte n/8, LSB first), followed by the
+ *                                     interface name for the member variants
+ * A bitmap operation reports 0 if every VID succeeded, otherwise the error
+ * of the lowest VID that failed.  A frame whose operations name more than
+ * VBP_MAX_EXPANDED VIDs in total (every scalar operation counts as one, every
+ * bitmap as its set bits) is rejected.
+ */
+
+#ifndef CTL_PROTO_H
+#define CTL_PROTO_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <linux/if.h>
+
+#define VBP_MAGIC        0xB5
+#define VBP_VERSION      1
+#define VBP_F_REPLY      0x0001
+
+#define VBP_HDR_LEN      16
+#define VBP_TLV_HDR_LEN  4
+#define VBP_BITMAP_LEN   512                /* 4096 VIDs */
+#define VBP_MAX_PAYLOAD  (4u * 1024 * 1024)
+#define VBP_MAX_OPS      65536
+#define VBP_MAX_EXPANDED (4094u * 16)       /* VIDs named per frame */
+
+enum vbp_opcode
+{
+    VBP_OP_CREATE_VLAN          = 1,
+    VBP_OP_DELETE_VLAN          = 2,
+    VBP_OP_ADD_MEMBER           = 3,
+    VBP_OP_REMOVE_MEMBER        = 4,
+    VBP_OP_CREATE_VLAN_BITMAP   = 5,
+    VBP_OP_DELETE_VLAN_BITMAP   = 6,
+    VBP_OP_ADD_MEMBER_BITMAP    = 7,
+    VBP_OP_REMOVE_MEMBER_BITMAP = 8,
+};
+
+/** One decoded operation; @c bitmap points into the frame buffer. */
+struct vbp_op
+{
+    uint8_t        opcode;
+    uint16_t       vid;
+    const uint8_t *bitmap;
+    char           iface[IFNAMSIZ];
+};
+
+/** One decoded request frame. */
+struct vbp_frame
+{
+    uint32_t       seq;
+    uint32_t       count;
+    struct vbp_op *ops;        /**< @c count entries, caller frees. */
+};
+
+int    vbp_parse_frame(const uint8_t *buf, size_t len, struct vbp_frame *out);
+void   vbp_frame_free(struct vbp_frame *frame);
+
+size_t vbp_put_header(uint8_t *buf, uint16_t flags, uint32_t seq,
+                      uint32_t count, uint32_t length);
+size_t vbp_put_op(uint8_t *buf, uint8_t opcode, uint16_t vid,
+                  const uint8_t *bitmap, const char *iface);
+
+struct vbp_conn;
+
+struct vbp_conn *vbp_conn_new(int fd);
+void   vbp_conn_put(struct vbp_conn *conn);
+int    vbp_execute(struct vbp_conn *conn, struct vbp_frame *frame);
+
+#endif /* CTL_PROTO_H */
@@ -0,0 +1,4981 @@
+/**
+ * @file dataplane.c
+ * @brief Forwarding workers: RX bursts from every port, 802.1Q classification,
+ *        per-VLAN learning and flooding, batched TX.
+ *
+ * Threading: each worker thread owns one ring per port.  With more than one
+ * worker the rings of a port form a PACKET_FANOUT group that spreads the
+ * port's ingress by flow hash, so the frames of one flow are handled by one
+ * worker and stay in order; egress goes out on the sending worker's own
+ * ring.  Workers can be pinned to CPUs.
+ *
+ * Worker 0 is also the control worker and the only writer of the port
+ * table.  Attach / detach requests from other threads are posted to it
+ * through a single request slot and an eventfd, and wait for the result.
+ * Before it changes the table it parks the other workers at the top of
+ * their loop, after they have flushed their TX rings, and releases them
+ * afterwards; the fast path therefore reads ports, flood bitmaps and rings
+ * without locks.  Readers of port names and VLANs take g_port_lock, which
+ * worker 0 only holds while changing a slot.  Port and VLAN counters live
+ * in each worker's own dp_stats.h shard and are summed only when read, and
+ * the FDB is shared (see fdb.h), so no counter or table lock is taken per
+ * frame.
+ *
+ * Ports are access ports of one VLAN or trunks carrying a set of VLANs
+ * tagged plus an optional untagged native VLAN.  Each RX burst goes through
+ * vt_parse_burst() (vlan_tag.h), which pops in-band tags, and is classified
+ * into VLANs: untagged frames to the access / native VLAN, tagged frames to
+ * their VLAN if the trunk carries it; anything else is dropped.  Source
+ * addresses are learned into the FDB (fdb.h) per VLAN, frames to a known
+ * unicast address go to that port only, and everything else is flooded to
+ * every other member of the VLAN.  Membership is kept as one egress port
+ * bitmap per VLAN ID, updated when a port is attached, changed or detached,
+ * so a flood is a walk over the set bits rather than a scan of the port
+ * table.  Egress is untagged on a port's access / native VLAN and tagged
+ * otherwise.  A frame for a port whose TX ring is full is copied into a
+ * dp_pool.h buffer from the worker's own cache and queued on that port's
+ * backlog, which is drained into the ring ahead of any newer frame as soon
+ * as the ring has room; it is dropped only if the backlog or the pool is
+ * full.  A port that leaves or changes its VLANs has its FDB entries
+ * flushed; an access VLAN whose last port leaves is flushed as a whole.
+ *
+ * VLAN translation: a trunk may carry VLANs under other VIDs, customer
+ * VIDs (C-VIDs), mapped one to one per port by a vlan_xlate.h table of two
+ * direct-indexed arrays.  Classification looks a tagged frame's VID up in
+ * the ingress array before it checks the VLAN against the trunk, and
+ * port_tx() tags with the egress array's C-VID; a port without mappings
+ * has no table and pays one untaken branch per tagged frame and per tagged
+ * transmission.  Tables are never freed while the workers run, so a
+ * mapping changes with a single store and without parking anyone.
+ *
+ * Routing: an IPv4 frame sent to the router MAC of its VLAN (the Vlan<id>
+ * bridge's address, or one set with dp_vlan_router()) is routed between
+ * VLANs instead of switched.  Its destination is resolved a burst at a time
+ * through the l3.h tables to an egress VLAN and a neighbor MAC; the frame is
+ * rewritten in place (MACs, TTL, header checksum) and then forwarded in the
+ * egress VLAN like any other frame, by FDB lookup or flood.  A routable
+ * frame without route, neighbor or TTL left is dropped.
+ *
+ * ACLs: after classification, and only if some port or VLAN has an ACL
+ * bound, the burst's header keys are parsed once and run through the
+ * acl.h table of the ingress port and then through those of the frames'
+ * VLANs, one acl_classify_burst() per distinct table.  Denied frames leave
+ * the burst and count as ingress drops of the port.  Workers reach a table
+ * through the ACL bound to the port slot or VLAN and never lock it; an
+ * edit builds a new table, swaps the pointer and frees the old one after a
+ * grace period, i.e. once every worker has started a new loop pass or is
+ * idle (qs / offline in struct dp_worker).
+ *
+ * Storm control: once the FDB lookup has decided which frames flood, and
+ * only if some bucket is configured, broadcast, multicast and unknown
+ * unicast frames are metered by the storm.h buckets of the ingress port
+ * and then of their VLAN, one storm_tb_claim() per bucket and burst.  The
+ * buckets are shared by all workers and updated lock-free, so a rate is
+ * enforced on a port or VLAN as a whole however its ingress is spread.
+ * Frames beyond the rate are dropped before they reach any egress ring.
+ *
+ * Multicast snooping: in the VLANs it is enabled for, a multicast frame
+ * about to flood is classified with snoop_classify().  IGMP and MLD
+ * messages are copied to a queue for the snooping thread and flood as
+ * usual; data for a group with listeners goes only to the listeners' ports
+ * and the VLAN's router ports, a mask over the flood bitmap.  Groups
+ * without listeners and link-local groups flood.  The snooping thread owns
+ * the snoop.h state and its timer wheel: it applies queued messages and
+ * expiries, recompiles the (VLAN, group) -> egress ports table after any
+ * change and swaps it in the same way as an ACL table, and keeps one
+ * router port bitmap per VLAN up to date.
+ *
+ * Link aggregation: a LAG groups attached ports by name.  Its attached
+ * member with the lowest slot, the representative, stands for the whole
+ * LAG: addresses learned on any member are learned on it, and floods and
+ * unicast go to it only.  Other members are masked out of every flood
+ * (g_lag_hidden), and a frame from a member never goes back to any member
+ * of the same LAG.  On transmission to the representative a member is
+ * picked by flow hash from the LAG's lag.h member table, so one flow keeps
+ * one member.  Worker 0 regroups the LAGs with the other workers parked
+ * whenever ports or LAG members change; a member's link going down or up
+ * only rewrites the member table, from the link snapshot or
+ * dp_lag_link(), without parking anyone.
+ *
+ * Mirroring: a frame received on a port, or sent on one, is offered to the
+ * mirror sessions that have the port, or the frame's VLAN, as a source in
+ * that direction: one session bitmap per port and per VLAN and direction,
+ * skipped altogether while no session has a source.  A session that
+ * samples the frame gets a copy, as it was on the wire (tag included) and
+ * cut to its snap length, in the worker's own mirror.h ring; a full ring
+ * drops the copy and counts it, so mirroring never waits for the disk.
+ * The mirror thread drains every ring into the sessions' pcap-ng files and
+ * is the only thread that writes them, under g_mirror_lock.
+ *
+ * sFlow: a port sampled at 1 in N keeps, per worker, a countdown of frames
+ * to its next sample drawn by sflow_skip(); a burst that ends before the
+ * countdown does costs one subtraction.  A sampled frame's first bytes
+ * and VLAN go to the worker's sample ring (a mirror.h ring, dropped and
+ * counted when full), and the sFlow thread turns them into flow samples,
+ * polls the counters of the sampled ports and of the VLANs asked for, and
+ * sends both to the collector in sFlow v5 datagrams.
+ *
+ * Packet traces: while a worker forwards a frame it traces, w->trace points
+ * at the trace and every pipeline stage appends its decision and cycle
+ * count to it (trace.h); otherwise each stage pays one untaken branch per
+ * burst, the forwarding decision and transmission one per frame.  A traced
+ * frame always travels as a burst of one.  Frames injected with
+ * dp_trace_inject() are forwarded by worker 0 from its control request
+ * slot.  A port sampled for tracing has every Nth frame it receives split
+ * out of its burst, at most one per worker and millisecond, and the trace
+ * kept in the worker's ring of recent traces, each slot a sequence lock
+ * that readers retry.
+ *
+ * Resources: ACL edits reserve their rules in the RES_ACL table (res.h)
+ * before compiling, so a full table refuses the edit with -ENOSPC and
+ * leaves the old list in place.  The FDB learns at most the RES_FDB
+ * capacity (fdb_set_limit()), and worker 0 reports its size to res.h once
+ * per loop; the report is a store only when the size changed.
+ */
+
+#define _GNU_SOURCE     /* pthread_getcpuclockid, pthread_setaffinity_np */
+
+#include <errno.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <linux/if_ether.h>
+
+#include "dataplane.h"
+#include "dp_pool.h"
+#include "dp_ring.h"
+#include "dp_stats.h"
+#include "fdb.h"
+#include "l3.h"
+#include "lag.h"
+#include "mirror.h"
+#include "res.h"
+#include "sflow.h"
+#include "snoop.h"
+#include "storm.h"
+#include "trace.h"
+#include "vlan_tag.h"
+#include "vlan_state.h"
+#include "vlan_xlate.h"
+
+/** poll() timeout while idle; bounds the delay of membership updates. */
+#define DP_IDLE_POLL_MS  100
+/** Frames classified per FDB lookup burst. */
+#define DP_BURST         32
+/** Packet buffers shared by the TX backlogs of all workers. */
+#define DP_POOL_BUFS     8192
+/** Frames one worker may hold back for one port. */
+#define DP_BACKLOG_MAX   DP_TX_FRAMES
+/** IGMP / MLD messages queued for the snooping thread. */
+#define DP_SNOOP_QUEUE   64
+/** Bytes of a message kept; enough for any untagged standard frame. */
+#define DP_SNOOP_SNAPLEN 1518
+/** Messages the snooping thread takes from the queue at a time. */
+#define DP_SNOOP_BATCH   16
+/** Slots of every worker's mirror ring; a power of two. */
+#define DP_MIRROR_RING   1024
+/** Records the mirror thread takes from one ring at a time. */
+#define DP_MIRROR_BATCH  256
+/** Sleep of the mirror thread when every ring is empty. */
+#define DP_MIRROR_IDLE_MS 10
+/** Slots of every worker's sFlow sample ring; a power of two. */
+#define DP_SFLOW_RING    256
+/** Sleep of the sFlow thread with no sample queued and no poll due. */
+#define DP_SFLOW_IDLE_MS 10
+/** Recent traces of sampled frames each worker keeps. */
+#define DP_TRACE_KEEP    16
+
+/** VLAN configuration of one port. */
+struct dp_port_cfg
+{
+    uint16_t vid;                        /* access VLAN, or a trunk's native VLAN (0: none) */
+    uint8_t  trunk;
+    uint64_t tagged[VLAN_ID_SPACE / 64]; /* VLANs a trunk carries tagged */
+};
+
+struct dp_port
+{
+    int                  in_use;
+    char                 name[IFNAMSIZ];
+    int                  ifindex;
+    struct dp_port_cfg   cfg;
+    uint16_t             fanout;     /* PACKET_FANOUT group of the rings, 0: none */
+    uint8_t              io;         /* DP_IO_*: backend of the rings */
+    struct dp_xdp        xdp;        /* redirect program, if io is AF_XDP */
+};
+
+/* An IGMP / MLD message on its way to the snooping thread. */
+struct dp_snoop_msg
+{
+    uint16_t vid;
+    uint16_t slot;
+    uint16_t len;                        /* 0: dropped, its port left */
+    uint8_t  data[DP_SNOOP_SNAPLEN];
+};
+
+/* A kept trace; @c seq is odd while the worker rewrites it. */
+struct dp_trace_slot
+{
+    uint32_t     seq;
+    struct trace t;
+};
+
+/* Frames waiting for room in a TX ring, oldest first. */
+struct dp_backlog
+{
+    struct dp_mbuf *head;
+    struct dp_mbuf *tail;
+    unsigned        n;
+};
+
+/* One forwarding thread and everything only it touches on the fast path. */
+struct dp_worker
+{
+    unsigned               id;
+    int                    cpu;                 /* pinned CPU, or -1 */
+    pthread_t              thread;
+    int                    event_fd;
+    uint64_t               now_ms;              /* worker clock, once per loop */
+    struct dps_shard       shard;               /* counter lines */
+    struct dpp_cache      *cache;               /* packet buffers */
+    struct dp_umem        *umem;                /* AF_XDP frames, DP_F_XDP only */
+    struct dp_worker_stats stats;               /* packets and bursts */
+    unsigned               backlogged;          /* frames in all backlogs */
+    uint64_t               qs;                  /* loop passes, for grace_sync() */
+    int                    offline;             /* in poll() or parked: holds no table */
+    struct dp_ring         ring[DP_MAX_PORTS];  /* by port slot */
+    struct dp_backlog      backlog[DP_MAX_PORTS];
+    struct mirror_ring    *mring;               /* copies for the mirror thread */
+    uint32_t               mirror_seen[DP_MAX_MIRRORS];   /* frames offered, for sampling */
+    uint64_t               mirror_drops[DP_MAX_MIRRORS];  /* copies the full ring refused */
+    struct mirror_ring    *sring;               /* sFlow samples for the sFlow thread */
+    uint32_t               sflow_rng;           /* sflow_skip() state */
+    uint32_t               sflow_skip[DP_MAX_PORTS];   /* frames to the next sample, 0: draw */
+    uint64_t               sflow_pool[DP_MAX_PORTS];   /* frames seen on sampled ports */
+    uint64_t               sflow_drops[DP_MAX_PORTS];  /* samples the full ring refused */
+    struct trace          *trace;               /* frame being traced, NULL: none */
+    uint32_t               trace_seen[DP_MAX_PORTS];   /* frames since the last trace */
+    uint64_t               trace_ms;            /* worker clock of the last trace */
+    unsigned               ntraces;             /* traces kept so far */
+    struct dp_trace_slot   traces[DP_TRACE_KEEP];
+} __attribute__((aligned(64)));
+
+enum dp_ctl_op
+{
+    DP_CTL_ATTACH,
+    DP_CTL_DETACH,
+    DP_CTL_LAG,                  /* regroup after a LAG change */
+    DP_CTL_TRACE,                /* forward a frame, tracing it */
+};
+
+struct dp_ctl
+{
+    enum dp_ctl_op     op;
+    char               name[IFNAMSIZ];
+    int                ifindex;
+    struct dp_port_cfg cfg;
+    const uint8_t     *frame;    /* DP_CTL_TRACE: the frame ... */
+    uint32_t           len;
+    struct trace      *trace;    /* ... and its trace */
+    int                result;
+    int                done;
+};
+
+/* Desired port configuration derived from the link snapshot. */
+struct dp_want
+{
+    int                ifindex;
+    char               name[IFNAMSIZ];
+    struct dp_port_cfg cfg;
+    int                down;     /* link not running */
+};
+
+static struct dp_port   g_ports[DP_MAX_PORTS];
+static unsigned         g_active[DP_MAX_PORTS];   /* in-use slots, worker only */
+static unsigned         g_nactive;
+static pthread_mutex_t  g_port_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static pthread_mutex_t  g_ctl_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t   g_ctl_cond = PTHREAD_COND_INITIALIZER;
+static struct dp_ctl   *g_ctl_req;
+static atomic_int       g_ctl_pending;
+
+static struct dp_worker g_workers[DP_MAX_WORKERS];
+static unsigned         g_nworkers;
+static int              g_running;
+static atomic_int       g_stop;
+static unsigned         g_flags;
+static uint64_t         g_seen_generation;
+
+/* Worker 0 parks the others around port table changes. */
+static pthread_mutex_t  g_park_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t   g_park_cond = PTHREAD_COND_INITIALIZER;
+static atomic_int       g_park;
+static unsigned         g_parked;
+
+static struct timespec        g_started;
+
+static struct fdb            *g_fdb;
+static struct dp_stats       *g_stats;
+static struct dp_pool        *g_pool;
+
+static struct dp_want         g_want[DP_MAX_PORTS];   /* reconcile() scratch */
+
+/* Member ports of every VLAN, bit i = slot i.  Worker 0 writes; relaxed reads. */
+static uint64_t               g_flood[VLAN_ID_SPACE];
+
+/* Router MAC of every VLAN as a 48-bit value, 0 if it is not routed; relaxed. */
+static uint64_t               g_rmac[VLAN_ID_SPACE];
+
+/* A named ACL; workers read only @table, which every edit replaces. */
+struct dp_acl
+{
+    int                  in_use;
+    char                 name[DP_ACL_NAME_LEN];
+    struct acl          *table;
+};
+
+/* Serializes ACL edits and binds; taken by control threads only, never by
+ * a worker, since grace_sync() waits for the workers. */
+static pthread_mutex_t        g_acl_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct dp_acl          g_acls[DP_MAX_ACLS];
+
+/* ACL bound to every port slot and VLAN, or NULL.  Port bindings change
+ * under g_port_lock, VLAN bindings under g_acl_lock; workers read them
+ * with acquire loads, and skip both arrays while g_acl_bound is 0. */
+static struct dp_acl         *g_port_acl[DP_MAX_PORTS];
+static struct dp_acl         *g_vlan_acl[VLAN_ID_SPACE];
+static unsigned               g_acl_bound;
+
+/* A storm control bucket and the rate it was configured with. */
+struct dp_storm
+{
+    struct storm_tb      tb;
+    struct storm_rate    r;
+};
+
+/* Buckets of every port slot and VLAN, by class.  Port buckets change
+ * under g_port_lock, VLAN buckets under g_storm_lock; workers only claim
+ * from them, and skip storm_burst() while g_storm_on (buckets turned on)
+ * is 0. */
+static pthread_mutex_t        g_storm_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct dp_storm        g_port_storm[DP_MAX_PORTS][STORM_NCLASSES];
+static struct dp_storm        g_vlan_storm[VLAN_ID_SPACE][STORM_NCLASSES];
+static unsigned               g_storm_on;
+
+/* Multicast snooping.  The snooper is fed by the snooping thread and
+ * configured by control threads under g_snoop_lock, which workers never
+ * take since grace_sync() runs under it.  Workers post IGMP / MLD messages
+ * to g_snoopq under g_snoopq_lock, and read the VLANs snooped
+ * (g_snoop_on) and their router ports (g_mrouter, bit i = slot i) relaxed,
+ * and the listener table g_mdb with acquire loads. */
+static pthread_mutex_t        g_snoop_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct snoop          *g_snooper;
+static int                    g_mdb_dirty;        /* g_mdb is behind the snooper */
+static pthread_t              g_snoop_thread;
+static int                    g_snoop_started;
+
+static pthread_mutex_t        g_snoopq_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t         g_snoopq_cond;
+static struct dp_snoop_msg    g_snoopq[DP_SNOOP_QUEUE];
+static unsigned               g_snoopq_head;
+static unsigned               g_snoopq_n;
+static uint64_t               g_snoop_gone;       /* slots detached since the thread looked */
+static int                    g_snoop_stop;
+
+static uint64_t               g_snoop_on[VLAN_ID_SPACE / 64];
+static uint64_t               g_mrouter[VLAN_ID_SPACE];
+static struct snoop_table    *g_mdb;
+
+/* A LAG.  Workers read @ports, @rep and @hash, which only change with them
+ * parked, and @table, which changes lock-free. */
+struct dp_lag
+{
+    int                  in_use;
+    char                 name[IFNAMSIZ];
+    uint8_t              hash;       /* LAG_HASH_* */
+    unsigned             nmembers;
+    char                 member[LAG_MAX_MEMBERS][IFNAMSIZ];
+    uint64_t             ports;      /* attached members, bit i = slot i */
+    uint64_t             up;         /* members in @table */
+    uint8_t              rep;        /* representative slot, if @ports */
+    struct lag_table     table;
+};
+
+/* LAG configuration, membership and link state.  Taken by control threads
+ * and by worker 0, never while waiting for a worker. */
+static pthread_mutex_t        g_lag_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct dp_lag          g_lags[DP_MAX_LAGS];
+static uint8_t                g_port_lag[DP_MAX_PORTS];  /* LAG index + 1 of every slot, 0: none */
+static uint64_t               g_lag_hidden;       /* members that are not representatives */
+static uint64_t               g_link_down;        /* slots whose link is down */
+
+/* A mirror session.  Workers read @cfg, which is set before any source
+ * refers to the session; @out belongs to the mirror thread. */
+struct dp_mirror
+{
+    int                  in_use;
+    int                  closing;    /* being deleted: no longer found by name */
+    char                 name[DP_MIRROR_NAME_LEN];
+    struct dp_mirror_cfg cfg;
+    struct mirror_file   out;
+    uint64_t             write_errors;
+};
+
+/* Mirror sessions, guarded by g_mirror_lock, which workers never take and
+ * the mirror thread holds while it writes.  Sources are session bitmaps
+ * (bit s = g_mirrors[s]) per port slot or VLAN and direction (0: rx, 1:
+ * tx); port bitmaps change under g_port_lock, VLAN bitmaps under
+ * g_mirror_lock.  Workers read them relaxed, and skip both arrays while
+ * g_mirror_sources (bitmaps in use) is 0. */
+static pthread_mutex_t        g_mirror_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct dp_mirror       g_mirrors[DP_MAX_MIRRORS];
+static uint8_t                g_port_mirror[DP_MAX_PORTS][2];
+static uint8_t                g_vlan_mirror[VLAN_ID_SPACE][2];
+static unsigned               g_mirror_sources;
+static pthread_t              g_mirror_thread;
+static int                    g_mirror_started;
+static atomic_int             g_mirror_stop;
+
+/* The sFlow agent; everything but @rate belongs to g_sflow_lock, which
+ * workers never take and the sFlow thread holds while it sends. */
+struct dp_sflow
+{
+    int                  on;
+    struct dp_sflow_cfg  cfg;
+    int                  fd;         /* UDP socket connected to the collector */
+    uint64_t             started_ms; /* for the uptime in datagrams */
+    uint64_t             next_poll_ms;
+    uint32_t             dgram_seq;
+    uint32_t             flow_seq[DP_MAX_PORTS];
+    uint32_t             port_seq[DP_MAX_PORTS];
+    uint32_t             vlan_seq[VLAN_ID_SPACE];
+    uint64_t             pool_base[DP_MAX_PORTS];   /* worker counts when sampling began */
+    uint64_t             drop_base[DP_MAX_PORTS];
+    uint64_t             vlans[VLAN_ID_SPACE / 64]; /* VLANs whose counters are polled */
+    uint64_t             samples;
+    uint64_t             counters;
+    uint64_t             datagrams;
+    uint64_t             send_errors;
+    struct sflow_dgram   dg;         /* being filled */
+};
+
+/* Sampling rate of every port slot (0: not sampled) changes under
+ * g_port_lock and g_sflow_lock and is read relaxed by the workers, as is
+ * the header length g_sflow_header. */
+static pthread_mutex_t        g_sflow_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct dp_sflow        g_sflow = { .fd = -1 };
+static uint32_t               g_sflow_rate[DP_MAX_PORTS];
+static unsigned               g_sflow_header;
+static pthread_t              g_sflow_thread;
+static int                    g_sflow_started;
+static atomic_int             g_sflow_stop;
+
+/* Trace sampling rate of every port slot (1 frame in N, 0: off); changes
+ * under g_port_lock and is read relaxed by the workers. */
+static uint32_t               g_trace_rate[DP_MAX_PORTS];
+
+/* VLAN translation table of every port slot.  A slot's table is allocated
+ * with its first mapping and kept until shutdown, so that no worker ever
+ * reads a freed one; mappings change under g_port_lock.  g_port_xlate[i]
+ * is the table while slot i has mappings and NULL otherwise; workers read
+ * it with an acquire load. */
+static struct vlan_xlate     *g_xlate_mem[DP_MAX_PORTS];
+static struct vlan_xlate     *g_port_xlate[DP_MAX_PORTS];
+
+/* ---------------------------------------------------------------------------
+ * Helpers
+ * --------------------------------------------------------------------------- */
+
+/* Single-writer counter update; readers use stat_load(). */
+static inline void stat_add(uint64_t *c, uint64_t v)
+{
+    __atomic_store_n(c, *c + v, __ATOMIC_RELAXED);
+}
+
+static inline uint64_t stat_load(const uint64_t *c)
+{
+    return __atomic_load_n(c, __ATOMIC_RELAXED);
+}
+
+static inline uint64_t mac48(const uint8_t *mac)
+{
+    return (uint64_t)mac[0] << 40 | (uint64_t)mac[1] << 32 | (uint64_t)mac[2] << 24 |
+           (uint64_t)mac[3] << 16 | (uint64_t)mac[4] << 8 | mac[5];
+}
+
+static int dp_ifindex(const char *name)
+{
+    struct ifreq ifr;
+    int fd;
+
+    fd = socket(AF_INET, SOCK_DGRAM, 0);
+    if (fd < 0)
+        return -1;
+
+    memset(&ifr, 0, sizeof(ifr));
+    strncpy(ifr.ifr_name, name, IFNAMSIZ - 1);
+    if (ioctl(fd, SIOCGIFINDEX, &ifr) < 0)
+    {
+        close(fd);
+        return -1;
+    }
+    close(fd);
+    return ifr.ifr_ifindex;
+}
+
+static struct dp_port *port_by_ifindex(int ifindex)
+{
+    unsigned i;
+
+    for (i = 0; i < g_nactive; i++)
+    {
+        if (g_ports[g_active[i]].ifindex == ifindex)
+            return &g_ports[g_active[i]];
+    }
+    return NULL;
+}
+
+static uint64_t now_ms(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC_COARSE, &ts);
+    return (uint64_t)ts.tv_sec * 1000 + (uint64_t)ts.tv_nsec / 1000000;
+}
+
+static inline unsigned slot_of(const struct dp_port *p)
+{
+    return (unsigned)(p - g_ports);
+}
+
+static inline int cfg_tagged(const struct dp_port_cfg *c, unsigned vid)
+{
+    return c->trunk && ((c->tagged[vid / 64] >> (vid % 64)) & 1);
+}
+
+static int cfg_equal(const struct dp_port_cfg *a, const struct dp_port_cfg *b)
+{
+    return a->vid == b->vid && a->trunk == b->trunk &&
+           (!a->trunk || memcmp(a->tagged, b->tagged, sizeof(a->tagged)) == 0);
+}
+
+static unsigned cfg_ntagged(const struct dp_port_cfg *c)
+{
+    unsigned n = 0;
+    unsigned i;
+
+    if (!c->trunk)
+        return 0;
+    for (i = 0; i < VLAN_ID_SPACE / 64; i++)
+        n += (unsigned)__builtin_popcountll(c->tagged[i]);
+    return n;
+}
+
+static inline int vlan_has_port(unsigned vid, unsigned slot)
+{
+    return (g_flood[vid] >> slot) & 1;
+}
+
+static inline void flood_bit(unsigned vid, uint64_t bit, int on)
+{
+    __atomic_store_n(&g_flood[vid], on ? g_flood[vid] | bit : g_flood[vid] & ~bit,
+                     __ATOMIC_RELAXED);
+}
+
+/* Add (@p on) or remove slot @p slot in the flood bitmaps of @p c's VLANs. */
+static void flood_update(unsigned slot, const struct dp_port_cfg *c, int on)
+{
+    uint64_t bit = 1ull << slot;
+    unsigned w;
+
+    if (c->vid)
+        flood_bit(c->vid, bit, on);
+    if (!c->trunk)
+        return;
+    for (w = 0; w < VLAN_ID_SPACE / 64; w++)
+    {
+        uint64_t m = c->tagged[w];
+
+        while (m)
+        {
+            flood_bit(w * 64 + (unsigned)__builtin_ctzll(m), bit, on);
+            m &= m - 1;
+        }
+    }
+}
+
+/* Reconfigure the @p n buckets at @p s to @p r (NULL: off), keeping
+ * g_storm_on in step; the caller holds their lock. */
+static int storm_set(struct dp_storm *s, unsigned n, const struct storm_rate *r)
+{
+    static const struct storm_rate off;
+    unsigned i;
+    int err;
+
+    for (i = 0; i < n; i++)
+    {
+        int was = s[i].r.rate != 0;
+
+        if ((err = storm_tb_set(&s[i].tb, r)) < 0)
+            return err;
+        s[i].r = r ? *r : off;
+        if (was != (s[i].r.rate != 0))
+            __atomic_add_fetch(&g_storm_on, was ? -1 : 1, __ATOMIC_RELAXED);
+    }
+    return 0;
+}
+
+/* Set mirror session bitmap @p m to @p v, keeping g_mirror_sources in
+ * step; the caller holds its lock. */
+static void mirror_set(uint8_t *m, uint8_t v)
+{
+    if (!*m != !v)
+        __atomic_add_fetch(&g_mirror_sources, v ? 1 : -1, __ATOMIC_RELAXED);
+    __atomic_store_n(m, v, __ATOMIC_RELAXED);
+}
+
+/*
+ * grace_sync() - Wait until no worker can still use a table it reached
+ * before the call: each one has started a new loop pass since, or is idle.
+ * Used to retire ACL and snooping tables and mirror sessions; never called
+ * by a worker.
+ */
+static void grace_sync(void)
+{
+    uint64_t seen[DP_MAX_WORKERS];
+    unsigned k;
+
+    for (k = 0; k < g_nworkers; k++)
+        seen[k] = __atomic_load_n(&g_workers[k].qs, __ATOMIC_SEQ_CST);
+    for (k = 0; k < g_nworkers; k++)
+    {
+        while (__atomic_load_n(&g_workers[k].qs, __ATOMIC_SEQ_CST) == seen[k] &&
+               !__atomic_load_n(&g_workers[k].offline, __ATOMIC_SEQ_CST) &&
+               !atomic_load(&g_stop))
+            usleep(50);
+    }
+}
+
+/* Have the snooping thread forget slot @p slot, whose port left, and drop
+ * the messages it still had queued from it. */
+static void snoop_port_gone(unsigned slot)
+{
+    unsigned i;
+
+    pthread_mutex_lock(&g_snoopq_lock);
+    for (i = 0; i < g_snoopq_n; i++)
+    {
+        struct dp_snoop_msg *m = &g_snoopq[(g_snoopq_head + i) % DP_SNOOP_QUEUE];
+
+        if (m->slot == slot)
+            m->len = 0;
+    }
+    g_snoop_gone |= 1ull << slot;
+    pthread_mutex_unlock(&g_snoopq_lock);
+}
+
+/* Attached members of @p g whose link is up and whose VLANs are the
+ * representative's; g_lag_lock held.  Floods follow the representative's
+ * membership, so a member configured otherwise would carry frames of VLANs
+ * it is not in, tagged by its own configuration. */
+static uint64_t lag_usable(const struct dp_lag *g)
+{
+    uint64_t m = g->ports & ~g_link_down;
+    uint64_t ok = 0;
+
+    for (; m; m &= m - 1)
+    {
+        unsigned slot = (unsigned)__builtin_ctzll(m);
+
+        if (cfg_equal(&g_ports[slot].cfg, &g_ports[g->rep].cfg))
+            ok |= 1ull << slot;
+    }
+    return ok;
+}
+
+/* Rebuild @p g's member table from its usable members; g_lag_lock held. */
+static void lag_refresh(struct dp_lag *g)
+{
+    uint8_t up[LAG_MAX_MEMBERS];
+    uint64_t m = lag_usable(g);
+    unsigned n = 0;
+
+    g->up = m;
+    for (; m; m &= m - 1)
+        up[n++] = (uint8_t)__builtin_ctzll(m);
+    lag_table_build(&g->table, up, n);
+}
+
+/*
+ * lag_link() - Record that the link of slot @p slot went up or down and, if
+ * it is a LAG member, bring it into or take it out of the member table;
+ * g_lag_lock held.
+ *
+ * A member going down only has its own table entries moved to the others,
+ * so the flows on them are not disturbed; one coming up rebalances.
+ */
+static void lag_link(unsigned slot, int up)
+{
+    uint64_t bit = 1ull << slot;
+    unsigned l = g_port_lag[slot];
+    struct dp_lag *g;
+
+    if (!(g_link_down & bit) == !!up)
+        return;
+    g_link_down ^= bit;
+    if (!l)
+        return;
+
+    g = &g_lags[l - 1];
+    if (up)
+    {
+        lag_refresh(g);
+    }
+    else
+    {
+        uint8_t rest[LAG_MAX_MEMBERS];
+        uint64_t m;
+        unsigned n = 0;
+
+        g->up &= ~bit;
+        for (m = g->up; m; m &= m - 1)
+            rest[n++] = (uint8_t)__builtin_ctzll(m);
+        lag_table_remove(&g->table, (uint8_t)slot, rest, n);
+    }
+    printf("dataplane: LAG %s member %s is %s, %d of %d members up\n", g->name,
+           g_ports[slot].name, up ? "up" : "down", __builtin_popcountll(g->up),
+           __builtin_popcountll(g->ports));
+}
+
+/*
+ * lag_regroup() - Match the attached ports against the LAGs' members and
+ * update the groupings and member tables; worker 0 with the others parked.
+ *
+ * FDB entries of every port whose grouping changed are flushed, since
+ * they were learned on a representative that may no longer be one.
+ */
+static void lag_regroup(void)
+{
+    uint8_t port_lag[DP_MAX_PORTS];
+    uint64_t active = 0;
+    uint64_t hidden = 0;
+    uint64_t stale = 0;
+    unsigned i, j, k;
+
+    memset(port_lag, 0, sizeof(port_lag));
+    for (k = 0; k < g_nactive; k++)
+        active |= 1ull << g_active[k];
+
+    pthread_mutex_lock(&g_lag_lock);
+    g_link_down &= active;
+    for (i = 0; i < DP_MAX_LAGS; i++)
+    {
+        struct dp_lag *g = &g_lags[i];
+        uint64_t ports = 0;
+
+        for (j = 0; g->in_use && j < g->nmembers; j++)
+        {
+            for (k = 0; k < g_nactive; k++)
+            {
+                if (strcmp(g_ports[g_active[k]].name, g->member[j]) == 0)
+                {
+                    ports |= 1ull << g_active[k];
+                    port_lag[g_active[k]] = (uint8_t)(i + 1);
+                }
+            }
+        }
+        if (ports != g->ports)
+        {
+            stale |= g->ports | ports;
+            g->ports = ports;
+            g->rep = ports ? (uint8_t)__builtin_ctzll(ports) : 0;
+            lag_refresh(g);
+        }
+        else if (ports && lag_usable(g) != g->up)
+        {
+            lag_refresh(g);     /* a member's VLANs changed */
+        }
+        if (ports)
+            hidden |= ports & ~(1ull << g->rep);
+    }
+    for (i = 0; i < DP_MAX_PORTS; i++)
+    {
+        if (port_lag[i] != g_port_lag[i])
+        {
+            stale |= 1ull << i;
+            g_port_lag[i] = port_lag[i];
+        }
+    }
+    g_lag_hidden = hidden;
+    pthread_mutex_unlock(&g_lag_lock);
+
+    if (stale)
+        fdb_flush_ports(g_fdb, stale);
+}
+
+static void rebuild_active(void)
+{
+    unsigned i;
+
+    g_nactive = 0;
+    for (i = 0; i < DP_MAX_PORTS; i++)
+    {
+        if (g_ports[i].in_use)
+            g_active[g_nactive++] = i;
+    }
+}
+
+/* ---------------------------------------------------------------------------
+ * Worker parking (worker 0)
+ * --------------------------------------------------------------------------- */
+
+static void wake_worker(const struct dp_worker *w)
+{
+    uint64_t one = 1;
+
+    if (write(w->event_fd, &one, sizeof(one)) < 0)
+        perror("dataplane: eventfd write");
+}
+
+/* Stop every other worker at the top of its loop; returns once all wait. */
+static void park_others(void)
+{
+    unsigned k;
+
+    if (g_nworkers < 2)
+        return;
+
+    atomic_store(&g_park, 1);
+    for (k = 1; k < g_nworkers; k++)
+        wake_worker(&g_workers[k]);
+
+    pthread_mutex_lock(&g_park_lock);
+    while (g_parked < g_nworkers - 1 && !atomic_load(&g_stop))
+        pthread_cond_wait(&g_park_cond, &g_park_lock);
+    pthread_mutex_unlock(&g_park_lock);
+}
+
+/* Release the parked workers; returns once all of them have left. */
+static void unpark_others(void)
+{
+    if (g_nworkers < 2)
+        return;
+
+    pthread_mutex_lock(&g_park_lock);
+    atomic_store(&g_park, 0);
+    pthread_cond_broadcast(&g_park_cond);
+    while (g_parked > 0)
+        pthread_cond_wait(&g_park_cond, &g_park_lock);
+    pthread_mutex_unlock(&g_park_lock);
+}
+
+static void flush_all(struct dp_worker *w);
+
+/* Called by workers 1..n-1 when g_park is set. */
+static void park_wait(struct dp_worker *w)
+{
+    flush_all(w);
+    __atomic_store_n(&w->offline, 1, __ATOMIC_SEQ_CST);
+
+    pthread_mutex_lock(&g_park_lock);
+    g_parked++;
+    pthread_cond_broadcast(&g_park_cond);
+    while (atomic_load(&g_park))
+        pthread_cond_wait(&g_park_cond, &g_park_lock);
+    g_parked--;
+    pthread_cond_broadcast(&g_park_cond);
+    pthread_mutex_unlock(&g_park_lock);
+    __atomic_store_n(&w->offline, 0, __ATOMIC_SEQ_CST);
+}
+
+/* ---------------------------------------------------------------------------
+ * Port table (worker 0, others parked)
+ * --------------------------------------------------------------------------- */
+
+/* Return @p w's backlog for @p slot to the pool through @p cache. */
+static void backlog_drop(struct dp_worker *w, unsigned slot, struct dpp_cache *cache)
+{
+    struct dp_backlog *bl = &w->backlog[slot];
+    struct dp_mbuf *m;
+
+    while ((m = bl->head) != NULL)
+    {
+        bl->head = m->next;
+        dpp_free(g_pool, cache, m);
+    }
+    w->backlogged -= bl->n;
+    bl->tail = NULL;
+    bl->n = 0;
+}
+
+/* Close slot @p slot's rings; the calling worker 0 frees the backlogs. */
+static void rings_close(unsigned slot)
+{
+    unsigned k;
+
+    for (k = 0; k < g_nworkers; k++)
+    {
+        backlog_drop(&g_workers[k], slot, g_workers[0].cache);
+        dp_ring_close(&g_workers[k].ring[slot]);
+    }
+    if (g_ports[slot].io != DP_IO_TPACKET)
+        dp_xdp_detach(&g_ports[slot].xdp);
+    g_ports[slot].io = DP_IO_TPACKET;
+}
+
+/* Attach the XDP program to @p ifindex and open worker k's socket on RX queue k. */
+static int rings_open_xdp(unsigned slot, int ifindex, struct dp_xdp *xdp)
+{
+    unsigned k;
+    int err;
+
+    err = dp_xdp_attach(xdp, ifindex, g_nworkers);
+    if (err < 0)
+        return err;
+    for (k = 0; k < g_nworkers; k++)
+    {
+        err = dp_ring_open_xsk(&g_workers[k].ring[slot], xdp, k, g_workers[k].umem);
+        if (err < 0)
+        {
+            while (k-- > 0)
+                dp_ring_close(&g_workers[k].ring[slot]);
+            dp_xdp_detach(xdp);
+            return err;
+        }
+    }
+    return 0;
+}
+
+/*
+ * Open every worker's ring on @p ifindex for slot @p slot: AF_XDP sockets if
+ * DP_F_XDP is set and the port allows it, else TPACKET rings joined in one
+ * fanout group.  Sets g_ports[slot].io.
+ */
+static int rings_open(unsigned slot, int ifindex, const char *name, uint16_t *fanout)
+{
+    struct dp_port *p = &g_ports[slot];
+    unsigned k;
+    int err;
+
+    *fanout = 0;
+    p->io = DP_IO_TPACKET;
+    if (g_flags & DP_F_XDP)
+    {
+        err = rings_open_xdp(slot, ifindex, &p->xdp);
+        if (err == 0)
+        {
+            p->io = p->xdp.native ? DP_IO_XDP_DRV : DP_IO_XDP_SKB;
+            return 0;
+        }
+        fprintf(stderr, "dataplane: AF_XDP unavailable on %s (%s), using TPACKET\n",
+                name, strerror(-err));
+    }
+
+    for (k = 0; k < g_nworkers; k++)
+    {
+        err = dp_ring_open(&g_workers[k].ring[slot], ifindex);
+        if (err == 0 && g_nworkers > 1)
+            err = dp_ring_join_fanout(&g_workers[k].ring[slot], fanout);
+        if (err < 0)
+        {
+            do
+                dp_ring_close(&g_workers[k].ring[slot]);
+            while (k-- > 0);
+            return err;
+        }
+    }
+    return 0;
+}
+
+static int slot_attach(const char *name, int ifindex, const struct dp_port_cfg *cfg)
+{
+    struct dp_port *p;
+    uint16_t fanout;
+    unsigned i;
+    int err;
+
+    if ((p = port_by_ifindex(ifindex)) != NULL)
+    {
+        flood_update(slot_of(p), &p->cfg, 0);
+        flood_update(slot_of(p), cfg, 1);
+        pthread_mutex_lock(&g_port_lock);
+        p->cfg = *cfg;
+        pthread_mutex_unlock(&g_port_lock);
+        return 0;
+    }
+
+    for (i = 0; i < DP_MAX_PORTS && g_ports[i].in_use; i++)
+        ;
+    if (i == DP_MAX_PORTS)
+        return -ENOSPC;
+    p = &g_ports[i];
+
+    err = rings_open(i, ifindex, name, &fanout);
+    if (err < 0)
+    {
+        fprintf(stderr, "dataplane: cannot attach %s: %s\n", name, strerror(-err));
+        return err;
+    }
+
+    pthread_mutex_lock(&g_port_lock);
+    snprintf(p->name, sizeof(p->name), "%s", name);
+    p->ifindex = ifindex;
+    p->cfg     = *cfg;
+    p->fanout  = fanout;
+    p->in_use  = 1;
+    pthread_mutex_unlock(&g_port_lock);
+
+    dps_port_reset(g_stats, i);
+    flood_update(i, cfg, 1);
+    rebuild_active();
+    if (cfg->trunk)
+        printf("dataplane: attached %s (ifindex %d) as trunk, native VLAN %u, %u tagged\n",
+               name, ifindex, (unsigned)cfg->vid, cfg_ntagged(cfg));
+    else
+        printf("dataplane: attached %s (ifindex %d) to VLAN %u\n", name, ifindex, (unsigned)cfg->vid);
+    return 0;
+}
+
+static void slot_detach(struct dp_port *p)
+{
+    printf("dataplane: detached %s\n", p->name);
+
+    flood_update(slot_of(p), &p->cfg, 0);
+    pthread_mutex_lock(&g_port_lock);
+    p->in_use = 0;
+    if (g_port_acl[slot_of(p)])
+    {
+        __atomic_store_n(&g_port_acl[slot_of(p)], NULL, __ATOMIC_RELEASE);
+        __atomic_sub_fetch(&g_acl_bound, 1, __ATOMIC_RELAXED);
+    }
+    storm_set(g_port_storm[slot_of(p)], STORM_NCLASSES, NULL);
+    mirror_set(&g_port_mirror[slot_of(p)][0], 0);
+    mirror_set(&g_port_mirror[slot_of(p)][1], 0);
+    __atomic_store_n(&g_sflow_rate[slot_of(p)], 0, __ATOMIC_RELAXED);
+    __atomic_store_n(&g_trace_rate[slot_of(p)], 0, __ATOMIC_RELAXED);
+    if (g_port_xlate[slot_of(p)])
+    {
+        __atomic_store_n(&g_port_xlate[slot_of(p)], NULL, __ATOMIC_RELEASE);
+        vlan_xlate_clear(g_xlate_mem[slot_of(p)]);
+    }
+    pthread_mutex_unlock(&g_port_lock);
+    snoop_port_gone(slot_of(p));
+
+    rings_close(slot_of(p));
+    rebuild_active();
+}
+
+/*
+ * flush_departed() - Flush the FDB after the ports in @p moved changed VLANs.
+ *
+ * @p old_vid[] holds the previous access VLAN of every port in @p moved.
+ * An access VLAN with no member port left is flushed as a whole; otherwise,
+ * and for trunks (@p was_trunk), the departed ports' entries go.  Either way
+ * the table is scanned once.
+ */
+static void flush_departed(uint64_t moved, uint64_t was_trunk, const uint16_t *old_vid)
+{
+    uint64_t vlans[VLAN_ID_SPACE / 64];
+    uint64_t ports = 0;
+    unsigned i;
+
+    if (!moved)
+        return;
+
+    memset(vlans, 0, sizeof(vlans));
+    for (i = 0; i < DP_MAX_PORTS; i++)
+    {
+        unsigned vid = old_vid[i];
+
+        if (!(moved & (1ull << i)))
+            continue;
+        if ((was_trunk & (1ull << i)) || vid == 0)
+        {
+            ports |= 1ull << i;
+            continue;
+        }
+        if (!g_flood[vid])
+            vlans[vid / 64] |= 1ull << (vid % 64);
+        else
+            ports |= 1ull << i;
+    }
+    fdb_flush(g_fdb, ports, vlans);
+}
+
+static struct dp_want *want_get(unsigned *nwant, const struct vs_link *l)
+{
+    unsigned i;
+
+    for (i = 0; i < *nwant; i++)
+    {
+        if (g_want[i].ifindex == l->ifindex)
+            return &g_want[i];
+    }
+    if (*nwant == DP_MAX_PORTS)
+        return NULL;
+
+    memset(&g_want[i], 0, sizeof(g_want[i]));
+    g_want[i].ifindex = l->ifindex;
+    snprintf(g_want[i].name, sizeof(g_want[i].name), "%s", l->name);
+    (*nwant)++;
+    return &g_want[i];
+}
+
+static const struct dp_want *want_find(unsigned nwant, int ifindex)
+{
+    unsigned i;
+
+    for (i = 0; i < nwant; i++)
+    {
+        if (g_want[i].ifindex == ifindex)
+            return &g_want[i];
+    }
+    return NULL;
+}
+
+/* Follow the link state of the attached ports from the reconcile() wants. */
+static void lag_link_sync(unsigned nwant)
+{
+    unsigned k;
+
+    pthread_mutex_lock(&g_lag_lock);
+    for (k = 0; k < g_nactive; k++)
+    {
+        const struct dp_want *w = want_find(nwant, g_ports[g_active[k]].ifindex);
+
+        lag_link(g_active[k], !(w && w->down));
+    }
+    pthread_mutex_unlock(&g_lag_lock);
+}
+
+/*
+ * reconcile() - Follow VLAN membership from the published link snapshot.
+ *
+ * A port enslaved to Vlan<N> is an access port of N, and the address of
+ * the Vlan<N> bridge is N's router MAC.  An 8021q
+ * sub-interface with ID N enslaved to Vlan<N> makes its parent a trunk
+ * carrying N tagged; if the parent is itself enslaved to Vlan<M>, M is the
+ * trunk's native VLAN.  A port's link is up while it has IFF_RUNNING,
+ * which takes LAG members in and out of their member tables.  Runs only
+ * when the snapshot generation has changed since the last pass, and parks
+ * the other workers only if a port actually changes.
+ */
+static void reconcile(void)
+{
+    const struct vlan_snapshot *snap;
+    uint16_t old_vid[DP_MAX_PORTS];
+    uint64_t was_trunk = 0;
+    uint64_t moved = 0;
+    unsigned nwant = 0;
+    unsigned i, j;
+
+    snap = vlan_state_read_begin();
+    if (!snap || snap->generation == g_seen_generation)
+    {
+        vlan_state_read_end();
+        return;
+    }
+    g_seen_generation = snap->generation;
+
+    for (i = 1; i < VLAN_ID_SPACE; i++)
+    {
+        const struct vs_link *b = snap->bridge_ifindex[i]
+                                ? vlan_snapshot_find_index(snap, snap->bridge_ifindex[i]) : NULL;
+        uint64_t rmac = b ? mac48(b->addr) : 0;
+
+        if (g_rmac[i] != rmac)
+            __atomic_store_n(&g_rmac[i], rmac, __ATOMIC_RELAXED);
+    }
+
+    for (i = 0; i < snap->nlinks; i++)
+    {
+        const struct vs_link *l = &snap->links[i];
+        struct dp_want *w;
+
+        if (l->member_vlan <= 0)
+            continue;
+
+        if (strcmp(l->kind, "vlan") == 0 && l->parent > 0)
+        {
+            const struct vs_link *parent = vlan_snapshot_find_index(snap, l->parent);
+
+            /* A sub-interface whose ID differs from its bridge would be a
+             * translation, which this plane does not do. */
+            if (!parent || l->vlan_id != l->member_vlan || (w = want_get(&nwant, parent)) == NULL)
+                continue;
+            w->cfg.trunk = 1;
+            w->cfg.tagged[l->vlan_id / 64] |= 1ull << (l->vlan_id % 64);
+            w->down = !(parent->flags & IFF_RUNNING);
+        }
+        else if ((w = want_get(&nwant, l)) != NULL)
+        {
+            w->cfg.vid = (uint16_t)l->member_vlan;
+            w->down = !(l->flags & IFF_RUNNING);
+        }
+    }
+    vlan_state_read_end();
+
+    for (i = 0; i < DP_MAX_PORTS; i++)
+    {
+        const struct dp_want *w = want_find(nwant, g_ports[i].ifindex);
+
+        if (g_ports[i].in_use && !(w && cfg_equal(&w->cfg, &g_ports[i].cfg)))
+            break;
+    }
+    for (j = 0; i == DP_MAX_PORTS && j < nwant && port_by_ifindex(g_want[j].ifindex); j++)
+        ;
+    if (i == DP_MAX_PORTS && j == nwant)
+    {
+        lag_link_sync(nwant);
+        return;
+    }
+
+    park_others();
+    for (i = 0; i < DP_MAX_PORTS; i++)
+    {
+        struct dp_port *p = &g_ports[i];
+        const struct dp_want *w;
+
+        if (!p->in_use)
+            continue;
+        w = want_find(nwant, p->ifindex);
+        if (w && cfg_equal(&w->cfg, &p->cfg))
+            continue;
+
+        old_vid[i] = p->cfg.vid;
+        moved |= 1ull << i;
+        if (p->cfg.trunk)
+            was_trunk |= 1ull << i;
+        if (!w)
+            slot_detach(p);
+        else
+            slot_attach(p->name, p->ifindex, &w->cfg);
+    }
+
+    for (i = 0; i < nwant; i++)
+    {
+        if (!port_by_ifindex(g_want[i].ifindex))
+            slot_attach(g_want[i].name, g_want[i].ifindex, &g_want[i].cfg);
+    }
+
+    flush_departed(moved, was_trunk, old_vid);
+    lag_regroup();
+    lag_link_sync(nwant);
+    unpark_others();
+}
+
+static int trace_inject(struct dp_worker *w, const struct dp_ctl *req);
+
+static void handle_ctl(void)
+{
+    struct dp_port *p;
+
+    pthread_mutex_lock(&g_ctl_lock);
+    if (g_ctl_req && !g_ctl_req->done && g_ctl_req->op == DP_CTL_TRACE)
+    {
+        /* Forwarding changes no table: the other workers keep running. */
+        g_ctl_req->result = trace_inject(&g_workers[0], g_ctl_req);
+        g_ctl_req->done = 1;
+        pthread_cond_broadcast(&g_ctl_cond);
+    }
+    else if (g_ctl_req && !g_ctl_req->done)
+    {
+        struct dp_ctl *req = g_ctl_req;
+        uint16_t old_vid[DP_MAX_PORTS];
+        uint64_t was_trunk = 0;
+        uint64_t moved = 0;
+
+        p = port_by_ifindex(req->ifindex);
+        if (p && (req->op == DP_CTL_DETACH || !cfg_equal(&p->cfg, &req->cfg)))
+        {
+            old_vid[slot_of(p)] = p->cfg.vid;
+            moved = 1ull << slot_of(p);
+            if (p->cfg.trunk)
+                was_trunk = moved;
+        }
+
+        park_others();
+        if (req->op == DP_CTL_ATTACH)
+        {
+            req->result = slot_attach(req->name, req->ifindex, &req->cfg);
+            flush_departed(moved, was_trunk, old_vid);
+        }
+        else if (req->op == DP_CTL_LAG)
+        {
+            req->result = 0;
+        }
+        else if (p)
+        {
+            slot_detach(p);
+            flush_departed(moved, was_trunk, old_vid);
+            req->result = 0;
+        }
+        else
+        {
+            req->result = -ENOENT;
+        }
+        lag_regroup();
+        unpark_others();
+        req->done = 1;
+        pthread_cond_broadcast(&g_ctl_cond);
+    }
+    atomic_store(&g_ctl_pending, 0);
+    pthread_mutex_unlock(&g_ctl_lock);
+}
+
+/* ---------------------------------------------------------------------------
+ * Fast path
+ * --------------------------------------------------------------------------- */
+
+/*
+ * ingress_vid() - VLAN of a parsed frame received on @p in, or 0 to drop it.
+ *
+ * Untagged and priority-tagged frames belong to the access / native VLAN;
+ * tagged frames are accepted only for a VLAN the trunk carries, after the
+ * port's translation, if any, has turned a C-VID into that VLAN.  A port
+ * carries a VLAN it translates to under the C-VID only.
+ */
+static inline uint16_t ingress_vid(const struct dp_port *in, const struct dp_frame *f)
+{
+    const struct vlan_xlate *x;
+    uint16_t vid = f->vlan_valid ? (uint16_t)(f->vlan_tci & 0x0FFF) : 0;
+
+    if (vid == 0)
+        return in->cfg.vid;
+    x = __atomic_load_n(&g_port_xlate[slot_of(in)], __ATOMIC_ACQUIRE);
+    if (__builtin_expect(x != NULL, 0))
+    {
+        uint16_t v = vlan_xlate_in(x, vid);
+
+        if (!v && vlan_xlate_out(x, vid))
+            return 0;
+        vid = v ? v : vid;
+    }
+    return cfg_tagged(&in->cfg, vid) ? vid : 0;
+}
+
+/* VID that VLAN @p vid is tagged with on slot @p slot: its C-VID if the
+ * port translates it. */
+static inline uint16_t egress_vid(unsigned slot, uint16_t vid)
+{
+    const struct vlan_xlate *x = __atomic_load_n(&g_port_xlate[slot], __ATOMIC_ACQUIRE);
+    uint16_t c;
+
+    if (__builtin_expect(x != NULL, 0) && (c = vlan_xlate_out(x, vid)) != 0)
+        return c;
+    return vid;
+}
+
+/* Add a step to the trace of the frame @p w is forwarding, if it traces one. */
+static inline void trace_at(struct dp_worker *w, unsigned stage, unsigned verdict,
+                            unsigned port, uint32_t arg)
+{
+    if (__builtin_expect(w->trace != NULL, 0))
+        trace_step(w->trace, stage, verdict, port, arg);
+}
+
+/*
+ * backlog_add() - Queue a copy of @p f, tagged with @p tci unless it is 0,
+ * behind the frames @p w already holds for port slot @p slot.
+ *
+ * @return 0, -EMSGSIZE if the frame does not fit a TX slot, or -ENOBUFS if
+ *         the backlog or the pool is full.
+ */
+static int backlog_add(struct dp_worker *w, unsigned slot, const struct dp_frame *f, uint16_t tci)
+{
+    struct dp_backlog *bl = &w->backlog[slot];
+    struct dp_mbuf *m;
+
+    if (f->len + (tci ? 4 : 0) > DP_TX_MAX_LEN)
+        return -EMSGSIZE;
+    if (bl->n >= DP_BACKLOG_MAX || (m = dpp_alloc(g_pool, w->cache)) == NULL)
+        return -ENOBUFS;
+
+    if (tci)
+        m->len = vt_tag_copy(m->data, f->data, f->len, tci);
+    else
+        memcpy(m->data, f->data, m->len = f->len);
+    m->next = NULL;
+    if (bl->tail)
+        bl->tail->next = m;
+    else
+        bl->head = m;
+    bl->tail = m;
+    bl->n++;
+    w->backlogged++;
+    return 0;
+}
+
+/* Move as much of @p w's backlog for @p slot into its TX ring as fits. */
+static void backlog_drain(struct dp_worker *w, unsigned slot)
+{
+    struct dp_backlog *bl = &w->backlog[slot];
+    struct dp_ring *ring = &w->ring[slot];
+    struct dp_mbuf *done[DP_BURST];
+    struct dp_mbuf *m;
+    unsigned n = 0;
+
+    while ((m = bl->head) != NULL && dp_ring_tx(ring, m->data, m->len) == 0)
+    {
+        bl->head = m->next;
+        bl->n--;
+        w->backlogged--;
+        done[n++] = m;
+        if (n == DP_BURST)
+        {
+            dpp_free_bulk(g_pool, w->cache, done, n);
+            n = 0;
+        }
+    }
+    if (!bl->head)
+        bl->tail = NULL;
+    if (n)
+        dpp_free_bulk(g_pool, w->cache, done, n);
+    dp_ring_tx_flush(ring);
+}
+
+/* Mirror sessions with port slot @p slot or VLAN @p vid as a source in
+ * direction @p d (0: rx, 1: tx). */
+static inline unsigned mirror_sessions(unsigned slot, unsigned vid, unsigned d)
+{
+    return __atomic_load_n(&g_port_mirror[slot][d], __ATOMIC_RELAXED) |
+           __atomic_load_n(&g_vlan_mirror[vid][d], __ATOMIC_RELAXED);
+}
+
+/*
+ * mirror_frame() - Offer @p f, seen in VLAN @p vid on port slot @p slot
+ * in direction @p dir with tag @p tci (0: untagged), to mirror sessions
+ * @p sessions.
+ *
+ * Each session that samples the frame gets a copy in @p w's ring; a full
+ * ring drops the copy.
+ */
+static void mirror_frame(struct dp_worker *w, unsigned sessions, const struct dp_frame *f,
+                         uint16_t tci, uint16_t vid, unsigned dir, unsigned slot)
+{
+    struct mirror_ring *r = __atomic_load_n(&w->mring, __ATOMIC_ACQUIRE);
+    struct mirror_rec *rec;
+    struct timespec ts;
+    uint64_t now = 0;
+
+    for (; r && sessions; sessions &= sessions - 1)
+    {
+        unsigned s = (unsigned)__builtin_ctz(sessions);
+        const struct dp_mirror *m = &g_mirrors[s];
+
+        if (m->cfg.sample > 1 && ++w->mirror_seen[s] % m->cfg.sample)
+            continue;
+        if ((rec = mirror_ring_reserve(r)) == NULL)
+        {
+            stat_add(&w->mirror_drops[s], 1);
+            stat_add(&w->stats.mirror_drops, 1);
+            continue;
+        }
+        if (!now)
+        {
+            clock_gettime(CLOCK_REALTIME, &ts);
+            now = (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+        }
+        mirror_rec_fill(rec, f->data, f->len, tci, m->cfg.snaplen);
+        rec->ts_ns = now;
+        rec->session = (uint8_t)s;
+        rec->dir = (uint8_t)dir;
+        rec->port = (uint16_t)slot;
+        rec->vid = vid;
+        mirror_ring_commit(r);
+    }
+}
+
+/*
+ * sflow_burst() - Count @p n frames received on @p in, sampled at 1 in
+ * @p rate, and queue the ones the countdown falls on for the sFlow thread.
+ */
+static void sflow_burst(struct dp_worker *w, const struct dp_port *in, const struct dp_frame *f,
+                        unsigned n, uint32_t rate)
+{
+    unsigned slot = slot_of(in);
+    uint32_t skip = w->sflow_skip[slot];
+    struct mirror_ring *r;
+    struct mirror_rec *rec;
+    unsigned i;
+
+    stat_add(&w->sflow_pool[slot], n);
+    if (skip > n)
+    {
+        w->sflow_skip[slot] = skip - n;
+        return;
+    }
+    r = __atomic_load_n(&w->sring, __ATOMIC_ACQUIRE);
+    for (i = (skip ? skip : sflow_skip(&w->sflow_rng, rate)) - 1; i < n;
+         i += sflow_skip(&w->sflow_rng, rate))
+    {
+        if (!r || (rec = mirror_ring_reserve(r)) == NULL)
+        {
+            stat_add(&w->sflow_drops[slot], 1);
+            continue;
+        }
+        mirror_rec_fill(rec, f[i].data, f[i].len, f[i].vlan_valid ? f[i].vlan_tci : 0,
+                        __atomic_load_n(&g_sflow_header, __ATOMIC_RELAXED));
+        rec->ts_ns = 0;
+        rec->session = 0;
+        rec->dir = MIRROR_RX;
+        rec->port = (uint16_t)slot;
+        rec->vid = ingress_vid(in, &f[i]);
+        mirror_ring_commit(r);
+    }
+    w->sflow_skip[slot] = i - n + 1;
+}
+
+/* Transmit @p f in VLAN @p vid, tagged (translated) unless it is @p out's
+ * access/native VLAN. */
+static inline void port_tx(struct dp_worker *w, struct dp_port *out, const struct dp_frame *f,
+                           uint16_t vid)
+{
+    unsigned slot = slot_of(out);
+    struct dp_ring *ring = &w->ring[slot];
+    struct dp_counters *pc, *vc;
+    uint16_t tci = 0;
+    int err = -ENOBUFS;
+
+    if (out->cfg.vid != vid)
+        tci = (uint16_t)((f->vlan_valid ? f->vlan_tci & 0xF000 : 0) | egress_vid(slot, vid));
+
+    /* Behind a backlog the frame must queue too, or it would overtake. */
+    if (w->backlog[slot].n == 0)
+        err = tci ? dp_ring_tx_tagged(ring, f->data, f->len, tci)
+                  : dp_ring_tx(ring, f->data, f->len);
+    if (err == -ENOBUFS)
+        err = backlog_add(w, slot, f, tci);
+
+    pc = &w->shard.port[slot_of(out)].c;
+    vc = &w->shard.vlan[vid].c;
+    if (err == 0)
+    {
+        unsigned ms;
+
+        dps_add(&pc->tx_packets, 1);
+        dps_add(&pc->tx_bytes, f->len);
+        dps_add(&vc->tx_packets, 1);
+        dps_add(&vc->tx_bytes, f->len);
+        if (__atomic_load_n(&g_mirror_sources, __ATOMIC_RELAXED) &&
+            (ms = mirror_sessions(slot, vid, 1)) != 0)
+            mirror_frame(w, ms, f, tci, vid, MIRROR_TX, slot);
+    }
+    else
+    {
+        dps_add(&pc->tx_dropped, 1);
+        dps_add(&vc->tx_dropped, 1);
+    }
+    trace_at(w, TRACE_TX, err == 0 ? TRACE_SENT : TRACE_DROP, slot, tci);
+}
+
+/* Slot that stands for slot @p slot in the FDB: its LAG's representative. */
+static inline unsigned port_id(unsigned slot)
+{
+    unsigned l = g_port_lag[slot];
+
+    return l ? g_lags[l - 1].rep : slot;
+}
+
+/* Slots a frame received on slot @p slot must not go back to: its LAG. */
+static inline uint64_t port_group(unsigned slot)
+{
+    unsigned l = g_port_lag[slot];
+
+    return l ? g_lags[l - 1].ports : 1ull << slot;
+}
+
+/* Port that transmits @p f for slot @p slot: the slot itself, or the member
+ * of its LAG that @p f's flow hashes to; NULL if no member is up. */
+static inline struct dp_port *egress_port(struct dp_worker *w, unsigned slot,
+                                          const struct dp_frame *f)
+{
+    const struct dp_lag *g;
+    unsigned l = g_port_lag[slot];
+    int m;
+
+    if (!l)
+        return &g_ports[slot];
+    g = &g_lags[l - 1];
+    m = lag_select(&g->table, lag_hash(f->data, f->len, g->hash));
+    if (m < 0)
+    {
+        stat_add(&w->stats.lag_drops, 1);
+        return NULL;
+    }
+    return &g_ports[m];
+}
+
+/* Copy @p f to every member of VLAN @p vid except the ports in @p skip; a
+ * LAG gets one copy. */
+static inline void flood(struct dp_worker *w, uint64_t skip, const struct dp_frame *f,
+                         uint16_t vid)
+{
+    uint64_t m = g_flood[vid] & ~(skip | g_lag_hidden);
+
+    while (m)
+    {
+        struct dp_port *o = egress_port(w, (unsigned)__builtin_ctzll(m), f);
+
+        if (o)
+            port_tx(w, o, f, vid);
+        m &= m - 1;
+    }
+}
+
+static inline void mac_put(uint8_t *p, uint64_t mac)
+{
+    unsigned b;
+
+    for (b = 0; b < 6; b++)
+        p[b] = (uint8_t)(mac >> (40 - 8 * b));
+}
+
+/*
+ * route_burst() - Route the frames of @p f selected by @p l3.
+ *
+ * Each is rewritten for its next hop, and vid[i] / dst[i] are set to the
+ * egress VLAN and the next hop's FDB key.
+ *
+ * @return the frames of @p l3 that must be dropped.
+ */
+static uint64_t route_burst(struct dp_worker *w, struct dp_frame *f, uint16_t *vid,
+                            uint64_t *dst, uint64_t l3)
+{
+    uint32_t addr[DP_BURST];
+    uint16_t out_vid[DP_BURST];
+    uint64_t out_mac[DP_BURST];
+    uint64_t drop = 0;
+    uint64_t ok;
+    uint64_t m;
+    unsigned i;
+
+    memset(addr, 0, sizeof(addr));
+    for (m = l3; m; m &= m - 1)
+    {
+        const uint8_t *ip;
+
+        i = (unsigned)__builtin_ctzll(m);
+        ip = f[i].data + ETH_HLEN;
+        /* TTL 1 would expire here; that needs ICMP, which is the kernel's job. */
+        if (f[i].len < ETH_HLEN + 20 || (ip[0] >> 4) != 4 || (ip[0] & 0x0F) < 5 || ip[8] <= 1)
+            drop |= 1ull << i;
+        else
+            addr[i] = (uint32_t)ip[16] << 24 | (uint32_t)ip[17] << 16 | (uint32_t)ip[18] << 8 | ip[19];
+    }
+
+    ok = l3_resolve_burst(addr, DP_BURST, out_vid, out_mac) & l3 & ~drop;
+    drop |= l3 & ~ok;
+
+    for (m = ok; m; m &= m - 1)
+    {
+        uint8_t *eth, *ip;
+        uint32_t sum;
+
+        i = (unsigned)__builtin_ctzll(m);
+        eth = f[i].data;
+        ip = eth + ETH_HLEN;
+
+        /* TTL is the high byte of its header word: RFC 1624 update. */
+        ip[8]--;
+        sum = (uint32_t)(ip[10] << 8 | ip[11]) + 0x0100;
+        sum = (sum & 0xFFFF) + (sum >> 16);
+        ip[10] = (uint8_t)(sum >> 8);
+        ip[11] = (uint8_t)sum;
+
+        mac_put(eth, out_mac[i]);
+        mac_put(eth + 6, __atomic_load_n(&g_rmac[out_vid[i]], __ATOMIC_RELAXED));
+        vid[i] = out_vid[i];
+        dst[i] = fdb_key(vid[i], eth);
+    }
+
+    stat_add(&w->stats.routed, (uint64_t)__builtin_popcountll(ok));
+    if (drop)
+        stat_add(&w->stats.route_drops, (uint64_t)__builtin_popcountll(drop));
+    return drop;
+}
+
+/*
+ * storm_meter() - Claim the frames @p sel of @p f from bucket @p s at @p now.
+ *
+ * @return the frames of @p sel that exceed the bucket's rate.
+ */
+static uint64_t storm_meter(struct dp_storm *s, const struct dp_frame *f, uint64_t sel,
+                            uint64_t now)
+{
+    uint32_t len[DP_BURST];
+    uint8_t idx[DP_BURST];
+    uint64_t pass;
+    uint64_t over = 0;
+    unsigned m = 0;
+
+    if (!sel || !storm_tb_on(&s->tb))
+        return 0;
+    for (; sel; sel &= sel - 1)
+    {
+        idx[m] = (uint8_t)__builtin_ctzll(sel);
+        len[m] = f[idx[m]].len;
+        m++;
+    }
+    pass = storm_tb_claim(&s->tb, now, len, m);
+    while (m--)
+    {
+        if (!(pass & (1ull << m)))
+            over |= 1ull << idx[m];
+    }
+    return over;
+}
+
+/*
+ * storm_burst() - Meter the frames of @p f that would flood: broadcast,
+ * multicast, and unicast whose destination @p out[] is unknown or no longer
+ * in the VLAN.  Frames in @p skip are already dropped.
+ *
+ * The port's buckets see every such frame, the VLANs' buckets only those
+ * the port's let through.
+ *
+ * @return the frames over a rate.
+ */
+static uint64_t storm_burst(struct dp_worker *w, const struct dp_port *in,
+                            const struct dp_frame *f, const uint16_t *vid,
+                            const uint8_t *out, uint64_t skip, unsigned n)
+{
+    static const uint8_t bcast[6] = { 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF };
+    struct dp_storm *ps = g_port_storm[slot_of(in)];
+    uint64_t sel[STORM_NCLASSES] = { 0 };
+    uint64_t all, over;
+    struct timespec ts;
+    uint64_t now;
+    unsigned i, c;
+
+    for (i = 0; i < n; i++)
+    {
+        const uint8_t *dst = f[i].data;
+
+        if (skip & (1ull << i))
+            continue;
+        if (dst[0] & 0x01)
+            c = memcmp(dst, bcast, 6) == 0 ? STORM_BCAST : STORM_MCAST;
+        else if (out[i] == FDB_PORT_NONE || !vlan_has_port(vid[i], out[i]))
+            c = STORM_UNKNOWN;
+        else
+            continue;
+        sel[c] |= 1ull << i;
+    }
+    all = sel[STORM_BCAST] | sel[STORM_MCAST] | sel[STORM_UNKNOWN];
+    if (!all)
+        return 0;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    now = (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+    for (c = 0; c < STORM_NCLASSES; c++)
+    {
+        uint64_t todo;
+
+        sel[c] &= ~storm_meter(&ps[c], f, sel[c], now);
+
+        /* Then one claim per VLAN of the class present in the burst. */
+        for (todo = sel[c]; todo; )
+        {
+            uint16_t v = vid[__builtin_ctzll(todo)];
+            uint64_t same = 0;
+            uint64_t m;
+
+            for (m = todo; m; m &= m - 1)
+            {
+                if (vid[__builtin_ctzll(m)] == v)
+                    same |= m & -m;
+            }
+            todo &= ~same;
+            sel[c] &= ~storm_meter(&g_vlan_storm[v][c], f, same, now);
+        }
+    }
+
+    over = all & ~(sel[STORM_BCAST] | sel[STORM_MCAST] | sel[STORM_UNKNOWN]);
+    if (over)
+        stat_add(&w->stats.storm_drops, (uint64_t)__builtin_popcountll(over));
+    return over;
+}
+
+static inline int snoop_vlan(unsigned vid)
+{
+    return (__atomic_load_n(&g_snoop_on[vid / 64], __ATOMIC_RELAXED) >> (vid % 64)) & 1;
+}
+
+/* Queue IGMP / MLD message @p f received on @p in in VLAN @p vid for the
+ * snooping thread; a full queue drops it (the frame itself still floods). */
+static void snoop_post(struct dp_worker *w, const struct dp_port *in, const struct dp_frame *f,
+                       uint16_t vid)
+{
+    struct dp_snoop_msg *m = NULL;
+
+    pthread_mutex_lock(&g_snoopq_lock);
+    if (g_snoopq_n < DP_SNOOP_QUEUE)
+    {
+        m = &g_snoopq[(g_snoopq_head + g_snoopq_n++) % DP_SNOOP_QUEUE];
+        m->vid = vid;
+        m->slot = (uint16_t)port_id(slot_of(in));
+        m->len = (uint16_t)(f->len < DP_SNOOP_SNAPLEN ? f->len : DP_SNOOP_SNAPLEN);
+        memcpy(m->data, f->data, m->len);
+        pthread_cond_signal(&g_snoopq_cond);
+    }
+    pthread_mutex_unlock(&g_snoopq_lock);
+    if (!m)
+        stat_add(&w->stats.snoop_overruns, 1);
+}
+
+/*
+ * mcast_prune() - Ports multicast frame @p f of snooped VLAN @p vid must
+ * not be flooded to: those without a listener for its group, unless they
+ * are router ports of the VLAN.
+ *
+ * IGMP / MLD messages are posted to the snooping thread; they, link-local
+ * traffic and groups without listeners flood.
+ *
+ * @return the ports to leave out, 0 to flood.
+ */
+static uint64_t mcast_prune(struct dp_worker *w, const struct dp_port *in,
+                            const struct dp_frame *f, uint16_t vid)
+{
+    const struct snoop_table *t;
+    struct snoop_key k;
+    uint64_t ports;
+
+    switch (snoop_classify(f->data, f->len, vid, &k))
+    {
+    case SNOOP_CONTROL:
+        snoop_post(w, in, f, vid);
+        return 0;
+    case SNOOP_DATA:
+        t = __atomic_load_n(&g_mdb, __ATOMIC_ACQUIRE);
+        ports = t ? snoop_lookup(t, &k) : 0;
+        if (!ports)
+            return 0;
+        stat_add(&w->stats.mcast_pruned, 1);
+        return ~(ports | __atomic_load_n(&g_mrouter[vid], __ATOMIC_RELAXED));
+    default:
+        return 0;
+    }
+}
+
+/*
+ * forward_burst() - Learn and forward @p n admitted frames received on @p in.
+ *
+ * Source keys are learned and destination keys looked up a burst at a time
+ * so the FDB can prefetch their buckets.  IPv4 frames to the VLAN's router
+ * MAC go through route_burst() first and are then forwarded in their egress
+ * VLAN, where they may leave through @p in again.  A switched destination
+ * learned on @p in itself, or on its LAG, is filtered; one whose port has
+ * since left the VLAN is flooded.  Frames that would flood pass storm
+ * control first, and multicast in a snooped VLAN floods only to its
+ * group's listeners.
+ */
+static void forward_burst(struct dp_worker *w, struct dp_port *in, struct dp_frame *f,
+                          uint16_t *vid, unsigned n)
+{
+    uint64_t src[DP_BURST];
+    uint64_t dst[DP_BURST];
+    uint8_t out[DP_BURST];
+    uint64_t l3 = 0;
+    uint64_t drop = 0;
+    uint64_t group;
+    unsigned nsrc = 0;
+    unsigned i;
+
+    for (i = 0; i < n; i++)
+    {
+        const uint8_t *eth = f[i].data;
+        struct dp_counters *vc = &w->shard.vlan[vid[i]].c;
+        uint64_t rmac = __atomic_load_n(&g_rmac[vid[i]], __ATOMIC_RELAXED);
+
+        dps_add(&vc->rx_packets, 1);
+        dps_add(&vc->rx_bytes, f[i].len);
+        dst[i] = fdb_key(vid[i], eth);
+        if (!(eth[6] & 0x01))
+            src[nsrc++] = fdb_key(vid[i], eth + 6);
+        if (rmac && (dst[i] & 0xFFFFFFFFFFFFull) == rmac && eth[12] == 0x08 && eth[13] == 0x00)
+            l3 |= 1ull << i;
+    }
+
+    fdb_learn_burst(g_fdb, src, nsrc, (uint8_t)port_id(slot_of(in)), (uint32_t)(w->now_ms / 1000));
+    trace_at(w, TRACE_LEARN, nsrc ? TRACE_PASS : TRACE_SKIP, port_id(slot_of(in)), vid[0]);
+    if (l3)
+    {
+        drop = route_burst(w, f, vid, dst, l3);
+        trace_at(w, TRACE_ROUTE, drop ? TRACE_DROP : TRACE_PASS, slot_of(in), vid[0]);
+    }
+    fdb_lookup_burst(g_fdb, dst, n, out);
+    trace_at(w, TRACE_LOOKUP, out[0] == FDB_PORT_NONE ? TRACE_MISS : TRACE_HIT, out[0], vid[0]);
+    if (__atomic_load_n(&g_storm_on, __ATOMIC_RELAXED))
+    {
+        drop |= storm_burst(w, in, f, vid, out, drop, n);
+        trace_at(w, TRACE_STORM, drop ? TRACE_DROP : TRACE_PASS, slot_of(in), vid[0]);
+    }
+
+    group = port_group(slot_of(in));
+    for (i = 0; i < n; i++)
+    {
+        uint64_t skip = (l3 & (1ull << i)) ? 0 : group;
+        struct dp_port *o;
+
+        if (drop & (1ull << i))
+            continue;
+        if (out[i] == FDB_PORT_NONE || (f[i].data[0] & 0x01))
+        {
+            if ((f[i].data[0] & 0x01) && snoop_vlan(vid[i]))
+                skip |= mcast_prune(w, in, &f[i], vid[i]);
+            trace_at(w, TRACE_FORWARD, TRACE_FLOOD, slot_of(in), vid[i]);
+            flood(w, skip, &f[i], vid[i]);
+            continue;
+        }
+        if (skip & (1ull << out[i]))
+        {
+            trace_at(w, TRACE_FORWARD, TRACE_FILTER, out[i], vid[i]);
+            continue;
+        }
+        if (!vlan_has_port(vid[i], out[i]))
+        {
+            trace_at(w, TRACE_FORWARD, TRACE_FLOOD, slot_of(in), vid[i]);
+            flood(w, skip, &f[i], vid[i]);
+        }
+        else if ((o = egress_port(w, out[i], &f[i])) != NULL)
+        {
+            trace_at(w, TRACE_FORWARD, TRACE_UNICAST, slot_of(o), vid[i]);
+            port_tx(w, o, &f[i], vid[i]);
+        }
+        else
+        {
+            trace_at(w, TRACE_FORWARD, TRACE_DROP, out[i], vid[i]);
+        }
+    }
+}
+
+static inline struct acl *acl_table(const struct dp_acl *d)
+{
+    return __atomic_load_n(&d->table, __ATOMIC_ACQUIRE);
+}
+
+/*
+ * acl_burst() - Run @p n classified frames of @p in through the ACLs of
+ * the port and of their VLANs @p vid[].
+ *
+ * A frame the port ACL denies is not looked up again; the others are
+ * grouped by VLAN ACL so that each table is searched once per burst.
+ *
+ * @return the mask of denied frames.
+ */
+static uint64_t acl_burst(struct dp_worker *w, const struct dp_port *in,
+                          const struct dp_frame *f, const uint16_t *vid, unsigned n)
+{
+    const struct dp_acl *pa = __atomic_load_n(&g_port_acl[slot_of(in)], __ATOMIC_ACQUIRE);
+    const struct dp_acl *va[DP_BURST];
+    struct acl_key keys[DP_BURST];
+    struct acl_key sub[DP_BURST];
+    uint64_t todo = 0;
+    uint64_t deny = 0;
+    unsigned i;
+
+    for (i = 0; i < n; i++)
+    {
+        va[i] = __atomic_load_n(&g_vlan_acl[vid[i]], __ATOMIC_ACQUIRE);
+        if (va[i])
+            todo |= 1ull << i;
+    }
+    if (!pa && !todo)
+        return 0;
+
+    for (i = 0; i < n; i++)
+        acl_key_parse(f[i].data, f[i].len, &keys[i]);
+    if (pa)
+        deny = acl_classify_burst(acl_table(pa), keys, n, w->id);
+
+    todo &= ~deny;
+    while (todo)
+    {
+        const struct dp_acl *d = va[__builtin_ctzll(todo)];
+        unsigned idx[DP_BURST];
+        unsigned m = 0;
+        uint64_t rest, res;
+
+        for (rest = todo; rest; rest &= rest - 1)
+        {
+            i = (unsigned)__builtin_ctzll(rest);
+            if (va[i] != d)
+                continue;
+            idx[m] = i;
+            sub[m++] = keys[i];
+            todo &= ~(1ull << i);
+        }
+        for (res = acl_classify_burst(acl_table(d), sub, m, w->id); res; res &= res - 1)
+            deny |= 1ull << idx[__builtin_ctzll(res)];
+    }
+    return deny;
+}
+
+/*
+ * ingress_burst() - Parse tags, classify and forward @p n frames of @p in.
+ *
+ * @return the number of frames dropped at ingress.
+ */
+static unsigned ingress_burst(struct dp_worker *w, struct dp_port *in, struct dp_frame *f,
+                              unsigned n)
+{
+    uint16_t vid[DP_BURST];
+    uint64_t drop;
+    unsigned mirror = __atomic_load_n(&g_mirror_sources, __ATOMIC_RELAXED);
+    uint32_t rate = __atomic_load_n(&g_sflow_rate[slot_of(in)], __ATOMIC_RELAXED);
+    unsigned k = 0;
+    unsigned i, ms;
+
+    drop = vt_parse_burst(f, n);
+    trace_at(w, TRACE_PARSE, drop ? TRACE_DROP : TRACE_PASS, slot_of(in),
+             f[0].vlan_valid ? TRACE_TAGGED | f[0].vlan_tci : 0);
+    /* Every frame counts towards the sample pool, admitted or not. */
+    if (rate)
+        sflow_burst(w, in, f, n, rate);
+    for (i = 0; i < n; i++)
+    {
+        if (drop & (1ull << i))
+            continue;
+        vid[k] = ingress_vid(in, &f[i]);
+        /* As received: before the ACLs, and with the tag it came with. */
+        if (mirror && (ms = mirror_sessions(slot_of(in), vid[k], 0)) != 0)
+            mirror_frame(w, ms, &f[i], f[i].vlan_valid ? f[i].vlan_tci : 0, vid[k], MIRROR_RX,
+                         slot_of(in));
+        if (vid[k] == 0)
+        {
+            /* Charge a tag the port does not carry to its VLAN. */
+            if (f[i].vlan_valid && (f[i].vlan_tci & 0x0FFF))
+                dps_add(&w->shard.vlan[f[i].vlan_tci & 0x0FFF].c.rx_dropped, 1);
+            continue;
+        }
+        if (k != i)
+            f[k] = f[i];
+        k++;
+    }
+    trace_at(w, TRACE_CLASSIFY, k ? TRACE_PASS : TRACE_DROP, slot_of(in),
+             k ? vid[0] : f[0].vlan_valid ? f[0].vlan_tci & 0x0FFF : 0);
+    if (k && __atomic_load_n(&g_acl_bound, __ATOMIC_RELAXED))
+    {
+        uint64_t deny = acl_burst(w, in, f, vid, k);
+
+        trace_at(w, TRACE_ACL, deny ? TRACE_DROP : TRACE_PASS, slot_of(in), vid[0]);
+        if (deny)
+        {
+            unsigned m = 0;
+
+            for (i = 0; i < k; i++)
+            {
+                if (deny & (1ull << i))
+                    continue;
+                f[m] = f[i];
+                vid[m++] = vid[i];
+            }
+            stat_add(&w->stats.acl_drops, k - m);
+            k = m;
+        }
+    }
+    if (k)
+        forward_burst(w, in, f, vid, k);
+    return n - k;
+}
+
+/*
+ * trace_live() - Forward @p f received on @p in as a burst of its own,
+ * tracing it into the next slot of @p w's recent traces.
+ *
+ * @return 1 if it was dropped at ingress, else 0.
+ */
+static unsigned trace_live(struct dp_worker *w, struct dp_port *in, struct dp_frame *f)
+{
+    struct dp_trace_slot *ts = &w->traces[w->ntraces % DP_TRACE_KEEP];
+    struct trace t;
+    unsigned dropped;
+
+    trace_start(&t, slot_of(in), f->data, f->len);
+    w->trace = &t;
+    dropped = ingress_burst(w, in, f, 1);
+    w->trace = NULL;
+    w->trace_ms = w->now_ms;
+
+    __atomic_store_n(&ts->seq, ts->seq + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    ts->t = t;
+    __atomic_store_n(&ts->seq, ts->seq + 1, __ATOMIC_RELEASE);
+    __atomic_store_n(&w->ntraces, w->ntraces + 1, __ATOMIC_RELEASE);
+    return dropped;
+}
+
+/*
+ * trace_inject() - Forward the frame of trace request @p req as if
+ * received on its port, tracing it into req->trace; worker 0 only.
+ *
+ * The frame is copied first: parsing and routing rewrite it in place.
+ *
+ * @return 0, or -ENOENT if the port is no longer attached.
+ */
+static int trace_inject(struct dp_worker *w, const struct dp_ctl *req)
+{
+    struct dp_port *p = port_by_ifindex(req->ifindex);
+    uint8_t buf[DP_TRACE_FRAME_MAX];
+    struct dp_frame f;
+
+    if (!p)
+        return -ENOENT;
+    memcpy(buf, req->frame, req->len);
+    f.data = buf;
+    f.len = req->len;
+    f.vlan_tci = 0;
+    f.vlan_valid = 0;
+
+    trace_start(req->trace, slot_of(p), buf, req->len);
+    w->trace = req->trace;
+    ingress_burst(w, p, &f, 1);
+    w->trace = NULL;
+    flush_all(w);
+    return 0;
+}
+
+/* Process at most one RX block of @p w's ring on @p in; returns the number of frames. */
+static unsigned port_rx(struct dp_worker *w, struct dp_port *in)
+{
+    struct dp_ring *ring = &w->ring[slot_of(in)];
+    struct dp_frame f[DP_BURST];
+    struct dp_rx_burst burst;
+    struct dp_counters *pc;
+    uint32_t trate = __atomic_load_n(&g_trace_rate[slot_of(in)], __ATOMIC_RELAXED);
+    uint64_t bytes = 0;
+    uint64_t dropped = 0;
+    unsigned nf = 0;
+    unsigned n = 0;
+
+    if (!dp_ring_rx_burst(ring, &burst))
+        return 0;
+
+    while (dp_ring_rx_next(&burst, &f[nf]))
+    {
+        n++;
+        bytes += f[nf].len;
+        /* A traced frame goes on its own, after the frames before it. */
+        if (trate && ++w->trace_seen[slot_of(in)] >= trate && w->trace_ms != w->now_ms)
+        {
+            if (nf)
+                dropped += ingress_burst(w, in, f, nf);
+            dropped += trace_live(w, in, &f[nf]);
+            w->trace_seen[slot_of(in)] = 0;
+            nf = 0;
+            continue;
+        }
+        if (++nf == DP_BURST)
+        {
+            dropped += ingress_burst(w, in, f, nf);
+            nf = 0;
+        }
+    }
+    if (nf)
+        dropped += ingress_burst(w, in, f, nf);
+    dp_ring_rx_release(ring, &burst);
+
+    pc = &w->shard.port[slot_of(in)].c;
+    dps_add(&pc->rx_packets, n);
+    dps_add(&pc->rx_bytes, bytes);
+    if (dropped)
+        dps_add(&pc->rx_dropped, dropped);
+    stat_add(&w->stats.packets, n);
+    stat_add(&w->stats.bursts, 1);
+    return n;
+}
+
+/* Flush every TX ring of @p w and drain the backlogs behind them. */
+static void flush_all(struct dp_worker *w)
+{
+    unsigned i;
+
+    for (i = 0; i < g_nactive; i++)
+    {
+        dp_ring_tx_flush(&w->ring[g_active[i]]);
+        if (w->backlog[g_active[i]].n)
+            backlog_drain(w, g_active[i]);
+    }
+}
+
+static void *dp_worker_main(void *arg)
+{
+    struct dp_worker *w = arg;
+    struct pollfd pfd[DP_MAX_PORTS + 1];
+    uint64_t ev;
+    unsigned i;
+
+    while (!atomic_load(&g_stop))
+    {
+        unsigned work = 0;
+
+        __atomic_store_n(&w->qs, w->qs + 1, __ATOMIC_SEQ_CST);
+        if (w->id != 0 && atomic_load(&g_park))
+            park_wait(w);
+
+        w->now_ms = now_ms();
+        if (w->id == 0)
+        {
+            fdb_age(g_fdb, w->now_ms);
+            res_set_used(RES_FDB, fdb_count(g_fdb));
+        }
+
+        for (i = 0; i < g_nactive; i++)
+            work += port_rx(w, &g_ports[g_active[i]]);
+        if (work)
+            flush_all(w);
+
+        if (w->id == 0)
+        {
+            if (atomic_load(&g_ctl_pending))
+                handle_ctl();
+            if (g_flags & DP_F_FOLLOW_STATE)
+                reconcile();
+        }
+        if (work)
+            continue;
+
+        /* Idle: sleep until one of our rings has a block, a ring with a
+         * backlog has room, or we are woken.  Frames still queued after an
+         * -EAGAIN flush are retried here. */
+        flush_all(w);
+        pfd[0].fd = w->event_fd;
+        pfd[0].events = POLLIN;
+        for (i = 0; i < g_nactive; i++)
+        {
+            pfd[i + 1].fd = w->ring[g_active[i]].fd;
+            pfd[i + 1].events = POLLIN | POLLERR;
+            if (w->backlog[g_active[i]].n)
+                pfd[i + 1].events |= POLLOUT;
+        }
+
+        __atomic_store_n(&w->offline, 1, __ATOMIC_SEQ_CST);
+        if (poll(pfd, g_nactive + 1, DP_IDLE_POLL_MS) > 0 && (pfd[0].revents & POLLIN))
+        {
+            if (read(w->event_fd, &ev, sizeof(ev)) < 0)
+                ev = 0;
+        }
+        __atomic_store_n(&w->offline, 0, __ATOMIC_SEQ_CST);
+    }
+    return NULL;
+}
+
+/* Stop and join workers [0, @p n) and close the event descriptors. */
+static void workers_stop(unsigned n)
+{
+    unsigned k;
+
+    atomic_store(&g_stop, 1);
+    atomic_store(&g_park, 0);
+    pthread_mutex_lock(&g_park_lock);
+    pthread_cond_broadcast(&g_park_cond);
+    pthread_mutex_unlock(&g_park_lock);
+
+    for (k = 0; k < n; k++)
+        wake_worker(&g_workers[k]);
+    for (k = 0; k < n; k++)
+        pthread_join(g_workers[k].thread, NULL);
+    for (k = 0; k < g_nworkers; k++)
+    {
+        if (g_workers[k].event_fd >= 0)
+            close(g_workers[k].event_fd);
+        g_workers[k].event_fd = -1;
+    }
+}
+
+static void acls_free(void)
+{
+    unsigned i;
+
+    for (i = 0; i < DP_MAX_ACLS; i++)
+    {
+        if (g_acls[i].in_use)
+            res_free(RES_ACL, g_acls[i].table->nrules);
+        acl_destroy(g_acls[i].table);
+        g_acls[i].table = NULL;
+        g_acls[i].in_use = 0;
+    }
+    memset(g_port_acl, 0, sizeof(g_port_acl));
+    memset(g_vlan_acl, 0, sizeof(g_vlan_acl));
+    g_acl_bound = 0;
+}
+
+static void tables_free(void)
+{
+    unsigned k;
+
+    fdb_destroy(g_fdb);
+    res_set_used(RES_FDB, 0);
+    dps_destroy(g_stats);
+    dpp_destroy(g_pool);
+    for (k = 0; k < DP_MAX_WORKERS; k++)
+    {
+        dp_umem_destroy(g_workers[k].umem);
+        g_workers[k].umem = NULL;
+    }
+    g_fdb = NULL;
+    g_stats = NULL;
+    g_pool = NULL;
+}
+
+static void snoop_stop(void);
+static void mirror_stop(void);
+static void sflow_stop(void);
+
+/* ---------------------------------------------------------------------------
+ * Public API
+ * --------------------------------------------------------------------------- */
+
+/**
+ * dp_init() - Start the forwarding workers.
+ *
+ * @param flags     DP_F_FOLLOW_STATE to attach every VLAN member port of the
+ *                  link snapshot automatically; DP_F_XDP to use AF_XDP on
+ *                  every port with exactly @p nworkers RX queues (others,
+ *                  and kernels without AF_XDP, keep TPACKET).
+ * @param nworkers  forwarding threads, 1..DP_MAX_WORKERS; with more than
+ *                  one, every port's ingress is spread over them by flow.
+ * @param cpus      CPU to pin worker i to, or NULL to leave them floating.
+ *
+ * @return
+ *    0        – success. \n
+ *   -EALREADY – already running. \n
+ *   -EINVAL   – @p nworkers out of range. \n
+ *   -ENOMEM   – the FDB, the counters or a UMEM could not be allocated. \n
+ *   -errno    – eventfd, thread creation or pinning failed.
+ */
+int dp_init(unsigned flags, unsigned nworkers, const int *cpus)
+{
+    unsigned k;
+    int err;
+
+    if (g_running)
+        return -EALREADY;
+    if (nworkers < 1 || nworkers > DP_MAX_WORKERS)
+        return -EINVAL;
+
+    g_fdb = fdb_create(FDB_DEFAULT_BUCKETS, FDB_DEFAULT_AGE_S);
+    g_stats = dps_create(nworkers, DP_MAX_PORTS, VLAN_ID_SPACE, DPS_DEFAULT_INTERVAL_MS);
+    g_pool = dpp_create(DP_POOL_BUFS, nworkers);
+    if (!g_fdb || !g_stats || !g_pool)
+    {
+        tables_free();
+        return -ENOMEM;
+    }
+    fdb_set_limit(g_fdb, res_capacity(RES_FDB));
+
+    memset(g_ports, 0, sizeof(g_ports));
+    memset(g_flood, 0, sizeof(g_flood));
+    memset(g_rmac, 0, sizeof(g_rmac));
+    memset(g_workers, 0, sizeof(g_workers));
+    g_nworkers = nworkers;
+    for (k = 0; k < nworkers; k++)
+        g_workers[k].event_fd = -1;
+    for (k = 0; k < nworkers; k++)
+    {
+        struct dp_worker *w = &g_workers[k];
+        unsigned i;
+
+        w->id = k;
+        w->cpu = cpus ? cpus[k] : -1;
+        w->shard = dps_shard(g_stats, k);
+        w->cache = dpp_cache(g_pool, k);
+        w->now_ms = now_ms();
+        for (i = 0; i < DP_MAX_PORTS; i++)
+            w->ring[i].fd = -1;
+        w->event_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        err = w->event_fd < 0 ? -errno : 0;
+        if (err == 0 && (flags & DP_F_XDP) && !(w->umem = dp_umem_create()))
+            err = -ENOMEM;
+        if (err < 0)
+        {
+            workers_stop(0);
+            tables_free();
+            return err;
+        }
+    }
+
+    g_nactive = 0;
+    g_flags = flags;
+    g_seen_generation = 0;
+    g_parked = 0;
+    atomic_store(&g_stop, 0);
+    atomic_store(&g_park, 0);
+    atomic_store(&g_ctl_pending, 0);
+    clock_gettime(CLOCK_MONOTONIC, &g_started);
+
+    for (k = 0; k < nworkers; k++)
+    {
+        struct dp_worker *w = &g_workers[k];
+        char name[16];
+
+        err = pthread_create(&w->thread, NULL, dp_worker_main, w);
+        if (err == 0 && w->cpu >= 0)
+        {
+            cpu_set_t set;
+
+            CPU_ZERO(&set);
+            CPU_SET(w->cpu, &set);
+            err = pthread_setaffinity_np(w->thread, sizeof(set), &set);
+            if (err)
+                k++;            /* the thread exists and must be joined */
+        }
+        if (err)
+        {
+            workers_stop(k);
+            tables_free();
+            return -err;
+        }
+        snprintf(name, sizeof(name), "dp-worker%u", k);
+        pthread_setname_np(w->thread, name);
+    }
+
+    g_running = 1;
+    return 0;
+}
+
+/**
+ * dp_shutdown() - Stop the workers and detach every port.
+ */
+void dp_shutdown(void)
+{
+    unsigned i;
+
+    if (!g_running)
+        return;
+
+    snoop_stop();
+    workers_stop(g_nworkers);
+    mirror_stop();
+    sflow_stop();
+    for (i = 0; i < DP_MAX_PORTS; i++)
+    {
+        if (g_ports[i].in_use)
+            rings_close(i);
+        g_ports[i].in_use = 0;
+    }
+    memset(g_trace_rate, 0, sizeof(g_trace_rate));
+    for (i = 0; i < DP_MAX_PORTS; i++)
+    {
+        free(g_xlate_mem[i]);
+        g_xlate_mem[i] = NULL;
+        g_port_xlate[i] = NULL;
+    }
+    pthread_mutex_lock(&g_acl_lock);
+    acls_free();
+    pthread_mutex_unlock(&g_acl_lock);
+    pthread_mutex_lock(&g_storm_lock);
+    storm_set(&g_port_storm[0][0], DP_MAX_PORTS * STORM_NCLASSES, NULL);
+    storm_set(&g_vlan_storm[0][0], VLAN_ID_SPACE * STORM_NCLASSES, NULL);
+    pthread_mutex_unlock(&g_storm_lock);
+    pthread_mutex_lock(&g_snoop_lock);
+    snoop_table_free(g_mdb);
+    snoop_destroy(g_snooper);
+    g_mdb = NULL;
+    g_snooper = NULL;
+    g_mdb_dirty = 0;
+    memset(g_snoop_on, 0, sizeof(g_snoop_on));
+    memset(g_mrouter, 0, sizeof(g_mrouter));
+    pthread_mutex_unlock(&g_snoop_lock);
+    pthread_mutex_lock(&g_lag_lock);
+    memset(g_lags, 0, sizeof(g_lags));
+    memset(g_port_lag, 0, sizeof(g_port_lag));
+    g_lag_hidden = 0;
+    g_link_down = 0;
+    pthread_mutex_unlock(&g_lag_lock);
+    tables_free();
+    g_nactive = 0;
+    g_nworkers = 0;
+    g_running = 0;
+}
+
+/**
+ * dp_running() - Non-zero while the forwarding worker is started.
+ */
+int dp_running(void)
+{
+    return g_running;
+}
+
+static int post_ctl(struct dp_ctl *req)
+{
+    if (!g_running)
+        return -ENODEV;
+
+    req->done = 0;
+    pthread_mutex_lock(&g_ctl_lock);
+    while (g_ctl_req)
+        pthread_cond_wait(&g_ctl_cond, &g_ctl_lock);
+    g_ctl_req = req;
+    atomic_store(&g_ctl_pending, 1);
+    wake_worker(&g_workers[0]);
+
+    while (!req->done)
+        pthread_cond_wait(&g_ctl_cond, &g_ctl_lock);
+    g_ctl_req = NULL;
+    pthread_cond_broadcast(&g_ctl_cond);
+    pthread_mutex_unlock(&g_ctl_lock);
+
+    return req->result;
+}
+
+/**
+ * dp_port_attach() - Switch frames of @p name as an access port of @p vid.
+ *
+ * Re-attaching an attached port only changes its configuration; a trunk
+ * becomes an access port.
+ *
+ * @return
+ *    0        – success. \n
+ *   -EINVAL   – @p vid outside [1..4094] or @p name NULL. \n
+ *   -ENOENT   – no such interface. \n
+ *   -EBUSY    – membership is followed from the link snapshot. \n
+ *   -ENOSPC   – DP_MAX_PORTS ports are attached already. \n
+ *   -ENODEV   – the forwarding plane is not running. \n
+ *   -errno    – the packet ring could not be set up.
+ */
+int dp_port_attach(const char *name, uint16_t vid)
+{
+    struct dp_ctl req;
+
+    if (!name || vid < 1 || vid > 4094)
+        return -EINVAL;
+    if (g_flags & DP_F_FOLLOW_STATE)
+        return -EBUSY;
+
+    memset(&req, 0, sizeof(req));
+    req.op = DP_CTL_ATTACH;
+    snprintf(req.name, sizeof(req.name), "%s", name);
+    req.cfg.vid = vid;
+    req.ifindex = dp_ifindex(name);
+    if (req.ifindex < 0)
+        return -ENOENT;
+
+    return post_ctl(&req);
+}
+
+/**
+ * dp_port_trunk() - Switch frames of @p name as a trunk port.
+ *
+ * @param native  VLAN for untagged frames, or 0 to drop them.
+ * @param vids    VLANs carried tagged; @p nvids may be 0.
+ *
+ * Attaches the port if needed; otherwise replaces its configuration.
+ *
+ * @return as dp_port_attach(); -EINVAL also for a VLAN ID outside
+ *         [1..4094] in @p vids or @p native above 4094.
+ */
+int dp_port_trunk(const char *name, uint16_t native, const uint16_t *vids, unsigned nvids)
+{
+    struct dp_ctl req;
+    unsigned i;
+
+    if (!name || native > 4094 || (nvids && !vids))
+        return -EINVAL;
+    if (g_flags & DP_F_FOLLOW_STATE)
+        return -EBUSY;
+
+    memset(&req, 0, sizeof(req));
+    req.op = DP_CTL_ATTACH;
+    snprintf(req.name, sizeof(req.name), "%s", name);
+    req.cfg.vid   = native;
+    req.cfg.trunk = 1;
+    for (i = 0; i < nvids; i++)
+    {
+        if (vids[i] < 1 || vids[i] > 4094)
+            return -EINVAL;
+        req.cfg.tagged[vids[i] / 64] |= 1ull << (vids[i] % 64);
+    }
+    req.ifindex = dp_ifindex(name);
+    if (req.ifindex < 0)
+        return -ENOENT;
+
+    return post_ctl(&req);
+}
+
+/**
+ * dp_port_detach() - Stop switching frames of @p name.
+ *
+ * @return 0, -ENOENT if not attached, -EBUSY or -ENODEV as for attach.
+ */
+int dp_port_detach(const char *name)
+{
+    struct dp_ctl req;
+
+    if (!name)
+        return -EINVAL;
+    if (g_flags & DP_F_FOLLOW_STATE)
+        return -EBUSY;
+
+    memset(&req, 0, sizeof(req));
+    req.op = DP_CTL_DETACH;
+    req.ifindex = dp_ifindex(name);
+    if (req.ifindex < 0)
+        return -ENOENT;
+
+    return post_ctl(&req);
+}
+
+/**
+ * dp_vlan_router() - Route IPv4 frames of VLAN @p vid sent to @p mac.
+ *
+ * @p mac is also the source of frames routed into @p vid.  NULL stops
+ * routing the VLAN.  Routes and neighbors come from l3.h.
+ *
+ * @return 0, -EINVAL for a VLAN ID outside [1..4094], -EBUSY if router MACs
+ *         are followed from the link snapshot, or -ENODEV if the
+ *         forwarding plane is not running.
+ */
+int dp_vlan_router(uint16_t vid, const uint8_t *mac)
+{
+    if (vid < 1 || vid > 4094)
+        return -EINVAL;
+    if (!g_running)
+        return -ENODEV;
+    if (g_flags & DP_F_FOLLOW_STATE)
+        return -EBUSY;
+
+    __atomic_store_n(&g_rmac[vid], mac ? mac48(mac) : 0, __ATOMIC_RELAXED);
+    return 0;
+}
+
+/**
+ * dp_get_port() - Copy the state of port table slot @p slot.
+ *
+ * @return 0 if the slot is in use, -ENOENT if it is free, -EINVAL if out
+ *         of range.
+ */
+int dp_get_port(unsigned slot, struct dp_port_info *info)
+{
+    struct dp_port *p;
+
+    if (slot >= DP_MAX_PORTS || !info)
+        return -EINVAL;
+    p = &g_ports[slot];
+
+    pthread_mutex_lock(&g_port_lock);
+    if (!p->in_use)
+    {
+        pthread_mutex_unlock(&g_port_lock);
+        return -ENOENT;
+    }
+    memcpy(info->name, p->name, sizeof(info->name));
+    info->ifindex = p->ifindex;
+    info->vid     = p->cfg.vid;
+    info->trunk   = p->cfg.trunk;
+    info->ntagged = cfg_ntagged(&p->cfg);
+    info->io      = p->io;
+    pthread_mutex_lock(&g_lag_lock);
+    if (g_port_lag[slot])
+        memcpy(info->lag, g_lags[g_port_lag[slot] - 1].name, sizeof(info->lag));
+    else
+        info->lag[0] = '\0';
+    pthread_mutex_unlock(&g_lag_lock);
+    pthread_mutex_unlock(&g_port_lock);
+
+    dps_port_read(g_stats, slot, &info->stats);
+    dps_port_rate(g_stats, slot, &info->rate);
+    return 0;
+}
+
+/**
+ * dp_vlan_ports() - Flood list of VLAN @p vid as a port bitmap.
+ *
+ * Bit i is set if port table slot i (dp_get_port()) is a member of the
+ * VLAN, tagged or untagged.  0 for a VLAN without ports or out of range.
+ */
+uint64_t dp_vlan_ports(uint16_t vid)
+{
+    if (vid >= VLAN_ID_SPACE)
+        return 0;
+    return __atomic_load_n(&g_flood[vid], __ATOMIC_RELAXED);
+}
+
+/**
+ * dp_get_vlan() - Counters and rates of VLAN @p vid.
+ *
+ * Counters cover every frame classified into the VLAN since the forwarding
+ * plane started; rx_dropped counts tagged frames of the VLAN arriving on a
+ * port that does not carry it.
+ *
+ * @return 0, -EINVAL for an out of range VLAN ID, or -ENODEV if the
+ *         forwarding plane is not running.
+ */
+int dp_get_vlan(uint16_t vid, struct dp_vlan_info *info)
+{
+    if (vid >= VLAN_ID_SPACE || !info)
+        return -EINVAL;
+    if (!g_running)
+        return -ENODEV;
+
+    info->vid = vid;
+    info->nports = (unsigned)__builtin_popcountll(dp_vlan_ports(vid));
+    dps_vlan_read(g_stats, vid, &info->stats);
+    dps_vlan_rate(g_stats, vid, &info->rate);
+    return 0;
+}
+
+static uint64_t thread_cpu_ns(pthread_t thread)
+{
+    struct timespec ts;
+    clockid_t cid;
+
+    if (pthread_getcpuclockid(thread, &cid) != 0 || clock_gettime(cid, &ts) != 0)
+        return 0;
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+static uint64_t wall_ns(void)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)((now.tv_sec - g_started.tv_sec) * 1000000000ll
+                    + (now.tv_nsec - g_started.tv_nsec));
+}
+
+/**
+ * dp_workers() - Number of forwarding workers, 0 if not running.
+ */
+unsigned dp_workers(void)
+{
+    return g_running ? g_nworkers : 0;
+}
+
+/**
+ * dp_get_worker() - Frames processed and CPU time used by worker @p id.
+ *
+ * packets * 1e9 / cpu_ns is the forwarding rate of that core.
+ *
+ * @return 0, -EINVAL if @p id is not a worker, or -ENODEV if the
+ *         forwarding plane is not running.
+ */
+int dp_get_worker(unsigned id, struct dp_worker_stats *stats)
+{
+    const struct dp_worker *w;
+
+    if (!g_running || !stats)
+        return -ENODEV;
+    if (id >= g_nworkers)
+        return -EINVAL;
+
+    w = &g_workers[id];
+    stats->cpu     = w->cpu;
+    stats->packets = stat_load(&w->stats.packets);
+    stats->bursts  = stat_load(&w->stats.bursts);
+    stats->routed  = stat_load(&w->stats.routed);
+    stats->route_drops = stat_load(&w->stats.route_drops);
+    stats->acl_drops = stat_load(&w->stats.acl_drops);
+    stats->storm_drops = stat_load(&w->stats.storm_drops);
+    stats->mcast_pruned = stat_load(&w->stats.mcast_pruned);
+    stats->snoop_overruns = stat_load(&w->stats.snoop_overruns);
+    stats->lag_drops = stat_load(&w->stats.lag_drops);
+    stats->mirror_drops = stat_load(&w->stats.mirror_drops);
+    stats->cpu_ns  = thread_cpu_ns(w->thread);
+    stats->wall_ns = wall_ns();
+    return 0;
+}
+
+/**
+ * dp_get_worker_stats() - Frames processed and CPU time used by all workers.
+ *
+ * packets * 1e9 / cpu_ns is the forwarding rate per core; cpu is -1.
+ *
+ * @return 0, or -ENODEV if the forwarding plane is not running.
+ */
+int dp_get_worker_stats(struct dp_worker_stats *stats)
+{
+    struct dp_worker_stats one;
+    unsigned k;
+
+    if (!g_running || !stats)
+        return -ENODEV;
+
+    memset(stats, 0, sizeof(*stats));
+    stats->cpu = -1;
+    for (k = 0; k < g_nworkers; k++)
+    {
+        dp_get_worker(k, &one);
+        stats->packets += one.packets;
+        stats->bursts  += one.bursts;
+        stats->routed  += one.routed;
+        stats->route_drops += one.route_drops;
+        stats->acl_drops += one.acl_drops;
+        stats->storm_drops += one.storm_drops;
+        stats->mcast_pruned += one.mcast_pruned;
+        stats->snoop_overruns += one.snoop_overruns;
+        stats->lag_drops += one.lag_drops;
+        stats->mirror_drops += one.mirror_drops;
+        stats->cpu_ns  += one.cpu_ns;
+    }
+    stats->wall_ns = wall_ns();
+    return 0;
+}
+
+/**
+ * dp_get_pool_stats() - Occupancy and exhaustion of the packet buffer pool.
+ *
+ * Buffers in use are frames held in TX backlogs; exhausted counts frames
+ * dropped because the pool had none left.
+ *
+ * @return 0, or -ENODEV if the forwarding plane is not running.
+ */
+int dp_get_pool_stats(struct dpp_stats *stats)
+{
+    if (!g_running || !stats)
+        return -ENODEV;
+    dpp_get_stats(g_pool, stats);
+    return 0;
+}
+
+/* ---------------------------------------------------------------------------
+ * ACLs (control threads, under g_acl_lock)
+ * --------------------------------------------------------------------------- */
+
+static struct dp_acl *acl_find(const char *name)
+{
+    unsigned i;
+
+    for (i = 0; i < DP_MAX_ACLS; i++)
+    {
+        if (g_acls[i].in_use && strcmp(g_acls[i].name, name) == 0)
+            return &g_acls[i];
+    }
+    return NULL;
+}
+
+/* Publish @p t as the table of @p d and retire the previous one. */
+static void acl_swap(struct dp_acl *d, struct acl *t)
+{
+    struct acl *old = d->table;
+
+    __atomic_store_n(&d->table, t, __ATOMIC_SEQ_CST);
+    if (!old)
+        return;
+    grace_sync();
+    acl_carry_hits(t, old);
+    acl_destroy(old);
+}
+
+/*
+ * acl_install() - Compile @p rules into the ACL @p name, creating it if
+ * @p create is set, and swap the result in.  The rules it adds are
+ * reserved in RES_ACL first, the ones it drops given back after the swap.
+ */
+static int acl_install(const char *name, const struct acl_rule *rules, unsigned n,
+                       uint8_t default_action, int create)
+{
+    struct dp_acl *d = acl_find(name);
+    unsigned old = d ? d->table->nrules : 0;
+    struct acl *t;
+    unsigned i;
+    int err;
+
+    if (!d && !create)
+        return -ENOENT;
+    if (!d)
+    {
+        for (i = 0; i < DP_MAX_ACLS && g_acls[i].in_use; i++)
+            ;
+        if (i == DP_MAX_ACLS)
+            return -ENOSPC;
+        d = &g_acls[i];
+    }
+
+    if (n > old && (err = res_alloc(RES_ACL, n - old)) < 0)
+        return err;
+    err = acl_build(rules, n, default_action, g_nworkers, &t);
+    if (err < 0)
+    {
+        if (n > old)
+            res_free(RES_ACL, n - old);
+        return err;
+    }
+    if (!d->in_use)
+    {
+        snprintf(d->name, sizeof(d->name), "%s", name);
+        d->in_use = 1;
+    }
+    acl_swap(d, t);
+    if (n < old)
+        res_free(RES_ACL, old - n);
+    return 0;
+}
+
+static int acl_name_ok(const char *name)
+{
+    return name && name[0] && strlen(name) < DP_ACL_NAME_LEN;
+}
+
+/* Number of port slots and VLANs @p d is bound to. */
+static void acl_uses(const struct dp_acl *d, unsigned *nports, unsigned *nvlans)
+{
+    unsigned i;
+
+    *nports = 0;
+    *nvlans = 0;
+    pthread_mutex_lock(&g_port_lock);
+    for (i = 0; i < DP_MAX_PORTS; i++)
+        *nports += g_port_acl[i] == d;
+    pthread_mutex_unlock(&g_port_lock);
+    for (i = 0; i < VLAN_ID_SPACE; i++)
+        *nvlans += g_vlan_acl[i] == d;
+}
+
+/**
+ * dp_acl_rule_add() - Add @p rule to ACL @p name, or replace the rule with
+ * the same sequence number.
+ *
+ * An ACL that does not exist yet is created with a default action of
+ * permit.  The list is recompiled and swapped in while traffic flows; the
+ * hit counters of the other rules are kept.
+ *
+ * @return
+ *    0        – success. \n
+ *   -EINVAL   – bad name or rule (see acl_build()). \n
+ *   -ENOSPC   – the list is full, DP_MAX_ACLS lists exist, or the RES_ACL
+ *               table (res.h) has no room for the rule. \n
+ *   -ENOMEM   – the table could not be built. \n
+ *   -ENODEV   – the forwarding plane is not running.
+ */
+int dp_acl_rule_add(const char *name, const struct acl_rule *rule)
+{
+    const struct dp_acl *d;
+    struct acl_rule *rules;
+    uint8_t def = ACL_PERMIT;
+    unsigned n = 0;
+    unsigned i;
+    int err;
+
+    if (!acl_name_ok(name) || !rule)
+        return -EINVAL;
+    if (!g_running)
+        return -ENODEV;
+
+    pthread_mutex_lock(&g_acl_lock);
+    d = acl_find(name);
+    rules = malloc(((d ? d->table->nrules : 0) + 1) * sizeof(*rules));
+    if (!rules)
+    {
+        pthread_mutex_unlock(&g_acl_lock);
+        return -ENOMEM;
+    }
+    if (d)
+    {
+        def = d->table->default_action;
+        for (i = 0; i < d->table->nrules; i++)
+        {
+            if (d->table->rules[i].seq != rule->seq)
+                rules[n++] = d->table->rules[i];
+        }
+    }
+    rules[n++] = *rule;
+    err = acl_install(name, rules, n, def, 1);
+    pthread_mutex_unlock(&g_acl_lock);
+    free(rules);
+    return err;
+}
+
+/**
+ * dp_acl_rule_del() - Remove the rule with sequence number @p seq from ACL
+ * @p name.
+ *
+ * @return 0, -ENOENT if there is no such ACL or rule, -EINVAL, -ENOMEM, or
+ *         -ENODEV if the forwarding plane is not running.
+ */
+int dp_acl_rule_del(const char *name, uint32_t seq)
+{
+    const struct dp_acl *d;
+    struct acl_rule *rules;
+    unsigned n = 0;
+    unsigned i;
+    int err;
+
+    if (!acl_name_ok(name))
+        return -EINVAL;
+    if (!g_running)
+        return -ENODEV;
+
+    pthread_mutex_lock(&g_acl_lock);
+    if ((d = acl_find(name)) == NULL)
+    {
+        pthread_mutex_unlock(&g_acl_lock);
+        return -ENOENT;
+    }
+    rules = malloc((d->table->nrules + 1) * sizeof(*rules));
+    if (!rules)
+    {
+        pthread_mutex_unlock(&g_acl_lock);
+        return -ENOMEM;
+    }
+    for (i = 0; i < d->table->nrules; i++)
+    {
+        if (d->table->rules[i].seq != seq)
+            rules[n++] = d->table->rules[i];
+    }
+    if (n == d->table->nrules)
+        err = -ENOENT;
+    else
+        err = acl_install(name, rules, n, d->table->default_action, 0);
+    pthread_mutex_unlock(&g_acl_lock);
+    free(rules);
+    return err;
+}
+
+/**
+ * dp_acl_set() - Replace ACL @p name as a whole, creating it if needed.
+ *
+ * The new list takes effect atomically: every frame sees either the old or
+ * the new rules.  Counters carry over to rules with the same sequence number.
+ *
+ * @return as dp_acl_rule_add().
+ */
+int dp_acl_set(const char *name, const struct acl_rule *rules, unsigned n, uint8_t default_action)
+{
+    int err;
+
+    if (!acl_name_ok(name))
+        return -EINVAL;
+    if (!g_running)
+        return -ENODEV;
+
+    pthread_mutex_lock(&g_acl_lock);
+    err = acl_install(name, rules, n, default_action, 1);
+    pthread_mutex_unlock(&g_acl_lock);
+    return err;
+}
+
+/**
+ * dp_acl_default() - Set the action of frames no rule of ACL @p name matches.
+ *
+ * Creates an empty ACL if @p name does not exist.
+ *
+ * @return as dp_acl_rule_add().
+ */
+int dp_acl_default(const char *name, uint8_t action)
+{
+    const struct dp_acl *d;
+    int err;
+
+    if (!acl_name_ok(name) || action > ACL_DENY)
+        return -EINVAL;
+    if (!g_running)
+        return -ENODEV;
+
+    pthread_mutex_lock(&g_acl_lock);
+    d = acl_find(name);
+    if (d)
+        err = acl_install(name, d->table->rules, d->table->nrules, action, 0);
+    else
+        err = acl_install(name, NULL, 0, action, 1);
+    pthread_mutex_unlock(&g_acl_lock);
+    return err;
+}
+
+/**
+ * dp_acl_delete() - Delete ACL @p name.
+ *
+ * @return 0, -ENOENT if it does not exist, -EBUSY while it is bound to a
+ *         port or VLAN, -EINVAL, or -ENODEV if the forwarding plane is not
+ *         running.
+ */
+int dp_acl_delete(const char *name)
+{
+    struct dp_acl *d;
+    unsigned nports, nvlans;
+    int err = 0;
+
+    if (!acl_name_ok(name))
+        return -EINVAL;
+    if (!g_running)
+        return -ENODEV;
+
+    pthread_mutex_lock(&g_acl_lock);
+    if ((d = acl_find(name)) == NULL)
+        err = -ENOENT;
+    else
+    {
+        acl_uses(d, &nports, &nvlans);
+        if (nports || nvlans)
+            err = -EBUSY;
+    }
+    if (err == 0)
+    {
+        /* A worker may still hold the ACL it read before the last unbind. */
+        grace_sync();
+        res_free(RES_ACL, d->table->nrules);
+        acl_destroy(d->table);
+        d->table = NULL;
+        d->in_use = 0;
+    }
+    pthread_mutex_unlock(&g_acl_lock);
+    return err;
+}
+
+/**
+ * dp_acl_bind_port() - Filter the ingress of attached port @p port through
+ * ACL @p name, or stop filtering it if @p name is NULL.
+ *
+ * A port keeps its ACL until it is unbound or detached.
+ *
+ * @return 0, -ENOENT if the port is not attached or the ACL does not exist,
+ *         -EINVAL, or -ENODEV if the forwarding plane is not running.
+ */
+int dp_acl_bind_port(const char *port, const char *name)
+{
+    struct dp_acl *d = NULL;
+    unsigned i;
+    int err = -ENOENT;
+
+    if (!port || (name && !acl_name_ok(name)))
+        return -EINVAL;
+    if (!g_running)
+        return -ENODEV;
+
+    pthread_mutex_lock(&g_acl_lock);
+    if (name && (d = acl_find(name)) == NULL)
+    {
+        pthread_mutex_unlock(&g_acl_lock);
+        return -ENOENT;
+    }
+    pthread_mutex_lock(&g_port_lock);
+    for (i = 0; i < DP_MAX_PORTS; i++)
+    {
+        if (!g_ports[i].in_use || strcmp(g_ports[i].name, port) != 0)
+            continue;
+        if (!g_port_acl[i] != !d)
+            __atomic_add_fetch(&g_acl_bound, d ? 1 : -1, __ATOMIC_RELAXED);
+        __atomic_store_n(&g_port_acl[i], d, __ATOMIC_RELEASE);
+        err = 0;
+        break;
+    }
+    pthread_mutex_unlock(&g_port_lock);
+    pthread_mutex_unlock(&g_acl_lock);
+    return err;
+}
+
+/**
+ * dp_acl_bind_vlan() - Filter the frames classified into VLAN @p vid
+ * through ACL @p name, or stop filtering them if @p name is NULL.
+ *
+ * Frames are checked against the VLAN they arrive in, after the ACL of
+ * their ingress port.
+ *
+ * @return 0, -ENOENT if the ACL does not exist, -EINVAL for a VLAN ID
+ *         outside [1..4094], or -ENODEV if the forwarding plane is not
+ *         running.
+ */
+int dp_acl_bind_vlan(uint16_t vid, const char *name)
+{
+    struct dp_acl *d = NULL;
+
+    if (vid < 1 || vid > 4094 || (name && !acl_name_ok(name)))
+        return -EINVAL;
+    if (!g_running)
+        return -ENODEV;
+
+    pthread_mutex_lock(&g_acl_lock);
+    if (name && (d = acl_find(name)) == NULL)
+    {
+        pthread_mutex_unlock(&g_acl_lock);
+        return -ENOENT;
+    }
+    if (!g_vlan_acl[vid] != !d)
+        __atomic_add_fetch(&g_acl_bound, d ? 1 : -1, __ATOMIC_RELAXED);
+    __atomic_store_n(&g_vlan_acl[vid], d, __ATOMIC_RELEASE);
+    pthread_mutex_unlock(&g_acl_lock);
+    return 0;
+}
+
+/**
+ * dp_get_acl() - Summary of ACL slot @p idx, 0..DP_MAX_ACLS-1.
+ *
+ * @return 0 if the slot holds an ACL, -ENOENT if it is free, -EINVAL if out
+ *         of range, or -ENODEV if the forwarding plane is not running.
+ */
+int dp_get_acl(unsigned idx, struct dp_acl_info *info)
+{
+    const struct dp_acl *d;
+
+    if (idx >= DP_MAX_ACLS || !info)
+        return -EINVAL;
+    if (!g_running)
+        return -ENODEV;
+
+    pthread_mutex_lock(&g_acl_lock);
+    d = &g_acls[idx];
+    if (!d->in_use)
+    {
+        pthread_mutex_unlock(&g_acl_lock);
+        return -ENOENT;
+    }
+    memcpy(info->name, d->name, sizeof(info->name));
+    info->nrules = d->table->nrules;
+    info->default_action = d->table->default_action;
+    info->no_match = acl_hits(d->table, d->table->nrules);
+    acl_uses(d, &info->nports, &info->nvlans);
+    pthread_mutex_unlock(&g_acl_lock);
+    return 0;
+}
+
+/**
+ * dp_acl_dump() - Pass every rule of ACL @p name, in sequence order, to
+ * @p fn with the number of frames it decided.
+ *
+ * @p fn runs under the ACL lock and must not call back into dp_acl_*().
+ *
+ * @return the number of rules, -ENOENT if the ACL does not exist, -EINVAL,
+ *         or -ENODEV if the forwarding plane is not running.
+ */
+int dp_acl_dump(const char *name, dp_acl_rule_fn fn, void *arg)
+{
+    const struct dp_acl *d;
+    unsigned i;
+    int n;
+
+    if (!acl_name_ok(name) || !fn)
+        return -EINVAL;
+    if (!g_running)
+        return -ENODEV;
+
+    pthread_mutex_lock(&g_acl_lock);
+    if ((d = acl_find(name)) == NULL)
+    {
+        pthread_mutex_unlock(&g_acl_lock);
+        return -ENOENT;
+    }
+    for (i = 0; i < d->table->nrules; i++)
+        fn(&d->table->rules[i], acl_hits(d->table, i), arg);
+    n = (int)d->table->nrules;
+    pthread_mutex_unlock(&g_acl_lock);
+    return n;
+}
+
+/**
+ * dp_storm_port() - Limit class @p cls of the ingress of attached port
+ * @p port to @p r, or stop limiting it if @p r is NULL or has a zero rate.
+ *
+ * The bucket starts full.  A port loses its limits when it is detached.
+ *
+ * @return 0, -ENOENT if the port is not attached, -EINVAL for a bad class
+ *         or rate (see storm_tb_set()), or -ENODEV if the forwarding plane
+ *         is not running.
+ */
+int dp_storm_port(const char *port, unsigned cls, const struct storm_rate *r)
+{
+    unsigned i;
+    int err = -ENOENT;
+
+    if (!port || cls >= STORM_NCLASSES)
+        return -EINVAL;
+    if (!g_running)
+        return -ENODEV;
+
+    pthread_mutex_lock(&g_port_lock);
+    for (i = 0; i < DP_MAX_PORTS; i++)
+    {
+        if (g_ports[i].in_use && strcmp(g_ports[i].name, port) == 0)
+        {
+            err = storm_set(&g_port_storm[i][cls], 1, r);
+            break;
+        }
+    }
+    pthread_mutex_unlock(&g_port_lock);
+    return err;
+}
+
+/**
+ * dp_storm_vlan() - Limit class @p cls of the frames classified into VLAN
+ * @p vid, from all its ports together, to @p r; NULL or a zero rate
+ * removes the limit.
+ *
+ * @return 0, -EINVAL for a VLAN ID outside [1..4094], a bad class or rate,
+ *         or -ENODEV if the forwarding plane is not running.
+ */
+int dp_storm_vlan(uint16_t vid, unsigned cls, const struct storm_rate *r)
+{
+    int err;
+
+    if (vid < 1 || vid > 4094 || cls >= STORM_NCLASSES)
+        return -EINVAL;
+    if (!g_running)
+        return -ENODEV;
+
+    pthread_mutex_lock(&g_storm_lock);
+    err = storm_set(&g_vlan_storm[vid][cls], 1, r);
+    pthread_mutex_unlock(&g_storm_lock);
+    return err;
+}
+
+/**
+ * dp_storm_walk() - Pass every configured bucket, with the frames it
+ * dropped, to @p fn: ports in slot order, then VLANs.
+ *
+ * @return the number of buckets, or -ENODEV if the forwarding plane is
+ *         not running.
+ */
+int dp_storm_walk(dp_storm_fn fn, void *arg)
+{
+    const struct dp_storm *s;
+    unsigned i, c;
+    int n = 0;
+
+    if (!fn)
+        return -EINVAL;
+    if (!g_running)
+        return -ENODEV;
+
+    pthread_mutex_lock(&g_port_lock);
+    for (i = 0; i < DP_MAX_PORTS; i++)
+    {
+        for (c = 0; g_ports[i].in_use && c < STORM_NCLASSES; c++)
+        {
+            s = &g_port_storm[i][c];
+            if (!s->r.rate)
+                continue;
+            fn(g_ports[i].name, 0, c, &s->r, __atomic_load_n(&s->tb.drops, __ATOMIC_RELAXED), arg);
+            n++;
+        }
+    }
+    pthread_mutex_unlock(&g_port_lock);
+
+    pthread_mutex_lock(&g_storm_lock);
+    for (i = 1; i < VLAN_ID_SPACE; i++)
+    {
+        for (c = 0; c < STORM_NCLASSES; c++)
+        {
+            s = &g_vlan_storm[i][c];
+            if (!s->r.rate)
+                continue;
+            fn(NULL, (uint16_t)i, c, &s->r, __atomic_load_n(&s->tb.drops, __ATOMIC_RELAXED), arg);
+            n++;
+        }
+    }
+    pthread_mutex_unlock(&g_storm_lock);
+    return n;
+}
+
+/* ---------------------------------------------------------------------------
+ * Link aggregation (control threads)
+ * --------------------------------------------------------------------------- */
+
+static struct dp_lag *lag_find(const char *name)
+{
+    unsigned i;
+
+    for (i = 0; i < DP_MAX_LAGS; i++)
+    {
+        if (g_lags[i].in_use && strcmp(g_lags[i].name, name) == 0)
+            return &g_lags[i];
+    }
+    return NULL;
+}
+
+/* Index of @p port among @p g's members, or -1; g_lag_lock held. */
+static int lag_member(const struct dp_lag *g, const char *port)
+{
+    unsigned j;
+
+    for (j = 0; j < g->nmembers; j++)
+    {
+        if (strcmp(g->member[j], port) == 0)
+            return (int)j;
+    }
+    return -1;
+}
+
+/* Have worker 0 regroup after a change; g_lag_lock not held. */
+static int lag_post(void)
+{
+    struct dp_ctl req;
+
+    memset(&req, 0, sizeof(req));
+    req.op = DP_CTL_LAG;
+    return post_ctl(&req);
+}
+
+static int lag_name_ok(const char *name)
+{
+    return name && name[0] && strlen(name) < IFNAMSIZ;
+}
+
+/**
+ * dp_lag_create() - Create the empty LAG @p name, hashing flows with
+ * policy @p hash (LAG_HASH_*).
+ *
+ * @return
+ *    0        – success. \n
+ *   -EINVAL   – bad name or policy. \n
+ *   -EEXIST   – a LAG of that name exists. \n
+ *   -ENOSPC   – DP_MAX_LAGS LAGs exist. \n
+ *   -ENODEV   – the forwarding plane is not running.
+ */
+int dp_lag_create(const char *name, unsigned hash)
+{
+    unsigned i;
+    int err = 0;
+
+    if (!lag_name_ok(name) || hash > LAG_HASH_L4)
+        return -EINVAL;
+    if (!g_running)
+        return -ENODEV;
+
+    pthread_mutex_lock(&g_lag_lock);
+    for (i = 0; i < DP_MAX_LAGS && g_lags[i].in_use; i++)
+        ;
+    if (lag_find(name))
+        err = -EEXIST;
+    else if (i == DP_MAX_LAGS)
+        err = -ENOSPC;
+    else
+    {
+        memset(&g_lags[i], 0, sizeof(g_lags[i]));
+        snprintf(g_lags[i].name, sizeof(g_lags[i].name), "%s", name);
+        g_lags[i].hash = (uint8_t)hash;
+        g_lags[i].in_use = 1;
+    }
+    pthread_mutex_unlock(&g_lag_lock);
+    return err;
+}
+
+/**
+ * dp_lag_delete() - Delete LAG @p name; its members carry on as separate
+ * ports.
+ *
+ * @return 0, -ENOENT if there is no such LAG, or -ENODEV.
+ */
+int dp_lag_delete(const char *name)
+{
+    struct dp_lag *g;
+
+    if (!name)
+        return -EINVAL;
+    if (!g_running)
+        return -ENODEV;
+
+    pthread_mutex_lock(&g_lag_lock);
+    if ((g = lag_find(name)) != NULL)
+        g->in_use = 0;
+    pthread_mutex_unlock(&g_lag_lock);
+    return g ? lag_post() : -ENOENT;
+}
+
+/**
+ * dp_lag_add_port() - Make port @p port a member of LAG @p name.
+ *
+ * The port need not be attached yet; it joins the LAG whenever it is.
+ * Members should be configured with the same VLANs, since the LAG floods
+ * and learns through its representative member only.
+ *
+ * @return
+ *    0        – success. \n
+ *   -EINVAL   – bad name. \n
+ *   -ENOENT   – no such LAG. \n
+ *   -EEXIST   – @p port is a member already. \n
+ *   -EBUSY    – @p port is a member of another LAG. \n
+ *   -ENOSPC   – the LAG has LAG_MAX_MEMBERS members. \n
+ *   -ENODEV   – the forwarding plane is not running.
+ */
+int dp_lag_add_port(const char *name, const char *port)
+{
+    struct dp_lag *g;
+    unsigned i;
+    int err = 0;
+
+    if (!name || !lag_name_ok(port))
+        return -EINVAL;
+    if (!g_running)
+        return -ENODEV;
+
+    pthread_mutex_lock(&g_lag_lock);
+    g = lag_find(name);
+    for (i = 0; g && err == 0 && i < DP_MAX_LAGS; i++)
+    {
+        if (g_lags[i].in_use && lag_member(&g_lags[i], port) >= 0)
+            err = &g_lags[i] == g ? -EEXIST : -EBUSY;
+    }
+    if (!g)
+        err = -ENOENT;
+    else if (err == 0 && g->nmembers == LAG_MAX_MEMBERS)
+        err = -ENOSPC;
+    else if (err == 0)
+        snprintf(g->member[g->nmembers++], IFNAMSIZ, "%s", port);
+    pthread_mutex_unlock(&g_lag_lock);
+    return err < 0 ? err : lag_post();
+}
+
+/**
+ * dp_lag_del_port() - Take port @p port out of LAG @p name.
+ *
+ * @return 0, -ENOENT if there is no such LAG or @p port is not a member,
+ *         or -ENODEV.
+ */
+int dp_lag_del_port(const char *name, const char *port)
+{
+    struct dp_lag *g;
+    int j = -1;
+
+    if (!name || !port)
+        return -EINVAL;
+    if (!g_running)
+        return -ENODEV;
+
+    pthread_mutex_lock(&g_lag_lock);
+    if ((g = lag_find(name)) != NULL && (j = lag_member(g, port)) >= 0)
+    {
+        memmove(g->member[j], g->member[j + 1], (g->nmembers - (unsigned)j - 1) * IFNAMSIZ);
+        g->nmembers--;
+    }
+    pthread_mutex_unlock(&g_lag_lock);
+    return j < 0 ? -ENOENT : lag_post();
+}
+
+/**
+ * dp_lag_link() - Report the link of attached port @p port up or down.
+ *
+ * A LAG member that goes down leaves its LAG's member table at once; only
+ * the flows hashed to it move.  Used when membership is set explicitly;
+ * with DP_F_FOLLOW_STATE the link snapshot's IFF_RUNNING decides.
+ *
+ * @return 0, -ENOENT if @p port is not attached, -EBUSY with
+ *         DP_F_FOLLOW_STATE, or -ENODEV.
+ */
+int dp_lag_link(const char *port, int up)
+{
+    unsigned i;
+    int err = -ENOENT;
+
+    if (!port)
+        return -EINVAL;
+    if (!g_running)
+        return -ENODEV;
+    if (g_flags & DP_F_FOLLOW_STATE)
+        return -EBUSY;
+
+    pthread_mutex_lock(&g_port_lock);
+    for (i = 0; i < DP_MAX_PORTS && err < 0; i++)
+    {
+        if (!g_ports[i].in_use || strcmp(g_ports[i].name, port) != 0)
+            continue;
+        pthread_mutex_lock(&g_lag_lock);
+        lag_link(i, up);
+        pthread_mutex_unlock(&g_lag_lock);
+        err = 0;
+    }
+    pthread_mutex_unlock(&g_port_lock);
+    return err;
+}
+
+/**
+ * dp_get_lag() - Copy the state of LAG table entry @p idx.
+ *
+ * @return 0 if the entry is in use, -ENOENT if it is free, -EINVAL if out
+ *         of range.
+ */
+int dp_get_lag(unsigned idx, struct dp_lag_info *info)
+{
+    const struct dp_lag *g;
+    int err = 0;
+
+    if (idx >= DP_MAX_LAGS || !info)
+        return -EINVAL;
+    g = &g_lags[idx];
+
+    pthread_mutex_lock(&g_lag_lock);
+    if (!g->in_use)
+    {
+        err = -ENOENT;
+    }
+    else
+    {
+        memcpy(info->name, g->name, sizeof(info->name));
+        memcpy(info->member, g->member, sizeof(info->member));
+        info->hash     = g->hash;
+        info->nmembers = g->nmembers;
+        info->ports    = g->ports;
+        info->up       = g->up;
+    }
+    pthread_mutex_unlock(&g_lag_lock);
+    return err;
+}
+
+/* ---------------------------------------------------------------------------
+ * Mirroring (control threads and the mirror thread)
+ * --------------------------------------------------------------------------- */
+
+static int mirror_name_ok(const char *name)
+{
+    return name && name[0] && strlen(name) < DP_MIRROR_NAME_LEN;
+}
+
+/* Session @p name, not being deleted; g_mirror_lock held. */
+static struct dp_mirror *mirror_find(const char *name)
+{
+    unsigned i;
+
+    for (i = 0; i < DP_MAX_MIRRORS; i++)
+    {
+        if (g_mirrors[i].in_use && !g_mirrors[i].closing && strcmp(g_mirrors[i].name, name) == 0)
+            return &g_mirrors[i];
+    }
+    return NULL;
+}
+
+/* Copy the name of every attached port slot into @p names ("?" for free
+ * slots); taken before g_mirror_lock, which nests inside g_port_lock. */
+static void mirror_names(char (*names)[IFNAMSIZ])
+{
+    unsigned i;
+
+    pthread_mutex_lock(&g_port_lock);
+    for (i = 0; i < DP_MAX_PORTS; i++)
+        snprintf(names[i], IFNAMSIZ, "%s", g_ports[i].in_use ? g_ports[i].name : "?");
+    pthread_mutex_unlock(&g_port_lock);
+}
+
+/* Non-zero if some worker's mirror ring holds a record. */
+static int mirror_pending(void)
+{
+    unsigned k;
+
+    for (k = 0; k < g_nworkers; k++)
+    {
+        if (g_workers[k].mring && mirror_ring_peek(g_workers[k].mring))
+            return 1;
+    }
+    return 0;
+}
+
+/*
+ * mirror_drain() - Write up to @p max records of every worker's ring to
+ * their sessions' files; g_mirror_lock held.
+ *
+ * @return the records taken.
+ */
+static unsigned mirror_drain(char (*names)[IFNAMSIZ], unsigned max)
+{
+    const struct mirror_rec *rec;
+    unsigned n = 0;
+    unsigned k, i;
+
+    for (k = 0; k < g_nworkers; k++)
+    {
+        struct mirror_ring *r = g_workers[k].mring;
+
+        for (i = 0; r && i < max && (rec = mirror_ring_peek(r)) != NULL; i++)
+        {
+            struct dp_mirror *m = &g_mirrors[rec->session];
+
+            if (m->in_use && mirror_file_write(&m->out, rec, names[rec->port]) < 0)
+                m->write_errors++;
+            mirror_ring_release(r);
+            n++;
+        }
+    }
+    return n;
+}
+
+static void mirror_flush(void)
+{
+    unsigned i;
+
+    for (i = 0; i < DP_MAX_MIRRORS; i++)
+    {
+        if (g_mirrors[i].in_use && mirror_file_flush(&g_mirrors[i].out) < 0)
+            g_mirrors[i].write_errors++;
+    }
+}
+
+static void *dp_mirror_main(void *arg)
+{
+    static char names[DP_MAX_PORTS][IFNAMSIZ];
+
+    (void)arg;
+    while (!atomic_load(&g_mirror_stop))
+    {
+        if (!mirror_pending())
+        {
+            pthread_mutex_lock(&g_mirror_lock);
+            mirror_flush();
+            pthread_mutex_unlock(&g_mirror_lock);
+            usleep(DP_MIRROR_IDLE_MS * 1000);
+            continue;
+        }
+        mirror_names(names);
+        pthread_mutex_lock(&g_mirror_lock);
+        mirror_drain(names, DP_MIRROR_BATCH);
+        pthread_mutex_unlock(&g_mirror_lock);
+    }
+    return NULL;
+}
+
+/* Stop the mirror thread, if started, once the workers have stopped: write
+ * what the rings still hold, close every session and free the rings. */
+static void mirror_stop(void)
+{
+    static char names[DP_MAX_PORTS][IFNAMSIZ];
+    unsigned i, k;
+
+    if (g_mirror_started)
+    {
+        atomic_store(&g_mirror_stop, 1);
+        pthread_join(g_mirror_thread, NULL);
+        g_mirror_started = 0;
+    }
+    mirror_names(names);
+    pthread_mutex_lock(&g_mirror_lock);
+    while (mirror_drain(names, DP_MIRROR_RING))
+        ;
+    for (i = 0; i < DP_MAX_MIRRORS; i++)
+    {
+        if (g_mirrors[i].in_use)
+            mirror_file_close(&g_mirrors[i].out);
+    }
+    memset(g_mirrors, 0, sizeof(g_mirrors));
+    memset(g_port_mirror, 0, sizeof(g_port_mirror));
+    memset(g_vlan_mirror, 0, sizeof(g_vlan_mirror));
+    g_mirror_sources = 0;
+    for (k = 0; k < g_nworkers; k++)
+    {
+        mirror_ring_destroy(g_workers[k].mring);
+        g_workers[k].mring = NULL;
+    }
+    pthread_mutex_unlock(&g_mirror_lock);
+}
+
+/**
+ * dp_mirror_create() - Start mirror session @p name, writing to the files
+ * described by @p cfg; it mirrors nothing until it has sources.
+ *
+ * The first file is created before the call returns.
+ *
+ * @return
+ *    0        – success. \n
+ *   -EINVAL   – bad name, file prefix or snap length. \n
+ *   -EEXIST   – a session of that name exists. \n
+ *   -ENOSPC   – DP_MAX_MIRRORS sessions exist. \n
+ *   -ENOMEM   – no memory for the rings. \n
+ *   -ENODEV   – the forwarding plane is not running. \n
+ *   -errno    – creating the file or the mirror thread failed.
+ */
+int dp_mirror_create(const char *name, const struct dp_mirror_cfg *cfg)
+{
+    struct dp_mirror *m = NULL;
+    unsigned i, k;
+    int err = 0;
+
+    if (!mirror_name_ok(name) || !cfg || !cfg->prefix[0] || cfg->snaplen > MIRROR_SNAPLEN_MAX ||
+        strnlen(cfg->prefix, sizeof(cfg->prefix)) == sizeof(cfg->prefix))
+        return -EINVAL;
+    if (!g_running)
+        return -ENODEV;
+
+    pthread_mutex_lock(&g_mirror_lock);
+    for (i = 0; i < DP_MAX_MIRRORS && g_mirrors[i].in_use; i++)
+        ;
+    if (mirror_find(name))
+        err = -EEXIST;
+    else if (i == DP_MAX_MIRRORS)
+        err = -ENOSPC;
+    for (k = 0; err == 0 && k < g_nworkers; k++)
+    {
+        struct mirror_ring *r;
+
+        if (g_workers[k].mring)
+            continue;
+        if ((r = mirror_ring_create(DP_MIRROR_RING)) == NULL)
+            err = -ENOMEM;
+        else
+            __atomic_store_n(&g_workers[k].mring, r, __ATOMIC_RELEASE);
+    }
+    if (err == 0)
+    {
+        m = &g_mirrors[i];
+        memset(m, 0, sizeof(*m));
+        m->cfg = *cfg;
+        err = mirror_file_open(&m->out, cfg->prefix, cfg->snaplen, cfg->file_bytes, cfg->files);
+    }
+    if (err == 0 && !g_mirror_started)
+    {
+        atomic_store(&g_mirror_stop, 0);
+        err = -pthread_create(&g_mirror_thread, NULL, dp_mirror_main, NULL);
+        if (err == 0)
+        {
+            pthread_setname_np(g_mirror_thread, "dp-mirror");
+            g_mirror_started = 1;
+        }
+        else
+        {
+            mirror_file_close(&m->out);
+        }
+    }
+    if (err == 0)
+    {
+        snprintf(m->name, sizeof(m->name), "%s", name);
+        m->in_use = 1;
+    }
+    pthread_mutex_unlock(&g_mirror_lock);
+    return err;
+}
+
+/**
+ * dp_mirror_delete() - Stop mirror session @p name and close its file,
+ * once the frames it already copied are written.
+ *
+ * @return 0, -ENOENT if there is no such session, or -ENODEV.
+ */
+int dp_mirror_delete(const char *name)
+{
+    char names[DP_MAX_PORTS][IFNAMSIZ];
+    struct dp_mirror *m;
+    unsigned s, i, k;
+
+    if (!name)
+        return -EINVAL;
+    if (!g_running)
+        return -ENODEV;
+
+    pthread_mutex_lock(&g_port_lock);
+    pthread_mutex_lock(&g_mirror_lock);
+    if ((m = mirror_find(name)) == NULL)
+    {
+        pthread_mutex_unlock(&g_mirror_lock);
+        pthread_mutex_unlock(&g_port_lock);
+        return -ENOENT;
+    }
+    s = (unsigned)(m - g_mirrors);
+    for (i = 0; i < DP_MAX_PORTS * 2; i++)
+        mirror_set(&g_port_mirror[0][0] + i, (uint8_t)((&g_port_mirror[0][0])[i] & ~(1u << s)));
+    for (i = 0; i < VLAN_ID_SPACE * 2; i++)
+        mirror_set(&g_vlan_mirror[0][0] + i, (uint8_t)((&g_vlan_mirror[0][0])[i] & ~(1u << s)));
+    m->closing = 1;
+    pthread_mutex_unlock(&g_mirror_lock);
+    pthread_mutex_unlock(&g_port_lock);
+
+    /* No worker copies for the session any more once each has started a
+     * new pass; what they copied before is written out below. */
+    grace_sync();
+    mirror_names(names);
+    pthread_mutex_lock(&g_mirror_lock);
+    while (mirror_drain(names, DP_MIRROR_RING))
+        ;
+    mirror_file_close(&m->out);
+    for (k = 0; k < g_nworkers; k++)
+    {
+        g_workers[k].mirror_seen[s] = 0;
+        __atomic_store_n(&g_workers[k].mirror_drops[s], 0, __ATOMIC_RELAXED);
+    }
+    m->in_use = 0;
+    m->closing = 0;
+    pthread_mutex_unlock(&g_mirror_lock);
+    return 0;
+}
+
+/* Make @p bit of the two session bitmaps at @p m follow @p dir; lock held. */
+static void mirror_source(uint8_t *m, uint8_t bit, unsigned dir)
+{
+    mirror_set(&m[0], (uint8_t)((dir & MIRROR_RX) ? m[0] | bit : m[0] & ~bit));
+    mirror_set(&m[1], (uint8_t)((dir & MIRROR_TX) ? m[1] | bit : m[1] & ~bit));
+}
+
+/**
+ * dp_mirror_port() - Mirror the frames attached port @p port receives
+ * (MIRROR_RX), sends (MIRROR_TX) or both to session @p name; @p dir 0
+ * stops.
+ *
+ * Received frames are captured as they arrived, before any ACL; sent
+ * frames as they left.  A port stops being a source when it is detached.
+ *
+ * @return 0, -ENOENT if there is no such session or the port is not
+ *         attached, -EINVAL for a bad direction, or -ENODEV.
+ */
+int dp_mirror_port(const char *name, const char *port, unsigned dir)
+{
+    struct dp_mirror *m;
+    unsigned i;
+    int err = -ENOENT;
+
+    if (!name || !port || dir > MIRROR_BOTH)
+        return -EINVAL;
+    if (!g_running)
+        return -ENODEV;
+
+    pthread_mutex_lock(&g_port_lock);
+    pthread_mutex_lock(&g_mirror_lock);
+    m = mirror_find(name);
+    for (i = 0; m && i < DP_MAX_PORTS; i++)
+    {
+        if (g_ports[i].in_use && strcmp(g_ports[i].name, port) == 0)
+        {
+            mirror_source(g_port_mirror[i], (uint8_t)(1u << (m - g_mirrors)), dir);
+            err = 0;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&g_mirror_lock);
+    pthread_mutex_unlock(&g_port_lock);
+    return err;
+}
+
+/**
+ * dp_mirror_vlan() - Mirror the frames classified into VLAN @p vid
+ * (MIRROR_RX), sent in it (MIRROR_TX) or both to session @p name, on all
+ * its ports; @p dir 0 stops.
+ *
+ * @return 0, -ENOENT if there is no such session, -EINVAL for a VLAN ID
+ *         outside [1..4094] or a bad direction, or -ENODEV.
+ */
+int dp_mirror_vlan(const char *name, uint16_t vid, unsigned dir)
+{
+    struct dp_mirror *m;
+    int err = 0;
+
+    if (!name || vid < 1 || vid > 4094 || dir > MIRROR_BOTH)
+        return -EINVAL;
+    if (!g_running)
+        return -ENODEV;
+
+    pthread_mutex_lock(&g_mirror_lock);
+    if ((m = mirror_find(name)) == NULL)
+        err = -ENOENT;
+    else
+        mirror_source(g_vlan_mirror[vid], (uint8_t)(1u << (m - g_mirrors)), dir);
+    pthread_mutex_unlock(&g_mirror_lock);
+    return err;
+}
+
+/**
+ * dp_get_mirror() - Copy the state of mirror session table entry @p idx.
+ *
+ * @return 0 if the entry is in use, -ENOENT if it is free, -EINVAL if out
+ *         of range, or -ENODEV.
+ */
+int dp_get_mirror(unsigned idx, struct dp_mirror_info *info)
+{
+    const struct dp_mirror *m;
+    uint8_t bit = (uint8_t)(1u << (idx % 8));
+    unsigned i, d, k;
+    int err = 0;
+
+    if (idx >= DP_MAX_MIRRORS || !info)
+        return -EINVAL;
+    if (!g_running)
+        return -ENODEV;
+
+    memset(info, 0, sizeof(*info));
+    pthread_mutex_lock(&g_port_lock);
+    pthread_mutex_lock(&g_mirror_lock);
+    m = &g_mirrors[idx];
+    if (!m->in_use || m->closing)
+    {
+        err = -ENOENT;
+    }
+    else
+    {
+        snprintf(info->name, sizeof(info->name), "%s", m->name);
+        info->cfg = m->cfg;
+        snprintf(info->file, sizeof(info->file), "%s", m->out.path);
+        for (d = 0; d < 2; d++)
+        {
+            for (i = 0; i < DP_MAX_PORTS; i++)
+            {
+                if (g_port_mirror[i][d] & bit)
+                    info->ports[d] |= 1ull << i;
+            }
+            for (i = 1; i < VLAN_ID_SPACE; i++)
+            {
+                if (g_vlan_mirror[i][d] & bit)
+                    info->vlans[d][i / 64] |= 1ull << (i % 64);
+            }
+        }
+        info->frames = m->out.frames;
+        info->bytes = m->out.bytes;
+        info->nfiles = m->out.seq;
+        info->drops = m->write_errors;
+        for (k = 0; k < g_nworkers; k++)
+            info->drops += stat_load(&g_workers[k].mirror_drops[idx]);
+    }
+    pthread_mutex_unlock(&g_mirror_lock);
+    pthread_mutex_unlock(&g_port_lock);
+    return err;
+}
+
+/* ---------------------------------------------------------------------------
+ * sFlow (control threads and the sFlow thread)
+ * --------------------------------------------------------------------------- */
+
+/* Copy the ifindex of every attached port slot into @p ifindex (0 for free
+ * slots); taken before g_sflow_lock, which nests inside g_port_lock. */
+static void sflow_ifindexes(int *ifindex)
+{
+    unsigned i;
+
+    pthread_mutex_lock(&g_port_lock);
+    for (i = 0; i < DP_MAX_PORTS; i++)
+        ifindex[i] = g_ports[i].in_use ? g_ports[i].ifindex : 0;
+    pthread_mutex_unlock(&g_port_lock);
+}
+
+/* Frames seen on port slot @p slot by all workers while it was sampled. */
+static uint64_t sflow_pool(unsigned slot)
+{
+    uint64_t sum = 0;
+    unsigned k;
+
+    for (k = 0; k < g_nworkers; k++)
+        sum += stat_load(&g_workers[k].sflow_pool[slot]);
+    return sum;
+}
+
+/* Samples of port slot @p slot all workers dropped on full rings. */
+static uint64_t sflow_drops(unsigned slot)
+{
+    uint64_t sum = 0;
+    unsigned k;
+
+    for (k = 0; k < g_nworkers; k++)
+        sum += stat_load(&g_workers[k].sflow_drops[slot]);
+    return sum;
+}
+
+/* Send the datagram being filled, if it holds a sample, and start the
+ * next one; g_sflow_lock held. */
+static void sflow_send(void)
+{
+    struct dp_sflow *a = &g_sflow;
+
+    if (a->dg.nsamples)
+    {
+        if (send(a->fd, a->dg.buf, a->dg.len, MSG_DONTWAIT) == (ssize_t)a->dg.len)
+            a->datagrams++;
+        else
+            a->send_errors++;
+        a->dgram_seq++;
+    }
+    sflow_dgram_start(&a->dg, a->cfg.agent, 0, a->dgram_seq + 1,
+                      (uint32_t)(now_ms() - a->started_ms));
+}
+
+/* Flow sample of @p rec, from port slot rec->port; g_sflow_lock held. */
+static void sflow_flow(const struct mirror_rec *rec, const int *ifindex)
+{
+    struct dp_sflow *a = &g_sflow;
+    unsigned slot = rec->port;
+    struct sflow_flow s;
+
+    memset(&s, 0, sizeof(s));
+    s.rate = __atomic_load_n(&g_sflow_rate[slot], __ATOMIC_RELAXED);
+    if (!s.rate || !ifindex[slot])
+        return;                 /* no longer sampled: the sample goes */
+    s.seq = ++a->flow_seq[slot];
+    s.source = SFLOW_SOURCE(SFLOW_DS_IFINDEX, ifindex[slot]);
+    s.pool = (uint32_t)(sflow_pool(slot) - a->pool_base[slot]);
+    s.drops = (uint32_t)(sflow_drops(slot) - a->drop_base[slot]);
+    s.input = (uint32_t)ifindex[slot];
+    s.frame_len = rec->len;
+    s.header = rec->data;
+    s.header_len = rec->caplen;
+    s.vid = rec->vid;
+    if (rec->caplen >= 16 && rec->data[12] == 0x81 && rec->data[13] == 0x00)
+        s.pcp = rec->data[14] >> 5;
+    if (sflow_add_flow(&a->dg, &s) < 0)
+    {
+        sflow_send();
+        sflow_add_flow(&a->dg, &s);
+    }
+    a->samples++;
+}
+
+/* Turn up to @p max samples of every worker's ring into flow samples;
+ * g_sflow_lock held.  Returns the samples taken. */
+static unsigned sflow_drain(const int *ifindex, unsigned max)
+{
+    const struct mirror_rec *rec;
+    unsigned n = 0;
+    unsigned k, i;
+
+    for (k = 0; k < g_nworkers; k++)
+    {
+        struct mirror_ring *r = g_workers[k].sring;
+
+        for (i = 0; r && i < max && (rec = mirror_ring_peek(r)) != NULL; i++)
+        {
+            if (ifindex)
+                sflow_flow(rec, ifindex);
+            mirror_ring_release(r);
+            n++;
+        }
+    }
+    return n;
+}
+
+/* Counter samples of the sampled ports and the polled VLANs; g_sflow_lock
+ * held. */
+static void sflow_poll(const int *ifindex)
+{
+    struct dp_sflow *a = &g_sflow;
+    uint64_t down = __atomic_load_n(&g_link_down, __ATOMIC_RELAXED);
+    struct sflow_if_counters ic;
+    struct sflow_vlan_counters vc;
+    struct dp_counters c;
+    unsigned i;
+
+    for (i = 0; i < DP_MAX_PORTS; i++)
+    {
+        if (!ifindex[i] || !__atomic_load_n(&g_sflow_rate[i], __ATOMIC_RELAXED))
+            continue;
+        dps_port_read(g_stats, i, &c);
+        memset(&ic, 0, sizeof(ic));
+        ic.seq = ++a->port_seq[i];
+        ic.ifindex = (uint32_t)ifindex[i];
+        ic.status = SFLOW_IF_ADMIN_UP | ((down & (1ull << i)) ? 0 : SFLOW_IF_OPER_UP);
+        ic.in_octets = c.rx_bytes;
+        ic.in_packets = (uint32_t)c.rx_packets;
+        ic.in_discards = (uint32_t)c.rx_dropped;
+        ic.out_octets = c.tx_bytes;
+        ic.out_packets = (uint32_t)c.tx_packets;
+        ic.out_discards = (uint32_t)c.tx_dropped;
+        if (sflow_add_if_counters(&a->dg, &ic) < 0)
+        {
+            sflow_send();
+            sflow_add_if_counters(&a->dg, &ic);
+        }
+        a->counters++;
+    }
+    for (i = 1; i < VLAN_ID_SPACE - 1; i++)
+    {
+        if (!(a->vlans[i / 64] & (1ull << (i % 64))))
+            continue;
+        dps_vlan_read(g_stats, i, &c);
+        vc.seq = ++a->vlan_seq[i];
+        vc.vid = (uint16_t)i;
+        vc.octets = c.rx_bytes;
+        vc.packets = (uint32_t)c.rx_packets;
+        vc.discards = (uint32_t)c.rx_dropped;
+        if (sflow_add_vlan_counters(&a->dg, &vc) < 0)
+        {
+            sflow_send();
+            sflow_add_vlan_counters(&a->dg, &vc);
+        }
+        a->counters++;
+    }
+}
+
+/* Non-zero if some worker's sample ring holds a sample. */
+static int sflow_pending(void)
+{
+    unsigned k;
+
+    for (k = 0; k < g_nworkers; k++)
+    {
+        if (g_workers[k].sring && mirror_ring_peek(g_workers[k].sring))
+            return 1;
+    }
+    return 0;
+}
+
+static void *dp_sflow_main(void *arg)
+{
+    static int ifindex[DP_MAX_PORTS];
+
+    (void)arg;
+    while (!atomic_load(&g_sflow_stop))
+    {
+        uint64_t now = now_ms();
+        int poll;
+
+        pthread_mutex_lock(&g_sflow_lock);
+        poll = g_sflow.cfg.poll_s && now >= g_sflow.next_poll_ms;
+        pthread_mutex_unlock(&g_sflow_lock);
+        if (!poll && !sflow_pending())
+        {
+            usleep(DP_SFLOW_IDLE_MS * 1000);
+            continue;
+        }
+        sflow_ifindexes(ifindex);
+        pthread_mutex_lock(&g_sflow_lock);
+        sflow_drain(ifindex, DP_SFLOW_RING);
+        if (poll)
+        {
+            sflow_poll(ifindex);
+            g_sflow.next_poll_ms = now + g_sflow.cfg.poll_s * 1000ull;
+        }
+        sflow_send();
+        pthread_mutex_unlock(&g_sflow_lock);
+    }
+    return NULL;
+}
+
+static void sflow_thread_stop(void)
+{
+    if (g_sflow_started)
+    {
+        atomic_store(&g_sflow_stop, 1);
+        pthread_join(g_sflow_thread, NULL);
+        g_sflow_started = 0;
+    }
+}
+
+/* Forget the agent: discard queued samples and close the socket; the
+ * sFlow thread has stopped and no worker samples any more. */
+static void sflow_reset(void)
+{
+    pthread_mutex_lock(&g_sflow_lock);
+    while (sflow_drain(NULL, DP_SFLOW_RING))
+        ;
+    if (g_sflow.fd >= 0)
+        close(g_sflow.fd);
+    memset(&g_sflow, 0, sizeof(g_sflow));
+    g_sflow.fd = -1;
+    pthread_mutex_unlock(&g_sflow_lock);
+}
+
+/* Stop the sFlow agent, if enabled, once the workers have stopped, and
+ * free the sample rings. */
+static void sflow_stop(void)
+{
+    unsigned k;
+
+    sflow_thread_stop();
+    memset(g_sflow_rate, 0, sizeof(g_sflow_rate));
+    sflow_reset();
+    for (k = 0; k < g_nworkers; k++)
+    {
+        mirror_ring_destroy(g_workers[k].sring);
+        g_workers[k].sring = NULL;
+    }
+}
+
+/**
+ * dp_sflow_enable() - Start the sFlow agent, or change its settings, with
+ * the collector, agent address, counter polling interval and header length
+ * of @p cfg.  Ports are sampled once dp_sflow_port() names them.
+ *
+ * @return
+ *    0        – success. \n
+ *   -EINVAL   – header length or polling interval out of range. \n
+ *   -ENOMEM   – no memory for the sample rings. \n
+ *   -ENODEV   – the forwarding plane is not running. \n
+ *   -errno    – creating the socket or the sFlow thread failed.
+ */
+int dp_sflow_enable(const struct dp_sflow_cfg *cfg)
+{
+    struct sockaddr_in sa;
+    unsigned k;
+    int fd;
+    int err = 0;
+
+    if (!cfg || (cfg->header && (cfg->header < 14 || cfg->header > DP_SFLOW_HEADER_MAX)) ||
+        cfg->poll_s > DP_SFLOW_POLL_MAX)
+        return -EINVAL;
+    if (!g_running)
+        return -ENODEV;
+
+    memset(&sa, 0, sizeof(sa));
+    sa.sin_family = AF_INET;
+    sa.sin_port = htons(cfg->port ? cfg->port : SFLOW_PORT);
+    memcpy(&sa.sin_addr, cfg->collector, 4);
+    if ((fd = socket(AF_INET, SOCK_DGRAM | SOCK_CLOEXEC, 0)) < 0)
+        return -errno;
+    if (connect(fd, (struct sockaddr *)&sa, sizeof(sa)) < 0)
+    {
+        err = -errno;
+        close(fd);
+        return err;
+    }
+
+    pthread_mutex_lock(&g_sflow_lock);
+    for (k = 0; k < g_nworkers && err == 0; k++)
+    {
+        struct mirror_ring *r;
+
+        if (g_workers[k].sring)
+            continue;
+        if ((r = mirror_ring_create(DP_SFLOW_RING)) == NULL)
+            err = -ENOMEM;
+        else
+            __atomic_store_n(&g_workers[k].sring, r, __ATOMIC_RELEASE);
+    }
+    if (err == 0 && g_sflow.on)
+    {
+        /* What is queued goes to the old collector. */
+        sflow_send();
+        close(g_sflow.fd);
+    }
+    else if (err == 0)
+    {
+        memset(&g_sflow, 0, sizeof(g_sflow));
+        g_sflow.started_ms = now_ms();
+    }
+    if (err == 0)
+    {
+        g_sflow.cfg = *cfg;
+        g_sflow.fd = fd;
+        g_sflow.next_poll_ms = now_ms() + cfg->poll_s * 1000ull;
+        __atomic_store_n(&g_sflow_header, cfg->header ? cfg->header : SFLOW_HEADER_MAX,
+                         __ATOMIC_RELAXED);
+        sflow_send();
+        if (!g_sflow_started)
+        {
+            atomic_store(&g_sflow_stop, 0);
+            err = -pthread_create(&g_sflow_thread, NULL, dp_sflow_main, NULL);
+            if (err == 0)
+            {
+                pthread_setname_np(g_sflow_thread, "dp-sflow");
+                g_sflow_started = 1;
+            }
+        }
+    }
+    if (err == 0)
+        g_sflow.on = 1;
+    else if (!g_sflow.on)
+        g_sflow.fd = -1;
+    if (err < 0)
+        close(fd);
+    pthread_mutex_unlock(&g_sflow_lock);
+    return err;
+}
+
+/**
+ * dp_sflow_disable() - Stop sampling every port and stop the sFlow agent;
+ * samples not yet sent are discarded.
+ *
+ * @return 0, -ENOENT if the agent is not enabled, or -ENODEV.
+ */
+int dp_sflow_disable(void)
+{
+    unsigned i;
+    int on;
+
+    if (!g_running)
+        return -ENODEV;
+
+    pthread_mutex_lock(&g_port_lock);
+    pthread_mutex_lock(&g_sflow_lock);
+    on = g_sflow.on;
+    g_sflow.on = 0;
+    for (i = 0; i < DP_MAX_PORTS; i++)
+        __atomic_store_n(&g_sflow_rate[i], 0, __ATOMIC_RELAXED);
+    pthread_mutex_unlock(&g_sflow_lock);
+    pthread_mutex_unlock(&g_port_lock);
+    if (!on)
+        return -ENOENT;
+
+    /* Once each worker has started a new pass none is filling a ring. */
+    sflow_thread_stop();
+    grace_sync();
+    sflow_reset();
+    return 0;
+}
+
+/**
+ * dp_sflow_port() - Sample 1 in @p rate of the frames attached port
+ * @p port receives, and poll its counters; @p rate 0 stops both.
+ *
+ * A port stops being sampled when it is detached.
+ *
+ * @return 0, -EINVAL for a rate above SFLOW_RATE_MAX, -ENOTCONN if the
+ *         agent is not enabled, -ENOENT if the port is not attached, or
+ *         -ENODEV.
+ */
+int dp_sflow_port(const char *port, uint32_t rate)
+{
+    unsigned i;
+    int err = -ENOENT;
+
+    if (!port || rate > SFLOW_RATE_MAX)
+        return -EINVAL;
+    if (!g_running)
+        return -ENODEV;
+
+    pthread_mutex_lock(&g_port_lock);
+    pthread_mutex_lock(&g_sflow_lock);
+    for (i = 0; g_sflow.on && i < DP_MAX_PORTS; i++)
+    {
+        if (!g_ports[i].in_use || strcmp(g_ports[i].name, port) != 0)
+            continue;
+        if (rate && !g_sflow_rate[i])
+        {
+            g_sflow.pool_base[i] = sflow_pool(i);
+            g_sflow.drop_base[i] = sflow_drops(i);
+        }
+        __atomic_store_n(&g_sflow_rate[i], rate, __ATOMIC_RELAXED);
+        err = 0;
+        break;
+    }
+    if (!g_sflow.on)
+        err = -ENOTCONN;
+    pthread_mutex_unlock(&g_sflow_lock);
+    pthread_mutex_unlock(&g_port_lock);
+    return err;
+}
+
+/**
+ * dp_sflow_vlan() - Poll the counters of VLAN @p vid (@p on non-zero) or
+ * stop.
+ *
+ * @return 0, -EINVAL for a VLAN ID outside [1..4094], -ENOTCONN if the
+ *         agent is not enabled, or -ENODEV.
+ */
+int dp_sflow_vlan(uint16_t vid, int on)
+{
+    int err = 0;
+
+    if (vid < 1 || vid > 4094)
+        return -EINVAL;
+    if (!g_running)
+        return -ENODEV;
+
+    pthread_mutex_lock(&g_sflow_lock);
+    if (!g_sflow.on)
+        err = -ENOTCONN;
+    else if (on)
+        g_sflow.vlans[vid / 64] |= 1ull << (vid % 64);
+    else
+        g_sflow.vlans[vid / 64] &= ~(1ull << (vid % 64));
+    pthread_mutex_unlock(&g_sflow_lock);
+    return err;
+}
+
+/**
+ * dp_get_sflow() - Copy the settings, sources and counters of the sFlow
+ * agent; @c enabled is 0 while it is not running.
+ *
+ * @return 0, -EINVAL, or -ENODEV.
+ */
+int dp_get_sflow(struct dp_sflow_info *info)
+{
+    unsigned i;
+
+    if (!info)
+        return -EINVAL;
+    if (!g_running)
+        return -ENODEV;
+
+    memset(info, 0, sizeof(*info));
+    pthread_mutex_lock(&g_sflow_lock);
+    info->enabled = g_sflow.on;
+    info->cfg = g_sflow.cfg;
+    for (i = 0; i < DP_MAX_PORTS; i++)
+    {
+        info->rate[i] = __atomic_load_n(&g_sflow_rate[i], __ATOMIC_RELAXED);
+        info->drops += sflow_drops(i);
+    }
+    memcpy(info->vlans, g_sflow.vlans, sizeof(info->vlans));
+    info->samples = g_sflow.samples;
+    info->counters = g_sflow.counters;
+    info->datagrams = g_sflow.datagrams;
+    info->send_errors = g_sflow.send_errors;
+    pthread_mutex_unlock(&g_sflow_lock);
+    return 0;
+}
+
+/* ---------------------------------------------------------------------------
+ * VLAN translation (control threads)
+ * --------------------------------------------------------------------------- */
+
+/**
+ * dp_vlan_xlate() - Translate C-VIDs @p cvid .. @p cvid + @p count - 1
+ * received on attached port @p port into VLANs @p vid .. @p vid + @p count
+ * - 1 in order, and those VLANs back into their C-VIDs when sent on it; or
+ * stop translating the C-VIDs if @p vid is 0.
+ *
+ * The port must be a trunk carrying the VLANs for their frames to pass.  A
+ * port loses its mappings when it is detached.
+ *
+ * @return 0, -ENOENT if the port is not attached, -EINVAL or -EEXIST if
+ *         the mappings are refused by vlan_xlate_check(), -ENOMEM, or
+ *         -ENODEV if the forwarding plane is not running.
+ */
+int dp_vlan_xlate(const char *port, uint16_t cvid, uint16_t vid, unsigned count)
+{
+    static const struct vlan_xlate none;
+    struct vlan_xlate *x;
+    unsigned i;
+    int err = -ENOENT;
+
+    if (!port)
+        return -EINVAL;
+    if (!g_running)
+        return -ENODEV;
+
+    pthread_mutex_lock(&g_port_lock);
+    for (i = 0; i < DP_MAX_PORTS; i++)
+    {
+        if (!g_ports[i].in_use || strcmp(g_ports[i].name, port) != 0)
+            continue;
+        x = g_xlate_mem[i];
+        err = vlan_xlate_check(x ? x : &none, cvid, vid, count);
+        if (err == 0 && !x && vid && (x = g_xlate_mem[i] = calloc(1, sizeof(*x))) == NULL)
+            err = -ENOMEM;
+        if (err == 0 && x)
+        {
+            vlan_xlate_set(x, cvid, vid, count);
+            __atomic_store_n(&g_port_xlate[i], x->n ? x : NULL, __ATOMIC_RELEASE);
+        }
+        break;
+    }
+    pthread_mutex_unlock(&g_port_lock);
+    return err;
+}
+
+/**
+ * dp_vlan_xlate_walk() - Pass every mapping to @p fn, by port slot and
+ * then C-VID.
+ *
+ * @return the number of mappings, or -ENODEV if the forwarding plane is
+ *         not running.
+ */
+int dp_vlan_xlate_walk(dp_xlate_fn fn, void *arg)
+{
+    const struct vlan_xlate *x;
+    unsigned i, c;
+    int n = 0;
+
+    if (!fn)
+        return -EINVAL;
+    if (!g_running)
+        return -ENODEV;
+
+    pthread_mutex_lock(&g_port_lock);
+    for (i = 0; i < DP_MAX_PORTS; i++)
+    {
+        if (!g_ports[i].in_use || (x = g_port_xlate[i]) == NULL)
+            continue;
+        for (c = 1; c < VLAN_ID_SPACE; c++)
+        {
+            if (!x->in[c])
+                continue;
+            fn(g_ports[i].name, (uint16_t)c, x->in[c], arg);
+            n++;
+        }
+    }
+    pthread_mutex_unlock(&g_port_lock);
+    return n;
+}
+
+/* ---------------------------------------------------------------------------
+ * Packet traces (control threads)
+ * --------------------------------------------------------------------------- */
+
+/**
+ * dp_trace_inject() - Forward frame @p frame of @p len bytes as if port
+ * @p port had received it, and fill @p t with its trace.
+ *
+ * The frame really is forwarded, learned from and counted in its VLAN; it
+ * is parsed like a received one, so an 802.1Q tag in it is the tag it
+ * arrived with.
+ *
+ * @return 0, -EINVAL for a NULL argument or a frame shorter than an
+ *         Ethernet header, -EMSGSIZE for one over DP_TRACE_FRAME_MAX,
+ *         -ENOENT if the port is not attached, or -ENODEV.
+ */
+int dp_trace_inject(const char *port, const uint8_t *frame, uint32_t len, struct trace *t)
+{
+    struct dp_ctl req;
+    unsigned i;
+
+    if (!port || !frame || !t || len < ETH_HLEN)
+        return -EINVAL;
+    if (len > DP_TRACE_FRAME_MAX)
+        return -EMSGSIZE;
+    if (!g_running)
+        return -ENODEV;
+
+    memset(&req, 0, sizeof(req));
+    pthread_mutex_lock(&g_port_lock);
+    for (i = 0; i < DP_MAX_PORTS; i++)
+    {
+        if (g_ports[i].in_use && strcmp(g_ports[i].name, port) == 0)
+            req.ifindex = g_ports[i].ifindex;
+    }
+    pthread_mutex_unlock(&g_port_lock);
+    if (!req.ifindex)
+        return -ENOENT;
+
+    req.op = DP_CTL_TRACE;
+    req.frame = frame;
+    req.len = len;
+    req.trace = t;
+    return post_ctl(&req);
+}
+
+/**
+ * dp_trace_sample() - Trace 1 in @p rate of the frames port @p port
+ * receives, at most one per worker and millisecond; @p rate 0 stops.
+ *
+ * The traces are read with dp_get_traces().  A port stops being sampled
+ * when it is detached.
+ *
+ * @return 0, -EINVAL, -ENOENT if the port is not attached, or -ENODEV.
+ */
+int dp_trace_sample(const char *port, uint32_t rate)
+{
+    unsigned i;
+    int err = -ENOENT;
+
+    if (!port)
+        return -EINVAL;
+    if (!g_running)
+        return -ENODEV;
+
+    pthread_mutex_lock(&g_port_lock);
+    for (i = 0; i < DP_MAX_PORTS; i++)
+    {
+        if (!g_ports[i].in_use || strcmp(g_ports[i].name, port) != 0)
+            continue;
+        __atomic_store_n(&g_trace_rate[i], rate, __ATOMIC_RELAXED);
+        err = 0;
+        break;
+    }
+    pthread_mutex_unlock(&g_port_lock);
+    return err;
+}
+
+/**
+ * dp_get_trace_rates() - Copy the trace sampling rate of every port slot
+ * (0: not sampled) into @p rate[DP_MAX_PORTS].
+ *
+ * @return 0, -EINVAL, or -ENODEV.
+ */
+int dp_get_trace_rates(uint32_t *rate)
+{
+    unsigned i;
+
+    if (!rate)
+        return -EINVAL;
+    if (!g_running)
+        return -ENODEV;
+
+    for (i = 0; i < DP_MAX_PORTS; i++)
+        rate[i] = __atomic_load_n(&g_trace_rate[i], __ATOMIC_RELAXED);
+    return 0;
+}
+
+/**
+ * dp_get_traces() - Copy the newest traces of sampled frames, at most
+ * @p max of them, newest first, into @p out.
+ *
+ * Every worker keeps its last DP_TRACE_KEEP traces; one that is being
+ * overwritten while it is read is left out.
+ *
+ * @return the number of traces copied, -EINVAL, or -ENODEV.
+ */
+int dp_get_traces(struct trace *out, unsigned max)
+{
+    unsigned n = 0;
+    unsigned k, j, pos;
+
+    if (!out)
+        return -EINVAL;
+    if (!g_running)
+        return -ENODEV;
+
+    for (k = 0; k < g_nworkers; k++)
+    {
+        for (j = 0; j < DP_TRACE_KEEP; j++)
+        {
+            const struct dp_trace_slot *ts = &g_workers[k].traces[j];
+            uint32_t seq = __atomic_load_n(&ts->seq, __ATOMIC_ACQUIRE);
+            struct trace t;
+
+            if (seq == 0 || (seq & 1))
+                continue;
+            memcpy(&t, &ts->t, sizeof(t));
+            __atomic_thread_fence(__ATOMIC_ACQUIRE);
+            if (__atomic_load_n(&ts->seq, __ATOMIC_RELAXED) != seq)
+                continue;
+
+            for (pos = 0; pos < n && out[pos].ts_ns >= t.ts_ns; pos++)
+                ;
+            if (pos == max)
+                continue;
+            if (n < max)
+                n++;
+            memmove(&out[pos + 1], &out[pos], (n - 1 - pos) * sizeof(*out));
+            out[pos] = t;
+        }
+    }
+    return (int)n;
+}
+
+/* ---------------------------------------------------------------------------
+ * Multicast snooping (snooping thread and control threads, under g_snoop_lock)
+ * --------------------------------------------------------------------------- */
+
+/* Snooper callback: router ports go straight to g_mrouter, group changes
+ * mark the listener table stale. */
+static void snoop_changed(enum snoop_op op, const struct snoop_key *k, int port, void *arg)
+{
+    uint64_t bit = 1ull << port;
+
+    (void)arg;
+    if (op == SNOOP_ROUTER_ADD)
+        __atomic_fetch_or(&g_mrouter[k->vid], bit, __ATOMIC_RELAXED);
+    else if (op == SNOOP_ROUTER_DEL)
+        __atomic_fetch_and(&g_mrouter[k->vid], ~bit, __ATOMIC_RELAXED);
+    else
+        g_mdb_dirty = 1;
+}
+
+/* Swap in a listener table compiled from the snooper if it changed, and
+ * free the previous one after a grace period.  Out of memory, the old
+ * table stays and the next pass retries. */
+static void mdb_publish(void)
+{
+    struct snoop_table *t, *old;
+
+    if (!g_mdb_dirty || !(t = snoop_compile(g_snooper)))
+        return;
+    old = __atomic_exchange_n(&g_mdb, t, __ATOMIC_SEQ_CST);
+    g_mdb_dirty = 0;
+    if (!old)
+        return;
+    grace_sync();
+    snoop_table_free(old);
+}
+
+static void *dp_snoop_main(void *arg)
+{
+    static struct dp_snoop_msg batch[DP_SNOOP_BATCH];
+    struct timespec deadline;
+    uint64_t gone;
+    unsigned n, i;
+
+    (void)arg;
+    pthread_mutex_lock(&g_snoopq_lock);
+    while (!g_snoop_stop)
+    {
+        if (!g_snoopq_n && !g_snoop_gone)
+        {
+            clock_gettime(CLOCK_MONOTONIC, &deadline);
+            deadline.tv_nsec += SNOOP_TICK_MS * 1000000L;
+            if (deadline.tv_nsec >= 1000000000L)
+            {
+                deadline.tv_sec++;
+                deadline.tv_nsec -= 1000000000L;
+            }
+            pthread_cond_timedwait(&g_snoopq_cond, &g_snoopq_lock, &deadline);
+        }
+        /* Messages queued before a port left were dropped with it, so its
+         * departure is applied ahead of everything taken with it. */
+        gone = g_snoop_gone;
+        g_snoop_gone = 0;
+        for (n = 0; n < DP_SNOOP_BATCH && g_snoopq_n; n++)
+        {
+            batch[n] = g_snoopq[g_snoopq_head];
+            g_snoopq_head = (g_snoopq_head + 1) % DP_SNOOP_QUEUE;
+            g_snoopq_n--;
+        }
+        pthread_mutex_unlock(&g_snoopq_lock);
+
+        pthread_mutex_lock(&g_snoop_lock);
+        for (; gone; gone &= gone - 1)
+            snoop_port_down(g_snooper, __builtin_ctzll(gone));
+        for (i = 0; i < n; i++)
+        {
+            if (batch[i].len)
+                snoop_rx(g_snooper, batch[i].vid, batch[i].slot, batch[i].data, batch[i].len,
+                         now_ms());
+        }
+        snoop_tick(g_snooper, now_ms());
+        mdb_publish();
+        pthread_mutex_unlock(&g_snoop_lock);
+
+        pthread_mutex_lock(&g_snoopq_lock);
+    }
+    pthread_mutex_unlock(&g_snoopq_lock);
+    return NULL;
+}
+
+/* Start the snooping thread; g_snoop_lock held. */
+static int snoop_start(void)
+{
+    pthread_condattr_t ca;
+    int err;
+
+    pthread_condattr_init(&ca);
+    pthread_condattr_setclock(&ca, CLOCK_MONOTONIC);
+    pthread_cond_init(&g_snoopq_cond, &ca);
+    pthread_condattr_destroy(&ca);
+
+    pthread_mutex_lock(&g_snoopq_lock);
+    g_snoopq_head = 0;
+    g_snoopq_n = 0;
+    g_snoop_gone = 0;
+    g_snoop_stop = 0;
+    pthread_mutex_unlock(&g_snoopq_lock);
+
+    err = pthread_create(&g_snoop_thread, NULL, dp_snoop_main, NULL);
+    if (err)
+    {
+        pthread_cond_destroy(&g_snoopq_cond);
+        return -err;
+    }
+    pthread_setname_np(g_snoop_thread, "dp-snoop");
+    g_snoop_started = 1;
+    return 0;
+}
+
+/* Stop the snooping thread, if started; g_snoop_lock not held. */
+static void snoop_stop(void)
+{
+    if (!g_snoop_started)
+        return;
+    pthread_mutex_lock(&g_snoopq_lock);
+    g_snoop_stop = 1;
+    pthread_cond_signal(&g_snoopq_cond);
+    pthread_mutex_unlock(&g_snoopq_lock);
+    pthread_join(g_snoop_thread, NULL);
+    pthread_cond_destroy(&g_snoopq_cond);
+    g_snoop_started = 0;
+}
+
+/**
+ * dp_snoop_vlan() - Start or stop IGMP / MLD snooping in VLAN @p vid.
+ *
+ * Until listeners report, the VLAN's multicast keeps flooding.  Stopping
+ * forgets the VLAN's groups and router ports and floods again.
+ *
+ * @return 0, -EINVAL for a VLAN ID outside [1..4094], -ENOMEM, the
+ *         negative error of starting the snooping thread, or -ENODEV if
+ *         the forwarding plane is not running.
+ */
+int dp_snoop_vlan(uint16_t vid, int on)
+{
+    uint64_t bit = 1ull << (vid % 64);
+    int err = 0;
+
+    if (vid < 1 || vid > 4094)
+        return -EINVAL;
+    if (!g_running)
+        return -ENODEV;
+
+    pthread_mutex_lock(&g_snoop_lock);
+    if (!g_snooper && !(g_snooper = snoop_create(now_ms(), snoop_changed, NULL)))
+        err = -ENOMEM;
+    else if (on && !g_snoop_started)
+        err = snoop_start();
+    if (err == 0)
+    {
+        if (!on)
+            __atomic_fetch_and(&g_snoop_on[vid / 64], ~bit, __ATOMIC_RELAXED);
+        snoop_vlan_enable(g_snooper, vid, on);
+        if (on)
+            __atomic_fetch_or(&g_snoop_on[vid / 64], bit, __ATOMIC_RELAXED);
+        mdb_publish();
+    }
+    pthread_mutex_unlock(&g_snoop_lock);
+    return err;
+}
+
+int dp_snoop_vlan_enabled(uint16_t vid)
+{
+    return g_running && vid < VLAN_ID_SPACE && snoop_vlan(vid);
+}
+
+/**
+ * dp_snoop_walk() - Pass the router ports and group memberships learned
+ * by the forwarding plane to @p fn (see snoop_walk()).
+ *
+ * Ports are port table slots (dp_get_port()).
+ *
+ * @return the number of entries, or -ENODEV if the forwarding plane is
+ *         not running.
+ */
+int dp_snoop_walk(snoop_walk_fn fn, void *arg)
+{
+    int n = 0;
+
+    if (!fn)
+        return -EINVAL;
+    if (!g_running)
+        return -ENODEV;
+
+    pthread_mutex_lock(&g_snoop_lock);
+    if (g_snooper)
+        n = snoop_walk(g_snooper, now_ms(), fn, arg);
+    pthread_mutex_unlock(&g_snoop_lock);
+    return n;
+}
+
+/**
+ * dp_snoop_get_stats() - Message and table counters of the snooper.
+ *
+ * @return 0, or -ENODEV if the forwarding plane is not running or never
+ *         snooped a VLAN.
+ */
+int dp_snoop_get_stats(struct snoop_stats *st)
+{
+    int err = -ENODEV;
+
+    if (!g_running || !st)
+        return -ENODEV;
+
+    pthread_mutex_lock(&g_snoop_lock);
+    if (g_snooper)
+    {
+        snoop_get_stats(g_snooper, st);
+        err = 0;
+    }
+    pthread_mutex_unlock(&g_snoop_lock);
+    return err;
+}
+
+/**
+ * dp_fdb_dump() - Walk the MAC address table without stalling the worker.
+ *
+ * @param vid  VLAN to list, or -1 for all.
+ *
+ * Entry ports are port table slots (dp_get_port()).
+ *
+ * @return the number of entries passed to @p fn, or -ENODEV if the
+ *         forwarding plane is not running.
+ */
+int dp_fdb_dump(int vid, fdb_dump_fn fn, void *arg)
+{
+    if (!g_running || !fn)
+        return -ENODEV;
+    return (int)fdb_dump(g_fdb, vid, (uint32_t)(now_ms() / 1000), fn, arg);
+}
+
+/**
+ * dp_fdb_set_capacity() - Configure the RES_FDB capacity (res.h) and learn
+ * at most that many addresses from now on.  Without the forwarding plane
+ * only the capacity is recorded, for the next dp_init().
+ *
+ * @return as res_set_capacity().
+ */
+int dp_fdb_set_capacity(unsigned capacity)
+{
+    int err = res_set_capacity(RES_FDB, capacity);
+
+    if (err == 0 && g_running)
+        fdb_set_limit(g_fdb, capacity);
+    return err;
+}
+
+/**
+ * dp_fdb_get_stats() - Learning, move, aging and flush counters of the FDB.
+ *
+ * @return 0, or -ENODEV if the forwarding plane is not running.
+ */
+int dp_fdb_get_stats(struct fdb_stats *stats)
+{
+    if (!g_running || !stats)
+        return -ENODEV;
+    fdb_get_stats(g_fdb, stats);
+    return 0;
+}
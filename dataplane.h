@@ -0,0 +1,305 @@
+/**
+ * @file dataplane.h
+ * @brief Optional user-space forwarding plane ("virtual ASIC" pipeline).
+ *
+ * When enabled, one or more worker threads attach a TPACKET_V3 ring
+ * (dp_ring.h) each to every VLAN member port and switch frames between the
+ * ports of the same VLAN in user space, tagging and untagging per port
+ * (access, or trunk with an optional native VLAN) on the way.  The Vlan<id>
+ * bridges stay administratively down, so the kernel does not forward the
+ * same frames a second time; they remain the record of VLAN membership that
+ * the control plane already manages.
+ *
+ * Port membership is either followed from the published link snapshot
+ * (DP_F_FOLLOW_STATE, used by the daemon; an 8021q sub-interface enslaved to
+ * a Vlan<id> bridge makes its parent a trunk) or set explicitly with
+ * dp_port_attach() / dp_port_trunk() / dp_port_detach() (tests and
+ * benchmarks).
+ *
+ * With DP_F_XDP a port is served through AF_XDP sockets, one per worker on
+ * its own RX queue, instead of TPACKET rings; see dp_xsk.h.
+ *
+ * Named ingress ACLs (acl.h) can be bound to ports and to VLANs; a frame
+ * denied by the ACL of its ingress port or of its VLAN is dropped before
+ * switching or routing.  ACLs are edited with dp_acl_rule_add() and
+ * friends while traffic flows: each edit compiles a new table and swaps it
+ * in atomically.
+ *
+ * Storm control meters broadcast, multicast and unknown unicast frames per
+ * ingress port and per VLAN against storm.h token buckets, in packets or
+ * bits per second, and drops what exceeds the rate before it floods.
+ *
+ * IGMP / MLD snooping (snoop.h), enabled per VLAN with dp_snoop_vlan(),
+ * learns which ports have listeners for which multicast group and narrows
+ * the flood of that group's data to them and to the VLAN's router ports.
+ *
+ * Link aggregation groups attached ports into LAGs (dp_lag_create()) that
+ * switch as one port: learned on and flooded to once, never sending a
+ * frame back into the LAG it came from, and transmitting each flow on one
+ * member chosen by an lag.h hash.  A member whose link goes down drops out
+ * of the hash at once, and so does one whose VLAN configuration differs
+ * from the LAG's first attached member until it matches again.
+ *
+ * Mirror sessions (dp_mirror_create()) copy the frames received or sent on
+ * chosen ports, or classified into or sent in chosen VLANs, into pcap-ng
+ * files (mirror.h), with a snap length and 1-in-N sampling per session.
+ * The workers hand the copies to a writer thread through lock-free rings
+ * and drop, counting them, whatever does not fit.
+ *
+ * The sFlow agent (dp_sflow_enable()) samples the frames received on
+ * chosen ports at random, 1 in N per port, polls the counters of those
+ * ports and of chosen VLANs, and exports both to a collector as sFlow v5
+ * datagrams (sflow.h) over UDP.
+ *
+ * VLAN translation (dp_vlan_xlate()) maps the customer VIDs received on a
+ * trunk into internal VLANs and back on egress, through one direct-indexed
+ * vlan_xlate.h table per port: one lookup per tagged frame, however many
+ * VIDs the port translates.
+ *
+ * Packet traces (trace.h) record the decision of every pipeline stage on
+ * one frame, and the cycles it took: dp_trace_inject() forwards a given
+ * frame as if a port had received it and returns its trace, and
+ * dp_trace_sample() traces 1 in N of the frames a port receives, read back
+ * with dp_get_traces().
+ */
+
+#ifndef DATAPLANE_H
+#define DATAPLANE_H
+
+#include <stdint.h>
+#include <linux/if.h>
+
+#include "acl.h"
+#include "dp_pool.h"
+#include "dp_stats.h"
+#include "fdb.h"
+#include "lag.h"
+#include "mirror.h"
+#include "sflow.h"
+#include "snoop.h"
+#include "storm.h"
+#include "trace.h"
+
+/** Ports the forwarding plane can attach at the same time. */
+#define DP_MAX_PORTS       64
+/** Forwarding worker threads, each with its own ring per port. */
+#define DP_MAX_WORKERS     16
+
+/** Named ACLs the forwarding plane holds. */
+#define DP_MAX_ACLS        64
+#define DP_ACL_NAME_LEN    32
+
+/** LAGs the forwarding plane holds. */
+#define DP_MAX_LAGS        32
+
+/** Mirror sessions the forwarding plane runs at the same time. */
+#define DP_MAX_MIRRORS     8
+#define DP_MIRROR_NAME_LEN 32
+
+/** Longest frame header an sFlow flow sample carries. */
+#define DP_SFLOW_HEADER_MAX 256
+/** Longest sFlow counter polling interval, seconds. */
+#define DP_SFLOW_POLL_MAX  3600
+
+/** Longest frame dp_trace_inject() takes. */
+#define DP_TRACE_FRAME_MAX 2048
+
+/** Mirror VLAN membership from vlan_state instead of dp_port_attach(). */
+#define DP_F_FOLLOW_STATE  0x1
+/** Receive and transmit through AF_XDP sockets (dp_xsk.h) where possible. */
+#define DP_F_XDP           0x2
+
+/** Port I/O backends (dp_port_info.io). */
+#define DP_IO_TPACKET      0
+#define DP_IO_XDP_SKB      1         /**< AF_XDP, XDP program in generic mode */
+#define DP_IO_XDP_DRV      2         /**< AF_XDP, XDP program in the driver */
+
+/** Snapshot of one attached port for the show commands. */
+struct dp_port_info
+{
+    char                 name[IFNAMSIZ];
+    int                  ifindex;
+    uint16_t             vid;        /**< access VLAN, or native VLAN of a trunk */
+    uint8_t              trunk;
+    unsigned             ntagged;    /**< VLANs a trunk carries tagged */
+    uint8_t              io;         /**< DP_IO_* */
+    char                 lag[IFNAMSIZ];  /**< LAG it is a member of, or "" */
+    struct dp_counters   stats;      /**< since the port was attached */
+    struct dp_rate       rate;       /**< over the last sampling period */
+};
+
+/** Traffic of one VLAN for the show commands. */
+struct dp_vlan_info
+{
+    uint16_t             vid;
+    unsigned             nports;     /**< member ports in the flood list */
+    struct dp_counters   stats;
+    struct dp_rate       rate;
+};
+
+struct dp_worker_stats
+{
+    int      cpu;            /**< pinned CPU, -1 if floating or for totals */
+    uint64_t packets;        /**< frames received and processed */
+    uint64_t bursts;         /**< RX blocks processed */
+    uint64_t routed;         /**< frames routed between VLANs */
+    uint64_t route_drops;    /**< routable frames without route, neighbor or TTL */
+    uint64_t acl_drops;      /**< frames denied by an ingress ACL */
+    uint64_t storm_drops;    /**< frames over a storm control rate */
+    uint64_t mcast_pruned;   /**< multicast frames sent to listeners only */
+    uint64_t snoop_overruns; /**< IGMP / MLD messages the snooping queue dropped */
+    uint64_t lag_drops;      /**< frames to a LAG without a member up */
+    uint64_t mirror_drops;   /**< mirrored copies dropped on a full ring */
+    uint64_t cpu_ns;         /**< worker thread CPU time */
+    uint64_t wall_ns;        /**< time since the workers started */
+};
+
+/** Configuration and state of one LAG for the show commands. */
+struct dp_lag_info
+{
+    char                 name[IFNAMSIZ];
+    uint8_t              hash;       /**< LAG_HASH_* */
+    unsigned             nmembers;
+    char                 member[LAG_MAX_MEMBERS][IFNAMSIZ];
+    uint64_t             ports;      /**< attached members, bit i = port slot i */
+    uint64_t             up;         /**< of those, the ones hashed over: link up,
+                                          the representative's VLANs */
+};
+
+/** Output settings of a mirror session. */
+struct dp_mirror_cfg
+{
+    char                 prefix[128]; /**< files are <prefix>.<n>.pcapng */
+    unsigned             snaplen;    /**< bytes kept per frame, 0: MIRROR_SNAPLEN_MAX */
+    unsigned             sample;     /**< mirror 1 frame in @c sample, 0 or 1: all */
+    uint64_t             file_bytes; /**< start a new file past this size, 0: never */
+    unsigned             files;      /**< files before the names wrap, 0: unlimited */
+};
+
+/** Configuration, sources and counters of one mirror session. */
+struct dp_mirror_info
+{
+    char                 name[DP_MIRROR_NAME_LEN];
+    struct dp_mirror_cfg cfg;
+    char                 file[160];  /**< file being written */
+    uint64_t             ports[2];   /**< source ports, bit i = slot i: [0] rx, [1] tx */
+    uint64_t             vlans[2][4096 / 64];  /**< source VLANs, bit v: [0] rx, [1] tx */
+    uint64_t             frames;     /**< frames written */
+    uint64_t             bytes;      /**< bytes of them captured */
+    uint64_t             drops;      /**< frames lost: full rings, write errors */
+    unsigned             nfiles;     /**< files started */
+};
+
+/** Settings of the sFlow agent. */
+struct dp_sflow_cfg
+{
+    uint8_t              collector[4]; /**< collector IPv4 address, network order */
+    uint16_t             port;       /**< its UDP port, 0: SFLOW_PORT */
+    uint8_t              agent[4];   /**< agent address the datagrams carry */
+    unsigned             poll_s;     /**< counter polling interval, 0: no polling */
+    unsigned             header;     /**< bytes of a sampled frame sent, 0: SFLOW_HEADER_MAX */
+};
+
+/** State of the sFlow agent. */
+struct dp_sflow_info
+{
+    int                  enabled;
+    struct dp_sflow_cfg  cfg;
+    uint32_t             rate[DP_MAX_PORTS];   /**< of every port slot, 0: not sampled */
+    uint64_t             vlans[4096 / 64];     /**< VLANs polled, bit v */
+    uint64_t             samples;    /**< flow samples sent */
+    uint64_t             drops;      /**< samples lost on full rings */
+    uint64_t             counters;   /**< counter samples sent */
+    uint64_t             datagrams;
+    uint64_t             send_errors;
+};
+
+/** Summary of one ACL for the show commands. */
+struct dp_acl_info
+{
+    char                 name[DP_ACL_NAME_LEN];
+    unsigned             nrules;
+    uint8_t              default_action;  /**< ACL_PERMIT or ACL_DENY */
+    unsigned             nports;     /**< ports it is bound to */
+    unsigned             nvlans;     /**< VLANs it is bound to */
+    uint64_t             no_match;   /**< frames that got the default action */
+};
+
+/** dp_storm_walk() callback; @p port is NULL for a VLAN bucket. */
+typedef void (*dp_storm_fn)(const char *port, uint16_t vid, unsigned cls,
+                            const struct storm_rate *rate, uint64_t drops, void *arg);
+
+/** dp_vlan_xlate_walk() callback: one mapping of port @p port. */
+typedef void (*dp_xlate_fn)(const char *port, uint16_t cvid, uint16_t vid, void *arg);
+
+/** dp_acl_dump() callback: one rule and the frames that matched it. */
+typedef void (*dp_acl_rule_fn)(const struct acl_rule *rule, uint64_t hits, void *arg);
+
+int  dp_init(unsigned flags, unsigned nworkers, const int *cpus);
+void dp_shutdown(void);
+int  dp_running(void);
+
+int  dp_port_attach(const char *name, uint16_t vid);
+int  dp_port_trunk(const char *name, uint16_t native, const uint16_t *vids, unsigned nvids);
+int  dp_vlan_router(uint16_t vid, const uint8_t *mac);
+int  dp_port_detach(const char *name);
+
+int  dp_get_port(unsigned slot, struct dp_port_info *info);
+uint64_t dp_vlan_ports(uint16_t vid);
+int  dp_get_vlan(uint16_t vid, struct dp_vlan_info *info);
+unsigned dp_workers(void);
+int  dp_get_worker(unsigned id, struct dp_worker_stats *stats);
+int  dp_get_worker_stats(struct dp_worker_stats *stats);
+int  dp_get_pool_stats(struct dpp_stats *stats);
+
+int  dp_acl_rule_add(const char *name, const struct acl_rule *rule);
+int  dp_acl_rule_del(const char *name, uint32_t seq);
+int  dp_acl_set(const char *name, const struct acl_rule *rules, unsigned n, uint8_t default_action);
+int  dp_acl_default(const char *name, uint8_t action);
+int  dp_acl_delete(const char *name);
+int  dp_acl_bind_port(const char *port, const char *name);
+int  dp_acl_bind_vlan(uint16_t vid, const char *name);
+int  dp_get_acl(unsigned idx, struct dp_acl_info *info);
+int  dp_acl_dump(const char *name, dp_acl_rule_fn fn, void *arg);
+
+int  dp_storm_port(const char *port, unsigned cls, const struct storm_rate *r);
+int  dp_storm_vlan(uint16_t vid, unsigned cls, const struct storm_rate *r);
+int  dp_storm_walk(dp_storm_fn fn, void *arg);
+
+int  dp_vlan_xlate(const char *port, uint16_t cvid, uint16_t vid, unsigned count);
+int  dp_vlan_xlate_walk(dp_xlate_fn fn, void *arg);
+
+int  dp_lag_create(const char *name, unsigned hash);
+int  dp_lag_delete(const char *name);
+int  dp_lag_add_port(const char *name, const char *port);
+int  dp_lag_del_port(const char *name, const char *port);
+int  dp_lag_link(const char *port, int up);
+int  dp_get_lag(unsigned idx, struct dp_lag_info *info);
+
+int  dp_mirror_create(const char *name, const struct dp_mirror_cfg *cfg);
+int  dp_mirror_delete(const char *name);
+int  dp_mirror_port(const char *name, const char *port, unsigned dir);
+int  dp_mirror_vlan(const char *name, uint16_t vid, unsigned dir);
+int  dp_get_mirror(unsigned idx, struct dp_mirror_info *info);
+
+int  dp_sflow_enable(const struct dp_sflow_cfg *cfg);
+int  dp_sflow_disable(void);
+int  dp_sflow_port(const char *port, uint32_t rate);
+int  dp_sflow_vlan(uint16_t vid, int on);
+int  dp_get_sflow(struct dp_sflow_info *info);
+
+int  dp_trace_inject(const char *port, const uint8_t *frame, uint32_t len, struct trace *t);
+int  dp_trace_sample(const char *port, uint32_t rate);
+int  dp_get_trace_rates(uint32_t *rate);
+int  dp_get_traces(struct trace *out, unsigned max);
+
+int  dp_snoop_vlan(uint16_t vid, int on);
+int  dp_snoop_vlan_enabled(uint16_t vid);
+int  dp_snoop_walk(snoop_walk_fn fn, void *arg);
+int  dp_snoop_get_stats(struct snoop_stats *st);
+
+int  dp_fdb_dump(int vid, fdb_dump_fn fn, void *arg);
+int  dp_fdb_get_stats(struct fdb_stats *stats);
+int  dp_fdb_set_capacity(unsigned capacity);
+
+#endif /* DATAPLANE_H */
@@ -0,0 +1,253 @@
+/**
+ * @file dp_pool.c
+ * @brief Packet buffer pool: hugepage mapping, shared free stack and
+ *        per-worker caches with bulk alloc / free.
+ */
+
+#define _GNU_SOURCE     /* MAP_HUGETLB, MADV_HUGEPAGE */
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+
+#include "dp_pool.h"
+
+struct dp_pool
+{
+    uint8_t          *mem;
+    size_t            mem_len;
+    int               hugepages;
+    unsigned          nbufs;
+
+    pthread_mutex_t   lock;       /* stack, top, min_top */
+    struct dp_mbuf  **stack;      /* free buffers outside the caches */
+    unsigned          top;
+    unsigned          min_top;
+
+    unsigned          ncaches;
+    struct dpp_cache *caches;
+};
+
+/* Single-writer counter update; readers use relaxed loads. */
+static inline void stat_add(uint64_t *c, uint64_t v)
+{
+    __atomic_store_n(c, *c + v, __ATOMIC_RELAXED);
+}
+
+static inline void cache_set_len(struct dpp_cache *c, unsigned len)
+{
+    __atomic_store_n(&c->len, len, __ATOMIC_RELAXED);
+}
+
+/* ---------------------------------------------------------------------------
+ * Shared stack
+ * --------------------------------------------------------------------------- */
+
+/* Move up to @p n buffers from the shared stack into @p c; returns how many. */
+static unsigned stack_get(struct dp_pool *pool, struct dpp_cache *c, unsigned n)
+{
+    pthread_mutex_lock(&pool->lock);
+    if (n > pool->top)
+        n = pool->top;
+    pool->top -= n;
+    memcpy(&c->objs[c->len], &pool->stack[pool->top], n * sizeof(c->objs[0]));
+    if (pool->top < pool->min_top)
+        pool->min_top = pool->top;
+    pthread_mutex_unlock(&pool->lock);
+
+    cache_set_len(c, c->len + n);
+    return n;
+}
+
+static void stack_put(struct dp_pool *pool, struct dp_mbuf *const *bufs, unsigned n)
+{
+    pthread_mutex_lock(&pool->lock);
+    memcpy(&pool->stack[pool->top], bufs, n * sizeof(bufs[0]));
+    pool->top += n;
+    pthread_mutex_unlock(&pool->lock);
+}
+
+/* ---------------------------------------------------------------------------
+ * Public API
+ * --------------------------------------------------------------------------- */
+
+/**
+ * dpp_create() - Map @p nbufs buffers and set up @p ncaches worker caches.
+ *
+ * The mapping is rounded up to DPP_HUGEPAGE and taken from the hugepage
+ * pool if possible; see dpp_stats.hugepages.
+ *
+ * @return the pool, or NULL if @p nbufs or @p ncaches is 0 or memory is
+ *         unavailable.
+ */
+struct dp_pool *dpp_create(unsigned nbufs, unsigned ncaches)
+{
+    struct dp_pool *pool;
+    unsigned i;
+
+    if (nbufs == 0 || ncaches == 0)
+        return NULL;
+    pool = calloc(1, sizeof(*pool));
+    if (!pool)
+        return NULL;
+
+    pool->nbufs = nbufs;
+    pool->ncaches = ncaches;
+    pthread_mutex_init(&pool->lock, NULL);
+    pool->mem_len = ((size_t)nbufs * DPP_BUF_SIZE + DPP_HUGEPAGE - 1) & ~((size_t)DPP_HUGEPAGE - 1);
+
+    pool->mem = mmap(NULL, pool->mem_len, PROT_READ | PROT_WRITE,
+                     MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB | MAP_POPULATE, -1, 0);
+    if (pool->mem != MAP_FAILED)
+    {
+        pool->hugepages = 1;
+    }
+    else
+    {
+        /* No reserved hugepages: normal pages, hinting THP where enabled. */
+        pool->mem = mmap(NULL, pool->mem_len, PROT_READ | PROT_WRITE,
+                         MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (pool->mem == MAP_FAILED)
+        {
+            pthread_mutex_destroy(&pool->lock);
+            free(pool);
+            return NULL;
+        }
+        madvise(pool->mem, pool->mem_len, MADV_HUGEPAGE);
+        memset(pool->mem, 0, pool->mem_len);
+    }
+
+    pool->stack = calloc(nbufs, sizeof(pool->stack[0]));
+    pool->caches = aligned_alloc(sizeof(struct dpp_cache), (size_t)ncaches * sizeof(struct dpp_cache));
+    if (!pool->stack || !pool->caches)
+    {
+        dpp_destroy(pool);
+        return NULL;
+    }
+    memset(pool->caches, 0, (size_t)ncaches * sizeof(struct dpp_cache));
+
+    /* Lowest addresses on top, so a lightly used pool touches few pages. */
+    for (i = 0; i < nbufs; i++)
+        pool->stack[i] = (struct dp_mbuf *)(pool->mem + (size_t)(nbufs - 1 - i) * DPP_BUF_SIZE);
+    pool->top = nbufs;
+    pool->min_top = nbufs;
+    return pool;
+}
+
+void dpp_destroy(struct dp_pool *pool)
+{
+    if (!pool)
+        return;
+    pthread_mutex_destroy(&pool->lock);
+    munmap(pool->mem, pool->mem_len);
+    free(pool->caches);
+    free(pool->stack);
+    free(pool);
+}
+
+/**
+ * dpp_cache() - Cache @p idx, for the one thread that allocates through it.
+ */
+struct dpp_cache *dpp_cache(struct dp_pool *pool, unsigned idx)
+{
+    return idx < pool->ncaches ? &pool->caches[idx] : NULL;
+}
+
+/**
+ * dpp_alloc_bulk() - Take @p n buffers through cache @p c.
+ *
+ * All or nothing: on failure no buffer is taken and the exhaustion counter
+ * is incremented once.
+ *
+ * @return 0, -EINVAL if @p n exceeds DPP_CACHE_SIZE, or -ENOBUFS if the
+ *         pool does not have @p n free buffers.
+ */
+int dpp_alloc_bulk(struct dp_pool *pool, struct dpp_cache *c, struct dp_mbuf **bufs, unsigned n)
+{
+    unsigned len;
+
+    if (n > DPP_CACHE_SIZE)
+        return -EINVAL;
+
+    if (c->len < n)
+    {
+        stack_get(pool, c, n - c->len + DPP_CACHE_BATCH);
+        if (c->len < n)
+        {
+            stat_add(&c->failed, 1);
+            return -ENOBUFS;
+        }
+    }
+
+    len = c->len - n;
+    memcpy(bufs, &c->objs[len], n * sizeof(bufs[0]));
+    cache_set_len(c, len);
+    stat_add(&c->allocs, n);
+    return 0;
+}
+
+/**
+ * dpp_free_bulk() - Return @p n buffers through cache @p c.
+ *
+ * A cache grown beyond DPP_CACHE_SIZE hands everything above half of that
+ * back to the shared stack.
+ */
+void dpp_free_bulk(struct dp_pool *pool, struct dpp_cache *c, struct dp_mbuf **bufs, unsigned n)
+{
+    unsigned len = c->len;
+    unsigned chunk;
+
+    stat_add(&c->frees, n);
+    while (n)
+    {
+        chunk = n < DPP_CACHE_SIZE ? n : DPP_CACHE_SIZE;
+        memcpy(&c->objs[len], bufs, chunk * sizeof(bufs[0]));
+        len += chunk;
+        bufs += chunk;
+        n -= chunk;
+
+        if (len > DPP_CACHE_SIZE)
+        {
+            stack_put(pool, &c->objs[DPP_CACHE_SIZE / 2], len - DPP_CACHE_SIZE / 2);
+            len = DPP_CACHE_SIZE / 2;
+        }
+    }
+    cache_set_len(c, len);
+}
+
+/**
+ * dpp_get_stats() - Occupancy and counters of @p pool.
+ *
+ * Caches are read without stopping their owners, so the figures may be a
+ * few buffers apart while the pool is in use.
+ */
+void dpp_get_stats(struct dp_pool *pool, struct dpp_stats *stats)
+{
+    unsigned i;
+
+    memset(stats, 0, sizeof(*stats));
+    stats->nbufs     = pool->nbufs;
+    stats->buf_size  = DPP_BUF_SIZE;
+    stats->bytes     = pool->mem_len;
+    stats->hugepages = pool->hugepages;
+
+    for (i = 0; i < pool->ncaches; i++)
+    {
+        const struct dpp_cache *c = &pool->caches[i];
+
+        stats->cached    += __atomic_load_n(&c->len, __ATOMIC_RELAXED);
+        stats->allocs    += __atomic_load_n(&c->allocs, __ATOMIC_RELAXED);
+        stats->frees     += __atomic_load_n(&c->frees, __ATOMIC_RELAXED);
+        stats->exhausted += __atomic_load_n(&c->failed, __ATOMIC_RELAXED);
+    }
+
+    pthread_mutex_lock(&pool->lock);
+    stats->avail     = pool->top;
+    stats->min_avail = pool->min_top;
+    pthread_mutex_unlock(&pool->lock);
+
+    stats->in_use = stats->cached + stats->avail < pool->nbufs
+                  ? pool->nbufs - stats->cached - stats->avail : 0;
+}
@@ -0,0 +1,92 @@
+/**
+ * @file dp_pool.h
+ * @brief Fixed-size packet buffer pool with per-worker caches.
+ *
+ * Buffers (struct dp_mbuf) are carved once from one anonymous mapping,
+ * backed by 2 MB hugepages when the system has them reserved and by normal
+ * pages (with a transparent hugepage hint) otherwise.  Nothing is allocated
+ * after dpp_create(), so the fast path never calls malloc().
+ *
+ * Free buffers live in a shared stack and in one cache per forwarding
+ * worker.  A cache belongs to a single thread and is used without locks or
+ * atomics other than relaxed counter stores; only when it runs empty or
+ * overflows does it move DPP_CACHE_BATCH buffers to or from the shared
+ * stack under the pool lock, so the lock is taken at most once per batch.
+ * A buffer may be freed into any cache, not only the one it came from.
+ *
+ * Occupancy (in use, cached, free) and exhaustion counters are read with
+ * dpp_get_stats() for the show commands.
+ */
+
+#ifndef DP_POOL_H
+#define DP_POOL_H
+
+#include <stdint.h>
+
+/** Bytes per buffer, header included. */
+#define DPP_BUF_SIZE     2048
+/** Buffers a cache keeps before it hands half of them back. */
+#define DPP_CACHE_SIZE   256
+/** Buffers moved between a cache and the shared stack at once. */
+#define DPP_CACHE_BATCH  64
+/** Hugepage size the mapping is rounded to. */
+#define DPP_HUGEPAGE     (2u << 20)
+
+/** One packet buffer. */
+struct dp_mbuf
+{
+    struct dp_mbuf *next;                  /**< for the owner's queues */
+    uint32_t        len;                   /**< bytes used in data[] */
+    uint32_t        flags;                 /**< owner defined */
+    uint8_t         data[DPP_BUF_SIZE - 16];
+} __attribute__((aligned(64)));
+
+/** A worker's private free list. */
+struct dpp_cache
+{
+    unsigned        len;
+    uint64_t        allocs;                /**< buffers handed out */
+    uint64_t        frees;
+    uint64_t        failed;                /**< requests refused, pool exhausted */
+    struct dp_mbuf *objs[2 * DPP_CACHE_SIZE];
+} __attribute__((aligned(64)));
+
+struct dpp_stats
+{
+    unsigned nbufs;
+    unsigned buf_size;
+    uint64_t bytes;          /**< size of the mapping */
+    int      hugepages;      /**< 1 if backed by explicit 2 MB hugepages */
+    unsigned in_use;         /**< buffers held outside the pool */
+    unsigned cached;         /**< free buffers in worker caches */
+    unsigned avail;          /**< free buffers in the shared stack */
+    unsigned min_avail;      /**< low-water mark of the shared stack */
+    uint64_t allocs;
+    uint64_t frees;
+    uint64_t exhausted;      /**< allocations refused for lack of buffers */
+};
+
+struct dp_pool;
+
+struct dp_pool   *dpp_create(unsigned nbufs, unsigned ncaches);
+void              dpp_destroy(struct dp_pool *pool);
+struct dpp_cache *dpp_cache(struct dp_pool *pool, unsigned idx);
+
+int   dpp_alloc_bulk(struct dp_pool *pool, struct dpp_cache *c, struct dp_mbuf **bufs, unsigned n);
+void  dpp_free_bulk(struct dp_pool *pool, struct dpp_cache *c, struct dp_mbuf **bufs, unsigned n);
+void  dpp_get_stats(struct dp_pool *pool, struct dpp_stats *stats);
+
+/** Single-buffer dpp_alloc_bulk(); NULL if the pool is exhausted. */
+static inline struct dp_mbuf *dpp_alloc(struct dp_pool *pool, struct dpp_cache *c)
+{
+    struct dp_mbuf *m;
+
+    return dpp_alloc_bulk(pool, c, &m, 1) == 0 ? m : NULL;
+}
+
+static inline void dpp_free(struct dp_pool *pool, struct dpp_cache *c, struct dp_mbuf *m)
+{
+    dpp_free_bulk(pool, c, &m, 1);
+}
+
+#endif /* DP_POOL_H */
@@ -0,0 +1,394 @@
+/**
+ * @file dp_ring.c
+ * @brief TPACKET_V3 ring setup and the RX block / TX frame accessors.
+ *
+ * Status words are shared with the kernel, so they are read with acquire and
+ * written with release ordering: a block or frame is only touched once its
+ * status says user space owns it, and ownership is only handed back after
+ * the payload accesses are complete.
+ */
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <linux/if_ether.h>
+
+#include "dp_ring.h"
+#include "vlan_tag.h"
+
+#define DP_TX_DATA_OFF  TPACKET_ALIGN(sizeof(struct tpacket3_hdr))
+
+static inline uint32_t status_load(volatile uint32_t *p)
+{
+    return __atomic_load_n(p, __ATOMIC_ACQUIRE);
+}
+
+static inline void status_store(volatile uint32_t *p, uint32_t v)
+{
+    __atomic_store_n(p, v, __ATOMIC_RELEASE);
+}
+
+/* ---------------------------------------------------------------------------
+ * Setup
+ * --------------------------------------------------------------------------- */
+
+/**
+ * dp_ring_open() - Bind a TPACKET_V3 socket to @p ifindex and map its rings.
+ *
+ * The socket receives every protocol but not the frames it (or the local
+ * stack) transmits on the port, and bypasses the qdisc layer on transmit.
+ *
+ * @return 0 on success, -errno on failure (the ring is left closed).
+ */
+int dp_ring_open(struct dp_ring *ring, int ifindex)
+{
+    struct tpacket_req3 rx;
+    struct tpacket_req3 tx;
+    struct sockaddr_ll sll;
+    int version = TPACKET_V3;
+    int one = 1;
+    int err;
+
+    memset(ring, 0, sizeof(*ring));
+    ring->fd = socket(AF_PACKET, SOCK_RAW, 0);
+    if (ring->fd < 0)
+        return -errno;
+    ring->ifindex = ifindex;
+
+    if (setsockopt(ring->fd, SOL_PACKET, PACKET_VERSION, &version, sizeof(version)) < 0)
+        goto fail;
+
+    /* Best effort: older kernels only lack the optimisation. */
+    setsockopt(ring->fd, SOL_PACKET, PACKET_QDISC_BYPASS, &one, sizeof(one));
+    setsockopt(ring->fd, SOL_PACKET, PACKET_IGNORE_OUTGOING, &one, sizeof(one));
+
+    memset(&rx, 0, sizeof(rx));
+    rx.tp_block_size       = DP_RX_BLOCK_SIZE;
+    rx.tp_block_nr         = DP_RX_BLOCKS;
+    rx.tp_frame_size       = DP_TX_FRAME_SIZE;
+    rx.tp_frame_nr         = (DP_RX_BLOCK_SIZE / DP_TX_FRAME_SIZE) * DP_RX_BLOCKS;
+    rx.tp_retire_blk_tov   = DP_RX_RETIRE_MS;
+    rx.tp_feature_req_word = TP_FT_REQ_FILL_RXHASH;
+    if (setsockopt(ring->fd, SOL_PACKET, PACKET_RX_RING, &rx, sizeof(rx)) < 0)
+        goto fail;
+
+    memset(&tx, 0, sizeof(tx));
+    tx.tp_block_size = DP_TX_FRAME_SIZE * 32;
+    tx.tp_block_nr   = DP_TX_FRAMES / 32;
+    tx.tp_frame_size = DP_TX_FRAME_SIZE;
+    tx.tp_frame_nr   = DP_TX_FRAMES;
+    if (setsockopt(ring->fd, SOL_PACKET, PACKET_TX_RING, &tx, sizeof(tx)) < 0)
+        goto fail;
+
+    ring->map_len = (size_t)DP_RX_BLOCK_SIZE * DP_RX_BLOCKS
+                  + (size_t)DP_TX_FRAME_SIZE * DP_TX_FRAMES;
+    ring->map = mmap(NULL, ring->map_len, PROT_READ | PROT_WRITE,
+                     MAP_SHARED | MAP_LOCKED | MAP_POPULATE, ring->fd, 0);
+    if (ring->map == MAP_FAILED)
+    {
+        /* MAP_LOCKED needs RLIMIT_MEMLOCK headroom; retry without it. */
+        ring->map = mmap(NULL, ring->map_len, PROT_READ | PROT_WRITE,
+                         MAP_SHARED | MAP_POPULATE, ring->fd, 0);
+        if (ring->map == MAP_FAILED)
+        {
+            ring->map = NULL;
+            goto fail;
+        }
+    }
+    ring->rx_base = ring->map;
+    ring->tx_base = ring->map + (size_t)DP_RX_BLOCK_SIZE * DP_RX_BLOCKS;
+
+    memset(&sll, 0, sizeof(sll));
+    sll.sll_family   = AF_PACKET;
+    sll.sll_protocol = htons(ETH_P_ALL);
+    sll.sll_ifindex  = ifindex;
+    if (bind(ring->fd, (struct sockaddr *)&sll, sizeof(sll)) < 0)
+        goto fail;
+
+    return 0;
+
+fail:
+    err = -errno;
+    dp_ring_close(ring);
+    return err;
+}
+
+/**
+ * dp_ring_open_xsk() - Open @p ring as an AF_XDP socket on RX queue @p queue.
+ *
+ * @p xdp must already be attached to the port (dp_xdp_attach()); the socket
+ * takes a chunk of @p umem, which belongs to the calling worker.  Such a
+ * ring receives only what arrives on its queue, so it needs no fanout.
+ *
+ * @return 0 on success, -errno on failure (the ring is left closed).
+ */
+int dp_ring_open_xsk(struct dp_ring *ring, struct dp_xdp *xdp, unsigned queue,
+                     struct dp_umem *umem)
+{
+    int err;
+
+    memset(ring, 0, sizeof(*ring));
+    ring->fd = -1;
+    ring->xsk = malloc(sizeof(*ring->xsk));
+    if (!ring->xsk)
+        return -ENOMEM;
+
+    err = dp_xsk_open(ring->xsk, xdp, queue, umem);
+    if (err < 0)
+    {
+        free(ring->xsk);
+        ring->xsk = NULL;
+        return err;
+    }
+    ring->fd = ring->xsk->fd;
+    ring->ifindex = xdp->ifindex;
+    return 0;
+}
+
+/**
+ * dp_ring_join_fanout() - Share the port's ingress with other rings.
+ *
+ * Frames are spread over the rings of a fanout group by the kernel's flow
+ * hash (PACKET_FANOUT_HASH), so all frames of one flow land in the same
+ * ring and keep their order.  Pass *@p group == 0 for the first ring of a
+ * port: the kernel allocates a group ID that is unique in the namespace and
+ * it is stored in *@p group for the others to join.
+ *
+ * @return 0 on success, -errno on failure.
+ */
+int dp_ring_join_fanout(struct dp_ring *ring, uint16_t *group)
+{
+    int arg = PACKET_FANOUT_HASH << 16;
+    socklen_t len = sizeof(arg);
+
+    if (*group == 0)
+        arg |= PACKET_FANOUT_FLAG_UNIQUEID << 16;
+    else
+        arg |= *group;
+
+    if (setsockopt(ring->fd, SOL_PACKET, PACKET_FANOUT, &arg, sizeof(arg)) < 0)
+        return -errno;
+    if (*group == 0)
+    {
+        if (getsockopt(ring->fd, SOL_PACKET, PACKET_FANOUT, &arg, &len) < 0)
+            return -errno;
+        *group = (uint16_t)(arg & 0xFFFF);
+    }
+    return 0;
+}
+
+/**
+ * dp_ring_close() - Unmap the rings and close the socket.  Idempotent.
+ */
+void dp_ring_close(struct dp_ring *ring)
+{
+    if (ring->xsk)
+    {
+        dp_xsk_close(ring->xsk);
+        free(ring->xsk);
+        ring->fd = -1;
+    }
+    if (ring->map)
+        munmap(ring->map, ring->map_len);
+    if (ring->fd >= 0)
+        close(ring->fd);
+    memset(ring, 0, sizeof(*ring));
+    ring->fd = -1;
+}
+
+/* ---------------------------------------------------------------------------
+ * RX
+ * --------------------------------------------------------------------------- */
+
+/**
+ * dp_ring_rx_burst() - Take the next block if the kernel has handed it over.
+ *
+ * The caller walks it with dp_ring_rx_next() and must give it back with
+ * dp_ring_rx_release() before taking another one.
+ *
+ * @return 1 if @p burst now refers to a ready block, 0 if none is ready.
+ */
+int dp_ring_rx_burst(struct dp_ring *ring, struct dp_rx_burst *burst)
+{
+    struct tpacket_block_desc *bd;
+
+    burst->xsk = ring->xsk;
+    if (ring->xsk)
+    {
+        burst->index = 0;
+        burst->xsk_count = dp_xsk_rx_peek(ring->xsk, &burst->xsk_idx);
+        return burst->xsk_count != 0;
+    }
+
+    bd = (struct tpacket_block_desc *)(ring->rx_base +
+                                       (size_t)ring->rx_cur * DP_RX_BLOCK_SIZE);
+    if (!(status_load(&bd->hdr.bh1.block_status) & TP_STATUS_USER))
+        return 0;
+
+    burst->block  = bd;
+    burst->index  = 0;
+    burst->offset = bd->hdr.bh1.offset_to_first_pkt;
+    return 1;
+}
+
+/**
+ * dp_ring_rx_next() - Fetch the next frame of the current block.
+ *
+ * @return 1 if @p frame was filled, 0 at the end of the block.
+ */
+int dp_ring_rx_next(struct dp_rx_burst *burst, struct dp_frame *frame)
+{
+    struct tpacket3_hdr *h;
+
+    if (burst->xsk)
+    {
+        if (burst->index >= burst->xsk_count)
+            return 0;
+        dp_xsk_rx_frame(burst->xsk, burst->xsk_idx + burst->index, &frame->data, &frame->len);
+        frame->vlan_valid = 0;
+        frame->vlan_tci   = 0;
+        burst->index++;
+        return 1;
+    }
+
+    if (burst->index >= burst->block->hdr.bh1.num_pkts)
+        return 0;
+
+    h = (struct tpacket3_hdr *)((uint8_t *)burst->block + burst->offset);
+    frame->data       = (uint8_t *)h + h->tp_mac;
+    frame->len        = h->tp_snaplen;
+    frame->vlan_valid = (h->tp_status & TP_STATUS_VLAN_VALID) != 0;
+    frame->vlan_tci   = frame->vlan_valid ? (uint16_t)h->hv1.tp_vlan_tci : 0;
+
+    burst->offset += h->tp_next_offset;
+    burst->index++;
+    return 1;
+}
+
+/**
+ * dp_ring_rx_release() - Return the current block to the kernel and advance.
+ */
+void dp_ring_rx_release(struct dp_ring *ring, struct dp_rx_burst *burst)
+{
+    if (burst->xsk)
+    {
+        dp_xsk_rx_release(burst->xsk, burst->xsk_idx, burst->xsk_count);
+        burst->xsk = NULL;
+        return;
+    }
+    status_store(&burst->block->hdr.bh1.block_status, TP_STATUS_KERNEL);
+    burst->block = NULL;
+    ring->rx_cur = (ring->rx_cur + 1) % DP_RX_BLOCKS;
+}
+
+/* ---------------------------------------------------------------------------
+ * TX
+ * --------------------------------------------------------------------------- */
+
+/**
+ * dp_ring_tx() - Copy one frame into the next free TX slot.
+ *
+ * The frame is not sent until dp_ring_tx_flush().
+ *
+ * @return 0 if queued, -EMSGSIZE if too long, -ENOBUFS if the ring is full.
+ */
+int dp_ring_tx(struct dp_ring *ring, const void *data, uint32_t len)
+{
+    struct tpacket3_hdr *h;
+    uint8_t *slot;
+
+    if (len > DP_TX_MAX_LEN)
+        return -EMSGSIZE;
+
+    if (ring->xsk)
+    {
+        slot = dp_xsk_tx_slot(ring->xsk);
+        if (!slot)
+            return -ENOBUFS;
+        memcpy(slot, data, len);
+        dp_xsk_tx_commit(ring->xsk, slot, len);
+        return 0;
+    }
+
+    h = (struct tpacket3_hdr *)(ring->tx_base + (size_t)ring->tx_cur * DP_TX_FRAME_SIZE);
+    if (status_load(&h->tp_status) != TP_STATUS_AVAILABLE)
+        return -ENOBUFS;
+
+    memcpy((uint8_t *)h + DP_TX_DATA_OFF, data, len);
+    h->tp_len         = len;
+    h->tp_snaplen     = len;
+    h->tp_next_offset = 0;
+    status_store(&h->tp_status, TP_STATUS_SEND_REQUEST);
+
+    ring->tx_cur = (ring->tx_cur + 1) % DP_TX_FRAMES;
+    ring->tx_pending++;
+    return 0;
+}
+
+/**
+ * dp_ring_tx_tagged() - dp_ring_tx() inserting an 802.1Q tag with @p tci.
+ *
+ * @p data is an untagged frame; the tag is inserted while copying.
+ *
+ * @return as dp_ring_tx(); -EMSGSIZE applies to the tagged length.
+ */
+int dp_ring_tx_tagged(struct dp_ring *ring, const void *data, uint32_t len, uint16_t tci)
+{
+    struct tpacket3_hdr *h;
+    uint8_t *slot;
+
+    if (len + 4 > DP_TX_MAX_LEN || len < 12)
+        return -EMSGSIZE;
+
+    if (ring->xsk)
+    {
+        slot = dp_xsk_tx_slot(ring->xsk);
+        if (!slot)
+            return -ENOBUFS;
+        dp_xsk_tx_commit(ring->xsk, slot, vt_tag_copy(slot, data, len, tci));
+        return 0;
+    }
+
+    h = (struct tpacket3_hdr *)(ring->tx_base + (size_t)ring->tx_cur * DP_TX_FRAME_SIZE);
+    if (status_load(&h->tp_status) != TP_STATUS_AVAILABLE)
+        return -ENOBUFS;
+
+    len = vt_tag_copy((uint8_t *)h + DP_TX_DATA_OFF, data, len, tci);
+    h->tp_len         = len;
+    h->tp_snaplen     = len;
+    h->tp_next_offset = 0;
+    status_store(&h->tp_status, TP_STATUS_SEND_REQUEST);
+
+    ring->tx_cur = (ring->tx_cur + 1) % DP_TX_FRAMES;
+    ring->tx_pending++;
+    return 0;
+}
+
+/**
+ * dp_ring_tx_flush() - Ask the kernel to transmit every queued frame.
+ *
+ * @return 0, -EAGAIN if the device is busy (frames stay queued and go out
+ *         with the next flush), or another -errno from sendto().
+ */
+int dp_ring_tx_flush(struct dp_ring *ring)
+{
+    if (ring->xsk)
+        return dp_xsk_tx_flush(ring->xsk);
+    if (ring->tx_pending == 0)
+        return 0;
+
+    if (sendto(ring->fd, NULL, 0, MSG_DONTWAIT, NULL, 0) < 0)
+    {
+        if (errno == EAGAIN || errno == ENOBUFS)
+            return -EAGAIN;
+        return -errno;
+    }
+
+    ring->tx_pending = 0;
+    return 0;
+}
@@ -0,0 +1,94 @@
+/**
+ * @file dp_ring.h
+ * @brief AF_PACKET TPACKET_V3 memory-mapped RX/TX rings for one port.
+ *
+ * The RX ring is block based: the kernel fills a block with several frames
+ * and hands the whole block to user space, so one poll() wake-up yields a
+ * burst.  The TX ring is frame based; frames are marked
+ * TP_STATUS_SEND_REQUEST and handed to the kernel with one sendto() per
+ * burst.  Both rings share one mapping (RX first, then TX).
+ *
+ * A ring is used by one thread at a time; no locking is done here.  Several
+ * rings on the same port can share its ingress through a PACKET_FANOUT
+ * group, one ring per forwarding worker.
+ *
+ * A ring opened with dp_ring_open_xsk() is backed by an AF_XDP socket on
+ * one RX queue instead (dp_xsk.h); the accessors below work the same on
+ * both, so the forwarding loop does not care which one a port uses.
+ */
+
+#ifndef DP_RING_H
+#define DP_RING_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <linux/if_packet.h>
+
+#include "dp_xsk.h"
+
+/** RX ring geometry: DP_RX_BLOCKS blocks of DP_RX_BLOCK_SIZE bytes. */
+#define DP_RX_BLOCK_SIZE   (1u << 16)
+#define DP_RX_BLOCKS       16
+/** A partially filled RX block is handed over after this many ms. */
+#define DP_RX_RETIRE_MS    1
+
+/** TX ring geometry: DP_TX_FRAMES frames of DP_TX_FRAME_SIZE bytes. */
+#define DP_TX_FRAME_SIZE   2048
+#define DP_TX_FRAMES       512
+
+/** Largest frame that fits a TX slot. */
+#define DP_TX_MAX_LEN      (DP_TX_FRAME_SIZE - TPACKET_ALIGN(sizeof(struct tpacket3_hdr)))
+
+struct dp_ring
+{
+    int       fd;
+    int       ifindex;
+    uint8_t  *map;
+    size_t    map_len;
+
+    uint8_t  *rx_base;
+    unsigned  rx_cur;          /* next block to inspect */
+
+    uint8_t  *tx_base;
+    unsigned  tx_cur;          /* next frame slot to fill */
+    unsigned  tx_pending;      /* frames queued since the last flush */
+
+    struct dp_xsk *xsk;        /* AF_XDP backend, or NULL for TPACKET */
+};
+
+/** One received frame, valid until its block is released. */
+struct dp_frame
+{
+    uint8_t  *data;
+    uint32_t  len;
+    uint16_t  vlan_tci;        /* tag stripped by the kernel, if any */
+    uint8_t   vlan_valid;
+};
+
+/** Position inside the RX block (or XSK batch) owned by user space. */
+struct dp_rx_burst
+{
+    struct tpacket_block_desc *block;
+    uint32_t                   index;
+    uint32_t                   offset;
+
+    struct dp_xsk             *xsk;
+    uint32_t                   xsk_idx;     /* first RX ring index of the batch */
+    uint32_t                   xsk_count;
+};
+
+int   dp_ring_open(struct dp_ring *ring, int ifindex);
+int   dp_ring_open_xsk(struct dp_ring *ring, struct dp_xdp *xdp, unsigned queue,
+                       struct dp_umem *umem);
+int   dp_ring_join_fanout(struct dp_ring *ring, uint16_t *group);
+void  dp_ring_close(struct dp_ring *ring);
+
+int   dp_ring_rx_burst(struct dp_ring *ring, struct dp_rx_burst *burst);
+int   dp_ring_rx_next(struct dp_rx_burst *burst, struct dp_frame *frame);
+void  dp_ring_rx_release(struct dp_ring *ring, struct dp_rx_burst *burst);
+
+int   dp_ring_tx(struct dp_ring *ring, const void *data, uint32_t len);
+int   dp_ring_tx_tagged(struct dp_ring *ring, const void *data, uint32_t len, uint16_t tci);
+int   dp_ring_tx_flush(struct dp_ring *ring);
+
+#endif /* DP_RING_H */
@@ -0,0 +1,325 @@
+/**
+ * @file dp_stats.c
+ * @brief Sharded forwarding counters: per-worker shards, lazy aggregation,
+ *        baseline resets and a rate sampler thread.
+ */
+
+#define _GNU_SOURCE     /* pthread_setname_np */
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "dp_stats.h"
+
+struct dps_snap
+{
+    uint64_t            t_ms;
+    struct dp_counters *port;
+    struct dp_counters *vlan;
+};
+
+struct dp_stats
+{
+    unsigned            nshards;
+    unsigned            nports;
+    unsigned            nvlans;
+    unsigned            interval_ms;
+    struct dps_line    *lines;      /* nshards x (nports + nvlans) */
+
+    pthread_mutex_t     lock;       /* base, snap, cur, nsamples */
+    struct dp_counters *base;       /* per-port reset baseline */
+    struct dps_snap     snap[2];
+    unsigned            cur;
+    unsigned            nsamples;
+
+    pthread_cond_t      cond;
+    pthread_t           thread;
+    int                 have_thread;
+    int                 stop;
+};
+
+/* ---------------------------------------------------------------------------
+ * Aggregation
+ * --------------------------------------------------------------------------- */
+
+static inline struct dps_line *shard_lines(struct dp_stats *s, unsigned shard)
+{
+    return s->lines + (size_t)shard * (s->nports + s->nvlans);
+}
+
+static void ctr_accumulate(struct dp_counters *sum, const struct dp_counters *c)
+{
+    sum->rx_packets += __atomic_load_n(&c->rx_packets, __ATOMIC_RELAXED);
+    sum->rx_bytes   += __atomic_load_n(&c->rx_bytes,   __ATOMIC_RELAXED);
+    sum->rx_dropped += __atomic_load_n(&c->rx_dropped, __ATOMIC_RELAXED);
+    sum->tx_packets += __atomic_load_n(&c->tx_packets, __ATOMIC_RELAXED);
+    sum->tx_bytes   += __atomic_load_n(&c->tx_bytes,   __ATOMIC_RELAXED);
+    sum->tx_dropped += __atomic_load_n(&c->tx_dropped, __ATOMIC_RELAXED);
+}
+
+static inline uint64_t delta(uint64_t now, uint64_t then)
+{
+    return now > then ? now - then : 0;
+}
+
+static void ctr_subtract(struct dp_counters *c, const struct dp_counters *b)
+{
+    c->rx_packets = delta(c->rx_packets, b->rx_packets);
+    c->rx_bytes   = delta(c->rx_bytes,   b->rx_bytes);
+    c->rx_dropped = delta(c->rx_dropped, b->rx_dropped);
+    c->tx_packets = delta(c->tx_packets, b->tx_packets);
+    c->tx_bytes   = delta(c->tx_bytes,   b->tx_bytes);
+    c->tx_dropped = delta(c->tx_dropped, b->tx_dropped);
+}
+
+/* Sum line @p idx (port index, or nports + VLAN ID) over every shard. */
+static void aggregate(struct dp_stats *s, unsigned idx, struct dp_counters *out)
+{
+    unsigned i;
+
+    memset(out, 0, sizeof(*out));
+    for (i = 0; i < s->nshards; i++)
+        ctr_accumulate(out, &shard_lines(s, i)[idx].c);
+}
+
+static void rate_of(const struct dp_counters *now, const struct dp_counters *then,
+                    uint64_t dt_ms, struct dp_rate *out)
+{
+    double dt = dt_ms / 1000.0;
+
+    out->rx_pps = delta(now->rx_packets, then->rx_packets) / dt;
+    out->rx_bps = delta(now->rx_bytes, then->rx_bytes) * 8.0 / dt;
+    out->tx_pps = delta(now->tx_packets, then->tx_packets) / dt;
+    out->tx_bps = delta(now->tx_bytes, then->tx_bytes) * 8.0 / dt;
+}
+
+/* Rate of line @p idx from the last two snapshots; zero until there are two. */
+static void rate_read(struct dp_stats *s, unsigned idx, struct dp_rate *out)
+{
+    const struct dps_snap *now, *then;
+
+    memset(out, 0, sizeof(*out));
+    pthread_mutex_lock(&s->lock);
+    now  = &s->snap[s->cur];
+    then = &s->snap[s->cur ^ 1];
+    if (s->nsamples >= 2 && now->t_ms > then->t_ms)
+    {
+        if (idx < s->nports)
+            rate_of(&now->port[idx], &then->port[idx], now->t_ms - then->t_ms, out);
+        else
+            rate_of(&now->vlan[idx - s->nports], &then->vlan[idx - s->nports],
+                    now->t_ms - then->t_ms, out);
+    }
+    pthread_mutex_unlock(&s->lock);
+}
+
+/* ---------------------------------------------------------------------------
+ * Sampler thread
+ * --------------------------------------------------------------------------- */
+
+static uint64_t mono_ms(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000 + (uint64_t)ts.tv_nsec / 1000000;
+}
+
+static void *sampler_main(void *arg)
+{
+    struct dp_stats *s = arg;
+    struct timespec deadline;
+
+    pthread_mutex_lock(&s->lock);
+    while (!s->stop)
+    {
+        clock_gettime(CLOCK_MONOTONIC, &deadline);
+        deadline.tv_sec  += s->interval_ms / 1000;
+        deadline.tv_nsec += (long)(s->interval_ms % 1000) * 1000000;
+        if (deadline.tv_nsec >= 1000000000)
+        {
+            deadline.tv_sec++;
+            deadline.tv_nsec -= 1000000000;
+        }
+        if (pthread_cond_timedwait(&s->cond, &s->lock, &deadline) != ETIMEDOUT)
+            continue;
+
+        pthread_mutex_unlock(&s->lock);
+        dps_sample(s, mono_ms());
+        pthread_mutex_lock(&s->lock);
+    }
+    pthread_mutex_unlock(&s->lock);
+    return NULL;
+}
+
+/* ---------------------------------------------------------------------------
+ * Public API
+ * --------------------------------------------------------------------------- */
+
+/**
+ * dps_create() - Allocate @p nshards counter shards.
+ *
+ * @param interval_ms  rate sampling period; 0 starts no sampler thread, and
+ *                     rates then only move when dps_sample() is called.
+ *
+ * @return the counter set, or NULL if memory or the thread is unavailable.
+ */
+struct dp_stats *dps_create(unsigned nshards, unsigned nports, unsigned nvlans,
+                            unsigned interval_ms)
+{
+    struct dp_stats *s;
+    pthread_condattr_t ca;
+    size_t bytes;
+    unsigned i;
+
+    if (nshards == 0 || nports == 0 || nvlans == 0)
+        return NULL;
+    s = calloc(1, sizeof(*s));
+    if (!s)
+        return NULL;
+
+    s->nshards = nshards;
+    s->nports = nports;
+    s->nvlans = nvlans;
+    s->interval_ms = interval_ms;
+
+    bytes = (size_t)nshards * (nports + nvlans) * sizeof(struct dps_line);
+    s->lines = aligned_alloc(sizeof(struct dps_line), bytes);
+    s->base = calloc(nports, sizeof(*s->base));
+    for (i = 0; i < 2; i++)
+    {
+        s->snap[i].port = calloc(nports, sizeof(struct dp_counters));
+        s->snap[i].vlan = calloc(nvlans, sizeof(struct dp_counters));
+    }
+    if (!s->lines || !s->base || !s->snap[0].port || !s->snap[0].vlan ||
+        !s->snap[1].port || !s->snap[1].vlan)
+    {
+        dps_destroy(s);
+        return NULL;
+    }
+    memset(s->lines, 0, bytes);
+
+    pthread_mutex_init(&s->lock, NULL);
+    pthread_condattr_init(&ca);
+    pthread_condattr_setclock(&ca, CLOCK_MONOTONIC);
+    pthread_cond_init(&s->cond, &ca);
+    pthread_condattr_destroy(&ca);
+
+    if (interval_ms)
+    {
+        if (pthread_create(&s->thread, NULL, sampler_main, s) != 0)
+        {
+            dps_destroy(s);
+            return NULL;
+        }
+        pthread_setname_np(s->thread, "dp-stats");
+        s->have_thread = 1;
+    }
+    return s;
+}
+
+void dps_destroy(struct dp_stats *s)
+{
+    unsigned i;
+
+    if (!s)
+        return;
+    if (s->have_thread)
+    {
+        pthread_mutex_lock(&s->lock);
+        s->stop = 1;
+        pthread_cond_signal(&s->cond);
+        pthread_mutex_unlock(&s->lock);
+        pthread_join(s->thread, NULL);
+    }
+    for (i = 0; i < 2; i++)
+    {
+        free(s->snap[i].port);
+        free(s->snap[i].vlan);
+    }
+    free(s->base);
+    free(s->lines);
+    free(s);
+}
+
+/**
+ * dps_shard() - Counter lines of shard @p shard, for its worker to update
+ *               with dps_add().
+ */
+struct dps_shard dps_shard(struct dp_stats *s, unsigned shard)
+{
+    struct dps_shard sh;
+
+    sh.port = shard_lines(s, shard);
+    sh.vlan = sh.port + s->nports;
+    return sh;
+}
+
+/**
+ * dps_port_read() - Totals of port @p port since its last reset.
+ */
+void dps_port_read(struct dp_stats *s, unsigned port, struct dp_counters *out)
+{
+    aggregate(s, port, out);
+    pthread_mutex_lock(&s->lock);
+    ctr_subtract(out, &s->base[port]);
+    pthread_mutex_unlock(&s->lock);
+}
+
+/**
+ * dps_vlan_read() - Totals of VLAN @p vid.
+ */
+void dps_vlan_read(struct dp_stats *s, unsigned vid, struct dp_counters *out)
+{
+    aggregate(s, s->nports + vid, out);
+}
+
+void dps_port_rate(struct dp_stats *s, unsigned port, struct dp_rate *out)
+{
+    rate_read(s, port, out);
+}
+
+void dps_vlan_rate(struct dp_stats *s, unsigned vid, struct dp_rate *out)
+{
+    rate_read(s, s->nports + vid, out);
+}
+
+/**
+ * dps_port_reset() - Start port @p port's totals from zero again.
+ *
+ * Rates are unaffected: they are computed from the raw, monotonic sums.
+ */
+void dps_port_reset(struct dp_stats *s, unsigned port)
+{
+    struct dp_counters now;
+
+    aggregate(s, port, &now);
+    pthread_mutex_lock(&s->lock);
+    s->base[port] = now;
+    pthread_mutex_unlock(&s->lock);
+}
+
+/**
+ * dps_sample() - Take a rate snapshot of every port and VLAN at @p now_ms.
+ *
+ * Called by the sampler thread; tests call it directly with interval 0.
+ */
+void dps_sample(struct dp_stats *s, uint64_t now_ms)
+{
+    struct dps_snap *next;
+    unsigned i;
+
+    pthread_mutex_lock(&s->lock);
+    next = &s->snap[s->cur ^ 1];
+    for (i = 0; i < s->nports; i++)
+        aggregate(s, i, &next->port[i]);
+    for (i = 0; i < s->nvlans; i++)
+        aggregate(s, s->nports + i, &next->vlan[i]);
+    next->t_ms = now_ms;
+    s->cur ^= 1;
+    s->nsamples++;
+    pthread_mutex_unlock(&s->lock);
+}
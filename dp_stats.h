@@ -0,0 +1,86 @@
+/**
+ * @file dp_stats.h
+ * @brief Per-worker sharded port and VLAN counters with lazy aggregation
+ *        and sampled rates.
+ *
+ * Every forwarding worker owns one shard: a private array of counter blocks
+ * for every port and every VLAN ID, each block padded to its own 64-byte
+ * cache line and each shard allocated on cache-line boundaries.  A worker
+ * therefore only ever writes lines no other thread writes, and the fast
+ * path never bounces a counter line between cores.
+ *
+ * Nothing is summed on the fast path.  Readers add the shards up when they
+ * ask (dps_port_read() / dps_vlan_read()), using relaxed loads, so a total
+ * may be a few frames behind but never torn.  Rates come from a sampler
+ * thread that takes a full aggregate every interval and keeps the last two;
+ * a rate is the difference of those two snapshots over their time delta.
+ *
+ * A port slot that is reused for another interface is reset by recording
+ * its current totals as a baseline that readers subtract, so a reset never
+ * writes into another worker's shard.
+ */
+
+#ifndef DP_STATS_H
+#define DP_STATS_H
+
+#include <stdint.h>
+
+/** Default rate sampling period. */
+#define DPS_DEFAULT_INTERVAL_MS  1000
+
+/** Packet, byte and drop counters of one port or VLAN. */
+struct dp_counters
+{
+    uint64_t rx_packets;
+    uint64_t rx_bytes;
+    uint64_t rx_dropped;     /**< frames not admitted */
+    uint64_t tx_packets;
+    uint64_t tx_bytes;
+    uint64_t tx_dropped;     /**< TX ring full or frame too long */
+};
+
+/** Rates over the last sampling period. */
+struct dp_rate
+{
+    double rx_pps;
+    double rx_bps;           /**< bits per second */
+    double tx_pps;
+    double tx_bps;
+};
+
+/** One counter block on its own cache line. */
+struct dps_line
+{
+    struct dp_counters c;
+} __attribute__((aligned(64)));
+
+/** A worker's view of its shard. */
+struct dps_shard
+{
+    struct dps_line *port;
+    struct dps_line *vlan;
+};
+
+struct dp_stats;
+
+struct dp_stats *dps_create(unsigned nshards, unsigned nports, unsigned nvlans,
+                            unsigned interval_ms);
+void dps_destroy(struct dp_stats *s);
+
+struct dps_shard dps_shard(struct dp_stats *s, unsigned shard);
+
+void dps_port_read(struct dp_stats *s, unsigned port, struct dp_counters *out);
+void dps_vlan_read(struct dp_stats *s, unsigned vid, struct dp_counters *out);
+void dps_port_rate(struct dp_stats *s, unsigned port, struct dp_rate *out);
+void dps_vlan_rate(struct dp_stats *s, unsigned vid, struct dp_rate *out);
+void dps_port_reset(struct dp_stats *s, unsigned port);
+
+void dps_sample(struct dp_stats *s, uint64_t now_ms);
+
+/** Single-writer counter update for the shard's owner; readers use relaxed loads. */
+static inline void dps_add(uint64_t *c, uint64_t v)
+{
+    __atomic_store_n(c, *c + v, __ATOMIC_RELAXED);
+}
+
+#endif /* DP_STATS_H */
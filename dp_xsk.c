@@ -0,0 +1,532 @@
+/**
+ * @file dp_xsk.c
+ * @brief AF_XDP sockets, shared UMEM and the XDP redirect program, set up
+ *        with raw bpf(2) and socket calls (no libbpf).
+ *
+ * Ring indices are shared with the kernel: the peer's index is read with
+ * acquire and ours is published with release ordering, as for the TPACKET
+ * status words in dp_ring.c.
+ */
+
+#define _GNU_SOURCE     /* MAP_HUGETLB */
+
+#include <errno.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <net/if.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <linux/bpf.h>
+#include <linux/ethtool.h>
+#include <linux/if_link.h>
+#include <linux/if_xdp.h>
+#include <linux/sockios.h>
+
+#include "dp_xsk.h"
+
+#ifndef AF_XDP
+#define AF_XDP 44
+#endif
+#ifndef SOL_XDP
+#define SOL_XDP 283
+#endif
+
+/* Frames of one chunk: RX first, then TX. */
+#define CHUNK_FRAMES  (DP_XSK_RX_FRAMES + DP_XSK_TX_FRAMES)
+#define UMEM_LEN      ((size_t)DP_XSK_PORTS * CHUNK_FRAMES * DP_XSK_FRAME)
+#define HUGEPAGE      (2u << 20)
+
+static inline uint32_t idx_load(const uint32_t *p)
+{
+    return __atomic_load_n(p, __ATOMIC_ACQUIRE);
+}
+
+static inline void idx_store(uint32_t *p, uint32_t v)
+{
+    __atomic_store_n(p, v, __ATOMIC_RELEASE);
+}
+
+static inline uint64_t chunk_base(const struct dp_xsk *xsk)
+{
+    return (uint64_t)xsk->chunk * CHUNK_FRAMES * DP_XSK_FRAME;
+}
+
+/* ---------------------------------------------------------------------------
+ * UMEM
+ * --------------------------------------------------------------------------- */
+
+/**
+ * dp_umem_create() - Map the frame area one worker's sockets share.
+ *
+ * Backed by 2 MB hugepages if reserved, normal pages otherwise.  The area
+ * is registered with the kernel by the first socket that uses it.
+ *
+ * @return the UMEM, or NULL if memory is unavailable.
+ */
+struct dp_umem *dp_umem_create(void)
+{
+    struct dp_umem *umem;
+    unsigned i;
+
+    umem = calloc(1, sizeof(*umem));
+    if (!umem)
+        return NULL;
+
+    umem->len = (UMEM_LEN + HUGEPAGE - 1) & ~((size_t)HUGEPAGE - 1);
+    umem->area = mmap(NULL, umem->len, PROT_READ | PROT_WRITE,
+                      MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+    umem->hugepages = umem->area != MAP_FAILED;
+    if (!umem->hugepages)
+        umem->area = mmap(NULL, umem->len, PROT_READ | PROT_WRITE,
+                          MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (umem->area == MAP_FAILED)
+    {
+        free(umem);
+        return NULL;
+    }
+    for (i = 0; i < DP_XSK_PORTS; i++)
+        umem->chunk_fd[i] = -1;
+    return umem;
+}
+
+/** dp_umem_destroy() - Unmap @p umem; every socket on it must be closed. */
+void dp_umem_destroy(struct dp_umem *umem)
+{
+    if (!umem)
+        return;
+    munmap(umem->area, umem->len);
+    free(umem);
+}
+
+/* ---------------------------------------------------------------------------
+ * XDP program
+ * --------------------------------------------------------------------------- */
+
+static long sys_bpf(int cmd, union bpf_attr *attr)
+{
+    return syscall(__NR_bpf, cmd, attr, sizeof(*attr));
+}
+
+static int rx_queues(int ifindex)
+{
+    struct ethtool_channels ch = { .cmd = ETHTOOL_GCHANNELS };
+    struct ifreq ifr;
+    int fd, n;
+
+    memset(&ifr, 0, sizeof(ifr));
+    if (!if_indextoname((unsigned)ifindex, ifr.ifr_name))
+        return -ENODEV;
+    ifr.ifr_data = (char *)&ch;
+
+    fd = socket(AF_INET, SOCK_DGRAM, 0);
+    if (fd < 0)
+        return -errno;
+    n = ioctl(fd, SIOCETHTOOL, &ifr) < 0 ? 1 : (int)(ch.rx_count + ch.combined_count);
+    close(fd);
+    return n > 0 ? n : 1;
+}
+
+/**
+ * dp_xdp_attach() - Redirect @p ifindex's RX queues to an XSKMAP.
+ *
+ * The program is
+ *
+ *     return bpf_redirect_map(&xsks, ctx->rx_queue_index, XDP_PASS);
+ *
+ * so a queue without a socket still reaches the stack.
+ *
+ * @return
+ *    0           – success. \n
+ *   -EOPNOTSUPP  – the port does not have exactly @p nqueues RX queues. \n
+ *   -errno       – the map, program or link could not be created (no
+ *                  BPF support or privileges, or no XDP on this device).
+ */
+int dp_xdp_attach(struct dp_xdp *xdp, int ifindex, unsigned nqueues)
+{
+    union bpf_attr attr;
+    int err;
+
+    memset(xdp, 0, sizeof(*xdp));
+    xdp->ifindex = ifindex;
+    xdp->map_fd = xdp->prog_fd = xdp->link_fd = -1;
+    if (rx_queues(ifindex) != (int)nqueues)
+        return -EOPNOTSUPP;
+    xdp->nqueues = nqueues;
+
+    memset(&attr, 0, sizeof(attr));
+    attr.map_type    = BPF_MAP_TYPE_XSKMAP;
+    attr.key_size    = sizeof(uint32_t);
+    attr.value_size  = sizeof(uint32_t);
+    attr.max_entries = nqueues;
+    xdp->map_fd = (int)sys_bpf(BPF_MAP_CREATE, &attr);
+    if (xdp->map_fd < 0)
+        goto fail;
+
+    {
+        struct bpf_insn prog[] =
+        {
+            /* r2 = ctx->rx_queue_index */
+            { BPF_LDX | BPF_MEM | BPF_W, BPF_REG_2, BPF_REG_1,
+              offsetof(struct xdp_md, rx_queue_index), 0 },
+            /* r1 = &xsks (two-slot immediate) */
+            { BPF_LD | BPF_DW | BPF_IMM, BPF_REG_1, BPF_PSEUDO_MAP_FD, 0, xdp->map_fd },
+            { 0, 0, 0, 0, 0 },
+            /* r3 = XDP_PASS, the action if the slot is empty */
+            { BPF_ALU64 | BPF_MOV | BPF_K, BPF_REG_3, 0, 0, XDP_PASS },
+            { BPF_JMP | BPF_CALL, 0, 0, 0, BPF_FUNC_redirect_map },
+            { BPF_JMP | BPF_EXIT, 0, 0, 0, 0 },
+        };
+
+        memset(&attr, 0, sizeof(attr));
+        attr.prog_type = BPF_PROG_TYPE_XDP;
+        attr.insns     = (uint64_t)(uintptr_t)prog;
+        attr.insn_cnt  = sizeof(prog) / sizeof(prog[0]);
+        attr.license   = (uint64_t)(uintptr_t)"GPL";
+        xdp->prog_fd = (int)sys_bpf(BPF_PROG_LOAD, &attr);
+        if (xdp->prog_fd < 0)
+            goto fail;
+    }
+
+    memset(&attr, 0, sizeof(attr));
+    attr.link_create.prog_fd        = (uint32_t)xdp->prog_fd;
+    attr.link_create.target_ifindex = (uint32_t)ifindex;
+    attr.link_create.attach_type    = BPF_XDP;
+    attr.link_create.flags          = XDP_FLAGS_DRV_MODE;
+    xdp->link_fd = (int)sys_bpf(BPF_LINK_CREATE, &attr);
+    xdp->native = xdp->link_fd >= 0;
+    if (xdp->link_fd < 0)
+    {
+        attr.link_create.flags = XDP_FLAGS_SKB_MODE;
+        xdp->link_fd = (int)sys_bpf(BPF_LINK_CREATE, &attr);
+        if (xdp->link_fd < 0)
+            goto fail;
+    }
+    return 0;
+
+fail:
+    err = -errno;
+    dp_xdp_detach(xdp);
+    return err;
+}
+
+/** dp_xdp_detach() - Remove the program; frames go to the stack again. */
+void dp_xdp_detach(struct dp_xdp *xdp)
+{
+    if (xdp->link_fd >= 0)
+        close(xdp->link_fd);
+    if (xdp->prog_fd >= 0)
+        close(xdp->prog_fd);
+    if (xdp->map_fd >= 0)
+        close(xdp->map_fd);
+    xdp->link_fd = xdp->prog_fd = xdp->map_fd = -1;
+}
+
+/* ---------------------------------------------------------------------------
+ * Sockets
+ * --------------------------------------------------------------------------- */
+
+static int ring_map(struct dpx_ring *r, int fd, const struct xdp_ring_offset *off,
+                    uint32_t entries, size_t desc_size, off_t pgoff)
+{
+    r->map_len = off->desc + entries * desc_size;
+    r->map = mmap(NULL, r->map_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, pgoff);
+    if (r->map == MAP_FAILED)
+    {
+        r->map = NULL;
+        return -errno;
+    }
+    r->producer = (uint32_t *)((uint8_t *)r->map + off->producer);
+    r->consumer = (uint32_t *)((uint8_t *)r->map + off->consumer);
+    r->flags    = (uint32_t *)((uint8_t *)r->map + off->flags);
+    r->desc     = (uint8_t *)r->map + off->desc;
+    r->mask     = entries - 1;
+    return 0;
+}
+
+static void ring_unmap(struct dpx_ring *r)
+{
+    if (r->map)
+        munmap(r->map, r->map_len);
+    r->map = NULL;
+}
+
+static int any_socket(const struct dp_umem *umem)
+{
+    unsigned i;
+
+    for (i = 0; i < DP_XSK_PORTS; i++)
+    {
+        if (umem->chunk_fd[i] >= 0)
+            return umem->chunk_fd[i];
+    }
+    return -1;
+}
+
+/**
+ * dp_xsk_open() - Bind an XSK socket to RX queue @p queue of @p xdp's port.
+ *
+ * The first socket on @p umem registers it; later ones share it.
+ *
+ * @return 0, -ENOSPC if @p umem has no free chunk, or -errno (no AF_XDP
+ *         in the kernel, or the bind was refused).
+ */
+int dp_xsk_open(struct dp_xsk *xsk, struct dp_xdp *xdp, unsigned queue, struct dp_umem *umem)
+{
+    struct xdp_mmap_offsets off;
+    struct sockaddr_xdp sxdp;
+    socklen_t optlen = sizeof(off);
+    uint32_t rx_n = DP_XSK_RX_FRAMES;
+    uint32_t tx_n = DP_XSK_TX_FRAMES;
+    uint32_t key = queue;
+    union bpf_attr attr;
+    uint64_t *fill;
+    unsigned i;
+    int share;
+    int err;
+
+    memset(xsk, 0, sizeof(*xsk));
+    xsk->fd = -1;
+    for (i = 0; i < DP_XSK_PORTS && umem->chunk_fd[i] >= 0; i++)
+        ;
+    if (i == DP_XSK_PORTS)
+        return -ENOSPC;
+    xsk->chunk = i;
+    xsk->umem  = umem;
+    xsk->xdp   = xdp;
+    xsk->queue = queue;
+
+    xsk->fd = socket(AF_XDP, SOCK_RAW | SOCK_CLOEXEC, 0);
+    if (xsk->fd < 0)
+        return -errno;
+
+    share = any_socket(umem);
+    if (share < 0)
+    {
+        struct xdp_umem_reg reg;
+
+        memset(&reg, 0, sizeof(reg));
+        reg.addr       = (uint64_t)(uintptr_t)umem->area;
+        reg.len        = umem->len;
+        reg.chunk_size = DP_XSK_FRAME;
+        if (setsockopt(xsk->fd, SOL_XDP, XDP_UMEM_REG, &reg, sizeof(reg)) < 0)
+            goto fail;
+    }
+
+    if (setsockopt(xsk->fd, SOL_XDP, XDP_UMEM_FILL_RING, &rx_n, sizeof(rx_n)) < 0 ||
+        setsockopt(xsk->fd, SOL_XDP, XDP_UMEM_COMPLETION_RING, &tx_n, sizeof(tx_n)) < 0 ||
+        setsockopt(xsk->fd, SOL_XDP, XDP_RX_RING, &rx_n, sizeof(rx_n)) < 0 ||
+        setsockopt(xsk->fd, SOL_XDP, XDP_TX_RING, &tx_n, sizeof(tx_n)) < 0 ||
+        getsockopt(xsk->fd, SOL_XDP, XDP_MMAP_OFFSETS, &off, &optlen) < 0)
+        goto fail;
+
+    if ((err = ring_map(&xsk->rx, xsk->fd, &off.rx, rx_n, sizeof(struct xdp_desc),
+                        XDP_PGOFF_RX_RING)) < 0 ||
+        (err = ring_map(&xsk->tx, xsk->fd, &off.tx, tx_n, sizeof(struct xdp_desc),
+                        XDP_PGOFF_TX_RING)) < 0 ||
+        (err = ring_map(&xsk->fill, xsk->fd, &off.fr, rx_n, sizeof(uint64_t),
+                        XDP_UMEM_PGOFF_FILL_RING)) < 0 ||
+        (err = ring_map(&xsk->comp, xsk->fd, &off.cr, tx_n, sizeof(uint64_t),
+                        XDP_UMEM_PGOFF_COMPLETION_RING)) < 0)
+    {
+        dp_xsk_close(xsk);
+        return err;
+    }
+
+    /* Every RX frame of the chunk goes to the fill ring before the bind. */
+    fill = xsk->fill.desc;
+    for (i = 0; i < DP_XSK_RX_FRAMES; i++)
+        fill[i] = chunk_base(xsk) + (uint64_t)i * DP_XSK_FRAME;
+    xsk->fill.head = DP_XSK_RX_FRAMES;
+    idx_store(xsk->fill.producer, xsk->fill.head);
+    for (i = 0; i < DP_XSK_TX_FRAMES; i++)
+        xsk->tx_free[i] = chunk_base(xsk) + (uint64_t)(DP_XSK_RX_FRAMES + i) * DP_XSK_FRAME;
+    xsk->ntx_free = DP_XSK_TX_FRAMES;
+
+    /* Sharing sockets inherit the mode of the UMEM's first socket. */
+    memset(&sxdp, 0, sizeof(sxdp));
+    sxdp.sxdp_family   = AF_XDP;
+    sxdp.sxdp_ifindex  = (uint32_t)xdp->ifindex;
+    sxdp.sxdp_queue_id = queue;
+    if (share >= 0)
+    {
+        sxdp.sxdp_flags          = XDP_SHARED_UMEM;
+        sxdp.sxdp_shared_umem_fd = (uint32_t)share;
+    }
+    else
+    {
+        sxdp.sxdp_flags = XDP_COPY | XDP_USE_NEED_WAKEUP;
+    }
+    if (bind(xsk->fd, (struct sockaddr *)&sxdp, sizeof(sxdp)) < 0)
+        goto fail;
+
+    memset(&attr, 0, sizeof(attr));
+    attr.map_fd = (uint32_t)xdp->map_fd;
+    attr.key    = (uint64_t)(uintptr_t)&key;
+    attr.value  = (uint64_t)(uintptr_t)&xsk->fd;
+    if (sys_bpf(BPF_MAP_UPDATE_ELEM, &attr) < 0)
+        goto fail;
+
+    umem->chunk_fd[xsk->chunk] = xsk->fd;
+    return 0;
+
+fail:
+    err = -errno;
+    dp_xsk_close(xsk);
+    return err;
+}
+
+/** dp_xsk_close() - Unhook and close the socket and return its chunk. */
+void dp_xsk_close(struct dp_xsk *xsk)
+{
+    if (xsk->fd >= 0)
+    {
+        if (xsk->umem && xsk->umem->chunk_fd[xsk->chunk] == xsk->fd)
+        {
+            union bpf_attr attr;
+            uint32_t key = xsk->queue;
+
+            memset(&attr, 0, sizeof(attr));
+            attr.map_fd = (uint32_t)xsk->xdp->map_fd;
+            attr.key    = (uint64_t)(uintptr_t)&key;
+            sys_bpf(BPF_MAP_DELETE_ELEM, &attr);
+            xsk->umem->chunk_fd[xsk->chunk] = -1;
+        }
+        close(xsk->fd);
+    }
+    ring_unmap(&xsk->rx);
+    ring_unmap(&xsk->tx);
+    ring_unmap(&xsk->fill);
+    ring_unmap(&xsk->comp);
+    xsk->fd = -1;
+}
+
+/* ---------------------------------------------------------------------------
+ * RX
+ * --------------------------------------------------------------------------- */
+
+/**
+ * dp_xsk_rx_peek() - Number of received frames ready, at most DP_XSK_BATCH,
+ *                    starting at ring index *@p idx.
+ */
+unsigned dp_xsk_rx_peek(struct dp_xsk *xsk, uint32_t *idx)
+{
+    uint32_t n = idx_load(xsk->rx.producer) - xsk->rx.head;
+
+    *idx = xsk->rx.head;
+    return n < DP_XSK_BATCH ? n : DP_XSK_BATCH;
+}
+
+void dp_xsk_rx_frame(struct dp_xsk *xsk, uint32_t idx, uint8_t **data, uint32_t *len)
+{
+    const struct xdp_desc *d = (const struct xdp_desc *)xsk->rx.desc + (idx & xsk->rx.mask);
+
+    *data = xsk->umem->area + d->addr;
+    *len  = d->len;
+}
+
+/**
+ * dp_xsk_rx_release() - Consume @p n frames from @p idx and put their
+ *                       frames straight back on the fill ring.
+ */
+void dp_xsk_rx_release(struct dp_xsk *xsk, uint32_t idx, unsigned n)
+{
+    const struct xdp_desc *rx = xsk->rx.desc;
+    uint64_t *fill = xsk->fill.desc;
+    unsigned i;
+
+    /* The fill ring holds every RX frame not in the RX ring, so it has room. */
+    for (i = 0; i < n; i++)
+    {
+        uint64_t addr = rx[(idx + i) & xsk->rx.mask].addr;
+
+        fill[(xsk->fill.head + i) & xsk->fill.mask] = addr & ~(uint64_t)(DP_XSK_FRAME - 1);
+    }
+    xsk->fill.head += n;
+    idx_store(xsk->fill.producer, xsk->fill.head);
+    xsk->rx.head = idx + n;
+    idx_store(xsk->rx.consumer, xsk->rx.head);
+
+    if (__atomic_load_n(xsk->fill.flags, __ATOMIC_RELAXED) & XDP_RING_NEED_WAKEUP)
+        recvfrom(xsk->fd, NULL, 0, MSG_DONTWAIT, NULL, NULL);
+}
+
+/* ---------------------------------------------------------------------------
+ * TX
+ * --------------------------------------------------------------------------- */
+
+static void tx_reclaim(struct dp_xsk *xsk)
+{
+    const uint64_t *comp = xsk->comp.desc;
+    uint32_t end = idx_load(xsk->comp.producer);
+
+    while (xsk->comp.head != end)
+        xsk->tx_free[xsk->ntx_free++] = comp[xsk->comp.head++ & xsk->comp.mask];
+    idx_store(xsk->comp.consumer, xsk->comp.head);
+}
+
+/**
+ * dp_xsk_tx_slot() - A free TX frame to copy a frame into, or NULL if every
+ *                    TX frame is still queued or in flight.
+ */
+uint8_t *dp_xsk_tx_slot(struct dp_xsk *xsk)
+{
+    if (xsk->ntx_free == 0)
+        tx_reclaim(xsk);
+    if (xsk->ntx_free == 0)
+        return NULL;
+    return xsk->umem->area + xsk->tx_free[xsk->ntx_free - 1];
+}
+
+/** dp_xsk_tx_commit() - Queue the frame written to @p slot for dp_xsk_tx_flush(). */
+void dp_xsk_tx_commit(struct dp_xsk *xsk, uint8_t *slot, uint32_t len)
+{
+    struct xdp_desc *d = (struct xdp_desc *)xsk->tx.desc + (xsk->tx.head & xsk->tx.mask);
+
+    d->addr    = (uint64_t)(slot - xsk->umem->area);
+    d->len     = len;
+    d->options = 0;
+    xsk->tx.head++;
+    xsk->ntx_free--;
+    xsk->tx_pending++;
+}
+
+/**
+ * dp_xsk_tx_flush() - Publish the queued frames and kick the kernel.
+ *
+ * Copy mode transmits a bounded batch per kick, so the kick is repeated
+ * while the kernel reports more work.
+ *
+ * @return 0, -EAGAIN if frames are left for the next flush, or -errno.
+ */
+int dp_xsk_tx_flush(struct dp_xsk *xsk)
+{
+    unsigned tries;
+    int err = 0;
+
+    if (xsk->tx_pending == 0)
+        return 0;
+
+    idx_store(xsk->tx.producer, xsk->tx.head);
+    for (tries = 0; tries < DP_XSK_TX_FRAMES / 16; tries++)
+    {
+        if (sendto(xsk->fd, NULL, 0, MSG_DONTWAIT, NULL, 0) >= 0)
+        {
+            err = 0;
+            break;
+        }
+        err = (errno == EAGAIN || errno == EBUSY || errno == ENOBUFS) ? -EAGAIN : -errno;
+        if (err != -EAGAIN || idx_load(xsk->tx.consumer) == xsk->tx.head)
+            break;
+    }
+    if (err == 0 || idx_load(xsk->tx.consumer) == xsk->tx.head)
+    {
+        xsk->tx_pending = 0;
+        err = 0;
+    }
+    tx_reclaim(xsk);
+    return err;
+}
@@ -0,0 +1,109 @@
+/**
+ * @file dp_xsk.h
+ * @brief AF_XDP backend for dp_ring.h: XDP redirect program, shared UMEM
+ *        and XSK socket rings.
+ *
+ * A port switched over AF_XDP gets a small XDP program (native mode where
+ * the driver has it, veth included, generic mode otherwise) that redirects
+ * every frame received on RX queue q to the XSK socket in slot q of the
+ * port's XSKMAP, or passes it to the stack if there is none.  Queue q
+ * belongs to forwarding worker q, so a port needs exactly as many RX queues
+ * as there are workers.
+ *
+ * Each worker registers one UMEM and every socket it opens, on any port,
+ * shares it (XDP_SHARED_UMEM).  The UMEM is split into DP_XSK_PORTS
+ * equal chunks, one per socket, each holding that socket's RX frames (kept
+ * in its fill ring and recycled there after every burst) and TX frames
+ * (recycled from its completion ring).  Closing a socket therefore returns
+ * its chunk whole, whatever was in flight.
+ *
+ * Sockets are bound in copy mode, which every driver supports, so a frame
+ * is copied once into the UMEM; unlike TPACKET it then bypasses the rest
+ * of the receive path (taps, bridging, protocol handlers).
+ */
+
+#ifndef DP_XSK_H
+#define DP_XSK_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/** UMEM frame size; the kernel reserves XDP_PACKET_HEADROOM of it on RX. */
+#define DP_XSK_FRAME       2048
+/** RX (and fill) ring entries and frames per socket. */
+#define DP_XSK_RX_FRAMES   512
+/** TX (and completion) ring entries and frames per socket. */
+#define DP_XSK_TX_FRAMES   256
+/** Sockets one worker's UMEM can back. */
+#define DP_XSK_PORTS       16
+/** Frames taken from the RX ring per dp_ring_rx_burst(). */
+#define DP_XSK_BATCH       64
+
+/** XDP program and XSKMAP attached to one port. */
+struct dp_xdp
+{
+    int      ifindex;
+    int      map_fd;
+    int      prog_fd;
+    int      link_fd;
+    unsigned nqueues;
+    int      native;         /**< 1: driver mode, 0: generic (skb) mode */
+};
+
+/** One producer or consumer ring shared with the kernel. */
+struct dpx_ring
+{
+    uint32_t *producer;
+    uint32_t *consumer;
+    uint32_t *flags;
+    void     *desc;
+    uint32_t  mask;
+    uint32_t  head;          /* our producer or consumer index */
+    void     *map;
+    size_t    map_len;
+};
+
+struct dp_umem
+{
+    uint8_t  *area;
+    size_t    len;
+    int       hugepages;
+    int       chunk_fd[DP_XSK_PORTS];   /* socket owning each chunk, or -1 */
+};
+
+struct dp_xsk
+{
+    int              fd;
+    struct dp_xdp   *xdp;
+    unsigned         queue;
+    struct dp_umem  *umem;
+    unsigned         chunk;
+
+    struct dpx_ring  rx;
+    struct dpx_ring  tx;
+    struct dpx_ring  fill;
+    struct dpx_ring  comp;
+
+    uint64_t         tx_free[DP_XSK_TX_FRAMES];
+    unsigned         ntx_free;
+    unsigned         tx_pending;
+};
+
+struct dp_umem *dp_umem_create(void);
+void            dp_umem_destroy(struct dp_umem *umem);
+
+int   dp_xdp_attach(struct dp_xdp *xdp, int ifindex, unsigned nqueues);
+void  dp_xdp_detach(struct dp_xdp *xdp);
+
+int   dp_xsk_open(struct dp_xsk *xsk, struct dp_xdp *xdp, unsigned queue, struct dp_umem *umem);
+void  dp_xsk_close(struct dp_xsk *xsk);
+
+unsigned dp_xsk_rx_peek(struct dp_xsk *xsk, uint32_t *idx);
+void     dp_xsk_rx_frame(struct dp_xsk *xsk, uint32_t idx, uint8_t **data, uint32_t *len);
+void     dp_xsk_rx_release(struct dp_xsk *xsk, uint32_t idx, unsigned n);
+
+uint8_t *dp_xsk_tx_slot(struct dp_xsk *xsk);
+void     dp_xsk_tx_commit(struct dp_xsk *xsk, uint8_t *slot, uint32_t len);
+int      dp_xsk_tx_flush(struct dp_xsk *xsk);
+
+#endif /* DP_XSK_H */
@@ -0,0 +1,699 @@
+/**
+ * @file fdb.c
+ * @brief Bucketized cuckoo hash for (VLAN, MAC) -> port, with wheel aging.
+ *
+ * Layout: a bucket is one cache line holding FDB_BUCKET_WAYS 16-byte slots.
+ * A slot's key carries FDB_VALID in bit 63 when in use (packed keys only use
+ * bits 0..59), so an empty slot is simply key == 0.
+ *
+ * Writer/reader protocol: every bucket maps to one of a power-of-two number
+ * of sequence counters.  The writer makes the counter odd before changing a
+ * slot's key or port and even again afterwards; lookups and fdb_dump() read
+ * a bucket and retry while the counter is odd or has moved.  A refresh of
+ * the last-seen time alone is a single aligned 32-bit store and skips the
+ * counter.  Displacing an entry during a cuckoo insert briefly removes it
+ * from the table, so a concurrent lookup or dump may miss it; a lookup miss
+ * only means one frame is flooded.
+ *
+ * Several forwarding workers share the table.  Only one of them is the
+ * writer at a time: inserts, moves, aging and flushes hold wlock.  The
+ * refresh of a known address is done without it, and fdb_learn_burst()
+ * only tries the lock, so a worker never waits for another one on the
+ * fast path.
+ */
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "fdb.h"
+
+#define FDB_VALID        (1ull << 63)
+#define FDB_MAX_KICKS    64
+#define FDB_MAX_STRIPES  1024
+#define FDB_BURST        32
+
+struct fdb_slot
+{
+    uint64_t key;
+    uint32_t seen_s;
+    uint8_t  port;
+    uint8_t  pad[3];
+};
+
+struct fdb_bucket
+{
+    struct fdb_slot slot[FDB_BUCKET_WAYS];
+} __attribute__((aligned(64)));
+
+_Static_assert(sizeof(struct fdb_bucket) == 64, "FDB bucket must be one cache line");
+
+struct fdb
+{
+    struct fdb_bucket *buckets;
+    uint32_t           mask;        /* nbuckets - 1 */
+    atomic_uint       *seq;
+    uint32_t           seq_mask;
+    uint32_t           age_s;
+    uint32_t           limit;       /* entries allowed; relaxed, see fdb_set_limit() */
+    uint32_t           rng;
+
+    /* aging wheel */
+    uint32_t           wheel_pos;
+    uint32_t           wheel_span;  /* buckets scanned per tick */
+    uint64_t           tick_ms;
+    uint64_t           next_tick_ms;
+
+    pthread_mutex_t    wlock;       /* serialises every key / port change */
+    struct fdb_stats   stats;       /* written under wlock, except deferred */
+};
+
+/* ---------------------------------------------------------------------------
+ * Helpers
+ * --------------------------------------------------------------------------- */
+
+/* Single-writer counter update; readers use stat_load(). */
+static inline void stat_add(uint64_t *c, uint64_t v)
+{
+    __atomic_store_n(c, *c + v, __ATOMIC_RELAXED);
+}
+
+static inline uint64_t stat_load(const uint64_t *c)
+{
+    return __atomic_load_n(c, __ATOMIC_RELAXED);
+}
+
+static inline void cpu_relax(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#endif
+}
+
+static inline uint64_t mix64(uint64_t k)
+{
+    k ^= k >> 33;
+    k *= 0xff51afd7ed558ccdull;
+    k ^= k >> 33;
+    k *= 0xc4ceb9fe1a85ec53ull;
+    k ^= k >> 33;
+    return k;
+}
+
+static inline void candidates(const struct fdb *fdb, uint64_t key, uint32_t *b1, uint32_t *b2)
+{
+    uint64_t h = mix64(key);
+
+    *b1 = (uint32_t)h & fdb->mask;
+    *b2 = (uint32_t)(h >> 32) & fdb->mask;
+    if (*b2 == *b1)
+        *b2 = *b1 ^ 1;
+}
+
+static inline uint32_t alt_bucket(const struct fdb *fdb, uint64_t key, uint32_t b)
+{
+    uint32_t b1, b2;
+
+    candidates(fdb, key, &b1, &b2);
+    return b == b1 ? b2 : b1;
+}
+
+static inline uint32_t next_rand(struct fdb *fdb)
+{
+    fdb->rng ^= fdb->rng << 13;
+    fdb->rng ^= fdb->rng >> 17;
+    fdb->rng ^= fdb->rng << 5;
+    return fdb->rng;
+}
+
+static inline void write_begin(struct fdb *fdb, uint32_t b)
+{
+    atomic_uint *s = &fdb->seq[b & fdb->seq_mask];
+
+    atomic_store_explicit(s, atomic_load_explicit(s, memory_order_relaxed) + 1,
+                          memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+}
+
+static inline void write_end(struct fdb *fdb, uint32_t b)
+{
+    atomic_uint *s = &fdb->seq[b & fdb->seq_mask];
+
+    atomic_store_explicit(s, atomic_load_explicit(s, memory_order_relaxed) + 1,
+                          memory_order_release);
+}
+
+static inline struct fdb_slot *find(struct fdb *fdb, uint32_t b, uint64_t vkey)
+{
+    struct fdb_slot *s = fdb->buckets[b].slot;
+    unsigned w;
+
+    for (w = 0; w < FDB_BUCKET_WAYS; w++)
+    {
+        if (s[w].key == vkey)
+            return &s[w];
+    }
+    return NULL;
+}
+
+static int place(struct fdb *fdb, uint32_t b, const struct fdb_slot *e)
+{
+    struct fdb_slot *s = fdb->buckets[b].slot;
+    unsigned w;
+
+    for (w = 0; w < FDB_BUCKET_WAYS; w++)
+    {
+        if (s[w].key == 0)
+        {
+            write_begin(fdb, b);
+            s[w] = *e;
+            write_end(fdb, b);
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static inline void swap_slot(struct fdb *fdb, uint32_t b, unsigned w, struct fdb_slot *e)
+{
+    struct fdb_slot tmp = fdb->buckets[b].slot[w];
+
+    write_begin(fdb, b);
+    fdb->buckets[b].slot[w] = *e;
+    write_end(fdb, b);
+    *e = tmp;
+}
+
+/*
+ * cuckoo_insert() - Place @p e, displacing entries along a random walk.
+ *
+ * A failed walk is undone step by step, so a full table never loses an
+ * existing entry; only the new one is rejected.
+ */
+static int cuckoo_insert(struct fdb *fdb, struct fdb_slot e)
+{
+    struct { uint32_t b; unsigned w; } path[FDB_MAX_KICKS];
+    uint32_t b1, b2, b;
+    int i;
+
+    candidates(fdb, e.key & ~FDB_VALID, &b1, &b2);
+    if (place(fdb, b1, &e) || place(fdb, b2, &e))
+        return 0;
+
+    b = (next_rand(fdb) & 1) ? b1 : b2;
+    for (i = 0; i < FDB_MAX_KICKS; i++)
+    {
+        path[i].b = b;
+        path[i].w = next_rand(fdb) % FDB_BUCKET_WAYS;
+        swap_slot(fdb, b, path[i].w, &e);
+        b = alt_bucket(fdb, e.key & ~FDB_VALID, b);
+        if (place(fdb, b, &e))
+            return 0;
+    }
+
+    while (i-- > 0)
+        swap_slot(fdb, path[i].b, path[i].w, &e);
+    return -ENOSPC;
+}
+
+/*
+ * lookup_one() - Port of @p vkey in bucket @p b1 or @p b2, consistent with
+ *                any concurrent writer.
+ */
+static inline uint8_t lookup_one(struct fdb *fdb, uint32_t b1, uint32_t b2, uint64_t vkey)
+{
+    atomic_uint *q1 = &fdb->seq[b1 & fdb->seq_mask];
+    atomic_uint *q2 = &fdb->seq[b2 & fdb->seq_mask];
+
+    for (;;)
+    {
+        unsigned s1 = atomic_load_explicit(q1, memory_order_acquire);
+        unsigned s2 = atomic_load_explicit(q2, memory_order_acquire);
+        struct fdb_slot *s;
+        uint8_t port;
+
+        if (!((s1 | s2) & 1))
+        {
+            if ((s = find(fdb, b1, vkey)) != NULL || (s = find(fdb, b2, vkey)) != NULL)
+                port = s->port;
+            else
+                port = FDB_PORT_NONE;
+            atomic_thread_fence(memory_order_acquire);
+            if (atomic_load_explicit(q1, memory_order_relaxed) == s1 &&
+                atomic_load_explicit(q2, memory_order_relaxed) == s2)
+                return port;
+        }
+        cpu_relax();
+    }
+}
+
+static void clear_slot(struct fdb *fdb, uint32_t b, unsigned w)
+{
+    write_begin(fdb, b);
+    fdb->buckets[b].slot[w].key = 0;
+    write_end(fdb, b);
+    stat_add(&fdb->stats.entries, (uint64_t)-1);
+}
+
+/* ---------------------------------------------------------------------------
+ * Lifecycle
+ * --------------------------------------------------------------------------- */
+
+/**
+ * fdb_create() - Allocate an empty table.
+ *
+ * @param nbuckets  rounded up to a power of two, at least 2; 0 selects
+ *                  FDB_DEFAULT_BUCKETS.  Capacity is nbuckets *
+ *                  FDB_BUCKET_WAYS, usable to roughly 95 % load.
+ * @param age_s     idle time after which an entry is aged out; 0 selects
+ *                  FDB_DEFAULT_AGE_S.
+ *
+ * @return the table, or NULL if out of memory.
+ */
+struct fdb *fdb_create(unsigned nbuckets, unsigned age_s)
+{
+    struct fdb *fdb;
+    uint32_t n = 2;
+    uint32_t stripes;
+
+    if (nbuckets == 0)
+        nbuckets = FDB_DEFAULT_BUCKETS;
+    while (n < nbuckets && n < (1u << 30))
+        n <<= 1;
+    stripes = n < FDB_MAX_STRIPES ? n : FDB_MAX_STRIPES;
+
+    fdb = calloc(1, sizeof(*fdb));
+    if (!fdb)
+        return NULL;
+
+    fdb->buckets = aligned_alloc(64, (size_t)n * sizeof(struct fdb_bucket));
+    fdb->seq = calloc(stripes, sizeof(*fdb->seq));
+    if (!fdb->buckets || !fdb->seq)
+    {
+        fdb_destroy(fdb);
+        return NULL;
+    }
+    memset(fdb->buckets, 0, (size_t)n * sizeof(struct fdb_bucket));
+
+    fdb->mask       = n - 1;
+    fdb->seq_mask   = stripes - 1;
+    fdb->age_s      = age_s ? age_s : FDB_DEFAULT_AGE_S;
+    fdb->limit      = n * FDB_BUCKET_WAYS;
+    fdb->rng        = 0x9e3779b9u;
+    fdb->wheel_span = (n + FDB_WHEEL_SLOTS - 1) / FDB_WHEEL_SLOTS;
+    fdb->tick_ms    = (uint64_t)fdb->age_s * 1000 / 2 / FDB_WHEEL_SLOTS;
+    if (fdb->tick_ms == 0)
+        fdb->tick_ms = 1;
+    pthread_mutex_init(&fdb->wlock, NULL);
+    return fdb;
+}
+
+void fdb_destroy(struct fdb *fdb)
+{
+    if (!fdb)
+        return;
+    if (fdb->seq && fdb->buckets)
+        pthread_mutex_destroy(&fdb->wlock);
+    free(fdb->buckets);
+    free(fdb->seq);
+    free(fdb);
+}
+
+/* ---------------------------------------------------------------------------
+ * Writer side
+ * --------------------------------------------------------------------------- */
+
+/* fdb_learn() with wlock held. */
+static int learn_locked(struct fdb *fdb, uint64_t key, uint8_t port, uint32_t now_s)
+{
+    uint64_t vkey = key | FDB_VALID;
+    struct fdb_slot *s;
+    struct fdb_slot e;
+    uint32_t b1, b2;
+    uint32_t b;
+
+    candidates(fdb, key, &b1, &b2);
+    b = b1;
+    if ((s = find(fdb, b1, vkey)) == NULL)
+    {
+        b = b2;
+        s = find(fdb, b2, vkey);
+    }
+
+    if (s)
+    {
+        if (s->port != port)
+        {
+            write_begin(fdb, b);
+            s->port = port;
+            s->seen_s = now_s;
+            write_end(fdb, b);
+            stat_add(&fdb->stats.moves, 1);
+        }
+        else if (s->seen_s != now_s)
+        {
+            __atomic_store_n(&s->seen_s, now_s, __ATOMIC_RELAXED);
+        }
+        return 0;
+    }
+
+    memset(&e, 0, sizeof(e));
+    e.key    = vkey;
+    e.seen_s = now_s;
+    e.port   = port;
+    if (fdb->stats.entries >= __atomic_load_n(&fdb->limit, __ATOMIC_RELAXED) ||
+        cuckoo_insert(fdb, e) < 0)
+    {
+        stat_add(&fdb->stats.full, 1);
+        return -ENOSPC;
+    }
+    stat_add(&fdb->stats.entries, 1);
+    stat_add(&fdb->stats.learned, 1);
+    return 0;
+}
+
+/**
+ * fdb_learn() - Record that @p key was seen as a source on @p port.
+ *
+ * Refreshing a known address on the same port writes only its last-seen
+ * time, and only once per second.  A known address on a different port is a
+ * station move and is re-pointed in place.
+ *
+ * @return 0 on success, -ENOSPC if the table has no room for a new entry
+ *         or holds fdb_set_limit() entries already.
+ */
+int fdb_learn(struct fdb *fdb, uint64_t key, uint8_t port, uint32_t now_s)
+{
+    int ret;
+
+    pthread_mutex_lock(&fdb->wlock);
+    ret = learn_locked(fdb, key, port, now_s);
+    pthread_mutex_unlock(&fdb->wlock);
+    return ret;
+}
+
+/**
+ * fdb_learn_burst() - fdb_learn() for @p n source keys seen on one port.
+ *
+ * Candidate buckets of each group of FDB_BURST keys are prefetched first.
+ * Addresses already known on @p port are refreshed without the writer
+ * lock; the rest are learned only if the lock is free, and are otherwise
+ * counted in fdb_stats.deferred and left for a later frame.  Keys that do
+ * not fit are counted in fdb_stats.full.
+ */
+void fdb_learn_burst(struct fdb *fdb, const uint64_t *keys, unsigned n,
+                     uint8_t port, uint32_t now_s)
+{
+    uint64_t slow[FDB_BURST];
+    unsigned base;
+    unsigned i;
+
+    for (base = 0; base < n; base += FDB_BURST)
+    {
+        unsigned cnt = n - base < FDB_BURST ? n - base : FDB_BURST;
+        unsigned nslow = 0;
+
+        for (i = 0; i < cnt; i++)
+        {
+            uint32_t b1, b2;
+
+            candidates(fdb, keys[base + i], &b1, &b2);
+            __builtin_prefetch(&fdb->buckets[b1], 1);
+            __builtin_prefetch(&fdb->buckets[b2], 1);
+        }
+        for (i = 0; i < cnt; i++)
+        {
+            uint64_t vkey = keys[base + i] | FDB_VALID;
+            struct fdb_slot *s;
+            uint32_t b1, b2;
+
+            candidates(fdb, keys[base + i], &b1, &b2);
+            if (((s = find(fdb, b1, vkey)) != NULL || (s = find(fdb, b2, vkey)) != NULL) &&
+                s->port == port)
+            {
+                if (s->seen_s != now_s)
+                    __atomic_store_n(&s->seen_s, now_s, __ATOMIC_RELAXED);
+                continue;
+            }
+            slow[nslow++] = keys[base + i];
+        }
+
+        if (nslow == 0)
+            continue;
+        if (pthread_mutex_trylock(&fdb->wlock) != 0)
+        {
+            __atomic_fetch_add(&fdb->stats.deferred, nslow, __ATOMIC_RELAXED);
+            continue;
+        }
+        for (i = 0; i < nslow; i++)
+            learn_locked(fdb, slow[i], port, now_s);
+        pthread_mutex_unlock(&fdb->wlock);
+    }
+}
+
+/**
+ * fdb_lookup() - Port of @p key, or FDB_PORT_NONE if unknown.
+ */
+uint8_t fdb_lookup(struct fdb *fdb, uint64_t key)
+{
+    uint32_t b1, b2;
+
+    candidates(fdb, key, &b1, &b2);
+    return lookup_one(fdb, b1, b2, key | FDB_VALID);
+}
+
+/**
+ * fdb_lookup_burst() - fdb_lookup() for @p n keys.
+ *
+ * Keys are processed in groups of FDB_BURST: all candidate buckets of a
+ * group are prefetched before the first one is probed.
+ */
+void fdb_lookup_burst(struct fdb *fdb, const uint64_t *keys, unsigned n, uint8_t *ports)
+{
+    uint32_t b1[FDB_BURST];
+    uint32_t b2[FDB_BURST];
+    unsigned base;
+    unsigned i;
+
+    for (base = 0; base < n; base += FDB_BURST)
+    {
+        unsigned cnt = n - base < FDB_BURST ? n - base : FDB_BURST;
+
+        for (i = 0; i < cnt; i++)
+        {
+            candidates(fdb, keys[base + i], &b1[i], &b2[i]);
+            __builtin_prefetch(&fdb->buckets[b1[i]]);
+            __builtin_prefetch(&fdb->buckets[b2[i]]);
+        }
+
+        for (i = 0; i < cnt; i++)
+            ports[base + i] = lookup_one(fdb, b1[i], b2[i], keys[base + i] | FDB_VALID);
+    }
+}
+
+/**
+ * fdb_age() - Advance the aging wheel to @p now_ms.
+ *
+ * Call regularly from one thread with a monotonic millisecond clock whose
+ * seconds are the @c now_s passed to fdb_learn().  Each elapsed tick scans
+ * the next wheel slot's range of buckets; a long gap is capped at one full
+ * revolution.  If another thread is changing the table the call does
+ * nothing and the ticks are caught up on the next one.
+ *
+ * @return the number of entries removed.
+ */
+unsigned fdb_age(struct fdb *fdb, uint64_t now_ms)
+{
+    uint32_t now_s = (uint32_t)(now_ms / 1000);
+    unsigned ticks = 0;
+    unsigned removed = 0;
+
+    if (pthread_mutex_trylock(&fdb->wlock) != 0)
+        return 0;
+
+    if (fdb->next_tick_ms == 0)
+        fdb->next_tick_ms = now_ms + fdb->tick_ms;
+
+    while (now_ms >= fdb->next_tick_ms && ticks < FDB_WHEEL_SLOTS)
+    {
+        uint32_t first = fdb->wheel_pos * fdb->wheel_span;
+        uint32_t last = first + fdb->wheel_span;
+        uint32_t b;
+
+        if (last > fdb->mask + 1)
+            last = fdb->mask + 1;
+
+        for (b = first; b < last; b++)
+        {
+            struct fdb_slot *s = fdb->buckets[b].slot;
+            unsigned w;
+
+            for (w = 0; w < FDB_BUCKET_WAYS; w++)
+            {
+                if (s[w].key && now_s - s[w].seen_s >= fdb->age_s)
+                {
+                    clear_slot(fdb, b, w);
+                    removed++;
+                }
+            }
+        }
+
+        fdb->wheel_pos = (fdb->wheel_pos + 1) % FDB_WHEEL_SLOTS;
+        fdb->next_tick_ms += fdb->tick_ms;
+        ticks++;
+    }
+    if (ticks == FDB_WHEEL_SLOTS && now_ms >= fdb->next_tick_ms)
+        fdb->next_tick_ms = now_ms + fdb->tick_ms;
+
+    if (removed)
+        stat_add(&fdb->stats.aged, removed);
+    pthread_mutex_unlock(&fdb->wlock);
+    return removed;
+}
+
+/**
+ * fdb_flush() - Remove entries by port and by VLAN in one pass.
+ *
+ * An entry is removed if bit N of @p port_mask is set for its port N (ports
+ * 0..63), or if its VLAN's bit is set in @p vlans (4096 bits, may be NULL).
+ *
+ * @return the number of entries removed.
+ */
+unsigned fdb_flush(struct fdb *fdb, uint64_t port_mask, const uint64_t *vlans)
+{
+    unsigned removed = 0;
+    uint32_t b;
+
+    pthread_mutex_lock(&fdb->wlock);
+    for (b = 0; b <= fdb->mask; b++)
+    {
+        struct fdb_slot *s = fdb->buckets[b].slot;
+        unsigned w;
+
+        for (w = 0; w < FDB_BUCKET_WAYS; w++)
+        {
+            unsigned vid;
+
+            if (!s[w].key)
+                continue;
+            vid = (unsigned)(s[w].key >> 48) & 0xFFF;
+            if ((s[w].port < 64 && (port_mask & (1ull << s[w].port))) ||
+                (vlans && (vlans[vid / 64] & (1ull << (vid % 64)))))
+            {
+                clear_slot(fdb, b, w);
+                removed++;
+            }
+        }
+    }
+    if (removed)
+        stat_add(&fdb->stats.flushed, removed);
+    pthread_mutex_unlock(&fdb->wlock);
+    return removed;
+}
+
+unsigned fdb_flush_ports(struct fdb *fdb, uint64_t port_mask)
+{
+    return port_mask ? fdb_flush(fdb, port_mask, NULL) : 0;
+}
+
+unsigned fdb_flush_vlan(struct fdb *fdb, uint16_t vid)
+{
+    uint64_t vlans[4096 / 64];
+
+    memset(vlans, 0, sizeof(vlans));
+    vlans[(vid & 0xFFF) / 64] = 1ull << (vid % 64);
+    return fdb_flush(fdb, 0, vlans);
+}
+
+/* ---------------------------------------------------------------------------
+ * Reader side
+ * --------------------------------------------------------------------------- */
+
+/**
+ * fdb_dump() - Call @p fn for every entry, optionally of one VLAN only.
+ *
+ * Safe against the concurrent writer: each bucket is copied under its
+ * sequence counter and the copy is retried if the writer touched it.
+ * @p fn runs on the copy, outside any retry loop.
+ *
+ * @param vid    VLAN to list, or -1 for all.
+ * @param now_s  current time on the writer's clock, for the age column.
+ *
+ * @return the number of entries passed to @p fn.
+ */
+size_t fdb_dump(struct fdb *fdb, int vid, uint32_t now_s, fdb_dump_fn fn, void *arg)
+{
+    struct fdb_bucket copy;
+    size_t count = 0;
+    uint32_t b;
+
+    for (b = 0; b <= fdb->mask; b++)
+    {
+        atomic_uint *seq = &fdb->seq[b & fdb->seq_mask];
+        unsigned s1, s2;
+        unsigned w;
+
+        do
+        {
+            s1 = atomic_load_explicit(seq, memory_order_acquire);
+            memcpy(&copy, &fdb->buckets[b], sizeof(copy));
+            atomic_thread_fence(memory_order_acquire);
+            s2 = atomic_load_explicit(seq, memory_order_relaxed);
+        } while ((s1 & 1) || s1 != s2);
+
+        for (w = 0; w < FDB_BUCKET_WAYS; w++)
+        {
+            struct fdb_entry e;
+            uint64_t key = copy.slot[w].key;
+
+            if (!key)
+                continue;
+            e.vid = (uint16_t)((key >> 48) & 0xFFF);
+            if (vid >= 0 && e.vid != vid)
+                continue;
+            e.mac[0] = (uint8_t)(key >> 40);
+            e.mac[1] = (uint8_t)(key >> 32);
+            e.mac[2] = (uint8_t)(key >> 24);
+            e.mac[3] = (uint8_t)(key >> 16);
+            e.mac[4] = (uint8_t)(key >> 8);
+            e.mac[5] = (uint8_t)key;
+            e.port   = copy.slot[w].port;
+            e.age_s  = now_s - copy.slot[w].seen_s;
+            if ((int32_t)e.age_s < 0)
+                e.age_s = 0;
+            fn(&e, arg);
+            count++;
+        }
+    }
+    return count;
+}
+
+/**
+ * fdb_set_limit() - Learn at most @p limit entries; 0 or more than the
+ * table holds lifts the limit.  Entries already learned are kept.
+ */
+void fdb_set_limit(struct fdb *fdb, unsigned limit)
+{
+    uint32_t size = (fdb->mask + 1) * FDB_BUCKET_WAYS;
+
+    __atomic_store_n(&fdb->limit, limit && limit < size ? limit : size, __ATOMIC_RELAXED);
+}
+
+/** fdb_count() - Number of entries, for polling at a high rate. */
+unsigned fdb_count(struct fdb *fdb)
+{
+    return (unsigned)stat_load(&fdb->stats.entries);
+}
+
+void fdb_get_stats(struct fdb *fdb, struct fdb_stats *stats)
+{
+    stats->entries = stat_load(&fdb->stats.entries);
+    stats->learned = stat_load(&fdb->stats.learned);
+    stats->moves   = stat_load(&fdb->stats.moves);
+    stats->aged    = stat_load(&fdb->stats.aged);
+    stats->flushed = stat_load(&fdb->stats.flushed);
+    stats->full    = stat_load(&fdb->stats.full);
+    stats->deferred = stat_load(&fdb->stats.deferred);
+}
@@ -0,0 +1,99 @@
+/**
+ * @file fdb.h
+ * @brief Per-VLAN MAC learning table (FDB) for the user-space forwarding plane.
+ *
+ * Keys are (VLAN ID, MAC address) packed into 64 bits; the value is the
+ * forwarding plane port slot the address was last seen on.  The table is a
+ * bucketized cuckoo hash: every key has two candidate buckets of
+ * FDB_BUCKET_WAYS entries, and each bucket is exactly one 64-byte cache line,
+ * so a lookup touches at most two lines.  fdb_lookup_burst() hashes a whole
+ * burst first and prefetches every candidate bucket before probing, which
+ * overlaps the cache misses of the burst.
+ *
+ * Concurrency: every forwarding worker learns and looks up in the same
+ * table.  Changes to keys and ports are serialised by a writer lock that the
+ * fast path only ever tries (fdb_learn_burst() defers a new address rather
+ * than wait); refreshing a known address and all lookups are lock-free.
+ * Lookups and fdb_dump() are protected by striped sequence counters and
+ * retry instead of blocking, so "show mac address-table" never stalls a
+ * worker.
+ *
+ * fdb_set_limit() caps the number of entries below what the buckets hold;
+ * learning past the cap fails like learning into a full table.
+ *
+ * Aging: the buckets are split into FDB_WHEEL_SLOTS equal ranges, one per
+ * slot of a timer wheel that completes a revolution every half aging time.
+ * Each tick scans one range, so aging work is spread evenly and an idle
+ * entry is removed between 1x and 1.5x the aging time after it was last
+ * seen.
+ */
+
+#ifndef FDB_H
+#define FDB_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define FDB_BUCKET_WAYS      4
+#define FDB_DEFAULT_BUCKETS  16384          /* 64K entries, 1 MiB */
+#define FDB_DEFAULT_AGE_S    300
+#define FDB_WHEEL_SLOTS      256
+/** Lookup result for an unknown (VLAN, MAC). */
+#define FDB_PORT_NONE        0xFF
+
+struct fdb;
+
+/** One table entry as returned by fdb_dump(). */
+struct fdb_entry
+{
+    uint16_t vid;
+    uint8_t  mac[6];
+    uint8_t  port;
+    uint32_t age_s;          /**< seconds since the address was last seen */
+};
+
+struct fdb_stats
+{
+    uint64_t entries;
+    uint64_t learned;
+    uint64_t moves;          /**< station moves between ports */
+    uint64_t aged;
+    uint64_t flushed;
+    uint64_t full;           /**< learns dropped because no slot was found */
+    uint64_t deferred;       /**< learns skipped while another worker wrote */
+};
+
+typedef void (*fdb_dump_fn)(const struct fdb_entry *entry, void *arg);
+
+struct fdb *fdb_create(unsigned nbuckets, unsigned age_s);
+void fdb_destroy(struct fdb *fdb);
+
+static inline uint64_t fdb_key(uint16_t vid, const uint8_t *mac)
+{
+    return ((uint64_t)(vid & 0xFFF) << 48) |
+           ((uint64_t)mac[0] << 40) | ((uint64_t)mac[1] << 32) |
+           ((uint64_t)mac[2] << 24) | ((uint64_t)mac[3] << 16) |
+           ((uint64_t)mac[4] << 8)  |  (uint64_t)mac[5];
+}
+
+/* Forwarding workers */
+int      fdb_learn(struct fdb *fdb, uint64_t key, uint8_t port, uint32_t now_s);
+void     fdb_learn_burst(struct fdb *fdb, const uint64_t *keys, unsigned n,
+                         uint8_t port, uint32_t now_s);
+uint8_t  fdb_lookup(struct fdb *fdb, uint64_t key);
+void     fdb_lookup_burst(struct fdb *fdb, const uint64_t *keys, unsigned n,
+                          uint8_t *ports);
+unsigned fdb_age(struct fdb *fdb, uint64_t now_ms);
+unsigned fdb_flush(struct fdb *fdb, uint64_t port_mask, const uint64_t *vlans);
+unsigned fdb_flush_ports(struct fdb *fdb, uint64_t port_mask);
+unsigned fdb_flush_vlan(struct fdb *fdb, uint16_t vid);
+
+/* Reader side (any thread) */
+size_t   fdb_dump(struct fdb *fdb, int vid, uint32_t now_s, fdb_dump_fn fn, void *arg);
+unsigned fdb_count(struct fdb *fdb);
+void     fdb_get_stats(struct fdb *fdb, struct fdb_stats *stats);
+
+/* Any thread */
+void     fdb_set_limit(struct fdb *fdb, unsigned limit);
+
+#endif /* FDB_H */
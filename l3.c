@@ -0,0 +1,571 @@
+/**
+ * @file l3.c
+ * @brief Route, next hop and neighbor tables of the routing stage, and the
+ *        monitor thread that mirrors them from rtnetlink.
+ */
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <arpa/inet.h>
+#include <linux/neighbour.h>
+#include <linux/rtnetlink.h>
+#include <netlink/netlink.h>
+#include <netlink/cache.h>
+#include <netlink/route/neighbour.h>
+#include <netlink/route/route.h>
+
+#include "l3.h"
+#include "res.h"
+#include "vlan_state.h"
+
+/** Monitor poll interval; bounds shutdown latency. */
+#define L3_POLL_MS      200
+
+#define NH_INDEX_SIZE   (2 * L3_MAX_NEXTHOPS)
+#define NEIGH_VALID     (1ull << 63)
+
+/* Neighbor states the kernel would use the address in. */
+#define NUD_USABLE      (NUD_REACHABLE | NUD_STALE | NUD_DELAY | NUD_PROBE | \
+                         NUD_PERMANENT | NUD_NOARP)
+
+static pthread_mutex_t        g_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct lpm            *g_lpm;
+
+/* Next hop ID -> gateway << 16 | VLAN; 0 for an unused ID.  Never rewritten. */
+static uint64_t               g_nh[L3_MAX_NEXTHOPS];
+static unsigned               g_nnh;
+static uint32_t               g_nh_index[NH_INDEX_SIZE];  /* writer side: ID + 1 */
+
+/* Neighbors: VALID | VLAN << 32 | address -> VALID | MAC, 0 when deleted. */
+static uint64_t               g_neigh_key[L3_MAX_NEIGH];
+static uint64_t               g_neigh_mac[L3_MAX_NEIGH];
+static unsigned               g_nneigh;
+static unsigned               g_neigh_slots;
+
+static uint64_t               g_route_updates;
+static uint64_t               g_neigh_updates;
+static uint64_t               g_ignored;
+
+static struct nl_cache_mngr  *g_mngr;
+static pthread_t              g_monitor;
+static atomic_int             g_stop;
+static int                    g_following;
+
+/* ---------------------------------------------------------------------------
+ * Helpers
+ * --------------------------------------------------------------------------- */
+
+static inline uint32_t hash64(uint64_t k)
+{
+    return (uint32_t)((k * 0x9E3779B97F4A7C15ull) >> 32);
+}
+
+static inline uint64_t neigh_key(uint16_t vid, uint32_t addr)
+{
+    return NEIGH_VALID | (uint64_t)vid << 32 | addr;
+}
+
+static inline uint64_t mac48(const uint8_t *mac)
+{
+    return (uint64_t)mac[0] << 40 | (uint64_t)mac[1] << 32 | (uint64_t)mac[2] << 24 |
+           (uint64_t)mac[3] << 16 | (uint64_t)mac[4] << 8 | mac[5];
+}
+
+/* Slot of @p key, or of the empty slot ending its probe run; -1 if the table is full. */
+static int neigh_slot(uint64_t key)
+{
+    uint32_t i = hash64(key) & (L3_MAX_NEIGH - 1);
+    unsigned n;
+
+    for (n = 0; n < L3_MAX_NEIGH; n++, i = (i + 1) & (L3_MAX_NEIGH - 1))
+    {
+        uint64_t k = __atomic_load_n(&g_neigh_key[i], __ATOMIC_ACQUIRE);
+
+        if (k == key || k == 0)
+            return (int)i;
+    }
+    return -1;
+}
+
+/* MAC of @p key with NEIGH_VALID set, or 0. */
+static inline uint64_t neigh_get(uint64_t key)
+{
+    int i = neigh_slot(key);
+
+    if (i < 0 || __atomic_load_n(&g_neigh_key[i], __ATOMIC_ACQUIRE) != key)
+        return 0;
+    return __atomic_load_n(&g_neigh_mac[i], __ATOMIC_RELAXED);
+}
+
+/* Intern (@p gw, @p vid); caller holds g_lock.  Returns the ID or -ENOSPC. */
+static int nh_intern(uint32_t gw, uint16_t vid)
+{
+    uint64_t w = (uint64_t)gw << 16 | vid;
+    uint32_t i = hash64(w) & (NH_INDEX_SIZE - 1);
+
+    for (; g_nh_index[i]; i = (i + 1) & (NH_INDEX_SIZE - 1))
+    {
+        if (g_nh[g_nh_index[i] - 1] == w)
+            return (int)g_nh_index[i] - 1;
+    }
+    if (g_nnh == L3_MAX_NEXTHOPS)
+        return -ENOSPC;
+    __atomic_store_n(&g_nh[g_nnh], w, __ATOMIC_RELEASE);
+    g_nh_index[i] = ++g_nnh;
+    return (int)g_nnh - 1;
+}
+
+/* VLAN whose Vlan<id> bridge is @p ifindex, or 0. */
+static uint16_t svi_vid(int ifindex)
+{
+    const struct vlan_snapshot *snap;
+    const struct vs_link *l;
+    uint16_t vid = 0;
+
+    snap = vlan_state_read_begin();
+    if (snap && (l = vlan_snapshot_find_index(snap, ifindex)) != NULL &&
+        strncmp(l->name, "Vlan", 4) == 0)
+    {
+        long v = strtol(l->name + 4, NULL, 10);
+
+        if (v > 0 && v < VLAN_ID_SPACE && snap->bridge_ifindex[v] == ifindex)
+            vid = (uint16_t)v;
+    }
+    vlan_state_read_end();
+    return vid;
+}
+
+static int addr4(struct nl_addr *a, uint32_t *out)
+{
+    if (!a || nl_addr_get_family(a) != AF_INET || nl_addr_get_len(a) != 4)
+        return -1;
+    memcpy(out, nl_addr_get_binary_addr(a), 4);
+    *out = ntohl(*out);
+    return 0;
+}
+
+/* ---------------------------------------------------------------------------
+ * Monitor thread
+ * --------------------------------------------------------------------------- */
+
+static void route_apply(struct rtnl_route *r, int action)
+{
+    struct rtnl_nexthop *nh;
+    struct nl_addr *dst = rtnl_route_get_dst(r);
+    uint32_t prefix = 0;
+    uint32_t gw = 0;
+    uint16_t vid;
+
+    if (rtnl_route_get_family(r) != AF_INET || rtnl_route_get_table(r) != RT_TABLE_MAIN ||
+        rtnl_route_get_type(r) != RTN_UNICAST || !dst ||
+        (nl_addr_get_len(dst) && addr4(dst, &prefix) < 0))
+    {
+        g_ignored++;
+        return;
+    }
+
+    if (action == NL_ACT_DEL)
+    {
+        if (l3_route_del(prefix, nl_addr_get_prefixlen(dst)) == 0)
+            g_route_updates++;
+        return;
+    }
+
+    /* Multipath routes are left to the kernel. */
+    if (rtnl_route_get_nnexthops(r) != 1 || (nh = rtnl_route_nexthop_n(r, 0)) == NULL ||
+        (vid = svi_vid(rtnl_route_nh_get_ifindex(nh))) == 0)
+    {
+        g_ignored++;
+        return;
+    }
+    addr4(rtnl_route_nh_get_gateway(nh), &gw);
+    if (l3_route_add(prefix, nl_addr_get_prefixlen(dst), gw, vid) == 0)
+        g_route_updates++;
+}
+
+static void neigh_apply(struct rtnl_neigh *n, int action)
+{
+    struct nl_addr *ll = rtnl_neigh_get_lladdr(n);
+    uint32_t addr;
+    uint16_t vid;
+
+    if (rtnl_neigh_get_family(n) != AF_INET || addr4(rtnl_neigh_get_dst(n), &addr) < 0 ||
+        (vid = svi_vid(rtnl_neigh_get_ifindex(n))) == 0)
+    {
+        g_ignored++;
+        return;
+    }
+
+    if (action == NL_ACT_DEL || !(rtnl_neigh_get_state(n) & NUD_USABLE) ||
+        !ll || nl_addr_get_len(ll) != 6)
+        l3_neigh_del(vid, addr);
+    else
+        l3_neigh_set(vid, addr, nl_addr_get_binary_addr(ll));
+    g_neigh_updates++;
+}
+
+static void route_change_cb(struct nl_cache *cache, struct nl_object *obj, int action, void *arg)
+{
+    (void)cache;
+    (void)arg;
+    route_apply((struct rtnl_route *)obj, action);
+}
+
+static void neigh_change_cb(struct nl_cache *cache, struct nl_object *obj, int action, void *arg)
+{
+    (void)cache;
+    (void)arg;
+    neigh_apply((struct rtnl_neigh *)obj, action);
+}
+
+static void route_load(struct nl_object *obj, void *arg)
+{
+    (void)arg;
+    route_apply((struct rtnl_route *)obj, NL_ACT_NEW);
+}
+
+static void neigh_load(struct nl_object *obj, void *arg)
+{
+    (void)arg;
+    neigh_apply((struct rtnl_neigh *)obj, NL_ACT_NEW);
+}
+
+static void *monitor_main(void *arg)
+{
+    (void)arg;
+
+    while (!atomic_load(&g_stop))
+        nl_cache_mngr_poll(g_mngr, L3_POLL_MS);
+    return NULL;
+}
+
+static int monitor_start(void)
+{
+    struct nl_cache *routes;
+    struct nl_cache *neighs;
+    int err;
+
+    err = nl_cache_mngr_alloc(NULL, NETLINK_ROUTE, 0, &g_mngr);
+    if (err < 0)
+    {
+        fprintf(stderr, "l3_init: nl_cache_mngr_alloc failed: %s\n", nl_geterror(err));
+        return -EIO;
+    }
+    if ((err = nl_cache_mngr_add(g_mngr, "route/route", route_change_cb, NULL, &routes)) < 0 ||
+        (err = nl_cache_mngr_add(g_mngr, "route/neigh", neigh_change_cb, NULL, &neighs)) < 0)
+    {
+        fprintf(stderr, "l3_init: nl_cache_mngr_add failed: %s\n", nl_geterror(err));
+        nl_cache_mngr_free(g_mngr);
+        g_mngr = NULL;
+        return -EIO;
+    }
+
+    nl_cache_foreach(routes, route_load, NULL);
+    nl_cache_foreach(neighs, neigh_load, NULL);
+
+    atomic_store(&g_stop, 0);
+    if (pthread_create(&g_monitor, NULL, monitor_main, NULL) != 0)
+    {
+        nl_cache_mngr_free(g_mngr);
+        g_mngr = NULL;
+        return -ENOMEM;
+    }
+    g_following = 1;
+    return 0;
+}
+
+/* ---------------------------------------------------------------------------
+ * Public API
+ * --------------------------------------------------------------------------- */
+
+/**
+ * l3_init() - Allocate the tables and, with L3_F_FOLLOW_KERNEL, load the
+ *             kernel's routes and neighbors and start following them.
+ *
+ * Following needs the vlan_state snapshot to map bridges to VLANs.
+ *
+ * @return
+ *    0        – success. \n
+ *   -EALREADY – already initialised. \n
+ *   -ENOMEM   – the tables could not be allocated. \n
+ *   -EIO      – the Netlink cache manager could not be set up.
+ */
+int l3_init(unsigned flags)
+{
+    struct lpm *t;
+    int err;
+
+    if (g_lpm)
+        return -EALREADY;
+    t = lpm_create(L3_MAX_ROUTES, L3_MAX_GROUPS);
+    if (!t)
+        return -ENOMEM;
+
+    pthread_mutex_lock(&g_lock);
+    memset(g_nh, 0, sizeof(g_nh));
+    memset(g_nh_index, 0, sizeof(g_nh_index));
+    memset(g_neigh_key, 0, sizeof(g_neigh_key));
+    memset(g_neigh_mac, 0, sizeof(g_neigh_mac));
+    g_nnh = g_nneigh = g_neigh_slots = 0;
+    g_route_updates = g_neigh_updates = g_ignored = 0;
+    __atomic_store_n(&g_lpm, t, __ATOMIC_RELEASE);
+    pthread_mutex_unlock(&g_lock);
+
+    if (flags & L3_F_FOLLOW_KERNEL)
+    {
+        err = monitor_start();
+        if (err < 0)
+        {
+            l3_shutdown();
+            return err;
+        }
+        printf("Routing tables loaded: %u routes\n", g_lpm->nrules);
+    }
+    return 0;
+}
+
+/**
+ * l3_shutdown() - Stop following the kernel and free the tables.
+ *
+ * The forwarding plane must be stopped first.
+ */
+void l3_shutdown(void)
+{
+    struct lpm *t;
+
+    if (g_following)
+    {
+        atomic_store(&g_stop, 1);
+        pthread_join(g_monitor, NULL);
+        g_following = 0;
+    }
+    if (g_mngr)
+    {
+        nl_cache_mngr_free(g_mngr);
+        g_mngr = NULL;
+    }
+
+    pthread_mutex_lock(&g_lock);
+    t = g_lpm;
+    __atomic_store_n(&g_lpm, NULL, __ATOMIC_RELEASE);
+    res_set_used(RES_ROUTE, 0);
+    pthread_mutex_unlock(&g_lock);
+    lpm_destroy(t);
+}
+
+/** l3_running() - Non-zero while the tables exist. */
+int l3_running(void)
+{
+    return __atomic_load_n(&g_lpm, __ATOMIC_ACQUIRE) != NULL;
+}
+
+/**
+ * l3_route_add() - Route @p prefix / @p len (host order) to VLAN @p vid,
+ *                  through gateway @p gw or, if 0, directly.
+ *
+ * A new prefix takes an entry of the RES_ROUTE table (res.h); changing
+ * the next hop of a known one does not.
+ *
+ * @return 0, -ENODEV if the tables do not exist, -EINVAL for a bad length
+ *         or VLAN, or -ENOSPC if RES_ROUTE is at its capacity or the
+ *         routes or next hops are exhausted.
+ */
+int l3_route_add(uint32_t prefix, unsigned len, uint32_t gw, uint16_t vid)
+{
+    uint32_t cur;
+    int fresh;
+    int nh;
+    int err;
+
+    if (len > 32 || vid == 0 || vid >= VLAN_ID_SPACE)
+        return -EINVAL;
+    pthread_mutex_lock(&g_lock);
+    if (!g_lpm)
+    {
+        pthread_mutex_unlock(&g_lock);
+        return -ENODEV;
+    }
+    fresh = lpm_find(g_lpm, prefix, len, &cur) < 0;
+    if (fresh && (err = res_alloc(RES_ROUTE, 1)) < 0)
+    {
+        pthread_mutex_unlock(&g_lock);
+        return err;
+    }
+    if ((nh = nh_intern(gw, vid)) < 0)
+        err = nh;
+    else
+        err = lpm_add(g_lpm, prefix, len, (uint32_t)nh);
+    if (err < 0 && fresh)
+        res_free(RES_ROUTE, 1);
+    pthread_mutex_unlock(&g_lock);
+    return err;
+}
+
+/** l3_route_del() - Remove a route; 0, -ENODEV or -ENOENT. */
+int l3_route_del(uint32_t prefix, unsigned len)
+{
+    int err;
+
+    pthread_mutex_lock(&g_lock);
+    err = g_lpm ? lpm_delete(g_lpm, prefix, len) : -ENODEV;
+    if (err == 0)
+        res_free(RES_ROUTE, 1);
+    pthread_mutex_unlock(&g_lock);
+    return err == -EINVAL ? -ENOENT : err;
+}
+
+/**
+ * l3_neigh_set() - Resolve @p addr (host order) in VLAN @p vid to @p mac.
+ *
+ * @return 0, -EINVAL for a bad VLAN, or -ENOSPC if every slot holds a
+ *         neighbor or a deleted one.
+ */
+int l3_neigh_set(uint16_t vid, uint32_t addr, const uint8_t *mac)
+{
+    uint64_t key = neigh_key(vid, addr);
+    int i;
+
+    if (vid == 0 || vid >= VLAN_ID_SPACE)
+        return -EINVAL;
+    pthread_mutex_lock(&g_lock);
+    i = neigh_slot(key);
+    if (i >= 0)
+    {
+        if (!(g_neigh_mac[i] & NEIGH_VALID))
+            g_nneigh++;
+        __atomic_store_n(&g_neigh_mac[i], NEIGH_VALID | mac48(mac), __ATOMIC_RELAXED);
+        if (g_neigh_key[i] == 0)
+        {
+            __atomic_store_n(&g_neigh_key[i], key, __ATOMIC_RELEASE);
+            g_neigh_slots++;
+        }
+    }
+    pthread_mutex_unlock(&g_lock);
+    return i < 0 ? -ENOSPC : 0;
+}
+
+/** l3_neigh_del() - Forget a neighbor; 0 or -ENOENT. */
+int l3_neigh_del(uint16_t vid, uint32_t addr)
+{
+    uint64_t key = neigh_key(vid, addr);
+    int err = -ENOENT;
+    int i;
+
+    pthread_mutex_lock(&g_lock);
+    i = neigh_slot(key);
+    if (i >= 0 && g_neigh_key[i] == key && (g_neigh_mac[i] & NEIGH_VALID))
+    {
+        __atomic_store_n(&g_neigh_mac[i], 0, __ATOMIC_RELAXED);
+        g_nneigh--;
+        err = 0;
+    }
+    pthread_mutex_unlock(&g_lock);
+    return err;
+}
+
+/**
+ * l3_resolve_burst() - Route @p n (at most 64) destination addresses.
+ *
+ * For address i that has a route whose next hop (the gateway, or the
+ * address itself on a connected route) has a neighbor entry, bit i of the
+ * result is set and vid[i] / mac[i] receive the egress VLAN and the MAC
+ * (low 48 bits) to send to.  Called by the forwarding workers.
+ */
+uint64_t l3_resolve_burst(const uint32_t *dst, unsigned n, uint16_t *vid, uint64_t *mac)
+{
+    const struct lpm *t = __atomic_load_n(&g_lpm, __ATOMIC_ACQUIRE);
+    uint32_t nh[64];
+    uint64_t miss;
+    uint64_t ok = 0;
+    unsigned i;
+
+    if (!t)
+        return 0;
+    lpm_lookup_burst(t, dst, n, nh, &miss);
+
+    for (i = 0; i < n && i < 64; i++)
+    {
+        uint64_t w, m;
+        uint32_t gw;
+
+        if (miss & (1ull << i))
+            continue;
+        w = __atomic_load_n(&g_nh[nh[i]], __ATOMIC_ACQUIRE);
+        gw = (uint32_t)(w >> 16);
+        m = neigh_get(neigh_key((uint16_t)(w & 0xFFFF), gw ? gw : dst[i]));
+        if (!(m & NEIGH_VALID))
+            continue;
+        vid[i] = (uint16_t)(w & 0xFFFF);
+        mac[i] = m & 0xFFFFFFFFFFFFull;
+        ok |= 1ull << i;
+    }
+    return ok;
+}
+
+struct route_walk
+{
+    l3_route_fn fn;
+    void       *arg;
+};
+
+static void route_walk_one(uint32_t prefix, unsigned depth, uint32_t nh, void *arg)
+{
+    struct route_walk *rw = arg;
+
+    rw->fn(prefix, depth, (uint32_t)(g_nh[nh] >> 16), (uint16_t)(g_nh[nh] & 0xFFFF), rw->arg);
+}
+
+/** l3_route_walk() - Call @p fn for every route, under the table lock. */
+void l3_route_walk(l3_route_fn fn, void *arg)
+{
+    struct route_walk rw = { fn, arg };
+
+    pthread_mutex_lock(&g_lock);
+    if (g_lpm)
+        lpm_walk(g_lpm, route_walk_one, &rw);
+    pthread_mutex_unlock(&g_lock);
+}
+
+/** l3_neigh_walk() - Call @p fn for every resolved neighbor, under the table lock. */
+void l3_neigh_walk(l3_neigh_fn fn, void *arg)
+{
+    uint8_t mac[6];
+    unsigned i, b;
+
+    pthread_mutex_lock(&g_lock);
+    for (i = 0; i < L3_MAX_NEIGH; i++)
+    {
+        if (!g_neigh_key[i] || !(g_neigh_mac[i] & NEIGH_VALID))
+            continue;
+        for (b = 0; b < 6; b++)
+            mac[b] = (uint8_t)(g_neigh_mac[i] >> (40 - 8 * b));
+        fn((uint32_t)g_neigh_key[i], (uint16_t)((g_neigh_key[i] >> 32) & 0xFFF), mac, arg);
+    }
+    pthread_mutex_unlock(&g_lock);
+}
+
+/** l3_get_stats() - Table sizes and mirror counters; -ENODEV if not running. */
+int l3_get_stats(struct l3_stats *stats)
+{
+    memset(stats, 0, sizeof(*stats));
+    pthread_mutex_lock(&g_lock);
+    if (!g_lpm)
+    {
+        pthread_mutex_unlock(&g_lock);
+        return -ENODEV;
+    }
+    stats->routes        = g_lpm->nrules;
+    stats->nexthops      = g_nnh;
+    stats->neighbors     = g_nneigh;
+    stats->neigh_slots   = g_neigh_slots;
+    stats->route_updates = g_route_updates;
+    stats->neigh_updates = g_neigh_updates;
+    stats->ignored       = g_ignored;
+    lpm_get_stats(g_lpm, &stats->lpm);
+    pthread_mutex_unlock(&g_lock);
+    return 0;
+}
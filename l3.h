@@ -0,0 +1,73 @@
+/**
+ * @file l3.h
+ * @brief Routing stage tables: IPv4 routes, next hops and neighbors of the
+ *        Vlan<id> SVIs, mirrored from the kernel.
+ *
+ * Routes live in a DIR-24-8 table (lpm.h) whose values are next hop IDs.
+ * A next hop is a (gateway, VLAN) pair, gateway 0 for a connected route,
+ * and is interned once and never freed, so an ID read by a forwarding
+ * worker always means the same thing.  Neighbors are kept by (VLAN, IPv4
+ * address) in an open-addressing table of 64-bit words a reader loads
+ * atomically; a deleted neighbor keeps its key with an invalid MAC.
+ *
+ * With L3_F_FOLLOW_KERNEL a monitor thread mirrors the main routing table
+ * (RTM_NEWROUTE / RTM_DELROUTE) and the ARP table (RTM_NEWNEIGH /
+ * RTM_DELNEIGH) through a libnl cache manager.  Only unicast routes
+ * leaving through a Vlan<id> bridge, and neighbors on one, are mirrored;
+ * the bridge is mapped to its VLAN with the vlan_state snapshot.  Without
+ * the flag the tables are filled with l3_route_add() / l3_neigh_set()
+ * (tests and benchmarks).  Either way, one thread writes at a time (the
+ * tables take a lock) and the forwarding workers read without one.
+ */
+
+#ifndef L3_H
+#define L3_H
+
+#include <stdint.h>
+
+#include "lpm.h"
+
+/** Routes the table holds. */
+#define L3_MAX_ROUTES      (1u << 20)
+/** /24s that may hold routes longer than /24. */
+#define L3_MAX_GROUPS      (1u << 14)
+/** Distinct (gateway, VLAN) next hops. */
+#define L3_MAX_NEXTHOPS    (1u << 16)
+/** Neighbor table slots, deleted neighbors included. */
+#define L3_MAX_NEIGH       (1u << 16)
+
+/** Mirror routes and neighbors from the kernel. */
+#define L3_F_FOLLOW_KERNEL 0x1
+
+struct l3_stats
+{
+    unsigned routes;
+    unsigned nexthops;
+    unsigned neighbors;
+    unsigned neigh_slots;       /**< occupied slots, deleted ones included */
+    uint64_t route_updates;     /**< mirrored route adds and deletes */
+    uint64_t neigh_updates;
+    uint64_t ignored;           /**< not unicast IPv4, or not on an SVI */
+    struct lpm_stats lpm;
+};
+
+/** Callbacks for l3_route_walk() and l3_neigh_walk(); addresses in host order. */
+typedef void (*l3_route_fn)(uint32_t prefix, unsigned len, uint32_t gw, uint16_t vid, void *arg);
+typedef void (*l3_neigh_fn)(uint32_t addr, uint16_t vid, const uint8_t *mac, void *arg);
+
+int  l3_init(unsigned flags);
+void l3_shutdown(void);
+int  l3_running(void);
+
+int  l3_route_add(uint32_t prefix, unsigned len, uint32_t gw, uint16_t vid);
+int  l3_route_del(uint32_t prefix, unsigned len);
+int  l3_neigh_set(uint16_t vid, uint32_t addr, const uint8_t *mac);
+int  l3_neigh_del(uint16_t vid, uint32_t addr);
+
+uint64_t l3_resolve_burst(const uint32_t *dst, unsigned n, uint16_t *vid, uint64_t *mac);
+
+void l3_route_walk(l3_route_fn fn, void *arg);
+void l3_neigh_walk(l3_neigh_fn fn, void *arg);
+int  l3_get_stats(struct l3_stats *stats);
+
+#endif /* L3_H */
@@ -0,0 +1,210 @@
+/**
+ * @file lag.c
+ * @brief LAG flow hashing and member tables (see lag.h).
+ *
+ * The hash is MurmurHash3's 32-bit block mix over the selected fields,
+ * taken as 32-bit words, and its finalizer, so that the low bits used to
+ * index the member table depend on every input bit.
+ */
+
+#include <errno.h>
+#include <string.h>
+
+#include "lag.h"
+
+static const char *const g_hash_names[] = { "l2", "l3", "l4" };
+
+/* ---------------------------------------------------------------------------
+ * Helpers
+ * --------------------------------------------------------------------------- */
+
+static inline uint32_t rotl32(uint32_t v, unsigned n)
+{
+    return v << n | v >> (32 - n);
+}
+
+static inline uint32_t mix(uint32_t h, uint32_t v)
+{
+    v *= 0xCC9E2D51u;
+    v = rotl32(v, 15);
+    v *= 0x1B873593u;
+    h ^= v;
+    h = rotl32(h, 13);
+    return h * 5 + 0xE6546B64u;
+}
+
+static inline uint32_t fmix(uint32_t h)
+{
+    h ^= h >> 16;
+    h *= 0x85EBCA6Bu;
+    h ^= h >> 13;
+    h *= 0xC2B2AE35u;
+    h ^= h >> 16;
+    return h;
+}
+
+static inline uint32_t word(const uint8_t *p)
+{
+    uint32_t v;
+
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+/* Mix the @p n words at @p p into @p h. */
+static uint32_t mix_words(uint32_t h, const uint8_t *p, unsigned n)
+{
+    while (n--)
+    {
+        h = mix(h, word(p));
+        p += 4;
+    }
+    return h;
+}
+
+/* ---------------------------------------------------------------------------
+ * Public API
+ * --------------------------------------------------------------------------- */
+
+/**
+ * lag_hash_name() - CLI name of hash policy @p mode.
+ */
+const char *lag_hash_name(unsigned mode)
+{
+    return mode <= LAG_HASH_L4 ? g_hash_names[mode] : "?";
+}
+
+/**
+ * lag_hash_parse() - Hash policy named @p name ("l2", "l3" or "l4"), or
+ * -EINVAL.
+ */
+int lag_hash_parse(const char *name)
+{
+    unsigned m;
+
+    for (m = 0; m <= LAG_HASH_L4; m++)
+    {
+        if (strcmp(name, g_hash_names[m]) == 0)
+            return (int)m;
+    }
+    return -EINVAL;
+}
+
+/**
+ * lag_hash() - Flow hash of Ethernet frame @p frame under policy @p mode.
+ *
+ * One 802.1Q / 802.1ad tag is skipped.  Fields past @p len are left out,
+ * so truncated frames still hash consistently.
+ */
+uint32_t lag_hash(const uint8_t *frame, size_t len, unsigned mode)
+{
+    const uint8_t *l3;
+    size_t off = 12;
+    uint16_t type;
+    uint32_t h;
+    uint8_t proto;
+
+    if (len < 14)
+        return 0;
+    h = mix_words(0, frame, 3);
+    type = (uint16_t)(frame[off] << 8 | frame[off + 1]);
+    if ((type == 0x8100 || type == 0x88A8) && len >= 18)
+    {
+        off += 4;
+        type = (uint16_t)(frame[off] << 8 | frame[off + 1]);
+    }
+    h = mix(h, type);
+    off += 2;
+    if (mode == LAG_HASH_L2)
+        return fmix(h);
+
+    l3 = frame + off;
+    if (type == 0x0800 && len >= off + 20 && (l3[0] >> 4) == 4)
+    {
+        size_t ihl = (size_t)(l3[0] & 0x0F) * 4;
+
+        h = mix_words(h, l3 + 12, 2);
+        proto = l3[9];
+        /* Only the first fragment has the ports; hash none of them by ports
+         * so that all fragments of a packet take the same member. */
+        if ((l3[6] & 0x3F) || l3[7] || ihl < 20)
+            return fmix(h);
+        off += ihl;
+    }
+    else if (type == 0x86DD && len >= off + 40 && (l3[0] >> 4) == 6)
+    {
+        h = mix_words(h, l3 + 8, 8);
+        proto = l3[6];
+        off += 40;
+    }
+    else
+    {
+        return fmix(h);
+    }
+
+    if (mode == LAG_HASH_L4 && (proto == 6 || proto == 17 || proto == 132) && len >= off + 4)
+        h = mix(h, word(frame + off));
+    return fmix(h);
+}
+
+/**
+ * lag_table_build() - Share @p t evenly among the @p nup members in @p up.
+ *
+ * Entry i goes to up[i % nup], so with n members each owns
+ * LAG_TABLE_SIZE / n entries, give or take one.  @p nup 0 makes
+ * lag_select() fail.
+ */
+void lag_table_build(struct lag_table *t, const uint8_t *up, unsigned nup)
+{
+    unsigned i;
+
+    if (nup == 0)
+    {
+        __atomic_store_n(&t->nup, 0, __ATOMIC_RELAXED);
+        return;
+    }
+    for (i = 0; i < LAG_TABLE_SIZE; i++)
+        __atomic_store_n(&t->member[i], up[i % nup], __ATOMIC_RELAXED);
+    __atomic_store_n(&t->nup, (uint8_t)nup, __ATOMIC_RELAXED);
+}
+
+/**
+ * lag_table_remove() - Take @p member out of @p t, whose other members are
+ * the @p nup in @p up.
+ *
+ * Only the entries of @p member change; each goes to the survivor owning
+ * the fewest entries at that point, so survivors that were within one
+ * entry of each other stay so.
+ */
+void lag_table_remove(struct lag_table *t, uint8_t member, const uint8_t *up, unsigned nup)
+{
+    unsigned owned[LAG_TABLE_SIZE];
+    unsigned i, j;
+
+    if (nup == 0)
+    {
+        __atomic_store_n(&t->nup, 0, __ATOMIC_RELAXED);
+        return;
+    }
+    for (j = 0; j < nup; j++)
+    {
+        owned[j] = 0;
+        for (i = 0; i < LAG_TABLE_SIZE; i++)
+            owned[j] += t->member[i] == up[j];
+    }
+    for (i = 0; i < LAG_TABLE_SIZE; i++)
+    {
+        unsigned least = 0;
+
+        if (t->member[i] != member)
+            continue;
+        for (j = 1; j < nup; j++)
+        {
+            if (owned[j] < owned[least])
+                least = j;
+        }
+        owned[least]++;
+        __atomic_store_n(&t->member[i], up[least], __ATOMIC_RELAXED);
+    }
+    __atomic_store_n(&t->nup, (uint8_t)nup, __ATOMIC_RELAXED);
+}
@@ -0,0 +1,63 @@
+/**
+ * @file lag.h
+ * @brief Link aggregation: flow hashing and the member table that maps a
+ *        hash to an egress member port.
+ *
+ * A LAG sends every frame of a flow through the same member so the flow
+ * stays in order, and spreads different flows over all members that are
+ * up.  The flow is identified by a hash over the fields of one of three
+ * policies: source and destination MAC and EtherType (l2), plus IPv4 /
+ * IPv6 source and destination address (l3), plus TCP / UDP / SCTP ports of
+ * unfragmented packets (l4).  Frames a policy cannot look into hash by the
+ * fields it found.
+ *
+ * Member selection is one load: a lag_table of LAG_TABLE_SIZE entries
+ * precomputed so that each member that is up owns an equal share, indexed
+ * by the low bits of the hash.  When a member goes down,
+ * lag_table_remove() hands only that member's entries to the survivors,
+ * so flows on the other members keep their path and the change is a few
+ * byte stores that readers may observe half-done.  Bringing a member (back)
+ * up rebuilds the table evenly with lag_table_build().
+ *
+ * Members are opaque 8-bit ids chosen by the caller (port table slots).
+ */
+
+#ifndef LAG_H
+#define LAG_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/** Hash policies. */
+#define LAG_HASH_L2      0
+#define LAG_HASH_L3      1
+#define LAG_HASH_L4      2
+
+/** Member ports of one LAG. */
+#define LAG_MAX_MEMBERS  16
+/** Entries of a member table; a power of two. */
+#define LAG_TABLE_SIZE   256
+
+/** Hash -> member map; @c nup 0: no member is up. */
+struct lag_table
+{
+    uint8_t nup;
+    uint8_t member[LAG_TABLE_SIZE];
+};
+
+/** Member for flow hash @p hash, or -1 if none is up; lock-free. */
+static inline int lag_select(const struct lag_table *t, uint32_t hash)
+{
+    if (!__atomic_load_n(&t->nup, __ATOMIC_RELAXED))
+        return -1;
+    return __atomic_load_n(&t->member[hash & (LAG_TABLE_SIZE - 1)], __ATOMIC_RELAXED);
+}
+
+const char *lag_hash_name(unsigned mode);
+int  lag_hash_parse(const char *name);
+uint32_t lag_hash(const uint8_t *frame, size_t len, unsigned mode);
+
+void lag_table_build(struct lag_table *t, const uint8_t *up, unsigned nup);
+void lag_table_remove(struct lag_table *t, uint8_t member, const uint8_t *up, unsigned nup);
+
+#endif /* LAG_H */
@@ -0,0 +1,243 @@
+/**
+ * @file lag_bond.c
+ * @brief Kernel bonding devices for link aggregation (see lag_bond.h).
+ *
+ * Requests name the bond and its members by IFLA_IFNAME wherever the
+ * kernel allows it, so the bond created by the first message of a batch
+ * can be brought up by the second.  Only enslaving needs the bond's
+ * ifindex, for IFLA_MASTER.
+ */
+
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <linux/if_bonding.h>
+#include <linux/if_link.h>
+#include <linux/rtnetlink.h>
+#include <netlink/attr.h>
+#include <netlink/msg.h>
+#include <netlink/netlink.h>
+
+#include "lag.h"
+#include "lag_bond.h"
+#include "nl_batch.h"
+#include "vlan_api.h"    /* NL_CALL_RET */
+#include "vlan_state.h"
+
+/** Requests of the longest batch: member down, enslave, member up. */
+#define LAG_BOND_MAX_MSGS   3
+
+static const uint8_t g_policy[] =
+{
+    [LAG_HASH_L2] = BOND_XMIT_POLICY_LAYER2,
+    [LAG_HASH_L3] = BOND_XMIT_POLICY_LAYER23,
+    [LAG_HASH_L4] = BOND_XMIT_POLICY_LAYER34,
+};
+
+/* ---------------------------------------------------------------------------
+ * Helpers
+ * --------------------------------------------------------------------------- */
+
+static int link_ifindex(const char *name)
+{
+    struct ifreq ifr;
+    int ifindex;
+    int fd;
+
+    if ((ifindex = vlan_state_lookup_ifindex(name)) > 0)
+        return ifindex;
+    if ((fd = socket(AF_INET, SOCK_DGRAM, 0)) < 0)
+        return -1;
+    memset(&ifr, 0, sizeof(ifr));
+    strncpy(ifr.ifr_name, name, IFNAMSIZ - 1);
+    ifindex = ioctl(fd, SIOCGIFINDEX, &ifr) < 0 ? -1 : ifr.ifr_ifindex;
+    close(fd);
+    return ifindex;
+}
+
+/* RTM_NEWLINK / RTM_DELLINK for link @p name, changing IFF_UP to @p up
+ * (-1: leave it). */
+static struct nl_msg *link_msg(int type, int flags, const char *name, int up)
+{
+    struct nl_msg *m = nlmsg_alloc_simple(type, flags);
+    struct ifinfomsg ifi;
+
+    if (!m)
+        return NULL;
+    memset(&ifi, 0, sizeof(ifi));
+    ifi.ifi_family = AF_UNSPEC;
+    if (up >= 0)
+    {
+        ifi.ifi_flags = up ? IFF_UP : 0;
+        ifi.ifi_change = IFF_UP;
+    }
+    if (nlmsg_append(m, &ifi, sizeof(ifi), NLMSG_ALIGNTO) < 0 ||
+        nla_put_string(m, IFLA_IFNAME, name) < 0)
+    {
+        nlmsg_free(m);
+        return NULL;
+    }
+    return m;
+}
+
+static struct nl_msg *bond_msg(const char *name, unsigned hash)
+{
+    struct nl_msg *m = link_msg(RTM_NEWLINK, NLM_F_CREATE | NLM_F_EXCL, name, -1);
+    struct nlattr *info, *data;
+
+    if (!m)
+        return NULL;
+    if (!(info = nla_nest_start(m, IFLA_LINKINFO)) ||
+        nla_put_string(m, IFLA_INFO_KIND, "bond") < 0 ||
+        !(data = nla_nest_start(m, IFLA_INFO_DATA)) ||
+        nla_put_u8(m, IFLA_BOND_MODE, BOND_MODE_XOR) < 0 ||
+        nla_put_u8(m, IFLA_BOND_XMIT_HASH_POLICY, g_policy[hash]) < 0 ||
+        nla_put_u32(m, IFLA_BOND_MIIMON, LAG_BOND_MIIMON_MS) < 0)
+    {
+        nlmsg_free(m);
+        return NULL;
+    }
+    nla_nest_end(m, data);
+    nla_nest_end(m, info);
+    return m;
+}
+
+static struct nl_msg *master_msg(const char *port, int master)
+{
+    struct nl_msg *m = link_msg(RTM_NEWLINK, 0, port, -1);
+
+    if (m && nla_put_u32(m, IFLA_MASTER, (uint32_t)master) < 0)
+    {
+        nlmsg_free(m);
+        return NULL;
+    }
+    return m;
+}
+
+/*
+ * run() - Send the @p n requests in @p m as one batch.
+ *
+ * @return 0, the first request's error, or -ENOMEM; every message is
+ *         consumed.
+ */
+static int run(struct nl_msg **m, unsigned n, const char *what)
+{
+    int status[LAG_BOND_MAX_MSGS];
+    struct nl_batch *b = nl_batch_alloc();
+    unsigned i;
+    int err = b ? 0 : -ENOMEM;
+    int _nl_err;
+
+    for (i = 0; i < n; i++)
+    {
+        if (err == 0 && !m[i])
+            err = -ENOMEM;
+        if (err == 0)
+            err = nl_batch_add(b, m[i], &status[i]);
+        else
+            nlmsg_free(m[i]);
+    }
+    if (err == 0)
+    {
+        NL_CALL_RET(_nl_err, nl_batch_commit(b), "nl_batch_commit", "batch=%p (%s)",
+                    (void *)b, what);
+        (void)_nl_err;
+        for (i = 0; i < n && err == 0; i++)
+            err = status[i];
+    }
+    nl_batch_free(b);
+    return err;
+}
+
+/* ---------------------------------------------------------------------------
+ * Public API
+ * --------------------------------------------------------------------------- */
+
+/**
+ * lag_bond_create() - Create bond @p name with hash policy @p hash and
+ * bring it up.
+ *
+ * @return 0, -EINVAL for a bad name or policy, -EEXIST if a link of that
+ *         name exists, -EOPNOTSUPP without kernel bonding, -ENOMEM, or the
+ *         kernel's negative errno.
+ */
+int lag_bond_create(const char *name, unsigned hash)
+{
+    struct nl_msg *m[2];
+
+    if (!name || !*name || strlen(name) >= IFNAMSIZ || hash > LAG_HASH_L4)
+        return -EINVAL;
+    if (link_ifindex(name) > 0)
+        return -EEXIST;
+
+    m[0] = bond_msg(name, hash);
+    m[1] = link_msg(RTM_NEWLINK, 0, name, 1);
+    return run(m, 2, "bond create");
+}
+
+/**
+ * lag_bond_delete() - Delete bond @p name; its members are released.
+ *
+ * @return 0, -ENOENT if there is no such link, or the kernel's errno.
+ */
+int lag_bond_delete(const char *name)
+{
+    struct nl_msg *m[1];
+
+    if (!name || link_ifindex(name) < 0)
+        return -ENOENT;
+    m[0] = link_msg(RTM_DELLINK, 0, name, -1);
+    return run(m, 1, "bond delete");
+}
+
+/**
+ * lag_bond_add_port() - Enslave @p port to bond @p name.
+ *
+ * The port is taken down for the kernel to accept it and brought up
+ * again; it leaves any bridge (VLAN) it was a member of.
+ *
+ * @return 0, -ENOENT if either link is missing, or the kernel's errno.
+ */
+int lag_bond_add_port(const char *name, const char *port)
+{
+    struct nl_msg *m[3];
+    int bond;
+
+    if (!name || !port || (bond = link_ifindex(name)) < 0 || link_ifindex(port) < 0)
+        return -ENOENT;
+
+    m[0] = link_msg(RTM_NEWLINK, 0, port, 0);
+    m[1] = master_msg(port, bond);
+    m[2] = link_msg(RTM_NEWLINK, 0, port, 1);
+    return run(m, 3, "bond enslave");
+}
+
+/**
+ * lag_bond_del_port() - Release @p port from bond @p name.
+ *
+ * @return 0, -ENOENT if either link is missing or the link snapshot shows
+ *         @p port enslaved elsewhere, or the kernel's errno.
+ */
+int lag_bond_del_port(const char *name, const char *port)
+{
+    const struct vlan_snapshot *snap;
+    const struct vs_link *l;
+    struct nl_msg *m[1];
+    int bond;
+    int other;
+
+    if (!name || !port || (bond = link_ifindex(name)) < 0 || link_ifindex(port) < 0)
+        return -ENOENT;
+    snap = vlan_state_read_begin();
+    l = snap ? vlan_snapshot_find_name(snap, port) : NULL;
+    other = l && l->master != bond;
+    vlan_state_read_end();
+    if (other)
+        return -ENOENT;
+
+    m[0] = master_msg(port, 0);
+    return run(m, 1, "bond release");
+}
@@ -0,0 +1,28 @@
+/**
+ * @file lag_bond.h
+ * @brief Link aggregation on the kernel bridge backend, as bonding devices.
+ *
+ * Without the user-space forwarding plane a LAG is a kernel bond in
+ * balance-xor mode, whose transmit hash policy follows the LAG's lag.h
+ * policy (l2: layer2, l3: layer2+3, l4: layer3+4) and whose MII monitor
+ * takes a member with no carrier out of the hash within LAG_BOND_MIIMON_MS.
+ * The bond is an ordinary link, so it joins VLANs like any port.  Every
+ * call sends its requests as one nl_batch.h batch: creating a bond and
+ * bringing it up, or taking a member down, enslaving it and bringing it
+ * back up, costs one round trip.
+ *
+ * Kernels built without bonding refuse the bond with -EOPNOTSUPP.
+ */
+
+#ifndef LAG_BOND_H
+#define LAG_BOND_H
+
+/** Link monitoring interval of the bonds. */
+#define LAG_BOND_MIIMON_MS  100
+
+int lag_bond_create(const char *name, unsigned hash);
+int lag_bond_delete(const char *name);
+int lag_bond_add_port(const char *name, const char *port);
+int lag_bond_del_port(const char *name, const char *port);
+
+#endif /* LAG_BOND_H */
@@ -0,0 +1,101 @@
+/**
+ * @file line_buf.c
+ * @brief Reassembly of newline-terminated text commands (see line_buf.h).
+ */
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "line_buf.h"
+
+/* Terminate the line at @p len, strip trailing CRs and hand it over. */
+static void emit(char *line, size_t len, line_fn fn, void *arg)
+{
+    while (len > 0 && line[len - 1] == '\r')
+        len--;
+    line[len] = '\0';
+    if (len > 0)
+        fn(line, arg);
+}
+
+/**
+ * line_buf_feed() - Append @p n bytes and pass every completed line to @p fn.
+ *
+ * Blank lines are skipped.  Lines are handed over in order, before the call
+ * returns; the bytes after the last newline stay in @p lb.
+ *
+ * @return
+ *    0          – success. \n
+ *   -ENOMEM     – the tail could not be stored; @p lb is unchanged. \n
+ *   -EMSGSIZE   – the tail reached LINE_BUF_MAX bytes without a newline and
+ *                 was discarded.
+ */
+int line_buf_feed(struct line_buf *lb, const char *data, size_t n,
+                  line_fn fn, void *arg)
+{
+    char *line;
+    char *search;
+    char *end;
+    char *nl;
+
+    /* One spare byte so the tail can always be NUL-terminated. */
+    if (lb->len + n + 1 > lb->cap)
+    {
+        size_t cap = lb->cap ? lb->cap : 256;
+        char *nb;
+
+        while (cap < lb->len + n + 1)
+            cap *= 2;
+        nb = realloc(lb->buf, cap);
+        if (!nb)
+            return -ENOMEM;
+        lb->buf = nb;
+        lb->cap = cap;
+    }
+    memcpy(lb->buf + lb->len, data, n);
+
+    line   = lb->buf;
+    search = lb->buf + lb->len;     /* the old tail holds no newline */
+    end    = search + n;
+
+    while ((nl = memchr(search, '\n', (size_t)(end - search))) != NULL)
+    {
+        emit(line, (size_t)(nl - line), fn, arg);
+        line = search = nl + 1;
+    }
+
+    lb->len = (size_t)(end - line);
+    memmove(lb->buf, line, lb->len);
+
+    if (lb->len >= LINE_BUF_MAX)
+    {
+        lb->len = 0;
+        return -EMSGSIZE;
+    }
+    return 0;
+}
+
+/**
+ * line_buf_flush() - Pass the unterminated tail, if any, to @p fn as a line.
+ *
+ * For transports that preserve message boundaries, where the end of a
+ * message also ends the command in it.
+ */
+void line_buf_flush(struct line_buf *lb, line_fn fn, void *arg)
+{
+    size_t len = lb->len;
+
+    lb->len = 0;
+    if (len > 0)
+        emit(lb->buf, len, fn, arg);
+}
+
+/** line_buf_free() - Release the buffer; @p lb is empty and reusable. */
+void line_buf_free(struct line_buf *lb)
+{
+    free(lb->buf);
+    lb->buf = NULL;
+    lb->len = 0;
+    lb->cap = 0;
+}
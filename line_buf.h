@@ -0,0 +1,37 @@
+/**
+ * @file line_buf.h
+ * @brief Reassembly of newline-terminated text commands from a byte stream.
+ *
+ * A stream socket may split a command over several reads or pack several
+ * commands into one.  line_buf_feed() appends what was read and hands every
+ * complete line to a callback; the unterminated tail is kept until a later
+ * read completes it.  Trailing CRs are stripped, so "\r\n" clients work too.
+ *
+ * A line_buf is zero-initialised and allocates on first use.  It is not
+ * thread-safe; its user serializes.
+ */
+
+#ifndef LINE_BUF_H
+#define LINE_BUF_H
+
+#include <stddef.h>
+
+/** Longest line accepted, terminator included. */
+#define LINE_BUF_MAX 65536
+
+struct line_buf
+{
+    char   *buf;
+    size_t  len;     /* bytes of the unterminated tail */
+    size_t  cap;
+};
+
+/** Receives one line, NUL-terminated and without its CR/LF; may modify it. */
+typedef void (*line_fn)(char *line, void *arg);
+
+int  line_buf_feed(struct line_buf *lb, const char *data, size_t n,
+                   line_fn fn, void *arg);
+void line_buf_flush(struct line_buf *lb, line_fn fn, void *arg);
+void line_buf_free(struct line_buf *lb);
+
+#endif /* LINE_BUF_H */
@@ -0,0 +1,278 @@
+/**
+ * @file link_attr.c
+ * @brief Batched link attribute changes over interface sets (see link_attr.h).
+ */
+
+#include <ctype.h>
+#include <errno.h>
+#include <fnmatch.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <linux/if_link.h>
+#include <linux/rtnetlink.h>
+#include <netlink/attr.h>
+#include <netlink/msg.h>
+#include <netlink/netlink.h>
+
+#include "link_attr.h"
+#include "nl_batch.h"
+#include "vlan_api.h"    /* NL_CALL_RET */
+#include "vlan_state.h"
+
+/* What one interface of the set is to become. */
+struct link_work
+{
+    int      ifindex;                 /* 0 if the interface does not exist */
+    unsigned flags;
+    unsigned mtu;
+};
+
+/* ---------------------------------------------------------------------------
+ * Helpers
+ * --------------------------------------------------------------------------- */
+
+static int is_pattern(const char *spec)
+{
+    return strpbrk(spec, "*?[") != NULL;
+}
+
+/*
+ * Split range "<prefix><first>-<last>" into the prefix length and its
+ * bounds.  Returns 1 for a range, 0 if @p spec is none, -EINVAL for a
+ * range that is reversed, too long or makes names too long.
+ */
+static int parse_range(const char *spec, size_t *plen, unsigned long *first, unsigned long *last)
+{
+    const char *dash = strrchr(spec, '-');
+    const char *p;
+    char *end;
+
+    if (!dash || dash == spec || !isdigit((unsigned char)dash[-1]) ||
+        !isdigit((unsigned char)dash[1]))
+        return 0;
+    for (p = dash; p > spec && isdigit((unsigned char)p[-1]); p--)
+        ;
+    if (p == spec)
+        return 0;
+
+    *plen = (size_t)(p - spec);
+    *first = strtoul(p, NULL, 10);
+    *last = strtoul(dash + 1, &end, 10);
+    if (*end)
+        return 0;
+    if (*last < *first || *last - *first >= LINK_ATTR_MAX_IFACES ||
+        *plen + (size_t)snprintf(NULL, 0, "%lu", *last) >= IFNAMSIZ)
+        return -EINVAL;
+    return 1;
+}
+
+/* Record interface @p l (NULL: @p name does not exist) as the next member
+ * of the set, with the attributes of @p a that it does not have yet. */
+static void add_member(struct link_result *r, struct link_work *w, const char *name,
+                       const struct vs_link *l, const struct link_attrs *a)
+{
+    snprintf(r->name, sizeof(r->name), "%s", name);
+    if (!l)
+    {
+        r->status = -ENODEV;
+        return;
+    }
+    w->ifindex = l->ifindex;
+    w->flags = l->flags;
+    w->mtu = l->mtu;
+    if ((a->set & LINK_ATTR_ADMIN) && !(l->flags & IFF_UP) != !a->up)
+    {
+        r->changed |= LINK_ATTR_ADMIN;
+        w->flags = a->up ? l->flags | IFF_UP : l->flags & ~(unsigned)IFF_UP;
+    }
+    if ((a->set & LINK_ATTR_MTU) && l->mtu != a->mtu)
+    {
+        r->changed |= LINK_ATTR_MTU;
+        w->mtu = a->mtu;
+    }
+    if ((a->set & LINK_ATTR_ALIAS) && strcmp(l->alias, a->alias) != 0)
+        r->changed |= LINK_ATTR_ALIAS;
+}
+
+/* Expand @p spec against @p snap into @p r / @p w; the member count or
+ * -errno. */
+static int expand(const struct vlan_snapshot *snap, const char *spec, const struct link_attrs *a,
+                  struct link_result *r, struct link_work *w)
+{
+    const struct vs_link *l = vlan_snapshot_find_name(snap, spec);
+    unsigned long first, last, i;
+    char name[IFNAMSIZ];
+    size_t plen;
+    int n = 0;
+    int err;
+
+    if (!l && is_pattern(spec))
+    {
+        for (i = 0; i < snap->nlinks && n < LINK_ATTR_MAX_IFACES; i++)
+        {
+            if (fnmatch(spec, snap->links[i].name, 0) == 0)
+            {
+                add_member(&r[n], &w[n], snap->links[i].name, &snap->links[i], a);
+                n++;
+            }
+        }
+        return n ? n : -ENODEV;
+    }
+
+    if (!l && (err = parse_range(spec, &plen, &first, &last)) != 0)
+    {
+        if (err < 0)
+            return err;
+        for (i = first; i <= last; i++)
+        {
+            snprintf(name, sizeof(name), "%.*s%lu", (int)plen, spec, i);
+            add_member(&r[n], &w[n], name, vlan_snapshot_find_name(snap, name), a);
+            n++;
+        }
+        return n;
+    }
+
+    if (strlen(spec) >= IFNAMSIZ)
+        return -EINVAL;
+    add_member(r, w, spec, l, a);
+    return 1;
+}
+
+static struct nl_msg *link_msg(int ifindex, unsigned changed, const struct link_attrs *a)
+{
+    struct nl_msg *m = nlmsg_alloc_simple(RTM_NEWLINK, 0);
+    struct ifinfomsg ifi;
+
+    if (!m)
+        return NULL;
+    memset(&ifi, 0, sizeof(ifi));
+    ifi.ifi_family = AF_UNSPEC;
+    ifi.ifi_index = ifindex;
+    if (changed & LINK_ATTR_ADMIN)
+    {
+        ifi.ifi_change = IFF_UP;
+        ifi.ifi_flags = a->up ? IFF_UP : 0;
+    }
+    /* The kernel applies the MTU before the flags of the same request. */
+    if (nlmsg_append(m, &ifi, sizeof(ifi), NLMSG_ALIGNTO) < 0 ||
+        ((changed & LINK_ATTR_MTU) && nla_put_u32(m, IFLA_MTU, a->mtu) < 0) ||
+        ((changed & LINK_ATTR_ALIAS) && nla_put(m, IFLA_IFALIAS, (int)strlen(a->alias), a->alias) < 0))
+    {
+        nlmsg_free(m);
+        return NULL;
+    }
+    return m;
+}
+
+/* ---------------------------------------------------------------------------
+ * Public API
+ * --------------------------------------------------------------------------- */
+
+/**
+ * link_attr_is_multi() - Nonzero if @p spec is a range or a pattern rather
+ * than one interface name.
+ */
+int link_attr_is_multi(const char *spec)
+{
+    size_t plen;
+    unsigned long first, last;
+
+    return spec && (is_pattern(spec) || parse_range(spec, &plen, &first, &last) != 0);
+}
+
+/**
+ * link_attr_set() - Give every interface of set @p spec the attributes of
+ * @p a, sending only those that differ, in one batch.
+ *
+ * A name that exists is taken literally even if it looks like a range.
+ * On success *@p res holds one result per interface of the set, in range
+ * order or, for a pattern, ifindex order; the caller frees it.
+ *
+ * @return the number of interfaces, or
+ *    -EINVAL      – nothing or an unknown attribute to set, MTU 0, alias
+ *                   not shorter than VS_ALIAS_LEN, or a bad range. \n
+ *    -ENODEV      – the pattern matches no interface, or no link snapshot. \n
+ *    -ENOMEM      – out of memory.
+ *   Each result's status tells whether its interface was changed.
+ */
+int link_attr_set(const char *spec, const struct link_attrs *a, struct link_result **res)
+{
+    const struct vlan_snapshot *snap;
+    struct link_result *r, *shrunk;
+    struct link_work *w;
+    struct vs_note *notes = NULL;
+    struct nl_batch *nl = NULL;
+    size_t nnotes = 0;
+    int i, n;
+
+    if (!spec || !a || !res || !a->set || (a->set & ~(LINK_ATTR_ADMIN | LINK_ATTR_MTU | LINK_ATTR_ALIAS)) ||
+        ((a->set & LINK_ATTR_MTU) && a->mtu == 0) ||
+        ((a->set & LINK_ATTR_ALIAS) && !memchr(a->alias, '\0', sizeof(a->alias))))
+        return -EINVAL;
+    *res = NULL;
+
+    r = calloc(LINK_ATTR_MAX_IFACES, sizeof(*r));
+    w = calloc(LINK_ATTR_MAX_IFACES, sizeof(*w));
+    if (!r || !w)
+    {
+        n = -ENOMEM;
+        goto out;
+    }
+
+    snap = vlan_state_read_begin();
+    n = snap ? expand(snap, spec, a, r, w) : -ENODEV;
+    vlan_state_read_end();
+    if (n < 0)
+        goto out;
+
+    if ((nl = nl_batch_alloc()) == NULL || (notes = calloc((size_t)n, sizeof(*notes))) == NULL)
+    {
+        n = -ENOMEM;
+        goto out;
+    }
+    for (i = 0; i < n; i++)
+    {
+        int err;
+
+        if (!r[i].changed)
+            continue;
+        if ((err = nl_batch_add(nl, link_msg(w[i].ifindex, r[i].changed, a), &r[i].status)) < 0)
+            r[i].status = err;
+    }
+    if (nl_batch_pending(nl))
+    {
+        size_t pending = nl_batch_pending(nl);
+        int err;
+
+        NL_CALL_RET(err, nl_batch_commit(nl), "nl_batch_commit", "batch=%p, links=%zu",
+                    (void *)nl, pending);
+        (void)err;
+    }
+
+    /* Compare the next command against what the kernel accepted now. */
+    for (i = 0; i < n; i++)
+    {
+        if (!r[i].changed || r[i].status < 0)
+            continue;
+        notes[nnotes].op      = VS_NOTE_LINK;
+        notes[nnotes].ifindex = w[i].ifindex;
+        notes[nnotes].flags   = w[i].flags;
+        notes[nnotes].mtu     = w[i].mtu;
+        notes[nnotes].alias   = (r[i].changed & LINK_ATTR_ALIAS) ? a->alias : NULL;
+        nnotes++;
+    }
+    vlan_state_note_many(notes, nnotes);
+
+    /* Hand out the results, shrunk to the set if possible. */
+    shrunk = realloc(r, (size_t)n * sizeof(*r));
+    *res = shrunk ? shrunk : r;
+    r = NULL;
+
+out:
+    nl_batch_free(nl);
+    free(notes);
+    free(w);
+    free(r);
+    return n;
+}
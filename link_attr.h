@@ -0,0 +1,55 @@
+/**
+ * @file link_attr.h
+ * @brief Admin state, MTU and alias of many interfaces in one Netlink batch.
+ *
+ * An interface set is named by one word: a plain name ("Ethernet4"), a
+ * range of numbered names ("Ethernet0-63": Ethernet0 .. Ethernet63), or a
+ * shell pattern matched against the existing interfaces ("Ethernet*",
+ * "Ethernet[0-3]?").  Bringing up a switch sets the same attributes on
+ * dozens of ports, and most of them often hold the value already, so the
+ * wanted attributes are compared with the published link snapshot
+ * (vlan_state.h) first: an interface gets one RTM_NEWLINK carrying only
+ * the attributes that differ, an interface that needs nothing gets no
+ * request, and all requests go out as one nl_batch.h batch.  Changes the
+ * kernel accepted are recorded in the snapshot right away, so a following
+ * command compares against them even before the kernel's notification.
+ */
+
+#ifndef LINK_ATTR_H
+#define LINK_ATTR_H
+
+#include <stddef.h>
+#include <linux/if.h>
+
+#include "vlan_state.h"  /* VS_ALIAS_LEN */
+
+/** Interfaces a range or pattern may name. */
+#define LINK_ATTR_MAX_IFACES  4096
+
+/** struct link_attrs.set / struct link_result.changed bits. */
+#define LINK_ATTR_ADMIN  0x1
+#define LINK_ATTR_MTU    0x2
+#define LINK_ATTR_ALIAS  0x4
+
+/** Attributes to set; only those with their bit in @c set are touched. */
+struct link_attrs
+{
+    unsigned set;
+    int      up;                      /**< LINK_ATTR_ADMIN: 1 up, 0 down */
+    unsigned mtu;                     /**< LINK_ATTR_MTU */
+    char     alias[VS_ALIAS_LEN];     /**< LINK_ATTR_ALIAS; "" clears it */
+};
+
+/** Outcome for one interface of the set. */
+struct link_result
+{
+    char     name[IFNAMSIZ];
+    unsigned changed;                 /**< attributes sent, 0 if none differed */
+    int      status;                  /**< 0, or -errno (-ENODEV: no such
+                                           interface in a range) */
+};
+
+int link_attr_is_multi(const char *spec);
+int link_attr_set(const char *spec, const struct link_attrs *a, struct link_result **res);
+
+#endif /* LINK_ATTR_H */
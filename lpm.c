@@ -0,0 +1,458 @@
+/**
+ * @file lpm.c
+ * @brief DIR-24-8 table: incremental add / delete, group folding and
+ *        burst lookup.
+ */
+
+#define _GNU_SOURCE     /* MAP_HUGETLB, MADV_HUGEPAGE */
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+
+#include "lpm.h"
+
+#define TBL24_ENTRIES  (1u << 24)
+#define HUGEPAGE       (2u << 20)
+
+struct lpm_rule
+{
+    uint32_t prefix;
+    uint32_t nh;
+    uint8_t  depth;
+    uint8_t  used;
+};
+
+static inline uint32_t depth_mask(unsigned depth)
+{
+    return depth ? ~0u << (32 - depth) : 0;
+}
+
+static inline uint32_t entry(unsigned depth, uint32_t nh)
+{
+    return LPM_E_VALID | (uint32_t)depth << 24 | nh;
+}
+
+static inline void entry_store(uint32_t *p, uint32_t e)
+{
+    __atomic_store_n(p, e, __ATOMIC_RELEASE);
+}
+
+static void *map_table(size_t len, int *hugepages)
+{
+    void *p;
+
+    p = mmap(NULL, len, PROT_READ | PROT_WRITE,
+             MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+    *hugepages = p != MAP_FAILED;
+    if (p == MAP_FAILED)
+    {
+        p = mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (p == MAP_FAILED)
+            return NULL;
+        madvise(p, len, MADV_HUGEPAGE);
+    }
+    return p;
+}
+
+/* ---------------------------------------------------------------------------
+ * Rules
+ * --------------------------------------------------------------------------- */
+
+static inline uint32_t rule_hash(const struct lpm *t, uint32_t prefix, unsigned depth)
+{
+    return ((prefix ^ depth) * 0x9E3779B1u) >> 7 & t->rules_mask;
+}
+
+static struct lpm_rule *rule_find(const struct lpm *t, uint32_t prefix, unsigned depth)
+{
+    uint32_t i = rule_hash(t, prefix, depth);
+
+    for (; t->rules[i].used; i = (i + 1) & t->rules_mask)
+    {
+        if (t->rules[i].prefix == prefix && t->rules[i].depth == depth)
+            return &t->rules[i];
+    }
+    return NULL;
+}
+
+/* Longest rule shorter than @p depth that covers @p prefix, as a table entry (0: none). */
+static uint32_t rule_cover(const struct lpm *t, uint32_t prefix, unsigned depth)
+{
+    const struct lpm_rule *r;
+
+    while (depth-- > 0)
+    {
+        if (t->depth_rules[depth] &&
+            (r = rule_find(t, prefix & depth_mask(depth), depth)) != NULL)
+            return entry(depth, r->nh);
+    }
+    return 0;
+}
+
+/* Remove @p r, shifting later members of its probe run back (no tombstones). */
+static void rule_remove(struct lpm *t, struct lpm_rule *r)
+{
+    uint32_t hole = (uint32_t)(r - t->rules);
+    uint32_t i = hole;
+
+    for (;;)
+    {
+        uint32_t home;
+
+        i = (i + 1) & t->rules_mask;
+        if (!t->rules[i].used)
+            break;
+        home = rule_hash(t, t->rules[i].prefix, t->rules[i].depth);
+        /* Move it if its home is not cyclically within (hole, i]. */
+        if (((i - home) & t->rules_mask) >= ((i - hole) & t->rules_mask))
+        {
+            t->rules[hole] = t->rules[i];
+            hole = i;
+        }
+    }
+    t->rules[hole].used = 0;
+}
+
+/* ---------------------------------------------------------------------------
+ * Groups
+ * --------------------------------------------------------------------------- */
+
+static int group_alloc(struct lpm *t, uint32_t *g)
+{
+    if (t->fifo_len == 0)
+        return -ENOSPC;
+    *g = t->group_fifo[t->fifo_head];
+    t->fifo_head = (t->fifo_head + 1) % t->ngroups;
+    t->fifo_len--;
+    return 0;
+}
+
+static void group_free(struct lpm *t, uint32_t g)
+{
+    t->group_fifo[(t->fifo_head + t->fifo_len) % t->ngroups] = g;
+    t->fifo_len++;
+}
+
+/* Fold the group behind tbl24[@p idx] back into tbl24 if its entries are all equal. */
+static void group_fold(struct lpm *t, uint32_t idx)
+{
+    uint32_t g = LPM_E_NH(t->tbl24[idx]);
+    const uint32_t *e = &t->tbl8[(size_t)g * 256];
+    unsigned i;
+
+    for (i = 1; i < 256; i++)
+    {
+        if (e[i] != e[0])
+            return;
+    }
+    if ((e[0] & LPM_E_VALID) && LPM_E_DEPTH(e[0]) > 24)
+        return;
+    entry_store(&t->tbl24[idx], e[0]);
+    group_free(t, g);
+}
+
+/* Set entries [@p from, @p from + @p n) of @p tbl that hold a prefix no longer than @p depth. */
+static void fill_shorter(uint32_t *tbl, size_t from, size_t n, unsigned depth, uint32_t e)
+{
+    size_t i;
+
+    for (i = from; i < from + n; i++)
+    {
+        if (!(tbl[i] & LPM_E_VALID) || LPM_E_DEPTH(tbl[i]) <= depth)
+            entry_store(&tbl[i], e);
+    }
+}
+
+/* Set entries of @p tbl in range that hold exactly @p depth. */
+static void fill_equal(uint32_t *tbl, size_t from, size_t n, unsigned depth, uint32_t e)
+{
+    size_t i;
+
+    for (i = from; i < from + n; i++)
+    {
+        if ((tbl[i] & LPM_E_VALID) && LPM_E_DEPTH(tbl[i]) == depth)
+            entry_store(&tbl[i], e);
+    }
+}
+
+/* ---------------------------------------------------------------------------
+ * Public API
+ * --------------------------------------------------------------------------- */
+
+/**
+ * lpm_create() - Allocate a table for @p max_rules prefixes of which at most
+ *                @p ngroups distinct /24s hold prefixes longer than /24.
+ *
+ * tbl24 takes 64 MB and is backed by hugepages when they are reserved;
+ * each group takes LPM_GROUP_SIZE.
+ *
+ * @return the table, or NULL if an argument is 0 or memory is unavailable.
+ */
+struct lpm *lpm_create(unsigned max_rules, unsigned ngroups)
+{
+    struct lpm *t;
+    uint32_t size = 1;
+    int huge8;
+    unsigned i;
+
+    if (max_rules == 0 || ngroups == 0 || ngroups > LPM_NH_MAX + 1)
+        return NULL;
+    t = calloc(1, sizeof(*t));
+    if (!t)
+        return NULL;
+
+    while (size < 2 * max_rules)
+        size <<= 1;
+    t->rules_mask = size - 1;
+    t->max_rules = max_rules;
+    t->ngroups = ngroups;
+    t->tbl24_len = (size_t)TBL24_ENTRIES * sizeof(uint32_t);
+    t->tbl8_len = ((size_t)ngroups * LPM_GROUP_SIZE + HUGEPAGE - 1) & ~((size_t)HUGEPAGE - 1);
+
+    t->rules = calloc(size, sizeof(*t->rules));
+    t->group_fifo = calloc(ngroups, sizeof(*t->group_fifo));
+    t->tbl24 = map_table(t->tbl24_len, &t->hugepages);
+    t->tbl8 = map_table(t->tbl8_len, &huge8);
+    if (!t->rules || !t->group_fifo || !t->tbl24 || !t->tbl8)
+    {
+        lpm_destroy(t);
+        return NULL;
+    }
+
+    for (i = 0; i < ngroups; i++)
+        t->group_fifo[i] = i;
+    t->fifo_len = ngroups;
+    return t;
+}
+
+void lpm_destroy(struct lpm *t)
+{
+    if (!t)
+        return;
+    if (t->tbl24)
+        munmap(t->tbl24, t->tbl24_len);
+    if (t->tbl8)
+        munmap(t->tbl8, t->tbl8_len);
+    free(t->group_fifo);
+    free(t->rules);
+    free(t);
+}
+
+/**
+ * lpm_add() - Add @p prefix / @p depth (host order) with next hop @p nh,
+ *             or change the next hop of an existing prefix.
+ *
+ * Host bits of @p prefix are ignored.
+ *
+ * @return
+ *    0        – success. \n
+ *   -EINVAL   – @p depth above 32 or @p nh above LPM_NH_MAX. \n
+ *   -ENOSPC   – the rule table or the tbl8 groups are full; the table is
+ *               unchanged.
+ */
+int lpm_add(struct lpm *t, uint32_t prefix, unsigned depth, uint32_t nh)
+{
+    struct lpm_rule *r;
+    uint32_t e;
+
+    if (depth > 32 || nh > LPM_NH_MAX)
+        return -EINVAL;
+    prefix &= depth_mask(depth);
+    e = entry(depth, nh);
+
+    r = rule_find(t, prefix, depth);
+    if (!r)
+    {
+        uint32_t i;
+
+        if (t->nrules == t->max_rules)
+            return -ENOSPC;
+        if (depth > 24 && !(t->tbl24[prefix >> 8] & LPM_E_EXT) && t->fifo_len == 0)
+            return -ENOSPC;
+        for (i = rule_hash(t, prefix, depth); t->rules[i].used; i = (i + 1) & t->rules_mask)
+            ;
+        r = &t->rules[i];
+        r->prefix = prefix;
+        r->depth = (uint8_t)depth;
+        r->used = 1;
+        t->nrules++;
+        t->depth_rules[depth]++;
+    }
+    r->nh = nh;
+
+    if (depth <= 24)
+    {
+        uint32_t idx = prefix >> 8;
+        uint32_t n = 1u << (24 - depth);
+        uint32_t i;
+
+        for (i = idx; i < idx + n; i++)
+        {
+            uint32_t cur = t->tbl24[i];
+
+            if (cur & LPM_E_EXT)
+                fill_shorter(t->tbl8, (size_t)LPM_E_NH(cur) * 256, 256, depth, e);
+            else if (!(cur & LPM_E_VALID) || LPM_E_DEPTH(cur) <= depth)
+                entry_store(&t->tbl24[i], e);
+        }
+    }
+    else
+    {
+        uint32_t idx = prefix >> 8;
+        uint32_t cur = t->tbl24[idx];
+        uint32_t g;
+
+        if (cur & LPM_E_EXT)
+        {
+            g = LPM_E_NH(cur);
+        }
+        else
+        {
+            unsigned i;
+
+            group_alloc(t, &g);
+            for (i = 0; i < 256; i++)
+                t->tbl8[(size_t)g * 256 + i] = cur;
+        }
+        fill_shorter(t->tbl8, (size_t)g * 256 + (prefix & 0xFF), 1u << (32 - depth), depth, e);
+        if (!(cur & LPM_E_EXT))
+            entry_store(&t->tbl24[idx], LPM_E_VALID | LPM_E_EXT | g);
+    }
+    return 0;
+}
+
+/**
+ * lpm_delete() - Remove @p prefix / @p depth.
+ *
+ * Addresses it covered fall back to the next shorter prefix covering them.
+ *
+ * @return 0, -EINVAL if @p depth is above 32, or -ENOENT if the prefix is
+ *         not in the table.
+ */
+int lpm_delete(struct lpm *t, uint32_t prefix, unsigned depth)
+{
+    struct lpm_rule *r;
+    uint32_t cover;
+
+    if (depth > 32)
+        return -EINVAL;
+    prefix &= depth_mask(depth);
+    r = rule_find(t, prefix, depth);
+    if (!r)
+        return -ENOENT;
+    rule_remove(t, r);
+    t->nrules--;
+    t->depth_rules[depth]--;
+    cover = rule_cover(t, prefix, depth);
+
+    if (depth <= 24)
+    {
+        uint32_t idx = prefix >> 8;
+        uint32_t n = 1u << (24 - depth);
+        uint32_t i;
+
+        for (i = idx; i < idx + n; i++)
+        {
+            uint32_t cur = t->tbl24[i];
+
+            if (cur & LPM_E_EXT)
+            {
+                fill_equal(t->tbl8, (size_t)LPM_E_NH(cur) * 256, 256, depth, cover);
+                group_fold(t, i);
+            }
+            else if ((cur & LPM_E_VALID) && LPM_E_DEPTH(cur) == depth)
+            {
+                entry_store(&t->tbl24[i], cover);
+            }
+        }
+    }
+    else
+    {
+        uint32_t idx = prefix >> 8;
+        uint32_t g = LPM_E_NH(t->tbl24[idx]);
+
+        fill_equal(t->tbl8, (size_t)g * 256 + (prefix & 0xFF), 1u << (32 - depth), depth, cover);
+        group_fold(t, idx);
+    }
+    return 0;
+}
+
+/**
+ * lpm_find() - Exact match of @p prefix / @p depth (not a lookup).
+ *
+ * @return 0 and *@p nh, or -ENOENT.
+ */
+int lpm_find(const struct lpm *t, uint32_t prefix, unsigned depth, uint32_t *nh)
+{
+    const struct lpm_rule *r;
+
+    if (depth > 32)
+        return -ENOENT;
+    r = rule_find(t, prefix & depth_mask(depth), depth);
+    if (!r)
+        return -ENOENT;
+    *nh = r->nh;
+    return 0;
+}
+
+/** lpm_walk() - Call @p fn for every prefix, in no particular order. */
+void lpm_walk(const struct lpm *t, lpm_walk_fn fn, void *arg)
+{
+    uint32_t i;
+
+    for (i = 0; i <= t->rules_mask; i++)
+    {
+        if (t->rules[i].used)
+            fn(t->rules[i].prefix, t->rules[i].depth, t->rules[i].nh, arg);
+    }
+}
+
+/**
+ * lpm_lookup_burst() - lpm_lookup() for @p n (at most 64) addresses.
+ *
+ * All tbl24 entries are loaded before any group is, so the cache misses of
+ * a burst overlap.  Bit i of *@p miss is set if address i has no route.
+ */
+void lpm_lookup_burst(const struct lpm *t, const uint32_t *addr, unsigned n, uint32_t *nh,
+                      uint64_t *miss)
+{
+    uint32_t e[64];
+    uint64_t m = 0;
+    unsigned i;
+
+    if (n > 64)
+        n = 64;
+    for (i = 0; i < n; i++)
+        __builtin_prefetch(&t->tbl24[addr[i] >> 8]);
+    for (i = 0; i < n; i++)
+    {
+        e[i] = __atomic_load_n(&t->tbl24[addr[i] >> 8], __ATOMIC_ACQUIRE);
+        if (e[i] & LPM_E_EXT)
+            __builtin_prefetch(&t->tbl8[(size_t)LPM_E_NH(e[i]) * 256 + (addr[i] & 0xFF)]);
+    }
+    for (i = 0; i < n; i++)
+    {
+        if (e[i] & LPM_E_EXT)
+            e[i] = __atomic_load_n(&t->tbl8[(size_t)LPM_E_NH(e[i]) * 256 + (addr[i] & 0xFF)],
+                                   __ATOMIC_RELAXED);
+        if (e[i] & LPM_E_VALID)
+            nh[i] = LPM_E_NH(e[i]);
+        else
+            m |= 1ull << i;
+    }
+    *miss = m;
+}
+
+void lpm_get_stats(const struct lpm *t, struct lpm_stats *stats)
+{
+    memset(stats, 0, sizeof(*stats));
+    stats->rules       = t->nrules;
+    stats->max_rules   = t->max_rules;
+    stats->groups      = t->ngroups;
+    stats->groups_used = t->ngroups - t->fifo_len;
+    stats->bytes       = t->tbl24_len + t->tbl8_len
+                       + (uint64_t)(t->rules_mask + 1) * sizeof(struct lpm_rule);
+    stats->hugepages   = t->hugepages;
+}
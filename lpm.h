@@ -0,0 +1,105 @@
+/**
+ * @file lpm.h
+ * @brief DIR-24-8 IPv4 longest-prefix-match table.
+ *
+ * The top 24 bits of an address index tbl24 (2^24 entries); an entry holds
+ * either the next hop of the longest prefix of length 24 or less covering
+ * that /24, or the index of a 256-entry tbl8 group that resolves the last
+ * 8 bits for /24s with longer prefixes.  A lookup is therefore one, at
+ * most two, memory reads, whatever the number of prefixes.
+ *
+ * Every entry records the length of the prefix it came from, so prefixes
+ * can be added and deleted one at a time: an add only overwrites entries
+ * of shorter prefixes, a delete restores the next shorter prefix covering
+ * the deleted one, found in the table of rules kept next to the arrays.  A
+ * group whose 256 entries become equal again is folded back into tbl24.
+ *
+ * One thread at a time may modify the table; lookups run concurrently
+ * without locks.  Every change is a single 32-bit store, and a new group is
+ * filled before tbl24 points at it.  A freed group goes to the back of a
+ * FIFO and is reused only after every other free group, which leaves a
+ * lookup that read its tbl24 entry just before the fold ample time to
+ * finish.
+ */
+
+#ifndef LPM_H
+#define LPM_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/** Largest next hop value. */
+#define LPM_NH_MAX       0xFFFFFFu
+/** Bytes of one tbl8 group. */
+#define LPM_GROUP_SIZE   (256 * sizeof(uint32_t))
+
+#define LPM_E_VALID      0x80000000u
+#define LPM_E_EXT        0x40000000u      /* tbl24 only: low bits are a group */
+#define LPM_E_DEPTH(e)   (((e) >> 24) & 0x3F)
+#define LPM_E_NH(e)      ((e) & LPM_NH_MAX)
+
+struct lpm_rule;
+
+struct lpm
+{
+    uint32_t        *tbl24;
+    uint32_t        *tbl8;
+    size_t           tbl24_len;     /* mapping sizes */
+    size_t           tbl8_len;
+    int              hugepages;
+
+    uint32_t         ngroups;
+    uint32_t        *group_fifo;    /* free groups, oldest first */
+    uint32_t         fifo_head;
+    uint32_t         fifo_len;
+
+    struct lpm_rule *rules;         /* open addressing, linear probing */
+    uint32_t         rules_mask;
+    uint32_t         max_rules;
+    uint32_t         nrules;
+    uint32_t         depth_rules[33];
+};
+
+struct lpm_stats
+{
+    unsigned rules;
+    unsigned max_rules;
+    unsigned groups_used;
+    unsigned groups;
+    uint64_t bytes;          /**< tbl24, tbl8 and the rule table */
+    int      hugepages;      /**< 1 if tbl24 is on 2 MB hugepages */
+};
+
+/** Callback for lpm_walk(). */
+typedef void (*lpm_walk_fn)(uint32_t prefix, unsigned depth, uint32_t nh, void *arg);
+
+struct lpm *lpm_create(unsigned max_rules, unsigned ngroups);
+void        lpm_destroy(struct lpm *t);
+
+int   lpm_add(struct lpm *t, uint32_t prefix, unsigned depth, uint32_t nh);
+int   lpm_delete(struct lpm *t, uint32_t prefix, unsigned depth);
+int   lpm_find(const struct lpm *t, uint32_t prefix, unsigned depth, uint32_t *nh);
+void  lpm_walk(const struct lpm *t, lpm_walk_fn fn, void *arg);
+void  lpm_get_stats(const struct lpm *t, struct lpm_stats *stats);
+
+void  lpm_lookup_burst(const struct lpm *t, const uint32_t *addr, unsigned n, uint32_t *nh,
+                       uint64_t *miss);
+
+/**
+ * lpm_lookup() - Next hop of the longest prefix covering @p addr (host order).
+ *
+ * @return 0 and *@p nh, or -1 if no prefix covers @p addr.
+ */
+static inline int lpm_lookup(const struct lpm *t, uint32_t addr, uint32_t *nh)
+{
+    uint32_t e = __atomic_load_n(&t->tbl24[addr >> 8], __ATOMIC_ACQUIRE);
+
+    if (e & LPM_E_EXT)
+        e = __atomic_load_n(&t->tbl8[(size_t)LPM_E_NH(e) * 256 + (addr & 0xFF)], __ATOMIC_RELAXED);
+    if (!(e & LPM_E_VALID))
+        return -1;
+    *nh = LPM_E_NH(e);
+    return 0;
+}
+
+#endif /* LPM_H */
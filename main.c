@@ -1,9 +1,17 @@
+#define _GNU_SOURCE     /* struct ucred for SO_PEERCRED */
+
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
 #include <arpa/inet.h>
+#include <ctype.h>
+#include <errno.h>
 #include <fcntl.h>
+#include <getopt.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdarg.h>
 #include <sys/ioctl.h>
 #include <time.h>
 #include <linux/netlink.h>      /* keep only one copy */
@@ -18,12 +26,61 @@
 #include <netlink/route/link.h>
 #include <netlink/route/link/vlan.h>
 #include <sys/socket.h>
+#include <sys/stat.h>
 #include <sys/types.h>
+#include <sys/un.h>
 
 #include "vlan_api.h"    /* NL_CALL_RET, NL_CALL_VOID, VLAN API */
+#include "cmd_sched.h"   /* keyed worker pool */
+#include "vlan_state.h"  /* lock-free link/VLAN snapshot */
+#include "ctl_proto.h"   /* binary control protocol */
+#include "line_buf.h"    /* text command reassembly */
+#include "cfg_load.h"    /* bulk configuration loader */
+#include "dataplane.h"   /* user-space forwarding plane */
+#include "l3.h"          /* routing stage tables */
+#include "tc_storm.h"    /* storm control on the kernel bridges */
+#include "br_mdb.h"      /* IGMP / MLD snooping on the kernel bridges */
+#include "lag_bond.h"    /* link aggregation on the kernel bridges */
+#include "tc_xlate.h"    /* VLAN translation on the kernel bridges */
+#include "res.h"         /* table capacities and alarms */
+#include "br_fdb.h"      /* static MACs and flushes on the kernel bridges */
+#include "link_attr.h"   /* batched link attributes over interface ranges */
 
 #define PORT 8888
-#define BUFFER_SIZE 1024
+#define BUFFER_SIZE 65536
+#define MAX_CLIENTS 64
+#define UNIX_SOCKET_PATH "/run/virtasic.sock"
+
+/* Fixed slots at the front of the poll set: the listeners, then the
+ * resource alarm eventfd; clients follow. */
+#define LISTEN_TCP   0
+#define LISTEN_UNIX  1
+#define NUM_LISTENERS 2
+#define RES_EVENTS   2
+#define NUM_FIXED    3
+
+/* Per-connection state; the protocol is chosen by the first byte received. */
+enum client_proto
+{
+    CLIENT_PROTO_UNKNOWN = 0,
+    CLIENT_PROTO_TEXT,
+    CLIENT_PROTO_BINARY,
+};
+
+struct client
+{
+    enum client_proto proto;
+    uint8_t *buf;        /* binary frame reassembly */
+    size_t   len;
+    size_t   cap;
+    struct vbp_conn *conn;  /* binary client: reply channel of its batches */
+    struct line_buf  line;  /* text client: command split across reads */
+    int      record;     /* SOCK_SEQPACKET: a message also ends its command */
+    int      alarms;     /* text client subscribed to resource alarms */
+};
+
+/* -v: log every command and binary batch as it is received. */
+static int g_verbose;
 
 /* Forward declarations */
 int get_words(const char* str, char*** words, int* cnt);
@@ -32,6 +89,50 @@ int cmd_rename_interfaces(char* prefix, char* new_prefix);
 int cmd_show_vlan();
 int cmd_set_vlan_on_interface(char* iface, char* type, char* ver);
 int cmd_set_vlan(char* ver, char* id);
+int cmd_show_scheduler();
+int cmd_exec(const char *path);
+int cmd_show_dataplane();
+int cmd_show_mac_address_table(int vid);
+int cmd_show_ip_route();
+int cmd_show_ip_neighbors();
+int cmd_acl_rule(char **words, int cnt);
+int cmd_acl_default(const char *name, const char *action);
+int cmd_no_acl(const char *name, const char *seq);
+int cmd_bind_acl(const char *name, const char *kind, const char *target);
+int cmd_show_acl();
+int cmd_storm_control(char **words, int cnt);
+int cmd_no_storm_control(const char *kind, const char *target, const char *cls);
+int cmd_show_storm_control();
+int cmd_vlan_translation(const char *port, const char *cvids, const char *vid);
+int cmd_show_vlan_translation();
+int cmd_multicast_snooping(const char *vlan, int on);
+int cmd_show_multicast_groups();
+int cmd_create_lag(const char *name, const char *hash);
+int cmd_delete_lag(const char *name);
+int cmd_lag_member(const char *port, const char *lag, int add);
+int cmd_show_lag();
+int cmd_create_mirror(char **words, int cnt);
+int cmd_delete_mirror(const char *name);
+int cmd_mirror_source(const char *name, const char *kind, const char *target, const char *dir);
+int cmd_show_mirror();
+int cmd_sflow_enable(char **words, int cnt);
+int cmd_sflow_disable();
+int cmd_sflow_port(const char *port, const char *rate);
+int cmd_sflow_vlan(const char *vid, int on);
+int cmd_show_sflow();
+int cmd_packet_trace(char **words, int cnt);
+int cmd_packet_trace_sample(const char *port, const char *rate);
+int cmd_show_packet_trace();
+int cmd_resource(const char *table, const char *what, const char *a, const char *b);
+int cmd_show_resources();
+int cmd_bridge_fdb_static(const char *mac, const char *vlan, const char *port, const char *count,
+                          int add);
+int cmd_bridge_fdb_flush(char **words, int cnt);
+int cmd_show_bridge_fdb(char **words, int cnt);
+int cmd_set_interface_attr(char **words, int cnt);
+int cmd_vlan_member(const char *vlan, const char *iface, int add);
+int cmd_show_interfaces_counters();
+int cmd_show_vlan_counters();
 int nl_create_vlan_subif(const char *iface_name, int vlan_id);
 
 /*
@@ -419,18 +520,173 @@ void process_command(const char *cmd)
         cmd_rename_interfaces(cmd_words[2], cmd_words[3]);
     }
     }
+    /* show interfaces counters */
+    else if (strcmp(cmd, "show interfaces counters") == 0)
+    {
+        printf("Executing: %s\n", cmd);
+        cmd_show_interfaces_counters();
+    }
     /* show vlan */
     else if (strcmp(cmd, "show vlan") == 0)
     {
         printf("Executing: %s\n", cmd);
         cmd_show_vlan();
     }
+    /* show vlan counters */
+    else if (strcmp(cmd, "show vlan counters") == 0)
+    {
+        printf("Executing: %s\n", cmd);
+        cmd_show_vlan_counters();
+    }
+    /* show scheduler */
+    else if (strcmp(cmd, "show scheduler") == 0)
+    {
+        printf("Executing: %s\n", cmd);
+        cmd_show_scheduler();
+    }
+    /* show dataplane */
+    else if (strcmp(cmd, "show dataplane") == 0)
+    {
+        printf("Executing: %s\n", cmd);
+        cmd_show_dataplane();
+    }
+    /* show ip route */
+    else if (strcmp(cmd, "show ip route") == 0)
+    {
+        printf("Executing: %s\n", cmd);
+        cmd_show_ip_route();
+    }
+    /* show ip neighbors */
+    else if (strcmp(cmd, "show ip neighbors") == 0)
+    {
+        printf("Executing: %s\n", cmd);
+        cmd_show_ip_neighbors();
+    }
+    /* show acl */
+    else if (strcmp(cmd, "show acl") == 0)
+    {
+        printf("Executing: %s\n", cmd);
+        cmd_show_acl();
+    }
+    /* show storm-control */
+    else if (strcmp(cmd, "show storm-control") == 0)
+    {
+        printf("Executing: %s\n", cmd);
+        cmd_show_storm_control();
+    }
+    /* show vlan translation */
+    else if (strcmp(cmd, "show vlan translation") == 0)
+    {
+        printf("Executing: %s\n", cmd);
+        cmd_show_vlan_translation();
+    }
+    /* show multicast groups */
+    else if (strcmp(cmd, "show multicast groups") == 0)
+    {
+        printf("Executing: %s\n", cmd);
+        cmd_show_multicast_groups();
+    }
+    /* show mirror */
+    else if (strcmp(cmd, "show mirror") == 0)
+    {
+        printf("Executing: %s\n", cmd);
+        cmd_show_mirror();
+    }
+    /* show sflow */
+    else if (strcmp(cmd, "show sflow") == 0)
+    {
+        printf("Executing: %s\n", cmd);
+        cmd_show_sflow();
+    }
+    /* show packet-trace */
+    else if (strcmp(cmd, "show packet-trace") == 0)
+    {
+        printf("Executing: %s\n", cmd);
+        cmd_show_packet_trace();
+    }
+    /* show resources */
+    else if (strcmp(cmd, "show resources") == 0)
+    {
+        printf("Executing: %s\n", cmd);
+        cmd_show_resources();
+    }
+    /* show lag */
+    else if (strcmp(cmd, "show lag") == 0)
+    {
+        printf("Executing: %s\n", cmd);
+        cmd_show_lag();
+    }
+    /* show mac address-table [vlan <id>] */
+    else if (strncmp(cmd, "show mac address-table", 22) == 0)
+    {
+        printf("Executing: %s\n", cmd);
+        if (cmd_words_cnt == 3)
+        {
+            cmd_show_mac_address_table(-1);
+        }
+        else if (cmd_words_cnt == 5 && strcmp(cmd_words[3], "vlan") == 0)
+        {
+            cmd_show_mac_address_table(atoi(cmd_words[4]));
+        }
+        else
+        {
+            printf("Bad format command: %s\n", cmd);
+        }
+    }
+    /* show bridge fdb [bridge <name>] [vlan <id>] [interface <port>] */
+    else if (strncmp(cmd, "show bridge fdb", 15) == 0)
+    {
+        printf("Executing: %s\n", cmd);
+        cmd_show_bridge_fdb(cmd_words, cmd_words_cnt);
+    }
+    /* bridge fdb add|del <mac> vlan <id> interface <port> [count <n>] */
+    else if (strncmp(cmd, "bridge fdb add ", 15) == 0 || strncmp(cmd, "bridge fdb del ", 15) == 0)
+    {
+        printf("Executing: %s\n", cmd);
+        if ((cmd_words_cnt == 8 || (cmd_words_cnt == 10 && strcmp(cmd_words[8], "count") == 0)) &&
+            strcmp(cmd_words[4], "vlan") == 0 && strcmp(cmd_words[6], "interface") == 0)
+        {
+            cmd_bridge_fdb_static(cmd_words[3], cmd_words[5], cmd_words[7],
+                                  cmd_words_cnt == 10 ? cmd_words[9] : NULL,
+                                  strcmp(cmd_words[2], "add") == 0);
+        }
+        else
+        {
+            printf("Bad format command: %s\n", cmd);
+        }
+    }
+    /* bridge fdb flush [vlan <id>] [interface <port>] [static] */
+    else if (strncmp(cmd, "bridge fdb flush", 16) == 0)
+    {
+        printf("Executing: %s\n", cmd);
+        cmd_bridge_fdb_flush(cmd_words, cmd_words_cnt);
+    }
+    /* exec <path> */
+    else if (strncmp(cmd, "exec ", 5) == 0)
+    {
+        printf("Executing: %s\n", cmd);
+        if (cmd_words_cnt != 2)
+        {
+            printf("Bad format command: %s\n", cmd);
+        }
+        else
+        {
+            cmd_exec(cmd_words[1]);
+        }
+    }
     /* set interface Ethernet56 type l2-trunk vlan v2 */
+    /* set interface <name|range|pattern> [admin up|down] [mtu <n>] [alias <text>] */
     /* Bug fix: "set interface " is 14 characters, not 15 */
     else if (strncmp(cmd, "set interface ", 14) == 0)
     {
         printf("Executing: %s\n", cmd);
-        if (cmd_words_cnt != 7)
+        if (cmd_words_cnt >= 5 && (strcmp(cmd_words[3], "admin") == 0 ||
+                                   strcmp(cmd_words[3], "mtu") == 0 ||
+                                   strcmp(cmd_words[3], "alias") == 0))
+        {
+            cmd_set_interface_attr(cmd_words, cmd_words_cnt);
+        }
+        else if (cmd_words_cnt != 7)
         {
             printf("Bad format command: %s\n", cmd);
         }
@@ -478,7 +734,7 @@ void process_command(const char *cmd)
             delete_vlan((uint16_t)atoi(cmd_words[2]));
         }
     }
-    /* add vlan <id> to <iface> */
+    /* add vlan <id> to <iface|lag> */
     else if (strncmp(cmd, "add vlan ", 9) == 0)
     {
         printf("Executing: %s\n", cmd);
@@ -488,10 +744,10 @@ void process_command(const char *cmd)
         }
         else
         {
-            add_vlan_assignment((uint16_t)atoi(cmd_words[2]), cmd_words[4]);
+            cmd_vlan_member(cmd_words[2], cmd_words[4], 1);
         }
     }
-    /* remove vlan <id> from <iface> */
+    /* remove vlan <id> from <iface|lag> */
     else if (strncmp(cmd, "remove vlan ", 12) == 0)
     {
         printf("Executing: %s\n", cmd);
@@ -501,842 +757,4782 @@ void process_command(const char *cmd)
         }
         else
         {
-            remove_vlan_assignment((uint16_t)atoi(cmd_words[2]), cmd_words[4]);
+            cmd_vlan_member(cmd_words[2], cmd_words[4], 0);
         }
     }
-    /* default */
-    else
+    /* create lag <name> [hash l2|l3|l4] */
+    else if (strncmp(cmd, "create lag ", 11) == 0)
     {
-        printf("Unknown command: %s\n", cmd);
+        printf("Executing: %s\n", cmd);
+        if (cmd_words_cnt == 3)
+        {
+            cmd_create_lag(cmd_words[2], NULL);
+        }
+        else if (cmd_words_cnt == 5 && strcmp(cmd_words[3], "hash") == 0)
+        {
+            cmd_create_lag(cmd_words[2], cmd_words[4]);
+        }
+        else
+        {
+            printf("Bad format command: %s\n", cmd);
+        }
     }
-
-    /* Bug fix: free the words array allocated by get_words */
-    for (int i = 0; i < cmd_words_cnt; i++)
+    /* delete lag <name> */
+    else if (strncmp(cmd, "delete lag ", 11) == 0)
     {
-        free(cmd_words[i]);
+        printf("Executing: %s\n", cmd);
+        if (cmd_words_cnt != 3)
+        {
+            printf("Bad format command: %s\n", cmd);
+        }
+        else
+        {
+            cmd_delete_lag(cmd_words[2]);
+        }
     }
-    free(cmd_words);
-}
-
-/*
- * cmd_show_interfaces - Query and display all network interfaces
- *
- * Description:
- *   Uses the Netlink ROUTE API (via libnl3) to enumerate all network interfaces
- *   present on the system and prints their index, name, type, and flags to stdout.
- *
- * Input parameters: none
- *
- * Output:
- *   Prints a table with columns: IDX, NAME, TYPE, FLAGS
- *   Each row represents one network interface.
- *
- * Return value:
- *    0  - success
- *   -1  - failed to allocate netlink socket
- *   -2  - failed to connect netlink socket to NETLINK_ROUTE
- *   -3  - failed to allocate the link cache from the kernel
- */
-int cmd_show_interfaces()
-{
-    struct nl_sock *sock = NULL;
-    struct nl_cache *cache = NULL;
-    struct rtnl_link *link = NULL;
-    struct nl_object *_nl_iter = NULL;
-    int _nl_err;
-
-    NL_CALL_RET(sock, nl_socket_alloc(),
-                "nl_socket_alloc", "");
-    if (!sock)
+    /* add interface <port> to lag <name> */
+    else if (strncmp(cmd, "add interface ", 14) == 0)
     {
-        fprintf(stderr, "cmd_show_interfaces: failed to allocate netlink socket\n");
-        return -1;
+        printf("Executing: %s\n", cmd);
+        if (cmd_words_cnt != 6 || strcmp(cmd_words[3], "to") != 0 || strcmp(cmd_words[4], "lag") != 0)
+        {
+            printf("Bad format command: %s\n", cmd);
+        }
+        else
+        {
+            cmd_lag_member(cmd_words[2], cmd_words[5], 1);
+        }
     }
-
-    NL_CALL_RET(_nl_err, nl_connect(sock, NETLINK_ROUTE),
-                "nl_connect", "sock=%p, protocol=NETLINK_ROUTE", (void *)sock);
-    if (_nl_err < 0)
+    /* remove interface <port> from lag <name> */
+    else if (strncmp(cmd, "remove interface ", 17) == 0)
     {
-        fprintf(stderr, "cmd_show_interfaces: failed to connect netlink socket\n");
-        NL_CALL_VOID(nl_socket_free(sock),
-                     "nl_socket_free", "sock=%p", (void *)sock);
-        return -2;
+        printf("Executing: %s\n", cmd);
+        if (cmd_words_cnt != 6 || strcmp(cmd_words[3], "from") != 0 || strcmp(cmd_words[4], "lag") != 0)
+        {
+            printf("Bad format command: %s\n", cmd);
+        }
+        else
+        {
+            cmd_lag_member(cmd_words[2], cmd_words[5], 0);
+        }
     }
-
-    NL_CALL_RET(_nl_err, rtnl_link_alloc_cache(sock, AF_UNSPEC, &cache),
-                "rtnl_link_alloc_cache",
-                "sock=%p, family=AF_UNSPEC, cache=%p",
-                (void *)sock, (void *)cache);
-    if (_nl_err < 0)
+    /* create mirror <name> file <prefix> [snaplen <n>] [sample <n>] [rotate <MB>] [files <n>] */
+    else if (strncmp(cmd, "create mirror ", 14) == 0)
     {
-        fprintf(stderr, "cmd_show_interfaces: failed to allocate link cache\n");
-        NL_CALL_VOID(nl_socket_free(sock),
-                     "nl_socket_free", "sock=%p", (void *)sock);
-        return -3;
+        printf("Executing: %s\n", cmd);
+        if (cmd_words_cnt < 5 || cmd_words_cnt % 2 == 0 || strcmp(cmd_words[3], "file") != 0)
+        {
+            printf("Bad format command: %s\n", cmd);
+        }
+        else
+        {
+            cmd_create_mirror(cmd_words, cmd_words_cnt);
+        }
     }
-
-    printf("%-5s  %-20s  %-12s  %s\n", "IDX", "NAME", "TYPE", "FLAGS");
-    printf("%-5s  %-20s  %-12s  %s\n", "---", "----", "----", "-----");
-
-    NL_CALL_RET(_nl_iter, nl_cache_get_first(cache),
-                "nl_cache_get_first", "cache=%p", (void *)cache);
-    link = (struct rtnl_link *)_nl_iter;
-    while (link != NULL)
+    /* delete mirror <name> */
+    else if (strncmp(cmd, "delete mirror ", 14) == 0)
     {
-        char flags_buf[256] = {0};
-        const char *type;
-        unsigned int _flags;
-        int _ifindex;
-        const char *_name;
-
-        NL_CALL_RET(type, rtnl_link_get_type(link),
-                    "rtnl_link_get_type", "link=%p", (void *)link);
-
-        NL_CALL_RET(_flags, rtnl_link_get_flags(link),
-                    "rtnl_link_get_flags", "link=%p", (void *)link);
-        NL_CALL_VOID(rtnl_link_flags2str(_flags, flags_buf, sizeof(flags_buf)),
-                     "rtnl_link_flags2str",
-                     "flags=%u, buf=%p, len=%zu",
-                     _flags, (void *)flags_buf, sizeof(flags_buf));
-
-        NL_CALL_RET(_ifindex, rtnl_link_get_ifindex(link),
-                    "rtnl_link_get_ifindex", "link=%p", (void *)link);
-        NL_CALL_RET(_name, rtnl_link_get_name(link),
-                    "rtnl_link_get_name", "link=%p", (void *)link);
-
-        printf("%-5d  %-20s  %-12s  %s\n",
-               _ifindex,
-               _name,
-               type ? type : "-",
-               flags_buf[0] ? flags_buf : "none");
-
-        NL_CALL_RET(_nl_iter, nl_cache_get_next((struct nl_object *)link),
-                    "nl_cache_get_next", "obj=%p", (void *)link);
-        link = (struct rtnl_link *)_nl_iter;
+        printf("Executing: %s\n", cmd);
+        if (cmd_words_cnt != 3)
+        {
+            printf("Bad format command: %s\n", cmd);
+        }
+        else
+        {
+            cmd_delete_mirror(cmd_words[2]);
+        }
     }
-
-    NL_CALL_VOID(nl_cache_free(cache),
-                 "nl_cache_free", "cache=%p", (void *)cache);
-    NL_CALL_VOID(nl_socket_free(sock),
-                 "nl_socket_free", "sock=%p", (void *)sock);
-    return 0;
-}
-
-/*
- * cmd_rename_interfaces - Rename network interfaces by replacing a name prefix
- *
- * Description:
- *   Iterates all network interfaces via the Netlink ROUTE API. For each
- *   interface whose name begins with `prefix`, renames it by substituting
- *   `prefix` with `new_prefix` while keeping the rest of the name unchanged.
- *   The rename is sent to the kernel via RTM_SETLINK (rtnl_link_change).
- *   Note: the kernel requires an interface to be DOWN before it can be renamed.
- *   Each renamed interface is printed to stdout; errors are printed to stderr.
- *
- * Input parameters:
- *   prefix     - the interface name prefix to match (e.g. "eth")
- *   new_prefix - the replacement prefix to use   (e.g. "net")
- *
- * Output:
- *   For each renamed interface, prints: <old_name> -> <new_name>
- *
- * Return value:
- *    0  - success (all matching interfaces were renamed successfully)
+    /* mirror <name> interface <port>|vlan <id> rx|tx|both */
+    else if (strncmp(cmd, "mirror ", 7) == 0)
+    {
+        printf("Executing: %s\n", cmd);
+        if (cmd_words_cnt != 5)
+        {
+            printf("Bad format command: %s\n", cmd);
+        }
+        else
+        {
+            cmd_mirror_source(cmd_words[1], cmd_words[2], cmd_words[3], cmd_words[4]);
+        }
+    }
+    /* no mirror <name> interface <port>|vlan <id> */
+    else if (strncmp(cmd, "no mirror ", 10) == 0)
+    {
+        printf("Executing: %s\n", cmd);
+        if (cmd_words_cnt != 5)
+        {
+            printf("Bad format command: %s\n", cmd);
+        }
+        else
+        {
+            cmd_mirror_source(cmd_words[2], cmd_words[3], cmd_words[4], NULL);
+        }
+    }
+    /* sflow collector <ip> agent <ip> [port <n>] [poll <s>] [header <bytes>] |
+     * sflow interface <port> rate <n> | sflow vlan <id> */
+    else if (strncmp(cmd, "sflow ", 6) == 0)
+    {
+        printf("Executing: %s\n", cmd);
+        if (cmd_words_cnt >= 5 && cmd_words_cnt % 2 == 1 && strcmp(cmd_words[1], "collector") == 0)
+        {
+            cmd_sflow_enable(cmd_words, cmd_words_cnt);
+        }
+        else if (cmd_words_cnt == 5 && strcmp(cmd_words[1], "interface") == 0 &&
+                 strcmp(cmd_words[3], "rate") == 0)
+        {
+            cmd_sflow_port(cmd_words[2], cmd_words[4]);
+        }
+        else if (cmd_words_cnt == 3 && strcmp(cmd_words[1], "vlan") == 0)
+        {
+            cmd_sflow_vlan(cmd_words[2], 1);
+        }
+        else
+        {
+            printf("Bad format command: %s\n", cmd);
+        }
+    }
+    /* no sflow | no sflow interface <port> | no sflow vlan <id> */
+    else if (strcmp(cmd, "no sflow") == 0 || strncmp(cmd, "no sflow ", 9) == 0)
+    {
+        printf("Executing: %s\n", cmd);
+        if (cmd_words_cnt == 2)
+        {
+            cmd_sflow_disable();
+        }
+        else if (cmd_words_cnt == 4 && strcmp(cmd_words[2], "interface") == 0)
+        {
+            cmd_sflow_port(cmd_words[3], NULL);
+        }
+        else if (cmd_words_cnt == 4 && strcmp(cmd_words[2], "vlan") == 0)
+        {
+            cmd_sflow_vlan(cmd_words[3], 0);
+        }
+        else
+        {
+            printf("Bad format command: %s\n", cmd);
+        }
+    }
+    /* packet-trace interface <port> [vlan <id>] [src <mac>] [dst <mac>] [len <n>] |
+     * packet-trace interface <port> frame <hex> |
+     * packet-trace sample interface <port> rate <n> */
+    else if (strncmp(cmd, "packet-trace ", 13) == 0)
+    {
+        printf("Executing: %s\n", cmd);
+        if (cmd_words_cnt >= 3 && cmd_words_cnt % 2 == 1 && strcmp(cmd_words[1], "interface") == 0)
+        {
+            cmd_packet_trace(cmd_words, cmd_words_cnt);
+        }
+        else if (cmd_words_cnt == 6 && strcmp(cmd_words[1], "sample") == 0 &&
+                 strcmp(cmd_words[2], "interface") == 0 && strcmp(cmd_words[4], "rate") == 0)
+        {
+            cmd_packet_trace_sample(cmd_words[3], cmd_words[5]);
+        }
+        else
+        {
+            printf("Bad format command: %s\n", cmd);
+        }
+    }
+    /* no packet-trace sample interface <port> */
+    else if (strncmp(cmd, "no packet-trace ", 16) == 0)
+    {
+        printf("Executing: %s\n", cmd);
+        if (cmd_words_cnt == 5 && strcmp(cmd_words[2], "sample") == 0 &&
+            strcmp(cmd_words[3], "interface") == 0)
+        {
+            cmd_packet_trace_sample(cmd_words[4], NULL);
+        }
+        else
+        {
+            printf("Bad format command: %s\n", cmd);
+        }
+    }
+    /* resource <table> capacity <n> | resource <table> threshold <high> [<low>] */
+    else if (strncmp(cmd, "resource ", 9) == 0)
+    {
+        printf("Executing: %s\n", cmd);
+        if ((cmd_words_cnt == 4 && strcmp(cmd_words[2], "capacity") == 0) ||
+            ((cmd_words_cnt == 4 || cmd_words_cnt == 5) && strcmp(cmd_words[2], "threshold") == 0))
+        {
+            cmd_resource(cmd_words[1], cmd_words[2], cmd_words[3],
+                         cmd_words_cnt == 5 ? cmd_words[4] : NULL);
+        }
+        else
+        {
+            printf("Bad format command: %s\n", cmd);
+        }
+    }
+    /* acl <name> rule <seq> permit|deny [match...] | acl <name> default permit|deny */
+    else if (strncmp(cmd, "acl ", 4) == 0)
+    {
+        printf("Executing: %s\n", cmd);
+        if (cmd_words_cnt >= 5 && strcmp(cmd_words[2], "rule") == 0)
+        {
+            cmd_acl_rule(cmd_words, cmd_words_cnt);
+        }
+        else if (cmd_words_cnt == 4 && strcmp(cmd_words[2], "default") == 0)
+        {
+            cmd_acl_default(cmd_words[1], cmd_words[3]);
+        }
+        else
+        {
+            printf("Bad format command: %s\n", cmd);
+        }
+    }
+    /* no acl <name> [rule <seq>] */
+    else if (strncmp(cmd, "no acl ", 7) == 0)
+    {
+        printf("Executing: %s\n", cmd);
+        if (cmd_words_cnt == 3)
+        {
+            cmd_no_acl(cmd_words[2], NULL);
+        }
+        else if (cmd_words_cnt == 5 && strcmp(cmd_words[3], "rule") == 0)
+        {
+            cmd_no_acl(cmd_words[2], cmd_words[4]);
+        }
+        else
+        {
+            printf("Bad format command: %s\n", cmd);
+        }
+    }
+    /* bind acl <name> interface <port> | bind acl <name> vlan <id> */
+    else if (strncmp(cmd, "bind acl ", 9) == 0)
+    {
+        printf("Executing: %s\n", cmd);
+        if (cmd_words_cnt != 5)
+        {
+            printf("Bad format command: %s\n", cmd);
+        }
+        else
+        {
+            cmd_bind_acl(cmd_words[2], cmd_words[3], cmd_words[4]);
+        }
+    }
+    /* unbind acl interface <port> | unbind acl vlan <id> */
+    else if (strncmp(cmd, "unbind acl ", 11) == 0)
+    {
+        printf("Executing: %s\n", cmd);
+        if (cmd_words_cnt != 4)
+        {
+            printf("Bad format command: %s\n", cmd);
+        }
+        else
+        {
+            cmd_bind_acl(NULL, cmd_words[2], cmd_words[3]);
+        }
+    }
+    /* storm-control interface <port>|vlan <id> <class> pps|kbps <rate> [burst <n>] */
+    else if (strncmp(cmd, "storm-control ", 14) == 0)
+    {
+        printf("Executing: %s\n", cmd);
+        if (cmd_words_cnt != 6 && cmd_words_cnt != 8)
+        {
+            printf("Bad format command: %s\n", cmd);
+        }
+        else
+        {
+            cmd_storm_control(cmd_words, cmd_words_cnt);
+        }
+    }
+    /* no storm-control interface <port>|vlan <id> <class> */
+    else if (strncmp(cmd, "no storm-control ", 17) == 0)
+    {
+        printf("Executing: %s\n", cmd);
+        if (cmd_words_cnt != 5)
+        {
+            printf("Bad format command: %s\n", cmd);
+        }
+        else
+        {
+            cmd_no_storm_control(cmd_words[2], cmd_words[3], cmd_words[4]);
+        }
+    }
+    /* vlan translation interface <port> <cvid>[-<last>] <vid> */
+    else if (strncmp(cmd, "vlan translation ", 17) == 0)
+    {
+        printf("Executing: %s\n", cmd);
+        if (cmd_words_cnt != 6 || strcmp(cmd_words[2], "interface") != 0)
+        {
+            printf("Bad format command: %s\n", cmd);
+        }
+        else
+        {
+            cmd_vlan_translation(cmd_words[3], cmd_words[4], cmd_words[5]);
+        }
+    }
+    /* no vlan translation interface <port> <cvid>[-<last>] */
+    else if (strncmp(cmd, "no vlan translation ", 20) == 0)
+    {
+        printf("Executing: %s\n", cmd);
+        if (cmd_words_cnt != 6 || strcmp(cmd_words[3], "interface") != 0)
+        {
+            printf("Bad format command: %s\n", cmd);
+        }
+        else
+        {
+            cmd_vlan_translation(cmd_words[4], cmd_words[5], NULL);
+        }
+    }
+    /* multicast snooping vlan <id> */
+    else if (strncmp(cmd, "multicast snooping ", 19) == 0)
+    {
+        printf("Executing: %s\n", cmd);
+        if (cmd_words_cnt != 4 || strcmp(cmd_words[2], "vlan") != 0)
+        {
+            printf("Bad format command: %s\n", cmd);
+        }
+        else
+        {
+            cmd_multicast_snooping(cmd_words[3], 1);
+        }
+    }
+    /* no multicast snooping vlan <id> */
+    else if (strncmp(cmd, "no multicast snooping ", 22) == 0)
+    {
+        printf("Executing: %s\n", cmd);
+        if (cmd_words_cnt != 5 || strcmp(cmd_words[3], "vlan") != 0)
+        {
+            printf("Bad format command: %s\n", cmd);
+        }
+        else
+        {
+            cmd_multicast_snooping(cmd_words[4], 0);
+        }
+    }
+    /* default */
+    else
+    {
+        printf("Unknown command: %s\n", cmd);
+    }
+
+    /* Bug fix: free the words array allocated by get_words */
+    for (int i = 0; i < cmd_words_cnt; i++)
+    {
+        free(cmd_words[i]);
+    }
+    free(cmd_words);
+}
+
+/*
+ * lag_lookup - Find the forwarding plane LAG named `name`
+ *
+ * Return value: 0 and the LAG's state in `info` (if not NULL), or -1
+ */
+static int lag_lookup(const char *name, struct dp_lag_info *info)
+{
+    struct dp_lag_info li;
+    unsigned i;
+
+    for (i = 0; i < DP_MAX_LAGS; i++)
+    {
+        if (dp_get_lag(i, &li) == 0 && strcmp(li.name, name) == 0)
+        {
+            if (info)
+                *info = li;
+            return 0;
+        }
+    }
+    return -1;
+}
+
+/*
+ * lag_members - vlan_lag_fn for the forwarding plane's LAGs
+ *
+ * Return value: the member count of LAG `name`, or -ENOENT
+ */
+_Static_assert(VLAN_IFNAMSIZ == IFNAMSIZ && VLAN_LAG_MAX_MEMBERS == LAG_MAX_MEMBERS,
+               "vlan_api.h sizes must match the forwarding plane's");
+
+static int lag_members(const char *name, char (*member)[VLAN_IFNAMSIZ], unsigned max)
+{
+    struct dp_lag_info li;
+    unsigned i;
+
+    if (!dp_running() || lag_lookup(name, &li) < 0)
+        return -ENOENT;
+    for (i = 0; i < li.nmembers && i < max; i++)
+        memcpy(member[i], li.member[i], VLAN_IFNAMSIZ);
+    return (int)li.nmembers;
+}
+
+/*
+ * command_keys - Derive the scheduler ordering keys for a command string
+ *
+ * Keying rules:
+ *   - VLAN: "create/delete vlan", "bridge fdb flush vlan <id>"
+ *   - interface: "set interface <name>", VLAN translations and "bridge fdb
+ *     flush interface <port>" (per port)
+ *   - VLAN and interface: assignments and static FDB entries, so they stay
+ *     ordered with the VLAN's create/delete and with moves of the same port
+ *   - SCHED_KEY_ALL:
+ *       "rename interfaces", "set vlan", "exec" - may touch any interface
+ *       ACLs - a binding can make a rule apply anywhere
+ *       storm control - VLAN limits land on every member port
+ *       multicast snooping - one snooper for all VLANs
+ *       LAGs and LAG assignments - a LAG stands for all its member ports;
+ *         while a LAG change is still queued, any name may be a LAG
+ *       mirror sessions - sources share one table per session
+ *       sFlow, packet-trace - sample or trace any port
+ *       resources - the tables are shared
+ *       other bridge FDB commands - may span every VLAN
+ *       "set interface <range|pattern>" - may name any interface
+ *   - none: read-only and unknown commands
+ *
+ * Return value: number of keys written to `keys` (0..SCHED_MAX_KEYS)
+ */
+static int command_keys(const char *cmd, uint32_t *keys)
+{
+    char iface[IFNAMSIZ];
+    char spec[64];
+    unsigned vid;
+
+    if ((sscanf(cmd, "add vlan %u to %15s", &vid, iface) == 2 ||
+         sscanf(cmd, "remove vlan %u from %15s", &vid, iface) == 2) &&
+        !vlan_lag_maybe(iface))
+    {
+        keys[0] = sched_key_vlan((uint16_t)vid);
+        keys[1] = sched_key_iface(iface);
+        return 2;
+    }
+
+    /* Static MACs and flushes need the port to stay a member of the VLAN. */
+    if (sscanf(cmd, "bridge fdb add %*s vlan %u interface %15s", &vid, iface) == 2 ||
+        sscanf(cmd, "bridge fdb del %*s vlan %u interface %15s", &vid, iface) == 2 ||
+        sscanf(cmd, "bridge fdb flush vlan %u interface %15s", &vid, iface) == 2)
+    {
+        keys[0] = sched_key_vlan((uint16_t)vid);
+        keys[1] = sched_key_iface(iface);
+        return 2;
+    }
+
+    if (sscanf(cmd, "create vlan %u", &vid) == 1 ||
+        sscanf(cmd, "delete vlan %u", &vid) == 1 ||
+        sscanf(cmd, "bridge fdb flush vlan %u", &vid) == 1)
+    {
+        keys[0] = sched_key_vlan((uint16_t)vid);
+        return 1;
+    }
+
+    /* An interface range or pattern may name any interface. */
+    if (sscanf(cmd, "set interface %63s", spec) == 1 && link_attr_is_multi(spec))
+    {
+        keys[0] = SCHED_KEY_ALL;
+        return 1;
+    }
+
+    if (sscanf(cmd, "set interface %15s", iface) == 1 ||
+        sscanf(cmd, "bridge fdb flush interface %15s", iface) == 1 ||
+        sscanf(cmd, "vlan translation interface %15s", iface) == 1 ||
+        sscanf(cmd, "no vlan translation interface %15s", iface) == 1)
+    {
+        keys[0] = sched_key_iface(iface);
+        return 1;
+    }
+
+    if (strncmp(cmd, "rename interfaces", 17) == 0 ||
+        strncmp(cmd, "set vlan ", 9) == 0 ||
+        strncmp(cmd, "exec ", 5) == 0 ||
+        strncmp(cmd, "acl ", 4) == 0 ||
+        strncmp(cmd, "no acl ", 7) == 0 ||
+        strncmp(cmd, "bind acl ", 9) == 0 ||
+        strncmp(cmd, "unbind acl ", 11) == 0 ||
+        strncmp(cmd, "storm-control ", 14) == 0 ||
+        strncmp(cmd, "no storm-control ", 17) == 0 ||
+        strncmp(cmd, "multicast snooping ", 19) == 0 ||
+        strncmp(cmd, "no multicast snooping ", 22) == 0 ||
+        strncmp(cmd, "add vlan ", 9) == 0 ||
+        strncmp(cmd, "remove vlan ", 12) == 0 ||
+        strncmp(cmd, "create lag ", 11) == 0 ||
+        strncmp(cmd, "delete lag ", 11) == 0 ||
+        strncmp(cmd, "add interface ", 14) == 0 ||
+        strncmp(cmd, "remove interface ", 17) == 0 ||
+        strncmp(cmd, "create mirror ", 14) == 0 ||
+        strncmp(cmd, "delete mirror ", 14) == 0 ||
+        strncmp(cmd, "mirror ", 7) == 0 ||
+        strncmp(cmd, "no mirror ", 10) == 0 ||
+        strncmp(cmd, "sflow ", 6) == 0 ||
+        strncmp(cmd, "no sflow", 8) == 0 ||
+        strncmp(cmd, "packet-trace ", 13) == 0 ||
+        strncmp(cmd, "no packet-trace ", 16) == 0 ||
+        strncmp(cmd, "resource ", 9) == 0 ||
+        strncmp(cmd, "bridge fdb ", 11) == 0)
+    {
+        keys[0] = SCHED_KEY_ALL;
+        return 1;
+    }
+
+    return 0;
+}
+
+static void command_job(void *arg)
+{
+    process_command(arg);
+    free(arg);
+}
+
+/*
+ * lag_change - Whether a command may create or delete a LAG or change its
+ * members ("exec" may run any of those); see vlan_lag_change_begin()
+ */
+static int lag_change(const char *cmd)
+{
+    return strncmp(cmd, "create lag ", 11) == 0 ||
+           strncmp(cmd, "delete lag ", 11) == 0 ||
+           strncmp(cmd, "add interface ", 14) == 0 ||
+           strncmp(cmd, "remove interface ", 17) == 0 ||
+           strncmp(cmd, "exec ", 5) == 0;
+}
+
+static void lag_command_job(void *arg)
+{
+    command_job(arg);
+    vlan_lag_change_end();
+}
+
+/* Client connection the command running on this thread streams its
+ * results to, or -1 (see dispatch_client_command()). */
+static __thread int t_reply_fd = -1;
+
+struct client_command
+{
+    int  fd;            /* dup() of the client socket */
+    char cmd[];
+};
+
+static void client_command_job(void *arg)
+{
+    struct client_command *c = arg;
+
+    t_reply_fd = c->fd;
+    process_command(c->cmd);
+    t_reply_fd = -1;
+    close(c->fd);
+    free(c);
+}
+
+/*
+ * reply - Print a result line to stdout and stream it to the client of the
+ * running command, if it has one
+ *
+ * A client that went away is ignored; one that does not read stalls only
+ * the worker running its command.
+ */
+static void reply(const char *fmt, ...)
+{
+    char line[512];
+    va_list ap;
+    int len;
+
+    va_start(ap, fmt);
+    len = vsnprintf(line, sizeof(line), fmt, ap);
+    va_end(ap);
+    if (len >= (int)sizeof(line))
+        len = (int)sizeof(line) - 1;
+    fputs(line, stdout);
+    if (t_reply_fd >= 0 && len > 0)
+        (void)!send(t_reply_fd, line, (size_t)len, MSG_NOSIGNAL);
+}
+
+/*
+ * dispatch_command - Hand a command to the worker pool
+ *
+ * "show scheduler" is answered inline so that the reported queue depths are
+ * not perturbed by the command itself.  If the pool rejects the job the
+ * command is executed on the calling thread instead.
+ */
+void dispatch_command(const char *cmd)
+{
+    uint32_t keys[SCHED_MAX_KEYS];
+    char *copy;
+    int nkeys;
+
+    if (strcmp(cmd, "show scheduler") == 0)
+    {
+        process_command(cmd);
+        return;
+    }
+
+    copy = strdup(cmd);
+    if (!copy)
+    {
+        perror("strdup");
+        return;
+    }
+
+    /* Until a LAG change has run, names it may affect are keyed as LAGs. */
+    nkeys = command_keys(cmd, keys);
+    if (!lag_change(cmd))
+    {
+        if (sched_submit(keys, nkeys, command_job, copy) < 0)
+            command_job(copy);
+        return;
+    }
+
+    vlan_lag_change_begin();
+    if (sched_submit(keys, nkeys, lag_command_job, copy) < 0)
+        lag_command_job(copy);
+}
+
+/*
+ * dispatch_client_command - Hand a command whose results stream back to
+ * the client to the worker pool
+ *
+ * Like dispatch_command(), but the job holds a duplicate of the client's
+ * socket, so what the command prints with reply() reaches the client as it
+ * is produced, while the main loop keeps serving other connections.
+ */
+static void dispatch_client_command(const char *cmd, int fd)
+{
+    uint32_t keys[SCHED_MAX_KEYS];
+    struct client_command *c;
+    size_t len = strlen(cmd);
+    int nkeys;
+
+    c = malloc(sizeof(*c) + len + 1);
+    if (!c || (c->fd = dup(fd)) < 0)
+    {
+        free(c);
+        dispatch_command(cmd);
+        return;
+    }
+    memcpy(c->cmd, cmd, len + 1);
+
+    nkeys = command_keys(cmd, keys);
+    if (sched_submit(keys, nkeys, client_command_job, c) < 0)
+    {
+        client_command_job(c);
+    }
+}
+
+/*
+ * cmd_show_interfaces - Query and display all network interfaces
+ *
+ * Description:
+ *   Prints every network interface from the published link snapshot
+ *   (vlan_state.c) without taking any lock, so the output does not wait for
+ *   concurrent provisioning commands.  If no snapshot is available it falls
+ *   back to enumerating the interfaces with the Netlink ROUTE API (libnl3).
+ *
+ * Input parameters: none
+ *
+ * Output:
+ *   Prints a table with columns: IDX, NAME, TYPE, FLAGS
+ *   Each row represents one network interface.
+ *
+ * Return value:
+ *    0  - success
+ *   -1  - failed to allocate netlink socket
+ *   -2  - failed to connect netlink socket to NETLINK_ROUTE
+ *   -3  - failed to allocate the link cache from the kernel
+ */
+int cmd_show_interfaces()
+{
+    const struct vlan_snapshot *snap;
+    struct nl_sock *sock = NULL;
+    struct nl_cache *cache = NULL;
+    struct rtnl_link *link = NULL;
+    struct nl_object *_nl_iter = NULL;
+    int _nl_err;
+
+    snap = vlan_state_read_begin();
+    if (snap)
+    {
+        printf("%-5s  %-20s  %-12s  %s\n", "IDX", "NAME", "TYPE", "FLAGS");
+        printf("%-5s  %-20s  %-12s  %s\n", "---", "----", "----", "-----");
+
+        for (unsigned i = 0; i < snap->nlinks; i++)
+        {
+            const struct vs_link *l = &snap->links[i];
+            char flags_buf[256] = {0};
+
+            rtnl_link_flags2str(l->flags, flags_buf, sizeof(flags_buf));
+            printf("%-5d  %-20s  %-12s  %s\n",
+                   l->ifindex,
+                   l->name,
+                   l->kind[0] ? l->kind : "-",
+                   flags_buf[0] ? flags_buf : "none");
+        }
+        printf("(snapshot generation %llu)\n", (unsigned long long)snap->generation);
+        vlan_state_read_end();
+        return 0;
+    }
+    vlan_state_read_end();
+
+    NL_CALL_RET(sock, nl_socket_alloc(),
+                "nl_socket_alloc", "");
+    if (!sock)
+    {
+        fprintf(stderr, "cmd_show_interfaces: failed to allocate netlink socket\n");
+        return -1;
+    }
+
+    NL_CALL_RET(_nl_err, nl_connect(sock, NETLINK_ROUTE),
+                "nl_connect", "sock=%p, protocol=NETLINK_ROUTE", (void *)sock);
+    if (_nl_err < 0)
+    {
+        fprintf(stderr, "cmd_show_interfaces: failed to connect netlink socket\n");
+        NL_CALL_VOID(nl_socket_free(sock),
+                     "nl_socket_free", "sock=%p", (void *)sock);
+        return -2;
+    }
+
+    NL_CALL_RET(_nl_err, rtnl_link_alloc_cache(sock, AF_UNSPEC, &cache),
+                "rtnl_link_alloc_cache",
+                "sock=%p, family=AF_UNSPEC, cache=%p",
+                (void *)sock, (void *)cache);
+    if (_nl_err < 0)
+    {
+        fprintf(stderr, "cmd_show_interfaces: failed to allocate link cache\n");
+        NL_CALL_VOID(nl_socket_free(sock),
+                     "nl_socket_free", "sock=%p", (void *)sock);
+        return -3;
+    }
+
+    printf("%-5s  %-20s  %-12s  %s\n", "IDX", "NAME", "TYPE", "FLAGS");
+    printf("%-5s  %-20s  %-12s  %s\n", "---", "----", "----", "-----");
+
+    NL_CALL_RET(_nl_iter, nl_cache_get_first(cache),
+                "nl_cache_get_first", "cache=%p", (void *)cache);
+    link = (struct rtnl_link *)_nl_iter;
+    while (link != NULL)
+    {
+        char flags_buf[256] = {0};
+        const char *type;
+        unsigned int _flags;
+        int _ifindex;
+        const char *_name;
+
+        NL_CALL_RET(type, rtnl_link_get_type(link),
+                    "rtnl_link_get_type", "link=%p", (void *)link);
+
+        NL_CALL_RET(_flags, rtnl_link_get_flags(link),
+                    "rtnl_link_get_flags", "link=%p", (void *)link);
+        NL_CALL_VOID(rtnl_link_flags2str(_flags, flags_buf, sizeof(flags_buf)),
+                     "rtnl_link_flags2str",
+                     "flags=%u, buf=%p, len=%zu",
+                     _flags, (void *)flags_buf, sizeof(flags_buf));
+
+        NL_CALL_RET(_ifindex, rtnl_link_get_ifindex(link),
+                    "rtnl_link_get_ifindex", "link=%p", (void *)link);
+        NL_CALL_RET(_name, rtnl_link_get_name(link),
+                    "rtnl_link_get_name", "link=%p", (void *)link);
+
+        printf("%-5d  %-20s  %-12s  %s\n",
+               _ifindex,
+               _name,
+               type ? type : "-",
+               flags_buf[0] ? flags_buf : "none");
+
+        NL_CALL_RET(_nl_iter, nl_cache_get_next((struct nl_object *)link),
+                    "nl_cache_get_next", "obj=%p", (void *)link);
+        link = (struct rtnl_link *)_nl_iter;
+    }
+
+    NL_CALL_VOID(nl_cache_free(cache),
+                 "nl_cache_free", "cache=%p", (void *)cache);
+    NL_CALL_VOID(nl_socket_free(sock),
+                 "nl_socket_free", "sock=%p", (void *)sock);
+    return 0;
+}
+
+/*
+ * cmd_rename_interfaces - Rename network interfaces by replacing a name prefix
+ *
+ * Description:
+ *   Iterates all network interfaces via the Netlink ROUTE API. For each
+ *   interface whose name begins with `prefix`, renames it by substituting
+ *   `prefix` with `new_prefix` while keeping the rest of the name unchanged.
+ *   The rename is sent to the kernel via RTM_SETLINK (rtnl_link_change).
+ *   Note: the kernel requires an interface to be DOWN before it can be renamed.
+ *   Each renamed interface is printed to stdout; errors are printed to stderr.
+ *
+ * Input parameters:
+ *   prefix     - the interface name prefix to match (e.g. "eth")
+ *   new_prefix - the replacement prefix to use   (e.g. "net")
+ *
+ * Output:
+ *   For each renamed interface, prints: <old_name> -> <new_name>
+ *
+ * Return value:
+ *    0  - success (all matching interfaces were renamed successfully)
  *   -1  - prefix or new_prefix is NULL
  *   -2  - failed to allocate netlink socket
  *   -3  - failed to connect netlink socket to NETLINK_ROUTE
  *   -4  - failed to allocate the link cache from the kernel
- *   -5  - one or more rename operations failed (kernel error)
+ *   -5  - one or more rename operations failed (kernel error)
+ */
+int cmd_rename_interfaces(char* prefix, char* new_prefix)
+{
+    struct nl_sock *sock = NULL;
+    struct nl_cache *cache = NULL;
+    struct rtnl_link *link = NULL;
+    struct rtnl_link *change = NULL;
+    struct nl_object *_nl_iter = NULL;
+    int ret_code = 0;
+    size_t prefix_len;
+    int _nl_err;
+
+    if (!prefix || !new_prefix)
+    {
+        fprintf(stderr, "cmd_rename_interfaces: prefix or new_prefix is NULL\n");
+        return -1;
+    }
+
+    NL_CALL_RET(sock, nl_socket_alloc(),
+                "nl_socket_alloc", "");
+    if (!sock)
+    {
+        fprintf(stderr, "cmd_rename_interfaces: failed to allocate netlink socket\n");
+        return -2;
+    }
+
+    NL_CALL_RET(_nl_err, nl_connect(sock, NETLINK_ROUTE),
+                "nl_connect", "sock=%p, protocol=NETLINK_ROUTE", (void *)sock);
+    if (_nl_err < 0)
+    {
+        fprintf(stderr, "cmd_rename_interfaces: failed to connect netlink socket\n");
+        NL_CALL_VOID(nl_socket_free(sock),
+                     "nl_socket_free", "sock=%p", (void *)sock);
+        return -3;
+    }
+
+    NL_CALL_RET(_nl_err, rtnl_link_alloc_cache(sock, AF_UNSPEC, &cache),
+                "rtnl_link_alloc_cache",
+                "sock=%p, family=AF_UNSPEC, cache=%p",
+                (void *)sock, (void *)cache);
+    if (_nl_err < 0)
+    {
+        fprintf(stderr, "cmd_rename_interfaces: failed to allocate link cache\n");
+        NL_CALL_VOID(nl_socket_free(sock),
+                     "nl_socket_free", "sock=%p", (void *)sock);
+        return -4;
+    }
+
+    prefix_len = strlen(prefix);
+
+    NL_CALL_RET(_nl_iter, nl_cache_get_first(cache),
+                "nl_cache_get_first", "cache=%p", (void *)cache);
+    link = (struct rtnl_link *)_nl_iter;
+    while (link != NULL)
+    {
+        const char *name;
+        char new_name[IFNAMSIZ];
+        int err;
+
+        NL_CALL_RET(name, rtnl_link_get_name(link),
+                    "rtnl_link_get_name", "link=%p", (void *)link);
+
+        if (!name || strncmp(name, prefix, prefix_len) != 0)
+        {
+            NL_CALL_RET(_nl_iter, nl_cache_get_next((struct nl_object *)link),
+                        "nl_cache_get_next", "obj=%p", (void *)link);
+            link = (struct rtnl_link *)_nl_iter;
+            continue;
+        }
+
+        snprintf(new_name, sizeof(new_name), "%s%s", new_prefix, name + prefix_len);
+
+        NL_CALL_RET(change, rtnl_link_alloc(),
+                    "rtnl_link_alloc", "");
+        if (!change)
+        {
+            fprintf(stderr, "cmd_rename_interfaces: failed to allocate change link for %s\n", name);
+            ret_code = -5;
+            break;
+        }
+
+        NL_CALL_VOID(rtnl_link_set_name(change, new_name),
+                     "rtnl_link_set_name", "link=%p, name=\"%s\"",
+                     (void *)change, new_name);
+
+        NL_CALL_RET(err, rtnl_link_change(sock, link, change, 0),
+                    "rtnl_link_change",
+                    "sock=%p, link=%p, change=%p, flags=0",
+                    (void *)sock, (void *)link, (void *)change);
+        if (err < 0)
+        {
+            const char *_errmsg;
+            NL_CALL_RET(_errmsg, nl_geterror(err),
+                        "nl_geterror", "err=%d", err);
+            fprintf(stderr, "cmd_rename_interfaces: rename %s -> %s failed: %s\n",
+                    name, new_name, _errmsg);
+            NL_CALL_VOID(rtnl_link_put(change),
+                         "rtnl_link_put", "link=%p", (void *)change);
+            ret_code = -5;
+            NL_CALL_RET(_nl_iter, nl_cache_get_next((struct nl_object *)link),
+                        "nl_cache_get_next", "obj=%p", (void *)link);
+            link = (struct rtnl_link *)_nl_iter;
+            continue;
+        }
+
+        printf("%s -> %s\n", name, new_name);
+        NL_CALL_VOID(rtnl_link_put(change),
+                     "rtnl_link_put", "link=%p", (void *)change);
+
+        NL_CALL_RET(_nl_iter, nl_cache_get_next((struct nl_object *)link),
+                    "nl_cache_get_next", "obj=%p", (void *)link);
+        link = (struct rtnl_link *)_nl_iter;
+    }
+
+    NL_CALL_VOID(nl_cache_free(cache),
+                 "nl_cache_free", "cache=%p", (void *)cache);
+    NL_CALL_VOID(nl_socket_free(sock),
+                 "nl_socket_free", "sock=%p", (void *)sock);
+    return ret_code;
+}
+
+/*
+ * cmd_show_vlan - Display all existing VLAN interfaces and their basic properties
+ *
+ * Description:
+ *   Enumerates all network interfaces from the published link snapshot (or,
+ *   if none is available, via the Netlink ROUTE API) and filters those whose
+ *   kernel type is "vlan". For each VLAN interface, the following
+ *   properties are displayed:
+ *     - Interface name
+ *     - Parent interface name (resolved from the parent's ifindex)
+ *     - VLAN ID (802.1Q tag)
+ *     - VLAN flags (e.g. reorder-hdr, gvrp, loose-binding, mvrp, bridge-binding)
+ *
+ * Input parameters: none
+ *
+ * Output:
+ *   Prints a table with columns: NAME, PARENT, VLAN_ID, FLAGS
+ *
+ * Return value:
+ *    0  - success
+ *   -1  - failed to allocate netlink socket
+ *   -2  - failed to connect netlink socket to NETLINK_ROUTE
+ *   -3  - failed to allocate the link cache from the kernel
+ */
+int cmd_show_vlan()
+{
+    const struct vlan_snapshot *snap;
+    struct nl_sock *sock = NULL;
+    struct nl_cache *cache = NULL;
+    struct rtnl_link *link = NULL;
+    struct rtnl_link *parent_link = NULL;
+    struct nl_object *_nl_iter = NULL;
+    int _nl_err;
+
+    snap = vlan_state_read_begin();
+    if (snap)
+    {
+        printf("%-20s  %-20s  %-10s  %s\n", "NAME", "PARENT", "VLAN_ID", "FLAGS");
+        printf("%-20s  %-20s  %-10s  %s\n", "----", "------", "-------", "-----");
+
+        for (unsigned i = 0; i < snap->nlinks; i++)
+        {
+            const struct vs_link *l = &snap->links[i];
+            const struct vs_link *parent;
+            char flags_buf[128] = {0};
+
+            if (strcmp(l->kind, "vlan") != 0)
+                continue;
+
+            parent = vlan_snapshot_find_index(snap, l->parent);
+            rtnl_link_vlan_flags2str((int)l->vlan_flags, flags_buf, sizeof(flags_buf));
+            printf("%-20s  %-20s  %-10d  %s\n",
+                   l->name,
+                   parent ? parent->name : "-",
+                   l->vlan_id,
+                   flags_buf[0] ? flags_buf : "none");
+        }
+        printf("(snapshot generation %llu)\n", (unsigned long long)snap->generation);
+        vlan_state_read_end();
+        return 0;
+    }
+    vlan_state_read_end();
+
+    NL_CALL_RET(sock, nl_socket_alloc(),
+                "nl_socket_alloc", "");
+    if (!sock)
+    {
+        fprintf(stderr, "cmd_show_vlan: failed to allocate netlink socket\n");
+        return -1;
+    }
+
+    NL_CALL_RET(_nl_err, nl_connect(sock, NETLINK_ROUTE),
+                "nl_connect", "sock=%p, protocol=NETLINK_ROUTE", (void *)sock);
+    if (_nl_err < 0)
+    {
+        fprintf(stderr, "cmd_show_vlan: failed to connect netlink socket\n");
+        NL_CALL_VOID(nl_socket_free(sock),
+                     "nl_socket_free", "sock=%p", (void *)sock);
+        return -2;
+    }
+
+    NL_CALL_RET(_nl_err, rtnl_link_alloc_cache(sock, AF_UNSPEC, &cache),
+                "rtnl_link_alloc_cache",
+                "sock=%p, family=AF_UNSPEC, cache=%p",
+                (void *)sock, (void *)cache);
+    if (_nl_err < 0)
+    {
+        fprintf(stderr, "cmd_show_vlan: failed to allocate link cache\n");
+        NL_CALL_VOID(nl_socket_free(sock),
+                     "nl_socket_free", "sock=%p", (void *)sock);
+        return -3;
+    }
+
+    printf("%-20s  %-20s  %-10s  %s\n", "NAME", "PARENT", "VLAN_ID", "FLAGS");
+    printf("%-20s  %-20s  %-10s  %s\n", "----", "------", "-------", "-----");
+
+    NL_CALL_RET(_nl_iter, nl_cache_get_first(cache),
+                "nl_cache_get_first", "cache=%p", (void *)cache);
+    link = (struct rtnl_link *)_nl_iter;
+    while (link != NULL)
+    {
+        char flags_buf[128] = {0};
+        const char *parent_name = "-";
+        int parent_idx;
+        int vlan_id;
+        int _is_vlan;
+        uint32_t _vlan_flags;
+        const char *_name;
+
+        NL_CALL_RET(_is_vlan, rtnl_link_is_vlan(link),
+                    "rtnl_link_is_vlan", "link=%p", (void *)link);
+        if (!_is_vlan)
+        {
+            NL_CALL_RET(_nl_iter, nl_cache_get_next((struct nl_object *)link),
+                        "nl_cache_get_next", "obj=%p", (void *)link);
+            link = (struct rtnl_link *)_nl_iter;
+            continue;
+        }
+
+        NL_CALL_RET(vlan_id, rtnl_link_vlan_get_id(link),
+                    "rtnl_link_vlan_get_id", "link=%p", (void *)link);
+        NL_CALL_RET(parent_idx, rtnl_link_get_link(link),
+                    "rtnl_link_get_link", "link=%p", (void *)link);
+
+        NL_CALL_RET(parent_link, rtnl_link_get(cache, parent_idx),
+                    "rtnl_link_get", "cache=%p, idx=%d", (void *)cache, parent_idx);
+        if (parent_link)
+        {
+            NL_CALL_RET(parent_name, rtnl_link_get_name(parent_link),
+                        "rtnl_link_get_name", "link=%p", (void *)parent_link);
+        }
+
+        NL_CALL_RET(_vlan_flags, (uint32_t)rtnl_link_vlan_get_flags(link),
+                    "rtnl_link_vlan_get_flags", "link=%p", (void *)link);
+        NL_CALL_VOID(rtnl_link_vlan_flags2str((int)_vlan_flags, flags_buf, sizeof(flags_buf)),
+                     "rtnl_link_vlan_flags2str",
+                     "flags=%u, buf=%p, len=%zu",
+                     _vlan_flags, (void *)flags_buf, sizeof(flags_buf));
+
+        NL_CALL_RET(_name, rtnl_link_get_name(link),
+                    "rtnl_link_get_name", "link=%p", (void *)link);
+
+        printf("%-20s  %-20s  %-10d  %s\n",
+               _name,
+               parent_name,
+               vlan_id,
+               flags_buf[0] ? flags_buf : "none");
+
+        if (parent_link)
+        {
+            NL_CALL_VOID(rtnl_link_put(parent_link),
+                         "rtnl_link_put", "link=%p", (void *)parent_link);
+            parent_link = NULL;
+        }
+
+        NL_CALL_RET(_nl_iter, nl_cache_get_next((struct nl_object *)link),
+                    "nl_cache_get_next", "obj=%p", (void *)link);
+        link = (struct rtnl_link *)_nl_iter;
+    }
+
+    NL_CALL_VOID(nl_cache_free(cache),
+                 "nl_cache_free", "cache=%p", (void *)cache);
+    NL_CALL_VOID(nl_socket_free(sock),
+                 "nl_socket_free", "sock=%p", (void *)sock);
+    return 0;
+}
+
+/*
+ * cmd_set_vlan_on_interface - Add a VLAN sub-interface to a network interface
+ *
+ * Description:
+ *   Creates a new kernel "vlan"-type link on top of the specified parent
+ *   interface using the Netlink ROUTE API (RTM_NEWLINK). The new interface is
+ *   named "<iface>.<ver>" (e.g. "Ethernet56.v2"). The `type` string (e.g.
+ *   "l2-trunk") is stored as the link alias so that cmd_set_vlan() can later
+ *   locate this interface by `ver`. A placeholder VLAN ID of 1 is used at
+ *   creation time; the actual ID should be set afterwards with cmd_set_vlan().
+ *
+ * Input parameters:
+ *   iface  - parent interface name (e.g. "Ethernet56"); must already exist
+ *   type   - VLAN type string (e.g. "l2-trunk", "l2-access"); stored as alias
+ *   ver    - VLAN version/name used as the new interface name suffix (e.g. "v2")
+ *
+ * Output:
+ *   On success, prints:
+ *     Created VLAN interface <iface>.<ver> (type=<type>) on <iface>
+ *
+ * Return value:
+ *    0  - success
+ *   -1  - iface, type, or ver is NULL
+ *   -2  - failed to allocate netlink socket
+ *   -3  - failed to connect netlink socket to NETLINK_ROUTE
+ *   -4  - failed to allocate the link cache from the kernel
+ *   -5  - parent interface not found in the cache
+ *   -6  - failed to allocate the new VLAN link object
+ *   -7  - RTM_NEWLINK failed (kernel error creating VLAN link)
+ */
+int cmd_set_vlan_on_interface(char* iface, char* type, char* ver)
+{
+    struct nl_sock *sock = NULL;
+    struct nl_cache *cache = NULL;
+    struct rtnl_link *parent = NULL;
+    struct rtnl_link *vlan_link = NULL;
+    char vlan_ifname[IFNAMSIZ];
+    int err;
+    int _nl_err;
+    int _parent_idx;
+
+    if (!iface || !type || !ver)
+    {
+        fprintf(stderr, "cmd_set_vlan_on_interface: iface, type, or ver is NULL\n");
+        return -1;
+    }
+
+    NL_CALL_RET(sock, nl_socket_alloc(),
+                "nl_socket_alloc", "");
+    if (!sock)
+    {
+        fprintf(stderr, "cmd_set_vlan_on_interface: failed to allocate netlink socket\n");
+        return -2;
+    }
+
+    NL_CALL_RET(_nl_err, nl_connect(sock, NETLINK_ROUTE),
+                "nl_connect", "sock=%p, protocol=NETLINK_ROUTE", (void *)sock);
+    if (_nl_err < 0)
+    {
+        fprintf(stderr, "cmd_set_vlan_on_interface: failed to connect netlink socket\n");
+        NL_CALL_VOID(nl_socket_free(sock),
+                     "nl_socket_free", "sock=%p", (void *)sock);
+        return -3;
+    }
+
+    NL_CALL_RET(_nl_err, rtnl_link_alloc_cache(sock, AF_UNSPEC, &cache),
+                "rtnl_link_alloc_cache",
+                "sock=%p, family=AF_UNSPEC, cache=%p",
+                (void *)sock, (void *)cache);
+    if (_nl_err < 0)
+    {
+        fprintf(stderr, "cmd_set_vlan_on_interface: failed to allocate link cache\n");
+        NL_CALL_VOID(nl_socket_free(sock),
+                     "nl_socket_free", "sock=%p", (void *)sock);
+        return -4;
+    }
+
+    NL_CALL_RET(parent, rtnl_link_get_by_name(cache, iface),
+                "rtnl_link_get_by_name", "cache=%p, name=\"%s\"",
+                (void *)cache, iface);
+    if (!parent)
+    {
+        fprintf(stderr, "cmd_set_vlan_on_interface: interface '%s' not found\n", iface);
+        NL_CALL_VOID(nl_cache_free(cache),
+                     "nl_cache_free", "cache=%p", (void *)cache);
+        NL_CALL_VOID(nl_socket_free(sock),
+                     "nl_socket_free", "sock=%p", (void *)sock);
+        return -5;
+    }
+
+    snprintf(vlan_ifname, sizeof(vlan_ifname), "%s.%s", iface, ver);
+
+    /* rtnl_link_vlan_alloc() allocates a link pre-configured as type "vlan" */
+    NL_CALL_RET(vlan_link, rtnl_link_vlan_alloc(),
+                "rtnl_link_vlan_alloc", "");
+    if (!vlan_link)
+    {
+        fprintf(stderr, "cmd_set_vlan_on_interface: failed to allocate VLAN link object\n");
+        NL_CALL_VOID(rtnl_link_put(parent),
+                     "rtnl_link_put", "link=%p", (void *)parent);
+        NL_CALL_VOID(nl_cache_free(cache),
+                     "nl_cache_free", "cache=%p", (void *)cache);
+        NL_CALL_VOID(nl_socket_free(sock),
+                     "nl_socket_free", "sock=%p", (void *)sock);
+        return -6;
+    }
+
+    NL_CALL_VOID(rtnl_link_set_name(vlan_link, vlan_ifname),
+                 "rtnl_link_set_name", "link=%p, name=\"%s\"",
+                 (void *)vlan_link, vlan_ifname);
+
+    NL_CALL_RET(_parent_idx, rtnl_link_get_ifindex(parent),
+                "rtnl_link_get_ifindex", "link=%p", (void *)parent);
+    NL_CALL_VOID(rtnl_link_set_link(vlan_link, _parent_idx),
+                 "rtnl_link_set_link", "link=%p, idx=%d",
+                 (void *)vlan_link, _parent_idx);
+
+    NL_CALL_VOID(rtnl_link_set_ifalias(vlan_link, type),
+                 "rtnl_link_set_ifalias", "link=%p, alias=\"%s\"",
+                 (void *)vlan_link, type);
+
+    /* Use placeholder VLAN ID 1; the real ID is set later by cmd_set_vlan() */
+    NL_CALL_VOID(rtnl_link_vlan_set_id(vlan_link, 1),
+                 "rtnl_link_vlan_set_id", "link=%p, id=1", (void *)vlan_link);
+
+    NL_CALL_RET(err, rtnl_link_add(sock, vlan_link, NLM_F_CREATE),
+                "rtnl_link_add",
+                "sock=%p, link=%p, flags=NLM_F_CREATE",
+                (void *)sock, (void *)vlan_link);
+    if (err < 0)
+    {
+        const char *_errmsg;
+        NL_CALL_RET(_errmsg, nl_geterror(err),
+                    "nl_geterror", "err=%d", err);
+        fprintf(stderr, "cmd_set_vlan_on_interface: failed to create VLAN interface %s: %s\n",
+                vlan_ifname, _errmsg);
+        NL_CALL_VOID(rtnl_link_put(vlan_link),
+                     "rtnl_link_put", "link=%p", (void *)vlan_link);
+        NL_CALL_VOID(rtnl_link_put(parent),
+                     "rtnl_link_put", "link=%p", (void *)parent);
+        NL_CALL_VOID(nl_cache_free(cache),
+                     "nl_cache_free", "cache=%p", (void *)cache);
+        NL_CALL_VOID(nl_socket_free(sock),
+                     "nl_socket_free", "sock=%p", (void *)sock);
+        return -7;
+    }
+
+    printf("Created VLAN interface %s (type=%s) on %s\n", vlan_ifname, type, iface);
+
+    NL_CALL_VOID(rtnl_link_put(vlan_link),
+                 "rtnl_link_put", "link=%p", (void *)vlan_link);
+    NL_CALL_VOID(rtnl_link_put(parent),
+                 "rtnl_link_put", "link=%p", (void *)parent);
+    NL_CALL_VOID(nl_cache_free(cache),
+                 "nl_cache_free", "cache=%p", (void *)cache);
+    NL_CALL_VOID(nl_socket_free(sock),
+                 "nl_socket_free", "sock=%p", (void *)sock);
+    return 0;
+}
+
+/*
+ * cmd_set_vlan - Set the VLAN ID on an existing VLAN interface
+ *
+ * Description:
+ *   Searches the kernel link cache for VLAN interfaces that match the version
+ *   identifier `ver`. Matching is performed in two ways:
+ *     1. The link alias equals `ver` (set by cmd_set_vlan_on_interface).
+ *     2. The interface name ends with ".<ver>" (e.g. "Ethernet56.v2" for ver="v2").
+ *   For every matching VLAN interface, the VLAN ID is updated to the numeric
+ *   value of `id` using RTM_SETLINK (rtnl_link_change). Prints the result for
+ *   each interface updated.
+ *
+ * Input parameters:
+ *   ver  - VLAN version/name string used to identify the VLAN (e.g. "v2");
+ *          must match the alias or name suffix of an existing VLAN interface
+ *   id   - VLAN ID as a decimal string (e.g. "2"); valid range: 1-4094
+ *
+ * Output:
+ *   For each updated interface, prints:
+ *     Set VLAN ID <id> on <name> (ver=<ver>)
+ *
+ * Return value:
+ *    0  - success (at least one VLAN interface updated)
+ *   -1  - ver or id is NULL, or id is outside the valid range 1-4094
+ *   -2  - failed to allocate netlink socket
+ *   -3  - failed to connect netlink socket to NETLINK_ROUTE
+ *   -4  - failed to allocate the link cache from the kernel
+ *   -5  - no VLAN interface matching `ver` was found
+ *   -6  - one or more RTM_SETLINK operations failed (kernel error)
+ */
+int cmd_set_vlan(char* ver, char* id)
+{
+    struct nl_sock *sock = NULL;
+    struct nl_cache *cache = NULL;
+    struct rtnl_link *link = NULL;
+    struct rtnl_link *change = NULL;
+    struct nl_object *_nl_iter = NULL;
+    int vlan_id;
+    int found = 0;
+    int ret_code = 0;
+    int _nl_err;
+
+    if (!ver || !id)
+    {
+        fprintf(stderr, "cmd_set_vlan: ver or id is NULL\n");
+        return -1;
+    }
+
+    vlan_id = atoi(id);
+    if (vlan_id < 1 || vlan_id > 4094)
+    {
+        fprintf(stderr, "cmd_set_vlan: VLAN ID '%s' is out of valid range 1-4094\n", id);
+        return -1;
+    }
+
+    NL_CALL_RET(sock, nl_socket_alloc(),
+                "nl_socket_alloc", "");
+    if (!sock)
+    {
+        fprintf(stderr, "cmd_set_vlan: failed to allocate netlink socket\n");
+        return -2;
+    }
+
+    NL_CALL_RET(_nl_err, nl_connect(sock, NETLINK_ROUTE),
+                "nl_connect", "sock=%p, protocol=NETLINK_ROUTE", (void *)sock);
+    if (_nl_err < 0)
+    {
+        fprintf(stderr, "cmd_set_vlan: failed to connect netlink socket\n");
+        NL_CALL_VOID(nl_socket_free(sock),
+                     "nl_socket_free", "sock=%p", (void *)sock);
+        return -3;
+    }
+
+    NL_CALL_RET(_nl_err, rtnl_link_alloc_cache(sock, AF_UNSPEC, &cache),
+                "rtnl_link_alloc_cache",
+                "sock=%p, family=AF_UNSPEC, cache=%p",
+                (void *)sock, (void *)cache);
+    if (_nl_err < 0)
+    {
+        fprintf(stderr, "cmd_set_vlan: failed to allocate link cache\n");
+        NL_CALL_VOID(nl_socket_free(sock),
+                     "nl_socket_free", "sock=%p", (void *)sock);
+        return -4;
+    }
+
+    NL_CALL_RET(_nl_iter, nl_cache_get_first(cache),
+                "nl_cache_get_first", "cache=%p", (void *)cache);
+    link = (struct rtnl_link *)_nl_iter;
+    while (link != NULL)
+    {
+        const char *alias;
+        const char *name;
+        const char *dot;
+        int alias_match = 0;
+        int suffix_match = 0;
+        int err;
+        int _is_vlan;
+
+        NL_CALL_RET(_is_vlan, rtnl_link_is_vlan(link),
+                    "rtnl_link_is_vlan", "link=%p", (void *)link);
+        if (!_is_vlan)
+        {
+            NL_CALL_RET(_nl_iter, nl_cache_get_next((struct nl_object *)link),
+                        "nl_cache_get_next", "obj=%p", (void *)link);
+            link = (struct rtnl_link *)_nl_iter;
+            continue;
+        }
+
+        NL_CALL_RET(alias, rtnl_link_get_ifalias(link),
+                    "rtnl_link_get_ifalias", "link=%p", (void *)link);
+        NL_CALL_RET(name, rtnl_link_get_name(link),
+                    "rtnl_link_get_name", "link=%p", (void *)link);
+
+        if (alias && strcmp(alias, ver) == 0)
+            alias_match = 1;
+
+        if (name)
+        {
+            dot = strrchr(name, '.');
+            if (dot && strcmp(dot + 1, ver) == 0)
+                suffix_match = 1;
+        }
+
+        if (!alias_match && !suffix_match)
+        {
+            NL_CALL_RET(_nl_iter, nl_cache_get_next((struct nl_object *)link),
+                        "nl_cache_get_next", "obj=%p", (void *)link);
+            link = (struct rtnl_link *)_nl_iter;
+            continue;
+        }
+
+        /* Build a minimal change object containing only the new VLAN ID */
+        NL_CALL_RET(change, rtnl_link_vlan_alloc(),
+                    "rtnl_link_vlan_alloc", "");
+        if (!change)
+        {
+            fprintf(stderr, "cmd_set_vlan: failed to allocate change link for %s\n",
+                    name ? name : "?");
+            ret_code = -6;
+            break;
+        }
+
+        NL_CALL_VOID(rtnl_link_vlan_set_id(change, vlan_id),
+                     "rtnl_link_vlan_set_id", "link=%p, id=%d",
+                     (void *)change, vlan_id);
+
+        NL_CALL_RET(err, rtnl_link_change(sock, link, change, 0),
+                    "rtnl_link_change",
+                    "sock=%p, link=%p, change=%p, flags=0",
+                    (void *)sock, (void *)link, (void *)change);
+        if (err < 0)
+        {
+            const char *_errmsg;
+            NL_CALL_RET(_errmsg, nl_geterror(err),
+                        "nl_geterror", "err=%d", err);
+            fprintf(stderr, "cmd_set_vlan: failed to set VLAN ID %d on %s: %s\n",
+                    vlan_id, name ? name : "?", _errmsg);
+            NL_CALL_VOID(rtnl_link_put(change),
+                         "rtnl_link_put", "link=%p", (void *)change);
+            ret_code = -6;
+            NL_CALL_RET(_nl_iter, nl_cache_get_next((struct nl_object *)link),
+                        "nl_cache_get_next", "obj=%p", (void *)link);
+            link = (struct rtnl_link *)_nl_iter;
+            continue;
+        }
+
+        printf("Set VLAN ID %d on %s (ver=%s)\n", vlan_id, name ? name : "?", ver);
+        NL_CALL_VOID(rtnl_link_put(change),
+                     "rtnl_link_put", "link=%p", (void *)change);
+        found = 1;
+
+        NL_CALL_RET(_nl_iter, nl_cache_get_next((struct nl_object *)link),
+                    "nl_cache_get_next", "obj=%p", (void *)link);
+        link = (struct rtnl_link *)_nl_iter;
+    }
+
+    if (!found && ret_code == 0)
+    {
+        fprintf(stderr, "cmd_set_vlan: no VLAN interface found matching ver='%s'\n", ver);
+        ret_code = -5;
+    }
+
+    NL_CALL_VOID(nl_cache_free(cache),
+                 "nl_cache_free", "cache=%p", (void *)cache);
+    NL_CALL_VOID(nl_socket_free(sock),
+                 "nl_socket_free", "sock=%p", (void *)sock);
+    return ret_code;
+}
+
+/*
+ * cmd_show_scheduler - Display per-queue metrics of the command worker pool
+ *
+ * Output:
+ *   Prints a table with columns: QUEUE, DEPTH, MAX_DEPTH, SUBMITTED, COMPLETED
+ *
+ * Return value:
+ *    0  - success
+ *   -1  - the worker pool is not running
+ */
+int cmd_show_scheduler()
+{
+    struct sched_queue_stats st;
+    unsigned n = sched_queue_count();
+    unsigned q;
+
+    if (n == 0)
+    {
+        fprintf(stderr, "cmd_show_scheduler: worker pool is not running\n");
+        return -1;
+    }
+
+    printf("%-6s  %-6s  %-10s  %-12s  %s\n",
+           "QUEUE", "DEPTH", "MAX_DEPTH", "SUBMITTED", "COMPLETED");
+    printf("%-6s  %-6s  %-10s  %-12s  %s\n",
+           "-----", "-----", "---------", "---------", "---------");
+
+    for (q = 0; q < n; q++)
+    {
+        if (sched_get_stats(q, &st) < 0)
+            continue;
+        printf("%-6u  %-6u  %-10u  %-12llu  %llu\n",
+               q, st.depth, st.max_depth,
+               (unsigned long long)st.submitted,
+               (unsigned long long)st.completed);
+    }
+    return 0;
+}
+
+/*
+ * cmd_exec - Execute a configuration file
+ *
+ * Description:
+ *   Loads `path` with the bulk configuration loader (cfg_load.c): VLAN
+ *   create/delete/add/remove lines are sent to the kernel in Netlink batches,
+ *   every other line goes through process_command() in file order.  Runs as
+ *   a SCHED_KEY_ALL job, so no other command interleaves with the file.
+ *
+ * Output:
+ *   Per-line errors as "<path>:<line>: <message>" on stderr, then a summary.
+ *
+ * Return value:
+ *    0  - every line succeeded
+ *   -1  - the file could not be read or the batch could not be set up
+ *   -2  - at least one line failed
+ */
+int cmd_exec(const char *path)
+{
+    struct cfg_stats st;
+    int err;
+
+    err = cfg_exec(path, process_command, &st);
+    if (err < 0 && err != -EIO)
+    {
+        fprintf(stderr, "cmd_exec: cannot execute %s: %s\n", path, strerror(-err));
+        return -1;
+    }
+
+    printf("exec %s: %zu lines, %zu commands, %zu VLAN ops in %zu transactions, "
+           "%zu other, %zu errors, %.3f ms\n",
+           path, st.lines, st.commands, st.batched, st.transactions,
+           st.fallback, st.errors, st.elapsed_ms);
+    if (st.errors)
+        printf("exec %s: first error at line %u\n", path, st.first_error);
+
+    return err < 0 ? -2 : 0;
+}
+
+/*
+ * cmd_show_dataplane - Display the user-space forwarding plane
+ *
+ * Output:
+ *   The workers' total frame count, CPU time and rate per core, the frames
+ *   routed between VLANs and the routable frames dropped (no route or
+ *   neighbor, or TTL expiring), one row per worker (WORKER, CPU, FRAMES,
+ *   BURSTS, CPU_S, MPPS), the packet buffer
+ *   pool's occupancy and exhaustion count, then one row per attached port:
+ *   PORT, IFINDEX, VLAN, IO, RX, RX_DROP, TX, TX_DROP.  IO is the port's
+ *   backend: tpacket, xdp-drv (AF_XDP, program in the driver) or xdp-skb
+ *   (AF_XDP, generic XDP)
+ *
+ * Return value:
+ *    0  - success
+ *   -1  - the forwarding plane is not running (start the daemon with -D)
+ */
+int cmd_show_dataplane()
+{
+    struct dp_worker_stats ws;
+    struct dp_port_info pi;
+    struct dpp_stats ps;
+    unsigned slot, k;
+
+    if (dp_get_worker_stats(&ws) < 0)
+    {
+        fprintf(stderr, "cmd_show_dataplane: forwarding plane is not running\n");
+        return -1;
+    }
+
+    printf("workers: %u, %llu frames in %llu bursts, cpu %.3f s, %.3f Mpps per core\n",
+           dp_workers(), (unsigned long long)ws.packets, (unsigned long long)ws.bursts,
+           ws.cpu_ns / 1e9, ws.cpu_ns ? ws.packets * 1e3 / ws.cpu_ns : 0.0);
+    printf("routed: %llu, route drops %llu, acl drops %llu, storm drops %llu\n",
+           (unsigned long long)ws.routed, (unsigned long long)ws.route_drops,
+           (unsigned long long)ws.acl_drops, (unsigned long long)ws.storm_drops);
+    printf("multicast: %llu floods pruned by snooping, %llu snooping queue overruns\n",
+           (unsigned long long)ws.mcast_pruned, (unsigned long long)ws.snoop_overruns);
+    printf("lag: %llu frames dropped without a member up\n", (unsigned long long)ws.lag_drops);
+    printf("mirror: %llu copies dropped on full rings\n", (unsigned long long)ws.mirror_drops);
+
+    printf("%-6s  %-4s  %-12s  %-10s  %-8s  %s\n",
+           "WORKER", "CPU", "FRAMES", "BURSTS", "CPU_S", "MPPS");
+    printf("%-6s  %-4s  %-12s  %-10s  %-8s  %s\n",
+           "------", "---", "------", "------", "-----", "----");
+    for (k = 0; dp_get_worker(k, &ws) == 0; k++)
+    {
+        char cpu[8];
+
+        if (ws.cpu >= 0)
+            snprintf(cpu, sizeof(cpu), "%d", ws.cpu);
+        else
+            snprintf(cpu, sizeof(cpu), "-");
+        printf("%-6u  %-4s  %-12llu  %-10llu  %-8.3f  %.3f\n",
+               k, cpu, (unsigned long long)ws.packets, (unsigned long long)ws.bursts,
+               ws.cpu_ns / 1e9, ws.cpu_ns ? ws.packets * 1e3 / ws.cpu_ns : 0.0);
+    }
+    printf("\n");
+
+    if (dp_get_pool_stats(&ps) == 0)
+    {
+        printf("buffers: %u x %u bytes on %s, %u in use, %u cached, %u free (low %u), "
+               "%llu exhausted\n\n",
+               ps.nbufs, ps.buf_size, ps.hugepages ? "2 MB hugepages" : "normal pages",
+               ps.in_use, ps.cached, ps.avail, ps.min_avail,
+               (unsigned long long)ps.exhausted);
+    }
+
+    printf("%-16s  %-7s  %-5s  %-7s  %-12s  %-8s  %-12s  %s\n",
+           "PORT", "IFINDEX", "VLAN", "IO", "RX", "RX_DROP", "TX", "TX_DROP");
+    printf("%-16s  %-7s  %-5s  %-7s  %-12s  %-8s  %-12s  %s\n",
+           "----", "-------", "----", "--", "--", "-------", "--", "-------");
+
+    for (slot = 0; slot < DP_MAX_PORTS; slot++)
+    {
+        if (dp_get_port(slot, &pi) < 0)
+            continue;
+        printf("%-16s  %-7d  %-5u  %-7s  %-12llu  %-8llu  %-12llu  %llu\n",
+               pi.name, pi.ifindex, (unsigned)pi.vid,
+               pi.io == DP_IO_XDP_DRV ? "xdp-drv" : pi.io == DP_IO_XDP_SKB ? "xdp-skb" : "tpacket",
+               (unsigned long long)pi.stats.rx_packets,
+               (unsigned long long)pi.stats.rx_dropped,
+               (unsigned long long)pi.stats.tx_packets,
+               (unsigned long long)pi.stats.tx_dropped);
+    }
+    return 0;
+}
+
+/*
+ * cmd_show_interfaces_counters - Display per-port traffic counters and rates
+ *
+ * Description:
+ *   Totals are summed over the forwarding workers' counter shards at the
+ *   time of the command; rates are taken from the last two periodic
+ *   snapshots (DPS_DEFAULT_INTERVAL_MS apart) and read zero until two
+ *   snapshots exist.
+ *
+ * Output:
+ *   One row per attached port: PORT, then RX and TX packets, bytes, drops,
+ *   packets per second and megabits per second
+ *
+ * Return value:
+ *    0  - success
+ *   -1  - the forwarding plane is not running (start the daemon with -D)
+ */
+int cmd_show_interfaces_counters()
+{
+    struct dp_port_info pi;
+    unsigned slot;
+
+    if (!dp_running())
+    {
+        fprintf(stderr, "cmd_show_interfaces_counters: forwarding plane is not running\n");
+        return -1;
+    }
+
+    printf("%-16s  %12s  %14s  %8s  %10s  %8s  %12s  %14s  %8s  %10s  %8s\n",
+           "PORT", "RX_PKTS", "RX_BYTES", "RX_DROP", "RX_PPS", "RX_MBPS",
+           "TX_PKTS", "TX_BYTES", "TX_DROP", "TX_PPS", "TX_MBPS");
+    printf("%-16s  %12s  %14s  %8s  %10s  %8s  %12s  %14s  %8s  %10s  %8s\n",
+           "----", "-------", "--------", "-------", "------", "-------",
+           "-------", "--------", "-------", "------", "-------");
+
+    for (slot = 0; slot < DP_MAX_PORTS; slot++)
+    {
+        if (dp_get_port(slot, &pi) < 0)
+            continue;
+        printf("%-16s  %12llu  %14llu  %8llu  %10.0f  %8.2f  %12llu  %14llu  %8llu  %10.0f  %8.2f\n",
+               pi.name,
+               (unsigned long long)pi.stats.rx_packets, (unsigned long long)pi.stats.rx_bytes,
+               (unsigned long long)pi.stats.rx_dropped, pi.rate.rx_pps, pi.rate.rx_bps / 1e6,
+               (unsigned long long)pi.stats.tx_packets, (unsigned long long)pi.stats.tx_bytes,
+               (unsigned long long)pi.stats.tx_dropped, pi.rate.tx_pps, pi.rate.tx_bps / 1e6);
+    }
+    return 0;
+}
+
+/*
+ * cmd_show_vlan_counters - Display per-VLAN traffic counters and rates
+ *
+ * Description:
+ *   Lists every VLAN that has member ports in the forwarding plane or has
+ *   seen traffic.  RX counts frames classified into the VLAN, TX counts
+ *   copies sent to its member ports (a flooded frame counts once per
+ *   port), RX_DROP counts tagged frames of the VLAN that arrived on a port
+ *   not carrying it.  Rates as for "show interfaces counters".
+ *
+ * Return value:
+ *    0  - success
+ *   -1  - the forwarding plane is not running (start the daemon with -D)
+ */
+int cmd_show_vlan_counters()
+{
+    struct dp_vlan_info vi;
+    unsigned vid;
+
+    if (!dp_running())
+    {
+        fprintf(stderr, "cmd_show_vlan_counters: forwarding plane is not running\n");
+        return -1;
+    }
+
+    printf("%-5s  %5s  %12s  %14s  %8s  %10s  %12s  %14s  %8s  %10s\n",
+           "VLAN", "PORTS", "RX_PKTS", "RX_BYTES", "RX_DROP", "RX_PPS",
+           "TX_PKTS", "TX_BYTES", "TX_DROP", "TX_PPS");
+    printf("%-5s  %5s  %12s  %14s  %8s  %10s  %12s  %14s  %8s  %10s\n",
+           "----", "-----", "-------", "--------", "-------", "------",
+           "-------", "--------", "-------", "------");
+
+    for (vid = 1; vid <= 4094; vid++)
+    {
+        if (dp_get_vlan((uint16_t)vid, &vi) < 0)
+            return -1;
+        if (vi.nports == 0 && vi.stats.rx_packets == 0 && vi.stats.rx_dropped == 0)
+            continue;
+        printf("%-5u  %5u  %12llu  %14llu  %8llu  %10.0f  %12llu  %14llu  %8llu  %10.0f\n",
+               vid, vi.nports,
+               (unsigned long long)vi.stats.rx_packets, (unsigned long long)vi.stats.rx_bytes,
+               (unsigned long long)vi.stats.rx_dropped, vi.rate.rx_pps,
+               (unsigned long long)vi.stats.tx_packets, (unsigned long long)vi.stats.tx_bytes,
+               (unsigned long long)vi.stats.tx_dropped, vi.rate.tx_pps);
+    }
+    return 0;
+}
+
+struct mac_table_ctx
+{
+    char names[DP_MAX_PORTS][IFNAMSIZ];
+};
+
+static void print_mac_entry(const struct fdb_entry *e, void *arg)
+{
+    struct mac_table_ctx *ctx = arg;
+
+    printf("%-5u  %02x:%02x:%02x:%02x:%02x:%02x  %-16s  %-8s  %u\n",
+           (unsigned)e->vid, e->mac[0], e->mac[1], e->mac[2], e->mac[3], e->mac[4], e->mac[5],
+           e->port < DP_MAX_PORTS && ctx->names[e->port][0] ? ctx->names[e->port] : "?",
+           "dynamic", e->age_s);
+}
+
+/*
+ * cmd_show_mac_address_table - Display the forwarding plane's learned MACs
+ *
+ * Reads the FDB concurrently with the forwarding worker; the worker is never
+ * blocked, and an entry being moved at that instant may be missing from the
+ * listing.
+ *
+ * Arguments:
+ *   vid - VLAN to list (1..4094), or -1 for all VLANs
+ *
+ * Output:
+ *   One row per entry: VLAN, MAC ADDRESS, PORT, TYPE, AGE (seconds), then
+ *   the entry total and the learning / move / aging counters
+ *
+ * Return value:
+ *    0  - success
+ *   -1  - the forwarding plane is not running (start the daemon with -D)
+ *   -2  - invalid VLAN ID
+ */
+int cmd_show_mac_address_table(int vid)
+{
+    struct mac_table_ctx ctx;
+    struct dp_port_info pi;
+    struct fdb_stats st;
+    unsigned slot;
+    int n;
+
+    if (vid != -1 && (vid < 1 || vid > 4094))
+    {
+        fprintf(stderr, "cmd_show_mac_address_table: invalid VLAN ID %d\n", vid);
+        return -2;
+    }
+    if (!dp_running())
+    {
+        fprintf(stderr, "cmd_show_mac_address_table: forwarding plane is not running\n");
+        return -1;
+    }
+
+    memset(&ctx, 0, sizeof(ctx));
+    for (slot = 0; slot < DP_MAX_PORTS; slot++)
+    {
+        if (dp_get_port(slot, &pi) == 0)
+            memcpy(ctx.names[slot], pi.lag[0] ? pi.lag : pi.name, IFNAMSIZ);
+    }
+
+    printf("%-5s  %-17s  %-16s  %-8s  %s\n", "VLAN", "MAC ADDRESS", "PORT", "TYPE", "AGE");
+    printf("%-5s  %-17s  %-16s  %-8s  %s\n", "----", "-----------", "----", "----", "---");
+    n = dp_fdb_dump(vid, print_mac_entry, &ctx);
+    if (n < 0)
+        return -1;
+
+    dp_fdb_get_stats(&st);
+    printf("Total entries: %d\n", n);
+    printf("learned %llu, moves %llu, aged %llu, flushed %llu, table full %llu\n",
+           (unsigned long long)st.learned, (unsigned long long)st.moves,
+           (unsigned long long)st.aged, (unsigned long long)st.flushed,
+           (unsigned long long)st.full);
+    return 0;
+}
+
+static void print_route(uint32_t prefix, unsigned len, uint32_t gw, uint16_t vid, void *arg)
+{
+    char dst[INET_ADDRSTRLEN + 3];
+    char via[INET_ADDRSTRLEN];
+    struct in_addr a;
+    char svi[16];
+
+    (void)arg;
+    a.s_addr = htonl(prefix);
+    inet_ntop(AF_INET, &a, dst, INET_ADDRSTRLEN);
+    snprintf(dst + strlen(dst), sizeof(dst) - strlen(dst), "/%u", len);
+    a.s_addr = htonl(gw);
+    if (gw)
+        inet_ntop(AF_INET, &a, via, sizeof(via));
+    else
+        snprintf(via, sizeof(via), "connected");
+    snprintf(svi, sizeof(svi), "Vlan%u", (unsigned)vid);
+    printf("%-18s  %-15s  %s\n", dst, via, svi);
+}
+
+static void print_neighbor(uint32_t addr, uint16_t vid, const uint8_t *mac, void *arg)
+{
+    char ip[INET_ADDRSTRLEN];
+    struct in_addr a;
+    char svi[16];
+
+    (void)arg;
+    a.s_addr = htonl(addr);
+    inet_ntop(AF_INET, &a, ip, sizeof(ip));
+    snprintf(svi, sizeof(svi), "Vlan%u", (unsigned)vid);
+    printf("%-15s  %02x:%02x:%02x:%02x:%02x:%02x  %s\n",
+           ip, mac[0], mac[1], mac[2], mac[3], mac[4], mac[5], svi);
+}
+
+/*
+ * cmd_show_ip_route - Display the forwarding plane's IPv4 routing table
+ *
+ * Lists the routes mirrored from the kernel's main table that leave
+ * through a Vlan<id> SVI.
+ *
+ * Output:
+ *   One row per route: PREFIX, NEXT HOP ("connected" for a directly
+ *   attached subnet), INTERFACE; then the table's occupancy and memory
+ *
+ * Return value:
+ *    0  - success
+ *   -1  - the routing tables are not running (start the daemon with -D)
+ */
+int cmd_show_ip_route()
+{
+    struct l3_stats st;
+
+    if (l3_get_stats(&st) < 0)
+    {
+        fprintf(stderr, "cmd_show_ip_route: routing tables are not running\n");
+        return -1;
+    }
+
+    printf("%-18s  %-15s  %s\n", "PREFIX", "NEXT HOP", "INTERFACE");
+    printf("%-18s  %-15s  %s\n", "------", "--------", "---------");
+    l3_route_walk(print_route, NULL);
+    printf("Total routes: %u (%u next hops), %u/%u long-prefix groups, %.1f MB%s\n",
+           st.routes, st.nexthops, st.lpm.groups_used, st.lpm.groups,
+           (double)st.lpm.bytes / (1 << 20), st.lpm.hugepages ? " on hugepages" : "");
+    printf("route updates %llu, ignored %llu\n",
+           (unsigned long long)st.route_updates, (unsigned long long)st.ignored);
+    return 0;
+}
+
+/*
+ * cmd_show_ip_neighbors - Display the forwarding plane's ARP table
+ *
+ * Output:
+ *   One row per resolved neighbor: ADDRESS, MAC ADDRESS, INTERFACE; then
+ *   the neighbor total and update count
+ *
+ * Return value:
+ *    0  - success
+ *   -1  - the routing tables are not running (start the daemon with -D)
+ */
+int cmd_show_ip_neighbors()
+{
+    struct l3_stats st;
+
+    if (l3_get_stats(&st) < 0)
+    {
+        fprintf(stderr, "cmd_show_ip_neighbors: routing tables are not running\n");
+        return -1;
+    }
+
+    printf("%-15s  %-17s  %s\n", "ADDRESS", "MAC ADDRESS", "INTERFACE");
+    printf("%-15s  %-17s  %s\n", "-------", "-----------", "---------");
+    l3_neigh_walk(print_neighbor, NULL);
+    printf("Total neighbors: %u, neighbor updates %llu\n",
+           st.neighbors, (unsigned long long)st.neigh_updates);
+    return 0;
+}
+
+static int parse_mac(const char *s, uint8_t *mac)
+{
+    unsigned b[6];
+    int i;
+
+    if (sscanf(s, "%x:%x:%x:%x:%x:%x", &b[0], &b[1], &b[2], &b[3], &b[4], &b[5]) != 6)
+        return -1;
+    for (i = 0; i < 6; i++)
+    {
+        if (b[i] > 0xFF)
+            return -1;
+        mac[i] = (uint8_t)b[i];
+    }
+    return 0;
+}
+
+/*
+ * cmd_bridge_fdb_static - Add or delete static MAC entries on a Vlan<id>
+ * bridge
+ *
+ * "bridge fdb add|del <mac> vlan <id> interface <port> [count <n>]" pins
+ * (or unpins) <mac> and the n - 1 addresses following it to the port, all
+ * in one batch of Netlink requests.  Entries that fail are listed with
+ * their error.
+ *
+ * Input parameters:
+ *   mac   - first address, aa:bb:cc:dd:ee:ff
+ *   vlan  - VLAN ID (1..4094)
+ *   port  - member port of Vlan<vlan>
+ *   count - number of consecutive addresses (1..65536), or NULL for one
+ *   add   - 1 to add, 0 to delete
+ *
+ * Return value:
+ *    0  - every entry succeeded
+ *   -1  - bad argument or out of memory
+ *   -2  - at least one entry failed
+ */
+int cmd_bridge_fdb_static(const char *mac, const char *vlan, const char *port, const char *count,
+                          int add)
+{
+    struct br_fdb_op *ops;
+    uint8_t first[6];
+    uint64_t base;
+    char *end;
+    long vid = strtol(vlan, &end, 10);
+    long n = 1;
+    long i, ok = 0;
+    int b;
+
+    if (count)
+        n = strtol(count, &end, 10);
+    if (parse_mac(mac, first) < 0 || *end || vid < 1 || vid > 4094 || n < 1 || n > 65536 ||
+        strlen(port) >= IFNAMSIZ)
+    {
+        fprintf(stderr, "cmd_bridge_fdb_static: usage: bridge fdb add|del <mac> vlan <1-4094> "
+                "interface <port> [count <1-65536>]\n");
+        return -1;
+    }
+    if ((ops = calloc((size_t)n, sizeof(*ops))) == NULL)
+    {
+        perror("calloc");
+        return -1;
+    }
+
+    for (base = 0, b = 0; b < 6; b++)
+        base = base << 8 | first[b];
+    for (i = 0; i < n; i++)
+    {
+        for (b = 0; b < 6; b++)
+            ops[i].mac[b] = (uint8_t)((base + (uint64_t)i) >> (40 - 8 * b));
+        ops[i].vid = (uint16_t)vid;
+        memcpy(ops[i].port, port, strlen(port) + 1);
+    }
+
+    br_fdb_static(ops, (size_t)n, add);
+    for (i = 0; i < n; i++)
+    {
+        if (ops[i].status == 0)
+        {
+            ok++;
+            continue;
+        }
+        reply("bridge fdb: %02x:%02x:%02x:%02x:%02x:%02x vlan %ld %s: %s\n", ops[i].mac[0],
+              ops[i].mac[1], ops[i].mac[2], ops[i].mac[3], ops[i].mac[4], ops[i].mac[5], vid, port,
+              ops[i].status == -EINVAL ? "not a member of the VLAN" : strerror(-ops[i].status));
+    }
+    reply("bridge fdb: %ld of %ld entries %s\n", ok, n, add ? "added" : "deleted");
+    free(ops);
+    return ok == n ? 0 : -2;
+}
+
+/*
+ * cmd_bridge_fdb_flush - Flush the learned MACs of the Vlan<id> bridges
+ *
+ * "bridge fdb flush [vlan <id>] [interface <port>] [static]" deletes the
+ * dynamic entries of the port in the VLAN, of every port of the VLAN, of
+ * the port in whichever VLAN it belongs to, or of every VLAN; "static"
+ * takes the static entries along.  Each bridge or port takes one bulk
+ * delete request on kernels that support it.
+ *
+ * Input parameters:
+ *   words - the command's words
+ *   cnt   - number of words
+ *
+ * Return value:
+ *    0  - success
+ *   -1  - bad argument
+ *   -2  - the flush failed
+ */
+int cmd_bridge_fdb_flush(char **words, int cnt)
+{
+    const char *port = NULL;
+    long vid = 0;
+    int statics = 0;
+    int i, err;
+
+    for (i = 3; i < cnt; i++)
+    {
+        char *end = NULL;
+
+        if (strcmp(words[i], "vlan") == 0 && i + 1 < cnt)
+            vid = strtol(words[++i], &end, 10);
+        else if (strcmp(words[i], "interface") == 0 && i + 1 < cnt)
+            port = words[++i];
+        else if (strcmp(words[i], "static") == 0)
+            statics = 1;
+        else
+            break;
+        if ((end && (*end || vid < 1 || vid > 4094)) || (port && strlen(port) >= IFNAMSIZ))
+            break;
+    }
+    if (i < cnt)
+    {
+        fprintf(stderr, "cmd_bridge_fdb_flush: usage: bridge fdb flush [vlan <1-4094>] "
+                "[interface <port>] [static]\n");
+        return -1;
+    }
+
+    err = br_fdb_flush((uint16_t)vid, port, statics);
+    if (err < 0)
+    {
+        reply("bridge fdb flush: %s\n", err == -EINVAL ? "port is not a VLAN member"
+                                        : strerror(-err));
+        return -2;
+    }
+    reply("bridge fdb: flushed %s entries\n", statics ? "dynamic and static" : "dynamic");
+    return 0;
+}
+
+static const char *const g_fdb_types[] = { "dynamic", "static", "local" };
+
+static void print_bridge_fdb_entry(const struct br_fdb_entry *e, void *arg)
+{
+    char vid[8] = "-";
+    char age[16] = "-";
+
+    (void)arg;
+    if (e->vid)
+        snprintf(vid, sizeof(vid), "%u", (unsigned)e->vid);
+    if (e->type == BR_FDB_DYNAMIC)
+        snprintf(age, sizeof(age), "%u", e->age_s);
+    reply("%02x:%02x:%02x:%02x:%02x:%02x  %-5s  %-16s  %-16s  %-8s  %s\n", e->mac[0], e->mac[1],
+          e->mac[2], e->mac[3], e->mac[4], e->mac[5], vid, e->port_name[0] ? e->port_name : "?",
+          e->bridge_name[0] ? e->bridge_name : "?", g_fdb_types[e->type], age);
+}
+
+/*
+ * cmd_show_bridge_fdb - Display the kernel FDB of the Vlan<id> bridges
+ *
+ * "show bridge fdb [bridge <name>] [vlan <id>] [interface <port>]" asks the
+ * kernel for the matching entries only, and prints (and streams) each one
+ * as it arrives.
+ *
+ * Input parameters:
+ *   words - the command's words
+ *   cnt   - number of words
+ *
+ * Output:
+ *   One row per entry: MAC ADDRESS, VLAN, PORT, BRIDGE, TYPE (dynamic,
+ *   static or local), AGE (seconds since last seen, dynamic entries); then
+ *   the entry total
+ *
+ * Return value:
+ *    0  - success
+ *   -1  - bad argument
+ *   -2  - no such bridge, VLAN or port, or the dump failed
+ */
+int cmd_show_bridge_fdb(char **words, int cnt)
+{
+    struct br_fdb_filter f;
+    int i, n;
+
+    memset(&f, 0, sizeof(f));
+    for (i = 3; i + 1 < cnt; i += 2)
+    {
+        char *end;
+        long vid;
+
+        if (strcmp(words[i], "bridge") == 0 && strlen(words[i + 1]) < IFNAMSIZ)
+            memcpy(f.bridge, words[i + 1], strlen(words[i + 1]) + 1);
+        else if (strcmp(words[i], "interface") == 0 && strlen(words[i + 1]) < IFNAMSIZ)
+            memcpy(f.port, words[i + 1], strlen(words[i + 1]) + 1);
+        else if (strcmp(words[i], "vlan") == 0 &&
+                 (vid = strtol(words[i + 1], &end, 10)) >= 1 && vid <= 4094 && !*end)
+            f.vid = (uint16_t)vid;
+        else
+            break;
+    }
+    if (i < cnt)
+    {
+        fprintf(stderr, "cmd_show_bridge_fdb: usage: show bridge fdb [bridge <name>] "
+                "[vlan <1-4094>] [interface <port>]\n");
+        return -1;
+    }
+
+    reply("%-17s  %-5s  %-16s  %-16s  %-8s  %s\n", "MAC ADDRESS", "VLAN", "PORT", "BRIDGE", "TYPE",
+          "AGE");
+    reply("%-17s  %-5s  %-16s  %-16s  %-8s  %s\n", "-----------", "----", "----", "------", "----",
+          "---");
+    n = br_fdb_dump(&f, print_bridge_fdb_entry, NULL);
+    if (n < 0)
+    {
+        reply("show bridge fdb: %s\n", n == -ENOENT ? "no such VLAN"
+                                       : n == -EINVAL ? "VLAN is not on that bridge"
+                                       : strerror(-n));
+        return -2;
+    }
+    reply("Total entries: %d\n", n);
+    return 0;
+}
+
+/*
+ * cmd_set_interface_attr - Set admin state, MTU and alias of interfaces
+ *
+ * "set interface <set> [admin up|down] [mtu <n>] [alias <text>]" where
+ * <set> is one name, a range such as Ethernet0-63 or a pattern such as
+ * Ethernet*.  Only the attributes an interface does not have yet are sent,
+ * for the whole set in one batch of Netlink requests.  The alias takes
+ * the rest of the line.  Prints (and streams) one line per interface.
+ *
+ * Input parameters:
+ *   words - the command's words
+ *   cnt   - number of words
+ *
+ * Return value:
+ *    0  - every interface has the attributes now
+ *   -1  - bad argument or out of memory
+ *   -2  - no interface matched, or at least one interface failed
+ */
+int cmd_set_interface_attr(char **words, int cnt)
+{
+    static const char *const names[] = { "admin", "mtu", "alias" };
+    struct link_attrs a;
+    struct link_result *res;
+    int i, n, changed = 0, failed = 0;
+
+    memset(&a, 0, sizeof(a));
+    for (i = 3; i + 1 < cnt; i += 2)
+    {
+        char *end;
+        long mtu;
+
+        if (strcmp(words[i], "admin") == 0 &&
+            (strcmp(words[i + 1], "up") == 0 || strcmp(words[i + 1], "down") == 0))
+        {
+            a.set |= LINK_ATTR_ADMIN;
+            a.up = strcmp(words[i + 1], "up") == 0;
+        }
+        else if (strcmp(words[i], "mtu") == 0 &&
+                 (mtu = strtol(words[i + 1], &end, 10)) >= 68 && mtu <= 65535 && !*end)
+        {
+            a.set |= LINK_ATTR_MTU;
+            a.mtu = (unsigned)mtu;
+        }
+        else if (strcmp(words[i], "alias") == 0)
+        {
+            size_t len = 0;
+
+            a.set |= LINK_ATTR_ALIAS;
+            for (i++; i < cnt && len < sizeof(a.alias); i++)
+                len += (size_t)snprintf(a.alias + len, sizeof(a.alias) - len, "%s%s",
+                                        len ? " " : "", words[i]);
+            if (len >= sizeof(a.alias))
+                i = -1;
+            break;
+        }
+        else
+            break;
+    }
+    if (i != cnt)
+    {
+        fprintf(stderr, "cmd_set_interface_attr: usage: set interface <name|range|pattern> "
+                "[admin up|down] [mtu <68-65535>] [alias <text>]\n");
+        return -1;
+    }
+
+    n = link_attr_set(words[2], &a, &res);
+    if (n < 0)
+    {
+        reply("set interface %s: %s\n", words[2], n == -ENODEV ? "no such interface"
+                                        : n == -EINVAL ? "bad interface name or range"
+                                        : strerror(-n));
+        return n == -ENOMEM ? -1 : -2;
+    }
+
+    for (i = 0; i < n; i++)
+    {
+        char what[32] = "";
+        unsigned b;
+
+        for (b = 0; b < 3; b++)
+        {
+            if (res[i].changed & (1u << b))
+                snprintf(what + strlen(what), sizeof(what) - strlen(what), "%s%s",
+                         what[0] ? "," : "", names[b]);
+        }
+        if (res[i].status < 0)
+        {
+            failed++;
+            reply("  %-16s  %s\n", res[i].name, strerror(-res[i].status));
+        }
+        else
+        {
+            changed += res[i].changed != 0;
+            reply("  %-16s  %s\n", res[i].name, res[i].changed ? what : "unchanged");
+        }
+    }
+    reply("set interface %s: %d interfaces, %d changed, %d unchanged, %d failed\n", words[2], n,
+          changed, n - changed - failed, failed);
+    free(res);
+    return failed ? -2 : 0;
+}
+
+/* "A.B.C.D[/L]" into a host-order address and a prefix length. */
+static int parse_prefix(const char *s, uint32_t *addr, uint8_t *len)
+{
+    char ip[INET_ADDRSTRLEN];
+    const char *slash = strchr(s, '/');
+    struct in_addr a;
+    size_t n = slash ? (size_t)(slash - s) : strlen(s);
+    int l = 32;
+
+    if (n >= sizeof(ip))
+        return -1;
+    memcpy(ip, s, n);
+    ip[n] = '\0';
+    if (inet_pton(AF_INET, ip, &a) != 1)
+        return -1;
+    if (slash && (sscanf(slash + 1, "%d", &l) != 1 || l < 0 || l > 32))
+        return -1;
+    *addr = ntohl(a.s_addr);
+    *len = (uint8_t)l;
+    return 0;
+}
+
+/* "P" or "P-Q" into a port range. */
+static int parse_port_range(const char *s, uint16_t *lo, uint16_t *hi)
+{
+    unsigned a, b;
+    int n = sscanf(s, "%u-%u", &a, &b);
+
+    if (n == 1)
+        b = a;
+    else if (n != 2)
+        return -1;
+    if (a > b || b > 65535)
+        return -1;
+    *lo = (uint16_t)a;
+    *hi = (uint16_t)b;
+    return 0;
+}
+
+static int parse_proto(const char *s, uint8_t *proto)
+{
+    unsigned p;
+
+    if (strcmp(s, "tcp") == 0)
+        p = 6;
+    else if (strcmp(s, "udp") == 0)
+        p = 17;
+    else if (strcmp(s, "icmp") == 0)
+        p = 1;
+    else if (sscanf(s, "%u", &p) != 1 || p > 255)
+        return -1;
+    *proto = (uint8_t)p;
+    return 0;
+}
+
+static int parse_action(const char *s, uint8_t *action)
+{
+    if (strcmp(s, "permit") == 0)
+        *action = ACL_PERMIT;
+    else if (strcmp(s, "deny") == 0)
+        *action = ACL_DENY;
+    else
+        return -1;
+    return 0;
+}
+
+/*
+ * cmd_acl_rule - Add or replace one rule of an ACL
+ *
+ * Description:
+ *   Parses "acl <name> rule <seq> permit|deny [match...]" where each match
+ *   is one of:
+ *     src-mac M, dst-mac M, ethertype N, src-ip A.B.C.D[/L],
+ *     dst-ip A.B.C.D[/L], proto tcp|udp|icmp|N, src-port P[-Q],
+ *     dst-port P[-Q]
+ *   A rule without matches matches every frame.  The ACL is created with
+ *   a default action of permit if it does not exist; the new list takes
+ *   effect atomically on the forwarding plane.
+ *
+ * Input parameters:
+ *   words, cnt - the command split into words
+ *
+ * Return value:
+ *    0  - success
+ *   -1  - bad syntax
+ *   -2  - the forwarding plane rejected the rule (printed with the reason)
+ */
+int cmd_acl_rule(char **words, int cnt)
+{
+    struct acl_rule r;
+    unsigned seq;
+    int i, err;
+
+    memset(&r, 0, sizeof(r));
+    if (cnt < 5 || sscanf(words[3], "%u", &seq) != 1 || parse_action(words[4], &r.action) < 0)
+    {
+        fprintf(stderr, "cmd_acl_rule: usage: acl <name> rule <seq> permit|deny [match...]\n");
+        return -1;
+    }
+    r.seq = seq;
+
+    for (i = 5; i + 1 < cnt; i += 2)
+    {
+        const char *key = words[i];
+        const char *val = words[i + 1];
+        int bad;
+
+        if (strcmp(key, "src-mac") == 0)
+        {
+            bad = parse_mac(val, r.src_mac);
+            r.fields |= ACL_M_SRC_MAC;
+        }
+        else if (strcmp(key, "dst-mac") == 0)
+        {
+            bad = parse_mac(val, r.dst_mac);
+            r.fields |= ACL_M_DST_MAC;
+        }
+        else if (strcmp(key, "ethertype") == 0)
+        {
+            char *end;
+            unsigned long v = strtoul(val, &end, 0);
+
+            bad = *end != '\0' || end == val || v > 0xFFFF;
+            r.ethertype = (uint16_t)v;
+            r.fields |= ACL_M_ETHERTYPE;
+        }
+        else if (strcmp(key, "src-ip") == 0)
+        {
+            bad = parse_prefix(val, &r.src_ip, &r.src_len);
+            r.fields |= ACL_M_SRC_IP;
+        }
+        else if (strcmp(key, "dst-ip") == 0)
+        {
+            bad = parse_prefix(val, &r.dst_ip, &r.dst_len);
+            r.fields |= ACL_M_DST_IP;
+        }
+        else if (strcmp(key, "proto") == 0)
+        {
+            bad = parse_proto(val, &r.proto);
+            r.fields |= ACL_M_PROTO;
+        }
+        else if (strcmp(key, "src-port") == 0)
+        {
+            bad = parse_port_range(val, &r.sport_lo, &r.sport_hi);
+            r.fields |= ACL_M_SPORT;
+        }
+        else if (strcmp(key, "dst-port") == 0)
+        {
+            bad = parse_port_range(val, &r.dport_lo, &r.dport_hi);
+            r.fields |= ACL_M_DPORT;
+        }
+        else
+            bad = 1;
+
+        if (bad)
+        {
+            fprintf(stderr, "cmd_acl_rule: bad match '%s %s'\n", key, val);
+            return -1;
+        }
+    }
+    if (i != cnt)
+    {
+        fprintf(stderr, "cmd_acl_rule: match '%s' without a value\n", words[i]);
+        return -1;
+    }
+
+    err = dp_acl_rule_add(words[1], &r);
+    if (err < 0)
+    {
+        fprintf(stderr, "cmd_acl_rule: %s rule %u: %s\n", words[1], seq, strerror(-err));
+        return -2;
+    }
+    printf("acl %s: rule %u %s\n", words[1], seq, r.action == ACL_DENY ? "deny" : "permit");
+    return 0;
+}
+
+/*
+ * cmd_acl_default - Set the action for frames no rule of an ACL matches
+ *
+ * Input parameters:
+ *   name   - ACL name; created empty if it does not exist
+ *   action - "permit" or "deny"
+ *
+ * Return value:
+ *    0  - success
+ *   -1  - bad action
+ *   -2  - the forwarding plane rejected the change
+ */
+int cmd_acl_default(const char *name, const char *action)
+{
+    uint8_t a;
+    int err;
+
+    if (parse_action(action, &a) < 0)
+    {
+        fprintf(stderr, "cmd_acl_default: action must be permit or deny\n");
+        return -1;
+    }
+    err = dp_acl_default(name, a);
+    if (err < 0)
+    {
+        fprintf(stderr, "cmd_acl_default: %s: %s\n", name, strerror(-err));
+        return -2;
+    }
+    printf("acl %s: default %s\n", name, action);
+    return 0;
+}
+
+/*
+ * cmd_no_acl - Delete one rule of an ACL, or the whole ACL
+ *
+ * Input parameters:
+ *   name - ACL name
+ *   seq  - sequence number of the rule, or NULL to delete the ACL, which
+ *          must not be bound anywhere
+ *
+ * Return value:
+ *    0  - success
+ *   -1  - bad sequence number
+ *   -2  - no such ACL or rule, or the ACL is still bound
+ */
+int cmd_no_acl(const char *name, const char *seq)
+{
+    unsigned s;
+    int err;
+
+    if (seq && sscanf(seq, "%u", &s) != 1)
+    {
+        fprintf(stderr, "cmd_no_acl: bad sequence number '%s'\n", seq);
+        return -1;
+    }
+    err = seq ? dp_acl_rule_del(name, s) : dp_acl_delete(name);
+    if (err < 0)
+    {
+        fprintf(stderr, "cmd_no_acl: %s: %s\n", name,
+                err == -EBUSY ? "still bound to a port or VLAN" : strerror(-err));
+        return -2;
+    }
+    if (seq)
+        printf("acl %s: rule %u deleted\n", name, s);
+    else
+        printf("acl %s deleted\n", name);
+    return 0;
+}
+
+/*
+ * cmd_bind_acl - Bind an ACL to the ingress of a port or VLAN, or unbind it
+ *
+ * Input parameters:
+ *   name   - ACL name, or NULL to unbind
+ *   kind   - "interface" or "vlan"
+ *   target - port name (attached to the forwarding plane) or VLAN ID
+ *
+ * Return value:
+ *    0  - success
+ *   -1  - bad syntax
+ *   -2  - the forwarding plane rejected the binding
+ */
+int cmd_bind_acl(const char *name, const char *kind, const char *target)
+{
+    int err;
+
+    if (strcmp(kind, "interface") == 0)
+        err = dp_acl_bind_port(target, name);
+    else if (strcmp(kind, "vlan") == 0)
+        err = dp_acl_bind_vlan((uint16_t)atoi(target), name);
+    else
+    {
+        fprintf(stderr, "cmd_bind_acl: expected interface or vlan, got '%s'\n", kind);
+        return -1;
+    }
+    if (err < 0)
+    {
+        fprintf(stderr, "cmd_bind_acl: %s %s: %s\n", kind, target, strerror(-err));
+        return -2;
+    }
+    if (name)
+        printf("acl %s bound to %s %s\n", name, kind, target);
+    else
+        printf("acl unbound from %s %s\n", kind, target);
+    return 0;
+}
+
+static void format_range(char *buf, size_t len, uint16_t lo, uint16_t hi)
+{
+    if (lo == hi)
+        snprintf(buf, len, "%u", (unsigned)lo);
+    else
+        snprintf(buf, len, "%u-%u", (unsigned)lo, (unsigned)hi);
+}
+
+static void print_acl_rule(const struct acl_rule *r, uint64_t hits, void *arg)
+{
+    char match[256];
+    char tmp[INET_ADDRSTRLEN];
+    size_t n = 0;
+    struct in_addr a;
+
+    (void)arg;
+    match[0] = '\0';
+#define ADD(...) (n += (size_t)snprintf(match + n, n < sizeof(match) ? sizeof(match) - n : 0, __VA_ARGS__))
+    if (r->fields & ACL_M_SRC_MAC)
+        ADD(" src-mac %02x:%02x:%02x:%02x:%02x:%02x", r->src_mac[0], r->src_mac[1],
+            r->src_mac[2], r->src_mac[3], r->src_mac[4], r->src_mac[5]);
+    if (r->fields & ACL_M_DST_MAC)
+        ADD(" dst-mac %02x:%02x:%02x:%02x:%02x:%02x", r->dst_mac[0], r->dst_mac[1],
+            r->dst_mac[2], r->dst_mac[3], r->dst_mac[4], r->dst_mac[5]);
+    if (r->fields & ACL_M_ETHERTYPE)
+        ADD(" ethertype 0x%04x", (unsigned)r->ethertype);
+    if (r->fields & ACL_M_SRC_IP)
+    {
+        a.s_addr = htonl(r->src_ip);
+        inet_ntop(AF_INET, &a, tmp, sizeof(tmp));
+        ADD(" src-ip %s/%u", tmp, (unsigned)r->src_len);
+    }
+    if (r->fields & ACL_M_DST_IP)
+    {
+        a.s_addr = htonl(r->dst_ip);
+        inet_ntop(AF_INET, &a, tmp, sizeof(tmp));
+        ADD(" dst-ip %s/%u", tmp, (unsigned)r->dst_len);
+    }
+    if (r->fields & ACL_M_PROTO)
+        ADD(" proto %u", (unsigned)r->proto);
+    if (r->fields & ACL_M_SPORT)
+    {
+        format_range(tmp, sizeof(tmp), r->sport_lo, r->sport_hi);
+        ADD(" src-port %s", tmp);
+    }
+    if (r->fields & ACL_M_DPORT)
+    {
+        format_range(tmp, sizeof(tmp), r->dport_lo, r->dport_hi);
+        ADD(" dst-port %s", tmp);
+    }
+#undef ADD
+    printf("  %-8u  %-6s  %-12llu%s\n", r->seq, r->action == ACL_DENY ? "deny" : "permit",
+           (unsigned long long)hits, n ? match : " any");
+}
+
+/*
+ * cmd_show_acl - Display every ACL with its rules and hit counters
+ *
+ * Output:
+ *   Per ACL a header with its default action and bindings, then one row
+ *   per rule in sequence order: SEQ, ACTION, HITS (frames the rule
+ *   decided), MATCH; the default action's hits are on the header line.
+ *   Total ACL drops of the forwarding plane follow.
+ *
+ * Return value:
+ *    0  - success
+ *   -1  - the forwarding plane is not running (start the daemon with -D)
+ */
+int cmd_show_acl()
+{
+    struct dp_worker_stats ws;
+    struct dp_acl_info ai;
+    unsigned i, nacl = 0;
+
+    if (dp_get_worker_stats(&ws) < 0)
+    {
+        fprintf(stderr, "cmd_show_acl: forwarding plane is not running\n");
+        return -1;
+    }
+
+    for (i = 0; i < DP_MAX_ACLS; i++)
+    {
+        if (dp_get_acl(i, &ai) < 0)
+            continue;
+        nacl++;
+        printf("acl %s: %u rules, default %s (%llu hits), bound to %u ports and %u VLANs\n",
+               ai.name, ai.nrules, ai.default_action == ACL_DENY ? "deny" : "permit",
+               (unsigned long long)ai.no_match, ai.nports, ai.nvlans);
+        printf("  %-8s  %-6s  %-12s %s\n", "SEQ", "ACTION", "HITS", "MATCH");
+        printf("  %-8s  %-6s  %-12s %s\n", "---", "------", "----", "-----");
+        dp_acl_dump(ai.name, print_acl_rule, NULL);
+        printf("\n");
+    }
+    printf("Total ACLs: %u, frames denied %llu\n", nacl, (unsigned long long)ws.acl_drops);
+    return 0;
+}
+
+/*
+ * storm_apply - Set or clear one storm control limit on the active backend
+ *
+ * The forwarding plane meters in its own buckets; without it the limit
+ * becomes a tc policer on the kernel bridge ports (tc_storm.h).
+ *
+ * Return value: 0, or a negative errno from the backend
+ */
+static int storm_apply(const char *kind, const char *target, unsigned cls,
+                       const struct storm_rate *r)
+{
+    int vlan = strcmp(kind, "vlan") == 0;
+
+    if (dp_running())
+        return vlan ? dp_storm_vlan((uint16_t)atoi(target), cls, r)
+                    : dp_storm_port(target, cls, r);
+    return vlan ? tc_storm_vlan((uint16_t)atoi(target), cls, r)
+                : tc_storm_port(target, cls, r);
+}
+
+/*
+ * cmd_storm_control - Limit broadcast, multicast or unknown unicast ingress
+ *
+ * Parses "storm-control interface <port>|vlan <id> <class> pps|kbps <rate>
+ * [burst <n>]" with class broadcast, multicast or unknown-unicast.  A VLAN
+ * limit applies to the traffic of all its ports together.  The burst is
+ * in packets for pps and in bytes for kbps, and defaults to a tenth of a
+ * second at the rate (at least 16 packets or 2048 bytes).
+ *
+ * Return value:
+ *    0  - success
+ *   -1  - bad syntax
+ *   -2  - the backend rejected the limit (unknown unicast needs -D)
+ */
+int cmd_storm_control(char **words, int cnt)
+{
+    struct storm_rate r;
+    unsigned long long rate;
+    unsigned burst = 0;
+    int cls;
+    int err;
+
+    memset(&r, 0, sizeof(r));
+    if ((strcmp(words[1], "interface") != 0 && strcmp(words[1], "vlan") != 0) ||
+        (cls = storm_class_parse(words[3])) < 0 ||
+        (strcmp(words[4], "pps") != 0 && strcmp(words[4], "kbps") != 0) ||
+        sscanf(words[5], "%llu", &rate) != 1 || rate == 0 ||
+        (cnt == 8 && (strcmp(words[6], "burst") != 0 ||
+                      sscanf(words[7], "%u", &burst) != 1 || burst == 0)))
+    {
+        fprintf(stderr, "cmd_storm_control: usage: storm-control interface <port>|vlan <id> "
+                "broadcast|multicast|unknown-unicast pps|kbps <rate> [burst <n>]\n");
+        return -1;
+    }
+    r.rate = rate;
+    r.bytes = words[4][0] == 'k';
+    if (!burst)
+    {
+        /* 0.1 s at the rate; kbit/s * 125 is bytes/s. */
+        unsigned long long b = r.bytes ? rate * 125 / 10 : rate / 10;
+        unsigned long long min = r.bytes ? 2048 : 16;
+
+        burst = (unsigned)(b < min ? min : b > 0xFFFFFFFFull ? 0xFFFFFFFFull : b);
+    }
+    r.burst = burst;
+
+    err = storm_apply(words[1], words[2], (unsigned)cls, &r);
+    if (err < 0)
+    {
+        fprintf(stderr, "cmd_storm_control: %s %s %s: %s\n", words[1], words[2], words[3],
+                err == -EOPNOTSUPP ? "only the forwarding plane (-D) meters unknown unicast"
+                                   : strerror(-err));
+        return -2;
+    }
+    printf("storm-control %s %s %s: %llu %s, burst %u %s\n", words[1], words[2], words[3],
+           rate, words[4], r.burst, r.bytes ? "bytes" : "packets");
+    return 0;
+}
+
+/*
+ * cmd_no_storm_control - Remove one storm control limit
+ *
+ * Input parameters:
+ *   kind   - "interface" or "vlan"
+ *   target - port name or VLAN ID
+ *   cls    - broadcast, multicast or unknown-unicast
+ *
+ * Return value:
+ *    0  - success
+ *   -1  - bad syntax
+ *   -2  - the backend rejected the change
+ */
+int cmd_no_storm_control(const char *kind, const char *target, const char *cls)
+{
+    int c = storm_class_parse(cls);
+    int err;
+
+    if ((strcmp(kind, "interface") != 0 && strcmp(kind, "vlan") != 0) || c < 0)
+    {
+        fprintf(stderr, "cmd_no_storm_control: usage: no storm-control interface <port>|vlan <id> "
+                "broadcast|multicast|unknown-unicast\n");
+        return -1;
+    }
+    err = storm_apply(kind, target, (unsigned)c, NULL);
+    if (err < 0)
+    {
+        fprintf(stderr, "cmd_no_storm_control: %s %s: %s\n", kind, target, strerror(-err));
+        return -2;
+    }
+    printf("storm-control %s %s %s removed\n", kind, target, cls);
+    return 0;
+}
+
+static void print_storm(const char *port, uint16_t vid, unsigned cls,
+                        const struct storm_rate *r, uint64_t drops, void *arg)
+{
+    char target[IFNAMSIZ + 8];
+
+    (void)arg;
+    if (port)
+        snprintf(target, sizeof(target), "%s", port);
+    else
+        snprintf(target, sizeof(target), "vlan %u", (unsigned)vid);
+    printf("%-16s  %-16s  %10llu %-4s  %10u  %llu\n", target, storm_class_name(cls),
+           (unsigned long long)r->rate, r->bytes ? "kbps" : "pps", r->burst,
+           (unsigned long long)drops);
+}
+
+/*
+ * cmd_show_storm_control - Display every storm control limit and its drops
+ *
+ * Output:
+ *   One row per limit: TARGET (port, or "vlan <id>"), CLASS, RATE with its
+ *   unit, BURST (packets for pps, bytes for kbps), DROPPED (frames over the
+ *   rate, from the forwarding plane's buckets or the kernel policers).
+ *
+ * Return value:
+ *    0  - success
+ *   -1  - the limits could not be read
+ */
+int cmd_show_storm_control()
+{
+    int n;
+
+    printf("%-16s  %-16s  %15s  %10s  %s\n", "TARGET", "CLASS", "RATE", "BURST", "DROPPED");
+    printf("%-16s  %-16s  %15s  %10s  %s\n", "------", "-----", "----", "-----", "-------");
+    n = dp_running() ? dp_storm_walk(print_storm, NULL) : tc_storm_walk(print_storm, NULL);
+    if (n < 0)
+    {
+        fprintf(stderr, "cmd_show_storm_control: %s\n", strerror(-n));
+        return -1;
+    }
+    printf("Total limits: %d (%s)\n", n, dp_running() ? "forwarding plane" : "kernel tc");
+    return 0;
+}
+
+/*
+ * vid_range - Parse "<first>" or "<first>-<last>" into @first and @count
+ *
+ * Return value: 0, or -1 unless 1 <= first <= last <= 4094
+ */
+static int vid_range(const char *s, uint16_t *first, unsigned *count)
+{
+    unsigned a, b;
+    char c;
+
+    if (sscanf(s, "%u%c", &a, &c) == 1)
+        b = a;
+    else if (sscanf(s, "%u-%u%c", &a, &b, &c) != 2)
+        return -1;
+    if (a < 1 || b > 4094 || a > b)
+        return -1;
+    *first = (uint16_t)a;
+    *count = b - a + 1;
+    return 0;
+}
+
+/*
+ * cmd_vlan_translation - Translate customer VIDs of a trunk port, or stop
+ *
+ * "vlan translation interface <port> <cvid>[-<last>] <vid>" maps the C-VIDs
+ * received on <port> to VLANs <vid>, <vid> + 1, ... in order, and those
+ * VLANs back to their C-VIDs on egress.  The port must carry the VLANs, and
+ * while it translates one it no longer accepts that VLAN's own tag.  The
+ * forwarding plane translates in its per-port tables; without it every
+ * mapping becomes a pair of tc vlan modify filters on the port
+ * (tc_xlate.h), not a sub-interface.
+ *
+ * Input parameters:
+ *   port  - trunk port
+ *   cvids - C-VID, or range of C-VIDs "<first>-<last>"
+ *   vid   - first VLAN ID, or NULL to remove the mappings of the C-VIDs
+ *
+ * Return value:
+ *    0  - success
+ *   -1  - bad syntax
+ *   -2  - the backend rejected the change
+ */
+int cmd_vlan_translation(const char *port, const char *cvids, const char *vid)
+{
+    uint16_t cvid;
+    unsigned count;
+    int v = 0;
+    int err;
+
+    if (vid_range(cvids, &cvid, &count) < 0 ||
+        (vid && ((v = atoi(vid)) < 1 || v + count - 1 > 4094)))
+    {
+        fprintf(stderr, "cmd_vlan_translation: usage: [no] vlan translation interface <port> "
+                "<cvid>[-<last>] [<vid>], VIDs 1..4094\n");
+        return -1;
+    }
+    err = dp_running() ? dp_vlan_xlate(port, cvid, (uint16_t)v, count)
+                       : tc_xlate_set(port, cvid, (uint16_t)v, count);
+    if (err < 0)
+    {
+        fprintf(stderr, "cmd_vlan_translation: %s %s: %s\n", port, cvids,
+                err == -EEXIST ? "a VLAN of the range is translated from another C-VID"
+                               : strerror(-err));
+        return -2;
+    }
+    if (!vid)
+        printf("vlan translation %s: C-VID %s removed\n", port, cvids);
+    else if (count == 1)
+        printf("vlan translation %s: C-VID %u <-> VLAN %d\n", port, (unsigned)cvid, v);
+    else
+        printf("vlan translation %s: C-VID %s <-> VLAN %d-%u\n", port, cvids, v, v + count - 1);
+    return 0;
+}
+
+/* A run of mappings with consecutive C-VIDs and VLANs, printed as one row. */
+struct xlate_run
+{
+    char     port[IFNAMSIZ];
+    uint16_t cvid;
+    uint16_t vid;
+    unsigned n;
+};
+
+static void print_xlate_run(const struct xlate_run *r)
+{
+    char c[16], v[16];
+
+    if (r->n == 0)
+        return;
+    if (r->n == 1)
+    {
+        snprintf(c, sizeof(c), "%u", (unsigned)r->cvid);
+        snprintf(v, sizeof(v), "%u", (unsigned)r->vid);
+    }
+    else
+    {
+        snprintf(c, sizeof(c), "%u-%u", (unsigned)r->cvid, r->cvid + r->n - 1);
+        snprintf(v, sizeof(v), "%u-%u", (unsigned)r->vid, r->vid + r->n - 1);
+    }
+    printf("%-16s  %-10s  %s\n", r->port, c, v);
+}
+
+static void print_xlate(const char *port, uint16_t cvid, uint16_t vid, void *arg)
+{
+    struct xlate_run *r = arg;
+
+    if (r->n && strcmp(r->port, port) == 0 && cvid == r->cvid + r->n && vid == r->vid + r->n)
+    {
+        r->n++;
+        return;
+    }
+    print_xlate_run(r);
+    snprintf(r->port, sizeof(r->port), "%s", port);
+    r->cvid = cvid;
+    r->vid = vid;
+    r->n = 1;
+}
+
+/*
+ * cmd_show_vlan_translation - Display the VLAN translations of every port
+ *
+ * Output:
+ *   One row per run of consecutive mappings: PORT, C-VID (or range) and
+ *   the VLAN (or range) it is translated to.
+ *
+ * Return value:
+ *    0  - success
+ *   -1  - the mappings could not be read
+ */
+int cmd_show_vlan_translation()
+{
+    struct xlate_run r;
+    int n;
+
+    memset(&r, 0, sizeof(r));
+    printf("%-16s  %-10s  %s\n", "PORT", "C-VID", "VLAN");
+    printf("%-16s  %-10s  %s\n", "----", "-----", "----");
+    n = dp_running() ? dp_vlan_xlate_walk(print_xlate, &r) : tc_xlate_walk(print_xlate, &r);
+    if (n < 0)
+    {
+        fprintf(stderr, "cmd_show_vlan_translation: %s\n", strerror(-n));
+        return -1;
+    }
+    print_xlate_run(&r);
+    printf("Total mappings: %d (%s)\n", n, dp_running() ? "forwarding plane" : "kernel tc");
+    return 0;
+}
+
+/*
+ * cmd_multicast_snooping - Start or stop IGMP / MLD snooping in a VLAN
+ *
+ * The forwarding plane narrows the VLAN's multicast floods itself; without
+ * it the kernel bridge's MDB is programmed from the reports (br_mdb.h).
+ *
+ * Input parameters:
+ *   vlan - VLAN ID (1..4094)
+ *   on   - 1 for "multicast snooping vlan", 0 for the "no" form
+ *
+ * Return value:
+ *    0  - success
+ *   -1  - bad VLAN ID
+ *   -2  - the backend failed
+ */
+int cmd_multicast_snooping(const char *vlan, int on)
+{
+    int vid = atoi(vlan);
+    int err;
+
+    if (vid < 1 || vid > 4094)
+    {
+        fprintf(stderr, "cmd_multicast_snooping: bad VLAN ID %s\n", vlan);
+        return -1;
+    }
+    err = dp_running() ? dp_snoop_vlan((uint16_t)vid, on) : br_mdb_vlan((uint16_t)vid, on);
+    if (err < 0)
+    {
+        fprintf(stderr, "cmd_multicast_snooping: vlan %d: %s\n", vid, strerror(-err));
+        return -2;
+    }
+    printf("multicast snooping %s on vlan %d\n", on ? "enabled" : "disabled", vid);
+    return 0;
+}
+
+static void print_mcast_entry(uint16_t vid, const struct snoop_key *k, int port,
+                              uint64_t expires_ms, void *arg)
+{
+    char group[INET6_ADDRSTRLEN] = "router";
+    char name[IFNAMSIZ] = "?";
+    struct dp_port_info pi;
+
+    (void)arg;
+    if (k)
+        inet_ntop(k->family, k->addr, group, sizeof(group));
+    if (dp_running())
+    {
+        if (dp_get_port((unsigned)port, &pi) == 0)
+            snprintf(name, sizeof(name), "%s", pi.lag[0] ? pi.lag : pi.name);
+    }
+    else
+    {
+        const struct vlan_snapshot *snap = vlan_state_read_begin();
+        const struct vs_link *l = snap ? vlan_snapshot_find_index(snap, port) : NULL;
+
+        if (l)
+            snprintf(name, sizeof(name), "%s", l->name);
+        vlan_state_read_end();
+    }
+    printf("%-6u  %-40s  %-16s  %llu\n", (unsigned)vid, group, name,
+           (unsigned long long)(expires_ms / 1000));
+}
+
+/*
+ * cmd_show_multicast_groups - Display the snooped group memberships
+ *
+ * Output:
+ *   One row per router port (GROUP "router") and per (group, port)
+ *   membership: VLAN, GROUP, PORT, EXPIRES (seconds left), then the
+ *   message counters of the snooper.
+ *
+ * Return value:
+ *    0  - success
+ *   -1  - nothing is snooped
+ */
+int cmd_show_multicast_groups()
+{
+    struct snoop_stats st;
+    int n;
+
+    if ((dp_running() ? dp_snoop_get_stats(&st) : br_mdb_get_stats(&st)) < 0)
+    {
+        fprintf(stderr, "cmd_show_multicast_groups: multicast snooping is not enabled\n");
+        return -1;
+    }
+    printf("%-6s  %-40s  %-16s  %s\n", "VLAN", "GROUP", "PORT", "EXPIRES");
+    printf("%-6s  %-40s  %-16s  %s\n", "----", "-----", "----", "-------");
+    n = dp_running() ? dp_snoop_walk(print_mcast_entry, NULL)
+                     : br_mdb_walk(print_mcast_entry, NULL);
+    printf("Total: %d entries, %u groups, %u router ports (%s)\n", n < 0 ? 0 : n, st.groups,
+           st.routers, dp_running() ? "forwarding plane" : "kernel MDB");
+    printf("Messages: %llu queries, %llu joins, %llu leaves, %llu invalid, %llu refused\n",
+           (unsigned long long)st.queries, (unsigned long long)st.reports,
+           (unsigned long long)st.leaves, (unsigned long long)st.invalid,
+           (unsigned long long)st.full);
+    return 0;
+}
+
+/*
+ * cmd_vlan_member - Add an interface or a LAG to a VLAN, or remove it
+ *
+ * A forwarding plane LAG's assignment is made for each member port
+ * (vlan_assign()); anything else, including a kernel bond, is a single
+ * assignment.
+ *
+ * Input parameters:
+ *   vlan  - VLAN ID (1..4094)
+ *   iface - interface or forwarding plane LAG name
+ *   add   - 1 for "add vlan", 0 for "remove vlan"
+ *
+ * Return value:
+ *    0  - success
+ *   -1  - bad VLAN ID
+ *   -2  - the assignment failed (for at least one member)
+ */
+int cmd_vlan_member(const char *vlan, const char *iface, int add)
+{
+    int vid = atoi(vlan);
+
+    if (vid < 1 || vid > 4094)
+    {
+        fprintf(stderr, "cmd_vlan_member: bad VLAN ID %s\n", vlan);
+        return -1;
+    }
+    return vlan_assign((uint16_t)vid, iface, add) < 0 ? -2 : 0;
+}
+
+/*
+ * cmd_create_lag - Create a link aggregation group
+ *
+ * The forwarding plane hashes the LAG's flows over its members itself;
+ * without it the LAG is a kernel bond in balance-xor mode with the
+ * matching transmit hash policy (lag_bond.h).
+ *
+ * Input parameters:
+ *   name - LAG name (an interface name in kernel mode)
+ *   hash - "l2", "l3" or "l4"; NULL for l3
+ *
+ * Return value:
+ *    0  - success
+ *   -1  - bad hash policy
+ *   -2  - the backend failed
+ */
+int cmd_create_lag(const char *name, const char *hash)
+{
+    int h = hash ? lag_hash_parse(hash) : LAG_HASH_L3;
+    int err;
+
+    if (h < 0)
+    {
+        fprintf(stderr, "cmd_create_lag: bad hash policy %s (l2, l3 or l4)\n", hash);
+        return -1;
+    }
+    err = dp_running() ? dp_lag_create(name, (unsigned)h) : lag_bond_create(name, (unsigned)h);
+    if (err < 0)
+    {
+        fprintf(stderr, "cmd_create_lag: %s: %s\n", name, strerror(-err));
+        return -2;
+    }
+    printf("lag %s created, hash %s\n", name, lag_hash_name((unsigned)h));
+    return 0;
+}
+
+/*
+ * cmd_delete_lag - Delete a link aggregation group; its members become
+ * separate ports again
+ *
+ * Return value:
+ *    0  - success
+ *   -2  - the backend failed (no such LAG)
+ */
+int cmd_delete_lag(const char *name)
+{
+    int err = dp_running() ? dp_lag_delete(name) : lag_bond_delete(name);
+
+    if (err < 0)
+    {
+        fprintf(stderr, "cmd_delete_lag: %s: %s\n", name, strerror(-err));
+        return -2;
+    }
+    printf("lag %s deleted\n", name);
+    return 0;
+}
+
+/* Vlan<id> bridge port `name` is enslaved to: its ID, 0 if none, -1 if no
+ * such link. */
+static int port_vlan(const char *name)
+{
+    const struct vlan_snapshot *snap = vlan_state_read_begin();
+    const struct vs_link *l = snap ? vlan_snapshot_find_name(snap, name) : NULL;
+    int vid = l ? l->member_vlan : -1;
+
+    vlan_state_read_end();
+    return vid;
+}
+
+/*
+ * lag_sync_vlan - Give a port that joined forwarding plane LAG `li` the
+ * LAG's VLAN, the one of its other members; take it away from a port that
+ * left
+ *
+ * Return value: 0, or the error of the assignment
+ */
+static int lag_sync_vlan(const struct dp_lag_info *li, const char *port, int joined)
+{
+    int cur = port_vlan(port);
+    int vid = 0;
+    unsigned i;
+
+    for (i = 0; joined && i < li->nmembers; i++)
+    {
+        if (strcmp(li->member[i], port) != 0 && (vid = port_vlan(li->member[i])) >= 0)
+            break;
+    }
+    if (joined && i == li->nmembers)
+        return 0;               /* the first member brings its own */
+    if (cur < 0 || cur == vid)
+        return 0;
+    return vid > 0 ? add_vlan_assignment((uint16_t)vid, port)
+                   : remove_vlan_assignment((uint16_t)cur, port);
+}
+
+/*
+ * cmd_lag_member - Add a port to a LAG, or remove it
+ *
+ * In the forwarding plane, a port joining a LAG is moved into the LAG's
+ * VLAN and a port leaving it leaves the VLAN too, so that every member
+ * carries what the LAG carries; until then the plane keeps the port out
+ * of the LAG's hash.
+ *
+ * Input parameters:
+ *   port - member interface
+ *   lag  - LAG name
+ *   add  - 1 for "add interface", 0 for "remove interface"
+ *
+ * Return value:
+ *    0  - success
+ *   -2  - the backend failed, or the port's VLAN could not be matched
+ */
+int cmd_lag_member(const char *port, const char *lag, int add)
+{
+    struct dp_lag_info li;
+    int err;
+
+    if (dp_running())
+    {
+        err = lag_lookup(lag, &li) < 0 ? -ENOENT
+              : add ? dp_lag_add_port(lag, port) : dp_lag_del_port(lag, port);
+    }
+    else
+    {
+        err = add ? lag_bond_add_port(lag, port) : lag_bond_del_port(lag, port);
+    }
+    if (err < 0)
+    {
+        fprintf(stderr, "cmd_lag_member: %s %s lag %s: %s\n", port, add ? "to" : "from", lag,
+                strerror(-err));
+        return -2;
+    }
+    printf("interface %s %s lag %s\n", port, add ? "added to" : "removed from", lag);
+    if (dp_running() && lag_sync_vlan(&li, port, add) < 0)
+    {
+        fprintf(stderr, "cmd_lag_member: %s: could not match the VLAN of lag %s\n", port, lag);
+        return -2;
+    }
+    return 0;
+}
+
+/*
+ * cmd_show_lag - Display the link aggregation groups and their members
+ *
+ * Output:
+ *   One row per LAG: NAME, HASH, UP (members in the hash) / MEMBERS, then
+ *   each member followed by its state: up, down (link down) or absent (not
+ *   switched by the forwarding plane).  Kernel bonds are read from the link
+ *   snapshot; their hash policy is shown as "-".
+ *
+ * Return value:
+ *    0  - success
+ */
+int cmd_show_lag()
+{
+    struct dp_lag_info li;
+    struct dp_port_info pi;
+    unsigned i, j, slot;
+    int n = 0;
+
+    printf("%-16s  %-4s  %-7s  %s\n", "NAME", "HASH", "UP", "MEMBERS");
+    printf("%-16s  %-4s  %-7s  %s\n", "----", "----", "--", "-------");
+    if (dp_running())
+    {
+        for (i = 0; i < DP_MAX_LAGS; i++)
+        {
+            if (dp_get_lag(i, &li) < 0)
+                continue;
+            printf("%-16s  %-4s  %u/%-5u ", li.name, lag_hash_name(li.hash),
+                   (unsigned)__builtin_popcountll(li.up), li.nmembers);
+            for (j = 0; j < li.nmembers; j++)
+            {
+                const char *state = "absent";
+
+                for (slot = 0; slot < DP_MAX_PORTS; slot++)
+                {
+                    if (!(li.ports & (1ull << slot)) || dp_get_port(slot, &pi) < 0 ||
+                        strcmp(pi.name, li.member[j]) != 0)
+                        continue;
+                    state = li.up & (1ull << slot) ? "up" : "down";
+                }
+                printf(" %s(%s)", li.member[j], state);
+            }
+            printf("\n");
+            n++;
+        }
+    }
+    else
+    {
+        const struct vlan_snapshot *snap = vlan_state_read_begin();
+
+        for (i = 0; snap && i < snap->nlinks; i++)
+        {
+            const struct vs_link *b = &snap->links[i];
+            unsigned nup = 0, nmem = 0;
+
+            if (strcmp(b->kind, "bond") != 0)
+                continue;
+            for (j = 0; j < snap->nlinks; j++)
+            {
+                if (snap->links[j].master != b->ifindex)
+                    continue;
+                nmem++;
+                nup += (snap->links[j].flags & IFF_RUNNING) != 0;
+            }
+            printf("%-16s  %-4s  %u/%-5u ", b->name, "-", nup, nmem);
+            for (j = 0; j < snap->nlinks; j++)
+            {
+                if (snap->links[j].master == b->ifindex)
+                    printf(" %s(%s)", snap->links[j].name,
+                           snap->links[j].flags & IFF_RUNNING ? "up" : "down");
+            }
+            printf("\n");
+            n++;
+        }
+        vlan_state_read_end();
+    }
+    printf("Total LAGs: %d (%s)\n", n, dp_running() ? "forwarding plane" : "kernel bonds");
+    return 0;
+}
+
+/*
+ * cmd_create_mirror - Start a mirror session writing pcap-ng files
+ *
+ * Only the forwarding plane mirrors: it copies frames from its forwarding
+ * path to a writer thread (see dataplane.h).  Files are named
+ * <prefix>.<n>.pcapng.
+ *
+ * Input parameters:
+ *   words - "create mirror <name> file <prefix>" followed by option pairs:
+ *           snaplen <bytes>, sample <n> (1 frame in n), rotate <MB> (file
+ *           size limit) and files <n> (files kept before the names wrap)
+ *   cnt   - number of words
+ *
+ * Return value:
+ *    0  - success
+ *   -1  - bad syntax
+ *   -2  - the forwarding plane is not running or refused the session
+ */
+int cmd_create_mirror(char **words, int cnt)
+{
+    struct dp_mirror_cfg cfg;
+    unsigned long long v;
+    int i, err;
+
+    memset(&cfg, 0, sizeof(cfg));
+    if (strlen(words[4]) >= sizeof(cfg.prefix))
+    {
+        fprintf(stderr, "cmd_create_mirror: file prefix too long\n");
+        return -1;
+    }
+    snprintf(cfg.prefix, sizeof(cfg.prefix), "%s", words[4]);
+    for (i = 5; i + 1 < cnt; i += 2)
+    {
+        if (sscanf(words[i + 1], "%llu", &v) != 1 || v > 0xFFFFFFFFull)
+            break;
+        if (strcmp(words[i], "snaplen") == 0 && v <= MIRROR_SNAPLEN_MAX)
+            cfg.snaplen = (unsigned)v;
+        else if (strcmp(words[i], "sample") == 0)
+            cfg.sample = (unsigned)v;
+        else if (strcmp(words[i], "rotate") == 0)
+            cfg.file_bytes = v << 20;
+        else if (strcmp(words[i], "files") == 0)
+            cfg.files = (unsigned)v;
+        else
+            break;
+    }
+    if (i < cnt)
+    {
+        fprintf(stderr, "cmd_create_mirror: usage: create mirror <name> file <prefix> "
+                "[snaplen <1..%u>] [sample <n>] [rotate <MB>] [files <n>]\n",
+                (unsigned)MIRROR_SNAPLEN_MAX);
+        return -1;
+    }
+
+    err = dp_mirror_create(words[2], &cfg);
+    if (err < 0)
+    {
+        fprintf(stderr, "cmd_create_mirror: %s: %s\n", words[2],
+                err == -ENODEV ? "only the forwarding plane (-D) mirrors" : strerror(-err));
+        return -2;
+    }
+    printf("mirror %s created, writing %s.0.pcapng\n", words[2], cfg.prefix);
+    return 0;
+}
+
+/*
+ * cmd_delete_mirror - Stop a mirror session and close its file
+ *
+ * Return value:
+ *    0  - success
+ *   -2  - no such session, or the forwarding plane is not running
+ */
+int cmd_delete_mirror(const char *name)
+{
+    int err = dp_mirror_delete(name);
+
+    if (err < 0)
+    {
+        fprintf(stderr, "cmd_delete_mirror: %s: %s\n", name, strerror(-err));
+        return -2;
+    }
+    printf("mirror %s deleted\n", name);
+    return 0;
+}
+
+/*
+ * cmd_mirror_source - Add a port or VLAN to a mirror session, or remove it
+ *
+ * Input parameters:
+ *   name   - mirror session
+ *   kind   - "interface" or "vlan"
+ *   target - port name or VLAN ID
+ *   dir    - "rx", "tx" or "both"; NULL for the "no" form
+ *
+ * Return value:
+ *    0  - success
+ *   -1  - bad syntax
+ *   -2  - the forwarding plane refused the change
+ */
+int cmd_mirror_source(const char *name, const char *kind, const char *target, const char *dir)
+{
+    unsigned d = 0;
+    int vid = atoi(target);
+    int err;
+
+    if (dir)
+        d = strcmp(dir, "rx") == 0 ? MIRROR_RX : strcmp(dir, "tx") == 0 ? MIRROR_TX
+          : strcmp(dir, "both") == 0 ? MIRROR_BOTH : 0;
+    if ((strcmp(kind, "interface") != 0 && strcmp(kind, "vlan") != 0) || (dir && !d))
+    {
+        fprintf(stderr, "cmd_mirror_source: usage: [no] mirror <name> interface <port>|vlan <id> "
+                "rx|tx|both\n");
+        return -1;
+    }
+    if (kind[0] == 'i')
+        err = dp_mirror_port(name, target, d);
+    else
+        err = vid < 1 || vid > 4094 ? -EINVAL : dp_mirror_vlan(name, (uint16_t)vid, d);
+    if (err < 0)
+    {
+        fprintf(stderr, "cmd_mirror_source: %s %s %s: %s\n", name, kind, target,
+                err == -ENODEV ? "only the forwarding plane (-D) mirrors" : strerror(-err));
+        return -2;
+    }
+    if (dir)
+        printf("mirror %s: %s %s %s\n", name, kind, target, dir);
+    else
+        printf("mirror %s: %s %s removed\n", name, kind, target);
+    return 0;
+}
+
+/* Print the sources of direction @p d of @p mi as " name..." words. */
+static void print_mirror_sources(const struct dp_mirror_info *mi, unsigned d)
+{
+    struct dp_port_info pi;
+    unsigned i;
+
+    for (i = 0; i < DP_MAX_PORTS; i++)
+    {
+        if ((mi->ports[d] & (1ull << i)) && dp_get_port(i, &pi) == 0)
+            printf(" %s", pi.name);
+    }
+    for (i = 1; i < 4095; i++)
+    {
+        if (mi->vlans[d][i / 64] & (1ull << (i % 64)))
+            printf(" vlan%u", i);
+    }
+}
+
+/*
+ * cmd_show_mirror - Display the mirror sessions
+ *
+ * Output:
+ *   One row per session: NAME, SNAPLEN, SAMPLE (1 in n), FRAMES written,
+ *   DROPS (copies lost to full rings or write errors), FILES started and
+ *   the file being written, then its rx and tx sources.
+ *
+ * Return value:
+ *    0  - success
+ *   -1  - the forwarding plane is not running
+ */
+int cmd_show_mirror()
+{
+    struct dp_mirror_info mi;
+    unsigned i;
+    int n = 0;
+
+    if (!dp_running())
+    {
+        fprintf(stderr, "cmd_show_mirror: only the forwarding plane (-D) mirrors\n");
+        return -1;
+    }
+    printf("%-16s  %-7s  %-6s  %-12s  %-10s  %-5s  %s\n",
+           "NAME", "SNAPLEN", "SAMPLE", "FRAMES", "DROPS", "FILES", "FILE");
+    printf("%-16s  %-7s  %-6s  %-12s  %-10s  %-5s  %s\n",
+           "----", "-------", "------", "------", "-----", "-----", "----");
+    for (i = 0; i < DP_MAX_MIRRORS; i++)
+    {
+        if (dp_get_mirror(i, &mi) < 0)
+            continue;
+        printf("%-16s  %-7u  %-6u  %-12llu  %-10llu  %-5u  %s\n", mi.name,
+               mi.cfg.snaplen ? mi.cfg.snaplen : (unsigned)MIRROR_SNAPLEN_MAX,
+               mi.cfg.sample > 1 ? mi.cfg.sample : 1, (unsigned long long)mi.frames,
+               (unsigned long long)mi.drops, mi.nfiles, mi.file);
+        printf("  rx:");
+        print_mirror_sources(&mi, 0);
+        printf("\n  tx:");
+        print_mirror_sources(&mi, 1);
+        printf("\n");
+        n++;
+    }
+    printf("Total sessions: %d\n", n);
+    return 0;
+}
+
+/*
+ * cmd_sflow_enable - Start the sFlow agent or change its settings
+ *
+ * Only the forwarding plane samples (see dataplane.h).  Counters are
+ * polled every 20 s unless "poll" says otherwise; "poll 0" stops polling.
+ *
+ * Input parameters:
+ *   words - "sflow collector <ip> agent <ip>" followed by option pairs:
+ *           port <udp port>, poll <seconds> and header <bytes of each
+ *           sampled frame>
+ *   cnt   - number of words
+ *
+ * Return value:
+ *    0  - success
+ *   -1  - bad syntax
+ *   -2  - the forwarding plane is not running or refused the settings
+ */
+int cmd_sflow_enable(char **words, int cnt)
+{
+    struct dp_sflow_cfg cfg;
+    unsigned long v;
+    int i, err;
+
+    memset(&cfg, 0, sizeof(cfg));
+    cfg.poll_s = 20;
+    if (strcmp(words[3], "agent") != 0 || inet_pton(AF_INET, words[2], cfg.collector) != 1 ||
+        inet_pton(AF_INET, words[4], cfg.agent) != 1)
+        i = 0;
+    else
+        i = 5;
+    for (; i > 0 && i + 1 < cnt; i += 2)
+    {
+        if (sscanf(words[i + 1], "%lu", &v) != 1)
+            break;
+        if (strcmp(words[i], "port") == 0 && v > 0 && v <= 65535)
+            cfg.port = (uint16_t)v;
+        else if (strcmp(words[i], "poll") == 0 && v <= DP_SFLOW_POLL_MAX)
+            cfg.poll_s = (unsigned)v;
+        else if (strcmp(words[i], "header") == 0 && v >= 14 && v <= DP_SFLOW_HEADER_MAX)
+            cfg.header = (unsigned)v;
+        else
+            break;
+    }
+    if (i != cnt)
+    {
+        fprintf(stderr, "cmd_sflow_enable: usage: sflow collector <ip> agent <ip> [port <n>] "
+                "[poll <0..%u>] [header <14..%u>]\n", DP_SFLOW_POLL_MAX, DP_SFLOW_HEADER_MAX);
+        return -1;
+    }
+
+    err = dp_sflow_enable(&cfg);
+    if (err < 0)
+    {
+        fprintf(stderr, "cmd_sflow_enable: %s\n",
+                err == -ENODEV ? "only the forwarding plane (-D) samples" : strerror(-err));
+        return -2;
+    }
+    printf("sflow: exporting to %s port %u\n", words[2], cfg.port ? cfg.port : SFLOW_PORT);
+    return 0;
+}
+
+/*
+ * cmd_sflow_disable - Stop sampling and stop the sFlow agent
+ *
+ * Return value:
+ *    0  - success
+ *   -2  - the agent is not running
+ */
+int cmd_sflow_disable()
+{
+    int err = dp_sflow_disable();
+
+    if (err < 0)
+    {
+        fprintf(stderr, "cmd_sflow_disable: %s\n",
+                err == -ENOENT ? "sflow is not enabled" : strerror(-err));
+        return -2;
+    }
+    printf("sflow: disabled\n");
+    return 0;
+}
+
+/*
+ * cmd_sflow_port - Sample a port 1 in N, or stop sampling it
+ *
+ * Input parameters:
+ *   port - attached port
+ *   rate - N, 1..SFLOW_RATE_MAX; NULL for the "no" form
+ *
+ * Return value:
+ *    0  - success
+ *   -1  - bad rate
+ *   -2  - the forwarding plane refused the change
+ */
+int cmd_sflow_port(const char *port, const char *rate)
+{
+    unsigned long n = 0;
+    int err;
+
+    if (rate && (sscanf(rate, "%lu", &n) != 1 || n < 1 || n > SFLOW_RATE_MAX))
+    {
+        fprintf(stderr, "cmd_sflow_port: rate must be 1..%u\n", SFLOW_RATE_MAX);
+        return -1;
+    }
+    err = dp_sflow_port(port, (uint32_t)n);
+    if (err < 0)
+    {
+        fprintf(stderr, "cmd_sflow_port: %s: %s\n", port,
+                err == -ENOTCONN ? "sflow is not enabled" :
+                err == -ENOENT ? "not a forwarding plane port" : strerror(-err));
+        return -2;
+    }
+    if (rate)
+        printf("sflow: sampling %s 1 in %lu\n", port, n);
+    else
+        printf("sflow: %s no longer sampled\n", port);
+    return 0;
+}
+
+/*
+ * cmd_sflow_vlan - Poll the counters of a VLAN, or stop
+ *
+ * Return value:
+ *    0  - success
+ *   -1  - bad VLAN ID
+ *   -2  - the forwarding plane refused the change
+ */
+int cmd_sflow_vlan(const char *vid, int on)
+{
+    int v = atoi(vid);
+    int err;
+
+    if (v < 1 || v > 4094)
+    {
+        fprintf(stderr, "cmd_sflow_vlan: VLAN ID must be 1..4094\n");
+        return -1;
+    }
+    err = dp_sflow_vlan((uint16_t)v, on);
+    if (err < 0)
+    {
+        fprintf(stderr, "cmd_sflow_vlan: %d: %s\n", v,
+                err == -ENOTCONN ? "sflow is not enabled" : strerror(-err));
+        return -2;
+    }
+    printf("sflow: VLAN %d counters %s\n", v, on ? "polled" : "no longer polled");
+    return 0;
+}
+
+/*
+ * cmd_show_sflow - Display the sFlow agent
+ *
+ * Output:
+ *   The collector, agent address, polling interval and header length, the
+ *   sampled ports with their rates, the polled VLANs, and the samples,
+ *   datagrams and losses so far.
+ *
+ * Return value:
+ *    0  - success
+ *   -1  - the forwarding plane is not running
+ */
+int cmd_show_sflow()
+{
+    struct dp_sflow_info si;
+    struct dp_port_info pi;
+    char col[INET_ADDRSTRLEN], agent[INET_ADDRSTRLEN];
+    unsigned i;
+
+    if (dp_get_sflow(&si) < 0)
+    {
+        fprintf(stderr, "cmd_show_sflow: only the forwarding plane (-D) samples\n");
+        return -1;
+    }
+    if (!si.enabled)
+    {
+        printf("sflow: disabled\n");
+        return 0;
+    }
+    inet_ntop(AF_INET, si.cfg.collector, col, sizeof(col));
+    inet_ntop(AF_INET, si.cfg.agent, agent, sizeof(agent));
+    printf("collector %s port %u, agent %s, poll %u s, header %u bytes\n", col,
+           si.cfg.port ? si.cfg.port : SFLOW_PORT, agent, si.cfg.poll_s,
+           si.cfg.header ? si.cfg.header : SFLOW_HEADER_MAX);
+    printf("%-16s  %s\n", "INTERFACE", "RATE");
+    printf("%-16s  %s\n", "---------", "----");
+    for (i = 0; i < DP_MAX_PORTS; i++)
+    {
+        if (si.rate[i] && dp_get_port(i, &pi) == 0)
+            printf("%-16s  1/%u\n", pi.name, si.rate[i]);
+    }
+    printf("vlans:");
+    for (i = 1; i < 4095; i++)
+    {
+        if (si.vlans[i / 64] & (1ull << (i % 64)))
+            printf(" %u", i);
+    }
+    printf("\nflow samples %llu, counter samples %llu, datagrams %llu, "
+           "ring drops %llu, send errors %llu\n",
+           (unsigned long long)si.samples, (unsigned long long)si.counters,
+           (unsigned long long)si.datagrams, (unsigned long long)si.drops,
+           (unsigned long long)si.send_errors);
+    return 0;
+}
+
+/* Name of port slot @p slot into @p buf. */
+static const char *trace_port(unsigned slot, char *buf, size_t len)
+{
+    struct dp_port_info pi;
+
+    if (dp_get_port(slot, &pi) == 0)
+        snprintf(buf, len, "%s", pi.name);
+    else
+        snprintf(buf, len, "slot %u", slot);
+    return buf;
+}
+
+/* What step @p s decided on, in words, into @p buf. */
+static void trace_detail(const struct trace_step *s, char *buf, size_t len)
+{
+    char name[IFNAMSIZ + 8];
+
+    buf[0] = '\0';
+    switch (s->stage)
+    {
+    case TRACE_PARSE:
+        if (s->arg & TRACE_TAGGED)
+            snprintf(buf, len, "tagged, vid %u pcp %u", s->arg & 0x0FFF, (s->arg >> 13) & 7);
+        else
+            snprintf(buf, len, "untagged");
+        break;
+    case TRACE_CLASSIFY:
+    case TRACE_ACL:
+    case TRACE_STORM:
+        if (s->arg)
+            snprintf(buf, len, "vlan %u", s->arg);
+        break;
+    case TRACE_LEARN:
+        if (s->verdict == TRACE_PASS)
+            snprintf(buf, len, "source on %s", trace_port(s->port, name, sizeof(name)));
+        else
+            snprintf(buf, len, "multicast source");
+        break;
+    case TRACE_ROUTE:
+        snprintf(buf, len, "to vlan %u", s->arg);
+        break;
+    case TRACE_LOOKUP:
+        if (s->verdict == TRACE_HIT)
+            snprintf(buf, len, "vlan %u, on %s", s->arg, trace_port(s->port, name, sizeof(name)));
+        else
+            snprintf(buf, len, "vlan %u", s->arg);
+        break;
+    case TRACE_FORWARD:
+        if (s->verdict == TRACE_UNICAST)
+            snprintf(buf, len, "to %s", trace_port(s->port, name, sizeof(name)));
+        else if (s->verdict == TRACE_FLOOD)
+            snprintf(buf, len, "vlan %u", s->arg);
+        else if (s->verdict == TRACE_FILTER)
+            snprintf(buf, len, "destination behind the ingress port");
+        else
+            snprintf(buf, len, "no LAG member up");
+        break;
+    case TRACE_TX:
+        trace_port(s->port, name, sizeof(name));
+        if (s->arg)
+            snprintf(buf, len, "%s, tagged vid %u pcp %u", name, s->arg & 0x0FFF, (s->arg >> 13) & 7);
+        else
+            snprintf(buf, len, "%s, untagged", name);
+        break;
+    }
+}
+
+/* Print trace @p t, one line per step. */
+static void print_trace(const struct trace *t)
+{
+    char name[IFNAMSIZ + 8];
+    char detail[80];
+    unsigned i;
+
+    printf("%u bytes on %s, %02x:%02x:%02x:%02x:%02x:%02x -> %02x:%02x:%02x:%02x:%02x:%02x\n",
+           t->len, trace_port(t->port, name, sizeof(name)),
+           t->head[6], t->head[7], t->head[8], t->head[9], t->head[10], t->head[11],
+           t->head[0], t->head[1], t->head[2], t->head[3], t->head[4], t->head[5]);
+    printf("  %-9s %-8s %10s %9s  %s\n", "STAGE", "VERDICT", "CYCLES", "NS", "DETAIL");
+    for (i = 0; i < t->nsteps; i++)
+    {
+        const struct trace_step *s = &t->step[i];
+
+        trace_detail(s, detail, sizeof(detail));
+        printf("  %-9s %-8s %10llu %9llu  %s\n", trace_stage_name(s->stage),
+               trace_verdict_name(s->verdict), (unsigned long long)s->cycles,
+               (unsigned long long)trace_ns(s->cycles), detail);
+    }
+    if (t->lost)
+        printf("  ... %u more steps\n", t->lost);
+    printf("  total %llu cycles, %llu ns\n", (unsigned long long)t->cycles,
+           (unsigned long long)trace_ns(t->cycles));
+}
+
+static unsigned hex_nibble(char c)
+{
+    if (isdigit((unsigned char)c))
+        return (unsigned)(c - '0');
+    return (unsigned)(tolower((unsigned char)c) - 'a' + 10);
+}
+
+/* Hex digits of @p s, ':' allowed between bytes, into @p buf; the length,
+ * or -1 if it is not hex or does not fit. */
+static int parse_hex(const char *s, uint8_t *buf, size_t max)
+{
+    size_t n = 0;
+
+    while (*s)
+    {
+        if (*s == ':')
+        {
+            s++;
+            continue;
+        }
+        if (n == max || !isxdigit((unsigned char)s[0]) || !isxdigit((unsigned char)s[1]))
+            return -1;
+        buf[n++] = (uint8_t)(hex_nibble(s[0]) << 4 | hex_nibble(s[1]));
+        s += 2;
+    }
+    return (int)n;
+}
+
+/*
+ * cmd_packet_trace - Forward a frame as if a port had received it and show
+ * the decision of every pipeline stage with its cost
+ *
+ * The frame is either given whole ("frame <hex>", as captured, tag
+ * included) or built: broadcast from 02:00:00:00:00:01 unless "dst" /
+ * "src" say otherwise, untagged unless "vlan" gives a tag, 60 bytes unless
+ * "len" says more.  Either way it really is forwarded.
+ *
+ * Input parameters:
+ *   words - "packet-trace interface <port>" followed by option pairs:
+ *           vlan <id>, src <mac>, dst <mac>, len <bytes>, or frame <hex>
+ *   cnt   - number of words
+ *
+ * Return value:
+ *    0  - success
+ *   -1  - bad syntax
+ *   -2  - the forwarding plane is not running or refused the frame
  */
-int cmd_rename_interfaces(char* prefix, char* new_prefix)
+int cmd_packet_trace(char **words, int cnt)
 {
-    struct nl_sock *sock = NULL;
-    struct nl_cache *cache = NULL;
-    struct rtnl_link *link = NULL;
-    struct rtnl_link *change = NULL;
-    struct nl_object *_nl_iter = NULL;
-    int ret_code = 0;
-    size_t prefix_len;
-    int _nl_err;
+    static const uint8_t bcast[6] = { 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF };
+    uint8_t frame[DP_TRACE_FRAME_MAX];
+    uint8_t src[6] = { 0x02, 0, 0, 0, 0, 0x01 };
+    uint8_t dst[6];
+    struct trace t;
+    unsigned long vid = 0, len = 60;
+    int given = -1;
+    size_t off = 12;
+    int i, err;
+
+    memcpy(dst, bcast, 6);
+    for (i = 3; i + 1 < cnt; i += 2)
+    {
+        const char *v = words[i + 1];
 
-    if (!prefix || !new_prefix)
+        if (strcmp(words[i], "frame") == 0 && cnt == 5)
+        {
+            if ((given = parse_hex(v, frame, sizeof(frame))) < ETH_HLEN)
+                break;
+        }
+        else if (strcmp(words[i], "vlan") == 0)
+        {
+            if (sscanf(v, "%lu", &vid) != 1 || vid < 1 || vid > 4094)
+                break;
+        }
+        else if (strcmp(words[i], "src") == 0)
+        {
+            if (parse_mac(v, src) < 0)
+                break;
+        }
+        else if (strcmp(words[i], "dst") == 0)
+        {
+            if (parse_mac(v, dst) < 0)
+                break;
+        }
+        else if (strcmp(words[i], "len") != 0 || sscanf(v, "%lu", &len) != 1 ||
+                 len < 60 || len > DP_TRACE_FRAME_MAX)
+        {
+            break;
+        }
+    }
+    if (i != cnt)
     {
-        fprintf(stderr, "cmd_rename_interfaces: prefix or new_prefix is NULL\n");
+        fprintf(stderr, "cmd_packet_trace: usage: packet-trace interface <port> [vlan <id>] "
+                "[src <mac>] [dst <mac>] [len <60..%u>] | frame <hex>\n", DP_TRACE_FRAME_MAX);
         return -1;
     }
 
-    NL_CALL_RET(sock, nl_socket_alloc(),
-                "nl_socket_alloc", "");
-    if (!sock)
+    if (given < 0)
     {
-        fprintf(stderr, "cmd_rename_interfaces: failed to allocate netlink socket\n");
-        return -2;
+        memset(frame, 0, len);
+        memcpy(frame, dst, 6);
+        memcpy(frame + 6, src, 6);
+        if (vid)
+        {
+            frame[off++] = 0x81;
+            frame[off++] = 0x00;
+            frame[off++] = (uint8_t)(vid >> 8);
+            frame[off++] = (uint8_t)vid;
+        }
+        frame[off++] = 0x88;                    /* local experimental EtherType */
+        frame[off] = 0xB5;
+        given = (int)len;
     }
 
-    NL_CALL_RET(_nl_err, nl_connect(sock, NETLINK_ROUTE),
-                "nl_connect", "sock=%p, protocol=NETLINK_ROUTE", (void *)sock);
-    if (_nl_err < 0)
+    err = dp_trace_inject(words[2], frame, (uint32_t)given, &t);
+    if (err < 0)
     {
-        fprintf(stderr, "cmd_rename_interfaces: failed to connect netlink socket\n");
-        NL_CALL_VOID(nl_socket_free(sock),
-                     "nl_socket_free", "sock=%p", (void *)sock);
-        return -3;
+        fprintf(stderr, "cmd_packet_trace: %s: %s\n", words[2],
+                err == -ENODEV ? "only the forwarding plane (-D) traces" :
+                err == -ENOENT ? "not a forwarding plane port" : strerror(-err));
+        return -2;
     }
+    print_trace(&t);
+    return 0;
+}
 
-    NL_CALL_RET(_nl_err, rtnl_link_alloc_cache(sock, AF_UNSPEC, &cache),
-                "rtnl_link_alloc_cache",
-                "sock=%p, family=AF_UNSPEC, cache=%p",
-                (void *)sock, (void *)cache);
-    if (_nl_err < 0)
+/*
+ * cmd_packet_trace_sample - Trace 1 in N of the frames a port receives, or
+ * stop
+ *
+ * At most one frame per forwarding worker and millisecond is traced; the
+ * newest traces are shown by "show packet-trace".
+ *
+ * Input parameters:
+ *   port - attached port
+ *   rate - N, at least 1; NULL for the "no" form
+ *
+ * Return value:
+ *    0  - success
+ *   -1  - bad rate
+ *   -2  - the forwarding plane refused the change
+ */
+int cmd_packet_trace_sample(const char *port, const char *rate)
+{
+    unsigned long n = 0;
+    int err;
+
+    if (rate && (sscanf(rate, "%lu", &n) != 1 || n < 1 || n > UINT32_MAX))
     {
-        fprintf(stderr, "cmd_rename_interfaces: failed to allocate link cache\n");
-        NL_CALL_VOID(nl_socket_free(sock),
-                     "nl_socket_free", "sock=%p", (void *)sock);
-        return -4;
+        fprintf(stderr, "cmd_packet_trace_sample: rate must be 1..%u\n", UINT32_MAX);
+        return -1;
+    }
+    err = dp_trace_sample(port, (uint32_t)n);
+    if (err < 0)
+    {
+        fprintf(stderr, "cmd_packet_trace_sample: %s: %s\n", port,
+                err == -ENODEV ? "only the forwarding plane (-D) traces" :
+                err == -ENOENT ? "not a forwarding plane port" : strerror(-err));
+        return -2;
     }
+    if (rate)
+        printf("packet-trace: tracing %s 1 in %lu\n", port, n);
+    else
+        printf("packet-trace: %s no longer traced\n", port);
+    return 0;
+}
 
-    prefix_len = strlen(prefix);
+/*
+ * cmd_show_packet_trace - Display the traced ports and the newest traces
+ *
+ * Output:
+ *   The ports sampled for tracing with their rates, then the newest traces
+ *   of sampled frames, newest first, each with its time.
+ *
+ * Return value:
+ *    0  - success
+ *   -1  - the forwarding plane is not running
+ */
+int cmd_show_packet_trace()
+{
+    static struct trace traces[16];
+    uint32_t rate[DP_MAX_PORTS];
+    struct dp_port_info pi;
+    int i, n;
 
-    NL_CALL_RET(_nl_iter, nl_cache_get_first(cache),
-                "nl_cache_get_first", "cache=%p", (void *)cache);
-    link = (struct rtnl_link *)_nl_iter;
-    while (link != NULL)
+    if (dp_get_trace_rates(rate) < 0 || (n = dp_get_traces(traces, 16)) < 0)
     {
-        const char *name;
-        char new_name[IFNAMSIZ];
-        int err;
+        fprintf(stderr, "cmd_show_packet_trace: only the forwarding plane (-D) traces\n");
+        return -1;
+    }
+    printf("%-16s  %s\n", "INTERFACE", "RATE");
+    printf("%-16s  %s\n", "---------", "----");
+    for (i = 0; i < DP_MAX_PORTS; i++)
+    {
+        if (rate[i] && dp_get_port((unsigned)i, &pi) == 0)
+            printf("%-16s  1/%u\n", pi.name, rate[i]);
+    }
+    for (i = 0; i < n; i++)
+    {
+        time_t sec = (time_t)(traces[i].ts_ns / 1000000000ull);
+        struct tm tm;
 
-        NL_CALL_RET(name, rtnl_link_get_name(link),
-                    "rtnl_link_get_name", "link=%p", (void *)link);
+        localtime_r(&sec, &tm);
+        printf("\n%02d:%02d:%02d.%06llu  ", tm.tm_hour, tm.tm_min, tm.tm_sec,
+               (unsigned long long)(traces[i].ts_ns % 1000000000ull / 1000));
+        print_trace(&traces[i]);
+    }
+    printf("Total traces: %d\n", n);
+    return 0;
+}
 
-        if (!name || strncmp(name, prefix, prefix_len) != 0)
-        {
-            NL_CALL_RET(_nl_iter, nl_cache_get_next((struct nl_object *)link),
-                        "nl_cache_get_next", "obj=%p", (void *)link);
-            link = (struct rtnl_link *)_nl_iter;
-            continue;
-        }
+/*
+ * cmd_resource - Configure the capacity or the alarm thresholds of a table
+ *
+ * "resource <table> capacity <n>" limits a table (vlan, fdb, acl, route)
+ * to n entries, at most what it can hold; creations past it fail with
+ * -ENOSPC before reaching the kernel or the forwarding plane.  "resource
+ * <table> threshold <high> [<low>]" raises the table's alarm at high
+ * percent of the capacity and clears it at low percent (default: ten
+ * points below high).
+ *
+ * Input parameters:
+ *   table - table name
+ *   what  - "capacity" or "threshold"
+ *   a     - capacity, or high threshold
+ *   b     - low threshold, or NULL
+ *
+ * Return value:
+ *    0  - success
+ *   -1  - unknown table or bad number
+ *   -2  - the table holds more entries than the capacity
+ */
+int cmd_resource(const char *table, const char *what, const char *a, const char *b)
+{
+    int kind = res_kind_parse(table);
+    struct res_info r;
+    char *end;
+    long n = strtol(a, &end, 10);
+    long low;
+    int err;
 
-        snprintf(new_name, sizeof(new_name), "%s%s", new_prefix, name + prefix_len);
+    if (kind < 0 || *end || n < 1)
+    {
+        fprintf(stderr, "cmd_resource: usage: resource vlan|fdb|acl|route capacity <n> | "
+                "threshold <high> [<low>]\n");
+        return -1;
+    }
 
-        NL_CALL_RET(change, rtnl_link_alloc(),
-                    "rtnl_link_alloc", "");
-        if (!change)
+    if (strcmp(what, "capacity") == 0)
+    {
+        err = kind == RES_FDB ? dp_fdb_set_capacity((unsigned)n)
+                              : res_set_capacity((enum res_kind)kind, (unsigned)n);
+        if (err == -EBUSY)
         {
-            fprintf(stderr, "cmd_rename_interfaces: failed to allocate change link for %s\n", name);
-            ret_code = -5;
-            break;
+            fprintf(stderr, "cmd_resource: %s holds more than %ld entries\n", table, n);
+            return -2;
         }
-
-        NL_CALL_VOID(rtnl_link_set_name(change, new_name),
-                     "rtnl_link_set_name", "link=%p, name=\"%s\"",
-                     (void *)change, new_name);
-
-        NL_CALL_RET(err, rtnl_link_change(sock, link, change, 0),
-                    "rtnl_link_change",
-                    "sock=%p, link=%p, change=%p, flags=0",
-                    (void *)sock, (void *)link, (void *)change);
         if (err < 0)
         {
-            const char *_errmsg;
-            NL_CALL_RET(_errmsg, nl_geterror(err),
-                        "nl_geterror", "err=%d", err);
-            fprintf(stderr, "cmd_rename_interfaces: rename %s -> %s failed: %s\n",
-                    name, new_name, _errmsg);
-            NL_CALL_VOID(rtnl_link_put(change),
-                         "rtnl_link_put", "link=%p", (void *)change);
-            ret_code = -5;
-            NL_CALL_RET(_nl_iter, nl_cache_get_next((struct nl_object *)link),
-                        "nl_cache_get_next", "obj=%p", (void *)link);
-            link = (struct rtnl_link *)_nl_iter;
-            continue;
+            res_get((enum res_kind)kind, &r);
+            fprintf(stderr, "cmd_resource: %s capacity must be 1..%u\n", table, r.limit);
+            return -1;
         }
+        printf("resource %s: capacity %ld\n", table, n);
+        return 0;
+    }
 
-        printf("%s -> %s\n", name, new_name);
-        NL_CALL_VOID(rtnl_link_put(change),
-                     "rtnl_link_put", "link=%p", (void *)change);
+    low = b ? strtol(b, &end, 10) : (n > 10 ? n - 10 : 0);
+    if ((b && *end) || low < 0 || res_set_threshold((enum res_kind)kind, (unsigned)n,
+                                                    (unsigned)low) < 0)
+    {
+        fprintf(stderr, "cmd_resource: thresholds must satisfy 0 <= low < high <= 100\n");
+        return -1;
+    }
+    printf("resource %s: alarm at %ld%%, cleared at %ld%%\n", table, n, low);
+    return 0;
+}
 
-        NL_CALL_RET(_nl_iter, nl_cache_get_next((struct nl_object *)link),
-                    "nl_cache_get_next", "obj=%p", (void *)link);
-        link = (struct rtnl_link *)_nl_iter;
+/*
+ * cmd_show_resources - Display the capacity and usage of every table
+ *
+ * Output:
+ *   One row per table: TABLE, LIMIT (what it can hold), CAPACITY
+ *   (configured), USED, PEAK (high-water mark), THRESHOLD (raise / clear
+ *   percentages), ALARM and REFUSED (reservations failed with -ENOSPC).
+ *   FDB usage is what the forwarding plane last reported.
+ *
+ * Return value: 0
+ */
+int cmd_show_resources()
+{
+    struct res_info r;
+    char thr[16];
+    unsigned k;
+
+    printf("%-6s  %8s  %8s  %8s  %5s  %8s  %-9s  %-6s  %s\n", "TABLE", "LIMIT", "CAPACITY",
+           "USED", "USE%", "PEAK", "THRESHOLD", "ALARM", "REFUSED");
+    printf("%-6s  %8s  %8s  %8s  %5s  %8s  %-9s  %-6s  %s\n", "-----", "-----", "--------",
+           "----", "----", "----", "---------", "-----", "-------");
+    for (k = 0; k < RES_NKINDS; k++)
+    {
+        res_get((enum res_kind)k, &r);
+        snprintf(thr, sizeof(thr), "%u/%u%%", r.high, r.low);
+        printf("%-6s  %8u  %8u  %8u  %4u%%  %8u  %-9s  %-6s  %llu\n", r.name, r.limit,
+               r.capacity, r.used, (unsigned)((uint64_t)r.used * 100 / r.capacity),
+               r.high_water, thr, r.alarm ? "raised" : "-", (unsigned long long)r.failures);
     }
+    return 0;
+}
 
-    NL_CALL_VOID(nl_cache_free(cache),
-                 "nl_cache_free", "cache=%p", (void *)cache);
-    NL_CALL_VOID(nl_socket_free(sock),
-                 "nl_socket_free", "sock=%p", (void *)sock);
-    return ret_code;
+/*
+ * format_alarm - Render the state of a table's alarm as one line for
+ * subscribers and the log
+ *
+ * Return value: length of the line
+ */
+static int format_alarm(char *line, size_t size, const struct res_info *r)
+{
+    int len = snprintf(line, size, "resource-alarm %s %s: %u of %u used (%u%%)\n", r->name,
+                       r->alarm ? "raised" : "cleared", r->used, r->capacity,
+                       (unsigned)((uint64_t)r->used * 100 / r->capacity));
+
+    return len < (int)size ? len : (int)size - 1;
 }
 
+/* Subscribed clients of the poll set, for stream_alarm(). */
+struct alarm_sinks
+{
+    const struct pollfd *fds;
+    const struct client *clients;
+    int                  nfds;
+};
+
 /*
- * cmd_show_vlan - Display all existing VLAN interfaces and their basic properties
+ * stream_alarm - Log an alarm change and send it to every subscribed client
  *
- * Description:
- *   Enumerates all network interfaces via the Netlink ROUTE API and filters
- *   those whose kernel type is "vlan". For each VLAN interface, the following
- *   properties are displayed:
- *     - Interface name
- *     - Parent interface name (resolved from the parent's ifindex)
- *     - VLAN ID (802.1Q tag)
- *     - VLAN flags (e.g. reorder-hdr, gvrp, loose-binding, mvrp, bridge-binding)
+ * A subscriber that does not read is skipped rather than waited for.
+ */
+static void stream_alarm(enum res_kind kind, const struct res_info *r, void *arg)
+{
+    const struct alarm_sinks *s = arg;
+    char line[160];
+    int len = format_alarm(line, sizeof(line), r);
+    int i;
+
+    (void)kind;
+    printf("%s", line);
+    for (i = NUM_FIXED; i < s->nfds; i++)
+    {
+        if (s->clients[i].alarms)
+            (void)!send(s->fds[i].fd, line, (size_t)len, MSG_NOSIGNAL | MSG_DONTWAIT);
+    }
+}
+
+/*
+ * subscribe_alarms - Start or stop streaming resource alarms to a client
  *
- * Input parameters: none
+ * A new subscriber is sent the alarms that are raised already, so it does
+ * not have to wait for the next change to learn about them.
+ */
+static void subscribe_alarms(int fd, struct client *c, int on)
+{
+    struct res_info r;
+    char line[160];
+    unsigned k;
+
+    c->alarms = on;
+    printf("Client %s resource alarms\n", on ? "subscribed to" : "unsubscribed from");
+    for (k = 0; on && k < RES_NKINDS; k++)
+    {
+        res_get((enum res_kind)k, &r);
+        if (r.alarm)
+            (void)!send(fd, line, (size_t)format_alarm(line, sizeof(line), &r),
+                        MSG_NOSIGNAL | MSG_DONTWAIT);
+    }
+}
+
+/*
+ * seed_resources - Count the Vlan<id> bridges that exist at startup as
+ * used entries of the VLAN table
+ */
+static void seed_resources(void)
+{
+    const struct vlan_snapshot *snap = vlan_state_read_begin();
+    unsigned vid, n = 0;
+
+    for (vid = 1; snap && vid < VLAN_ID_SPACE; vid++)
+        n += snap->bridge_ifindex[vid] != 0;
+    vlan_state_read_end();
+    res_set_used(RES_VLAN, n);
+}
+
+/* The text client a line_buf callback runs for. */
+struct text_client
+{
+    int            fd;
+    struct client *c;
+};
+
+/*
+ * handle_client_line - Execute one text command
  *
- * Output:
- *   Prints a table with columns: NAME, PARENT, VLAN_ID, FLAGS
+ * "[un]subscribe resource-alarms" concerns the connection itself and is
+ * handled here; the results of the bridge FDB and "set interface" commands
+ * are streamed back to the client.
+ */
+static void handle_client_line(char *line, void *arg)
+{
+    const struct text_client *t = arg;
+
+    if (g_verbose)
+        printf("Received command: %s\n", line);
+    if (strcmp(line, "subscribe resource-alarms") == 0)
+        subscribe_alarms(t->fd, t->c, 1);
+    else if (strcmp(line, "unsubscribe resource-alarms") == 0)
+        subscribe_alarms(t->fd, t->c, 0);
+    else if (strncmp(line, "bridge fdb ", 11) == 0 ||
+             strncmp(line, "show bridge fdb", 15) == 0 ||
+             strncmp(line, "set interface ", 14) == 0)
+        dispatch_client_command(line, t->fd);
+    else
+        dispatch_command(line);
+}
+
+/*
+ * handle_client_data - Reassemble and execute newline-terminated commands
+ *
+ * Appends `data` to the client's line buffer and executes every complete
+ * line; a command split across reads runs once its newline arrives.  On a
+ * SOCK_SEQPACKET socket the end of each message ends its last command, so
+ * one command per message needs no terminator there.
+ *
+ * Return value:
+ *    0  - success (an unterminated tail is kept for the next read)
+ *   -1  - line too long or out of memory; the connection should be closed
+ */
+static int handle_client_data(int fd, struct client *c, const char *data, size_t n)
+{
+    struct text_client t = { fd, c };
+    int err;
+
+    err = line_buf_feed(&c->line, data, n, handle_client_line, &t);
+    if (err < 0)
+    {
+        fprintf(stderr, "text client: %s, closing connection\n",
+                err == -EMSGSIZE ? "command line too long" : strerror(-err));
+        return -1;
+    }
+    if (c->record)
+        line_buf_flush(&c->line, handle_client_line, &t);
+    return 0;
+}
+
+/*
+ * handle_binary_data - Reassemble and execute binary protocol frames
+ *
+ * Appends `data` to the client's buffer and executes every complete frame.
  *
  * Return value:
- *    0  - success
- *   -1  - failed to allocate netlink socket
- *   -2  - failed to connect netlink socket to NETLINK_ROUTE
- *   -3  - failed to allocate the link cache from the kernel
+ *    0  - success (incomplete trailing data is kept for the next read)
+ *   -1  - protocol error or out of memory; the connection should be closed
  */
-int cmd_show_vlan()
+static int handle_binary_data(int fd, struct client *c, const uint8_t *data, size_t n)
 {
-    struct nl_sock *sock = NULL;
-    struct nl_cache *cache = NULL;
-    struct rtnl_link *link = NULL;
-    struct rtnl_link *parent_link = NULL;
-    struct nl_object *_nl_iter = NULL;
-    int _nl_err;
+    struct vbp_frame frame;
+    size_t off = 0;
+    int consumed;
 
-    NL_CALL_RET(sock, nl_socket_alloc(),
-                "nl_socket_alloc", "");
-    if (!sock)
+    if (c->len + n > c->cap)
     {
-        fprintf(stderr, "cmd_show_vlan: failed to allocate netlink socket\n");
+        size_t cap = c->cap ? c->cap : 4096;
+        uint8_t *nb;
+
+        while (cap < c->len + n)
+            cap *= 2;
+        if (cap > VBP_HDR_LEN + VBP_MAX_PAYLOAD)
+        {
+            fprintf(stderr, "binary client exceeded maximum frame size\n");
+            return -1;
+        }
+        nb = realloc(c->buf, cap);
+        if (!nb)
+        {
+            perror("realloc");
+            return -1;
+        }
+        c->buf = nb;
+        c->cap = cap;
+    }
+    memcpy(c->buf + c->len, data, n);
+    c->len += n;
+
+    if (!c->conn && !(c->conn = vbp_conn_new(fd)))
+    {
+        perror("vbp_conn_new");
         return -1;
     }
 
-    NL_CALL_RET(_nl_err, nl_connect(sock, NETLINK_ROUTE),
-                "nl_connect", "sock=%p, protocol=NETLINK_ROUTE", (void *)sock);
-    if (_nl_err < 0)
+    while ((consumed = vbp_parse_frame(c->buf + off, c->len - off, &frame)) > 0)
     {
-        fprintf(stderr, "cmd_show_vlan: failed to connect netlink socket\n");
-        NL_CALL_VOID(nl_socket_free(sock),
-                     "nl_socket_free", "sock=%p", (void *)sock);
-        return -2;
+        if (g_verbose)
+            printf("Received binary batch seq=%u ops=%u\n", frame.seq, frame.count);
+        if (vbp_execute(c->conn, &frame) < 0)
+            fprintf(stderr, "failed to execute binary batch seq=%u\n", frame.seq);
+        vbp_frame_free(&frame);
+        off += (size_t)consumed;
     }
 
-    NL_CALL_RET(_nl_err, rtnl_link_alloc_cache(sock, AF_UNSPEC, &cache),
-                "rtnl_link_alloc_cache",
-                "sock=%p, family=AF_UNSPEC, cache=%p",
-                (void *)sock, (void *)cache);
-    if (_nl_err < 0)
+    if (consumed < 0)
     {
-        fprintf(stderr, "cmd_show_vlan: failed to allocate link cache\n");
-        NL_CALL_VOID(nl_socket_free(sock),
-                     "nl_socket_free", "sock=%p", (void *)sock);
-        return -3;
+        fprintf(stderr, "binary protocol error, closing connection\n");
+        return -1;
     }
 
-    printf("%-20s  %-20s  %-10s  %s\n", "NAME", "PARENT", "VLAN_ID", "FLAGS");
-    printf("%-20s  %-20s  %-10s  %s\n", "----", "------", "-------", "-----");
+    memmove(c->buf, c->buf + off, c->len - off);
+    c->len -= off;
+    return 0;
+}
 
-    NL_CALL_RET(_nl_iter, nl_cache_get_first(cache),
-                "nl_cache_get_first", "cache=%p", (void *)cache);
-    link = (struct rtnl_link *)_nl_iter;
-    while (link != NULL)
-    {
-        char flags_buf[128] = {0};
-        const char *parent_name = "-";
-        int parent_idx;
-        int vlan_id;
-        int _is_vlan;
-        uint32_t _vlan_flags;
-        const char *_name;
+static void usage(const char *prog)
+{
+    fprintf(stderr,
+            "Usage: %s [-w workers] [-b addr] [-p port] [-T] [-u path] [-S] [-g gid]\n"
+            "          [-c config] [-D] [-F workers] [-P cpus] [-X] [-v]\n"
+            "  -w N     number of command worker threads (default: online CPUs)\n"
+            "  -b ADDR  TCP bind address (default: 0.0.0.0; use 127.0.0.1 for loopback)\n"
+            "  -p PORT  TCP port (default: %d)\n"
+            "  -T       disable the TCP listener\n"
+            "  -u PATH  Unix domain socket path (default: %s; \"none\" disables)\n"
+            "  -S       use SOCK_SEQPACKET instead of SOCK_STREAM for the Unix socket\n"
+            "  -g GID   additionally allow Unix socket peers in this group (primary or\n"
+            "           supplementary)\n"
+            "  -c FILE  startup configuration, executed before accepting clients\n"
+            "  -D       switch VLAN member ports in the user-space forwarding plane\n"
+            "  -F N     forwarding worker threads for -D (default: 1, or one per -P CPU)\n"
+            "  -P LIST  pin forwarding workers to these CPUs, e.g. 2-5 or 2,4,6\n"
+            "  -X       use AF_XDP on ports with one RX queue per forwarding worker\n"
+            "  -v       log every command and binary batch as it is received\n",
+            prog, PORT, UNIX_SOCKET_PATH);
+}
 
-        NL_CALL_RET(_is_vlan, rtnl_link_is_vlan(link),
-                    "rtnl_link_is_vlan", "link=%p", (void *)link);
-        if (!_is_vlan)
-        {
-            NL_CALL_RET(_nl_iter, nl_cache_get_next((struct nl_object *)link),
-                        "nl_cache_get_next", "obj=%p", (void *)link);
-            link = (struct rtnl_link *)_nl_iter;
-            continue;
-        }
+/*
+ * parse_cpulist - Parse a CPU list such as "0,2-4" into @cpus
+ *
+ * Return value: number of CPUs stored, or -1 if the list is malformed or
+ *               names more than @max CPUs
+ */
+static int parse_cpulist(const char *list, int *cpus, unsigned max)
+{
+    unsigned n = 0;
+    const char *p = list;
+    char *end;
 
-        NL_CALL_RET(vlan_id, rtnl_link_vlan_get_id(link),
-                    "rtnl_link_vlan_get_id", "link=%p", (void *)link);
-        NL_CALL_RET(parent_idx, rtnl_link_get_link(link),
-                    "rtnl_link_get_link", "link=%p", (void *)link);
+    while (*p)
+    {
+        long lo, hi;
 
-        NL_CALL_RET(parent_link, rtnl_link_get(cache, parent_idx),
-                    "rtnl_link_get", "cache=%p, idx=%d", (void *)cache, parent_idx);
-        if (parent_link)
+        lo = strtol(p, &end, 10);
+        if (end == p || lo < 0)
+            return -1;
+        hi = lo;
+        if (*end == '-')
         {
-            NL_CALL_RET(parent_name, rtnl_link_get_name(parent_link),
-                        "rtnl_link_get_name", "link=%p", (void *)parent_link);
+            p = end + 1;
+            hi = strtol(p, &end, 10);
+            if (end == p || hi < lo)
+                return -1;
         }
-
-        NL_CALL_RET(_vlan_flags, (uint32_t)rtnl_link_vlan_get_flags(link),
-                    "rtnl_link_vlan_get_flags", "link=%p", (void *)link);
-        NL_CALL_VOID(rtnl_link_vlan_flags2str((int)_vlan_flags, flags_buf, sizeof(flags_buf)),
-                     "rtnl_link_vlan_flags2str",
-                     "flags=%u, buf=%p, len=%zu",
-                     _vlan_flags, (void *)flags_buf, sizeof(flags_buf));
-
-        NL_CALL_RET(_name, rtnl_link_get_name(link),
-                    "rtnl_link_get_name", "link=%p", (void *)link);
-
-        printf("%-20s  %-20s  %-10d  %s\n",
-               _name,
-               parent_name,
-               vlan_id,
-               flags_buf[0] ? flags_buf : "none");
-
-        if (parent_link)
+        for (; lo <= hi; lo++)
         {
-            NL_CALL_VOID(rtnl_link_put(parent_link),
-                         "rtnl_link_put", "link=%p", (void *)parent_link);
-            parent_link = NULL;
+            if (n == max)
+                return -1;
+            cpus[n++] = (int)lo;
         }
-
-        NL_CALL_RET(_nl_iter, nl_cache_get_next((struct nl_object *)link),
-                    "nl_cache_get_next", "obj=%p", (void *)link);
-        link = (struct rtnl_link *)_nl_iter;
+        if (*end == ',')
+            end++;
+        else if (*end != '\0')
+            return -1;
+        p = end;
     }
+    return n ? (int)n : -1;
+}
 
-    NL_CALL_VOID(nl_cache_free(cache),
-                 "nl_cache_free", "cache=%p", (void *)cache);
-    NL_CALL_VOID(nl_socket_free(sock),
-                 "nl_socket_free", "sock=%p", (void *)sock);
-    return 0;
+static volatile sig_atomic_t g_stop;
+
+static void on_signal(int sig)
+{
+    (void)sig;
+    g_stop = 1;
 }
 
 /*
- * cmd_set_vlan_on_interface - Add a VLAN sub-interface to a network interface
- *
- * Description:
- *   Creates a new kernel "vlan"-type link on top of the specified parent
- *   interface using the Netlink ROUTE API (RTM_NEWLINK). The new interface is
- *   named "<iface>.<ver>" (e.g. "Ethernet56.v2"). The `type` string (e.g.
- *   "l2-trunk") is stored as the link alias so that cmd_set_vlan() can later
- *   locate this interface by `ver`. A placeholder VLAN ID of 1 is used at
- *   creation time; the actual ID should be set afterwards with cmd_set_vlan().
- *
- * Input parameters:
- *   iface  - parent interface name (e.g. "Ethernet56"); must already exist
- *   type   - VLAN type string (e.g. "l2-trunk", "l2-access"); stored as alias
- *   ver    - VLAN version/name used as the new interface name suffix (e.g. "v2")
- *
- * Output:
- *   On success, prints:
- *     Created VLAN interface <iface>.<ver> (type=<type>) on <iface>
+ * open_tcp_listener - Create the non-blocking TCP control listener
  *
- * Return value:
- *    0  - success
- *   -1  - iface, type, or ver is NULL
- *   -2  - failed to allocate netlink socket
- *   -3  - failed to connect netlink socket to NETLINK_ROUTE
- *   -4  - failed to allocate the link cache from the kernel
- *   -5  - parent interface not found in the cache
- *   -6  - failed to allocate the new VLAN link object
- *   -7  - RTM_NEWLINK failed (kernel error creating VLAN link)
+ * Return value: listening socket, or -1 on error (already reported)
  */
-int cmd_set_vlan_on_interface(char* iface, char* type, char* ver)
+static int open_tcp_listener(const char *bind_addr, int port)
 {
-    struct nl_sock *sock = NULL;
-    struct nl_cache *cache = NULL;
-    struct rtnl_link *parent = NULL;
-    struct rtnl_link *vlan_link = NULL;
-    char vlan_ifname[IFNAMSIZ];
-    int err;
-    int _nl_err;
-    int _parent_idx;
+    struct sockaddr_in address;
+    int fd;
 
-    if (!iface || !type || !ver)
+    memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_port = htons(port);
+    if (inet_pton(AF_INET, bind_addr, &address.sin_addr) != 1)
     {
-        fprintf(stderr, "cmd_set_vlan_on_interface: iface, type, or ver is NULL\n");
+        fprintf(stderr, "invalid TCP bind address: %s\n", bind_addr);
         return -1;
     }
 
-    NL_CALL_RET(sock, nl_socket_alloc(),
-                "nl_socket_alloc", "");
-    if (!sock)
-    {
-        fprintf(stderr, "cmd_set_vlan_on_interface: failed to allocate netlink socket\n");
-        return -2;
-    }
-
-    NL_CALL_RET(_nl_err, nl_connect(sock, NETLINK_ROUTE),
-                "nl_connect", "sock=%p, protocol=NETLINK_ROUTE", (void *)sock);
-    if (_nl_err < 0)
-    {
-        fprintf(stderr, "cmd_set_vlan_on_interface: failed to connect netlink socket\n");
-        NL_CALL_VOID(nl_socket_free(sock),
-                     "nl_socket_free", "sock=%p", (void *)sock);
-        return -3;
-    }
-
-    NL_CALL_RET(_nl_err, rtnl_link_alloc_cache(sock, AF_UNSPEC, &cache),
-                "rtnl_link_alloc_cache",
-                "sock=%p, family=AF_UNSPEC, cache=%p",
-                (void *)sock, (void *)cache);
-    if (_nl_err < 0)
+    /* Bug fix: socket() returns -1 on failure, not 0; fd 0 is a valid descriptor */
+    if ((fd = socket(AF_INET, SOCK_STREAM, 0)) < 0)
     {
-        fprintf(stderr, "cmd_set_vlan_on_interface: failed to allocate link cache\n");
-        NL_CALL_VOID(nl_socket_free(sock),
-                     "nl_socket_free", "sock=%p", (void *)sock);
-        return -4;
+        perror("socket failed");
+        return -1;
     }
 
-    NL_CALL_RET(parent, rtnl_link_get_by_name(cache, iface),
-                "rtnl_link_get_by_name", "cache=%p, name=\"%s\"",
-                (void *)cache, iface);
-    if (!parent)
+    /* Bug fix: SO_REUSEADDR must be set BEFORE bind(), not after listen() */
+    if (set_reuseraddr(fd) < 0)
     {
-        fprintf(stderr, "cmd_set_vlan_on_interface: interface '%s' not found\n", iface);
-        NL_CALL_VOID(nl_cache_free(cache),
-                     "nl_cache_free", "cache=%p", (void *)cache);
-        NL_CALL_VOID(nl_socket_free(sock),
-                     "nl_socket_free", "sock=%p", (void *)sock);
-        return -5;
+        perror("set_reuseraddr");
+        close(fd);
+        return -1;
     }
 
-    snprintf(vlan_ifname, sizeof(vlan_ifname), "%s.%s", iface, ver);
-
-    /* rtnl_link_vlan_alloc() allocates a link pre-configured as type "vlan" */
-    NL_CALL_RET(vlan_link, rtnl_link_vlan_alloc(),
-                "rtnl_link_vlan_alloc", "");
-    if (!vlan_link)
+    if (bind(fd, (struct sockaddr *)&address, sizeof(address)) < 0)
     {
-        fprintf(stderr, "cmd_set_vlan_on_interface: failed to allocate VLAN link object\n");
-        NL_CALL_VOID(rtnl_link_put(parent),
-                     "rtnl_link_put", "link=%p", (void *)parent);
-        NL_CALL_VOID(nl_cache_free(cache),
-                     "nl_cache_free", "cache=%p", (void *)cache);
-        NL_CALL_VOID(nl_socket_free(sock),
-                     "nl_socket_free", "sock=%p", (void *)sock);
-        return -6;
+        perror("bind failed");
+        close(fd);
+        return -1;
     }
 
-    NL_CALL_VOID(rtnl_link_set_name(vlan_link, vlan_ifname),
-                 "rtnl_link_set_name", "link=%p, name=\"%s\"",
-                 (void *)vlan_link, vlan_ifname);
-
-    NL_CALL_RET(_parent_idx, rtnl_link_get_ifindex(parent),
-                "rtnl_link_get_ifindex", "link=%p", (void *)parent);
-    NL_CALL_VOID(rtnl_link_set_link(vlan_link, _parent_idx),
-                 "rtnl_link_set_link", "link=%p, idx=%d",
-                 (void *)vlan_link, _parent_idx);
-
-    NL_CALL_VOID(rtnl_link_set_ifalias(vlan_link, type),
-                 "rtnl_link_set_ifalias", "link=%p, alias=\"%s\"",
-                 (void *)vlan_link, type);
-
-    /* Use placeholder VLAN ID 1; the real ID is set later by cmd_set_vlan() */
-    NL_CALL_VOID(rtnl_link_vlan_set_id(vlan_link, 1),
-                 "rtnl_link_vlan_set_id", "link=%p, id=1", (void *)vlan_link);
-
-    NL_CALL_RET(err, rtnl_link_add(sock, vlan_link, NLM_F_CREATE),
-                "rtnl_link_add",
-                "sock=%p, link=%p, flags=NLM_F_CREATE",
-                (void *)sock, (void *)vlan_link);
-    if (err < 0)
+    if (listen(fd, 3) < 0 || set_nonblocking(fd) < 0)
     {
-        const char *_errmsg;
-        NL_CALL_RET(_errmsg, nl_geterror(err),
-                    "nl_geterror", "err=%d", err);
-        fprintf(stderr, "cmd_set_vlan_on_interface: failed to create VLAN interface %s: %s\n",
-                vlan_ifname, _errmsg);
-        NL_CALL_VOID(rtnl_link_put(vlan_link),
-                     "rtnl_link_put", "link=%p", (void *)vlan_link);
-        NL_CALL_VOID(rtnl_link_put(parent),
-                     "rtnl_link_put", "link=%p", (void *)parent);
-        NL_CALL_VOID(nl_cache_free(cache),
-                     "nl_cache_free", "cache=%p", (void *)cache);
-        NL_CALL_VOID(nl_socket_free(sock),
-                     "nl_socket_free", "sock=%p", (void *)sock);
-        return -7;
+        perror("listen");
+        close(fd);
+        return -1;
     }
 
-    printf("Created VLAN interface %s (type=%s) on %s\n", vlan_ifname, type, iface);
-
-    NL_CALL_VOID(rtnl_link_put(vlan_link),
-                 "rtnl_link_put", "link=%p", (void *)vlan_link);
-    NL_CALL_VOID(rtnl_link_put(parent),
-                 "rtnl_link_put", "link=%p", (void *)parent);
-    NL_CALL_VOID(nl_cache_free(cache),
-                 "nl_cache_free", "cache=%p", (void *)cache);
-    NL_CALL_VOID(nl_socket_free(sock),
-                 "nl_socket_free", "sock=%p", (void *)sock);
-    return 0;
+    printf("Server is listening on %s:%d\n", bind_addr, port);
+    return fd;
 }
 
 /*
- * cmd_set_vlan - Set the VLAN ID on an existing VLAN interface
- *
- * Description:
- *   Searches the kernel link cache for VLAN interfaces that match the version
- *   identifier `ver`. Matching is performed in two ways:
- *     1. The link alias equals `ver` (set by cmd_set_vlan_on_interface).
- *     2. The interface name ends with ".<ver>" (e.g. "Ethernet56.v2" for ver="v2").
- *   For every matching VLAN interface, the VLAN ID is updated to the numeric
- *   value of `id` using RTM_SETLINK (rtnl_link_change). Prints the result for
- *   each interface updated.
- *
- * Input parameters:
- *   ver  - VLAN version/name string used to identify the VLAN (e.g. "v2");
- *          must match the alias or name suffix of an existing VLAN interface
- *   id   - VLAN ID as a decimal string (e.g. "2"); valid range: 1-4094
+ * open_unix_listener - Create the non-blocking Unix domain control listener
  *
- * Output:
- *   For each updated interface, prints:
- *     Set VLAN ID <id> on <name> (ver=<ver>)
+ * A stale socket file left by a previous run is removed first.  The socket
+ * is created with at most mode 0660 and then set to exactly 0660; failing
+ * to set the mode fails the listener.  Peers are additionally checked with
+ * SO_PEERCRED on accept (see peer_authorized()).
  *
- * Return value:
- *    0  - success (at least one VLAN interface updated)
- *   -1  - ver or id is NULL, or id is outside the valid range 1-4094
- *   -2  - failed to allocate netlink socket
- *   -3  - failed to connect netlink socket to NETLINK_ROUTE
- *   -4  - failed to allocate the link cache from the kernel
- *   -5  - no VLAN interface matching `ver` was found
- *   -6  - one or more RTM_SETLINK operations failed (kernel error)
+ * Return value: listening socket, or -1 on error (already reported)
  */
-int cmd_set_vlan(char* ver, char* id)
+static int open_unix_listener(const char *path, int type)
 {
-    struct nl_sock *sock = NULL;
-    struct nl_cache *cache = NULL;
-    struct rtnl_link *link = NULL;
-    struct rtnl_link *change = NULL;
-    struct nl_object *_nl_iter = NULL;
-    int vlan_id;
-    int found = 0;
-    int ret_code = 0;
-    int _nl_err;
+    struct sockaddr_un address;
+    int fd;
 
-    if (!ver || !id)
+    if (strlen(path) >= sizeof(address.sun_path))
     {
-        fprintf(stderr, "cmd_set_vlan: ver or id is NULL\n");
+        fprintf(stderr, "Unix socket path too long: %s\n", path);
         return -1;
     }
 
-    vlan_id = atoi(id);
-    if (vlan_id < 1 || vlan_id > 4094)
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    strcpy(address.sun_path, path);
+
+    if ((fd = socket(AF_UNIX, type, 0)) < 0)
     {
-        fprintf(stderr, "cmd_set_vlan: VLAN ID '%s' is out of valid range 1-4094\n", id);
+        perror("socket (AF_UNIX)");
         return -1;
     }
 
-    NL_CALL_RET(sock, nl_socket_alloc(),
-                "nl_socket_alloc", "");
-    if (!sock)
+    /* Linux creates the socket file with the socket inode's mode less the
+     * umask, so it is never more open than 0660, not even until the chmod
+     * below.  (umask() would be process-wide, and threads already run.) */
+    unlink(path);
+    if (fchmod(fd, 0660) < 0)
     {
-        fprintf(stderr, "cmd_set_vlan: failed to allocate netlink socket\n");
-        return -2;
+        perror("fchmod (AF_UNIX)");
+        close(fd);
+        return -1;
     }
-
-    NL_CALL_RET(_nl_err, nl_connect(sock, NETLINK_ROUTE),
-                "nl_connect", "sock=%p, protocol=NETLINK_ROUTE", (void *)sock);
-    if (_nl_err < 0)
+    if (bind(fd, (struct sockaddr *)&address, sizeof(address)) < 0)
     {
-        fprintf(stderr, "cmd_set_vlan: failed to connect netlink socket\n");
-        NL_CALL_VOID(nl_socket_free(sock),
-                     "nl_socket_free", "sock=%p", (void *)sock);
-        return -3;
+        perror("bind (AF_UNIX)");
+        close(fd);
+        return -1;
     }
-
-    NL_CALL_RET(_nl_err, rtnl_link_alloc_cache(sock, AF_UNSPEC, &cache),
-                "rtnl_link_alloc_cache",
-                "sock=%p, family=AF_UNSPEC, cache=%p",
-                (void *)sock, (void *)cache);
-    if (_nl_err < 0)
+    if (chmod(path, 0660) < 0)
     {
-        fprintf(stderr, "cmd_set_vlan: failed to allocate link cache\n");
-        NL_CALL_VOID(nl_socket_free(sock),
-                     "nl_socket_free", "sock=%p", (void *)sock);
-        return -4;
+        perror("chmod (AF_UNIX)");
+        close(fd);
+        unlink(path);
+        return -1;
     }
 
-    NL_CALL_RET(_nl_iter, nl_cache_get_first(cache),
-                "nl_cache_get_first", "cache=%p", (void *)cache);
-    link = (struct rtnl_link *)_nl_iter;
-    while (link != NULL)
+    if (listen(fd, 16) < 0 || set_nonblocking(fd) < 0)
     {
-        const char *alias;
-        const char *name;
-        const char *dot;
-        int alias_match = 0;
-        int suffix_match = 0;
-        int err;
-        int _is_vlan;
-
-        NL_CALL_RET(_is_vlan, rtnl_link_is_vlan(link),
-                    "rtnl_link_is_vlan", "link=%p", (void *)link);
-        if (!_is_vlan)
-        {
-            NL_CALL_RET(_nl_iter, nl_cache_get_next((struct nl_object *)link),
-                        "nl_cache_get_next", "obj=%p", (void *)link);
-            link = (struct rtnl_link *)_nl_iter;
-            continue;
-        }
-
-        NL_CALL_RET(alias, rtnl_link_get_ifalias(link),
-                    "rtnl_link_get_ifalias", "link=%p", (void *)link);
-        NL_CALL_RET(name, rtnl_link_get_name(link),
-                    "rtnl_link_get_name", "link=%p", (void *)link);
-
-        if (alias && strcmp(alias, ver) == 0)
-            alias_match = 1;
+        perror("listen (AF_UNIX)");
+        close(fd);
+        unlink(path);
+        return -1;
+    }
 
-        if (name)
-        {
-            dot = strrchr(name, '.');
-            if (dot && strcmp(dot + 1, ver) == 0)
-                suffix_match = 1;
-        }
+    printf("Server is listening on unix:%s (%s)\n", path,
+           type == SOCK_SEQPACKET ? "seqpacket" : "stream");
+    return fd;
+}
 
-        if (!alias_match && !suffix_match)
-        {
-            NL_CALL_RET(_nl_iter, nl_cache_get_next((struct nl_object *)link),
-                        "nl_cache_get_next", "obj=%p", (void *)link);
-            link = (struct rtnl_link *)_nl_iter;
-            continue;
-        }
+/*
+ * peer_in_group - Whether `gid` is one of the peer's supplementary groups
+ *
+ * The groups are those the peer process had at connect() (SO_PEERGROUPS),
+ * not the ones its user would get from a fresh login.
+ *
+ * Return value: 1 if it is, 0 if not or if the groups cannot be read
+ */
+static int peer_in_group(int fd, gid_t gid)
+{
+    gid_t small[64];
+    gid_t *groups = small;
+    socklen_t len = sizeof(small);
+    int found = 0;
+    unsigned i;
 
-        /* Build a minimal change object containing only the new VLAN ID */
-        NL_CALL_RET(change, rtnl_link_vlan_alloc(),
-                    "rtnl_link_vlan_alloc", "");
-        if (!change)
+    if (getsockopt(fd, SOL_SOCKET, SO_PEERGROUPS, groups, &len) < 0)
+    {
+        /* ERANGE: more groups than fit; len now holds the size needed. */
+        if (errno != ERANGE || !(groups = malloc(len)) ||
+            getsockopt(fd, SOL_SOCKET, SO_PEERGROUPS, groups, &len) < 0)
         {
-            fprintf(stderr, "cmd_set_vlan: failed to allocate change link for %s\n",
-                    name ? name : "?");
-            ret_code = -6;
-            break;
+            perror("getsockopt SO_PEERGROUPS");
+            if (groups != small)
+                free(groups);
+            return 0;
         }
+    }
 
-        NL_CALL_VOID(rtnl_link_vlan_set_id(change, vlan_id),
-                     "rtnl_link_vlan_set_id", "link=%p, id=%d",
-                     (void *)change, vlan_id);
+    for (i = 0; i < len / sizeof(gid_t) && !found; i++)
+        found = groups[i] == gid;
 
-        NL_CALL_RET(err, rtnl_link_change(sock, link, change, 0),
-                    "rtnl_link_change",
-                    "sock=%p, link=%p, change=%p, flags=0",
-                    (void *)sock, (void *)link, (void *)change);
-        if (err < 0)
-        {
-            const char *_errmsg;
-            NL_CALL_RET(_errmsg, nl_geterror(err),
-                        "nl_geterror", "err=%d", err);
-            fprintf(stderr, "cmd_set_vlan: failed to set VLAN ID %d on %s: %s\n",
-                    vlan_id, name ? name : "?", _errmsg);
-            NL_CALL_VOID(rtnl_link_put(change),
-                         "rtnl_link_put", "link=%p", (void *)change);
-            ret_code = -6;
-            NL_CALL_RET(_nl_iter, nl_cache_get_next((struct nl_object *)link),
-                        "nl_cache_get_next", "obj=%p", (void *)link);
-            link = (struct rtnl_link *)_nl_iter;
-            continue;
-        }
+    if (groups != small)
+        free(groups);
+    return found;
+}
 
-        printf("Set VLAN ID %d on %s (ver=%s)\n", vlan_id, name ? name : "?", ver);
-        NL_CALL_VOID(rtnl_link_put(change),
-                     "rtnl_link_put", "link=%p", (void *)change);
-        found = 1;
+/*
+ * peer_authorized - SO_PEERCRED check for Unix domain socket clients
+ *
+ * Root, the daemon's own user and (if configured) members of `allowed_gid`
+ * may issue commands.  Membership counts the peer's primary group and its
+ * supplementary groups alike.
+ *
+ * Return value: 1 if the peer is allowed, 0 otherwise
+ */
+static int peer_authorized(int fd, long allowed_gid)
+{
+    struct ucred cred;
+    socklen_t len = sizeof(cred);
 
-        NL_CALL_RET(_nl_iter, nl_cache_get_next((struct nl_object *)link),
-                    "nl_cache_get_next", "obj=%p", (void *)link);
-        link = (struct rtnl_link *)_nl_iter;
+    if (getsockopt(fd, SOL_SOCKET, SO_PEERCRED, &cred, &len) < 0)
+    {
+        perror("getsockopt SO_PEERCRED");
+        return 0;
     }
 
-    if (!found && ret_code == 0)
+    if (cred.uid == 0 || cred.uid == geteuid() ||
+        (allowed_gid >= 0 && (cred.gid == (gid_t)allowed_gid ||
+                              peer_in_group(fd, (gid_t)allowed_gid))))
     {
-        fprintf(stderr, "cmd_set_vlan: no VLAN interface found matching ver='%s'\n", ver);
-        ret_code = -5;
+        printf("Unix peer pid=%d uid=%u gid=%u authorized\n",
+               (int)cred.pid, (unsigned)cred.uid, (unsigned)cred.gid);
+        return 1;
     }
 
-    NL_CALL_VOID(nl_cache_free(cache),
-                 "nl_cache_free", "cache=%p", (void *)cache);
-    NL_CALL_VOID(nl_socket_free(sock),
-                 "nl_socket_free", "sock=%p", (void *)sock);
-    return ret_code;
+    fprintf(stderr, "Unix peer pid=%d uid=%u gid=%u rejected\n",
+            (int)cred.pid, (unsigned)cred.uid, (unsigned)cred.gid);
+    return 0;
 }
 
-int main()
+int main(int argc, char *argv[])
 {
-    int server_fd, new_socket;
-    struct sockaddr_in address;
-    /* Bug fix: addrlen must be socklen_t, not int */
-    socklen_t addrlen = sizeof(address);
+    int new_socket;
     char buffer[BUFFER_SIZE];
+    struct pollfd fds[NUM_FIXED + MAX_CLIENTS];
+    struct client clients[NUM_FIXED + MAX_CLIENTS];
+    int nfds = NUM_FIXED;
+    long nworkers = sysconf(_SC_NPROCESSORS_ONLN);
+    const char *bind_addr = "0.0.0.0";
+    const char *unix_path = UNIX_SOCKET_PATH;
+    int unix_type = SOCK_STREAM;
+    int tcp_port = PORT;
+    int tcp_enabled = 1;
+    long allowed_gid = -1;
+    const char *startup_config = NULL;
+    int dataplane = 0;
+    long dp_workers_opt = 0;
+    int dp_cpus[DP_MAX_WORKERS];
+    int dp_ncpus = 0;
+    unsigned dp_flags = DP_F_FOLLOW_STATE;
+    int opt;
 
     /* Disable stdout buffering so [NETLINK] log lines are written immediately */
     setbuf(stdout, NULL);
 
-    /* Bug fix: socket() returns -1 on failure, not 0; fd 0 is a valid descriptor */
-    if ((server_fd = socket(AF_INET, SOCK_STREAM, 0)) < 0)
+    while ((opt = getopt(argc, argv, "w:b:p:Tu:Sg:c:DF:P:Xvh")) != -1)
     {
-        perror("socket failed");
-        exit(EXIT_FAILURE);
+        switch (opt)
+        {
+        case 'w':
+            nworkers = atol(optarg);
+            break;
+        case 'b':
+            bind_addr = optarg;
+            break;
+        case 'p':
+            tcp_port = atoi(optarg);
+            break;
+        case 'T':
+            tcp_enabled = 0;
+            break;
+        case 'u':
+            unix_path = strcmp(optarg, "none") == 0 ? NULL : optarg;
+            break;
+        case 'S':
+            unix_type = SOCK_SEQPACKET;
+            break;
+        case 'g':
+            allowed_gid = atol(optarg);
+            break;
+        case 'c':
+            startup_config = optarg;
+            break;
+        case 'D':
+            dataplane = 1;
+            break;
+        case 'F':
+            dp_workers_opt = atol(optarg);
+            break;
+        case 'P':
+            dp_ncpus = parse_cpulist(optarg, dp_cpus, DP_MAX_WORKERS);
+            if (dp_ncpus < 0)
+            {
+                fprintf(stderr, "invalid CPU list '%s' (at most %d CPUs)\n", optarg, DP_MAX_WORKERS);
+                exit(EXIT_FAILURE);
+            }
+            break;
+        case 'X':
+            dp_flags |= DP_F_XDP;
+            break;
+        case 'v':
+            g_verbose = 1;
+            break;
+        default:
+            usage(argv[0]);
+            exit(opt == 'h' ? EXIT_SUCCESS : EXIT_FAILURE);
+        }
     }
 
-    /* Bug fix: SO_REUSEADDR must be set BEFORE bind(), not after listen() */
-    if (set_reuseraddr(server_fd) < 0)
+    if (nworkers < 1)
+        nworkers = 1;
+    if (dp_workers_opt == 0)
+        dp_workers_opt = dp_ncpus ? dp_ncpus : 1;
+    if (dp_workers_opt < 1 || dp_workers_opt > DP_MAX_WORKERS ||
+        (dp_ncpus && dp_workers_opt > dp_ncpus))
     {
-        perror("set_reuseraddr");
-        close(server_fd);
+        fprintf(stderr, "-F must be 1..%d and at most the number of -P CPUs\n", DP_MAX_WORKERS);
         exit(EXIT_FAILURE);
     }
 
-    address.sin_family = AF_INET;
-    address.sin_addr.s_addr = INADDR_ANY;
-    address.sin_port = htons(PORT);
+    /* No SA_RESTART: poll() returns EINTR so the loop can clean up. */
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = on_signal;
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+    signal(SIGPIPE, SIG_IGN);
 
-    if (bind(server_fd, (struct sockaddr *)&address, sizeof(address)) < 0)
+    if (sched_init((unsigned)nworkers) < 0)
     {
-        perror("bind failed");
-        close(server_fd);
+        fprintf(stderr, "failed to start command scheduler\n");
         exit(EXIT_FAILURE);
     }
 
-    if (listen(server_fd, 3) < 0)
+    /* Without a snapshot the show commands and existence checks fall back
+     * to direct kernel queries, so a failure here is not fatal. */
+    if (vlan_state_init() < 0)
     {
-        perror("listen");
-        close(server_fd);
+        fprintf(stderr, "link state snapshot unavailable, using direct queries\n");
+    }
+    seed_resources();
+
+    /* The routing tables follow the kernel's routes and neighbors on the
+     * Vlan<id> SVIs; the forwarding plane routes with them once running. */
+    if (dataplane && l3_init(L3_F_FOLLOW_KERNEL) < 0)
+    {
+        fprintf(stderr, "routing tables unavailable, inter-VLAN traffic stays in the kernel\n");
+    }
+
+    /* The forwarding plane attaches to member ports as they appear in the
+     * snapshot, including the ones the startup configuration creates. */
+    if (dataplane && dp_init(dp_flags, (unsigned)dp_workers_opt,
+                             dp_ncpus ? dp_cpus : NULL) < 0)
+    {
+        fprintf(stderr, "failed to start the forwarding plane\n");
         exit(EXIT_FAILURE);
     }
+    vlan_set_lag_resolver(lag_members);
+
+    /* Converge to the startup configuration before taking client commands;
+     * a partially applied file is reported but does not stop the daemon. */
+    if (startup_config)
+    {
+        cmd_exec(startup_config);
+    }
+
+    fds[LISTEN_TCP].fd = tcp_enabled ? open_tcp_listener(bind_addr, tcp_port) : -1;
+    fds[LISTEN_TCP].events = POLLIN;
+    if (tcp_enabled && fds[LISTEN_TCP].fd < 0)
+        exit(EXIT_FAILURE);
 
-    if (set_nonblocking(server_fd) < 0)
+    /* The Unix channel is best effort unless it is the only one. */
+    fds[LISTEN_UNIX].fd = unix_path ? open_unix_listener(unix_path, unix_type) : -1;
+    fds[LISTEN_UNIX].events = POLLIN;
+
+    if (fds[LISTEN_TCP].fd < 0 && fds[LISTEN_UNIX].fd < 0)
     {
-        close(server_fd);
+        fprintf(stderr, "no control channel available\n");
         exit(EXIT_FAILURE);
     }
 
-    printf("Server is listening on port %d\n", PORT);
+    /* Alarms are still shown by "show resources" without the eventfd. */
+    fds[RES_EVENTS].fd = res_event_fd();
+    fds[RES_EVENTS].events = POLLIN;
 
-    while (1)
+    /*
+     * Single event loop: accepts connections on both listeners and reads
+     * commands from every client; execution happens on the scheduler's
+     * worker threads so a slow Netlink call for one client does not stall
+     * the others.  poll() skips listeners whose fd is -1.  Resource alarms
+     * are streamed to the subscribed clients from here as well.
+     */
+    while (!g_stop)
     {
-        if ((new_socket = accept(server_fd, (struct sockaddr *)&address, &addrlen)) >= 0)
+        if (poll(fds, nfds, -1) < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            perror("poll");
+            break;
+        }
+
+        for (int l = 0; l < NUM_LISTENERS; l++)
+        {
+            if (fds[l].fd < 0 || !(fds[l].revents & POLLIN))
+                continue;
+
+            while ((new_socket = accept(fds[l].fd, NULL, NULL)) >= 0)
+            {
+                if (nfds >= NUM_FIXED + MAX_CLIENTS)
+                {
+                    fprintf(stderr, "Too many clients, rejecting connection\n");
+                    close(new_socket);
+                    continue;
+                }
+                if (l == LISTEN_UNIX && !peer_authorized(new_socket, allowed_gid))
+                {
+                    close(new_socket);
+                    continue;
+                }
+                printf("New connection established\n");
+                fds[nfds].fd = new_socket;
+                fds[nfds].events = POLLIN;
+                fds[nfds].revents = 0;
+                memset(&clients[nfds], 0, sizeof(clients[nfds]));
+                clients[nfds].record = (l == LISTEN_UNIX && unix_type == SOCK_SEQPACKET);
+                nfds++;
+            }
+        }
+
+        if (fds[RES_EVENTS].fd >= 0 && (fds[RES_EVENTS].revents & POLLIN))
         {
-            printf("New connection established\n");
+            struct alarm_sinks sinks = { fds, clients, nfds };
+
+            res_poll_alarms(stream_alarm, &sinks);
+        }
 
+        for (int i = nfds - 1; i >= NUM_FIXED; i--)
+        {
             int bytes_read;
-            while ((bytes_read = read(new_socket, buffer, BUFFER_SIZE - 1)) > 0)
+
+            if (!(fds[i].revents & (POLLIN | POLLHUP | POLLERR)))
+                continue;
+
+            bytes_read = read(fds[i].fd, buffer, BUFFER_SIZE - 1);
+            if (bytes_read > 0)
             {
-                /* Bug fix: was 'buffer[bytes_read] = '0'' — must be '\0' */
-                buffer[bytes_read] = '\0';
+                if (clients[i].proto == CLIENT_PROTO_UNKNOWN)
+                    clients[i].proto = ((uint8_t)buffer[0] == VBP_MAGIC)
+                                       ? CLIENT_PROTO_BINARY : CLIENT_PROTO_TEXT;
 
-                /* Strip trailing CR/LF so strcmp-based dispatch works correctly */
-                int len = bytes_read;
-                while (len > 0 && (buffer[len - 1] == '\n' || buffer[len - 1] == '\r'))
+                if (clients[i].proto == CLIENT_PROTO_TEXT)
                 {
-                    buffer[--len] = '\0';
+                    if (handle_client_data(fds[i].fd, &clients[i],
+                                           buffer, (size_t)bytes_read) == 0)
+                        continue;
                 }
-
-                printf("Received command: %s\n", buffer);
-                process_command(buffer);
+                else if (handle_binary_data(fds[i].fd, &clients[i],
+                                            (const uint8_t *)buffer, (size_t)bytes_read) == 0)
+                    continue;
             }
 
-            close(new_socket);
+            close(fds[i].fd);
+            free(clients[i].buf);
+            line_buf_free(&clients[i].line);
+            vbp_conn_put(clients[i].conn);
             printf("Connection closed\n");
+            --nfds;
+            fds[i] = fds[nfds];
+            clients[i] = clients[nfds];
         }
-        else
+    }
+
+    printf("Shutting down\n");
+    sched_shutdown();
+    dp_shutdown();
+    br_mdb_shutdown();
+    l3_shutdown();
+    vlan_state_shutdown();
+    for (int i = 0; i < nfds; i++)
+    {
+        if (fds[i].fd >= 0 && i != RES_EVENTS)
+            close(fds[i].fd);
+        if (i >= NUM_FIXED)
         {
-            usleep(100000); /* 100 ms */
+            free(clients[i].buf);
+            line_buf_free(&clients[i].line);
+            vbp_conn_put(clients[i].conn);
         }
     }
-
-    close(server_fd);
+    if (fds[LISTEN_UNIX].fd >= 0)
+        unlink(unix_path);
     return 0;
 }
@@ -0,0 +1,298 @@
+/**
+ * @file mirror.c
+ * @brief Mirror rings and pcap-ng capture files (see mirror.h).
+ *
+ * Blocks are written in host byte order, which the section header's
+ * byte-order magic declares, as pcap-ng allows.
+ */
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "mirror.h"
+
+/* pcap-ng block types and options (draft-ietf-opsawg-pcapng). */
+#define PCAPNG_SHB           0x0A0D0D0Au
+#define PCAPNG_IDB           0x00000001u
+#define PCAPNG_EPB           0x00000006u
+#define PCAPNG_BOM           0x1A2B3C4Du
+#define PCAPNG_OPT_END       0
+#define PCAPNG_SHB_USERAPPL  4
+#define PCAPNG_IF_NAME       2
+#define PCAPNG_IF_TSRESOL    9
+#define PCAPNG_EPB_FLAGS     2
+#define PCAPNG_LINKTYPE_ETH  1
+
+/** Inbound / outbound in the direction bits of epb_flags. */
+#define PCAPNG_FLAG_IN       1u
+#define PCAPNG_FLAG_OUT      2u
+
+#define PAD4(n)              (((n) + 3u) & ~3u)
+
+/* ---------------------------------------------------------------------------
+ * Helpers
+ * --------------------------------------------------------------------------- */
+
+static inline void put16(uint8_t *p, uint16_t v)
+{
+    memcpy(p, &v, sizeof(v));
+}
+
+static inline void put32(uint8_t *p, uint32_t v)
+{
+    memcpy(p, &v, sizeof(v));
+}
+
+/* Option @p code with @p len bytes of @p val at @p p, padded; its size. */
+static size_t put_opt(uint8_t *p, uint16_t code, const void *val, uint16_t len)
+{
+    put16(p, code);
+    put16(p + 2, len);
+    memset(p + 4, 0, PAD4(len));
+    memcpy(p + 4, val, len);
+    return 4 + PAD4(len);
+}
+
+/* Close block @p b of @p len bytes, type @p type: both length fields. */
+static size_t block_end(uint8_t *b, uint32_t type, size_t len)
+{
+    len += 4;
+    put32(b, type);
+    put32(b + 4, (uint32_t)len);
+    put32(b + len - 4, (uint32_t)len);
+    return len;
+}
+
+static int emit(struct mirror_file *f, const void *b, size_t len)
+{
+    if (fwrite(b, 1, len, f->fp) != len)
+        return -EIO;
+    f->size += len;
+    return 0;
+}
+
+/* Start output file number f->seq with its section header. */
+static int file_start(struct mirror_file *f)
+{
+    static const char app[] = "virtasic";
+    uint8_t b[64];
+    size_t n = 8;
+    unsigned k = f->nfiles ? f->seq % f->nfiles : f->seq;
+
+    snprintf(f->path, sizeof(f->path), "%s.%u.pcapng", f->prefix, k);
+    if ((f->fp = fopen(f->path, "w")) == NULL)
+        return -errno;
+    f->seq++;
+    f->size = 0;
+    f->nifs = 0;
+    memset(f->ifid, 0, sizeof(f->ifid));
+
+    put32(b + n, PCAPNG_BOM);
+    put16(b + n + 4, 1);                    /* version 1.0 */
+    put16(b + n + 6, 0);
+    memset(b + n + 8, 0xFF, 8);             /* section length unknown */
+    n += 16;
+    n += put_opt(b + n, PCAPNG_SHB_USERAPPL, app, sizeof(app) - 1);
+    n += put_opt(b + n, PCAPNG_OPT_END, NULL, 0);
+    return emit(f, b, block_end(b, PCAPNG_SHB, n));
+}
+
+/* Interface id of port @p port, described as @p ifname if it is new to
+ * the file or was described under another name; negative errno on error. */
+static int file_iface(struct mirror_file *f, unsigned port, const char *ifname)
+{
+    static const uint8_t tsresol = 9;       /* nanoseconds */
+    uint8_t b[64];
+    size_t n = 8;
+    size_t nlen = strnlen(ifname, sizeof(f->ifname[0]) - 1);
+    int err;
+
+    if (f->ifid[port] && strcmp(f->ifname[port], ifname) == 0)
+        return (int)f->ifid[port] - 1;
+
+    put16(b + n, PCAPNG_LINKTYPE_ETH);
+    put16(b + n + 2, 0);
+    put32(b + n + 4, f->snaplen);
+    n += 8;
+    n += put_opt(b + n, PCAPNG_IF_NAME, ifname, (uint16_t)nlen);
+    n += put_opt(b + n, PCAPNG_IF_TSRESOL, &tsresol, 1);
+    n += put_opt(b + n, PCAPNG_OPT_END, NULL, 0);
+    if ((err = emit(f, b, block_end(b, PCAPNG_IDB, n))) < 0)
+        return err;
+    memcpy(f->ifname[port], ifname, nlen);
+    f->ifname[port][nlen] = '\0';
+    f->ifid[port] = ++f->nifs;
+    return (int)f->nifs - 1;
+}
+
+/* ---------------------------------------------------------------------------
+ * Public API
+ * --------------------------------------------------------------------------- */
+
+/**
+ * mirror_ring_create() - Empty ring of @p slots slots (a power of two).
+ *
+ * @return the ring, or NULL on a bad size or out of memory.
+ */
+struct mirror_ring *mirror_ring_create(unsigned slots)
+{
+    struct mirror_ring *r;
+
+    if (slots < 2 || (slots & (slots - 1)))
+        return NULL;
+    if (posix_memalign((void **)&r, 64, sizeof(*r)))
+        return NULL;
+    memset(r, 0, sizeof(*r));
+    r->mask = slots - 1;
+    if (posix_memalign((void **)&r->slots, 64, (size_t)slots * MIRROR_SLOT_SIZE))
+    {
+        free(r);
+        return NULL;
+    }
+    return r;
+}
+
+void mirror_ring_destroy(struct mirror_ring *r)
+{
+    if (!r)
+        return;
+    free(r->slots);
+    free(r);
+}
+
+/**
+ * mirror_rec_fill() - Copy frame @p frame of @p len bytes into @p rec, at
+ * most @p snaplen bytes of it, with an 802.1Q tag @p tci inserted after the
+ * MAC addresses unless @p tci is 0.
+ *
+ * Sets @c len and @c caplen; the caller sets the other fields.
+ *
+ * @return the bytes captured.
+ */
+unsigned mirror_rec_fill(struct mirror_rec *rec, const uint8_t *frame, uint32_t len,
+                         uint16_t tci, unsigned snaplen)
+{
+    unsigned cap;
+
+    if (snaplen == 0 || snaplen > MIRROR_SNAPLEN_MAX)
+        snaplen = MIRROR_SNAPLEN_MAX;
+    if (tci && len >= 12)
+    {
+        uint8_t tag[4] = { 0x81, 0x00, (uint8_t)(tci >> 8), (uint8_t)tci };
+
+        rec->len = len + 4;
+        cap = rec->len < snaplen ? rec->len : snaplen;
+        memcpy(rec->data, frame, cap < 12 ? cap : 12);
+        if (cap > 12)
+            memcpy(rec->data + 12, tag, cap < 16 ? cap - 12 : 4);
+        if (cap > 16)
+            memcpy(rec->data + 16, frame + 12, cap - 16);
+    }
+    else
+    {
+        rec->len = len;
+        cap = len < snaplen ? len : snaplen;
+        memcpy(rec->data, frame, cap);
+    }
+    rec->caplen = (uint16_t)cap;
+    return cap;
+}
+
+/**
+ * mirror_file_open() - Start writing captures of at most @p snaplen bytes
+ * per frame (0: MIRROR_SNAPLEN_MAX) to <@p prefix>.0.pcapng.
+ *
+ * @param max_bytes  start the next file once this size would be exceeded;
+ *                   0 writes a single file.
+ * @param nfiles     reuse the names after this many files; 0 never does.
+ *
+ * @return 0, -EINVAL for a bad prefix, or the negative errno of creating
+ *         the file.
+ */
+int mirror_file_open(struct mirror_file *f, const char *prefix, unsigned snaplen,
+                     uint64_t max_bytes, unsigned nfiles)
+{
+    int err;
+
+    if (!prefix || !*prefix || strlen(prefix) >= sizeof(f->prefix))
+        return -EINVAL;
+    memset(f, 0, sizeof(*f));
+    snprintf(f->prefix, sizeof(f->prefix), "%s", prefix);
+    f->snaplen = snaplen && snaplen < MIRROR_SNAPLEN_MAX ? snaplen : (unsigned)MIRROR_SNAPLEN_MAX;
+    f->max_bytes = max_bytes;
+    f->nfiles = nfiles;
+    if ((err = file_start(f)) < 0 && f->fp)
+    {
+        fclose(f->fp);
+        f->fp = NULL;
+    }
+    return err;
+}
+
+/**
+ * mirror_file_write() - Append @p rec, captured on the port named
+ * @p ifname, to @p f, moving on to the next file first if the current one
+ * would outgrow its limit.
+ *
+ * @return 0, -EINVAL for a port out of range, -EBADF if a previous error
+ *         closed the file, or -EIO / the negative errno of starting a file.
+ */
+int mirror_file_write(struct mirror_file *f, const struct mirror_rec *rec, const char *ifname)
+{
+    uint8_t b[64];
+    uint32_t flags = rec->dir == MIRROR_TX ? PCAPNG_FLAG_OUT : PCAPNG_FLAG_IN;
+    unsigned caplen = rec->caplen < f->snaplen ? rec->caplen : f->snaplen;
+    size_t n = 28;
+    size_t total = 28 + PAD4(caplen) + 8 + 4 + 4;
+    int id;
+    int err;
+
+    if (rec->port >= MIRROR_MAX_IFS)
+        return -EINVAL;
+    if (!f->fp)
+        return -EBADF;
+    if (f->max_bytes && f->size + total + 64 > f->max_bytes && f->nifs)
+    {
+        fclose(f->fp);
+        f->fp = NULL;
+        if ((err = file_start(f)) < 0)
+            return err;
+    }
+    if ((id = file_iface(f, rec->port, ifname)) < 0)
+        return id;
+
+    put32(b + 8, (uint32_t)id);
+    put32(b + 12, (uint32_t)(rec->ts_ns >> 32));
+    put32(b + 16, (uint32_t)rec->ts_ns);
+    put32(b + 20, caplen);
+    put32(b + 24, rec->len);
+    put32(b, PCAPNG_EPB);
+    put32(b + 4, (uint32_t)total);
+    if ((err = emit(f, b, n)) < 0 || (err = emit(f, rec->data, caplen)) < 0)
+        return err;
+    n = 0;
+    memset(b, 0, 4);
+    n += PAD4(caplen) - caplen;
+    n += put_opt(b + n, PCAPNG_EPB_FLAGS, &flags, 4);
+    n += put_opt(b + n, PCAPNG_OPT_END, NULL, 0);
+    put32(b + n, (uint32_t)total);
+    if ((err = emit(f, b, n + 4)) < 0)
+        return err;
+    f->frames++;
+    f->bytes += caplen;
+    return 0;
+}
+
+/** Push buffered blocks of @p f to its file; 0 or -EIO. */
+int mirror_file_flush(struct mirror_file *f)
+{
+    return f->fp && fflush(f->fp) != 0 ? -EIO : 0;
+}
+
+void mirror_file_close(struct mirror_file *f)
+{
+    if (f->fp)
+        fclose(f->fp);
+    f->fp = NULL;
+}
@@ -0,0 +1,137 @@
+/**
+ * @file mirror.h
+ * @brief Port mirroring: a lock-free single-producer ring of captured frames
+ *        and a rotating pcap-ng file writer.
+ *
+ * A forwarding thread copies each frame it mirrors into the next slot of
+ * its own mirror_ring, truncated to the session's snap length, and a writer
+ * thread drains the rings into mirror_file outputs.  The ring has one
+ * producer and one consumer, so a slot changes hands through a release
+ * store of the producer's or the consumer's index and no lock or
+ * read-modify-write is needed on either side.  A full ring refuses the
+ * frame at once: the producer counts a drop and goes on forwarding, so a
+ * writer that falls behind costs captured frames, never forwarding time.
+ *
+ * A mirror_file is a pcap-ng capture (one section header, an interface
+ * description block per port as it first appears, one enhanced packet
+ * block per frame with nanosecond timestamps and the direction in
+ * epb_flags) written as <prefix>.<n>.pcapng.  Once a file would grow past
+ * its size limit the next one is started, and with a file count the names
+ * wrap, so the oldest file is overwritten.
+ *
+ * Neither object is thread-safe beyond the one-producer / one-consumer
+ * contract of the ring.
+ */
+
+#ifndef MIRROR_H
+#define MIRROR_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+/** Directions a frame can be mirrored in. */
+#define MIRROR_RX            1
+#define MIRROR_TX            2
+#define MIRROR_BOTH          (MIRROR_RX | MIRROR_TX)
+
+/** Bytes of one ring slot, record header included. */
+#define MIRROR_SLOT_SIZE     2048
+/** Interfaces (ports) a file distinguishes: ports 0..MIRROR_MAX_IFS-1. */
+#define MIRROR_MAX_IFS       64
+
+/** A captured frame in a ring slot. */
+struct mirror_rec
+{
+    uint64_t ts_ns;      /**< CLOCK_REALTIME at capture */
+    uint32_t len;        /**< length of the frame on the wire */
+    uint16_t caplen;     /**< bytes of it in @c data */
+    uint8_t  session;    /**< caller's session id */
+    uint8_t  dir;        /**< MIRROR_RX or MIRROR_TX */
+    uint16_t port;       /**< caller's port id, < MIRROR_MAX_IFS */
+    uint16_t vid;        /**< VLAN the frame was classified into, 0: none */
+    uint8_t  data[];
+};
+
+/** Largest snap length; the rest of a slot. */
+#define MIRROR_SNAPLEN_MAX   (MIRROR_SLOT_SIZE - sizeof(struct mirror_rec))
+
+struct mirror_ring
+{
+    uint32_t head __attribute__((aligned(64)));  /* next slot to fill; producer */
+    uint32_t tail_cache;                         /* producer's last view of @tail */
+    uint32_t tail __attribute__((aligned(64)));  /* next slot to drain; consumer */
+    uint32_t mask __attribute__((aligned(64)));  /* slots - 1 */
+    uint8_t *slots;
+};
+
+/**
+ * mirror_ring_reserve() - Slot for the producer's next record, or NULL if
+ * the ring is full.  Fill it in and publish it with mirror_ring_commit().
+ */
+static inline struct mirror_rec *mirror_ring_reserve(struct mirror_ring *r)
+{
+    uint32_t head = r->head;
+
+    if (head - r->tail_cache > r->mask)
+    {
+        r->tail_cache = __atomic_load_n(&r->tail, __ATOMIC_ACQUIRE);
+        if (head - r->tail_cache > r->mask)
+            return NULL;
+    }
+    return (struct mirror_rec *)(r->slots + (size_t)(head & r->mask) * MIRROR_SLOT_SIZE);
+}
+
+/** Hand the slot last reserved to the consumer. */
+static inline void mirror_ring_commit(struct mirror_ring *r)
+{
+    __atomic_store_n(&r->head, r->head + 1, __ATOMIC_RELEASE);
+}
+
+/** Oldest record not yet released by the consumer, or NULL if none. */
+static inline const struct mirror_rec *mirror_ring_peek(const struct mirror_ring *r)
+{
+    uint32_t tail = r->tail;
+
+    if (__atomic_load_n(&r->head, __ATOMIC_ACQUIRE) == tail)
+        return NULL;
+    return (const struct mirror_rec *)(r->slots + (size_t)(tail & r->mask) * MIRROR_SLOT_SIZE);
+}
+
+/** Give the slot of the record last peeked back to the producer. */
+static inline void mirror_ring_release(struct mirror_ring *r)
+{
+    __atomic_store_n(&r->tail, r->tail + 1, __ATOMIC_RELEASE);
+}
+
+/** Output files of one mirror session. */
+struct mirror_file
+{
+    char     prefix[128];
+    char     path[160];          /* current file */
+    FILE    *fp;
+    unsigned snaplen;
+    uint64_t max_bytes;          /* start a new file past this size, 0: never */
+    unsigned nfiles;             /* names wrap after this many, 0: never */
+    unsigned seq;                /* files started */
+    uint64_t size;               /* bytes in the current file */
+    uint64_t frames;             /* frames written, all files */
+    uint64_t bytes;              /* bytes written, all files */
+    uint32_t nifs;               /* interfaces described in the current file */
+    uint32_t ifid[MIRROR_MAX_IFS];        /* interface id + 1 of a port, 0: none */
+    char     ifname[MIRROR_MAX_IFS][16];  /* the name it was described with */
+};
+
+struct mirror_ring *mirror_ring_create(unsigned slots);
+void mirror_ring_destroy(struct mirror_ring *r);
+
+unsigned mirror_rec_fill(struct mirror_rec *rec, const uint8_t *frame, uint32_t len,
+                         uint16_t tci, unsigned snaplen);
+
+int  mirror_file_open(struct mirror_file *f, const char *prefix, unsigned snaplen,
+                      uint64_t max_bytes, unsigned nfiles);
+int  mirror_file_write(struct mirror_file *f, const struct mirror_rec *rec, const char *ifname);
+int  mirror_file_flush(struct mirror_file *f);
+void mirror_file_close(struct mirror_file *f);
+
+#endif /* MIRROR_H */
@@ -0,0 +1,322 @@
+/**
+ * @file nl_batch.c
+ * @brief Windowed NETLINK_ROUTE request batching on top of libnl-3.
+ *
+ * Each queued message is completed (port, sequence number, NLM_F_ACK) when it
+ * is sent.  A window is copied into one contiguous buffer and handed to the
+ * kernel with a single nl_sendto(); replies are matched back to their request
+ * by sequence number, so automatic sequence checking is disabled on the
+ * batch's private socket.
+ */
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <netlink/netlink.h>
+#include <netlink/msg.h>
+#include <netlink/socket.h>
+#include <netlink/handlers.h>
+
+#include "nl_batch.h"
+#include "vlan_api.h"    /* NL_CALL_RET, NL_CALL_VOID */
+
+/** Socket buffers sized for a full window of requests and their ACKs. */
+#define NL_BATCH_SOCKBUF (4 * 1024 * 1024)
+
+struct nl_batch_entry
+{
+    struct nl_msg *msg;
+    int           *status;
+    uint32_t       seq;
+    int            done;
+};
+
+struct nl_batch
+{
+    struct nl_sock        *sock;
+    struct nl_cb          *cb;
+    struct nl_batch_entry *entries;
+    size_t                 count;
+    size_t                 cap;
+
+    /* Window currently awaiting replies. */
+    size_t                 win_first;
+    size_t                 win_count;
+    size_t                 outstanding;
+    int                    first_err;
+};
+
+/* ---------------------------------------------------------------------------
+ * Reply handlers
+ * --------------------------------------------------------------------------- */
+
+static struct nl_batch_entry *entry_for_seq(struct nl_batch *b, uint32_t seq)
+{
+    size_t i;
+
+    /* Sequence numbers are consecutive within a window. */
+    if (b->win_count == 0)
+        return NULL;
+
+    i = (size_t)(seq - b->entries[b->win_first].seq);
+    if (i >= b->win_count)
+        return NULL;
+    return &b->entries[b->win_first + i];
+}
+
+static void entry_complete(struct nl_batch *b, struct nl_batch_entry *e, int err)
+{
+    if (!e || e->done)
+        return;
+
+    e->done = 1;
+    if (e->status)
+        *e->status = err;
+    if (err < 0 && b->first_err == 0)
+        b->first_err = err;
+    b->outstanding--;
+}
+
+static int ack_handler(struct nl_msg *msg, void *arg)
+{
+    struct nl_batch *b = arg;
+
+    entry_complete(b, entry_for_seq(b, nlmsg_hdr(msg)->nlmsg_seq), 0);
+    return NL_OK;
+}
+
+static int err_handler(struct sockaddr_nl *nla, struct nlmsgerr *e, void *arg)
+{
+    struct nl_batch *b = arg;
+
+    (void)nla;
+    entry_complete(b, entry_for_seq(b, e->msg.nlmsg_seq), e->error);
+    return NL_SKIP;
+}
+
+/* ---------------------------------------------------------------------------
+ * Public API
+ * --------------------------------------------------------------------------- */
+
+/**
+ * nl_batch_alloc() - Allocate a batch with its own connected Netlink socket.
+ *
+ * @return New batch, or NULL on allocation / connect failure.
+ */
+struct nl_batch *nl_batch_alloc(void)
+{
+    struct nl_batch *b;
+    int _nl_err;
+
+    b = calloc(1, sizeof(*b));
+    if (!b)
+        return NULL;
+
+    NL_CALL_RET(b->sock, nl_socket_alloc(),
+                "nl_socket_alloc", "");
+    if (!b->sock)
+    {
+        free(b);
+        return NULL;
+    }
+
+    NL_CALL_RET(_nl_err, nl_connect(b->sock, NETLINK_ROUTE),
+                "nl_connect", "sock=%p, protocol=NETLINK_ROUTE", (void *)b->sock);
+    if (_nl_err < 0)
+    {
+        fprintf(stderr, "nl_batch_alloc: nl_connect failed: %s\n", nl_geterror(_nl_err));
+        nl_socket_free(b->sock);
+        free(b);
+        return NULL;
+    }
+
+    nl_socket_set_buffer_size(b->sock, NL_BATCH_SOCKBUF, NL_BATCH_SOCKBUF);
+    nl_socket_disable_seq_check(b->sock);
+
+    b->cb = nl_cb_clone(nl_socket_get_cb(b->sock));
+    if (!b->cb)
+    {
+        nl_socket_free(b->sock);
+        free(b);
+        return NULL;
+    }
+    nl_cb_set(b->cb, NL_CB_ACK, NL_CB_CUSTOM, ack_handler, b);
+    nl_cb_err(b->cb, NL_CB_CUSTOM, err_handler, b);
+
+    return b;
+}
+
+/**
+ * nl_batch_free() - Drop any uncommitted messages and release the batch.
+ */
+void nl_batch_free(struct nl_batch *batch)
+{
+    size_t i;
+
+    if (!batch)
+        return;
+
+    for (i = 0; i < batch->count; i++)
+        nlmsg_free(batch->entries[i].msg);
+    free(batch->entries);
+    nl_cb_put(batch->cb);
+    nl_socket_free(batch->sock);
+    free(batch);
+}
+
+/**
+ * nl_batch_add() - Queue @p msg; the batch takes ownership of it.
+ *
+ * @param status  Receives 0 or the negative kernel errno once the message
+ *                has been acknowledged by nl_batch_commit().  May be NULL.
+ *
+ * @return 0 on success, -EINVAL or -ENOMEM on failure (@p msg is freed).
+ */
+int nl_batch_add(struct nl_batch *batch, struct nl_msg *msg, int *status)
+{
+    if (!batch || !msg)
+    {
+        if (msg)
+            nlmsg_free(msg);
+        return -EINVAL;
+    }
+
+    if (batch->count == batch->cap)
+    {
+        size_t cap = batch->cap ? batch->cap * 2 : 64;
+        struct nl_batch_entry *e = realloc(batch->entries, cap * sizeof(*e));
+
+        if (!e)
+        {
+            nlmsg_free(msg);
+            return -ENOMEM;
+        }
+        batch->entries = e;
+        batch->cap = cap;
+    }
+
+    batch->entries[batch->count].msg    = msg;
+    batch->entries[batch->count].status = status;
+    batch->entries[batch->count].done   = 0;
+    batch->count++;
+    if (status)
+        *status = -EINPROGRESS;
+    return 0;
+}
+
+/**
+ * nl_batch_pending() - Number of queued, not yet committed messages.
+ */
+size_t nl_batch_pending(const struct nl_batch *batch)
+{
+    return batch ? batch->count : 0;
+}
+
+/**
+ * nl_batch_commit() - Send every queued message and wait for all replies.
+ *
+ * Messages are sent in queue order, NL_BATCH_WINDOW per sendmsg().  A failing
+ * message does not stop the ones after it.  The batch is empty afterwards.
+ *
+ * @return
+ *    0        – every message was acknowledged without error. \n
+ *   <0        – the first kernel error, or -EIO if sending / receiving
+ *               failed (unacknowledged messages then report -EIO).
+ */
+int nl_batch_commit(struct nl_batch *batch)
+{
+    uint8_t *buf = NULL;
+    size_t buf_cap = 0;
+    size_t first;
+    size_t i;
+    int ret;
+
+    if (!batch)
+        return -EINVAL;
+
+    batch->first_err = 0;
+
+    for (first = 0; first < batch->count; first += batch->win_count)
+    {
+        size_t len = 0;
+
+        batch->win_first   = first;
+        batch->win_count   = batch->count - first;
+        if (batch->win_count > NL_BATCH_WINDOW)
+            batch->win_count = NL_BATCH_WINDOW;
+        batch->outstanding = batch->win_count;
+
+        for (i = first; i < first + batch->win_count; i++)
+        {
+            struct nlmsghdr *hdr;
+
+            nl_complete_msg(batch->sock, batch->entries[i].msg);
+            hdr = nlmsg_hdr(batch->entries[i].msg);
+            batch->entries[i].seq = hdr->nlmsg_seq;
+
+            if (len + NLMSG_ALIGN(hdr->nlmsg_len) > buf_cap)
+            {
+                size_t cap = buf_cap ? buf_cap * 2 : 65536;
+                uint8_t *nb;
+
+                while (cap < len + NLMSG_ALIGN(hdr->nlmsg_len))
+                    cap *= 2;
+                nb = realloc(buf, cap);
+                if (!nb)
+                {
+                    ret = -ENOMEM;
+                    goto fail;
+                }
+                buf = nb;
+                buf_cap = cap;
+            }
+            memcpy(buf + len, hdr, hdr->nlmsg_len);
+            memset(buf + len + hdr->nlmsg_len, 0,
+                   NLMSG_ALIGN(hdr->nlmsg_len) - hdr->nlmsg_len);
+            len += NLMSG_ALIGN(hdr->nlmsg_len);
+        }
+
+        ret = nl_sendto(batch->sock, buf, len);
+        if (ret < 0)
+        {
+            fprintf(stderr, "nl_batch_commit: sendmsg failed: %s\n", nl_geterror(ret));
+            ret = -EIO;
+            goto fail;
+        }
+
+        while (batch->outstanding > 0)
+        {
+            ret = nl_recvmsgs(batch->sock, batch->cb);
+            if (ret < 0)
+            {
+                fprintf(stderr, "nl_batch_commit: receive failed: %s\n", nl_geterror(ret));
+                ret = -EIO;
+                goto fail;
+            }
+        }
+    }
+
+    ret = batch->first_err;
+    goto out;
+
+fail:
+    for (i = batch->win_first; i < batch->count; i++)
+    {
+        if (i >= batch->win_first + batch->win_count || !batch->entries[i].done)
+        {
+            batch->entries[i].done = 1;
+            if (batch->entries[i].status)
+                *batch->entries[i].status = -EIO;
+        }
+    }
+
+out:
+    for (i = 0; i < batch->count; i++)
+        nlmsg_free(batch->entries[i].msg);
+    batch->count = 0;
+    batch->win_count = 0;
+    free(buf);
+    return ret;
+}
@@ -0,0 +1,30 @@
+/**
+ * @file nl_batch.h
+ * @brief Batched NETLINK_ROUTE requests: many messages per sendmsg(), one
+ *        status per message.
+ *
+ * Requests are queued with nl_batch_add() and sent by nl_batch_commit(),
+ * which packs up to NL_BATCH_WINDOW messages back to back into a single
+ * sendmsg() and then collects one ACK / error per message.  The kernel
+ * processes the messages of a window in order, so a batch behaves like the
+ * same requests sent one at a time, without a round trip per request.
+ */
+
+#ifndef NL_BATCH_H
+#define NL_BATCH_H
+
+#include <stddef.h>
+
+struct nl_msg;
+struct nl_batch;
+
+/** Messages packed into one sendmsg() / acknowledged per receive loop. */
+#define NL_BATCH_WINDOW 256
+
+struct nl_batch *nl_batch_alloc(void);
+void   nl_batch_free(struct nl_batch *batch);
+int    nl_batch_add(struct nl_batch *batch, struct nl_msg *msg, int *status);
+int    nl_batch_commit(struct nl_batch *batch);
+size_t nl_batch_pending(const struct nl_batch *batch);
+
+#endif /* NL_BATCH_H */
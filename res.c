@@ -0,0 +1,334 @@
+/**
+ * @file res.c
+ * @brief Resource manager (see res.h).
+ */
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+
+#include "acl.h"         /* ACL_MAX_RULES */
+#include "dataplane.h"   /* DP_MAX_ACLS */
+#include "fdb.h"         /* FDB_DEFAULT_BUCKETS, FDB_BUCKET_WAYS */
+#include "l3.h"          /* L3_MAX_ROUTES */
+#include "res.h"
+
+struct res_table
+{
+    const char *name;
+    unsigned    limit;
+    unsigned    capacity;       /* atomic; changes under g_res_lock */
+    unsigned    used;           /* atomic */
+    unsigned    high_water;     /* atomic */
+    unsigned    high;           /* under g_res_lock, read relaxed */
+    unsigned    low;
+    int         alarm;          /* under g_res_lock, read relaxed */
+    uint64_t    raised;         /* under g_res_lock */
+    uint64_t    failures;       /* atomic */
+    int         reported;       /* res_poll_alarms() caller only */
+};
+
+#define RES_TABLE(n, l) { .name = (n), .limit = (l), .capacity = (l), \
+                          .high = RES_DEFAULT_HIGH, .low = RES_DEFAULT_LOW }
+
+static struct res_table g_res[RES_NKINDS] =
+{
+    [RES_VLAN]  = RES_TABLE("vlan",  4094),
+    [RES_FDB]   = RES_TABLE("fdb",   FDB_DEFAULT_BUCKETS * FDB_BUCKET_WAYS),
+    [RES_ACL]   = RES_TABLE("acl",   DP_MAX_ACLS * ACL_MAX_RULES),
+    [RES_ROUTE] = RES_TABLE("route", L3_MAX_ROUTES),
+};
+
+/* Serializes alarm transitions and configuration; never held for long, so
+ * the forwarding worker that reports the FDB may take it. */
+static pthread_mutex_t g_res_lock = PTHREAD_MUTEX_INITIALIZER;
+static int             g_event_fd = -1;
+
+/* ---------------------------------------------------------------------------
+ * Helpers
+ * --------------------------------------------------------------------------- */
+
+static inline unsigned load(const unsigned *v)
+{
+    return __atomic_load_n(v, __ATOMIC_RELAXED);
+}
+
+/* Nonzero if @p used is at least @p pct percent of @p cap. */
+static inline int at_or_above(unsigned used, unsigned cap, unsigned pct)
+{
+    return (uint64_t)used * 100 >= (uint64_t)pct * cap;
+}
+
+/* Raise or clear the alarm of @p t from its current usage; g_res_lock held. */
+static void eval_locked(struct res_table *t)
+{
+    unsigned used = load(&t->used);
+    unsigned cap = load(&t->capacity);
+    int alarm;
+
+    if (t->alarm)
+        alarm = !(used <= (uint64_t)t->low * cap / 100);
+    else
+        alarm = at_or_above(used, cap, t->high);
+    if (alarm == t->alarm)
+        return;
+
+    __atomic_store_n(&t->alarm, alarm, __ATOMIC_RELAXED);
+    if (alarm)
+        t->raised++;
+    if (__atomic_load_n(&g_event_fd, __ATOMIC_ACQUIRE) >= 0)
+    {
+        uint64_t one = 1;
+
+        (void)!write(g_event_fd, &one, sizeof(one));
+    }
+}
+
+/* Account for usage @p used of @p t: high-water mark, then the alarm if
+ * a threshold may have been crossed. */
+static void update(struct res_table *t, unsigned used)
+{
+    unsigned hw = load(&t->high_water);
+    unsigned cap = load(&t->capacity);
+
+    while (used > hw &&
+           !__atomic_compare_exchange_n(&t->high_water, &hw, used, 1,
+                                        __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+        ;
+
+    if (__atomic_load_n(&t->alarm, __ATOMIC_RELAXED)
+        ? used > (uint64_t)load(&t->low) * cap / 100
+        : !at_or_above(used, cap, load(&t->high)))
+        return;
+
+    pthread_mutex_lock(&g_res_lock);
+    eval_locked(t);
+    pthread_mutex_unlock(&g_res_lock);
+}
+
+/* ---------------------------------------------------------------------------
+ * Public API
+ * --------------------------------------------------------------------------- */
+
+/** res_kind_name() - Name of table @p kind ("vlan", "fdb", ...), or NULL. */
+const char *res_kind_name(unsigned kind)
+{
+    return kind < RES_NKINDS ? g_res[kind].name : NULL;
+}
+
+/** res_kind_parse() - Table named @p name, or -EINVAL. */
+int res_kind_parse(const char *name)
+{
+    unsigned k;
+
+    for (k = 0; name && k < RES_NKINDS; k++)
+    {
+        if (strcmp(name, g_res[k].name) == 0)
+            return (int)k;
+    }
+    return -EINVAL;
+}
+
+/**
+ * res_alloc() - Reserve @p n entries of table @p kind.
+ *
+ * @return 0, -ENOSPC if fewer than @p n entries are left under the
+ *         configured capacity (nothing is reserved then), or -EINVAL.
+ */
+int res_alloc(enum res_kind kind, unsigned n)
+{
+    struct res_table *t;
+    unsigned used;
+
+    if ((unsigned)kind >= RES_NKINDS)
+        return -EINVAL;
+    t = &g_res[kind];
+
+    used = load(&t->used);
+    do
+    {
+        unsigned cap = load(&t->capacity);
+
+        if (used >= cap || n > cap - used)
+        {
+            __atomic_add_fetch(&t->failures, 1, __ATOMIC_RELAXED);
+            return -ENOSPC;
+        }
+    } while (!__atomic_compare_exchange_n(&t->used, &used, used + n, 1,
+                                          __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+    update(t, used + n);
+    return 0;
+}
+
+/** res_free() - Give back @p n entries of table @p kind. */
+void res_free(enum res_kind kind, unsigned n)
+{
+    struct res_table *t;
+    unsigned used;
+
+    if ((unsigned)kind >= RES_NKINDS || n == 0)
+        return;
+    t = &g_res[kind];
+
+    used = load(&t->used);
+    while (!__atomic_compare_exchange_n(&t->used, &used, used > n ? used - n : 0, 1,
+                                        __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+        ;
+    update(t, used > n ? used - n : 0);
+}
+
+/**
+ * res_set_used() - Report that table @p kind holds @p used entries, for
+ * tables that fill without res_alloc().
+ */
+void res_set_used(enum res_kind kind, unsigned used)
+{
+    struct res_table *t;
+
+    if ((unsigned)kind >= RES_NKINDS)
+        return;
+    t = &g_res[kind];
+    if (load(&t->used) == used)
+        return;
+    __atomic_store_n(&t->used, used, __ATOMIC_RELAXED);
+    update(t, used);
+}
+
+/**
+ * res_set_capacity() - Configure how many entries of table @p kind may be
+ * used.
+ *
+ * @return 0, -EINVAL for an unknown table or a capacity outside
+ *         [1..limit], or -EBUSY if more entries are in use.
+ */
+int res_set_capacity(enum res_kind kind, unsigned capacity)
+{
+    struct res_table *t;
+    int err = 0;
+
+    if ((unsigned)kind >= RES_NKINDS)
+        return -EINVAL;
+    t = &g_res[kind];
+    if (capacity < 1 || capacity > t->limit)
+        return -EINVAL;
+
+    pthread_mutex_lock(&g_res_lock);
+    if (load(&t->used) > capacity)
+        err = -EBUSY;
+    else
+    {
+        __atomic_store_n(&t->capacity, capacity, __ATOMIC_RELAXED);
+        eval_locked(t);
+    }
+    pthread_mutex_unlock(&g_res_lock);
+    return err;
+}
+
+/**
+ * res_set_threshold() - Raise the alarm of table @p kind at @p high percent
+ * of its capacity, and clear it at @p low percent.
+ *
+ * @return 0, or -EINVAL unless 0 <= @p low < @p high <= 100.
+ */
+int res_set_threshold(enum res_kind kind, unsigned high, unsigned low)
+{
+    struct res_table *t;
+
+    if ((unsigned)kind >= RES_NKINDS || high < 1 || high > 100 || low >= high)
+        return -EINVAL;
+    t = &g_res[kind];
+
+    pthread_mutex_lock(&g_res_lock);
+    __atomic_store_n(&t->high, high, __ATOMIC_RELAXED);
+    __atomic_store_n(&t->low, low, __ATOMIC_RELAXED);
+    eval_locked(t);
+    pthread_mutex_unlock(&g_res_lock);
+    return 0;
+}
+
+/** res_capacity() - Configured capacity of table @p kind, 0 if unknown. */
+unsigned res_capacity(enum res_kind kind)
+{
+    return (unsigned)kind < RES_NKINDS ? load(&g_res[kind].capacity) : 0;
+}
+
+/** res_get() - State of table @p kind; 0 or -EINVAL. */
+int res_get(enum res_kind kind, struct res_info *info)
+{
+    struct res_table *t;
+
+    if ((unsigned)kind >= RES_NKINDS || !info)
+        return -EINVAL;
+    t = &g_res[kind];
+
+    pthread_mutex_lock(&g_res_lock);
+    info->name       = t->name;
+    info->limit      = t->limit;
+    info->capacity   = load(&t->capacity);
+    info->used       = load(&t->used);
+    info->high_water = load(&t->high_water);
+    info->high       = t->high;
+    info->low        = t->low;
+    info->alarm      = t->alarm;
+    info->raised     = t->raised;
+    info->failures   = __atomic_load_n(&t->failures, __ATOMIC_RELAXED);
+    pthread_mutex_unlock(&g_res_lock);
+    return 0;
+}
+
+/**
+ * res_event_fd() - Eventfd that becomes readable when an alarm is raised
+ * or cleared, created on the first call.
+ *
+ * @return the descriptor, or -errno.
+ */
+int res_event_fd(void)
+{
+    int fd;
+
+    pthread_mutex_lock(&g_res_lock);
+    if (g_event_fd < 0)
+    {
+        fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        if (fd >= 0)
+            __atomic_store_n(&g_event_fd, fd, __ATOMIC_RELEASE);
+    }
+    fd = g_event_fd >= 0 ? g_event_fd : -errno;
+    pthread_mutex_unlock(&g_res_lock);
+    return fd;
+}
+
+/**
+ * res_poll_alarms() - Pass every table whose alarm was raised or cleared
+ * since the last call to @p fn, and reset the event descriptor.
+ *
+ * Meant for one consumer thread.  An alarm raised and cleared again
+ * between two calls is not reported; res_info.raised still counts it.
+ *
+ * @return the number of tables passed to @p fn.
+ */
+int res_poll_alarms(res_alarm_fn fn, void *arg)
+{
+    struct res_info info;
+    uint64_t v;
+    unsigned k;
+    int n = 0;
+
+    if (__atomic_load_n(&g_event_fd, __ATOMIC_ACQUIRE) >= 0)
+        (void)!read(g_event_fd, &v, sizeof(v));
+
+    for (k = 0; k < RES_NKINDS; k++)
+    {
+        res_get((enum res_kind)k, &info);
+        if (info.alarm == g_res[k].reported)
+            continue;
+        g_res[k].reported = info.alarm;
+        if (fn)
+            fn((enum res_kind)k, &info, arg);
+        n++;
+    }
+    return n;
+}
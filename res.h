@@ -0,0 +1,75 @@
+/**
+ * @file res.h
+ * @brief Resource manager: configured capacity, usage and high-water mark of
+ *        the VLAN, FDB, ACL and route tables, with threshold alarms.
+ *
+ * A switch ASIC has fixed table sizes and tells the operator how full each
+ * one is; this module does the same for the tables the daemon programs.
+ * Every table has a hard limit (what the backing structure can hold) and a
+ * configured capacity at or below it.  Owners of a table reserve entries
+ * with res_alloc() before they touch the kernel or the forwarding plane, so
+ * a full table fails with -ENOSPC without side effects, and give them back
+ * with res_free().  Tables that fill on their own (the FDB learns in the
+ * forwarding workers) report their size with res_set_used() instead.
+ *
+ * Usage is a lock-free counter: a reservation is one compare-and-swap, and
+ * res_set_used() from a forwarding worker one load and, if it changed, one
+ * store.  An alarm is raised when usage reaches the high threshold (a
+ * percentage of the capacity) and cleared when it falls to the low one; only
+ * those crossings take a lock.  Each crossing is signalled on the eventfd
+ * returned by res_event_fd(), and res_poll_alarms() reports the alarms that
+ * changed since the last call, for one consumer thread to stream them.
+ */
+
+#ifndef RES_H
+#define RES_H
+
+#include <stdint.h>
+
+/** Tables under the resource manager. */
+enum res_kind
+{
+    RES_VLAN,           /**< Vlan<id> bridges */
+    RES_FDB,            /**< forwarding-plane MAC table entries */
+    RES_ACL,            /**< ACL rules, over every list */
+    RES_ROUTE,          /**< routing-stage IPv4 routes */
+    RES_NKINDS
+};
+
+/** Default high and low alarm thresholds, in percent of the capacity. */
+#define RES_DEFAULT_HIGH    90
+#define RES_DEFAULT_LOW     80
+
+struct res_info
+{
+    const char *name;
+    unsigned    limit;          /**< what the table can hold at most */
+    unsigned    capacity;       /**< configured, <= limit */
+    unsigned    used;
+    unsigned    high_water;     /**< highest usage since start */
+    unsigned    high;           /**< alarm threshold, percent */
+    unsigned    low;            /**< clear threshold, percent */
+    int         alarm;          /**< 1 while raised */
+    uint64_t    raised;         /**< times the alarm was raised */
+    uint64_t    failures;       /**< reservations refused with -ENOSPC */
+};
+
+/** res_poll_alarms() callback: the alarm of @p kind is now @p info->alarm. */
+typedef void (*res_alarm_fn)(enum res_kind kind, const struct res_info *info, void *arg);
+
+const char *res_kind_name(unsigned kind);
+int  res_kind_parse(const char *name);
+
+int  res_alloc(enum res_kind kind, unsigned n);
+void res_free(enum res_kind kind, unsigned n);
+void res_set_used(enum res_kind kind, unsigned used);
+
+int  res_set_capacity(enum res_kind kind, unsigned capacity);
+int  res_set_threshold(enum res_kind kind, unsigned high, unsigned low);
+unsigned res_capacity(enum res_kind kind);
+int  res_get(enum res_kind kind, struct res_info *info);
+
+int  res_event_fd(void);
+int  res_poll_alarms(res_alarm_fn fn, void *arg);
+
+#endif /* RES_H */
@@ -0,0 +1,234 @@
+/**
+ * @file sflow.c
+ * @brief sFlow version 5 datagrams (see sflow.h).
+ *
+ * Layouts follow sflow_version_5.txt: the datagram header, flow sample
+ * (enterprise 0, format 1) with raw packet header (1) and extended switch
+ * (1001) records, and counter sample (format 2) with generic interface (1)
+ * or VLAN (5) counters.  Every sample and record is a tag word, a length
+ * word and its body.
+ */
+
+#include <errno.h>
+#include <string.h>
+
+#include "sflow.h"
+
+#define SFLOW_VERSION          5
+#define SFLOW_ADDR_IP4         1
+
+#define SFLOW_FLOW_SAMPLE      1
+#define SFLOW_COUNTER_SAMPLE   2
+#define SFLOW_REC_HEADER       1
+#define SFLOW_REC_SWITCH       1001
+#define SFLOW_REC_IF           1
+#define SFLOW_REC_VLAN         5
+
+#define SFLOW_PROTO_ETHERNET   1
+#define SFLOW_IFTYPE_ETHERNET  6
+#define SFLOW_IF_FULL_DUPLEX   1
+/** A 32-bit counter the agent does not keep. */
+#define SFLOW_UNKNOWN          0xFFFFFFFFu
+
+/** Offset of the sample count in the datagram header. */
+#define SFLOW_NSAMPLES_OFF     24
+
+#define PAD4(n)                (((n) + 3u) & ~3u)
+
+/* ---------------------------------------------------------------------------
+ * Helpers
+ * --------------------------------------------------------------------------- */
+
+static inline uint8_t *put32(uint8_t *p, uint32_t v)
+{
+    p[0] = (uint8_t)(v >> 24);
+    p[1] = (uint8_t)(v >> 16);
+    p[2] = (uint8_t)(v >> 8);
+    p[3] = (uint8_t)v;
+    return p + 4;
+}
+
+static inline uint8_t *put64(uint8_t *p, uint64_t v)
+{
+    return put32(put32(p, (uint32_t)(v >> 32)), (uint32_t)v);
+}
+
+/* Room for a sample of @p len bytes: its start, or NULL when full. */
+static uint8_t *sample_begin(struct sflow_dgram *d, size_t len)
+{
+    if (d->len + len > sizeof(d->buf))
+        return NULL;
+    return d->buf + d->len;
+}
+
+/* Account for the sample of @p len bytes just written. */
+static void sample_end(struct sflow_dgram *d, size_t len)
+{
+    d->len += len;
+    put32(d->buf + SFLOW_NSAMPLES_OFF, ++d->nsamples);
+}
+
+/* ---------------------------------------------------------------------------
+ * Public API
+ * --------------------------------------------------------------------------- */
+
+/**
+ * sflow_skip() - Frames to count before the next sample at 1 in @p rate:
+ * uniform in [1, 2 * @p rate - 1], so @p rate on average.
+ *
+ * @p state is the caller's xorshift32 generator state; any value, 0
+ * included, will do to start it.  @p rate must stay below 2^31.
+ */
+uint32_t sflow_skip(uint32_t *state, uint32_t rate)
+{
+    uint32_t x = *state ? *state : 0x9E3779B9u;
+
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    *state = x;
+    return rate > 1 ? 1 + x % (2 * rate - 1) : 1;
+}
+
+/**
+ * sflow_dgram_start() - Begin datagram @p d, number @p seq of agent
+ * @p agent (IPv4, network order) / @p sub_agent, @p uptime_ms after the
+ * agent started.
+ */
+void sflow_dgram_start(struct sflow_dgram *d, const uint8_t agent[4], uint32_t sub_agent,
+                       uint32_t seq, uint32_t uptime_ms)
+{
+    uint8_t *p = d->buf;
+
+    p = put32(p, SFLOW_VERSION);
+    p = put32(p, SFLOW_ADDR_IP4);
+    memcpy(p, agent, 4);
+    p = put32(p + 4, sub_agent);
+    p = put32(p, seq);
+    p = put32(p, uptime_ms);
+    p = put32(p, 0);
+    d->len = (size_t)(p - d->buf);
+    d->nsamples = 0;
+}
+
+/**
+ * sflow_add_flow() - Append a flow sample of frame @p s to @p d.
+ *
+ * @return 0, or -ENOSPC if it does not fit; @p d is unchanged then.
+ */
+int sflow_add_flow(struct sflow_dgram *d, const struct sflow_flow *s)
+{
+    unsigned hlen = s->header_len < s->frame_len ? s->header_len : s->frame_len;
+    size_t hrec = 16 + PAD4(hlen);
+    size_t len = 8 + 32 + 8 + hrec + 8 + 16;
+    uint8_t *p = sample_begin(d, len);
+
+    if (!p)
+        return -ENOSPC;
+    p = put32(p, SFLOW_FLOW_SAMPLE);
+    p = put32(p, (uint32_t)len - 8);
+    p = put32(p, s->seq);
+    p = put32(p, s->source);
+    p = put32(p, s->rate);
+    p = put32(p, s->pool);
+    p = put32(p, s->drops);
+    p = put32(p, s->input);
+    p = put32(p, s->output);
+    p = put32(p, 2);                        /* records */
+
+    p = put32(p, SFLOW_REC_HEADER);
+    p = put32(p, (uint32_t)hrec);
+    p = put32(p, SFLOW_PROTO_ETHERNET);
+    p = put32(p, s->frame_len);
+    p = put32(p, 0);                        /* bytes stripped: no FCS to strip */
+    p = put32(p, hlen);
+    memcpy(p, s->header, hlen);
+    memset(p + hlen, 0, PAD4(hlen) - hlen);
+    p += PAD4(hlen);
+
+    p = put32(p, SFLOW_REC_SWITCH);
+    p = put32(p, 16);
+    p = put32(p, s->vid);
+    p = put32(p, s->pcp);
+    p = put32(p, s->vid);                   /* switched, so out in the same VLAN */
+    put32(p, s->pcp);
+    sample_end(d, len);
+    return 0;
+}
+
+/**
+ * sflow_add_if_counters() - Append a counter sample of port @p c to @p d.
+ *
+ * Multicast, broadcast, error and unknown protocol counts are reported as
+ * not kept.
+ *
+ * @return 0, or -ENOSPC if it does not fit.
+ */
+int sflow_add_if_counters(struct sflow_dgram *d, const struct sflow_if_counters *c)
+{
+    size_t len = 8 + 12 + 8 + 88;
+    uint8_t *p = sample_begin(d, len);
+
+    if (!p)
+        return -ENOSPC;
+    p = put32(p, SFLOW_COUNTER_SAMPLE);
+    p = put32(p, (uint32_t)len - 8);
+    p = put32(p, c->seq);
+    p = put32(p, SFLOW_SOURCE(SFLOW_DS_IFINDEX, c->ifindex));
+    p = put32(p, 1);                        /* records */
+
+    p = put32(p, SFLOW_REC_IF);
+    p = put32(p, 88);
+    p = put32(p, c->ifindex);
+    p = put32(p, SFLOW_IFTYPE_ETHERNET);
+    p = put64(p, c->speed);
+    p = put32(p, SFLOW_IF_FULL_DUPLEX);
+    p = put32(p, c->status);
+    p = put64(p, c->in_octets);
+    p = put32(p, c->in_packets);
+    p = put32(p, SFLOW_UNKNOWN);            /* multicast */
+    p = put32(p, SFLOW_UNKNOWN);            /* broadcast */
+    p = put32(p, c->in_discards);
+    p = put32(p, SFLOW_UNKNOWN);            /* errors */
+    p = put32(p, SFLOW_UNKNOWN);            /* unknown protocols */
+    p = put64(p, c->out_octets);
+    p = put32(p, c->out_packets);
+    p = put32(p, SFLOW_UNKNOWN);
+    p = put32(p, SFLOW_UNKNOWN);
+    p = put32(p, c->out_discards);
+    p = put32(p, SFLOW_UNKNOWN);
+    put32(p, 0);                            /* not promiscuous */
+    sample_end(d, len);
+    return 0;
+}
+
+/**
+ * sflow_add_vlan_counters() - Append a counter sample of VLAN @p c to
+ * @p d, with data source SFLOW_DS_VLAN / the VLAN ID.
+ *
+ * @return 0, or -ENOSPC if it does not fit.
+ */
+int sflow_add_vlan_counters(struct sflow_dgram *d, const struct sflow_vlan_counters *c)
+{
+    size_t len = 8 + 12 + 8 + 28;
+    uint8_t *p = sample_begin(d, len);
+
+    if (!p)
+        return -ENOSPC;
+    p = put32(p, SFLOW_COUNTER_SAMPLE);
+    p = put32(p, (uint32_t)len - 8);
+    p = put32(p, c->seq);
+    p = put32(p, SFLOW_SOURCE(SFLOW_DS_VLAN, c->vid));
+    p = put32(p, 1);
+
+    p = put32(p, SFLOW_REC_VLAN);
+    p = put32(p, 28);
+    p = put32(p, c->vid);
+    p = put64(p, c->octets);
+    p = put32(p, c->packets);
+    p = put32(p, SFLOW_UNKNOWN);
+    p = put32(p, SFLOW_UNKNOWN);
+    put32(p, c->discards);
+    sample_end(d, len);
+    return 0;
+}
@@ -0,0 +1,102 @@
+/**
+ * @file sflow.h
+ * @brief sFlow version 5 datagram encoding and the random sampling skip.
+ *
+ * An sFlow agent samples 1 in N frames of a data source (a port) at random
+ * and polls the source's counters at a fixed interval; both kinds of
+ * sample travel to the collector in sFlow v5 datagrams over UDP (port
+ * SFLOW_PORT).  This module builds those datagrams: a flow sample carries
+ * the first bytes of the sampled frame (raw packet header record) and its
+ * VLAN (extended switch record), a counter sample a port's generic
+ * interface counters or a VLAN's counters.  All fields are XDR, that is
+ * big-endian and padded to four bytes.
+ *
+ * Sampling uses a skip count instead of a per-frame random draw: the
+ * sampler counts down sflow_skip() frames between samples, a random number
+ * whose mean is the sampling rate, so the cost per frame is a decrement.
+ */
+
+#ifndef SFLOW_H
+#define SFLOW_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/** UDP port of an sFlow collector. */
+#define SFLOW_PORT          6343
+/** Largest datagram built, under a 1500-byte path MTU. */
+#define SFLOW_DGRAM_MAX     1400
+/** Bytes of a sampled frame exported by default. */
+#define SFLOW_HEADER_MAX    128
+/** Largest sampling rate sflow_skip() takes. */
+#define SFLOW_RATE_MAX      (1u << 30)
+
+/** Data source types, the top byte of a source id. */
+#define SFLOW_DS_IFINDEX    0
+#define SFLOW_DS_VLAN       1
+
+#define SFLOW_SOURCE(type, index)   ((uint32_t)(type) << 24 | ((index) & 0xFFFFFF))
+
+/** ifStatus bits of the generic interface counters. */
+#define SFLOW_IF_ADMIN_UP   1u
+#define SFLOW_IF_OPER_UP    2u
+
+/** One datagram being built. */
+struct sflow_dgram
+{
+    uint8_t  buf[SFLOW_DGRAM_MAX];
+    size_t   len;
+    unsigned nsamples;
+};
+
+/** A sampled frame. */
+struct sflow_flow
+{
+    uint32_t       seq;          /**< samples taken from the source so far */
+    uint32_t       source;       /**< SFLOW_SOURCE() */
+    uint32_t       rate;         /**< 1 in @c rate */
+    uint32_t       pool;         /**< frames the source saw, sampled or not */
+    uint32_t       drops;        /**< samples lost for lack of resources */
+    uint32_t       input;        /**< ifIndex the frame came in on */
+    uint32_t       output;       /**< ifIndex it left on, 0: not known */
+    uint32_t       frame_len;    /**< length on the wire */
+    const uint8_t *header;       /**< its first bytes ... */
+    unsigned       header_len;   /**< ... this many */
+    uint16_t       vid;          /**< VLAN it was switched in */
+    uint8_t        pcp;          /**< its priority */
+};
+
+/** Counters of a port, packet counts totals of all address types. */
+struct sflow_if_counters
+{
+    uint32_t seq;
+    uint32_t ifindex;
+    uint32_t status;             /**< SFLOW_IF_* */
+    uint64_t speed;              /**< bits per second, 0: not known */
+    uint64_t in_octets;
+    uint32_t in_packets;
+    uint32_t in_discards;
+    uint64_t out_octets;
+    uint32_t out_packets;
+    uint32_t out_discards;
+};
+
+/** Counters of a VLAN. */
+struct sflow_vlan_counters
+{
+    uint32_t seq;
+    uint16_t vid;
+    uint64_t octets;
+    uint32_t packets;
+    uint32_t discards;
+};
+
+uint32_t sflow_skip(uint32_t *state, uint32_t rate);
+
+void sflow_dgram_start(struct sflow_dgram *d, const uint8_t agent[4], uint32_t sub_agent,
+                       uint32_t seq, uint32_t uptime_ms);
+int  sflow_add_flow(struct sflow_dgram *d, const struct sflow_flow *s);
+int  sflow_add_if_counters(struct sflow_dgram *d, const struct sflow_if_counters *c);
+int  sflow_add_vlan_counters(struct sflow_dgram *d, const struct sflow_vlan_counters *c);
+
+#endif /* SFLOW_H */
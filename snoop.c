@@ -0,0 +1,798 @@
+/**
+ * @file snoop.c
+ * @brief IGMP / MLD snooping state (see snoop.h).
+ *
+ * Groups live in a chained hash table keyed by (VLAN, address), each with
+ * a list of member ports; router ports are a list per VLAN.  A member and
+ * a router port are both a struct snoop_member whose embedded tw_timer is
+ * its expiry, so the wheel's callback gets straight back to it.
+ */
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+
+#include "snoop.h"
+#include "twheel.h"
+#include "vlan_state.h"  /* VLAN_ID_SPACE */
+
+#define SNOOP_HASH_SIZE  4096
+/** Wheel slots; one turn (409.6 s) covers the longest interval. */
+#define SNOOP_WHEEL_SLOTS 4096
+
+/* IGMP message types. */
+#define IGMP_QUERY       0x11
+#define IGMP_V1_REPORT   0x12
+#define IGMP_V2_REPORT   0x16
+#define IGMP_V2_LEAVE    0x17
+#define IGMP_V3_REPORT   0x22
+
+/* MLD message types (ICMPv6). */
+#define MLD_QUERY        130
+#define MLD_V1_REPORT    131
+#define MLD_V1_DONE      132
+#define MLD_V2_REPORT    143
+
+/* Group record types shared by IGMPv3 and MLDv2. */
+#define REC_IS_IN        1
+#define REC_IS_EX        2
+#define REC_TO_IN        3
+#define REC_TO_EX        4
+#define REC_ALLOW        5
+
+struct snoop_group;
+
+/* A member port of a group, or a router port of a VLAN (group NULL). */
+struct snoop_member
+{
+    struct tw_timer      timer;      /* first: the wheel hands it back */
+    struct snoop_member *next;
+    struct snoop_group  *group;
+    uint16_t             vid;
+    int                  port;
+};
+
+struct snoop_group
+{
+    struct snoop_group  *next;       /* hash chain */
+    struct snoop_key     k;
+    struct snoop_member *members;
+};
+
+struct snoop
+{
+    struct twheel        wheel;
+    snoop_change_fn      fn;
+    void                *arg;
+    uint64_t             enabled[VLAN_ID_SPACE / 64];
+    struct snoop_member *routers[VLAN_ID_SPACE];
+    struct snoop_group  *hash[SNOOP_HASH_SIZE];
+    struct snoop_stats   st;
+};
+
+struct snoop_slot
+{
+    struct snoop_key     k;
+    uint8_t              used;
+    uint64_t             ports;
+};
+
+struct snoop_table
+{
+    unsigned             mask;
+    struct snoop_slot    slot[];
+};
+
+/* Parsed IP header of a frame. */
+struct ip_view
+{
+    uint8_t              family;
+    uint8_t              proto;      /* IPv4 protocol, or upper-layer next header */
+    const uint8_t       *src;
+    const uint8_t       *dst;
+    const uint8_t       *l4;
+    size_t               l4len;
+};
+
+/* ---------------------------------------------------------------------------
+ * Helpers
+ * --------------------------------------------------------------------------- */
+
+static inline uint64_t ticks(uint64_t ms)
+{
+    return ms / SNOOP_TICK_MS;
+}
+
+static unsigned key_hash(const struct snoop_key *k)
+{
+    uint32_t h = 2166136261u ^ k->vid;
+    unsigned i;
+
+    for (i = 0; i < (k->family == AF_INET ? 4u : 16u); i++)
+        h = (h ^ k->addr[i]) * 16777619u;
+    return h;
+}
+
+static int key_equal(const struct snoop_key *a, const struct snoop_key *b)
+{
+    return a->vid == b->vid && a->family == b->family && memcmp(a->addr, b->addr, 16) == 0;
+}
+
+static void key_set(struct snoop_key *k, uint16_t vid, uint8_t family, const uint8_t *addr)
+{
+    memset(k, 0, sizeof(*k));
+    k->vid = vid;
+    k->family = family;
+    memcpy(k->addr, addr, family == AF_INET ? 4 : 16);
+}
+
+/* A group that is multicast and wider than link-local scope. */
+static int trackable(uint8_t family, const uint8_t *a)
+{
+    if (family == AF_INET)
+        return (a[0] & 0xF0) == 0xE0 && !(a[0] == 224 && a[1] == 0 && a[2] == 0);
+    return a[0] == 0xFF && (a[1] & 0x0F) > 2;
+}
+
+static uint32_t csum_add(uint32_t sum, const uint8_t *p, size_t len)
+{
+    while (len > 1)
+    {
+        sum += (uint32_t)p[0] << 8 | p[1];
+        p += 2;
+        len -= 2;
+    }
+    if (len)
+        sum += (uint32_t)p[0] << 8;
+    return sum;
+}
+
+static int csum_ok(uint32_t sum)
+{
+    while (sum >> 16)
+        sum = (sum & 0xFFFF) + (sum >> 16);
+    return sum == 0xFFFF;
+}
+
+/* Locate the IP header and the upper-layer payload of an untagged frame. */
+static int parse_ip(const uint8_t *f, size_t len, struct ip_view *v)
+{
+    size_t end;
+
+    if (len < 14 + 20)
+        return -1;
+    if (f[12] == 0x08 && f[13] == 0x00)
+    {
+        const uint8_t *ip = f + 14;
+        size_t hl = (size_t)(ip[0] & 0x0F) * 4;
+        size_t tot = (size_t)ip[2] << 8 | ip[3];
+
+        /* Fragments never carry a whole IGMP message; treat them as data. */
+        if ((ip[0] >> 4) != 4 || hl < 20 || tot < hl || 14 + tot > len)
+            return -1;
+        v->family = AF_INET;
+        v->proto = ((ip[6] & 0x3F) | ip[7]) ? 0 : ip[9];
+        v->src = ip + 12;
+        v->dst = ip + 16;
+        v->l4 = ip + hl;
+        v->l4len = tot - hl;
+        return 0;
+    }
+    if (f[12] == 0x86 && f[13] == 0xDD && len >= 14 + 40)
+    {
+        const uint8_t *ip = f + 14;
+        size_t off = 40;
+        uint8_t nh = ip[6];
+
+        end = 40 + ((size_t)ip[4] << 8 | ip[5]);
+        if ((ip[0] >> 4) != 6 || 14 + end > len)
+            return -1;
+        /* MLD rides behind a hop-by-hop header with the router alert. */
+        if (nh == 0)
+        {
+            if (off + 8 > end)
+                return -1;
+            nh = ip[off];
+            off += ((size_t)ip[off + 1] + 1) * 8;
+            if (off > end)
+                return -1;
+        }
+        v->family = AF_INET6;
+        v->proto = nh;
+        v->src = ip + 8;
+        v->dst = ip + 24;
+        v->l4 = ip + off;
+        v->l4len = end - off;
+        return 0;
+    }
+    return -1;
+}
+
+static int is_mld(const struct ip_view *v)
+{
+    uint8_t t;
+
+    if (v->family != AF_INET6 || v->proto != 58 || v->l4len < 1)
+        return 0;
+    t = v->l4[0];
+    return t == MLD_QUERY || t == MLD_V1_REPORT || t == MLD_V1_DONE || t == MLD_V2_REPORT;
+}
+
+/* ---------------------------------------------------------------------------
+ * Groups and router ports
+ * --------------------------------------------------------------------------- */
+
+static struct snoop_group **group_slot(struct snoop *s, const struct snoop_key *k)
+{
+    struct snoop_group **pg = &s->hash[key_hash(k) & (SNOOP_HASH_SIZE - 1)];
+
+    while (*pg && !key_equal(&(*pg)->k, k))
+        pg = &(*pg)->next;
+    return pg;
+}
+
+static struct snoop_member **member_slot(struct snoop_member **head, int port)
+{
+    while (*head && (*head)->port != port)
+        head = &(*head)->next;
+    return head;
+}
+
+/* Unlink @p m (found at @p pm), report it and free it, and its group if
+ * that was the last member. */
+static void member_remove(struct snoop *s, struct snoop_member **pm)
+{
+    struct snoop_member *m = *pm;
+    struct snoop_group *g = m->group;
+    struct snoop_key k;
+
+    *pm = m->next;
+    tw_cancel(&s->wheel, &m->timer);
+    if (g)
+    {
+        k = g->k;
+        s->st.members--;
+        if (!g->members)
+        {
+            *group_slot(s, &g->k) = g->next;
+            s->st.groups--;
+            free(g);
+        }
+        s->fn(SNOOP_PRUNE, &k, m->port, s->arg);
+    }
+    else
+    {
+        memset(&k, 0, sizeof(k));
+        k.vid = m->vid;
+        s->st.routers--;
+        s->fn(SNOOP_ROUTER_DEL, &k, m->port, s->arg);
+    }
+    free(m);
+}
+
+static void on_expire(struct tw_timer *t, void *arg)
+{
+    struct snoop *s = arg;
+    struct snoop_member *m = (struct snoop_member *)t;
+    struct snoop_member **head = m->group ? &m->group->members : &s->routers[m->vid];
+
+    member_remove(s, member_slot(head, m->port));
+}
+
+static void join(struct snoop *s, const struct snoop_key *k, int port, uint64_t now)
+{
+    struct snoop_group **pg = group_slot(s, k);
+    struct snoop_member **pm;
+    struct snoop_member *m;
+
+    if (!*pg)
+    {
+        if (s->st.groups >= SNOOP_MAX_GROUPS || !(*pg = calloc(1, sizeof(**pg))))
+        {
+            s->st.full++;
+            return;
+        }
+        (*pg)->k = *k;
+        s->st.groups++;
+    }
+    pm = member_slot(&(*pg)->members, port);
+    if (!*pm)
+    {
+        if (!(m = calloc(1, sizeof(*m))))
+        {
+            if (!(*pg)->members)
+            {
+                struct snoop_group *g = *pg;
+
+                *pg = g->next;
+                s->st.groups--;
+                free(g);
+            }
+            s->st.full++;
+            return;
+        }
+        m->group = *pg;
+        m->vid = k->vid;
+        m->port = port;
+        *pm = m;
+        s->st.members++;
+        s->fn(SNOOP_JOIN, k, port, s->arg);
+    }
+    tw_arm(&s->wheel, &(*pm)->timer, ticks(now + SNOOP_MEMBER_MS));
+}
+
+static void leave(struct snoop *s, const struct snoop_key *k, int port, uint64_t now)
+{
+    struct snoop_group *g = *group_slot(s, k);
+    struct snoop_member *m = g ? *member_slot(&g->members, port) : NULL;
+    uint64_t t = ticks(now + SNOOP_LEAVE_MS);
+
+    if (m && m->timer.expires > t)
+        tw_arm(&s->wheel, &m->timer, t);
+}
+
+static void router(struct snoop *s, uint16_t vid, int port, uint64_t now)
+{
+    struct snoop_member **pm = member_slot(&s->routers[vid], port);
+    struct snoop_key k;
+
+    if (!*pm)
+    {
+        if (!(*pm = calloc(1, sizeof(**pm))))
+            return;
+        (*pm)->vid = vid;
+        (*pm)->port = port;
+        s->st.routers++;
+        memset(&k, 0, sizeof(k));
+        k.vid = vid;
+        s->fn(SNOOP_ROUTER_ADD, &k, port, s->arg);
+    }
+    tw_arm(&s->wheel, &(*pm)->timer, ticks(now + SNOOP_ROUTER_MS));
+}
+
+/* Apply one IGMPv3 / MLDv2 group record. */
+static void record(struct snoop *s, uint16_t vid, int port, uint8_t family, const uint8_t *addr,
+                   unsigned type, unsigned nsrc, uint64_t now)
+{
+    struct snoop_key k;
+
+    if (!trackable(family, addr))
+        return;
+    key_set(&k, vid, family, addr);
+    /* Include mode with no sources means no listener; BLOCK only trims sources. */
+    if ((type == REC_IS_IN || type == REC_TO_IN) && nsrc == 0)
+    {
+        s->st.leaves++;
+        leave(s, &k, port, now);
+    }
+    else if (type >= REC_IS_IN && type <= REC_ALLOW)
+    {
+        s->st.reports++;
+        join(s, &k, port, now);
+    }
+}
+
+/* ---------------------------------------------------------------------------
+ * Message parsing
+ * --------------------------------------------------------------------------- */
+
+static int igmp_rx(struct snoop *s, uint16_t vid, int port, const uint8_t *p, size_t n,
+                   uint64_t now)
+{
+    struct snoop_key k;
+    size_t off, nrec, i;
+
+    if (n < 8 || !csum_ok(csum_add(0, p, n)))
+        return -EINVAL;
+
+    switch (p[0])
+    {
+    case IGMP_QUERY:
+        s->st.queries++;
+        router(s, vid, port, now);
+        return 1;
+
+    case IGMP_V1_REPORT:
+    case IGMP_V2_REPORT:
+    case IGMP_V2_LEAVE:
+        if (!trackable(AF_INET, p + 4))
+            return 1;
+        key_set(&k, vid, AF_INET, p + 4);
+        if (p[0] == IGMP_V2_LEAVE)
+        {
+            s->st.leaves++;
+            leave(s, &k, port, now);
+        }
+        else
+        {
+            s->st.reports++;
+            join(s, &k, port, now);
+        }
+        return 1;
+
+    case IGMP_V3_REPORT:
+        nrec = (size_t)p[6] << 8 | p[7];
+        for (i = 0, off = 8; i < nrec; i++)
+        {
+            size_t nsrc, next;
+
+            if (off + 8 > n)
+                return -EINVAL;
+            nsrc = (size_t)p[off + 2] << 8 | p[off + 3];
+            next = off + 8 + nsrc * 4 + (size_t)p[off + 1] * 4;
+            if (next > n)
+                return -EINVAL;
+            record(s, vid, port, AF_INET, p + off + 4, p[off], (unsigned)nsrc, now);
+            off = next;
+        }
+        return 1;
+
+    default:
+        return 0;
+    }
+}
+
+static int mld_rx(struct snoop *s, uint16_t vid, int port, const struct ip_view *v, uint64_t now)
+{
+    const uint8_t *p = v->l4;
+    size_t n = v->l4len;
+    uint8_t pseudo[8] = { 0 };
+    struct snoop_key k;
+    size_t off, nrec, i;
+    uint32_t sum;
+
+    if (n < 24)
+        return -EINVAL;
+    pseudo[0] = (uint8_t)(n >> 24);
+    pseudo[1] = (uint8_t)(n >> 16);
+    pseudo[2] = (uint8_t)(n >> 8);
+    pseudo[3] = (uint8_t)n;
+    pseudo[7] = 58;
+    sum = csum_add(0, v->src, 16);
+    sum = csum_add(sum, v->dst, 16);
+    sum = csum_add(sum, pseudo, sizeof(pseudo));
+    if (!csum_ok(csum_add(sum, p, n)))
+        return -EINVAL;
+
+    switch (p[0])
+    {
+    case MLD_QUERY:
+        s->st.queries++;
+        router(s, vid, port, now);
+        return 1;
+
+    case MLD_V1_REPORT:
+    case MLD_V1_DONE:
+        if (!trackable(AF_INET6, p + 8))
+            return 1;
+        key_set(&k, vid, AF_INET6, p + 8);
+        if (p[0] == MLD_V1_DONE)
+        {
+            s->st.leaves++;
+            leave(s, &k, port, now);
+        }
+        else
+        {
+            s->st.reports++;
+            join(s, &k, port, now);
+        }
+        return 1;
+
+    default:    /* MLD_V2_REPORT */
+        nrec = (size_t)p[6] << 8 | p[7];
+        for (i = 0, off = 8; i < nrec; i++)
+        {
+            size_t nsrc, next;
+
+            if (off + 20 > n)
+                return -EINVAL;
+            nsrc = (size_t)p[off + 2] << 8 | p[off + 3];
+            next = off + 20 + nsrc * 16 + (size_t)p[off + 1] * 4;
+            if (next > n)
+                return -EINVAL;
+            record(s, vid, port, AF_INET6, p + off + 4, p[off], (unsigned)nsrc, now);
+            off = next;
+        }
+        return 1;
+    }
+}
+
+/* ---------------------------------------------------------------------------
+ * Public API
+ * --------------------------------------------------------------------------- */
+
+/**
+ * snoop_create() - New snooper at time @p now_ms with no VLAN enabled.
+ *
+ * @p fn is called for every change, from inside the call that makes it.
+ *
+ * @return the snooper, or NULL if out of memory.
+ */
+struct snoop *snoop_create(uint64_t now_ms, snoop_change_fn fn, void *arg)
+{
+    struct snoop *s = calloc(1, sizeof(*s));
+
+    if (!s)
+        return NULL;
+    if (tw_init(&s->wheel, SNOOP_WHEEL_SLOTS, ticks(now_ms)) < 0)
+    {
+        free(s);
+        return NULL;
+    }
+    s->fn = fn;
+    s->arg = arg;
+    return s;
+}
+
+/** snoop_destroy() - Free @p s and its state without reporting changes. */
+void snoop_destroy(struct snoop *s)
+{
+    struct snoop_member *m, *next;
+    struct snoop_group *g, *gnext;
+    unsigned i;
+
+    if (!s)
+        return;
+    for (i = 0; i < SNOOP_HASH_SIZE; i++)
+    {
+        for (g = s->hash[i]; g; g = gnext)
+        {
+            gnext = g->next;
+            for (m = g->members; m; m = next)
+            {
+                next = m->next;
+                free(m);
+            }
+            free(g);
+        }
+    }
+    for (i = 0; i < VLAN_ID_SPACE; i++)
+    {
+        for (m = s->routers[i]; m; m = next)
+        {
+            next = m->next;
+            free(m);
+        }
+    }
+    tw_destroy(&s->wheel);
+    free(s);
+}
+
+/**
+ * snoop_vlan_enable() - Start or stop snooping in VLAN @p vid.
+ *
+ * Stopping forgets the VLAN's groups and router ports, each reported as a
+ * prune or a router removal.
+ *
+ * @return 0, or -EINVAL for a VLAN ID outside [1..4094].
+ */
+int snoop_vlan_enable(struct snoop *s, uint16_t vid, int on)
+{
+    struct snoop_group **pg;
+    unsigned i;
+
+    if (vid < 1 || vid > 4094)
+        return -EINVAL;
+    if (on)
+    {
+        s->enabled[vid / 64] |= 1ull << (vid % 64);
+        return 0;
+    }
+
+    s->enabled[vid / 64] &= ~(1ull << (vid % 64));
+    while (s->routers[vid])
+        member_remove(s, &s->routers[vid]);
+    for (i = 0; i < SNOOP_HASH_SIZE; i++)
+    {
+        for (pg = &s->hash[i]; *pg; )
+        {
+            struct snoop_group *g = *pg;
+
+            if (g->k.vid != vid)
+            {
+                pg = &g->next;
+                continue;
+            }
+            /* The last removal frees g and unlinks it from *pg. */
+            while (g->members->next)
+                member_remove(s, &g->members);
+            member_remove(s, &g->members);
+        }
+    }
+    return 0;
+}
+
+int snoop_vlan_enabled(const struct snoop *s, uint16_t vid)
+{
+    return vid < VLAN_ID_SPACE && ((s->enabled[vid / 64] >> (vid % 64)) & 1);
+}
+
+/**
+ * snoop_rx() - Learn from frame @p frame (untagged, from the Ethernet
+ * header) received on @p port in VLAN @p vid at @p now_ms.
+ *
+ * @return 1 if it was an IGMP or MLD message of a snooped VLAN, 0 if it
+ *         was not, or -EINVAL if it was truncated or had a bad checksum.
+ */
+int snoop_rx(struct snoop *s, uint16_t vid, int port, const uint8_t *frame, size_t len,
+             uint64_t now_ms)
+{
+    struct ip_view v;
+    int ret = 0;
+
+    if (!snoop_vlan_enabled(s, vid) || parse_ip(frame, len, &v) < 0)
+        return 0;
+    if (v.family == AF_INET && v.proto == 2)
+        ret = igmp_rx(s, vid, port, v.l4, v.l4len, now_ms);
+    else if (is_mld(&v))
+        ret = mld_rx(s, vid, port, &v, now_ms);
+    if (ret < 0)
+        s->st.invalid++;
+    return ret;
+}
+
+/** snoop_port_down() - Forget @p port in every group and VLAN. */
+void snoop_port_down(struct snoop *s, int port)
+{
+    struct snoop_member **pm;
+    struct snoop_group *g, *next;
+    unsigned i;
+
+    for (i = 0; i < VLAN_ID_SPACE; i++)
+    {
+        pm = member_slot(&s->routers[i], port);
+        if (*pm)
+            member_remove(s, pm);
+    }
+    for (i = 0; i < SNOOP_HASH_SIZE; i++)
+    {
+        for (g = s->hash[i]; g; g = next)
+        {
+            next = g->next;         /* g may go with its last member */
+            pm = member_slot(&g->members, port);
+            if (*pm)
+                member_remove(s, pm);
+        }
+    }
+}
+
+/**
+ * snoop_tick() - Expire the memberships and router ports due by @p now_ms.
+ *
+ * @return the number expired.
+ */
+unsigned snoop_tick(struct snoop *s, uint64_t now_ms)
+{
+    return tw_advance(&s->wheel, ticks(now_ms), on_expire, s);
+}
+
+/**
+ * snoop_walk() - Pass every router port and every (group, port) membership
+ * with the time it has left to @p fn: router ports by VLAN first, then
+ * groups in no particular order.
+ *
+ * @return the number of entries passed.
+ */
+int snoop_walk(const struct snoop *s, uint64_t now_ms, snoop_walk_fn fn, void *arg)
+{
+    const struct snoop_member *m;
+    const struct snoop_group *g;
+    uint64_t at;
+    unsigned i;
+    int n = 0;
+
+    for (i = 0; i < VLAN_ID_SPACE; i++)
+    {
+        for (m = s->routers[i]; m; m = m->next, n++)
+        {
+            at = m->timer.expires * SNOOP_TICK_MS;
+            fn((uint16_t)i, NULL, m->port, at > now_ms ? at - now_ms : 0, arg);
+        }
+    }
+    for (i = 0; i < SNOOP_HASH_SIZE; i++)
+    {
+        for (g = s->hash[i]; g; g = g->next)
+        {
+            for (m = g->members; m; m = m->next, n++)
+            {
+                at = m->timer.expires * SNOOP_TICK_MS;
+                fn(g->k.vid, &g->k, m->port, at > now_ms ? at - now_ms : 0, arg);
+            }
+        }
+    }
+    return n;
+}
+
+void snoop_get_stats(const struct snoop *s, struct snoop_stats *st)
+{
+    *st = s->st;
+}
+
+/**
+ * snoop_classify() - What a forwarding path should do with a multicast
+ * frame of VLAN @p vid.
+ *
+ * @return SNOOP_CONTROL for IGMP / MLD, SNOOP_DATA with @p k set for
+ *         data to a trackable group, SNOOP_OTHER otherwise.
+ */
+int snoop_classify(const uint8_t *frame, size_t len, uint16_t vid, struct snoop_key *k)
+{
+    struct ip_view v;
+
+    if (parse_ip(frame, len, &v) < 0)
+        return SNOOP_OTHER;
+    if ((v.family == AF_INET && v.proto == 2) || is_mld(&v))
+        return SNOOP_CONTROL;
+    if (!trackable(v.family, v.dst))
+        return SNOOP_OTHER;
+    key_set(k, vid, v.family, v.dst);
+    return SNOOP_DATA;
+}
+
+/**
+ * snoop_compile() - Snapshot the listener ports of every group as a
+ * read-only table for snoop_lookup().
+ *
+ * Bit p of a group's bitmap is port p; ports outside [0..63] are left out.
+ *
+ * @return the table (free with snoop_table_free()), or NULL if out of
+ *         memory.
+ */
+struct snoop_table *snoop_compile(const struct snoop *s)
+{
+    const struct snoop_member *m;
+    const struct snoop_group *g;
+    struct snoop_table *t;
+    unsigned size = 16;
+    unsigned i;
+
+    while (size < 2 * s->st.groups)
+        size *= 2;
+    t = calloc(1, sizeof(*t) + size * sizeof(t->slot[0]));
+    if (!t)
+        return NULL;
+    t->mask = size - 1;
+
+    for (i = 0; i < SNOOP_HASH_SIZE; i++)
+    {
+        for (g = s->hash[i]; g; g = g->next)
+        {
+            unsigned h = key_hash(&g->k) & t->mask;
+
+            while (t->slot[h].used)
+                h = (h + 1) & t->mask;
+            t->slot[h].k = g->k;
+            t->slot[h].used = 1;
+            for (m = g->members; m; m = m->next)
+            {
+                if (m->port >= 0 && m->port < 64)
+                    t->slot[h].ports |= 1ull << m->port;
+            }
+        }
+    }
+    return t;
+}
+
+/**
+ * snoop_lookup() - Listener ports of group @p k in table @p t.
+ *
+ * @return the port bitmap, 0 if the group has no listener.
+ */
+uint64_t snoop_lookup(const struct snoop_table *t, const struct snoop_key *k)
+{
+    unsigned h = key_hash(k) & t->mask;
+
+    while (t->slot[h].used)
+    {
+        if (key_equal(&t->slot[h].k, k))
+            return t->slot[h].ports;
+        h = (h + 1) & t->mask;
+    }
+    return 0;
+}
+
+void snoop_table_free(struct snoop_table *t)
+{
+    free(t);
+}
@@ -0,0 +1,110 @@
+/**
+ * @file snoop.h
+ * @brief IGMP / MLD snooping: per-VLAN multicast group membership learned
+ *        from the hosts' reports.
+ *
+ * The snooper listens to the IGMPv1/v2/v3 and MLDv1/v2 messages received
+ * on the ports of the VLANs it is enabled for and keeps, per VLAN, which
+ * ports have listeners for which group (RFC 4541).  A report adds or
+ * refreshes the port's membership for the group membership interval; a
+ * leave (IGMPv2 leave, MLD done, or a v3/v2 record that changes to include
+ * no sources) shortens it to the last member query time, so the port is
+ * pruned unless another listener behind it answers the querier's
+ * group-specific query.  Ports that receive queries are router ports for
+ * the other querier present interval; multicast data is sent to them as
+ * well as to the group's listeners.  Groups are tracked per address, not
+ * per source; link-local groups (224.0.0.0/24, ff02::/16 and narrower
+ * scopes) are never tracked and always flood.
+ *
+ * Every timeout is a tw_timer on one timer wheel (twheel.h) with a tick
+ * of SNOOP_TICK_MS, so expiring thousands of memberships costs one slot
+ * visit per tick.  Changes are reported through a callback as they
+ * happen, so a backend can program them (the forwarding plane's egress
+ * bitmaps, or kernel bridge MDB entries, see br_mdb.h).
+ *
+ * Ports are opaque integers chosen by the caller (a port table slot or an
+ * ifindex).  snoop_compile() turns the current state into an immutable
+ * snoop_table keyed by (VLAN, group) whose values are port bitmaps, for
+ * lock-free lookups from a forwarding path; that needs ports below 64.
+ *
+ * A struct snoop is not thread-safe; its owner serializes calls.
+ */
+
+#ifndef SNOOP_H
+#define SNOOP_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/** Timer resolution. */
+#define SNOOP_TICK_MS        100
+/** Group membership interval (RFC 3376 8.4 / RFC 3810 9.4 defaults). */
+#define SNOOP_MEMBER_MS      260000
+/** Other querier present interval (RFC 3376 8.5). */
+#define SNOOP_ROUTER_MS      255000
+/** Last member query time (RFC 3376 8.8). */
+#define SNOOP_LEAVE_MS       2000
+/** Groups tracked over all VLANs. */
+#define SNOOP_MAX_GROUPS     8192
+
+/** A multicast group in a VLAN. */
+struct snoop_key
+{
+    uint16_t vid;
+    uint8_t  family;             /**< AF_INET or AF_INET6 */
+    uint8_t  addr[16];           /**< IPv4 groups in the first 4 bytes */
+};
+
+enum snoop_op
+{
+    SNOOP_JOIN,                  /**< @c port joined group @c k */
+    SNOOP_PRUNE,                 /**< @c port left group @c k */
+    SNOOP_ROUTER_ADD,            /**< @c port became a router port of @c k->vid */
+    SNOOP_ROUTER_DEL,            /**< ... and stopped being one */
+};
+
+/** Change callback; for router changes only @p k->vid is set. */
+typedef void (*snoop_change_fn)(enum snoop_op op, const struct snoop_key *k, int port, void *arg);
+
+/** snoop_walk() callback; @p k is NULL for a router port. */
+typedef void (*snoop_walk_fn)(uint16_t vid, const struct snoop_key *k, int port,
+                              uint64_t expires_ms, void *arg);
+
+/** Classification of a frame by snoop_classify(). */
+#define SNOOP_OTHER          0   /**< not multicast IP, or link-local: flood */
+#define SNOOP_DATA           1   /**< multicast IP data for a trackable group */
+#define SNOOP_CONTROL        2   /**< IGMP or MLD: feed to snoop_rx(), flood */
+
+struct snoop_stats
+{
+    uint64_t queries;
+    uint64_t reports;            /**< v1/v2 reports and v3 records that join */
+    uint64_t leaves;             /**< leaves, dones and records that leave */
+    uint64_t invalid;            /**< truncated or bad checksum */
+    uint64_t full;               /**< joins refused at SNOOP_MAX_GROUPS */
+    unsigned groups;
+    unsigned members;            /**< (group, port) pairs */
+    unsigned routers;            /**< (VLAN, port) pairs */
+};
+
+struct snoop;
+struct snoop_table;
+
+struct snoop *snoop_create(uint64_t now_ms, snoop_change_fn fn, void *arg);
+void snoop_destroy(struct snoop *s);
+int  snoop_vlan_enable(struct snoop *s, uint16_t vid, int on);
+int  snoop_vlan_enabled(const struct snoop *s, uint16_t vid);
+int  snoop_rx(struct snoop *s, uint16_t vid, int port, const uint8_t *frame, size_t len,
+              uint64_t now_ms);
+void snoop_port_down(struct snoop *s, int port);
+unsigned snoop_tick(struct snoop *s, uint64_t now_ms);
+int  snoop_walk(const struct snoop *s, uint64_t now_ms, snoop_walk_fn fn, void *arg);
+void snoop_get_stats(const struct snoop *s, struct snoop_stats *st);
+
+int  snoop_classify(const uint8_t *frame, size_t len, uint16_t vid, struct snoop_key *k);
+
+struct snoop_table *snoop_compile(const struct snoop *s);
+uint64_t snoop_lookup(const struct snoop_table *t, const struct snoop_key *k);
+void snoop_table_free(struct snoop_table *t);
+
+#endif /* SNOOP_H */
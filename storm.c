@@ -0,0 +1,126 @@
+/**
+ * @file storm.c
+ * @brief GCRA token buckets for storm control (see storm.h).
+ */
+
+#include <errno.h>
+#include <string.h>
+
+#include "storm.h"
+
+static const char *const g_class_names[STORM_NCLASSES] =
+{
+    [STORM_BCAST]   = "broadcast",
+    [STORM_MCAST]   = "multicast",
+    [STORM_UNKNOWN] = "unknown-unicast",
+};
+
+/**
+ * storm_class_name() - CLI name of traffic class @p cls.
+ */
+const char *storm_class_name(unsigned cls)
+{
+    return cls < STORM_NCLASSES ? g_class_names[cls] : "?";
+}
+
+/**
+ * storm_class_parse() - Traffic class named @p name, or -EINVAL.
+ */
+int storm_class_parse(const char *name)
+{
+    unsigned c;
+
+    for (c = 0; c < STORM_NCLASSES; c++)
+    {
+        if (strcmp(name, g_class_names[c]) == 0)
+            return (int)c;
+    }
+    return -EINVAL;
+}
+
+/**
+ * storm_tb_set() - (Re)configure bucket @p tb; NULL or a zero rate turns
+ * it off.
+ *
+ * May be called while readers use the bucket: they see the old or the new
+ * parameters, and the bucket starts full.  The drop counter restarts when
+ * a bucket that was off is turned on.
+ *
+ * @return 0, or -EINVAL for a zero burst, a rate above 1 frame/ns or
+ *         100 Tbit/s, or a byte burst below 64.
+ */
+int storm_tb_set(struct storm_tb *tb, const struct storm_rate *r)
+{
+    uint64_t ivl;
+
+    if (!r || r->rate == 0)
+    {
+        __atomic_store_n(&tb->ivl, 0, __ATOMIC_RELAXED);
+        return 0;
+    }
+    if (r->burst == 0 || (r->bytes && r->burst < 64) ||
+        r->rate > (r->bytes ? 100000000000ull : 1000000000ull))
+        return -EINVAL;
+
+    /* ns per packet, or 8e6 / kbit/s ns per byte, in 16.16 fixed point. */
+    ivl = ((r->bytes ? 8000000ull : 1000000000ull) << 16) / r->rate;
+    if (ivl == 0)
+        ivl = 1;
+
+    if (__atomic_load_n(&tb->ivl, __ATOMIC_RELAXED) == 0)
+        __atomic_store_n(&tb->drops, 0, __ATOMIC_RELAXED);
+    __atomic_store_n(&tb->bytes, r->bytes, __ATOMIC_RELAXED);
+    __atomic_store_n(&tb->tau, ((uint64_t)r->burst * ivl) >> 16, __ATOMIC_RELAXED);
+    __atomic_store_n(&tb->tat, 0, __ATOMIC_RELAXED);
+    __atomic_store_n(&tb->ivl, ivl, __ATOMIC_RELEASE);
+    return 0;
+}
+
+/**
+ * storm_tb_claim() - Meter @p n frames of lengths @p len[] arriving at
+ * @p now (ns, CLOCK_MONOTONIC).
+ *
+ * Frames are taken in order; one that does not conform consumes nothing,
+ * so a smaller frame after it may still pass.  Non-conforming frames are
+ * added to the bucket's drop counter.
+ *
+ * @return the mask of frames that conform; all of them if the bucket is off.
+ */
+uint64_t storm_tb_claim(struct storm_tb *tb, uint64_t now, const uint32_t *len, unsigned n)
+{
+    uint64_t ivl = __atomic_load_n(&tb->ivl, __ATOMIC_ACQUIRE);
+    uint64_t tau = __atomic_load_n(&tb->tau, __ATOMIC_RELAXED);
+    int bytes = __atomic_load_n(&tb->bytes, __ATOMIC_RELAXED);
+    uint64_t tat = __atomic_load_n(&tb->tat, __ATOMIC_RELAXED);
+    uint64_t pass;
+    unsigned i, dropped;
+
+    if (ivl == 0)
+        return n >= 64 ? ~0ull : (1ull << n) - 1;
+
+    for (;;)
+    {
+        uint64_t t = tat > now ? tat : now;
+
+        pass = 0;
+        for (i = 0; i < n; i++)
+        {
+            uint64_t inc = ((bytes ? len[i] : 1) * ivl) >> 16;
+
+            if (t + inc - now <= tau)
+            {
+                t += inc;
+                pass |= 1ull << i;
+            }
+        }
+        /* On a lost race tat is reloaded and the burst decided again. */
+        if (!pass || __atomic_compare_exchange_n(&tb->tat, &tat, t, 0,
+                                                 __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+            break;
+    }
+
+    dropped = n - (unsigned)__builtin_popcountll(pass);
+    if (dropped)
+        __atomic_add_fetch(&tb->drops, dropped, __ATOMIC_RELAXED);
+    return pass;
+}
@@ -0,0 +1,63 @@
+/**
+ * @file storm.h
+ * @brief Storm control: lock-free token buckets for broadcast, multicast and
+ *        unknown-unicast traffic.
+ *
+ * A bucket is a GCRA (virtual scheduling) meter, equivalent to a token
+ * bucket of depth @c burst filled at @c rate, kept as one 64-bit word: the
+ * theoretical arrival time (TAT) of the next frame.  A frame of cost c
+ * conforms if max(TAT, now) + c * T - now <= burst * T, with T the time one
+ * packet (or one byte) is worth at the configured rate, and then moves TAT
+ * forward by c * T.  storm_tb_claim() decides a whole burst against one
+ * snapshot of TAT and publishes the result with a single compare-and-swap,
+ * so several workers can share a bucket without a lock and at the cost of
+ * one atomic operation per burst rather than per frame.
+ *
+ * A rate is either in packets per second or, with @c bytes set, in kbit/s
+ * with a burst in bytes.
+ */
+
+#ifndef STORM_H
+#define STORM_H
+
+#include <stdint.h>
+
+/** Traffic classes storm control meters separately. */
+enum storm_class
+{
+    STORM_BCAST,        /**< destination ff:ff:ff:ff:ff:ff */
+    STORM_MCAST,        /**< other group destinations */
+    STORM_UNKNOWN,      /**< unicast destinations not in the FDB */
+    STORM_NCLASSES
+};
+
+/** Configured rate of one bucket; @c rate 0 disables it. */
+struct storm_rate
+{
+    uint64_t rate;      /**< packets/s, or kbit/s if @c bytes */
+    uint32_t burst;     /**< packets, or bytes if @c bytes */
+    uint8_t  bytes;
+};
+
+struct storm_tb
+{
+    uint64_t tat;       /* theoretical arrival time, ns */
+    uint64_t ivl;       /* ns per packet or byte, 16.16 fixed point; 0: off */
+    uint64_t tau;       /* bucket depth, ns */
+    uint64_t drops;     /* frames that did not conform */
+    uint8_t  bytes;     /* cost of a frame is its length */
+};
+
+/** Nonzero if @p tb is metering; lets callers skip collecting a burst. */
+static inline int storm_tb_on(const struct storm_tb *tb)
+{
+    return __atomic_load_n(&tb->ivl, __ATOMIC_RELAXED) != 0;
+}
+
+const char *storm_class_name(unsigned cls);
+int  storm_class_parse(const char *name);
+
+int  storm_tb_set(struct storm_tb *tb, const struct storm_rate *r);
+uint64_t storm_tb_claim(struct storm_tb *tb, uint64_t now, const uint32_t *len, unsigned n);
+
+#endif /* STORM_H */
@@ -0,0 +1,619 @@
+/**
+ * @file tc_storm.c
+ * @brief Kernel tc police actions for storm control (see tc_storm.h).
+ *
+ * The configured rates are kept here per port and per VLAN; every change
+ * re-renders the affected ports from them.  Rendering a port deletes its
+ * four storm filters (chains 0 and 1, priorities 2 and 3) and adds back
+ * what the port's own and its VLAN's configuration need:
+ *
+ *   chain 0, prio 2  dst ff:ff:ff:ff:ff:ff  [police port bcast] -> next
+ *   chain 0, prio 3  dst 01:00:00:00:00:00/01:00:00:00:00:00
+ *                                           [police port mcast] -> next
+ *   chain 1, prio 2  broadcast              [police VLAN bcast] -> ok
+ *   chain 1, prio 3  multicast              [police VLAN mcast] -> ok
+ *
+ * where "next" is "goto chain 1" if the VLAN has policers and "ok"
+ * otherwise, and a class without a policer of its own still gets its
+ * filter (with a gact action only) so that broadcast never falls through
+ * to the multicast filter.  Police actions drop what exceeds the rate and
+ * pipe the rest to the next action.  Every police action has a fixed
+ * index derived from the port's ifindex or the VLAN ID, which is how the
+ * VLAN's action is shared between member ports and how drop counters are
+ * read back.  The requests of one change go out as one nl_batch.h batch,
+ * all deletes before all adds, so a shared action is recreated with the
+ * new rate rather than reused.  Priority 1 of chain 0 belongs to VLAN
+ * translation (tc_xlate.h), whose filters continue to these.
+ */
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <arpa/inet.h>
+#include <linux/if_ether.h>
+#include <linux/gen_stats.h>
+#include <linux/pkt_cls.h>
+#include <linux/pkt_sched.h>
+#include <linux/rtnetlink.h>
+#include <linux/tc_act/tc_gact.h>
+#include <netlink/attr.h>
+#include <netlink/msg.h>
+#include <netlink/netlink.h>
+#include <netlink/socket.h>
+
+#include "nl_batch.h"
+#include "tc_storm.h"
+#include "tc_xlate.h"   /* TC_XLATE_PRIO */
+#include "vlan_api.h"    /* NL_CALL_RET */
+#include "vlan_state.h"
+
+/** Ports with a port-level policer at the same time. */
+#define TC_STORM_MAX_PORTS  256
+/** Classes the kernel can meter: broadcast and multicast. */
+#define TC_NCLASSES         2
+/** Priority of the broadcast filters, multicast the next one. */
+#define TC_STORM_PRIO       (TC_XLATE_PRIO + 1)
+
+/* Police action indexes: port ifindex or VLAN ID, times 4, plus class. */
+#define TC_INDEX_PORT       0x40000000u
+#define TC_INDEX_VLAN       0x3F000000u
+
+struct tc_port
+{
+    int               ifindex;
+    char              name[IFNAMSIZ];
+    struct storm_rate r[TC_NCLASSES];
+};
+
+struct tc_vlan
+{
+    struct storm_rate r[TC_NCLASSES];
+    int              *members;      /* ports rendered with this VLAN's policers */
+    unsigned          nmembers;
+};
+
+static pthread_mutex_t g_tc_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct tc_port  g_tc_ports[TC_STORM_MAX_PORTS];
+static struct tc_vlan  g_tc_vlans[VLAN_ID_SPACE];
+
+/* ---------------------------------------------------------------------------
+ * Helpers
+ * --------------------------------------------------------------------------- */
+
+static int rates_any(const struct storm_rate *r)
+{
+    return r[0].rate || r[1].rate;
+}
+
+static struct tc_port *port_find(int ifindex)
+{
+    unsigned i;
+
+    for (i = 0; i < TC_STORM_MAX_PORTS; i++)
+    {
+        if (g_tc_ports[i].ifindex == ifindex)
+            return &g_tc_ports[i];
+    }
+    return NULL;
+}
+
+/* Nanoseconds to psched ticks (PSCHED_SHIFT is 6). */
+static uint64_t ns_ticks(uint64_t ns)
+{
+    return ns >> 6;
+}
+
+static struct nl_msg *tc_msg(int type, int flags, int ifindex, uint32_t parent,
+                             uint32_t handle, uint32_t info)
+{
+    struct tcmsg t;
+    struct nl_msg *m = nlmsg_alloc_simple(type, flags);
+
+    if (!m)
+        return NULL;
+    memset(&t, 0, sizeof(t));
+    t.tcm_family  = AF_UNSPEC;
+    t.tcm_ifindex = ifindex;
+    t.tcm_parent  = parent;
+    t.tcm_handle  = handle;
+    t.tcm_info    = info;
+    if (nlmsg_append(m, &t, sizeof(t), NLMSG_ALIGNTO) < 0)
+    {
+        nlmsg_free(m);
+        return NULL;
+    }
+    return m;
+}
+
+static struct nl_msg *filter_msg(int type, int flags, int ifindex, uint32_t chain, unsigned prio)
+{
+    struct nl_msg *m = tc_msg(type, flags, ifindex, TC_H_MAKE(TC_H_CLSACT, TC_H_MIN_INGRESS),
+                              0, TC_H_MAKE((uint32_t)prio << 16, htons(ETH_P_ALL)));
+
+    if (m && nla_put_u32(m, TCA_CHAIN, chain) < 0)
+    {
+        nlmsg_free(m);
+        return NULL;
+    }
+    return m;
+}
+
+/* The options of a police action of @p index metering at @p r. */
+static int put_police(struct nl_msg *m, uint32_t index, const struct storm_rate *r)
+{
+    struct tc_police p;
+
+    memset(&p, 0, sizeof(p));
+    p.index  = index;
+    p.action = TC_ACT_SHOT;
+    if (r->bytes)
+    {
+        uint64_t bps = r->rate * 1000 / 8;      /* bytes per second */
+        uint32_t rtab[256];
+        unsigned i;
+
+        p.rate.rate      = bps >= 0xFFFFFFFFull ? 0xFFFFFFFFu : (uint32_t)bps;
+        p.rate.cell_log  = 9;                   /* 255 << 9 covers 64K frames */
+        p.rate.cell_align = -1;
+        p.rate.linklayer = TC_LINKLAYER_ETHERNET;
+        p.burst = (uint32_t)ns_ticks((uint64_t)r->burst * 1000000000ull / bps);
+        for (i = 0; i < 256; i++)
+            rtab[i] = (uint32_t)ns_ticks(((uint64_t)(i + 1) << 9) * 1000000000ull / bps);
+        if (nla_put(m, TCA_POLICE_RATE, sizeof(rtab), rtab) < 0)
+            return -ENOMEM;
+        if (bps >= 0xFFFFFFFFull && nla_put_u64(m, TCA_POLICE_RATE64, bps) < 0)
+            return -ENOMEM;
+    }
+    else if (nla_put_u64(m, TCA_POLICE_PKTRATE64, r->rate) < 0 ||
+             nla_put_u64(m, TCA_POLICE_PKTBURST64,
+                         ns_ticks((uint64_t)r->burst * 1000000000ull / r->rate)) < 0)
+        return -ENOMEM;
+
+    if (nla_put(m, TCA_POLICE_TBF, sizeof(p), &p) < 0 ||
+        nla_put_u32(m, TCA_POLICE_RESULT, TC_ACT_PIPE) < 0)
+        return -ENOMEM;
+    return 0;
+}
+
+/*
+ * filter_add() - Flower filter for class @p cls: police at @p r with
+ * action index @p index (no police action if @p r is off), then @p verdict.
+ */
+static struct nl_msg *filter_add(int ifindex, uint32_t chain, unsigned cls,
+                                 const struct storm_rate *r, uint32_t index, int verdict)
+{
+    static const uint8_t bcast[6] = { 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF };
+    static const uint8_t group[6] = { 0x01, 0, 0, 0, 0, 0 };
+    const uint8_t *key = cls == STORM_BCAST ? bcast : group;
+    struct nl_msg *m = filter_msg(RTM_NEWTFILTER, NLM_F_CREATE | NLM_F_EXCL, ifindex, chain,
+                                  TC_STORM_PRIO + cls);
+    struct tc_gact g;
+    struct nlattr *opts, *acts, *act, *aopts;
+    int prio = 1;
+
+    if (!m)
+        return NULL;
+    memset(&g, 0, sizeof(g));
+    g.action = verdict;
+
+    if (nla_put_string(m, TCA_KIND, "flower") < 0 ||
+        !(opts = nla_nest_start(m, TCA_OPTIONS)) ||
+        nla_put(m, TCA_FLOWER_KEY_ETH_DST, 6, key) < 0 ||
+        nla_put(m, TCA_FLOWER_KEY_ETH_DST_MASK, 6, key) < 0 ||
+        !(acts = nla_nest_start(m, TCA_FLOWER_ACT)))
+        goto fail;
+    if (r->rate)
+    {
+        if (!(act = nla_nest_start(m, prio++)) ||
+            nla_put_string(m, TCA_ACT_KIND, "police") < 0 ||
+            !(aopts = nla_nest_start(m, TCA_ACT_OPTIONS)) ||
+            put_police(m, index, r) < 0)
+            goto fail;
+        nla_nest_end(m, aopts);
+        nla_nest_end(m, act);
+    }
+    if (!(act = nla_nest_start(m, prio)) ||
+        nla_put_string(m, TCA_ACT_KIND, "gact") < 0 ||
+        !(aopts = nla_nest_start(m, TCA_ACT_OPTIONS)) ||
+        nla_put(m, TCA_GACT_PARMS, sizeof(g), &g) < 0)
+        goto fail;
+    nla_nest_end(m, aopts);
+    nla_nest_end(m, act);
+    nla_nest_end(m, acts);
+    nla_nest_end(m, opts);
+    return m;
+
+fail:
+    nlmsg_free(m);
+    return NULL;
+}
+
+/* ---------------------------------------------------------------------------
+ * Rendering
+ * --------------------------------------------------------------------------- */
+
+/* Requests of one change; only the filter adds report a status. */
+struct render
+{
+    struct nl_batch *nl;
+    int             *status;
+    unsigned         n;
+    int              err;
+};
+
+static int render_begin(struct render *rd, unsigned nports)
+{
+    memset(rd, 0, sizeof(*rd));
+    rd->nl = nl_batch_alloc();
+    rd->status = calloc(nports * 2 * TC_NCLASSES + 1, sizeof(int));
+    if (!rd->nl || !rd->status)
+    {
+        nl_batch_free(rd->nl);
+        free(rd->status);
+        return -ENOMEM;
+    }
+    return 0;
+}
+
+static void queue(struct render *rd, struct nl_msg *m, int checked)
+{
+    int *status = NULL;
+
+    if (rd->err)
+    {
+        nlmsg_free(m);
+        return;
+    }
+    if (!m)
+    {
+        rd->err = -ENOMEM;
+        return;
+    }
+    if (checked)
+        status = &rd->status[rd->n++];
+    rd->err = nl_batch_add(rd->nl, m, status);
+}
+
+/* Delete the storm filters of port @p ifindex; absent ones are fine. */
+static void render_delete(struct render *rd, int ifindex)
+{
+    unsigned chain, cls;
+
+    for (chain = 0; chain < 2; chain++)
+    {
+        for (cls = 0; cls < TC_NCLASSES; cls++)
+            queue(rd, filter_msg(RTM_DELTFILTER, 0, ifindex, chain, TC_STORM_PRIO + cls), 0);
+    }
+}
+
+static struct nl_msg *clsact_msg(int ifindex)
+{
+    struct nl_msg *m = tc_msg(RTM_NEWQDISC, NLM_F_CREATE | NLM_F_EXCL, ifindex,
+                              TC_H_CLSACT, TC_H_MAKE(TC_H_CLSACT, 0), 0);
+
+    if (m && nla_put_string(m, TCA_KIND, "clsact") < 0)
+    {
+        nlmsg_free(m);
+        return NULL;
+    }
+    return m;
+}
+
+/* Add the filters of port @p ifindex, a member of VLAN @p vid (0: none). */
+static void render_add(struct render *rd, int ifindex, int vid)
+{
+    static const struct storm_rate off[TC_NCLASSES];
+    const struct tc_port *p = port_find(ifindex);
+    const struct storm_rate *pr = p ? p->r : off;
+    const struct storm_rate *vr = NULL;
+    int next = TC_ACT_OK;
+    unsigned cls;
+
+    if (vid > 0 && vid < VLAN_ID_SPACE && rates_any(g_tc_vlans[vid].r))
+    {
+        vr = g_tc_vlans[vid].r;
+        next = TC_ACT_GOTO_CHAIN | 1;
+    }
+    if (!rates_any(pr) && !vr)
+        return;
+
+    /* Fails with EEXIST if the port already has one. */
+    queue(rd, clsact_msg(ifindex), 0);
+    for (cls = 0; cls < TC_NCLASSES; cls++)
+        queue(rd, filter_add(ifindex, 0, cls, &pr[cls],
+                             TC_INDEX_PORT + (uint32_t)ifindex * 4 + cls, next), 1);
+    for (cls = 0; vr && cls < TC_NCLASSES; cls++)
+        queue(rd, filter_add(ifindex, 1, cls, &vr[cls],
+                             TC_INDEX_VLAN + (uint32_t)vid * 4 + cls, TC_ACT_OK), 1);
+}
+
+/* Send the batch; the first failed filter add, if any, is the result. */
+static int render_commit(struct render *rd)
+{
+    unsigned i;
+    int err = rd->err;
+    int _nl_err;
+
+    NL_CALL_RET(_nl_err, nl_batch_commit(rd->nl), "nl_batch_commit", "batch=%p, filters=%u",
+                (void *)rd->nl, rd->n);
+    (void)_nl_err;
+    for (i = 0; i < rd->n && err == 0; i++)
+        err = rd->status[i];
+    nl_batch_free(rd->nl);
+    free(rd->status);
+    return err;
+}
+
+/* Current Vlan<id> membership of @p ifindex, 0 if none. */
+static int member_vlan(const struct vlan_snapshot *snap, int ifindex)
+{
+    const struct vs_link *l = snap ? vlan_snapshot_find_index(snap, ifindex) : NULL;
+
+    return l ? l->member_vlan : 0;
+}
+
+/* ---------------------------------------------------------------------------
+ * Public API
+ * --------------------------------------------------------------------------- */
+
+static int rate_check(unsigned cls, const struct storm_rate *r)
+{
+    struct storm_tb tb;
+
+    if (cls == STORM_UNKNOWN)
+        return -EOPNOTSUPP;
+    if (cls >= TC_NCLASSES)
+        return -EINVAL;
+    memset(&tb, 0, sizeof(tb));
+    return storm_tb_set(&tb, r);
+}
+
+/**
+ * tc_storm_port() - Police class @p cls on the ingress of port @p iface at
+ * @p r, or stop policing it if @p r is NULL or has a zero rate.
+ *
+ * The port's VLAN policers, if any, are re-applied along with it.
+ *
+ * @return
+ *    0           – success. \n
+ *   -EINVAL      – bad class or rate (see storm_tb_set()). \n
+ *   -EOPNOTSUPP  – unknown unicast, which the kernel cannot meter. \n
+ *   -ENODEV      – no such interface. \n
+ *   -ENOSPC      – TC_STORM_MAX_PORTS ports are policed already. \n
+ *   -errno       – the kernel refused a filter (-ENOENT: no flower
+ *                  classifier or police action in this kernel); the
+ *                  previous rate is kept.
+ */
+int tc_storm_port(const char *iface, unsigned cls, const struct storm_rate *r)
+{
+    const struct vlan_snapshot *snap;
+    static const struct storm_rate off;
+    struct storm_rate old;
+    struct tc_port *p;
+    struct render rd;
+    int ifindex;
+    int err;
+
+    if (!iface)
+        return -EINVAL;
+    if ((err = rate_check(cls, r)) < 0)
+        return err;
+    if ((ifindex = vlan_state_lookup_ifindex(iface)) <= 0)
+        return -ENODEV;
+
+    pthread_mutex_lock(&g_tc_lock);
+    if ((p = port_find(ifindex)) == NULL)
+    {
+        if (!r || r->rate == 0)
+        {
+            pthread_mutex_unlock(&g_tc_lock);
+            return 0;
+        }
+        if ((p = port_find(0)) == NULL)
+        {
+            pthread_mutex_unlock(&g_tc_lock);
+            return -ENOSPC;
+        }
+        memset(p, 0, sizeof(*p));
+        p->ifindex = ifindex;
+        snprintf(p->name, sizeof(p->name), "%s", iface);
+    }
+    old = p->r[cls];
+    p->r[cls] = r ? *r : off;
+
+    err = render_begin(&rd, 1);
+    if (err == 0)
+    {
+        snap = vlan_state_read_begin();
+        render_delete(&rd, ifindex);
+        render_add(&rd, ifindex, member_vlan(snap, ifindex));
+        vlan_state_read_end();
+        err = render_commit(&rd);
+    }
+    if (err < 0)
+        p->r[cls] = old;
+    if (!rates_any(p->r))
+        p->ifindex = 0;
+    pthread_mutex_unlock(&g_tc_lock);
+    return err;
+}
+
+/**
+ * tc_storm_vlan() - Police the aggregate class @p cls ingress of the member
+ * ports of Vlan<@p vid> at @p r, or stop if @p r is NULL or has a zero rate.
+ *
+ * Ports that left the VLAN since the last change lose its policers; ports
+ * that join later get them with the next change of the VLAN or the port.
+ *
+ * @return as tc_storm_port(), -EINVAL for a VLAN ID outside [1..4094].
+ */
+int tc_storm_vlan(uint16_t vid, unsigned cls, const struct storm_rate *r)
+{
+    static const struct storm_rate off;
+    const struct vlan_snapshot *snap;
+    struct storm_rate old;
+    struct tc_vlan *v;
+    struct render rd;
+    int *members = NULL;
+    unsigned nmembers = 0;
+    unsigned i;
+    int err;
+
+    if (vid < 1 || vid > 4094)
+        return -EINVAL;
+    if ((err = rate_check(cls, r)) < 0)
+        return err;
+
+    pthread_mutex_lock(&g_tc_lock);
+    v = &g_tc_vlans[vid];
+    old = v->r[cls];
+    v->r[cls] = r ? *r : off;
+
+    snap = vlan_state_read_begin();
+    for (i = 0; snap && i < snap->nlinks; i++)
+        nmembers += snap->links[i].member_vlan == vid;
+    members = malloc((nmembers ? nmembers : 1) * sizeof(*members));
+    if (!members || render_begin(&rd, nmembers + v->nmembers) < 0)
+    {
+        vlan_state_read_end();
+        free(members);
+        v->r[cls] = old;
+        pthread_mutex_unlock(&g_tc_lock);
+        return -ENOMEM;
+    }
+    nmembers = 0;
+    for (i = 0; snap && i < snap->nlinks; i++)
+    {
+        if (snap->links[i].member_vlan == vid)
+            members[nmembers++] = snap->links[i].ifindex;
+    }
+
+    /* Deletes first, so that the shared actions are recreated. */
+    for (i = 0; i < v->nmembers; i++)
+        render_delete(&rd, v->members[i]);
+    for (i = 0; i < nmembers; i++)
+        render_delete(&rd, members[i]);
+    for (i = 0; i < v->nmembers; i++)
+        render_add(&rd, v->members[i], member_vlan(snap, v->members[i]));
+    for (i = 0; i < nmembers; i++)
+        render_add(&rd, members[i], vid);
+    vlan_state_read_end();
+    err = render_commit(&rd);
+    if (err < 0)
+        v->r[cls] = old;
+
+    free(v->members);
+    v->members = rates_any(v->r) ? members : NULL;
+    v->nmembers = rates_any(v->r) ? nmembers : 0;
+    if (!v->members)
+        free(members);
+    pthread_mutex_unlock(&g_tc_lock);
+    return err;
+}
+
+/* Drops of the police action read back by action_drops(). */
+static int on_action(struct nl_msg *msg, void *arg)
+{
+    struct nlattr *tb[TCA_ROOT_MAX + 1];
+    struct nlattr *acts[TCA_ACT_MAX_PRIO + 1];
+    struct nlattr *act[TCA_ACT_MAX + 1];
+    struct nlattr *st[TCA_STATS_MAX + 1];
+    struct gnet_stats_queue q;
+
+    if (nlmsg_parse(nlmsg_hdr(msg), sizeof(struct tcamsg), tb, TCA_ROOT_MAX, NULL) < 0 ||
+        !tb[TCA_ACT_TAB] ||
+        nla_parse_nested(acts, TCA_ACT_MAX_PRIO, tb[TCA_ACT_TAB], NULL) < 0 || !acts[1] ||
+        nla_parse_nested(act, TCA_ACT_MAX, acts[1], NULL) < 0 || !act[TCA_ACT_STATS] ||
+        nla_parse_nested(st, TCA_STATS_MAX, act[TCA_ACT_STATS], NULL) < 0 ||
+        !st[TCA_STATS_QUEUE])
+        return NL_SKIP;
+
+    memset(&q, 0, sizeof(q));
+    memcpy(&q, nla_data(st[TCA_STATS_QUEUE]),
+           nla_len(st[TCA_STATS_QUEUE]) < (int)sizeof(q) ? (size_t)nla_len(st[TCA_STATS_QUEUE]) : sizeof(q));
+    *(uint64_t *)arg = q.drops;
+    return NL_OK;
+}
+
+/* Frames dropped by police action @p index, 0 if it cannot be read. */
+static uint64_t action_drops(struct nl_sock *sock, uint32_t index)
+{
+    struct tcamsg t;
+    struct nl_msg *m = nlmsg_alloc_simple(RTM_GETACTION, 0);
+    struct nlattr *tab, *act;
+    uint64_t drops = 0;
+
+    if (!m)
+        return 0;
+    memset(&t, 0, sizeof(t));
+    t.tca_family = AF_UNSPEC;
+    if (nlmsg_append(m, &t, sizeof(t), NLMSG_ALIGNTO) < 0 ||
+        !(tab = nla_nest_start(m, TCA_ACT_TAB)) ||
+        !(act = nla_nest_start(m, 1)) ||
+        nla_put_string(m, TCA_ACT_KIND, "police") < 0 ||
+        nla_put_u32(m, TCA_ACT_INDEX, index) < 0)
+    {
+        nlmsg_free(m);
+        return 0;
+    }
+    nla_nest_end(m, act);
+    nla_nest_end(m, tab);
+
+    nl_socket_modify_cb(sock, NL_CB_VALID, NL_CB_CUSTOM, on_action, &drops);
+    if (nl_send_auto(sock, m) >= 0)
+        nl_recvmsgs_default(sock);
+    nlmsg_free(m);
+    return drops;
+}
+
+/**
+ * tc_storm_walk() - Pass every configured policer and its kernel drop
+ * counter to @p fn: ports first, then VLANs.
+ *
+ * @return the number of policers, or -ENOMEM if no Netlink socket could
+ *         be opened.
+ */
+int tc_storm_walk(tc_storm_fn fn, void *arg)
+{
+    struct nl_sock *sock = nl_socket_alloc();
+    unsigned i, cls;
+    int n = 0;
+
+    if (!sock || nl_connect(sock, NETLINK_ROUTE) < 0)
+    {
+        nl_socket_free(sock);
+        return -ENOMEM;
+    }
+
+    pthread_mutex_lock(&g_tc_lock);
+    for (i = 0; i < TC_STORM_MAX_PORTS; i++)
+    {
+        const struct tc_port *p = &g_tc_ports[i];
+
+        for (cls = 0; p->ifindex && cls < TC_NCLASSES; cls++)
+        {
+            if (!p->r[cls].rate)
+                continue;
+            fn(p->name, 0, cls, &p->r[cls],
+               action_drops(sock, TC_INDEX_PORT + (uint32_t)p->ifindex * 4 + cls), arg);
+            n++;
+        }
+    }
+    for (i = 1; i < VLAN_ID_SPACE; i++)
+    {
+        for (cls = 0; cls < TC_NCLASSES; cls++)
+        {
+            if (!g_tc_vlans[i].r[cls].rate)
+                continue;
+            fn(NULL, (uint16_t)i, cls, &g_tc_vlans[i].r[cls],
+               action_drops(sock, TC_INDEX_VLAN + i * 4 + cls), arg);
+            n++;
+        }
+    }
+    pthread_mutex_unlock(&g_tc_lock);
+
+    nl_socket_free(sock);
+    return n;
+}
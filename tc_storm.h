@@ -0,0 +1,34 @@
+/**
+ * @file tc_storm.h
+ * @brief Storm control on the kernel bridge backend, as tc police actions.
+ *
+ * Without the user-space forwarding plane the Vlan<id> bridges forward in
+ * the kernel, and storm control is programmed as the equivalent kernel
+ * policers: a clsact qdisc on every affected port, flower filters on the
+ * destination MAC and "police" actions on its ingress.  Chain 0 holds the
+ * port's own policers, chain 1 those of the port's VLAN; the VLAN policer
+ * of a class is one action shared by the filters of every member port, so
+ * it meters the VLAN's aggregate.  Broadcast is matched before multicast
+ * so that the two classes stay disjoint, as on the forwarding plane.
+ *
+ * The kernel cannot tell unknown from known unicast at ingress, so that
+ * class is refused with -EOPNOTSUPP.  A VLAN policer covers the VLAN's
+ * member ports at the time it is (re)configured.
+ */
+
+#ifndef TC_STORM_H
+#define TC_STORM_H
+
+#include <stdint.h>
+
+#include "storm.h"
+
+/** tc_storm_walk() callback; @p iface is NULL for a VLAN policer. */
+typedef void (*tc_storm_fn)(const char *iface, uint16_t vid, unsigned cls,
+                            const struct storm_rate *rate, uint64_t drops, void *arg);
+
+int  tc_storm_port(const char *iface, unsigned cls, const struct storm_rate *r);
+int  tc_storm_vlan(uint16_t vid, unsigned cls, const struct storm_rate *r);
+int  tc_storm_walk(tc_storm_fn fn, void *arg);
+
+#endif /* TC_STORM_H */
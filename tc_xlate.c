@@ -0,0 +1,315 @@
+/**
+ * @file tc_xlate.c
+ * @brief Kernel tc vlan modify actions for VLAN translation (see tc_xlate.h).
+ *
+ * The mappings are kept here in one vlan_xlate.h table per port, which
+ * checks a change before anything reaches the kernel.  Each mapping C <-> N
+ * is rendered as
+ *
+ *   ingress, chain 0, prio 1, handle C  vlan_id C  [vlan modify id N] -> continue
+ *   egress,  chain 0, prio 1, handle N  vlan_id N  [vlan modify id C] -> continue
+ *
+ * so a filter is found again by its handle, the VID it matches.  The
+ * requests of one change go out as one nl_batch.h batch: the filters of
+ * the mappings it replaces are deleted before the new ones are added.
+ */
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <arpa/inet.h>
+#include <net/if.h>
+#include <linux/if_ether.h>
+#include <linux/pkt_cls.h>
+#include <linux/pkt_sched.h>
+#include <linux/rtnetlink.h>
+#include <linux/tc_act/tc_vlan.h>
+#include <netlink/attr.h>
+#include <netlink/msg.h>
+#include <netlink/netlink.h>
+
+#include "nl_batch.h"
+#include "tc_xlate.h"
+#include "vlan_api.h"    /* NL_CALL_RET */
+#include "vlan_state.h"
+#include "vlan_xlate.h"
+
+/** Ports with mappings at the same time. */
+#define TC_XLATE_MAX_PORTS  256
+
+struct tc_xport
+{
+    int               ifindex;
+    char              name[IFNAMSIZ];
+    struct vlan_xlate x;
+};
+
+/* Ports with mappings, allocated with the first one and freed with the last. */
+static pthread_mutex_t  g_xl_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct tc_xport *g_xports[TC_XLATE_MAX_PORTS];
+
+/* ---------------------------------------------------------------------------
+ * Helpers
+ * --------------------------------------------------------------------------- */
+
+static struct tc_xport **port_find(int ifindex)
+{
+    unsigned i;
+
+    for (i = 0; i < TC_XLATE_MAX_PORTS; i++)
+    {
+        if (ifindex ? g_xports[i] && g_xports[i]->ifindex == ifindex : !g_xports[i])
+            return &g_xports[i];
+    }
+    return NULL;
+}
+
+static struct nl_msg *tc_msg(int type, int flags, int ifindex, uint32_t parent,
+                             uint32_t handle, uint32_t info)
+{
+    struct tcmsg t;
+    struct nl_msg *m = nlmsg_alloc_simple(type, flags);
+
+    if (!m)
+        return NULL;
+    memset(&t, 0, sizeof(t));
+    t.tcm_family  = AF_UNSPEC;
+    t.tcm_ifindex = ifindex;
+    t.tcm_parent  = parent;
+    t.tcm_handle  = handle;
+    t.tcm_info    = info;
+    if (nlmsg_append(m, &t, sizeof(t), NLMSG_ALIGNTO) < 0)
+    {
+        nlmsg_free(m);
+        return NULL;
+    }
+    return m;
+}
+
+static struct nl_msg *clsact_msg(int ifindex)
+{
+    struct nl_msg *m = tc_msg(RTM_NEWQDISC, NLM_F_CREATE | NLM_F_EXCL, ifindex,
+                              TC_H_CLSACT, TC_H_MAKE(TC_H_CLSACT, 0), 0);
+
+    if (m && nla_put_string(m, TCA_KIND, "clsact") < 0)
+    {
+        nlmsg_free(m);
+        return NULL;
+    }
+    return m;
+}
+
+/* Translation filter of port @p ifindex matching tag @p vid, on ingress
+ * (TC_H_MIN_INGRESS) or egress (TC_H_MIN_EGRESS) as @p dir says. */
+static struct nl_msg *xlate_msg(int type, int flags, int ifindex, uint32_t dir, uint16_t vid)
+{
+    struct nl_msg *m = tc_msg(type, flags, ifindex, TC_H_MAKE(TC_H_CLSACT, dir), vid,
+                              TC_H_MAKE((uint32_t)TC_XLATE_PRIO << 16, htons(ETH_P_8021Q)));
+
+    if (m && nla_put_string(m, TCA_KIND, "flower") < 0)
+    {
+        nlmsg_free(m);
+        return NULL;
+    }
+    return m;
+}
+
+/* Filter rewriting tag @p from to @p to in direction @p dir. */
+static struct nl_msg *xlate_add(int ifindex, uint32_t dir, uint16_t from, uint16_t to)
+{
+    struct nl_msg *m = xlate_msg(RTM_NEWTFILTER, NLM_F_CREATE | NLM_F_EXCL, ifindex, dir, from);
+    uint16_t proto = htons(ETH_P_8021Q);
+    struct nlattr *opts, *acts, *act, *aopts;
+    struct tc_vlan v;
+
+    if (!m)
+        return NULL;
+    memset(&v, 0, sizeof(v));
+    v.action   = TC_ACT_UNSPEC;         /* continue with the next filter */
+    v.v_action = TCA_VLAN_ACT_MODIFY;
+
+    /* Flower parses the VLAN keys only under an 802.1Q EtherType key. */
+    if (!(opts = nla_nest_start(m, TCA_OPTIONS)) ||
+        nla_put(m, TCA_FLOWER_KEY_ETH_TYPE, sizeof(proto), &proto) < 0 ||
+        nla_put_u16(m, TCA_FLOWER_KEY_VLAN_ID, from) < 0 ||
+        !(acts = nla_nest_start(m, TCA_FLOWER_ACT)) ||
+        !(act = nla_nest_start(m, 1)) ||
+        nla_put_string(m, TCA_ACT_KIND, "vlan") < 0 ||
+        !(aopts = nla_nest_start(m, TCA_ACT_OPTIONS)) ||
+        nla_put(m, TCA_VLAN_PARMS, sizeof(v), &v) < 0 ||
+        nla_put_u16(m, TCA_VLAN_PUSH_VLAN_ID, to) < 0)
+    {
+        nlmsg_free(m);
+        return NULL;
+    }
+    nla_nest_end(m, aopts);
+    nla_nest_end(m, act);
+    nla_nest_end(m, acts);
+    nla_nest_end(m, opts);
+    return m;
+}
+
+/* Queue the deletion of both filters of mapping @p cvid <-> @p vid. */
+static int queue_delete(struct nl_batch *nl, int ifindex, uint16_t cvid, uint16_t vid)
+{
+    int err = nl_batch_add(nl, xlate_msg(RTM_DELTFILTER, 0, ifindex, TC_H_MIN_INGRESS, cvid), NULL);
+
+    return err ? err : nl_batch_add(nl, xlate_msg(RTM_DELTFILTER, 0, ifindex, TC_H_MIN_EGRESS, vid),
+                                    NULL);
+}
+
+static int commit(struct nl_batch *nl, unsigned n)
+{
+    int err;
+
+    NL_CALL_RET(err, nl_batch_commit(nl), "nl_batch_commit", "batch=%p, requests=%u",
+                (void *)nl, n);
+    return err;
+}
+
+/* ---------------------------------------------------------------------------
+ * Public API
+ * --------------------------------------------------------------------------- */
+
+/**
+ * tc_xlate_set() - Translate C-VIDs @p cvid .. @p cvid + @p count - 1 of
+ * port @p iface to VIDs @p vid .. @p vid + @p count - 1 in order, or stop
+ * translating them if @p vid is 0.
+ *
+ * @return
+ *    0           – success. \n
+ *   -EINVAL      – bad range (see vlan_xlate_check()). \n
+ *   -EEXIST      – a VID of the range is the translation of a C-VID of
+ *                  the port outside the range. \n
+ *   -ENODEV      – no such interface. \n
+ *   -ENOSPC      – TC_XLATE_MAX_PORTS ports translate already. \n
+ *   -ENOMEM      – out of memory. \n
+ *   -errno       – the kernel refused a filter (-ENOENT: no flower
+ *                  classifier or vlan action in this kernel); the C-VIDs
+ *                  it refused are left untranslated, the others mapped.
+ */
+int tc_xlate_set(const char *iface, uint16_t cvid, uint16_t vid, unsigned count)
+{
+    static const struct vlan_xlate none;
+    struct tc_xport **slot, *p;
+    struct nl_batch *nl;
+    int *status;
+    unsigned i;
+    int ifindex;
+    int err;
+
+    if (!iface)
+        return -EINVAL;
+    if ((err = vlan_xlate_check(&none, cvid, vid, count)) < 0)
+        return err;
+    if ((ifindex = vlan_state_lookup_ifindex(iface)) <= 0)
+        return -ENODEV;
+
+    pthread_mutex_lock(&g_xl_lock);
+    if ((slot = port_find(ifindex)) == NULL)
+    {
+        if (!vid)
+        {
+            pthread_mutex_unlock(&g_xl_lock);
+            return 0;
+        }
+        if ((slot = port_find(0)) == NULL || (*slot = calloc(1, sizeof(**slot))) == NULL)
+        {
+            pthread_mutex_unlock(&g_xl_lock);
+            return slot ? -ENOMEM : -ENOSPC;
+        }
+        (*slot)->ifindex = ifindex;
+        snprintf((*slot)->name, sizeof((*slot)->name), "%s", iface);
+    }
+    p = *slot;
+    if ((err = vlan_xlate_check(&p->x, cvid, vid, count)) < 0)
+        goto out;
+
+    nl = nl_batch_alloc();
+    status = calloc(2 * count, sizeof(int));
+    if (!nl || !status)
+    {
+        err = -ENOMEM;
+        goto free;
+    }
+    /* Fails with EEXIST if the port already has one. */
+    if (vid && (err = nl_batch_add(nl, clsact_msg(ifindex), NULL)) < 0)
+        goto free;
+    for (i = 0; i < count && err == 0; i++)
+    {
+        uint16_t old = p->x.in[cvid + i];
+
+        if (old)
+            err = queue_delete(nl, ifindex, (uint16_t)(cvid + i), old);
+    }
+    for (i = 0; vid && i < count && err == 0; i++)
+    {
+        err = nl_batch_add(nl, xlate_add(ifindex, TC_H_MIN_INGRESS, (uint16_t)(cvid + i),
+                                         (uint16_t)(vid + i)), &status[2 * i]);
+        if (err == 0)
+            err = nl_batch_add(nl, xlate_add(ifindex, TC_H_MIN_EGRESS, (uint16_t)(vid + i),
+                                             (uint16_t)(cvid + i)), &status[2 * i + 1]);
+    }
+    if (err < 0)
+        goto free;
+    (void)commit(nl, (unsigned)nl_batch_pending(nl));
+    vlan_xlate_set(&p->x, cvid, vid, count);
+
+    /* Take back the mappings the kernel refused, with whichever of their
+     * two filters it did accept. */
+    for (i = 0; vid && i < count; i++)
+    {
+        if (status[2 * i] == 0 && status[2 * i + 1] == 0)
+            continue;
+        if (err == 0)
+            err = status[2 * i] ? status[2 * i] : status[2 * i + 1];
+        vlan_xlate_set(&p->x, (uint16_t)(cvid + i), 0, 1);
+        queue_delete(nl, ifindex, (uint16_t)(cvid + i), (uint16_t)(vid + i));
+    }
+    if (nl_batch_pending(nl))
+        (void)commit(nl, (unsigned)nl_batch_pending(nl));
+
+free:
+    nl_batch_free(nl);
+    free(status);
+out:
+    if (p->x.n == 0)
+    {
+        free(p);
+        *slot = NULL;
+    }
+    pthread_mutex_unlock(&g_xl_lock);
+    return err;
+}
+
+/**
+ * tc_xlate_walk() - Pass every mapping to @p fn, by port and then C-VID.
+ *
+ * @return the number of mappings.
+ */
+int tc_xlate_walk(tc_xlate_fn fn, void *arg)
+{
+    unsigned i, c;
+    int n = 0;
+
+    if (!fn)
+        return -EINVAL;
+
+    pthread_mutex_lock(&g_xl_lock);
+    for (i = 0; i < TC_XLATE_MAX_PORTS; i++)
+    {
+        const struct tc_xport *p = g_xports[i];
+
+        for (c = 1; p && c < VLAN_ID_SPACE; c++)
+        {
+            if (!p->x.in[c])
+                continue;
+            fn(p->name, (uint16_t)c, p->x.in[c], arg);
+            n++;
+        }
+    }
+    pthread_mutex_unlock(&g_xl_lock);
+    return n;
+}
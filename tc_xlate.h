@@ -0,0 +1,36 @@
+/**
+ * @file tc_xlate.h
+ * @brief VLAN translation on the kernel bridge backend, as tc vlan modify
+ *        actions.
+ *
+ * Without the user-space forwarding plane a trunk carries VLAN N as the
+ * 8021q sub-interface <port>.N enslaved to Vlan<N>.  Translating customer
+ * VID C to N with one more sub-interface per C-VID would cost an interface
+ * per mapping; instead every mapping is two flower filters on the port's
+ * clsact qdisc.  On ingress, a frame tagged C has its tag rewritten to N
+ * before the 8021q layer hands it to <port>.N; on egress, a frame that
+ * <port>.N sends tagged N leaves tagged C.  Both filters keep the priority
+ * bits and continue classification, so storm control (tc_storm.h) still
+ * sees the frame.  All filters of one direction share one flower mask,
+ * i.e. one hash table, so a frame costs one lookup however many VIDs the
+ * port translates.
+ *
+ * The port must carry every internal VLAN it translates to, as for an
+ * untranslated trunk VLAN; tc_xlate_set() does not create sub-interfaces.
+ */
+
+#ifndef TC_XLATE_H
+#define TC_XLATE_H
+
+#include <stdint.h>
+
+/** Priority of the translation filters in chain 0 of both directions. */
+#define TC_XLATE_PRIO       1
+
+/** tc_xlate_walk() callback: one mapping of port @p iface. */
+typedef void (*tc_xlate_fn)(const char *iface, uint16_t cvid, uint16_t vid, void *arg);
+
+int  tc_xlate_set(const char *iface, uint16_t cvid, uint16_t vid, unsigned count);
+int  tc_xlate_walk(tc_xlate_fn fn, void *arg);
+
+#endif /* TC_XLATE_H */
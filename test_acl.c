@@ -0,0 +1,334 @@
+/**
+ * @file test_acl.c
+ * @brief Test for the ACL classifier (acl.c).
+ *
+ * Tests:
+ *   A1: acl_build() argument and rule checks
+ *   A2: an empty list applies its default action
+ *   A3: the rule with the lowest sequence number wins, whatever the order
+ *       the list was given in
+ *   A4: IPv4 and L4 rules never match frames without those headers
+ *   A5: random rules agree with a linear reference on random frames
+ *   A6: burst classification agrees with single lookups and counts hits
+ *       per shard
+ *   A7: acl_carry_hits() keeps counters of rules that survive a rebuild
+ *
+ * Needs no privileges.
+ */
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "acl.h"
+
+#define NRULES   300
+#define NFRAMES  20000
+
+/* -------------------------------------------------------------------------
+ * Helpers
+ * ------------------------------------------------------------------------- */
+
+static int g_pass = 0;
+static int g_fail = 0;
+
+static void check(const char *desc, int got, int expected)
+{
+    if (got == expected)
+    {
+        printf("[PASS] %s  (ret=%d)\n", desc, got);
+        g_pass++;
+    }
+    else
+    {
+        printf("[FAIL] %s  (expected=%d, got=%d)\n", desc, expected, got);
+        g_fail++;
+    }
+}
+
+/* Header fields of a test frame. */
+struct hdr
+{
+    uint8_t  dst[6];
+    uint8_t  src[6];
+    uint16_t ethertype;
+    int      frag;              /* non-first fragment */
+    uint32_t sip, dip;
+    uint8_t  proto;
+    uint16_t sport, dport;
+};
+
+static uint32_t build_frame(const struct hdr *h, uint8_t *f)
+{
+    uint8_t *ip = f + 14;
+
+    memset(f, 0, 64);
+    memcpy(f, h->dst, 6);
+    memcpy(f + 6, h->src, 6);
+    f[12] = (uint8_t)(h->ethertype >> 8);
+    f[13] = (uint8_t)h->ethertype;
+    if (h->ethertype != 0x0800)
+        return 64;
+    ip[0] = 0x45;
+    ip[6] = h->frag ? 0x00 : 0x40;
+    ip[7] = h->frag ? 0x10 : 0x00;
+    ip[9] = h->proto;
+    ip[12] = (uint8_t)(h->sip >> 24); ip[13] = (uint8_t)(h->sip >> 16);
+    ip[14] = (uint8_t)(h->sip >> 8);  ip[15] = (uint8_t)h->sip;
+    ip[16] = (uint8_t)(h->dip >> 24); ip[17] = (uint8_t)(h->dip >> 16);
+    ip[18] = (uint8_t)(h->dip >> 8);  ip[19] = (uint8_t)h->dip;
+    ip[20] = (uint8_t)(h->sport >> 8); ip[21] = (uint8_t)h->sport;
+    ip[22] = (uint8_t)(h->dport >> 8); ip[23] = (uint8_t)h->dport;
+    return 64;
+}
+
+static struct acl_key key_of(const struct hdr *h)
+{
+    struct acl_key k;
+    uint8_t f[64];
+
+    acl_key_parse(f, build_frame(h, f), &k);
+    return k;
+}
+
+static uint32_t plen_mask(unsigned len)
+{
+    return len ? ~0u << (32 - len) : 0;
+}
+
+static int ref_match(const struct acl_rule *r, const struct hdr *h)
+{
+    int ip = h->ethertype == 0x0800;
+    int l4 = ip && !h->frag && (h->proto == 6 || h->proto == 17 || h->proto == 132);
+
+    if ((r->fields & ACL_M_DST_MAC) && memcmp(r->dst_mac, h->dst, 6))
+        return 0;
+    if ((r->fields & ACL_M_SRC_MAC) && memcmp(r->src_mac, h->src, 6))
+        return 0;
+    if ((r->fields & ACL_M_ETHERTYPE) && r->ethertype != h->ethertype)
+        return 0;
+    if ((r->fields & (ACL_M_SRC_IP | ACL_M_DST_IP | ACL_M_PROTO)) && !ip)
+        return 0;
+    if ((r->fields & ACL_M_SRC_IP) && ((h->sip ^ r->src_ip) & plen_mask(r->src_len)))
+        return 0;
+    if ((r->fields & ACL_M_DST_IP) && ((h->dip ^ r->dst_ip) & plen_mask(r->dst_len)))
+        return 0;
+    if ((r->fields & ACL_M_PROTO) && r->proto != h->proto)
+        return 0;
+    if ((r->fields & (ACL_M_SPORT | ACL_M_DPORT)) && !l4)
+        return 0;
+    if ((r->fields & ACL_M_SPORT) && (h->sport < r->sport_lo || h->sport > r->sport_hi))
+        return 0;
+    if ((r->fields & ACL_M_DPORT) && (h->dport < r->dport_lo || h->dport > r->dport_hi))
+        return 0;
+    return 1;
+}
+
+/* Lowest sequence number among the rules matching @p h, or -1. */
+static int ref_seq(const struct acl_rule *rules, unsigned n, const struct hdr *h)
+{
+    long best = -1;
+    unsigned i;
+
+    for (i = 0; i < n; i++)
+    {
+        if (ref_match(&rules[i], h) && (best < 0 || rules[i].seq < (uint32_t)best))
+            best = rules[i].seq;
+    }
+    return (int)best;
+}
+
+static int seq_of(const struct acl *a, const struct acl_key *k)
+{
+    int r = acl_classify(a, k);
+
+    return r < 0 ? -1 : (int)a->rules[r].seq;
+}
+
+static uint8_t small(void)
+{
+    return (uint8_t)(random() % 4);
+}
+
+static void random_hdr(struct hdr *h)
+{
+    memset(h, 0, sizeof(*h));
+    h->dst[5] = small();
+    h->src[5] = small();
+    h->ethertype = random() % 5 ? 0x0800 : 0x0806;
+    h->frag = random() % 10 == 0;
+    h->sip = 0x0A000000u | (uint32_t)(random() & 0xFFFF);
+    h->dip = 0x0A000000u | (uint32_t)(random() & 0xFFFF);
+    h->proto = (uint8_t[]){ 6, 17, 1, 132 }[random() % 4];
+    h->sport = (uint16_t)(random() % 2048);
+    h->dport = (uint16_t)(random() % 2048);
+}
+
+static void random_rule(struct acl_rule *r, uint32_t seq)
+{
+    memset(r, 0, sizeof(*r));
+    r->seq = seq;
+    r->action = random() % 2 ? ACL_DENY : ACL_PERMIT;
+    r->fields = (uint16_t)(random() & ((1 << ACL_NFIELDS) - 1) & random());
+    r->dst_mac[5] = small();
+    r->src_mac[5] = small();
+    r->ethertype = random() % 5 ? 0x0800 : 0x0806;
+    r->proto = (uint8_t[]){ 6, 17, 1, 132 }[random() % 4];
+    r->src_len = (uint8_t)(8 + random() % 25);
+    r->dst_len = (uint8_t)(8 + random() % 25);
+    r->src_ip = 0x0A000000u | (uint32_t)(random() & 0xFFFF);
+    r->dst_ip = 0x0A000000u | (uint32_t)(random() & 0xFFFF);
+    r->sport_lo = (uint16_t)(random() % 2048);
+    r->sport_hi = (uint16_t)(r->sport_lo + random() % 512);
+    r->dport_lo = (uint16_t)(random() % 2048);
+    r->dport_hi = (uint16_t)(r->dport_lo + random() % 512);
+}
+
+/* -------------------------------------------------------------------------
+ * Main
+ * ------------------------------------------------------------------------- */
+
+int main(void)
+{
+    static struct acl_rule rules[ACL_MAX_RULES + 1];
+    static struct hdr hdrs[NFRAMES];
+    struct acl_key keys[64];
+    struct acl *a, *b;
+    struct hdr h;
+    uint64_t deny, total;
+    unsigned i, k, bad;
+
+    setbuf(stdout, NULL);
+    srandom(1);
+
+    printf("============================================================\n");
+    printf("  virtasic ACL classifier test\n");
+    printf("============================================================\n");
+
+    memset(rules, 0, sizeof(rules));
+    rules[0].seq = 10;
+    rules[0].action = 2;
+    check("A1: unknown action", acl_build(rules, 1, ACL_PERMIT, 1, &a), -EINVAL);
+    rules[0].action = ACL_DENY;
+    rules[0].fields = ACL_M_SRC_IP;
+    rules[0].src_len = 33;
+    check("A1: prefix longer than 32", acl_build(rules, 1, ACL_PERMIT, 1, &a), -EINVAL);
+    rules[0].src_len = 8;
+    rules[0].fields = ACL_M_DPORT;
+    rules[0].dport_lo = 100;
+    rules[0].dport_hi = 99;
+    check("A1: empty port range", acl_build(rules, 1, ACL_PERMIT, 1, &a), -EINVAL);
+    rules[0].dport_hi = 100;
+    rules[1] = rules[0];
+    check("A1: duplicate sequence number", acl_build(rules, 2, ACL_PERMIT, 1, &a), -EINVAL);
+    check("A1: no shards", acl_build(rules, 1, ACL_PERMIT, 0, &a), -EINVAL);
+    check("A1: unknown default", acl_build(rules, 1, 7, 1, &a), -EINVAL);
+    check("A1: too many rules", acl_build(rules, ACL_MAX_RULES + 1, ACL_PERMIT, 1, &a), -ENOSPC);
+
+    check("A2: empty list builds", acl_build(NULL, 0, ACL_DENY, 1, &a), 0);
+    random_hdr(&h);
+    keys[0] = key_of(&h);
+    check("A2: nothing matches", acl_classify(a, &keys[0]), -1);
+    check("A2: default deny applies", (int)acl_classify_burst(a, keys, 1, 0), 1);
+    check("A2: counted as no match", (int)acl_hits(a, 0), 1);
+    acl_destroy(a);
+
+    memset(rules, 0, 3 * sizeof(rules[0]));
+    rules[0].seq = 30;                              /* any IPv4 to port 80: permit */
+    rules[0].fields = ACL_M_DPORT;
+    rules[0].dport_lo = rules[0].dport_hi = 80;
+    rules[1].seq = 20;                              /* 10.0.0.0/8: deny */
+    rules[1].action = ACL_DENY;
+    rules[1].fields = ACL_M_SRC_IP;
+    rules[1].src_ip = 0x0A000000;
+    rules[1].src_len = 8;
+    rules[2].seq = 40;                              /* ARP: deny */
+    rules[2].action = ACL_DENY;
+    rules[2].fields = ACL_M_ETHERTYPE;
+    rules[2].ethertype = 0x0806;
+    check("A3: build", acl_build(rules, 3, ACL_PERMIT, 1, &a), 0);
+    memset(&h, 0, sizeof(h));
+    h.ethertype = 0x0800;
+    h.proto = 6;
+    h.sip = 0x0A010203;
+    h.dport = 80;
+    keys[0] = key_of(&h);
+    check("A3: sequence 20 before 30", seq_of(a, &keys[0]), 20);
+    h.sip = 0xC0000201;
+    keys[0] = key_of(&h);
+    check("A3: outside the prefix, 30", seq_of(a, &keys[0]), 30);
+    h.dport = 81;
+    keys[0] = key_of(&h);
+    check("A3: no rule", seq_of(a, &keys[0]), -1);
+
+    h.ethertype = 0x0806;
+    keys[0] = key_of(&h);
+    check("A4: ARP matches only its EtherType rule", seq_of(a, &keys[0]), 40);
+    rules[2].fields = ACL_M_SRC_IP;
+    rules[2].src_ip = 0;
+    rules[2].src_len = 0;
+    acl_destroy(a);
+    acl_build(rules, 3, ACL_PERMIT, 1, &a);
+    check("A4: 0.0.0.0/0 does not match ARP", seq_of(a, &keys[0]), -1);
+    h.ethertype = 0x0800;
+    h.sip = 0xC0000201;
+    h.dport = 80;
+    h.frag = 1;
+    keys[0] = key_of(&h);
+    check("A4: no ports in a later fragment", seq_of(a, &keys[0]), 40);
+    h.frag = 0;
+    h.proto = 1;
+    keys[0] = key_of(&h);
+    check("A4: no ports in ICMP", seq_of(a, &keys[0]), 40);
+    acl_destroy(a);
+
+    for (i = 0; i < NRULES; i++)
+        random_rule(&rules[i], (uint32_t)((i * 7919) % 100003));
+    check("A5: build random list", acl_build(rules, NRULES, ACL_PERMIT, 4, &a), 0);
+    for (i = 0, bad = 0; i < NFRAMES; i++)
+    {
+        random_hdr(&hdrs[i]);
+        keys[0] = key_of(&hdrs[i]);
+        bad += seq_of(a, &keys[0]) != ref_seq(rules, NRULES, &hdrs[i]);
+    }
+    check("A5: every frame agrees with the reference", (int)bad, 0);
+
+    bad = 0;
+    for (i = 0; i + 64 <= NFRAMES; i += 64)
+    {
+        for (k = 0; k < 64; k++)
+            keys[k] = key_of(&hdrs[i + k]);
+        deny = acl_classify_burst(a, keys, 64, (i / 64) % 4);
+        for (k = 0; k < 64; k++)
+        {
+            int r = acl_classify(a, &keys[k]);
+            int d = r < 0 ? a->default_action : a->action[r];
+
+            bad += ((deny >> k) & 1) != (uint64_t)(d == ACL_DENY);
+        }
+    }
+    check("A6: burst agrees with single lookups", (int)bad, 0);
+    for (i = 0, total = 0; i <= a->nrules; i++)
+        total += acl_hits(a, i);
+    check("A6: every frame counted once", (int)total, NFRAMES / 64 * 64);
+
+    rules[NRULES] = rules[0];
+    rules[NRULES].seq = 200000;
+    check("A7: rebuild with one more rule", acl_build(rules, NRULES + 1, ACL_PERMIT, 4, &b), 0);
+    acl_carry_hits(b, a);
+    for (i = 0, bad = 0; i < a->nrules; i++)
+        bad += acl_hits(b, i) != acl_hits(a, i);
+    check("A7: counters carried", (int)bad, 0);
+    check("A7: new rule starts at zero", (int)acl_hits(b, NRULES), 0);
+    check("A7: no-match counter carried", acl_hits(b, NRULES + 1) == acl_hits(a, NRULES), 1);
+    acl_destroy(a);
+    acl_destroy(b);
+
+    printf("============================================================\n");
+    printf("  Results: %d passed, %d failed\n", g_pass, g_fail);
+    printf("============================================================\n");
+
+    return (g_fail > 0) ? 1 : 0;
+}
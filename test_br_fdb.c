@@ -0,0 +1,264 @@
+/**
+ * @file test_br_fdb.c
+ * @brief Test for the kernel bridge FDB programming (br_fdb.c).
+ *
+ * Tests:
+ *   B1: bad arguments are refused before anything reaches the kernel
+ *   K1: static entries on a Vlan<id> member port: a range added in one
+ *       batch, refused for an absent VLAN, an absent port and a port of
+ *       another bridge, each with its own status
+ *   K2: dumps filtered by VLAN, bridge and port return the matching entries
+ *       only, with their type
+ *   K3: flushes: a learned MAC goes with the dynamic flush of the VLAN,
+ *       static entries stay until flushed with "static", local ones always
+ *
+ * B1 needs no privileges; K1..K3 run in a private network namespace and
+ * are skipped without CAP_SYS_ADMIN / CAP_NET_ADMIN.
+ */
+
+#define _GNU_SOURCE     /* unshare */
+
+#include <errno.h>
+#include <sched.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <linux/if_ether.h>
+#include <linux/if_packet.h>
+#include <net/if.h>
+#include <netlink/netlink.h>
+#include <netlink/route/link.h>
+#include <netlink/route/link/veth.h>
+
+#include "br_fdb.h"
+#include "vlan_api.h"
+#include "vlan_state.h"
+
+/* -------------------------------------------------------------------------
+ * Helpers
+ * ------------------------------------------------------------------------- */
+
+static int g_pass = 0;
+static int g_fail = 0;
+
+static void check(const char *desc, int got, int expected)
+{
+    if (got == expected)
+    {
+        printf("[PASS] %s  (ret=%d)\n", desc, got);
+        g_pass++;
+    }
+    else
+    {
+        printf("[FAIL] %s  (expected=%d, got=%d)\n", desc, expected, got);
+        g_fail++;
+    }
+}
+
+static int link_up(const char *name)
+{
+    struct ifreq ifr;
+    int fd = socket(AF_INET, SOCK_DGRAM, 0);
+    int ret = -1;
+
+    if (fd < 0)
+        return -1;
+    memset(&ifr, 0, sizeof(ifr));
+    strncpy(ifr.ifr_name, name, IFNAMSIZ - 1);
+    if (ioctl(fd, SIOCGIFFLAGS, &ifr) == 0)
+    {
+        ifr.ifr_flags |= IFF_UP;
+        ret = ioctl(fd, SIOCSIFFLAGS, &ifr);
+    }
+    close(fd);
+    return ret;
+}
+
+static int make_pair(void)
+{
+    struct nl_sock *sock = nl_socket_alloc();
+    int err;
+
+    if (!sock || nl_connect(sock, NETLINK_ROUTE) < 0)
+        return -1;
+    err = rtnl_link_veth_add(sock, "h0", "s0", getpid());
+    if (err == 0 && (link_up("h0") < 0 || link_up("s0") < 0))
+        err = -1;
+    nl_socket_free(sock);
+    return err;
+}
+
+/* Send a broadcast frame with source address @p src out of @p name. */
+static int send_from(const char *name, const uint8_t *src)
+{
+    struct sockaddr_ll sll;
+    uint8_t f[60];
+    int fd = socket(AF_PACKET, SOCK_RAW, htons(ETH_P_ALL));
+    int ret;
+
+    if (fd < 0)
+        return -1;
+    memset(f, 0, sizeof(f));
+    memset(f, 0xff, 6);
+    memcpy(f + 6, src, 6);
+    f[12] = 0x88;               /* local experimental EtherType */
+    f[13] = 0xb5;
+    memset(&sll, 0, sizeof(sll));
+    sll.sll_family = AF_PACKET;
+    sll.sll_ifindex = (int)if_nametoindex(name);
+    ret = sendto(fd, f, sizeof(f), 0, (struct sockaddr *)&sll, sizeof(sll)) == sizeof(f) ? 0 : -1;
+    close(fd);
+    return ret;
+}
+
+/* Entries seen by the last dump, by type. */
+static int g_seen[3];
+static int g_seen_vid_ok;
+static void count_entry(const struct br_fdb_entry *e, void *arg)
+{
+    (void)arg;
+    g_seen[e->type]++;
+    g_seen_vid_ok &= e->vid == 10 && strcmp(e->bridge_name, "Vlan10") == 0;
+}
+
+/* Dump with filter (@p bridge, @p vid, @p port); the count or -errno. */
+static int dump(const char *bridge, uint16_t vid, const char *port)
+{
+    struct br_fdb_filter f;
+
+    memset(&f, 0, sizeof(f));
+    memset(g_seen, 0, sizeof(g_seen));
+    g_seen_vid_ok = 1;
+    if (bridge)
+        snprintf(f.bridge, sizeof(f.bridge), "%s", bridge);
+    if (port)
+        snprintf(f.port, sizeof(f.port), "%s", port);
+    f.vid = vid;
+    return br_fdb_dump(&f, count_entry, NULL);
+}
+
+static void fill(struct br_fdb_op *ops, unsigned n, uint16_t vid, const char *port)
+{
+    static const uint8_t base[6] = { 0x02, 0x00, 0x00, 0xaa, 0x00, 0x00 };
+    unsigned i;
+
+    memset(ops, 0, n * sizeof(*ops));
+    for (i = 0; i < n; i++)
+    {
+        memcpy(ops[i].mac, base, 6);
+        ops[i].mac[4] = (uint8_t)(i >> 8);
+        ops[i].mac[5] = (uint8_t)i;
+        ops[i].vid = vid;
+        snprintf(ops[i].port, sizeof(ops[i].port), "%s", port);
+    }
+}
+
+/* K1..K3, inside the namespace with the h0/s0 pair. */
+static void test_kernel(void)
+{
+    static const uint8_t learned[6] = { 0x02, 0x00, 0x00, 0xbb, 0x00, 0x01 };
+    static struct br_fdb_op ops[300];
+    int i, ok;
+
+    usleep(100000);             /* let the snapshot see the pair */
+    check("K1: create VLAN 10", create_vlan(10), 0);
+    check("K1: s0 joins it", add_vlan_assignment(10, "s0"), 0);
+    check("K1: Vlan10 up", link_up("Vlan10"), 0);
+
+    fill(ops, 300, 10, "s0");
+    check("K1: 300 static entries on s0", br_fdb_static(ops, 300, 1), 0);
+    for (ok = 1, i = 0; i < 300; i++)
+        ok &= ops[i].status == 0;
+    check("K1: ... each acknowledged", ok, 1);
+    fill(ops, 3, 10, "s0");
+    ops[0].vid = 20;
+    snprintf(ops[1].port, sizeof(ops[1].port), "nonexistent0");
+    snprintf(ops[2].port, sizeof(ops[2].port), "h0");
+    check("K1: a batch with failures reports the first", br_fdb_static(ops, 3, 1), -ENOENT);
+    check("K1: ... no VLAN 20", ops[0].status, -ENOENT);
+    check("K1: ... no such port", ops[1].status, -ENODEV);
+    check("K1: ... h0 is not in VLAN 10", ops[2].status, -EINVAL);
+
+    check("K2: VLAN 10 holds the 300 and the local entries", dump(NULL, 10, NULL) > 300, 1);
+    check("K2: ... 300 static", g_seen[BR_FDB_STATIC], 300);
+    check("K2: ... all on Vlan10", g_seen_vid_ok, 1);
+    check("K2: port s0: 300 static", dump(NULL, 0, "s0") > 0 && g_seen[BR_FDB_STATIC] == 300, 1);
+    check("K2: ... and its local address", g_seen[BR_FDB_LOCAL] >= 1, 1);
+    check("K2: bridge Vlan10 and VLAN 10", dump("Vlan10", 10, "s0") > 0 && g_seen[BR_FDB_STATIC] == 300, 1);
+    check("K2: port h0 is on no bridge", dump(NULL, 0, "h0"), 0);
+    check("K2: no VLAN 20", dump(NULL, 20, NULL), -ENOENT);
+    check("K2: VLAN 10 is not on bridge h0", dump("h0", 10, NULL), -EINVAL);
+    check("K2: no such port", dump(NULL, 0, "nonexistent0"), -ENODEV);
+
+    fill(ops, 100, 10, "s0");
+    check("K1: delete 100", br_fdb_static(ops, 100, 0), 0);
+    dump(NULL, 10, NULL);
+    check("K1: 200 static left", g_seen[BR_FDB_STATIC], 200);
+    check("K1: deleting again fails per entry", br_fdb_static(ops, 1, 0), -ENOENT);
+
+    check("K3: a frame from h0", send_from("h0", learned), 0);
+    for (i = 0; i < 100 && (dump(NULL, 10, "s0"), g_seen[BR_FDB_DYNAMIC]) == 0; i++)
+        usleep(10000);
+    check("K3: learned on s0", g_seen[BR_FDB_DYNAMIC], 1);
+    check("K3: flush h0 refused", br_fdb_flush(0, "h0", 0), -EINVAL);
+    check("K3: flush VLAN 20 refused", br_fdb_flush(20, NULL, 0), -ENOENT);
+    check("K3: flush VLAN 10", br_fdb_flush(10, NULL, 0), 0);
+    dump(NULL, 10, NULL);
+    check("K3: learned entry gone", g_seen[BR_FDB_DYNAMIC], 0);
+    check("K3: static entries kept", g_seen[BR_FDB_STATIC], 200);
+    check("K3: flush s0 with the static entries", br_fdb_flush(10, "s0", 1), 0);
+    dump(NULL, 10, NULL);
+    check("K3: static entries gone", g_seen[BR_FDB_STATIC], 0);
+    check("K3: local entries kept", g_seen[BR_FDB_LOCAL] >= 1, 1);
+    check("K3: flushing every VLAN", br_fdb_flush(0, NULL, 1), 0);
+    check("K3: delete VLAN 10", delete_vlan(10), 0);
+}
+
+/* -------------------------------------------------------------------------
+ * Main
+ * ------------------------------------------------------------------------- */
+
+int main(void)
+{
+    struct br_fdb_op op;
+    struct br_fdb_filter f;
+
+    setbuf(stdout, NULL);
+
+    printf("============================================================\n");
+    printf("  virtasic bridge FDB test\n");
+    printf("============================================================\n");
+
+    memset(&op, 0, sizeof(op));
+    memset(&f, 0, sizeof(f));
+    check("B1: VLAN 0", br_fdb_static(&op, 1, 1), -EINVAL);
+    check("B1: ... in the entry's status", op.status, -EINVAL);
+    op.vid = 4095;
+    check("B1: VLAN 4095", br_fdb_static(&op, 1, 0), -EINVAL);
+    check("B1: no entries", br_fdb_static(NULL, 0, 1), 0);
+    check("B1: dump without a callback", br_fdb_dump(NULL, NULL, NULL), -EINVAL);
+    f.vid = 4095;
+    check("B1: dump VLAN 4095", br_fdb_dump(&f, count_entry, NULL), -EINVAL);
+    check("B1: flush VLAN 4095", br_fdb_flush(4095, NULL, 0), -EINVAL);
+
+    if (unshare(CLONE_NEWNET) < 0 || vlan_state_init() < 0 || make_pair() < 0)
+    {
+        printf("[SKIP] K: cannot create a network namespace with a veth pair\n");
+    }
+    else
+    {
+        test_kernel();
+        vlan_state_shutdown();
+    }
+
+    printf("============================================================\n");
+    printf("  Results: %d passed, %d failed\n", g_pass, g_fail);
+    printf("============================================================\n");
+
+    return (g_fail > 0) ? 1 : 0;
+}
@@ -0,0 +1,241 @@
+/**
+ * @file test_cfg_load.c
+ * @brief Test for the bulk configuration loader.
+ *
+ *  Part A – Parsing and validation (no kernel changes)
+ *    C1: comments, blank lines, CRLF and indentation are skipped; other
+ *        commands reach the fallback handler in file order
+ *    C2: malformed and invalid VLAN lines are reported with their line number
+ *    C3: nested exec, the nesting limit and a missing file
+ *    C5: assignments naming a LAG go to the fallback handler, which expands
+ *        them to the member ports, in file order; any name may be a LAG
+ *        while a LAG change is queued
+ *
+ *  Part B – Batched lifecycle (requires CAP_NET_ADMIN + kernel bridge module)
+ *    C4: create / delete of two VLANs in one file, including an operation
+ *        that has to wait for a queued create (-EAGAIN path)
+ */
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "cfg_load.h"
+#include "vlan_api.h"
+
+#define TEST_DIR "/tmp"
+
+/* -------------------------------------------------------------------------
+ * Helpers
+ * ------------------------------------------------------------------------- */
+
+static int g_pass = 0;
+static int g_fail = 0;
+
+static void check(const char *desc, int got, int expected)
+{
+    if (got == expected)
+    {
+        printf("[PASS] %s  (ret=%d)\n", desc, got);
+        g_pass++;
+    }
+    else
+    {
+        printf("[FAIL] %s  (expected=%d, got=%d)\n", desc, expected, got);
+        g_fail++;
+    }
+}
+
+static char g_seen[8][64];
+static int  g_nseen;
+
+static void fallback(const char *cmd)
+{
+    if (g_nseen < 8)
+        snprintf(g_seen[g_nseen], sizeof(g_seen[0]), "%s", cmd);
+    g_nseen++;
+}
+
+static void write_file(const char *path, const char *text)
+{
+    FILE *f = fopen(path, "w");
+
+    if (!f)
+    {
+        perror(path);
+        return;
+    }
+    fputs(text, f);
+    fclose(f);
+}
+
+/* -------------------------------------------------------------------------
+ * Tests
+ * ------------------------------------------------------------------------- */
+
+static void test_skip_and_fallback(void)
+{
+    const char *path = TEST_DIR "/test_cfg_c1.conf";
+    struct cfg_stats st;
+
+    write_file(path,
+               "# comment\n"
+               "\n"
+               "! another comment\n"
+               "   show vlan\r\n"
+               "\t\n"
+               "show interfaces");
+    g_nseen = 0;
+
+    check("C1: cfg_exec", cfg_exec(path, fallback, &st), 0);
+    check("C1: lines counted", (int)st.lines, 6);
+    check("C1: commands counted", (int)st.commands, 2);
+    check("C1: fallback calls", g_nseen, 2);
+    check("C1: first fallback trimmed", strcmp(g_seen[0], "show vlan"), 0);
+    check("C1: unterminated last line", strcmp(g_seen[1], "show interfaces"), 0);
+    check("C1: no VLAN transactions", (int)st.transactions, 0);
+    unlink(path);
+}
+
+/* vlan_lag_fn knowing one LAG, "lag1", with members s1 and s3. */
+static int fake_lag(const char *name, char (*member)[VLAN_IFNAMSIZ], unsigned max)
+{
+    if (strcmp(name, "lag1") != 0)
+        return -ENOENT;
+    if (max >= 2)
+    {
+        snprintf(member[0], VLAN_IFNAMSIZ, "s1");
+        snprintf(member[1], VLAN_IFNAMSIZ, "s3");
+    }
+    return 2;
+}
+
+static void test_lag_fallback(void)
+{
+    const char *path = TEST_DIR "/test_cfg_c5.conf";
+    struct cfg_stats st;
+
+    write_file(path,
+               "add vlan 10 to lag1\n"
+               "show vlan\n"
+               "remove vlan 10 from lag1\n");
+    g_nseen = 0;
+    vlan_set_lag_resolver(fake_lag);
+
+    check("C5: cfg_exec", cfg_exec(path, fallback, &st), 0);
+    check("C5: all three to the fallback", g_nseen, 3);
+    check("C5: LAG add first", strcmp(g_seen[0], "add vlan 10 to lag1"), 0);
+    check("C5: LAG remove last", strcmp(g_seen[2], "remove vlan 10 from lag1"), 0);
+    check("C5: nothing batched", (int)st.batched, 0);
+
+    check("C5: lag1 may be a LAG", vlan_lag_maybe("lag1"), 1);
+    check("C5: s1 cannot", vlan_lag_maybe("s1"), 0);
+    vlan_lag_change_begin();
+    check("C5: ... unless a LAG change is queued", vlan_lag_maybe("s1"), 1);
+    vlan_lag_change_end();
+    check("C5: ... and not once it has run", vlan_lag_maybe("s1"), 0);
+    vlan_set_lag_resolver(NULL);
+    unlink(path);
+}
+
+static void test_validation(void)
+{
+    const char *path = TEST_DIR "/test_cfg_c2.conf";
+    struct cfg_stats st;
+
+    write_file(path,
+               "create vlan 0\n"                     /* 1: -EINVAL          */
+               "create vlan abc\n"                   /* 2: not a number     */
+               "add vlan 200 to lo\n"                /* 3: VLAN missing     */
+               "add vlan 200 to ifname_far_too_long\n" /* 4: name too long */
+               "delete vlan 4095\n");                /* 5: -EINVAL          */
+    g_nseen = 0;
+
+    check("C2: cfg_exec reports failure", cfg_exec(path, fallback, &st), -EIO);
+    check("C2: five errors", (int)st.errors, 5);
+    check("C2: first error on line 1", (int)st.first_error, 1);
+    check("C2: nothing reached the kernel", (int)st.transactions, 0);
+    check("C2: nothing passed to fallback", g_nseen, 0);
+    unlink(path);
+}
+
+static void test_nesting(void)
+{
+    const char *outer = TEST_DIR "/test_cfg_c3a.conf";
+    const char *inner = TEST_DIR "/test_cfg_c3b.conf";
+    const char *loop  = TEST_DIR "/test_cfg_c3c.conf";
+    struct cfg_stats st;
+
+    write_file(inner, "show vlan\n");
+    write_file(outer, "show interfaces\nexec " TEST_DIR "/test_cfg_c3b.conf\n");
+    write_file(loop,  "exec " TEST_DIR "/test_cfg_c3c.conf\n");
+    g_nseen = 0;
+
+    check("C3: nested exec", cfg_exec(outer, fallback, &st), 0);
+    check("C3: nested lines counted", (int)st.lines, 3);
+    check("C3: nested command order", strcmp(g_seen[1], "show vlan"), 0);
+
+    check("C3: self-exec stops at the nesting limit",
+          cfg_exec(loop, fallback, &st), -EIO);
+    check("C3: one nesting error", (int)st.errors, 1);
+
+    check("C3: missing file", cfg_exec(TEST_DIR "/test_cfg_absent.conf", fallback, &st),
+          -ENOENT);
+
+    unlink(outer);
+    unlink(inner);
+    unlink(loop);
+}
+
+static void test_lifecycle(void)
+{
+    const char *path = TEST_DIR "/test_cfg_c4.conf";
+    struct cfg_stats st;
+    int ret;
+
+    write_file(path,
+               "create vlan 300\n"
+               "create vlan 301\n"
+               "delete vlan 300\n"       /* waits for the queued create */
+               "delete vlan 301\n");
+
+    ret = cfg_exec(path, NULL, &st);
+    if (ret == -EIO && st.first_error == 1)
+    {
+        printf("[SKIP] C4: kernel rejected bridge creation (no CAP_NET_ADMIN?)\n");
+        unlink(path);
+        return;
+    }
+
+    check("C4: cfg_exec", ret, 0);
+    check("C4: four VLAN ops", (int)st.batched, 4);
+    check("C4: two transactions", (int)st.transactions, 2);
+    unlink(path);
+}
+
+/* -------------------------------------------------------------------------
+ * Main
+ * ------------------------------------------------------------------------- */
+
+int main(void)
+{
+    setbuf(stdout, NULL);
+
+    printf("============================================================\n");
+    printf("  virtasic configuration loader test\n");
+    printf("============================================================\n");
+
+    test_skip_and_fallback();
+    test_validation();
+    test_nesting();
+    test_lag_fallback();
+    test_lifecycle();
+
+    printf("============================================================\n");
+    printf("  Results: %d passed, %d failed\n", g_pass, g_fail);
+    printf("============================================================\n");
+
+    return (g_fail > 0) ? 1 : 0;
+}
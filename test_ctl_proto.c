@@ -0,0 +1,364 @@
+/**
+ * @file test_ctl_proto.c
+ * @brief Test for the binary control protocol codec and batch execution.
+ *
+ *   P1: an encoded batch round-trips through vbp_parse_frame()
+ *   P2: truncated input asks for more data; malformed input is rejected
+ *   P3: a batch executed over a socketpair yields one status per operation
+ *   P4: a reply that does not fit into the send buffer drops the client
+ *       instead of blocking the worker
+ *   P5: a frame naming more than VBP_MAX_EXPANDED VIDs is rejected
+ *   K1: bitmap operations create and delete their VLANs and report the
+ *       error of the lowest VID that failed
+ *
+ * P3 and P4 only use operations that fail validation (out-of-range or absent
+ * VLANs), so no kernel state is modified.  K1 runs in a private network
+ * namespace and is skipped without CAP_SYS_ADMIN / CAP_NET_ADMIN.
+ */
+
+#define _GNU_SOURCE     /* unshare */
+
+#include <errno.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <net/if.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+
+#include "ctl_proto.h"
+#include "cmd_sched.h"
+
+#define TEST_ABSENT_VLAN_ID 200
+
+/* -------------------------------------------------------------------------
+ * Helpers
+ * ------------------------------------------------------------------------- */
+
+static int g_pass = 0;
+static int g_fail = 0;
+
+static void check(const char *desc, int got, int expected)
+{
+    if (got == expected)
+    {
+        printf("[PASS] %s  (ret=%d)\n", desc, got);
+        g_pass++;
+    }
+    else
+    {
+        printf("[FAIL] %s  (expected=%d, got=%d)\n", desc, expected, got);
+        g_fail++;
+    }
+}
+
+static uint8_t g_frame[VBP_HDR_LEN + 4096];
+
+/* Build: create(0), add(200, "lo"), delete-bitmap{4095}, remove(200, "lo"). */
+static size_t build_sample(uint32_t seq)
+{
+    uint8_t bitmap[VBP_BITMAP_LEN] = {0};
+    size_t off = VBP_HDR_LEN;
+
+    bitmap[4095 / 8] |= 1u << (4095 % 8);
+
+    off += vbp_put_op(g_frame + off, VBP_OP_CREATE_VLAN, 0, NULL, NULL);
+    off += vbp_put_op(g_frame + off, VBP_OP_ADD_MEMBER, TEST_ABSENT_VLAN_ID, NULL, "lo");
+    off += vbp_put_op(g_frame + off, VBP_OP_DELETE_VLAN_BITMAP, 0, bitmap, NULL);
+    off += vbp_put_op(g_frame + off, VBP_OP_REMOVE_MEMBER, TEST_ABSENT_VLAN_ID, NULL, "lo");
+    vbp_put_header(g_frame, 0, seq, 4, (uint32_t)(off - VBP_HDR_LEN));
+    return off;
+}
+
+/* Execute @p frame over a socketpair; the first @p n statuses go to @p st. */
+static int run_frame(const uint8_t *frame, size_t len, int16_t *st, unsigned n)
+{
+    uint8_t reply[VBP_HDR_LEN + 16];
+    struct vbp_frame f;
+    struct vbp_conn *conn;
+    size_t want = VBP_HDR_LEN + 2 * (size_t)n;
+    size_t got = 0;
+    unsigned i;
+    int sv[2];
+    int ret;
+
+    if (n > 8 || socketpair(AF_UNIX, SOCK_STREAM, 0, sv) < 0)
+        return -EINVAL;
+
+    conn = vbp_conn_new(sv[0]);
+    ret = vbp_parse_frame(frame, len, &f);
+    if (ret > 0)
+        ret = vbp_execute(conn, &f);
+    vbp_frame_free(&f);
+    vbp_conn_put(conn);
+
+    while (ret == 0 && got < want)
+    {
+        ssize_t r = read(sv[1], reply + got, want - got);
+        if (r <= 0)
+            ret = -EIO;
+        else
+            got += (size_t)r;
+    }
+    for (i = 0; ret == 0 && i < n; i++)
+        st[i] = (int16_t)((reply[VBP_HDR_LEN + 2 * i] << 8) | reply[VBP_HDR_LEN + 2 * i + 1]);
+
+    close(sv[0]);
+    close(sv[1]);
+    return ret;
+}
+
+/* -------------------------------------------------------------------------
+ * Tests
+ * ------------------------------------------------------------------------- */
+
+static void test_roundtrip(void)
+{
+    struct vbp_frame f;
+    size_t len = build_sample(42);
+    int ret;
+
+    ret = vbp_parse_frame(g_frame, len, &f);
+    check("P1: full frame consumed", ret, (int)len);
+    check("P1: seq", (int)f.seq, 42);
+    check("P1: op count", (int)f.count, 4);
+    if (f.count == 4)
+    {
+        check("P1: op[1] opcode", f.ops[1].opcode, VBP_OP_ADD_MEMBER);
+        check("P1: op[1] vid", f.ops[1].vid, TEST_ABSENT_VLAN_ID);
+        check("P1: op[1] iface", strcmp(f.ops[1].iface, "lo"), 0);
+        check("P1: op[2] bitmap bit 4095",
+              (f.ops[2].bitmap[511] >> 7) & 1, 1);
+    }
+    vbp_frame_free(&f);
+}
+
+static void test_malformed(void)
+{
+    struct vbp_frame f;
+    size_t len = build_sample(1);
+
+    check("P2: header only -> need more", vbp_parse_frame(g_frame, VBP_HDR_LEN, &f), 0);
+    check("P2: truncated payload -> need more", vbp_parse_frame(g_frame, len - 1, &f), 0);
+
+    g_frame[0] = 'c';
+    check("P2: bad magic rejected", vbp_parse_frame(g_frame, len, &f), -EPROTO);
+
+    build_sample(1);
+    g_frame[VBP_HDR_LEN] = 99;    /* unknown opcode */
+    check("P2: unknown opcode rejected", vbp_parse_frame(g_frame, len, &f), -EPROTO);
+
+    build_sample(1);
+    g_frame[11] = 5;              /* count larger than the TLVs present */
+    check("P2: count mismatch rejected", vbp_parse_frame(g_frame, len, &f), -EPROTO);
+}
+
+static void test_execute(void)
+{
+    struct vbp_frame f;
+    uint8_t reply[VBP_HDR_LEN + 8];
+    size_t len = build_sample(7);
+    size_t got = 0;
+    int sv[2];
+    int16_t st[4];
+    struct vbp_conn *conn;
+    int i;
+
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, sv) < 0)
+    {
+        check("P3: socketpair", -errno, 0);
+        return;
+    }
+
+    conn = vbp_conn_new(sv[0]);
+    vbp_parse_frame(g_frame, len, &f);
+    check("P3: vbp_execute", vbp_execute(conn, &f), 0);
+    vbp_frame_free(&f);
+    vbp_conn_put(conn);
+
+    while (got < sizeof(reply))
+    {
+        ssize_t n = read(sv[1], reply + got, sizeof(reply) - got);
+        if (n <= 0)
+            break;
+        got += (size_t)n;
+    }
+
+    check("P3: reply length", (int)got, (int)sizeof(reply));
+    check("P3: reply flagged", reply[3] & VBP_F_REPLY, VBP_F_REPLY);
+    check("P3: reply seq echoed", reply[7], 7);
+
+    for (i = 0; i < 4; i++)
+        st[i] = (int16_t)((reply[VBP_HDR_LEN + 2 * i] << 8) | reply[VBP_HDR_LEN + 2 * i + 1]);
+
+    check("P3: create_vlan(0) -> -EINVAL", st[0], -EINVAL);
+    check("P3: add to absent VLAN -> -ENOENT", st[1], -ENOENT);
+    check("P3: delete bitmap {4095} -> -EINVAL", st[2], -EINVAL);
+    check("P3: remove from absent VLAN -> -ENOENT", st[3], -ENOENT);
+
+    close(sv[0]);
+    close(sv[1]);
+}
+
+static void test_full_buffer(void)
+{
+    struct vbp_frame f;
+    struct vbp_conn *conn;
+    uint8_t chunk[4096];
+    size_t len = build_sample(8);
+    size_t filled = 0, drained = 0;
+    struct timeval tmo = { 5, 0 };
+    ssize_t n;
+    int sv[2];
+
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, sv) < 0)
+    {
+        check("P4: socketpair", -errno, 0);
+        return;
+    }
+
+    /* A client that sends but never reads; top up byte by byte so not
+     * even the 24-byte reply fits. */
+    memset(chunk, 0, sizeof(chunk));
+    while ((n = send(sv[0], chunk, sizeof(chunk), MSG_DONTWAIT)) > 0)
+        filled += (size_t)n;
+    while ((n = send(sv[0], chunk, 1, MSG_DONTWAIT)) > 0)
+        filled += (size_t)n;
+    setsockopt(sv[1], SOL_SOCKET, SO_RCVTIMEO, &tmo, sizeof(tmo));
+
+    conn = vbp_conn_new(sv[0]);
+    vbp_parse_frame(g_frame, len, &f);
+    check("P4: vbp_execute", vbp_execute(conn, &f), 0);
+    vbp_frame_free(&f);
+    vbp_conn_put(conn);
+
+    /* The worker must give up rather than wait for this read. */
+    sched_drain();
+    while ((n = read(sv[1], chunk, sizeof(chunk))) > 0)
+        drained += (size_t)n;
+
+    check("P4: no reply squeezed in", drained == filled, 1);
+    check("P4: connection shut down", (int)n, 0);
+
+    close(sv[0]);
+    close(sv[1]);
+}
+
+static void test_expansion_cap(void)
+{
+    static uint8_t buf[VBP_HDR_LEN + 16 * (VBP_TLV_HDR_LEN + VBP_BITMAP_LEN)];
+    uint8_t full[VBP_BITMAP_LEN];
+    uint8_t rest[VBP_BITMAP_LEN];
+    struct vbp_frame f;
+    size_t off = VBP_HDR_LEN;
+    unsigned i;
+    int ret;
+
+    /* Fifteen full bitmaps and one with the remaining 4064 VIDs. */
+    memset(full, 0xff, sizeof(full));
+    memset(rest, 0, sizeof(rest));
+    memset(rest, 0xff, (VBP_MAX_EXPANDED - 15 * 4096) / 8);
+    for (i = 0; i < 15; i++)
+        off += vbp_put_op(buf + off, VBP_OP_DELETE_VLAN_BITMAP, 0, full, NULL);
+    off += vbp_put_op(buf + off, VBP_OP_DELETE_VLAN_BITMAP, 0, rest, NULL);
+    vbp_put_header(buf, 0, 1, 16, (uint32_t)(off - VBP_HDR_LEN));
+
+    ret = vbp_parse_frame(buf, off, &f);
+    check("P5: exactly VBP_MAX_EXPANDED VIDs accepted", ret, (int)off);
+    vbp_frame_free(&f);
+
+    buf[off - 1] |= 0x01;   /* one more VID in the last bitmap */
+    check("P5: one VID more rejected", vbp_parse_frame(buf, off, &f), -E2BIG);
+    check("P5: ... and nothing handed out", f.ops == NULL, 1);
+}
+
+/* K1, inside a private network namespace. */
+static void test_bitmap_kernel(void)
+{
+    uint8_t bitmap[VBP_BITMAP_LEN];
+    size_t off;
+    int16_t st[2];
+    unsigned vid;
+
+    /* Create Vlan10..Vlan19 in one operation. */
+    memset(bitmap, 0, sizeof(bitmap));
+    for (vid = 10; vid < 20; vid++)
+        bitmap[vid / 8] |= (uint8_t)(1u << (vid % 8));
+    off = VBP_HDR_LEN;
+    off += vbp_put_op(g_frame + off, VBP_OP_CREATE_VLAN_BITMAP, 0, bitmap, NULL);
+    vbp_put_header(g_frame, 0, 1, 1, (uint32_t)(off - VBP_HDR_LEN));
+    check("K1: create bitmap 10-19", run_frame(g_frame, off, st, 1), 0);
+    check("K1: ... succeeds", st[0], 0);
+    check("K1: ... Vlan10 exists", if_nametoindex("Vlan10") != 0, 1);
+    check("K1: ... Vlan19 exists", if_nametoindex("Vlan19") != 0, 1);
+
+    /* {15, 21}: 15 exists already, 21 is still created. */
+    memset(bitmap, 0, sizeof(bitmap));
+    bitmap[15 / 8] |= 1u << (15 % 8);
+    bitmap[21 / 8] |= 1u << (21 % 8);
+    off = VBP_HDR_LEN;
+    off += vbp_put_op(g_frame + off, VBP_OP_CREATE_VLAN_BITMAP, 0, bitmap, NULL);
+    off += vbp_put_op(g_frame + off, VBP_OP_ADD_MEMBER_BITMAP, 0, bitmap, "lo");
+    vbp_put_header(g_frame, 0, 2, 2, (uint32_t)(off - VBP_HDR_LEN));
+    check("K1: create bitmap {15, 21}", run_frame(g_frame, off, st, 2), 0);
+    check("K1: ... reports VLAN 15", st[0], -EEXIST);
+    check("K1: ... Vlan21 created anyway", if_nametoindex("Vlan21") != 0, 1);
+    check("K1: lo cannot join a bridge", st[1] < 0, 1);
+
+    /* Delete 10..21; 20 never existed. */
+    memset(bitmap, 0, sizeof(bitmap));
+    for (vid = 10; vid <= 21; vid++)
+        bitmap[vid / 8] |= (uint8_t)(1u << (vid % 8));
+    off = VBP_HDR_LEN;
+    off += vbp_put_op(g_frame + off, VBP_OP_DELETE_VLAN_BITMAP, 0, bitmap, NULL);
+    vbp_put_header(g_frame, 0, 3, 1, (uint32_t)(off - VBP_HDR_LEN));
+    check("K1: delete bitmap 10-21", run_frame(g_frame, off, st, 1), 0);
+    check("K1: ... reports VLAN 20", st[0], -ENOENT);
+    check("K1: ... Vlan10 gone", if_nametoindex("Vlan10"), 0);
+    check("K1: ... Vlan21 gone", if_nametoindex("Vlan21"), 0);
+}
+
+/* -------------------------------------------------------------------------
+ * Main
+ * ------------------------------------------------------------------------- */
+
+int main(void)
+{
+    int netns;
+
+    setbuf(stdout, NULL);
+
+    printf("============================================================\n");
+    printf("  virtasic binary control protocol test\n");
+    printf("============================================================\n");
+
+    /* Before sched_init(): the workers must start inside the namespace. */
+    netns = unshare(CLONE_NEWNET) == 0;
+
+    if (sched_init(2) < 0)
+    {
+        printf("[FAIL] sched_init\n");
+        return 1;
+    }
+
+    test_roundtrip();
+    test_malformed();
+    test_execute();
+    test_full_buffer();
+    test_expansion_cap();
+
+    if (!netns)
+        printf("[SKIP] K1: cannot create a network namespace\n");
+    else
+        test_bitmap_kernel();
+
+    sched_shutdown();
+
+    printf("============================================================\n");
+    printf("  Results: %d passed, %d failed\n", g_pass, g_fail);
+    printf("============================================================\n");
+
+    return (g_fail > 0) ? 1 : 0;
+}
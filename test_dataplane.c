@@ -0,0 +1,1308 @@
+/**
+ * @file test_dataplane.c
+ * @brief Integration test for the user-space forwarding plane.
+ *
+ * Runs in a private network namespace with five veth pairs hN <-> sN.  The
+ * sN ends are attached to the forwarding plane (s0, s1, s3 in VLAN 10, s2 in
+ * VLAN 20, s4 a trunk carrying VLAN 10 tagged with native VLAN 20); frames
+ * are injected and captured on the hN ends.
+ *
+ *   D1: attach five ports
+ *   D2: a broadcast from h0 reaches h1 (same VLAN)
+ *   D3: ... but not h2 (other VLAN)
+ *   D4: a tagged frame on an access port is dropped
+ *   D5: port counters reflect the traffic
+ *   D6: detach, and detach of a port that is not attached
+ *   D7: a learned unicast address is forwarded to its port only
+ *   D8: detaching a port flushes the addresses learned on it
+ *   D9: an access-port broadcast leaves the trunk tagged
+ *   D10: a tagged frame from the trunk leaves access ports untagged
+ *   D11: an untagged frame from the trunk lands in the native VLAN
+ *   D12: a tag the trunk does not carry is dropped
+ *   D13: per-VLAN flood bitmaps follow attach and detach
+ *   D14: VLAN counters, including drops of a tag the trunk does not carry
+ *   D15: with two workers every frame is forwarded exactly once
+ *   D16: the packet buffer pool is set up and holds nothing once idle
+ *   D17: with DP_F_XDP ports forward over AF_XDP where the kernel has it,
+ *        and a port without one RX queue per worker falls back to TPACKET
+ *   D18: an IPv4 frame to the router MAC is routed from VLAN 10 to VLAN 20
+ *        (MACs rewritten, TTL decremented, checksum still valid); one
+ *        without a neighbor or with TTL 1 is dropped
+ *   D19: a port ACL denies one source MAC and counts its hits, a rule
+ *        replaced in place takes effect and keeps its counter, a VLAN ACL
+ *        applies after the port ACL, and a bound ACL cannot be deleted
+ *   D20: storm control cuts a broadcast storm on a port, a multicast storm
+ *        in a VLAN and an unknown-unicast storm down to their bursts and
+ *        counts the drops; known unicast is not metered, and a detached
+ *        port loses its buckets
+ *   D21: with IGMP snooping on VLAN 10, data for a group goes only to the
+ *        port that reported it and to router ports; reports still flood,
+ *        unregistered groups flood, a detached port leaves its groups and
+ *        turning snooping off forgets everything
+ *   D22: s1 and s3 bundled into a LAG take one copy of a flood between
+ *        them, flows spread over both, a frame from one member does not
+ *        return through the other, a member whose link goes down hands its
+ *        flows to the other, and with none up the LAG drops; a member
+ *        moved to another VLAN leaves the hash until it is moved back
+ *   D23: a mirror session on s0's ingress writes every frame, cut to its
+ *        snap length, to a pcap-ng file; one on VLAN 10's egress samples
+ *        1 in 3 and keeps the trunk's tag; a detached port stops being a
+ *        source
+ *   D24: sFlow samples every frame of s0 and about 1 in 4 of s4's, with
+ *        their ports, VLAN, priority and tag, and polls the counters of s0
+ *        and VLAN 10, in datagrams sent to a UDP collector on loopback
+ *   D25: an injected broadcast is traced through parsing, classification,
+ *        learning, lookup and a flood to an access port and the trunk,
+ *        and really forwarded; a known unicast goes to its port, one back
+ *        to its own port is filtered, a tag the port does not carry stops
+ *        the trace at classification; a port sampled for tracing keeps
+ *        traces of the frames it receives until it is detached
+ *   D26: with C-VID 100 translated to VLAN 10 on the trunk, a frame tagged
+ *        100 reaches the access ports and VLAN 10 floods leave the trunk
+ *        tagged 100, while the trunk's own tag 10 is dropped; a VLAN can
+ *        have one C-VID only, a thousand C-VIDs map at once, unmapping
+ *        restores tag 10 and a detached port loses its mappings
+ *   D27: with the ACL table limited to three rules a fourth is refused
+ *        and the list kept, replacing a rule takes no entry and deleting
+ *        gives them back; with the FDB limited to two entries a third
+ *        source is not learned, and worker 0 reports the usage
+ *
+ * Requires CAP_SYS_ADMIN (unshare) and CAP_NET_ADMIN / CAP_NET_RAW; the test
+ * is skipped without them.
+ */
+
+#define _GNU_SOURCE     /* unshare */
+
+#include <errno.h>
+#include <poll.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <linux/if.h>
+#include <linux/if_ether.h>
+#include <linux/if_packet.h>
+#include <netlink/netlink.h>
+#include <netlink/route/link.h>
+#include <netlink/route/link/veth.h>
+
+#include "dataplane.h"
+#include "l3.h"
+#include "res.h"
+
+#define TEST_ETHERTYPE 0x88B5      /* local experimental */
+
+/* -------------------------------------------------------------------------
+ * Helpers
+ * ------------------------------------------------------------------------- */
+
+static int g_pass = 0;
+static int g_fail = 0;
+
+static void check(const char *desc, int got, int expected)
+{
+    if (got == expected)
+    {
+        printf("[PASS] %s  (ret=%d)\n", desc, got);
+        g_pass++;
+    }
+    else
+    {
+        printf("[FAIL] %s  (expected=%d, got=%d)\n", desc, expected, got);
+        g_fail++;
+    }
+}
+
+static int link_up(const char *name)
+{
+    struct ifreq ifr;
+    int fd = socket(AF_INET, SOCK_DGRAM, 0);
+    int ret = -1;
+
+    if (fd < 0)
+        return -1;
+    memset(&ifr, 0, sizeof(ifr));
+    strncpy(ifr.ifr_name, name, IFNAMSIZ - 1);
+    if (ioctl(fd, SIOCGIFFLAGS, &ifr) == 0)
+    {
+        ifr.ifr_flags |= IFF_UP;
+        ret = ioctl(fd, SIOCSIFFLAGS, &ifr);
+    }
+    close(fd);
+    return ret;
+}
+
+static int make_pairs(int n)
+{
+    struct nl_sock *sock = nl_socket_alloc();
+    char a[IFNAMSIZ];
+    char b[IFNAMSIZ];
+    int i;
+    int err = 0;
+
+    if (!sock || nl_connect(sock, NETLINK_ROUTE) < 0)
+        return -1;
+
+    for (i = 0; i < n && err == 0; i++)
+    {
+        snprintf(a, sizeof(a), "h%d", i);
+        snprintf(b, sizeof(b), "s%d", i);
+        err = rtnl_link_veth_add(sock, a, b, getpid());
+        if (err == 0 && (link_up(a) < 0 || link_up(b) < 0))
+            err = -1;
+    }
+    nl_socket_free(sock);
+    return err;
+}
+
+/* Keep IPv6 autoconfiguration traffic out of the counters; best effort. */
+static int disable_ipv6(void)
+{
+    FILE *f = fopen("/proc/sys/net/ipv6/conf/default/disable_ipv6", "w");
+
+    if (f)
+    {
+        fputs("1", f);
+        fclose(f);
+    }
+    return 0;
+}
+
+/*
+ * Open a packet socket on host end @p name for @p proto.  A trunk host uses
+ * ETH_P_ALL: the kernel clears a VLAN tag that no 8021q device claims before
+ * protocol-specific sockets see the frame, so only taps report it.
+ */
+static int open_host(const char *name, uint16_t proto)
+{
+    struct sockaddr_ll sll;
+    struct ifreq ifr;
+    int one = 1;
+    int fd = socket(AF_PACKET, SOCK_RAW | SOCK_NONBLOCK, htons(proto));
+
+    if (fd < 0)
+        return -1;
+    setsockopt(fd, SOL_PACKET, PACKET_AUXDATA, &one, sizeof(one));
+    memset(&ifr, 0, sizeof(ifr));
+    strncpy(ifr.ifr_name, name, IFNAMSIZ - 1);
+    ioctl(fd, SIOCGIFINDEX, &ifr);
+
+    memset(&sll, 0, sizeof(sll));
+    sll.sll_family   = AF_PACKET;
+    sll.sll_protocol = htons(proto);
+    sll.sll_ifindex  = ifr.ifr_ifindex;
+    if (bind(fd, (struct sockaddr *)&sll, sizeof(sll)) < 0)
+    {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+static int g_xlate_seen;
+static void count_xlate(const char *port, uint16_t cvid, uint16_t vid, void *arg)
+{
+    (void)port;
+    (void)arg;
+    if (cvid == 100 && vid == 10)
+        g_xlate_seen++;
+}
+
+/* Send from 02:00:00:00:00:<src> to @p dst, or broadcast if @p dst is NULL;
+ * tagged with @p vid unless it is 0. */
+static int send_to(int fd, const uint8_t *dst, uint8_t src, uint16_t vid, uint8_t marker)
+{
+    uint8_t f[64];
+    size_t off = 12;
+
+    memset(f, 0, sizeof(f));
+    if (dst)
+        memcpy(f, dst, 6);
+    else
+        memset(f, 0xFF, 6);                     /* broadcast */
+    f[6] = 0x02; f[11] = src;                   /* locally administered */
+    if (vid)
+    {
+        f[off++] = 0x81; f[off++] = 0x00;
+        f[off++] = (uint8_t)(vid >> 8); f[off++] = (uint8_t)vid;
+    }
+    f[off++] = TEST_ETHERTYPE >> 8;
+    f[off++] = TEST_ETHERTYPE & 0xFF;
+    f[off]   = marker;
+    return send(fd, f, sizeof(f), 0) == (ssize_t)sizeof(f) ? 0 : -1;
+}
+
+static int send_frame(int fd, int tagged, uint8_t marker)
+{
+    return send_to(fd, NULL, 0x01, tagged ? 10 : 0, marker);
+}
+
+/*
+ * Count frames carrying @p marker within @p ms, like receive_marked(), and
+ * store the VLAN tag of the last one in @p vid (0 if it was untagged).
+ */
+static int receive_vlan(int fd, uint8_t marker, int ms, int *vid)
+{
+    struct pollfd pfd = { .fd = fd, .events = POLLIN };
+    union
+    {
+        struct cmsghdr hdr;
+        char           buf[CMSG_SPACE(sizeof(struct tpacket_auxdata))];
+    } ctl;
+    uint8_t f[2048];
+    int n = 0;
+
+    *vid = -1;
+    while (poll(&pfd, 1, ms) > 0)
+    {
+        struct iovec iov = { .iov_base = f, .iov_len = sizeof(f) };
+        struct msghdr msg = { .msg_iov = &iov, .msg_iovlen = 1,
+                              .msg_control = &ctl, .msg_controllen = sizeof(ctl) };
+        struct cmsghdr *c;
+        ssize_t len = recvmsg(fd, &msg, 0);
+
+        ms = 50;
+        if (len < 15 || f[12] != (TEST_ETHERTYPE >> 8) || f[14] != marker)
+            continue;
+        n++;
+        *vid = 0;
+        for (c = CMSG_FIRSTHDR(&msg); c; c = CMSG_NXTHDR(&msg, c))
+        {
+            struct tpacket_auxdata aux;
+
+            if (c->cmsg_level != SOL_PACKET || c->cmsg_type != PACKET_AUXDATA)
+                continue;
+            memcpy(&aux, CMSG_DATA(c), sizeof(aux));
+            if (aux.tp_status & TP_STATUS_VLAN_VALID)
+                *vid = aux.tp_vlan_tci & 0x0FFF;
+        }
+    }
+    return n;
+}
+
+static int g_fdb_port_hits;
+static void count_port(const struct fdb_entry *e, void *arg)
+{
+    if (e->port == *(const uint8_t *)arg)
+        g_fdb_port_hits++;
+}
+
+/* Count frames carrying @p marker that arrive on @p fd within @p ms. */
+static int receive_marked(int fd, uint8_t marker, int ms)
+{
+    struct pollfd pfd = { .fd = fd, .events = POLLIN };
+    uint8_t f[2048];
+    int n = 0;
+
+    while (poll(&pfd, 1, ms) > 0)
+    {
+        ssize_t len = recv(fd, f, sizeof(f), 0);
+
+        if (len >= 15 && f[14] == marker)
+            n++;
+        ms = 50;
+    }
+    return n;
+}
+
+/* One's complement sum of the IPv4 header at @p ip; 0xFFFF when valid. */
+static uint16_t ip_sum(const uint8_t *ip)
+{
+    uint32_t sum = 0;
+    int k;
+
+    for (k = 0; k < 20; k += 2)
+        sum += (uint32_t)(ip[k] << 8 | ip[k + 1]);
+    while (sum >> 16)
+        sum = (sum & 0xFFFF) + (sum >> 16);
+    return (uint16_t)sum;
+}
+
+/* Send an IPv4 frame from h0's address to @p router, for 10.0.20.<host>. */
+static int send_ip(int fd, const uint8_t *router, uint8_t host, uint8_t ttl, uint8_t marker)
+{
+    uint8_t f[64];
+    uint8_t *ip = f + ETH_HLEN;
+    uint16_t sum;
+
+    memset(f, 0, sizeof(f));
+    memcpy(f, router, 6);
+    f[6] = 0x02; f[11] = 0x01;
+    f[12] = 0x08; f[13] = 0x00;
+    ip[0] = 0x45;
+    ip[3] = 46;                                 /* total length */
+    ip[8] = ttl;
+    ip[9] = 253;                                /* experimental protocol */
+    ip[12] = 10; ip[14] = 10; ip[15] = 2;       /* 10.0.10.2 */
+    ip[16] = 10; ip[18] = 20; ip[19] = host;
+    ip[20] = marker;
+    sum = (uint16_t)~ip_sum(ip);
+    ip[10] = (uint8_t)(sum >> 8);
+    ip[11] = (uint8_t)sum;
+    return send(fd, f, sizeof(f), 0) == (ssize_t)sizeof(f) ? 0 : -1;
+}
+
+/* Receive the IPv4 frame carrying @p marker within @p ms into @p f. */
+static int receive_ip(int fd, uint8_t marker, int ms, uint8_t *f)
+{
+    struct pollfd pfd = { .fd = fd, .events = POLLIN };
+
+    while (poll(&pfd, 1, ms) > 0)
+    {
+        ssize_t len = recv(fd, f, 2048, 0);
+
+        if (len >= ETH_HLEN + 21 && f[12] == 0x08 && f[13] == 0x00 &&
+            f[ETH_HLEN + 9] == 253 && f[ETH_HLEN + 20] == marker)
+            return 0;
+    }
+    return -1;
+}
+
+static int      g_storm_buckets;
+static uint64_t g_storm_drops;
+static void count_storm(const char *port, uint16_t vid, unsigned cls,
+                        const struct storm_rate *rate, uint64_t drops, void *arg)
+{
+    (void)port;
+    (void)vid;
+    (void)cls;
+    (void)rate;
+    (void)arg;
+    g_storm_buckets++;
+    g_storm_drops += drops;
+}
+
+/* Send @p n frames from 02:00:00:00:00:<src> to @p dst, all marked @p marker. */
+static void send_storm(int fd, const uint8_t *dst, uint8_t src, int n, uint8_t marker)
+{
+    while (n-- > 0)
+        send_to(fd, dst, src, 0, marker);
+}
+
+/* Send an IPv4 multicast frame from h-side @p src to @p group: IGMP message
+ * @p igmp_type for the group if it is not 0, else data marked @p marker. */
+static int send_mcast(int fd, uint8_t src, const uint8_t *group, uint8_t igmp_type,
+                      uint8_t marker)
+{
+    uint8_t f[64];
+    uint8_t *ip = f + ETH_HLEN;
+    uint32_t sum = 0;
+    int k;
+
+    memset(f, 0, sizeof(f));
+    f[0] = 0x01; f[2] = 0x5E;
+    f[3] = group[1] & 0x7F; f[4] = group[2]; f[5] = group[3];
+    f[6] = 0x02; f[11] = src;
+    f[12] = 0x08; f[13] = 0x00;
+    ip[0] = 0x45;
+    ip[3] = 28;                                 /* total length */
+    ip[8] = 1;
+    ip[9] = igmp_type ? 2 : 253;
+    ip[12] = 10; ip[14] = 10; ip[15] = src;
+    memcpy(ip + 16, group, 4);
+    if (igmp_type)
+    {
+        ip[20] = igmp_type;
+        if (igmp_type != 0x11)
+            memcpy(ip + 24, group, 4);
+        for (k = 20; k < 28; k += 2)
+            sum += (uint32_t)(ip[k] << 8 | ip[k + 1]);
+        while (sum >> 16)
+            sum = (sum & 0xFFFF) + (sum >> 16);
+        ip[22] = (uint8_t)(~sum >> 8);
+        ip[23] = (uint8_t)~sum;
+    }
+    else
+    {
+        ip[20] = marker;
+    }
+    sum = (uint16_t)~ip_sum(ip);
+    ip[10] = (uint8_t)(sum >> 8);
+    ip[11] = (uint8_t)sum;
+    return send(fd, f, sizeof(f), 0) == (ssize_t)sizeof(f) ? 0 : -1;
+}
+
+/* Count IGMP frames arriving on @p fd within @p ms. */
+static int receive_igmp(int fd, int ms)
+{
+    struct pollfd pfd = { .fd = fd, .events = POLLIN };
+    uint8_t f[2048];
+    int n = 0;
+
+    while (poll(&pfd, 1, ms) > 0)
+    {
+        ssize_t len = recv(fd, f, sizeof(f), 0);
+
+        if (len >= ETH_HLEN + 20 && f[12] == 0x08 && f[ETH_HLEN + 9] == 2)
+            n++;
+        ms = 50;
+    }
+    return n;
+}
+
+static void count_snoop(uint16_t vid, const struct snoop_key *k, int port, uint64_t expires_ms,
+                        void *arg)
+{
+    (void)vid;
+    (void)k;
+    (void)port;
+    (void)expires_ms;
+    (void)arg;
+}
+
+/* Poll for up to a second until the snooper holds @p n entries. */
+static int snoop_wait(int n)
+{
+    int i;
+
+    for (i = 0; i < 100 && dp_snoop_walk(count_snoop, NULL) != n; i++)
+        usleep(10000);
+    return dp_snoop_walk(count_snoop, NULL);
+}
+
+static uint64_t g_acl_hits[4];
+static void count_rule(const struct acl_rule *rule, uint64_t hits, void *arg)
+{
+    (void)arg;
+    if (rule->seq / 10 < 4)
+        g_acl_hits[rule->seq / 10] = hits;
+}
+
+/* Send one broadcast from each of @p n source MACs on @p fd, all marked
+ * @p marker, and count the copies arriving on h-side @p a and @p b. */
+static void send_flows(int fd, int n, uint8_t marker, int a, int b, int *na, int *nb)
+{
+    int k;
+
+    for (k = 0; k < n; k++)
+        send_to(fd, NULL, (uint8_t)(0x40 + k), 0, marker);
+    *na = receive_marked(a, marker, 500);
+    *nb = receive_marked(b, marker, 200);
+}
+
+/* Packet blocks in the pcap-ng file at @p path; @p caplen / @p origlen get
+ * the lengths of the first, @p in and @p tagged count inbound and 802.1Q
+ * tagged packets.  -1 if the file cannot be read. */
+static int pcapng_packets(const char *path, uint32_t *caplen, uint32_t *origlen, int *in,
+                          int *tagged)
+{
+    uint8_t b[65536];
+    FILE *fp = fopen(path, "r");
+    size_t len, off = 0;
+    int n = 0;
+
+    if (!fp)
+        return -1;
+    len = fread(b, 1, sizeof(b), fp);
+    fclose(fp);
+    *in = *tagged = 0;
+    while (off + 12 <= len)
+    {
+        uint32_t type, blen, cap;
+
+        memcpy(&type, b + off, 4);
+        memcpy(&blen, b + off + 4, 4);
+        if (blen < 12 || off + blen > len)
+            return -1;
+        if (type == 6)
+        {
+            memcpy(&cap, b + off + 20, 4);
+            if (n++ == 0)
+            {
+                *caplen = cap;
+                memcpy(origlen, b + off + 24, 4);
+            }
+            *in += b[off + 28 + ((cap + 3) & ~3u) + 4] == 1;
+            *tagged += cap >= 14 && b[off + 28 + 12] == 0x81 && b[off + 28 + 13] == 0x00;
+        }
+        off += blen;
+    }
+    return n;
+}
+
+/* What the sFlow datagrams received by a collector carried. */
+struct sflow_seen
+{
+    int      dgrams;
+    int      flows;          /* flow samples */
+    int      tagged;         /* of them, with an 802.1Q header */
+    int      port_ctrs;      /* counter samples of a port */
+    int      vlan_ctrs;      /* ... of a VLAN */
+    uint32_t input;          /* last flow sample: input ifIndex */
+    uint32_t vid;            /* ... VLAN */
+    uint32_t pcp;            /* ... priority */
+    uint32_t pool;           /* ... sample pool */
+    uint32_t ctr_source;     /* last port counter sample: source */
+    uint32_t in_packets;     /* ... packets received */
+};
+
+/* ifindex of the port in slot @p slot, -1 if none. */
+static int slot_ifindex(unsigned slot)
+{
+    struct dp_port_info pi;
+
+    return dp_get_port(slot, &pi) == 0 ? pi.ifindex : -1;
+}
+
+static uint32_t be32(const uint8_t *p)
+{
+    return (uint32_t)p[0] << 24 | (uint32_t)p[1] << 16 | (uint32_t)p[2] << 8 | p[3];
+}
+
+/* 60-byte frame from 02:00:00:00:00:<src> to @p dst (NULL: broadcast),
+ * tagged with @p vid unless it is 0, carrying @p marker, into @p f. */
+static void build_frame(uint8_t *f, const uint8_t *dst, uint8_t src, uint16_t vid, uint8_t marker)
+{
+    size_t off = 12;
+
+    memset(f, 0, 60);
+    if (dst)
+        memcpy(f, dst, 6);
+    else
+        memset(f, 0xFF, 6);
+    f[6] = 0x02; f[11] = src;
+    if (vid)
+    {
+        f[off++] = 0x81; f[off++] = 0x00;
+        f[off++] = (uint8_t)(vid >> 8); f[off++] = (uint8_t)vid;
+    }
+    f[off++] = TEST_ETHERTYPE >> 8;
+    f[off++] = TEST_ETHERTYPE & 0xFF;
+    f[off] = marker;
+}
+
+/* Whether the steps of @p t went through stages @p stage[0..n) in order. */
+static int trace_path(const struct trace *t, const uint8_t *stage, unsigned n)
+{
+    unsigned i;
+
+    if (t->nsteps != n)
+        return 0;
+    for (i = 0; i < n; i++)
+    {
+        if (t->step[i].stage != stage[i])
+            return 0;
+    }
+    return 1;
+}
+
+/* Add the samples of the datagrams arriving on @p fd within @p ms to @p s. */
+static void receive_sflow(int fd, int ms, struct sflow_seen *s)
+{
+    struct pollfd pfd = { .fd = fd, .events = POLLIN };
+    struct timespec t0, t;
+    uint8_t d[2048];
+    int left = ms;
+
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    while (left > 0)
+    {
+        ssize_t len;
+        size_t off = 28;
+        uint32_t n;
+
+        if (poll(&pfd, 1, left) > 0 && (len = recv(fd, d, sizeof(d), 0)) >= 28 && be32(d) == 5)
+        {
+            s->dgrams++;
+            for (n = be32(d + 24); n > 0 && off + 8 <= (size_t)len; n--)
+            {
+                const uint8_t *p = d + off;
+
+                if (be32(p) == 1)
+                {
+                    const uint8_t *r = p + 40;
+
+                    s->flows++;
+                    s->pool = be32(p + 20);
+                    s->input = be32(p + 28);
+                    s->tagged += be32(r + 20) >= 16 && r[24 + 12] == 0x81 && r[24 + 13] == 0x00;
+                    r += 8 + be32(r + 4);
+                    s->vid = be32(r + 8);
+                    s->pcp = be32(r + 12);
+                }
+                else if (be32(p) == 2 && be32(p + 12) >> 24 == 1)
+                {
+                    s->vlan_ctrs++;
+                }
+                else if (be32(p) == 2)
+                {
+                    s->port_ctrs++;
+                    s->ctr_source = be32(p + 12);
+                    s->in_packets = be32(p + 28 + 32);
+                }
+                off += 8 + be32(p + 4);
+            }
+        }
+        clock_gettime(CLOCK_MONOTONIC, &t);
+        left = ms - (int)((t.tv_sec - t0.tv_sec) * 1000 + (t.tv_nsec - t0.tv_nsec) / 1000000);
+    }
+}
+
+/* -------------------------------------------------------------------------
+ * Main
+ * ------------------------------------------------------------------------- */
+
+int main(void)
+{
+    static const uint8_t mac_h1[6] = { 0x02, 0, 0, 0, 0, 0x11 };
+    static const uint8_t mac_h2[6] = { 0x02, 0, 0, 0, 0, 0x22 };
+    static const uint8_t router[6] = { 0x02, 0, 0, 0, 0, 0xFE };
+    static const uint8_t mac_h5[6] = { 0x02, 0, 0, 0, 0, 0x05 };
+    static const uint8_t mac_group[6] = { 0x01, 0x00, 0x5E, 0, 0, 0x01 };
+    static const uint8_t mac_nobody[6] = { 0x02, 0, 0, 0, 0, 0x77 };
+    struct storm_rate sr;
+    struct dp_acl_info ai;
+    struct dp_lag_info li;
+    struct dp_mirror_info mi;
+    struct dp_mirror_cfg mc;
+    char dir[] = "/tmp/test_dataplane.XXXXXX";
+    char path[64];
+    uint32_t caplen = 0, origlen = 0;
+    int in, tagged;
+    struct dp_sflow_cfg sc;
+    struct dp_sflow_info si;
+    struct sflow_seen seen;
+    struct sockaddr_in sa;
+    socklen_t salen = sizeof(sa);
+    int col;
+    static const uint8_t flood_path[] = { TRACE_PARSE, TRACE_CLASSIFY, TRACE_LEARN, TRACE_LOOKUP,
+                                          TRACE_FORWARD, TRACE_TX, TRACE_TX };
+    static const uint8_t unicast_path[] = { TRACE_PARSE, TRACE_CLASSIFY, TRACE_LEARN,
+                                            TRACE_LOOKUP, TRACE_FORWARD, TRACE_TX };
+    static const uint8_t mac_h0[6] = { 0x02, 0, 0, 0, 0, 0x01 };
+    static struct trace traces[16];
+    uint32_t trace_rate[DP_MAX_PORTS];
+    struct trace tr;
+    struct res_info ri;
+    struct fdb_stats fst;
+    int ok;
+    uint64_t sum;
+    uint8_t fr[DP_TRACE_FRAME_MAX + 1];
+    struct acl_rule rule;
+    struct l3_stats ls;
+    uint8_t rx[2048];
+    struct dp_port_info pi;
+    struct dp_vlan_info vi;
+    struct dp_worker_stats ws;
+    struct dpp_stats ps;
+    static const uint16_t trunk_vids[] = { 10 };
+    static const uint8_t group[4] = { 239, 1, 2, 3 };
+    uint8_t slot;
+    int ip4[3];
+    int h[5];
+    int na, nb;
+    int vid;
+    int i;
+
+    setbuf(stdout, NULL);
+
+    printf("============================================================\n");
+    printf("  virtasic forwarding plane test\n");
+    printf("============================================================\n");
+
+    if (unshare(CLONE_NEWNET) < 0 || disable_ipv6() < 0 || make_pairs(5) < 0)
+    {
+        printf("[SKIP] cannot create a network namespace with veth pairs\n");
+        printf("  Results: %d passed, %d failed\n", g_pass, g_fail);
+        return 0;
+    }
+
+    for (i = 0; i < 5; i++)
+    {
+        char name[IFNAMSIZ];
+
+        snprintf(name, sizeof(name), "h%d", i);
+        h[i] = open_host(name, i == 4 ? ETH_P_ALL : TEST_ETHERTYPE);
+    }
+
+    check("dp_init", dp_init(0, 1, NULL), 0);
+
+    check("D1: attach s0 to VLAN 10", dp_port_attach("s0", 10), 0);
+    check("D1: attach s1 to VLAN 10", dp_port_attach("s1", 10), 0);
+    check("D1: attach s2 to VLAN 20", dp_port_attach("s2", 20), 0);
+    check("D1: attach s3 to VLAN 10", dp_port_attach("s3", 10), 0);
+    check("D1: attach s4 as trunk", dp_port_trunk("s4", 20, trunk_vids, 1), 0);
+    check("D1: attach absent port", dp_port_attach("nonexistent_if0", 10), -ENOENT);
+
+    send_frame(h[0], 0, 0xA1);
+    check("D2: broadcast reaches h1", receive_marked(h[1], 0xA1, 500), 1);
+    check("D3: broadcast does not reach h2", receive_marked(h[2], 0xA1, 100), 0);
+
+    send_frame(h[0], 1, 0xA2);
+    check("D4: tagged frame dropped", receive_marked(h[1], 0xA2, 200), 0);
+
+    /* Slot order follows attach order on a fresh table. */
+    dp_get_port(0, &pi);
+    check("D5: s0 rx_dropped", (int)pi.stats.rx_dropped >= 1, 1);
+    dp_get_port(1, &pi);
+    check("D5: s1 tx_packets", (int)pi.stats.tx_packets >= 1, 1);
+    dp_get_port(2, &pi);
+    check("D5: s2 tx_packets", (int)pi.stats.tx_packets, 0);
+
+    /* h1 announces itself, then h0 sends to it. */
+    send_to(h[1], NULL, 0x11, 0, 0xA3);
+    receive_marked(h[0], 0xA3, 200);
+    send_to(h[0], mac_h1, 0x01, 0, 0xA4);
+    check("D7: unicast reaches h1", receive_marked(h[1], 0xA4, 500), 1);
+    check("D7: unicast not flooded to h3", receive_marked(h[3], 0xA4, 100), 0);
+
+    slot = 1;
+    g_fdb_port_hits = 0;
+    dp_fdb_dump(10, count_port, &slot);
+    check("D8: s1 has learned entries", g_fdb_port_hits > 0, 1);
+
+    check("D6: detach s1", dp_port_detach("s1"), 0);
+    check("D6: detach s1 again", dp_port_detach("s1"), -ENOENT);
+
+    g_fdb_port_hits = 0;
+    dp_fdb_dump(10, count_port, &slot);
+    check("D8: s1 entries flushed on detach", g_fdb_port_hits, 0);
+
+    send_frame(h[0], 0, 0xA5);
+    check("D9: broadcast reaches the trunk", receive_vlan(h[4], 0xA5, 500, &vid), 1);
+    check("D9: ... tagged with VLAN 10", vid, 10);
+
+    send_to(h[4], NULL, 0x44, 10, 0xA6);
+    check("D10: tagged frame reaches h3", receive_vlan(h[3], 0xA6, 500, &vid), 1);
+    check("D10: ... untagged", vid, 0);
+    check("D10: ... not the native VLAN", receive_marked(h[2], 0xA6, 100), 0);
+
+    send_to(h[4], NULL, 0x44, 0, 0xA7);
+    check("D11: untagged frame reaches h2", receive_vlan(h[2], 0xA7, 500, &vid), 1);
+    check("D11: ... untagged", vid, 0);
+
+    send_to(h[4], NULL, 0x44, 30, 0xA8);
+    check("D12: VLAN 30 not carried", receive_marked(h[3], 0xA8, 200) +
+                                       receive_marked(h[2], 0xA8, 100), 0);
+
+    /* Slots follow attach order: s0..s4 = 0..4, s1 detached. */
+    check("D13: VLAN 10 flood list", (int)dp_vlan_ports(10), 0x19);
+    check("D13: VLAN 20 flood list", (int)dp_vlan_ports(20), 0x14);
+    check("D13: VLAN 30 flood list", (int)dp_vlan_ports(30), 0);
+    dp_port_detach("s4");
+    check("D13: trunk detach clears VLAN 10", (int)dp_vlan_ports(10), 0x09);
+    check("D13: ... and its native VLAN", (int)dp_vlan_ports(20), 0x04);
+
+    check("D14: dp_get_vlan", dp_get_vlan(10, &vi), 0);
+    check("D14: VLAN 10 received frames", vi.stats.rx_packets >= 4, 1);
+    check("D14: VLAN 10 sent frames", vi.stats.tx_packets >= 4, 1);
+    check("D14: VLAN 10 has two ports left", (int)vi.nports, 2);
+    dp_get_vlan(30, &vi);
+    check("D14: VLAN 30 drop counted", (int)vi.stats.rx_dropped, 1);
+    check("D14: VLAN out of range", dp_get_vlan(4096, &vi), -EINVAL);
+
+    dp_shutdown();
+
+    check("D15: dp_init with two workers", dp_init(0, 2, NULL), 0);
+    check("D15: two workers", (int)dp_workers(), 2);
+    check("D15: attach s0", dp_port_attach("s0", 10), 0);
+    check("D15: attach s1", dp_port_attach("s1", 10), 0);
+    for (i = 0; i < 16; i++)
+        send_to(h[0], NULL, (uint8_t)(0x10 + i), 0, 0xB0);
+    check("D15: all frames reach h1 once", receive_marked(h[1], 0xB0, 500), 16);
+    dp_get_worker_stats(&ws);
+    check("D15: workers processed every frame", (int)ws.packets, 16);
+    check("D15: no third worker", dp_get_worker(2, &ws), -EINVAL);
+
+    check("D16: dp_get_pool_stats", dp_get_pool_stats(&ps), 0);
+    check("D16: pool has buffers", ps.nbufs > 0, 1);
+    check("D16: nothing held back", (int)ps.in_use, 0);
+    check("D16: never exhausted", (int)ps.exhausted, 0);
+    dp_shutdown();
+
+    check("D17: dp_init with AF_XDP", dp_init(DP_F_XDP, 1, NULL), 0);
+    check("D17: attach s0", dp_port_attach("s0", 10), 0);
+    check("D17: attach s1", dp_port_attach("s1", 10), 0);
+    for (i = 0; i < DP_MAX_PORTS && dp_get_port((unsigned)i, &pi) < 0; i++)
+        ;
+    printf("  s0 backend: %s\n", pi.io == DP_IO_XDP_DRV ? "AF_XDP, native" :
+                                 pi.io == DP_IO_XDP_SKB ? "AF_XDP, generic" : "TPACKET");
+    for (i = 0; i < 16; i++)
+        send_to(h[0], NULL, (uint8_t)(0x10 + i), 0, 0xC0);
+    check("D17: all frames reach h1 once", receive_marked(h[1], 0xC0, 500), 16);
+    dp_shutdown();
+
+    check("D17: dp_init with AF_XDP, two workers", dp_init(DP_F_XDP, 2, NULL), 0);
+    check("D17: attach single-queue s0", dp_port_attach("s0", 10), 0);
+    for (i = 0; i < DP_MAX_PORTS && dp_get_port((unsigned)i, &pi) < 0; i++)
+        ;
+    check("D17: s0 fell back to TPACKET", pi.io, DP_IO_TPACKET);
+    dp_shutdown();
+
+    check("D18: l3_init", l3_init(0), 0);
+    check("D18: dp_init", dp_init(0, 1, NULL), 0);
+    check("D18: attach s0", dp_port_attach("s0", 10), 0);
+    check("D18: attach s2", dp_port_attach("s2", 20), 0);
+    check("D18: router MAC on VLAN 10", dp_vlan_router(10, router), 0);
+    check("D18: router MAC on VLAN 20", dp_vlan_router(20, router), 0);
+    check("D18: router on VLAN 0", dp_vlan_router(0, router), -EINVAL);
+    check("D18: connected route", l3_route_add(0x0A001400, 24, 0, 20), 0);
+    check("D18: neighbor 10.0.20.2", l3_neigh_set(20, 0x0A001402, mac_h2), 0);
+    l3_get_stats(&ls);
+    check("D18: one route", (int)ls.routes, 1);
+    check("D18: one neighbor", (int)ls.neighbors, 1);
+
+    i = open_host("h2", ETH_P_IP);
+    send_ip(h[0], router, 2, 64, 0xD0);
+    check("D18: routed frame reaches h2", receive_ip(i, 0xD0, 500, rx), 0);
+    check("D18: destination is the neighbor", memcmp(rx, mac_h2, 6), 0);
+    check("D18: source is the router", memcmp(rx + 6, router, 6), 0);
+    check("D18: TTL decremented", rx[ETH_HLEN + 8], 63);
+    check("D18: header checksum valid", ip_sum(rx + ETH_HLEN), 0xFFFF);
+    send_ip(h[0], router, 3, 64, 0xD1);
+    check("D18: no neighbor, dropped", receive_ip(i, 0xD1, 200, rx), -1);
+    send_ip(h[0], router, 2, 1, 0xD2);
+    check("D18: TTL 1, dropped", receive_ip(i, 0xD2, 200, rx), -1);
+    dp_get_worker_stats(&ws);
+    check("D18: one frame routed", (int)ws.routed, 1);
+    check("D18: two route drops", (int)ws.route_drops, 2);
+    close(i);
+    dp_shutdown();
+    l3_shutdown();
+
+    memset(&rule, 0, sizeof(rule));
+    rule.seq = 10;
+    rule.action = ACL_DENY;
+    rule.fields = ACL_M_SRC_MAC;
+    memcpy(rule.src_mac, mac_h5, 6);
+    check("D19: dp_acl_rule_add before dp_init", dp_acl_rule_add("edge", &rule), -ENODEV);
+    check("D19: dp_init with two workers", dp_init(0, 2, NULL), 0);
+    check("D19: attach s0", dp_port_attach("s0", 10), 0);
+    check("D19: attach s1", dp_port_attach("s1", 10), 0);
+    check("D19: add deny rule", dp_acl_rule_add("edge", &rule), 0);
+    check("D19: bind unknown ACL", dp_acl_bind_port("s0", "nope"), -ENOENT);
+    check("D19: bind to absent port", dp_acl_bind_port("s4", "edge"), -ENOENT);
+    check("D19: bind to s0", dp_acl_bind_port("s0", "edge"), 0);
+    send_to(h[0], NULL, 0x05, 0, 0xE0);
+    check("D19: denied source dropped", receive_marked(h[1], 0xE0, 200), 0);
+    send_to(h[0], NULL, 0x06, 0, 0xE1);
+    check("D19: other source forwarded", receive_marked(h[1], 0xE1, 500), 1);
+    check("D19: dump", dp_acl_dump("edge", count_rule, NULL), 1);
+    check("D19: rule hit once", (int)g_acl_hits[1], 1);
+    check("D19: dp_get_acl", dp_get_acl(0, &ai), 0);
+    check("D19: one rule, one port", (int)(ai.nrules * 10 + ai.nports), 11);
+    check("D19: default hit once", (int)ai.no_match, 1);
+    dp_get_worker_stats(&ws);
+    check("D19: one ACL drop", (int)ws.acl_drops, 1);
+
+    rule.action = ACL_PERMIT;
+    check("D19: replace rule 10", dp_acl_rule_add("edge", &rule), 0);
+    send_to(h[0], NULL, 0x05, 0, 0xE2);
+    check("D19: replaced rule permits", receive_marked(h[1], 0xE2, 500), 1);
+    dp_acl_dump("edge", count_rule, NULL);
+    check("D19: counter kept across the edit", (int)g_acl_hits[1], 2);
+
+    check("D19: empty deny-all ACL", dp_acl_default("v10", ACL_DENY), 0);
+    check("D19: bind to VLAN 10", dp_acl_bind_vlan(10, "v10"), 0);
+    send_to(h[0], NULL, 0x06, 0, 0xE3);
+    check("D19: VLAN ACL denies", receive_marked(h[1], 0xE3, 200), 0);
+    check("D19: unbind VLAN 10", dp_acl_bind_vlan(10, NULL), 0);
+    send_to(h[0], NULL, 0x06, 0, 0xE4);
+    check("D19: unbound VLAN forwards", receive_marked(h[1], 0xE4, 500), 1);
+
+    check("D19: delete bound ACL", dp_acl_delete("edge"), -EBUSY);
+    check("D19: delete rule", dp_acl_rule_del("edge", 10), 0);
+    check("D19: delete absent rule", dp_acl_rule_del("edge", 10), -ENOENT);
+    check("D19: unbind s0", dp_acl_bind_port("s0", NULL), 0);
+    check("D19: delete ACL", dp_acl_delete("edge"), 0);
+    check("D19: ... gone", dp_acl_delete("edge"), -ENOENT);
+    dp_get_worker_stats(&ws);
+    check("D19: two ACL drops in total", (int)ws.acl_drops, 2);
+    dp_shutdown();
+
+    sr = (struct storm_rate){ .rate = 1, .burst = 5 };
+    check("D20: dp_storm_port before dp_init", dp_storm_port("s0", STORM_BCAST, &sr), -ENODEV);
+    check("D20: dp_init", dp_init(0, 1, NULL), 0);
+    check("D20: attach s0", dp_port_attach("s0", 10), 0);
+    check("D20: attach s1", dp_port_attach("s1", 10), 0);
+    check("D20: absent port", dp_storm_port("s4", STORM_BCAST, &sr), -ENOENT);
+    check("D20: bad class", dp_storm_port("s0", STORM_NCLASSES, &sr), -EINVAL);
+    check("D20: broadcast on s0, 1 pps burst 5", dp_storm_port("s0", STORM_BCAST, &sr), 0);
+    send_storm(h[0], NULL, 0x01, 20, 0xF0);
+    check("D20: broadcast storm cut to the burst", receive_marked(h[1], 0xF0, 500), 5);
+    sr.burst = 3;
+    check("D20: multicast in VLAN 10, burst 3", dp_storm_vlan(10, STORM_MCAST, &sr), 0);
+    send_storm(h[0], mac_group, 0x01, 20, 0xF1);
+    check("D20: multicast storm cut to the burst", receive_marked(h[1], 0xF1, 500), 3);
+    sr.burst = 2;
+    check("D20: unknown unicast on s0, burst 2", dp_storm_port("s0", STORM_UNKNOWN, &sr), 0);
+    send_storm(h[0], mac_nobody, 0x01, 20, 0xF2);
+    check("D20: unknown unicast storm cut to the burst", receive_marked(h[1], 0xF2, 500), 2);
+    send_to(h[1], NULL, 0x02, 0, 0xF3);                 /* s1 learns 02::02 */
+    receive_marked(h[0], 0xF3, 200);
+    send_storm(h[0], (const uint8_t[6]){ 0x02, 0, 0, 0, 0, 0x02 }, 0x01, 20, 0xF4);
+    check("D20: known unicast not metered", receive_marked(h[1], 0xF4, 500), 20);
+    g_storm_drops = 0;
+    check("D20: three buckets", dp_storm_walk(count_storm, NULL), 3);
+    check("D20: their drops", (int)g_storm_drops, 15 + 17 + 18);
+    dp_get_worker_stats(&ws);
+    check("D20: worker storm drops", (int)ws.storm_drops, 15 + 17 + 18);
+    check("D20: broadcast limit off", dp_storm_port("s0", STORM_BCAST, NULL), 0);
+    send_storm(h[0], NULL, 0x01, 20, 0xF5);
+    check("D20: broadcast passes again", receive_marked(h[1], 0xF5, 500), 20);
+    check("D20: detach s0", dp_port_detach("s0"), 0);
+    g_storm_buckets = 0;
+    check("D20: only the VLAN bucket left", dp_storm_walk(count_storm, NULL), 1);
+    dp_shutdown();
+
+    check("D21: dp_snoop_vlan before dp_init", dp_snoop_vlan(10, 1), -ENODEV);
+    check("D21: dp_init", dp_init(0, 1, NULL), 0);
+    check("D21: attach s0", dp_port_attach("s0", 10), 0);
+    check("D21: attach s1", dp_port_attach("s1", 10), 0);
+    check("D21: attach s3", dp_port_attach("s3", 10), 0);
+    check("D21: bad VLAN", dp_snoop_vlan(4095, 1), -EINVAL);
+    check("D21: snoop VLAN 10", dp_snoop_vlan(10, 1), 0);
+    check("D21: ... enabled", dp_snoop_vlan_enabled(10), 1);
+    for (i = 0; i < 3; i++)
+        ip4[i] = open_host(i == 0 ? "h0" : i == 1 ? "h1" : "h3", ETH_P_IP);
+    send_mcast(ip4[1], 0x11, group, 0x16, 0);
+    check("D21: report floods to h3", receive_igmp(ip4[2], 500), 1);
+    check("D21: ... and h0", receive_igmp(ip4[0], 200), 1);
+    check("D21: h1 joined", snoop_wait(1), 1);
+    send_mcast(ip4[0], 0x01, group, 0, 0xD1);
+    check("D21: group data reaches h1", receive_ip(ip4[1], 0xD1, 500, rx), 0);
+    check("D21: ... but not h3", receive_ip(ip4[2], 0xD1, 200, rx), -1);
+    send_mcast(ip4[0], 0x01, (const uint8_t[4]){ 239, 9, 9, 9 }, 0, 0xD2);
+    check("D21: unregistered group floods", receive_ip(ip4[2], 0xD2, 500, rx), 0);
+    send_mcast(ip4[2], 0x13, (const uint8_t[4]){ 224, 0, 0, 1 }, 0x11, 0);
+    check("D21: query floods to h0", receive_igmp(ip4[0], 500), 1);
+    check("D21: s3 is a router port", snoop_wait(2), 2);
+    send_mcast(ip4[0], 0x01, group, 0, 0xD3);
+    check("D21: group data reaches the router port", receive_ip(ip4[2], 0xD3, 500, rx), 0);
+    dp_get_worker_stats(&ws);
+    check("D21: pruned floods counted", (int)ws.mcast_pruned, 2);
+    check("D21: detach s1", dp_port_detach("s1"), 0);
+    check("D21: its membership goes", snoop_wait(1), 1);
+    check("D21: snooping off", dp_snoop_vlan(10, 0), 0);
+    check("D21: nothing left", dp_snoop_walk(count_snoop, NULL), 0);
+    check("D21: ... disabled", dp_snoop_vlan_enabled(10), 0);
+    dp_shutdown();
+    for (i = 0; i < 3; i++)
+        close(ip4[i]);
+
+    check("D22: dp_lag_create before dp_init", dp_lag_create("lag1", LAG_HASH_L2), -ENODEV);
+    check("D22: dp_init", dp_init(0, 1, NULL), 0);
+    check("D22: attach s0", dp_port_attach("s0", 10), 0);
+    check("D22: attach s1", dp_port_attach("s1", 10), 0);
+    check("D22: attach s3", dp_port_attach("s3", 10), 0);
+    check("D22: bad policy", dp_lag_create("lag1", 9), -EINVAL);
+    check("D22: absent LAG", dp_lag_add_port("lag1", "s1"), -ENOENT);
+    check("D22: create lag1", dp_lag_create("lag1", LAG_HASH_L2), 0);
+    check("D22: ... twice", dp_lag_create("lag1", LAG_HASH_L2), -EEXIST);
+    check("D22: add s1", dp_lag_add_port("lag1", "s1"), 0);
+    check("D22: add s3", dp_lag_add_port("lag1", "s3"), 0);
+    check("D22: s1 a member already", dp_lag_add_port("lag1", "s1"), -EEXIST);
+    check("D22: create lag2", dp_lag_create("lag2", LAG_HASH_L3), 0);
+    check("D22: s1 in another LAG", dp_lag_add_port("lag2", "s1"), -EBUSY);
+    check("D22: delete lag2", dp_lag_delete("lag2"), 0);
+    check("D22: lag1 in entry 0", dp_get_lag(0, &li), 0);
+    check("D22: ... two ports attached and up",
+          __builtin_popcountll(li.ports) == 2 && li.up == li.ports, 1);
+    memset(&pi, 0, sizeof(pi));
+    for (slot = 0; slot < DP_MAX_PORTS; slot++)
+    {
+        if (dp_get_port(slot, &pi) == 0 && strcmp(pi.name, "s3") == 0)
+            break;
+    }
+    check("D22: s3 shows its LAG", strcmp(pi.lag, "lag1"), 0);
+    send_flows(h[0], 32, 0xE0, h[1], h[3], &na, &nb);
+    check("D22: 32 flows, one copy each", na + nb, 32);
+    check("D22: ... over both members", na > 0 && nb > 0, 1);
+    send_to(h[1], NULL, 0x11, 0, 0xE1);
+    check("D22: a member's flood reaches h0", receive_marked(h[0], 0xE1, 500), 1);
+    check("D22: ... but not the other member", receive_marked(h[3], 0xE1, 200), 0);
+    check("D22: absent port's link", dp_lag_link("s2", 0), -ENOENT);
+    check("D22: s1 link down", dp_lag_link("s1", 0), 0);
+    send_flows(h[0], 32, 0xE2, h[1], h[3], &na, &nb);
+    check("D22: all flows on s3", nb, 32);
+    check("D22: ... none on s1", na, 0);
+    check("D22: s3 link down", dp_lag_link("s3", 0), 0);
+    send_flows(h[0], 4, 0xE3, h[1], h[3], &na, &nb);
+    check("D22: no member up, nothing sent", na + nb, 0);
+    dp_get_worker_stats(&ws);
+    check("D22: drops counted", (int)ws.lag_drops, 4);
+    check("D22: s1 link up", dp_lag_link("s1", 1), 0);
+    check("D22: s3 link up", dp_lag_link("s3", 1), 0);
+    check("D22: s3 moved to VLAN 20", dp_port_attach("s3", 20), 0);
+    check("D22: ... leaves the hash", dp_get_lag(0, &li) == 0 && __builtin_popcountll(li.up) == 1, 1);
+    send_flows(h[0], 32, 0xE5, h[1], h[3], &na, &nb);
+    check("D22: all flows on s1", na, 32);
+    check("D22: ... none on s3", nb, 0);
+    check("D22: s3 back in VLAN 10", dp_port_attach("s3", 10), 0);
+    check("D22: ... rejoins the hash", dp_get_lag(0, &li) == 0 && li.up == li.ports, 1);
+    check("D22: remove s3", dp_lag_del_port("lag1", "s3"), 0);
+    send_to(h[0], NULL, 0x01, 0, 0xE4);
+    check("D22: s3 on its own again", receive_marked(h[3], 0xE4, 500), 1);
+    check("D22: ... and s1 in lag1", receive_marked(h[1], 0xE4, 200), 1);
+    check("D22: delete lag1", dp_lag_delete("lag1"), 0);
+    check("D22: ... gone", dp_get_lag(0, &li), -ENOENT);
+    dp_shutdown();
+
+    memset(&mc, 0, sizeof(mc));
+    check("D23: dp_mirror_create before dp_init", dp_mirror_create("m1", &mc), -EINVAL);
+    snprintf(mc.prefix, sizeof(mc.prefix), "%s/m1", mkdtemp(dir) ? dir : "/tmp");
+    check("D23: ... with a prefix", dp_mirror_create("m1", &mc), -ENODEV);
+    check("D23: dp_init", dp_init(0, 1, NULL), 0);
+    check("D23: attach s0", dp_port_attach("s0", 10), 0);
+    check("D23: attach s1", dp_port_attach("s1", 10), 0);
+    check("D23: attach s4 as trunk", dp_port_trunk("s4", 20, trunk_vids, 1), 0);
+    mc.snaplen = MIRROR_SNAPLEN_MAX + 1;
+    check("D23: bad snap length", dp_mirror_create("m1", &mc), -EINVAL);
+    mc.snaplen = 32;
+    check("D23: create m1, snap length 32", dp_mirror_create("m1", &mc), 0);
+    check("D23: ... twice", dp_mirror_create("m1", &mc), -EEXIST);
+    check("D23: absent session", dp_mirror_port("m9", "s0", MIRROR_RX), -ENOENT);
+    check("D23: absent port", dp_mirror_port("m1", "s2", MIRROR_RX), -ENOENT);
+    check("D23: bad direction", dp_mirror_port("m1", "s0", 4), -EINVAL);
+    check("D23: m1 on s0 rx", dp_mirror_port("m1", "s0", MIRROR_RX), 0);
+    send_storm(h[0], NULL, 0x01, 5, 0xC0);
+    check("D23: frames still forwarded", receive_marked(h[1], 0xC0, 500), 5);
+    check("D23: m1 sources", dp_get_mirror(0, &mi) == 0 && mi.ports[0] == 1 && mi.ports[1] == 0, 1);
+    check("D23: delete m1", dp_mirror_delete("m1"), 0);
+    snprintf(path, sizeof(path), "%s/m1.0.pcapng", dir);
+    check("D23: five packets in the file", pcapng_packets(path, &caplen, &origlen, &in, &tagged), 5);
+    check("D23: ... cut to 32 of 64 bytes", caplen == 32 && origlen == 64, 1);
+    check("D23: ... all inbound", in, 5);
+
+    snprintf(mc.prefix, sizeof(mc.prefix), "%s/m2", dir);
+    mc.snaplen = 0;
+    mc.sample = 3;
+    check("D23: create m2, 1 in 3", dp_mirror_create("m2", &mc), 0);
+    check("D23: bad VLAN", dp_mirror_vlan("m2", 4095, MIRROR_TX), -EINVAL);
+    check("D23: m2 on VLAN 10 tx", dp_mirror_vlan("m2", 10, MIRROR_TX), 0);
+    check("D23: ... and s1 rx", dp_mirror_port("m2", "s1", MIRROR_RX), 0);
+    send_storm(h[0], NULL, 0x01, 8, 0xC1);
+    check("D23: broadcasts reach the trunk", receive_marked(h[4], 0xC1, 500), 8);
+    check("D23: s1 detached", dp_port_detach("s1"), 0);
+    check("D23: ... and no longer a source", dp_get_mirror(0, &mi) == 0 && mi.ports[0] == 0 &&
+          (mi.vlans[1][0] >> 10 & 1), 1);
+    check("D23: no copy dropped", (int)mi.drops, 0);
+    dp_shutdown();
+    snprintf(path, sizeof(path), "%s/m2.0.pcapng", dir);
+    check("D23: 16 copies sent, 5 sampled", pcapng_packets(path, &caplen, &origlen, &in, &tagged), 5);
+    check("D23: ... outbound", in, 0);
+    check("D23: ... the trunk's tagged", tagged > 0 && tagged < 5, 1);
+    snprintf(path, sizeof(path), "rm -rf %s", dir);
+    if (system(path) != 0)
+        printf("cannot remove %s\n", dir);
+
+    memset(&sc, 0, sizeof(sc));
+    memset(&sa, 0, sizeof(sa));
+    sa.sin_family = AF_INET;
+    sa.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    col = socket(AF_INET, SOCK_DGRAM, 0);
+    check("D24: collector on loopback", link_up("lo") == 0 && col >= 0 &&
+          bind(col, (struct sockaddr *)&sa, sizeof(sa)) == 0 &&
+          getsockname(col, (struct sockaddr *)&sa, &salen) == 0, 1);
+    memcpy(sc.collector, &sa.sin_addr, 4);
+    sc.port = ntohs(sa.sin_port);
+    sc.agent[0] = 192; sc.agent[2] = 2; sc.agent[3] = 1;
+    sc.poll_s = 1;
+    check("D24: dp_sflow_enable before dp_init", dp_sflow_enable(&sc), -ENODEV);
+    check("D24: dp_init", dp_init(0, 1, NULL), 0);
+    check("D24: attach s0", dp_port_attach("s0", 10), 0);
+    check("D24: attach s1", dp_port_attach("s1", 10), 0);
+    check("D24: attach s4 as trunk", dp_port_trunk("s4", 20, trunk_vids, 1), 0);
+    check("D24: port before the agent", dp_sflow_port("s0", 1), -ENOTCONN);
+    check("D24: disable before enable", dp_sflow_disable(), -ENOENT);
+    sc.header = DP_SFLOW_HEADER_MAX + 1;
+    check("D24: bad header length", dp_sflow_enable(&sc), -EINVAL);
+    sc.header = 0;
+    check("D24: enable", dp_sflow_enable(&sc), 0);
+    check("D24: absent port", dp_sflow_port("s2", 1), -ENOENT);
+    check("D24: rate too high", dp_sflow_port("s0", SFLOW_RATE_MAX + 1), -EINVAL);
+    check("D24: bad VLAN", dp_sflow_vlan(0, 1), -EINVAL);
+    check("D24: sample all of s0", dp_sflow_port("s0", 1), 0);
+    check("D24: poll VLAN 10", dp_sflow_vlan(10, 1), 0);
+    send_storm(h[0], NULL, 0x01, 5, 0xD0);
+    memset(&seen, 0, sizeof(seen));
+    receive_sflow(col, 1500, &seen);
+    check("D24: five flow samples", seen.flows, 5);
+    check("D24: ... from s0", (int)seen.input, slot_ifindex(0));
+    check("D24: ... in VLAN 10, untagged", (int)seen.vid == 10 && seen.tagged == 0, 1);
+    check("D24: ... out of a pool of 5", (int)seen.pool, 5);
+    check("D24: s0 counters polled", seen.port_ctrs >= 1 && seen.ctr_source == (uint32_t)slot_ifindex(0), 1);
+    check("D24: ... with its packets", (int)seen.in_packets, 5);
+    check("D24: VLAN 10 counters polled", seen.vlan_ctrs >= 1, 1);
+
+    check("D24: s0 no longer sampled", dp_sflow_port("s0", 0), 0);
+    check("D24: sample 1 in 4 of s4", dp_sflow_port("s4", 4), 0);
+    check("D24: stop polling VLAN 10", dp_sflow_vlan(10, 0), 0);
+    for (i = 0; i < 400; i++)
+        send_to(h[4], NULL, 0x04, 5 << 13 | 10, 0xD1);
+    memset(&seen, 0, sizeof(seen));
+    receive_sflow(col, 1500, &seen);
+    check("D24: 400 frames, 60..140 sampled", seen.flows >= 60 && seen.flows <= 140, 1);
+    check("D24: ... from s4", (int)seen.input, slot_ifindex(2));
+    check("D24: ... tagged, VLAN 10, priority 5",
+          seen.tagged == seen.flows && seen.vid == 10 && seen.pcp == 5, 1);
+    check("D24: ... pool within the 400", seen.pool > 300 && seen.pool <= 400, 1);
+    check("D24: only s4's counters", seen.vlan_ctrs == 0 && seen.ctr_source == (uint32_t)slot_ifindex(2), 1);
+    check("D24: agent state", dp_get_sflow(&si) == 0 && si.enabled && si.rate[2] == 4 &&
+          si.rate[0] == 0 && si.drops == 0 && si.datagrams >= (uint64_t)seen.dgrams, 1);
+    check("D24: s4 detached", dp_port_detach("s4"), 0);
+    check("D24: ... and no longer sampled", dp_get_sflow(&si) == 0 && si.rate[2] == 0, 1);
+    check("D24: disable", dp_sflow_disable(), 0);
+    check("D24: ... twice", dp_sflow_disable(), -ENOENT);
+    check("D24: agent off", dp_get_sflow(&si) == 0 && si.enabled == 0 && si.samples == 0, 1);
+    dp_shutdown();
+    close(col);
+
+    /* Earlier tests leave frames nobody read; full queues would drop more. */
+    for (i = 0; i < 5; i++)
+        receive_marked(h[i], 0, 10);
+    build_frame(fr, NULL, 0x01, 0, 0xE0);
+    check("D25: dp_trace_inject before dp_init", dp_trace_inject("s0", fr, 60, &tr), -ENODEV);
+    check("D25: dp_init", dp_init(0, 1, NULL), 0);
+    check("D25: attach s0", dp_port_attach("s0", 10), 0);
+    check("D25: attach s1", dp_port_attach("s1", 10), 0);
+    check("D25: attach s4 as trunk", dp_port_trunk("s4", 20, trunk_vids, 1), 0);
+    check("D25: absent port", dp_trace_inject("s2", fr, 60, &tr), -ENOENT);
+    check("D25: runt", dp_trace_inject("s0", fr, 13, &tr), -EINVAL);
+    check("D25: too long", dp_trace_inject("s0", fr, DP_TRACE_FRAME_MAX + 1, &tr), -EMSGSIZE);
+    check("D25: broadcast on s0", dp_trace_inject("s0", fr, 60, &tr), 0);
+    check("D25: ... parse, classify, learn, lookup, flood, two tx",
+          trace_path(&tr, flood_path, 7), 1);
+    check("D25: ... untagged, VLAN 10", tr.step[0].arg == 0 && tr.step[1].arg == 10, 1);
+    check("D25: ... lookup missed, flooded",
+          tr.step[3].verdict == TRACE_MISS && tr.step[4].verdict == TRACE_FLOOD, 1);
+    check("D25: ... to s1 untagged and s4 tagged",
+          tr.step[5].verdict == TRACE_SENT && tr.step[6].verdict == TRACE_SENT &&
+          tr.step[5].port == 1 && tr.step[5].arg == 0 &&
+          tr.step[6].port == 2 && (tr.step[6].arg & 0x0FFF) == 10, 1);
+    for (sum = 0, i = 0; i < tr.nsteps; i++)
+        sum += tr.step[i].cycles;
+    check("D25: ... timed", tr.cycles > 0 && sum == tr.cycles && !tr.dropped, 1);
+    check("D25: ... the frame kept", tr.port == 0 && tr.len == 60 && memcmp(tr.head, fr, 12) == 0, 1);
+    check("D25: ... and forwarded to h1", receive_marked(h[1], 0xE0, 500), 1);
+    check("D25: ... and to h4, tagged", receive_vlan(h[4], 0xE0, 500, &vid) == 1 && vid == 10, 1);
+
+    build_frame(fr, mac_h0, 0x11, 0, 0xE1);
+    check("D25: unicast to h0 on s1", dp_trace_inject("s1", fr, 60, &tr), 0);
+    check("D25: ... one tx", trace_path(&tr, unicast_path, 6), 1);
+    check("D25: ... found on s0", tr.step[3].verdict == TRACE_HIT && tr.step[3].port == 0 &&
+          tr.step[4].verdict == TRACE_UNICAST && tr.step[5].port == 0, 1);
+    check("D25: ... reaches h0", receive_marked(h[0], 0xE1, 500), 1);
+    check("D25: ... only", receive_marked(h[4], 0xE1, 200), 0);
+    build_frame(fr, mac_h0, 0x05, 0, 0xE2);
+    check("D25: unicast back to s0", dp_trace_inject("s0", fr, 60, &tr), 0);
+    check("D25: ... filtered", tr.nsteps == 5 && tr.step[4].verdict == TRACE_FILTER, 1);
+    build_frame(fr, NULL, 0x01, 20, 0xE3);
+    check("D25: VLAN 20 tag on s0", dp_trace_inject("s0", fr, 60, &tr), 0);
+    check("D25: ... parsed tagged", tr.step[0].verdict == TRACE_PASS &&
+          tr.step[0].arg == (TRACE_TAGGED | 20), 1);
+    check("D25: ... dropped at classification", tr.nsteps == 2 &&
+          tr.step[1].verdict == TRACE_DROP && tr.step[1].arg == 20 && tr.dropped, 1);
+
+    check("D25: no sampled trace yet", dp_get_traces(traces, 16), 0);
+    check("D25: sample an absent port", dp_trace_sample("s2", 1), -ENOENT);
+    check("D25: sample every frame of s1", dp_trace_sample("s1", 1), 0);
+    for (i = 0; i < 3; i++)
+    {
+        send_to(h[1], NULL, 0x11, 0, 0xE4);
+        usleep(20000);
+    }
+    check("D25: ... forwarded", receive_marked(h[0], 0xE4, 500), 3);
+    check("D25: three traces", dp_get_traces(traces, 16), 3);
+    check("D25: ... newest first", traces[0].ts_ns > traces[1].ts_ns &&
+          traces[1].ts_ns > traces[2].ts_ns, 1);
+    check("D25: ... of s1's floods", traces[0].port == 1 && trace_path(&traces[0], flood_path, 7), 1);
+    check("D25: ... at most as many as asked", dp_get_traces(traces, 2), 2);
+    check("D25: rate shown", dp_get_trace_rates(trace_rate) == 0 && trace_rate[1] == 1, 1);
+    check("D25: s1 detached", dp_port_detach("s1"), 0);
+    check("D25: ... and no longer sampled", dp_get_trace_rates(trace_rate) == 0 &&
+          trace_rate[1] == 0, 1);
+    dp_shutdown();
+
+    for (i = 0; i < 5; i++)
+        receive_marked(h[i], 0, 10);
+    check("D26: dp_vlan_xlate before dp_init", dp_vlan_xlate("s4", 100, 10, 1), -ENODEV);
+    check("D26: dp_init", dp_init(0, 1, NULL), 0);
+    check("D26: attach s0", dp_port_attach("s0", 10), 0);
+    check("D26: attach s1", dp_port_attach("s1", 10), 0);
+    check("D26: attach s4 as trunk", dp_port_trunk("s4", 20, trunk_vids, 1), 0);
+    check("D26: absent port", dp_vlan_xlate("s2", 100, 10, 1), -ENOENT);
+    check("D26: bad range", dp_vlan_xlate("s4", 4000, 10, 100), -EINVAL);
+    check("D26: C-VID 100 to VLAN 10 on s4", dp_vlan_xlate("s4", 100, 10, 1), 0);
+    send_to(h[4], NULL, 0x41, 100, 0xF0);
+    check("D26: tag 100 from h4 reaches h0", receive_vlan(h[0], 0xF0, 500, &vid) == 1 && vid == 0, 1);
+    send_frame(h[0], 0, 0xF1);
+    check("D26: a VLAN 10 flood leaves h4 tagged 100",
+          receive_vlan(h[4], 0xF1, 500, &vid) == 1 && vid == 100, 1);
+    send_to(h[4], NULL, 0x41, 10, 0xF2);
+    check("D26: tag 10 from h4 is dropped", receive_marked(h[0], 0xF2, 200), 0);
+    build_frame(fr, NULL, 0x41, 100, 0xF3);
+    check("D26: traced, tag 100 on s4", dp_trace_inject("s4", fr, 60, &tr), 0);
+    check("D26: ... classified into VLAN 10", tr.nsteps > 2 && tr.step[0].arg == (TRACE_TAGGED | 100) &&
+          tr.step[1].verdict == TRACE_PASS && tr.step[1].arg == 10, 1);
+    check("D26: VLAN 10 has a C-VID already", dp_vlan_xlate("s4", 200, 10, 1), -EEXIST);
+    check("D26: C-VIDs 1000..1999 to 2000..2999", dp_vlan_xlate("s4", 1000, 2000, 1000), 0);
+    g_xlate_seen = 0;
+    check("D26: 1001 mappings", dp_vlan_xlate_walk(count_xlate, NULL), 1001);
+    check("D26: ... 100 to 10 among them", g_xlate_seen, 1);
+    check("D26: unmap C-VID 100", dp_vlan_xlate("s4", 100, 0, 1), 0);
+    send_to(h[4], NULL, 0x41, 10, 0xF4);
+    check("D26: tag 10 passes again", receive_marked(h[0], 0xF4, 500), 1);
+    send_to(h[4], NULL, 0x41, 100, 0xF5);
+    check("D26: ... tag 100 no longer", receive_marked(h[0], 0xF5, 200), 0);
+    check("D26: s4 detached", dp_port_detach("s4"), 0);
+    check("D26: ... without mappings", dp_vlan_xlate_walk(count_xlate, NULL), 0);
+    dp_shutdown();
+
+    for (i = 0; i < 5; i++)
+        receive_marked(h[i], 0, 10);
+    check("D27: FDB capacity 2 before dp_init", dp_fdb_set_capacity(2), 0);
+    check("D27: dp_init", dp_init(0, 1, NULL), 0);
+    check("D27: attach s0", dp_port_attach("s0", 10), 0);
+    check("D27: attach s1", dp_port_attach("s1", 10), 0);
+    check("D27: ACL capacity 3", res_set_capacity(RES_ACL, 3), 0);
+    memset(&rule, 0, sizeof(rule));
+    rule.action = ACL_DENY;
+    rule.fields = ACL_M_SRC_MAC;
+    for (ok = 1, i = 1; i <= 3; i++)
+    {
+        rule.seq = (uint32_t)(10 * i);
+        ok &= dp_acl_rule_add("cap", &rule) == 0;
+    }
+    check("D27: three rules", ok, 1);
+    rule.seq = 40;
+    check("D27: a fourth is refused", dp_acl_rule_add("cap", &rule), -ENOSPC);
+    check("D27: ... and the list kept", dp_acl_dump("cap", count_rule, NULL), 3);
+    rule.seq = 20;
+    rule.action = ACL_PERMIT;
+    check("D27: replacing rule 20 fits", dp_acl_rule_add("cap", &rule), 0);
+    check("D27: rule 30 deleted", dp_acl_rule_del("cap", 30), 0);
+    check("D27: ... and its entry freed", dp_acl_rule_add("cap", &rule) == 0 &&
+          res_get(RES_ACL, &ri) == 0 && ri.used == 2, 1);
+    check("D27: ACL deleted", dp_acl_delete("cap"), 0);
+    check("D27: ... its rules freed", res_get(RES_ACL, &ri) == 0 && ri.used == 0, 1);
+    check("D27: ACL capacity restored", res_set_capacity(RES_ACL, ri.limit), 0);
+    for (i = 0; i < 3; i++)
+    {
+        send_to(h[0], NULL, (uint8_t)(0x31 + i), 0, (uint8_t)(0xF8 + i));
+        receive_marked(h[1], (uint8_t)(0xF8 + i), 500);
+    }
+    check("D27: two sources learned", dp_fdb_get_stats(&fst) == 0 && fst.entries == 2, 1);
+    check("D27: ... the third refused", fst.full > 0, 1);
+    usleep(10000);
+    check("D27: worker 0 reported the usage", res_get(RES_FDB, &ri) == 0 && ri.used == 2 &&
+          ri.capacity == 2, 1);
+    check("D27: FDB capacity restored", dp_fdb_set_capacity(ri.limit), 0);
+    dp_shutdown();
+    check("D27: ... FDB empty after dp_shutdown", res_get(RES_FDB, &ri) == 0 && ri.used == 0, 1);
+
+    for (i = 0; i < 5; i++)
+        close(h[i]);
+
+    printf("============================================================\n");
+    printf("  Results: %d passed, %d failed\n", g_pass, g_fail);
+    printf("============================================================\n");
+
+    return (g_fail > 0) ? 1 : 0;
+}
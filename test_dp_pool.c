@@ -0,0 +1,172 @@
+/**
+ * @file test_dp_pool.c
+ * @brief Test for the packet buffer pool (dp_pool.c).
+ *
+ * Tests:
+ *   P1: the mapping is whole hugepages and buffers are line aligned
+ *   P2: a bulk allocation refills the cache in one batch
+ *   P3: allocation is all or nothing and exhaustion is counted
+ *   P4: freed buffers come back, each exactly once
+ *   P5: an overfull cache hands buffers back to the shared stack
+ *   P6: four workers with their own caches never share a buffer
+ *
+ * Needs no privileges; hugepages are used if reserved, otherwise P1 runs
+ * on normal pages.
+ */
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "dp_pool.h"
+
+#define NTHREADS  4
+#define NROUNDS   20000
+
+/* -------------------------------------------------------------------------
+ * Helpers
+ * ------------------------------------------------------------------------- */
+
+static int g_pass = 0;
+static int g_fail = 0;
+
+static void check(const char *desc, int got, int expected)
+{
+    if (got == expected)
+    {
+        printf("[PASS] %s  (ret=%d)\n", desc, got);
+        g_pass++;
+    }
+    else
+    {
+        printf("[FAIL] %s  (expected=%d, got=%d)\n", desc, expected, got);
+        g_fail++;
+    }
+}
+
+struct worker
+{
+    struct dp_pool *pool;
+    unsigned        id;
+    unsigned        clobbered;
+};
+
+/* Alloc, stamp, verify the stamp, free; a shared buffer shows as a clobbered stamp. */
+static void *worker_main(void *arg)
+{
+    struct worker *w = arg;
+    struct dpp_cache *c = dpp_cache(w->pool, w->id);
+    struct dp_mbuf *m[16];
+    unsigned r, i, n;
+
+    for (r = 0; r < NROUNDS; r++)
+    {
+        n = 1 + (r % 16);
+        if (dpp_alloc_bulk(w->pool, c, m, n) < 0)
+            continue;
+        for (i = 0; i < n; i++)
+            m[i]->flags = w->id << 24 | r;
+        for (i = 0; i < n; i++)
+        {
+            if (m[i]->flags != (w->id << 24 | r))
+                w->clobbered++;
+        }
+        dpp_free_bulk(w->pool, c, m, n);
+    }
+    return NULL;
+}
+
+/* -------------------------------------------------------------------------
+ * Main
+ * ------------------------------------------------------------------------- */
+
+int main(void)
+{
+    static struct dp_mbuf *bufs[1024];
+    struct worker w[NTHREADS];
+    pthread_t t[NTHREADS];
+    struct dpp_stats st;
+    struct dp_pool *pool;
+    struct dpp_cache *c;
+    unsigned i, j, dup;
+
+    setbuf(stdout, NULL);
+
+    printf("============================================================\n");
+    printf("  virtasic packet buffer pool test\n");
+    printf("============================================================\n");
+
+    check("dpp_create rejects an empty pool", dpp_create(0, 1) == NULL, 1);
+
+    pool = dpp_create(1024, NTHREADS);
+    check("dpp_create", pool != NULL, 1);
+    if (!pool)
+        return 1;
+    c = dpp_cache(pool, 0);
+
+    dpp_get_stats(pool, &st);
+    printf("  mapping: %llu bytes, %s\n", (unsigned long long)st.bytes,
+           st.hugepages ? "2 MB hugepages" : "normal pages");
+    check("P1: mapping is whole hugepages", (int)(st.bytes % DPP_HUGEPAGE), 0);
+    check("P1: buffer is its nominal size", (int)sizeof(struct dp_mbuf), DPP_BUF_SIZE);
+    check("P1: everything starts free", (int)st.avail, 1024);
+    check("P1: no cache beyond the last", dpp_cache(pool, NTHREADS) == NULL, 1);
+
+    check("P2: alloc 32", dpp_alloc_bulk(pool, c, bufs, 32), 0);
+    check("P2: buffer is line aligned", (int)((uintptr_t)bufs[0] % 64), 0);
+    dpp_get_stats(pool, &st);
+    check("P2: 32 in use", (int)st.in_use, 32);
+    check("P2: one batch left in the cache", (int)st.cached, DPP_CACHE_BATCH);
+    check("P2: shared stack paid for both", (int)st.avail, 1024 - 32 - DPP_CACHE_BATCH);
+    check("P2: bulk larger than a cache", dpp_alloc_bulk(pool, c, bufs, DPP_CACHE_SIZE + 1), -EINVAL);
+
+    for (i = 32; i < 1024; i += 32)
+        dpp_alloc_bulk(pool, c, bufs + i, 32);
+    dpp_get_stats(pool, &st);
+    check("P3: whole pool in use", (int)st.in_use, 1024);
+    check("P3: shared stack ran dry", (int)st.min_avail, 0);
+    check("P3: one more is refused", dpp_alloc(pool, c) == NULL, 1);
+    check("P3: refused bulk", dpp_alloc_bulk(pool, c, bufs, 8), -ENOBUFS);
+    dpp_get_stats(pool, &st);
+    check("P3: exhaustion counted", (int)st.exhausted, 2);
+
+    for (dup = 0, i = 0; i < 1024; i++)
+    {
+        for (j = i + 1; j < 1024; j++)
+            dup += bufs[i] == bufs[j];
+    }
+    check("P4: every buffer handed out once", (int)dup, 0);
+    dpp_free_bulk(pool, c, bufs, 1024);
+    dpp_get_stats(pool, &st);
+    check("P4: all buffers back", (int)st.in_use, 0);
+    check("P4: allocs match frees", st.allocs == st.frees, 1);
+
+    check("P5: cache kept within its size", st.cached <= DPP_CACHE_SIZE, 1);
+    check("P5: the rest went to the stack", (int)(st.avail + st.cached), 1024);
+
+    for (i = 0; i < NTHREADS; i++)
+    {
+        w[i].pool = pool;
+        w[i].id = i;
+        w[i].clobbered = 0;
+        pthread_create(&t[i], NULL, worker_main, &w[i]);
+    }
+    for (dup = 0, i = 0; i < NTHREADS; i++)
+    {
+        pthread_join(t[i], NULL);
+        dup += w[i].clobbered;
+    }
+    check("P6: no buffer shared between workers", (int)dup, 0);
+    dpp_get_stats(pool, &st);
+    check("P6: all buffers back", (int)st.in_use, 0);
+
+    dpp_destroy(pool);
+
+    printf("============================================================\n");
+    printf("  Results: %d passed, %d failed\n", g_pass, g_fail);
+    printf("============================================================\n");
+
+    return (g_fail > 0) ? 1 : 0;
+}
@@ -0,0 +1,168 @@
+/**
+ * @file test_dp_stats.c
+ * @brief Test for the sharded forwarding counters (dp_stats.c).
+ *
+ * Tests:
+ *   S1: counter blocks are one cache line each and shards are line aligned
+ *   S2: four concurrent writers, one per shard, aggregate exactly
+ *   S3: a port reset starts its totals from zero without touching the shards
+ *   S4: rates are the difference of the last two samples over their interval,
+ *       and survive a port reset
+ *   S5: the sampler thread produces a rate for steady traffic
+ *
+ * Needs no privileges.
+ */
+
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <time.h>
+
+#include "dp_stats.h"
+
+#define NSHARDS  4
+#define NPORTS   8
+#define NVLANS   4096
+#define NADDS    200000
+
+/* -------------------------------------------------------------------------
+ * Helpers
+ * ------------------------------------------------------------------------- */
+
+static int g_pass = 0;
+static int g_fail = 0;
+
+static void check(const char *desc, int got, int expected)
+{
+    if (got == expected)
+    {
+        printf("[PASS] %s  (ret=%d)\n", desc, got);
+        g_pass++;
+    }
+    else
+    {
+        printf("[FAIL] %s  (expected=%d, got=%d)\n", desc, expected, got);
+        g_fail++;
+    }
+}
+
+struct writer
+{
+    struct dp_stats *s;
+    unsigned         shard;
+};
+
+static void *writer_main(void *arg)
+{
+    struct writer *w = arg;
+    struct dps_shard sh = dps_shard(w->s, w->shard);
+    unsigned i;
+
+    for (i = 0; i < NADDS; i++)
+    {
+        dps_add(&sh.port[3].c.rx_packets, 1);
+        dps_add(&sh.port[3].c.rx_bytes, 64);
+        dps_add(&sh.vlan[100].c.tx_packets, 1);
+    }
+    return NULL;
+}
+
+static void sleep_ms(long ms)
+{
+    struct timespec ts = { ms / 1000, (ms % 1000) * 1000000L };
+
+    nanosleep(&ts, NULL);
+}
+
+/* -------------------------------------------------------------------------
+ * Main
+ * ------------------------------------------------------------------------- */
+
+int main(void)
+{
+    struct writer w[NSHARDS];
+    pthread_t t[NSHARDS];
+    struct dp_counters c;
+    struct dp_rate r;
+    struct dps_shard sh;
+    struct dp_stats *s;
+    unsigned i;
+
+    setbuf(stdout, NULL);
+
+    printf("============================================================\n");
+    printf("  virtasic sharded counter test\n");
+    printf("============================================================\n");
+
+    s = dps_create(NSHARDS, NPORTS, NVLANS, 0);
+    check("dps_create", s != NULL, 1);
+    if (!s)
+        return 1;
+
+    sh = dps_shard(s, 1);
+    check("S1: counter block is one cache line", (int)sizeof(struct dps_line), 64);
+    check("S1: shard is line aligned", (int)((uintptr_t)sh.port % 64), 0);
+    check("S1: VLAN lines follow the port lines", sh.vlan == sh.port + NPORTS, 1);
+
+    for (i = 0; i < NSHARDS; i++)
+    {
+        w[i].s = s;
+        w[i].shard = i;
+        pthread_create(&t[i], NULL, writer_main, &w[i]);
+    }
+    for (i = 0; i < NSHARDS; i++)
+        pthread_join(t[i], NULL);
+
+    dps_port_read(s, 3, &c);
+    check("S2: port packets summed over shards", c.rx_packets == (uint64_t)NSHARDS * NADDS, 1);
+    check("S2: port bytes summed over shards", c.rx_bytes == (uint64_t)NSHARDS * NADDS * 64, 1);
+    dps_vlan_read(s, 100, &c);
+    check("S2: VLAN packets summed over shards", c.tx_packets == (uint64_t)NSHARDS * NADDS, 1);
+    dps_port_read(s, 2, &c);
+    check("S2: other port untouched", (int)c.rx_packets, 0);
+
+    dps_port_reset(s, 3);
+    dps_port_read(s, 3, &c);
+    check("S3: reset port reads zero", (int)c.rx_packets, 0);
+    dps_add(&sh.port[3].c.rx_packets, 5);
+    dps_port_read(s, 3, &c);
+    check("S3: counts again after reset", (int)c.rx_packets, 5);
+
+    dps_port_rate(s, 3, &r);
+    check("S4: no rate before two samples", r.rx_pps == 0.0, 1);
+    dps_sample(s, 1000);
+    dps_add(&sh.port[3].c.rx_packets, 1000);
+    dps_add(&sh.port[3].c.rx_bytes, 64000);
+    dps_add(&sh.vlan[100].c.tx_packets, 500);
+    dps_sample(s, 2000);
+    dps_port_rate(s, 3, &r);
+    check("S4: port packet rate", (int)r.rx_pps, 1000);
+    check("S4: port bit rate", (int)r.rx_bps, 512000);
+    dps_vlan_rate(s, 100, &r);
+    check("S4: VLAN packet rate", (int)r.tx_pps, 500);
+    dps_port_reset(s, 3);
+    dps_port_rate(s, 3, &r);
+    check("S4: a reset leaves the rate alone", (int)r.rx_pps, 1000);
+    dps_destroy(s);
+
+    s = dps_create(1, NPORTS, NVLANS, 50);
+    check("S5: dps_create with sampler", s != NULL, 1);
+    if (s)
+    {
+        sh = dps_shard(s, 0);
+        for (i = 0; i < 300; i++)
+        {
+            dps_add(&sh.port[0].c.tx_packets, 10);
+            sleep_ms(1);
+        }
+        dps_port_rate(s, 0, &r);
+        check("S5: sampler reports a rate", r.tx_pps > 0.0, 1);
+        dps_destroy(s);
+    }
+
+    printf("============================================================\n");
+    printf("  Results: %d passed, %d failed\n", g_pass, g_fail);
+    printf("============================================================\n");
+
+    return (g_fail > 0) ? 1 : 0;
+}
@@ -0,0 +1,403 @@
+/**
+ * @file test_fdb.c
+ * @brief Test for the per-VLAN MAC learning table (fdb.c).
+ *
+ *   F1: learn and look up; the same MAC in two VLANs is two entries
+ *   F2: a station move re-points the entry and is counted
+ *   F3: the aging wheel removes idle entries and keeps refreshed ones
+ *   F4: flush by port and by VLAN
+ *   F5: a table filled to 90 % keeps every entry; burst lookups agree with
+ *       single lookups; a full table rejects new keys without losing old ones
+ *   F6: dumps running concurrently with a churning writer never see a torn
+ *       entry; the dump rate is reported
+ *   F7: four workers learning and looking up at the same time end with
+ *       every address learned once, on the right port
+ *   F8: a limit below the table size stops learning new addresses at the
+ *       limit but still refreshes and moves known ones; lifting it resumes
+ *
+ * Needs no privileges.
+ */
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+
+#include "fdb.h"
+
+#define TEST_BUCKETS  1024
+#define TEST_AGE_S    10
+
+/* -------------------------------------------------------------------------
+ * Helpers
+ * ------------------------------------------------------------------------- */
+
+static int g_pass = 0;
+static int g_fail = 0;
+
+static void check(const char *desc, int got, int expected)
+{
+    if (got == expected)
+    {
+        printf("[PASS] %s  (ret=%d)\n", desc, got);
+        g_pass++;
+    }
+    else
+    {
+        printf("[FAIL] %s  (expected=%d, got=%d)\n", desc, expected, got);
+        g_fail++;
+    }
+}
+
+static uint64_t key_of(uint16_t vid, uint32_t n)
+{
+    uint8_t mac[6] = { 0x02, 0x00, (uint8_t)(n >> 24), (uint8_t)(n >> 16),
+                       (uint8_t)(n >> 8), (uint8_t)n };
+
+    return fdb_key(vid, mac);
+}
+
+/* Port that F5/F6 expect for a key: derived from the key itself. */
+static uint8_t port_of(uint64_t key)
+{
+    return (uint8_t)((key ^ (key >> 48)) % 48);
+}
+
+static size_t count_cb_n;
+static void count_cb(const struct fdb_entry *e, void *arg)
+{
+    (void)e;
+    (void)arg;
+    count_cb_n++;
+}
+
+static size_t count(struct fdb *fdb, int vid)
+{
+    count_cb_n = 0;
+    fdb_dump(fdb, vid, 0, count_cb, NULL);
+    return count_cb_n;
+}
+
+/* -------------------------------------------------------------------------
+ * Tests
+ * ------------------------------------------------------------------------- */
+
+static void test_learn(void)
+{
+    struct fdb *fdb = fdb_create(TEST_BUCKETS, TEST_AGE_S);
+    struct fdb_stats st;
+
+    check("F1: lookup in empty table", fdb_lookup(fdb, key_of(10, 1)), FDB_PORT_NONE);
+    check("F1: learn vlan 10", fdb_learn(fdb, key_of(10, 1), 3, 0), 0);
+    check("F1: learn vlan 20", fdb_learn(fdb, key_of(20, 1), 4, 0), 0);
+    check("F1: lookup vlan 10", fdb_lookup(fdb, key_of(10, 1)), 3);
+    check("F1: lookup vlan 20", fdb_lookup(fdb, key_of(20, 1)), 4);
+    check("F1: relearn is not a new entry", fdb_learn(fdb, key_of(10, 1), 3, 1), 0);
+    check("F1: dump vlan 10", (int)count(fdb, 10), 1);
+    check("F1: dump all", (int)count(fdb, -1), 2);
+
+    check("F2: station move", fdb_learn(fdb, key_of(10, 1), 5, 2), 0);
+    check("F2: lookup after move", fdb_lookup(fdb, key_of(10, 1)), 5);
+    fdb_get_stats(fdb, &st);
+    check("F2: moves counted", (int)st.moves, 1);
+    check("F2: entries", (int)st.entries, 2);
+
+    fdb_destroy(fdb);
+}
+
+static void test_aging(void)
+{
+    struct fdb *fdb = fdb_create(TEST_BUCKETS, TEST_AGE_S);
+    uint64_t ms;
+
+    fdb_learn(fdb, key_of(10, 1), 1, 0);
+    fdb_learn(fdb, key_of(10, 2), 2, 0);
+
+    /* Keep entry 2 alive; one revolution is TEST_AGE_S / 2. */
+    for (ms = 0; ms <= 2 * TEST_AGE_S * 1000; ms += 100)
+    {
+        if (ms % 1000 == 0)
+            fdb_learn(fdb, key_of(10, 2), 2, (uint32_t)(ms / 1000));
+        fdb_age(fdb, ms);
+    }
+    check("F3: idle entry aged out", fdb_lookup(fdb, key_of(10, 1)), FDB_PORT_NONE);
+    check("F3: active entry kept", fdb_lookup(fdb, key_of(10, 2)), 2);
+
+    fdb_destroy(fdb);
+}
+
+static void test_flush(void)
+{
+    struct fdb *fdb = fdb_create(TEST_BUCKETS, TEST_AGE_S);
+    uint32_t i;
+
+    for (i = 0; i < 100; i++)
+    {
+        fdb_learn(fdb, key_of(10, i), (uint8_t)(i % 2), 0);
+        fdb_learn(fdb, key_of(20, i), 2, 0);
+    }
+    check("F4: flush port 1", (int)fdb_flush_ports(fdb, 1ull << 1), 50);
+    check("F4: vlan 10 keeps port 0", (int)count(fdb, 10), 50);
+    check("F4: flush vlan 20", (int)fdb_flush_vlan(fdb, 20), 100);
+    check("F4: vlan 20 empty", (int)count(fdb, 20), 0);
+    check("F4: vlan 10 untouched", (int)count(fdb, 10), 50);
+
+    fdb_destroy(fdb);
+}
+
+static void test_capacity(void)
+{
+    struct fdb *fdb = fdb_create(TEST_BUCKETS, TEST_AGE_S);
+    unsigned cap = TEST_BUCKETS * FDB_BUCKET_WAYS;
+    unsigned fill = cap * 9 / 10;
+    static uint64_t keys[TEST_BUCKETS * FDB_BUCKET_WAYS * 2];
+    static uint8_t ports[TEST_BUCKETS * FDB_BUCKET_WAYS * 2];
+    unsigned failed = 0;
+    unsigned wrong = 0;
+    unsigned i;
+
+    for (i = 0; i < fill; i++)
+    {
+        keys[i] = key_of((uint16_t)(1 + i % 4094), i);
+        if (fdb_learn(fdb, keys[i], port_of(keys[i]), 0) < 0)
+            failed++;
+    }
+    check("F5: 90% fill accepted", (int)failed, 0);
+
+    fdb_lookup_burst(fdb, keys, fill, ports);
+    for (i = 0; i < fill; i++)
+    {
+        if (ports[i] != port_of(keys[i]) || fdb_lookup(fdb, keys[i]) != ports[i])
+            wrong++;
+    }
+    check("F5: burst and single lookups agree", (int)wrong, 0);
+
+    /* Overfill: some learns must fail, but nothing present may vanish. */
+    failed = 0;
+    for (i = fill; i < 2 * cap; i++)
+    {
+        keys[i] = key_of(7, 0x100000 + i);
+        if (fdb_learn(fdb, keys[i], port_of(keys[i]), 0) < 0)
+            failed++;
+    }
+    check("F5: overfill rejects keys", failed > 0, 1);
+
+    wrong = 0;
+    for (i = 0; i < 2 * cap; i++)
+    {
+        uint8_t p = fdb_lookup(fdb, keys[i]);
+
+        if (i < fill ? p != port_of(keys[i]) : (p != FDB_PORT_NONE && p != port_of(keys[i])))
+            wrong++;
+    }
+    check("F5: no entry lost on a full table", (int)wrong, 0);
+
+    fdb_destroy(fdb);
+}
+
+static void test_limit(void)
+{
+    struct fdb *fdb = fdb_create(TEST_BUCKETS, TEST_AGE_S);
+    struct fdb_stats st;
+    unsigned failed = 0;
+    unsigned i;
+
+    fdb_set_limit(fdb, 100);
+    for (i = 0; i < 150; i++)
+    {
+        if (fdb_learn(fdb, key_of(10, i), 1, 0) < 0)
+            failed++;
+    }
+    check("F8: learning stops at the limit", (int)failed, 50);
+    check("F8: 100 entries", (int)fdb_count(fdb), 100);
+    check("F8: known address moves at the limit", fdb_learn(fdb, key_of(10, 0), 2, 1), 0);
+    check("F8: ... to its new port", fdb_lookup(fdb, key_of(10, 0)), 2);
+    fdb_get_stats(fdb, &st);
+    check("F8: refusals counted as full", (int)st.full, 50);
+
+    fdb_set_limit(fdb, 0);
+    check("F8: lifted limit learns again", fdb_learn(fdb, key_of(10, 200), 1, 2), 0);
+    check("F8: 101 entries", (int)fdb_count(fdb), 101);
+
+    fdb_destroy(fdb);
+}
+
+/* F6: concurrent dump against a writer ------------------------------------ */
+
+static atomic_int g_stop;
+static atomic_ulong g_torn;
+static atomic_ulong g_dumps;
+
+static void verify_cb(const struct fdb_entry *e, void *arg)
+{
+    uint64_t key = fdb_key(e->vid, e->mac);
+
+    (void)arg;
+    if (e->port != port_of(key))
+        atomic_fetch_add(&g_torn, 1);
+}
+
+static void *dump_reader(void *arg)
+{
+    struct fdb *fdb = arg;
+
+    while (!atomic_load(&g_stop))
+    {
+        fdb_dump(fdb, -1, 0, verify_cb, NULL);
+        atomic_fetch_add(&g_dumps, 1);
+    }
+    return NULL;
+}
+
+static void test_concurrent(void)
+{
+    struct fdb *fdb = fdb_create(TEST_BUCKETS, TEST_AGE_S);
+    struct timespec t0, t1;
+    pthread_t thr;
+    unsigned round;
+    uint32_t i;
+    double secs;
+
+    pthread_create(&thr, NULL, dump_reader, fdb);
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+
+    for (round = 0; round < 200; round++)
+    {
+        for (i = 0; i < TEST_BUCKETS * 3; i++)
+        {
+            uint64_t k = key_of((uint16_t)(1 + round % 2), i * 7919 + round);
+
+            fdb_learn(fdb, k, port_of(k), round);
+        }
+        fdb_flush_vlan(fdb, (uint16_t)(1 + round % 2));
+    }
+
+    atomic_store(&g_stop, 1);
+    pthread_join(thr, NULL);
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    secs = (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) / 1e9;
+
+    printf("  %lu full dumps in %.2f s while the writer churned\n",
+           (unsigned long)atomic_load(&g_dumps), secs);
+    check("F6: dumps completed", atomic_load(&g_dumps) > 0, 1);
+    check("F6: no torn entries", (int)atomic_load(&g_torn), 0);
+
+    fdb_destroy(fdb);
+}
+
+/* F7: several workers learning at once --------------------------------- */
+
+#define F7_WORKERS  4
+#define F7_KEYS     400
+
+struct f7_worker
+{
+    struct fdb *fdb;
+    uint8_t     id;
+    unsigned    passes;
+    unsigned    wrong;      /* lookups of another worker's key with a wrong port */
+};
+
+static uint64_t f7_key(unsigned worker, unsigned n)
+{
+    return key_of((uint16_t)(10 + worker), (uint32_t)n * 131);
+}
+
+static void *f7_main(void *arg)
+{
+    struct f7_worker *w = arg;
+    uint64_t keys[32];
+    uint8_t ports[32];
+    unsigned done = 0;
+    unsigned i, j;
+
+    while (done < F7_KEYS && w->passes < 1000)
+    {
+        w->passes++;
+        for (i = 0; i < F7_KEYS; i += 32)
+        {
+            unsigned n = F7_KEYS - i < 32 ? F7_KEYS - i : 32;
+            unsigned other = (w->id + 1) % F7_WORKERS;
+
+            for (j = 0; j < n; j++)
+                keys[j] = f7_key(w->id, i + j);
+            fdb_learn_burst(w->fdb, keys, n, w->id, 1);
+
+            for (j = 0; j < n; j++)
+                keys[j] = f7_key(other, i + j);
+            fdb_lookup_burst(w->fdb, keys, n, ports);
+            for (j = 0; j < n; j++)
+            {
+                if (ports[j] != FDB_PORT_NONE && ports[j] != other)
+                    w->wrong++;
+            }
+        }
+        for (done = 0, i = 0; i < F7_KEYS; i++)
+            done += fdb_lookup(w->fdb, f7_key(w->id, i)) == w->id;
+    }
+    return NULL;
+}
+
+static void test_workers(void)
+{
+    struct fdb *fdb = fdb_create(TEST_BUCKETS, TEST_AGE_S);
+    struct f7_worker w[F7_WORKERS];
+    pthread_t thr[F7_WORKERS];
+    struct fdb_stats st;
+    unsigned wrong = 0;
+    unsigned found = 0;
+    unsigned i, k;
+
+    for (k = 0; k < F7_WORKERS; k++)
+    {
+        w[k].fdb = fdb;
+        w[k].id = (uint8_t)k;
+        w[k].passes = 0;
+        w[k].wrong = 0;
+        pthread_create(&thr[k], NULL, f7_main, &w[k]);
+    }
+    for (k = 0; k < F7_WORKERS; k++)
+    {
+        pthread_join(thr[k], NULL);
+        wrong += w[k].wrong;
+        for (i = 0; i < F7_KEYS; i++)
+            found += fdb_lookup(fdb, f7_key(k, i)) == k;
+    }
+
+    fdb_get_stats(fdb, &st);
+    printf("  %llu learns deferred by lock contention\n", (unsigned long long)st.deferred);
+    check("F7: every address learned on its port", (int)found, F7_WORKERS * F7_KEYS);
+    check("F7: each learned once", (int)st.entries, F7_WORKERS * F7_KEYS);
+    check("F7: no lookup returned a wrong port", (int)wrong, 0);
+
+    fdb_destroy(fdb);
+}
+
+/* -------------------------------------------------------------------------
+ * Main
+ * ------------------------------------------------------------------------- */
+
+int main(void)
+{
+    setbuf(stdout, NULL);
+
+    printf("============================================================\n");
+    printf("  virtasic FDB test\n");
+    printf("============================================================\n");
+
+    test_learn();
+    test_aging();
+    test_flush();
+    test_capacity();
+    test_limit();
+    test_concurrent();
+    test_workers();
+
+    printf("============================================================\n");
+    printf("  Results: %d passed, %d failed\n", g_pass, g_fail);
+    printf("============================================================\n");
+
+    return (g_fail > 0) ? 1 : 0;
+}
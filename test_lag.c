@@ -0,0 +1,277 @@
+/**
+ * @file test_lag.c
+ * @brief Test for LAG flow hashing and member tables (lag.c) and the kernel
+ *        bonding backend (lag_bond.c).
+ *
+ * Tests:
+ *   H1: hash policy names
+ *   H2: each policy covers its fields and no others; a VLAN tag is skipped,
+ *       IPv4 fragments and truncated frames fall back to fewer fields
+ *   H3: flows with different ports spread evenly over four members
+ *   T1: a table built for four members gives each a quarter; no member
+ *       up selects none
+ *   T2: removing a member moves only its entries, evenly, and removing
+ *       the last one empties the table
+ *   K1: a bond with a member on a veth is created, filled, emptied and
+ *       deleted; refusals for bad names and policies
+ *
+ * H1..T2 need no privileges; K1 runs in a private network namespace and
+ * is skipped without CAP_SYS_ADMIN / CAP_NET_ADMIN, or past the refusal
+ * checks on a kernel without bonding.
+ */
+
+#define _GNU_SOURCE     /* unshare */
+
+#include <errno.h>
+#include <sched.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <net/if.h>
+#include <netlink/netlink.h>
+#include <netlink/route/link.h>
+#include <netlink/route/link/veth.h>
+
+#include "lag.h"
+#include "lag_bond.h"
+#include "vlan_state.h"
+
+/* -------------------------------------------------------------------------
+ * Helpers
+ * ------------------------------------------------------------------------- */
+
+static int g_pass = 0;
+static int g_fail = 0;
+
+static void check(const char *desc, int got, int expected)
+{
+    if (got == expected)
+    {
+        printf("[PASS] %s  (ret=%d)\n", desc, got);
+        g_pass++;
+    }
+    else
+    {
+        printf("[FAIL] %s  (expected=%d, got=%d)\n", desc, expected, got);
+        g_fail++;
+    }
+}
+
+/* Untagged IPv4 / UDP frame from 10.0.0.@p src to 10.0.1.@p dst, ports
+ * @p sport -> 53; @p frag sets the more-fragments flag. */
+static size_t udp4(uint8_t *f, uint8_t src, uint8_t dst, uint16_t sport, int frag)
+{
+    static const uint8_t eth[14] = { 0x02, 0, 0, 0, 0, 0x02, 0x02, 0, 0, 0, 0, 0x01, 0x08, 0x00 };
+
+    memset(f, 0, 64);
+    memcpy(f, eth, sizeof(eth));
+    f[14] = 0x45;
+    f[20] = frag ? 0x20 : 0;
+    f[22] = 64;
+    f[23] = 17;
+    f[26] = 10;
+    f[29] = src;
+    f[30] = 10;
+    f[32] = 1;
+    f[33] = dst;
+    f[34] = (uint8_t)(sport >> 8);
+    f[35] = (uint8_t)sport;
+    f[37] = 53;
+    return 64;
+}
+
+/* Entries of @p t owned by @p member. */
+static int owned(const struct lag_table *t, uint8_t member)
+{
+    int n = 0;
+    unsigned i;
+
+    for (i = 0; i < LAG_TABLE_SIZE; i++)
+        n += t->member[i] == member;
+    return n;
+}
+
+static int link_up(const char *name)
+{
+    struct ifreq ifr;
+    int fd = socket(AF_INET, SOCK_DGRAM, 0);
+    int ret = -1;
+
+    if (fd < 0)
+        return -1;
+    memset(&ifr, 0, sizeof(ifr));
+    strncpy(ifr.ifr_name, name, IFNAMSIZ - 1);
+    if (ioctl(fd, SIOCGIFFLAGS, &ifr) == 0)
+    {
+        ifr.ifr_flags |= IFF_UP;
+        ret = ioctl(fd, SIOCSIFFLAGS, &ifr);
+    }
+    close(fd);
+    return ret;
+}
+
+static int make_pair(void)
+{
+    struct nl_sock *sock = nl_socket_alloc();
+    int err;
+
+    if (!sock || nl_connect(sock, NETLINK_ROUTE) < 0)
+        return -1;
+    err = rtnl_link_veth_add(sock, "h0", "s0", getpid());
+    if (err == 0 && (link_up("h0") < 0 || link_up("s0") < 0))
+        err = -1;
+    nl_socket_free(sock);
+    return err;
+}
+
+/* Master ifindex of @p name in the current snapshot, -1 if unknown. */
+static int master_of(const char *name)
+{
+    const struct vlan_snapshot *snap;
+    const struct vs_link *l;
+    int master = -1;
+
+    snap = vlan_state_read_begin();
+    if ((l = vlan_snapshot_find_name(snap, name)) != NULL)
+        master = l->master;
+    vlan_state_read_end();
+    return master;
+}
+
+/* K1, inside the namespace with the h0/s0 pair. */
+static void test_kernel(void)
+{
+    int ret;
+
+    usleep(100000);             /* let the snapshot see the pair */
+    check("K1: bad policy", lag_bond_create("bond1", 7), -EINVAL);
+    check("K1: name taken by a link", lag_bond_create("s0", LAG_HASH_L2), -EEXIST);
+    check("K1: absent bond", lag_bond_add_port("bond1", "s0"), -ENOENT);
+    check("K1: absent bond deleted", lag_bond_delete("bond1"), -ENOENT);
+    ret = lag_bond_create("bond1", LAG_HASH_L4);
+    if (ret == -EOPNOTSUPP)
+    {
+        printf("[SKIP] K1: kernel without bonding\n");
+        return;
+    }
+    check("K1: create bond1, layer3+4", ret, 0);
+    check("K1: bond1 is up", (int)(if_nametoindex("bond1") > 0), 1);
+    check("K1: enslave s0", lag_bond_add_port("bond1", "s0"), 0);
+    usleep(100000);
+    check("K1: s0 under bond1", master_of("s0"), (int)if_nametoindex("bond1"));
+    check("K1: release s0", lag_bond_del_port("bond1", "s0"), 0);
+    usleep(100000);
+    check("K1: s0 free", master_of("s0"), 0);
+    check("K1: delete bond1", lag_bond_delete("bond1"), 0);
+    check("K1: bond1 gone", (int)if_nametoindex("bond1"), 0);
+}
+
+/* -------------------------------------------------------------------------
+ * Main
+ * ------------------------------------------------------------------------- */
+
+int main(void)
+{
+    static const uint8_t four[4] = { 3, 7, 9, 12 };
+    struct lag_table t;
+    uint8_t f[64], g[64], tagged[68];
+    int per[4] = { 0, 0, 0, 0 };
+    int min, max, moved;
+    unsigned i;
+
+    setbuf(stdout, NULL);
+
+    printf("============================================================\n");
+    printf("  virtasic link aggregation test\n");
+    printf("============================================================\n");
+
+    check("H1: l2", lag_hash_parse("l2"), LAG_HASH_L2);
+    check("H1: l4", lag_hash_parse("l4"), LAG_HASH_L4);
+    check("H1: bad policy", lag_hash_parse("l7"), -EINVAL);
+    check("H1: name round trip", strcmp(lag_hash_name(LAG_HASH_L3), "l3"), 0);
+
+    udp4(f, 1, 1, 1000, 0);
+    udp4(g, 2, 1, 1000, 0);
+    check("H2: l2 ignores addresses", lag_hash(f, 64, LAG_HASH_L2) == lag_hash(g, 64, LAG_HASH_L2), 1);
+    check("H2: l3 covers them", lag_hash(f, 64, LAG_HASH_L3) != lag_hash(g, 64, LAG_HASH_L3), 1);
+    udp4(g, 1, 1, 1001, 0);
+    check("H2: l3 ignores ports", lag_hash(f, 64, LAG_HASH_L3) == lag_hash(g, 64, LAG_HASH_L3), 1);
+    check("H2: l4 covers them", lag_hash(f, 64, LAG_HASH_L4) != lag_hash(g, 64, LAG_HASH_L4), 1);
+    g[0] = 0x04;
+    check("H2: l4 covers MACs", lag_hash(f, 64, LAG_HASH_L4) != lag_hash(g, 64, LAG_HASH_L4), 1);
+    udp4(g, 1, 1, 1001, 1);
+    check("H2: fragment hashes by addresses",
+          lag_hash(g, 64, LAG_HASH_L4) == lag_hash(g, 64, LAG_HASH_L3), 1);
+    check("H2: truncated frame hashes by MACs",
+          lag_hash(f, 20, LAG_HASH_L4) == lag_hash(f, 20, LAG_HASH_L2), 1);
+    memcpy(tagged, f, 12);
+    tagged[12] = 0x81;
+    tagged[13] = 0x00;
+    tagged[14] = 0x00;
+    tagged[15] = 10;
+    memcpy(tagged + 16, f + 12, 52);
+    check("H2: VLAN tag skipped", lag_hash(tagged, 68, LAG_HASH_L4) == lag_hash(f, 64, LAG_HASH_L4), 1);
+
+    lag_table_build(&t, four, 4);
+    for (i = 0; i < 4000; i++)
+    {
+        int m;
+
+        udp4(f, 1, 1, (uint16_t)(1024 + i), 0);
+        m = lag_select(&t, lag_hash(f, 64, LAG_HASH_L4));
+        per[m == 3 ? 0 : m == 7 ? 1 : m == 9 ? 2 : 3]++;
+    }
+    min = max = per[0];
+    for (i = 1; i < 4; i++)
+    {
+        min = per[i] < min ? per[i] : min;
+        max = per[i] > max ? per[i] : max;
+    }
+    check("H3: 4000 flows, each member within 20% of 1000", min >= 800 && max <= 1200, 1);
+
+    lag_table_build(&t, four, 4);
+    check("T1: member 3 owns a quarter", owned(&t, 3), LAG_TABLE_SIZE / 4);
+    check("T1: member 12 owns a quarter", owned(&t, 12), LAG_TABLE_SIZE / 4);
+    check("T1: hash selects by the low bits", lag_select(&t, 0x100 + 5), t.member[5]);
+    lag_table_build(&t, four, 0);
+    check("T1: no member up", lag_select(&t, 5), -1);
+
+    lag_table_build(&t, four, 4);
+    memcpy(f, t.member, 64);        /* first 64 entries, for comparison */
+    lag_table_remove(&t, 9, (const uint8_t[]){ 3, 7, 12 }, 3);
+    check("T2: member 9 gone", owned(&t, 9), 0);
+    moved = 0;
+    for (i = 0; i < 64; i++)
+        moved += f[i] != 9 && t.member[i] != f[i];
+    check("T2: other members' entries stay", moved, 0);
+    check("T2: survivors within one entry",
+          owned(&t, 3) >= 85 && owned(&t, 3) <= 86 && owned(&t, 7) >= 85 && owned(&t, 7) <= 86 &&
+          owned(&t, 12) >= 85 && owned(&t, 12) <= 86, 1);
+    lag_table_remove(&t, 12, (const uint8_t[]){ 3, 7 }, 2);
+    check("T2: two left, even", owned(&t, 3), LAG_TABLE_SIZE / 2);
+    lag_table_remove(&t, 3, (const uint8_t[]){ 7 }, 1);
+    check("T2: one left owns all", owned(&t, 7), LAG_TABLE_SIZE);
+    lag_table_remove(&t, 7, NULL, 0);
+    check("T2: none left", lag_select(&t, 0), -1);
+    lag_table_build(&t, four, 4);
+    check("T2: rebuilt", lag_select(&t, 1), t.member[1]);
+
+    if (unshare(CLONE_NEWNET) < 0 || vlan_state_init() < 0 || make_pair() < 0)
+    {
+        printf("[SKIP] K1: cannot create a network namespace with a veth pair\n");
+    }
+    else
+    {
+        test_kernel();
+        vlan_state_shutdown();
+    }
+
+    printf("============================================================\n");
+    printf("  Results: %d passed, %d failed\n", g_pass, g_fail);
+    printf("============================================================\n");
+
+    return (g_fail > 0) ? 1 : 0;
+}
@@ -0,0 +1,128 @@
+/**
+ * @file test_line_buf.c
+ * @brief Test for the text command reassembly (line_buf.c).
+ *
+ * Tests:
+ *   L1: a command split across two reads runs once, after its newline
+ *   L2: several commands in one read run in order; CR/LF and blank lines
+ *   L3: a tail is only flushed on request (message-based transports)
+ *   L4: a line that never ends is refused at LINE_BUF_MAX
+ */
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "line_buf.h"
+
+/* -------------------------------------------------------------------------
+ * Helpers
+ * ------------------------------------------------------------------------- */
+
+static int g_pass = 0;
+static int g_fail = 0;
+
+static void check(const char *desc, int got, int expected)
+{
+    if (got == expected)
+    {
+        printf("[PASS] %s  (ret=%d)\n", desc, got);
+        g_pass++;
+    }
+    else
+    {
+        printf("[FAIL] %s  (expected=%d, got=%d)\n", desc, expected, got);
+        g_fail++;
+    }
+}
+
+/* Lines handed out so far, joined with '|'. */
+static char g_seen[256];
+static int  g_nseen;
+
+static void collect(char *line, void *arg)
+{
+    size_t len = strlen(g_seen);
+
+    (void)arg;
+    snprintf(g_seen + len, sizeof(g_seen) - len, "%s%s", g_nseen ? "|" : "", line);
+    g_nseen++;
+}
+
+static int feed(struct line_buf *lb, const char *s)
+{
+    return line_buf_feed(lb, s, strlen(s), collect, NULL);
+}
+
+static void reset(void)
+{
+    g_seen[0] = '\0';
+    g_nseen = 0;
+}
+
+/* -------------------------------------------------------------------------
+ * Main
+ * ------------------------------------------------------------------------- */
+
+int main(void)
+{
+    struct line_buf lb;
+    char *big;
+
+    printf("============================================================\n");
+    printf("  virtasic text command reassembly test\n");
+    printf("============================================================\n");
+
+    memset(&lb, 0, sizeof(lb));
+
+    reset();
+    check("L1: first half of a command", feed(&lb, "create vl"), 0);
+    check("L1: ... runs nothing yet", g_nseen, 0);
+    check("L1: second half with the newline", feed(&lb, "an 10\n"), 0);
+    check("L1: ... runs it once", g_nseen, 1);
+    check("L1: ... whole", strcmp(g_seen, "create vlan 10"), 0);
+    check("L1: ... nothing left over", (int)lb.len, 0);
+
+    reset();
+    check("L2: three commands and a fragment",
+          feed(&lb, "show vlan\r\n\nadd vlan 10 to eth0\ndelete vlan 10\nshow in"), 0);
+    check("L2: ... blank line skipped", g_nseen, 3);
+    check("L2: ... in order, without CR",
+          strcmp(g_seen, "show vlan|add vlan 10 to eth0|delete vlan 10"), 0);
+    check("L2: ... fragment kept", (int)lb.len, 7);
+    reset();
+    check("L2: fragment completed", feed(&lb, "terfaces\r\n"), 0);
+    check("L2: ... as one line", strcmp(g_seen, "show interfaces"), 0);
+
+    reset();
+    feed(&lb, "show vlan");
+    check("L3: unterminated tail waits", g_nseen, 0);
+    line_buf_flush(&lb, collect, NULL);
+    check("L3: flush runs it", strcmp(g_seen, "show vlan"), 0);
+    line_buf_flush(&lb, collect, NULL);
+    check("L3: ... only once", g_nseen, 1);
+
+    reset();
+    big = malloc(LINE_BUF_MAX);
+    if (big)
+    {
+        memset(big, 'x', LINE_BUF_MAX);
+        check("L4: LINE_BUF_MAX - 1 bytes kept",
+              line_buf_feed(&lb, big, LINE_BUF_MAX - 1, collect, NULL), 0);
+        check("L4: one more refused", feed(&lb, "x"), -EMSGSIZE);
+        check("L4: ... and discarded", (int)lb.len, 0);
+        check("L4: next command still works", feed(&lb, "show vlan\n"), 0);
+        check("L4: ... runs", strcmp(g_seen, "show vlan"), 0);
+        free(big);
+    }
+
+    line_buf_free(&lb);
+    check("L4: freed buffer is empty", lb.buf == NULL && lb.len == 0, 1);
+
+    printf("============================================================\n");
+    printf("  Results: %d passed, %d failed\n", g_pass, g_fail);
+    printf("============================================================\n");
+
+    return (g_fail > 0) ? 1 : 0;
+}
@@ -0,0 +1,218 @@
+/**
+ * @file test_link_attr.c
+ * @brief Test for the batched link attribute changes (link_attr.c).
+ *
+ * Tests:
+ *   A1: bad arguments are refused before anything reaches the kernel;
+ *       ranges and patterns are told from plain names
+ *   K1: a range covers the numbered names, the missing ones with -ENODEV;
+ *       setting the admin state again sends nothing; bad ranges are refused
+ *   K2: a pattern matches the existing interfaces; MTU and alias reach the
+ *       kernel and the snapshot, and only the attribute that differs is sent
+ *   K3: a change the kernel refuses is reported for its interface only and
+ *       not recorded, so the next command tries again
+ *
+ * A1 needs no privileges; K1..K3 run in a private network namespace and
+ * are skipped without CAP_SYS_ADMIN / CAP_NET_ADMIN.
+ */
+
+#define _GNU_SOURCE     /* unshare */
+
+#include <errno.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <net/if.h>
+#include <netlink/netlink.h>
+#include <netlink/route/link.h>
+#include <netlink/route/link/veth.h>
+
+#include "link_attr.h"
+#include "vlan_state.h"
+
+/* -------------------------------------------------------------------------
+ * Helpers
+ * ------------------------------------------------------------------------- */
+
+static int g_pass = 0;
+static int g_fail = 0;
+
+static void check(const char *desc, int got, int expected)
+{
+    if (got == expected)
+    {
+        printf("[PASS] %s  (ret=%d)\n", desc, got);
+        g_pass++;
+    }
+    else
+    {
+        printf("[FAIL] %s  (expected=%d, got=%d)\n", desc, expected, got);
+        g_fail++;
+    }
+}
+
+/* Create the pairs p0/q0 and p1/q1, all down. */
+static int make_pairs(void)
+{
+    struct nl_sock *sock = nl_socket_alloc();
+    int err;
+
+    if (!sock || nl_connect(sock, NETLINK_ROUTE) < 0)
+        return -1;
+    err = rtnl_link_veth_add(sock, "p0", "q0", getpid());
+    if (err == 0)
+        err = rtnl_link_veth_add(sock, "p1", "q1", getpid());
+    nl_socket_free(sock);
+    return err;
+}
+
+/* Kernel flags (@p mtu 0) or MTU of @p name; -1 on error. */
+static int kernel_attr(const char *name, int mtu)
+{
+    struct ifreq ifr;
+    int fd = socket(AF_INET, SOCK_DGRAM, 0);
+    int ret = -1;
+
+    if (fd < 0)
+        return -1;
+    memset(&ifr, 0, sizeof(ifr));
+    strncpy(ifr.ifr_name, name, IFNAMSIZ - 1);
+    if (ioctl(fd, mtu ? SIOCGIFMTU : SIOCGIFFLAGS, &ifr) == 0)
+        ret = mtu ? ifr.ifr_mtu : ifr.ifr_flags;
+    close(fd);
+    return ret;
+}
+
+/* Alias of @p name in the snapshot, or "?" */
+static const char *snap_alias(const char *name)
+{
+    static char alias[VS_ALIAS_LEN];
+    const struct vlan_snapshot *snap = vlan_state_read_begin();
+    const struct vs_link *l = snap ? vlan_snapshot_find_name(snap, name) : NULL;
+
+    snprintf(alias, sizeof(alias), "%s", l ? l->alias : "?");
+    vlan_state_read_end();
+    return alias;
+}
+
+/* Set @p a on @p spec; the count, and in g_res the results. */
+static struct link_result *g_res;
+static int set(const char *spec, const struct link_attrs *a)
+{
+    free(g_res);
+    g_res = NULL;
+    return link_attr_set(spec, a, &g_res);
+}
+
+/* K1..K3, inside the namespace with the p0/q0 and p1/q1 pairs. */
+static void test_kernel(void)
+{
+    struct link_attrs a;
+
+    usleep(100000);             /* let the snapshot see the pairs */
+
+    memset(&a, 0, sizeof(a));
+    a.set = LINK_ATTR_ADMIN;
+    a.up = 1;
+    check("K1: p0-3 up covers four names", set("p0-3", &a), 4);
+    check("K1: ... p0 brought up", g_res[0].changed == LINK_ATTR_ADMIN && g_res[0].status == 0, 1);
+    check("K1: ... p1 brought up", g_res[1].changed == LINK_ATTR_ADMIN && g_res[1].status == 0, 1);
+    check("K1: ... no p2", g_res[2].status, -ENODEV);
+    check("K1: ... no p3", strcmp(g_res[3].name, "p3") == 0 && g_res[3].status == -ENODEV, 1);
+    check("K1: p1 is up in the kernel", (kernel_attr("p1", 0) & IFF_UP) != 0, 1);
+    check("K1: p0-1 up again", set("p0-1", &a), 2);
+    check("K1: ... sends nothing", g_res[0].changed | g_res[1].changed, 0);
+    check("K1: a missing name", set("nonexistent0", &a), 1);
+    check("K1: ... with its status", g_res[0].status, -ENODEV);
+    check("K1: a pattern matching nothing", set("zz*", &a), -ENODEV);
+    check("K1: a reversed range", set("p3-1", &a), -EINVAL);
+    check("K1: a range over the limit", set("p0-4096", &a), -EINVAL);
+    check("K1: names too long", set("Ethernet-longname0-1", &a), -EINVAL);
+
+    memset(&a, 0, sizeof(a));
+    a.set = LINK_ATTR_MTU | LINK_ATTR_ALIAS;
+    a.mtu = 9000;
+    snprintf(a.alias, sizeof(a.alias), "uplink port");
+    check("K2: q* matches two", set("q*", &a), 2);
+    check("K2: ... q0 first", strcmp(g_res[0].name, "q0") == 0 || strcmp(g_res[1].name, "q0") == 0, 1);
+    check("K2: ... MTU and alias sent",
+          g_res[0].changed == (LINK_ATTR_MTU | LINK_ATTR_ALIAS) &&
+          g_res[1].changed == (LINK_ATTR_MTU | LINK_ATTR_ALIAS), 1);
+    check("K2: q1 MTU in the kernel", kernel_attr("q1", 1), 9000);
+    check("K2: q1 alias in the snapshot", strcmp(snap_alias("q1"), "uplink port"), 0);
+    a.set |= LINK_ATTR_ADMIN;
+    a.up = 1;
+    check("K2: q? with admin up", set("q?", &a), 2);
+    check("K2: ... only the admin state sent",
+          g_res[0].changed == LINK_ATTR_ADMIN && g_res[1].changed == LINK_ATTR_ADMIN, 1);
+    check("K2: q0 is up in the kernel", (kernel_attr("q0", 0) & IFF_UP) != 0, 1);
+    a.set = LINK_ATTR_ALIAS;
+    a.alias[0] = '\0';
+    check("K2: clearing the alias of q0", set("q0", &a), 1);
+    check("K2: ... sent", g_res[0].changed == LINK_ATTR_ALIAS && g_res[0].status == 0, 1);
+    check("K2: ... and recorded", strcmp(snap_alias("q0"), ""), 0);
+
+    memset(&a, 0, sizeof(a));
+    a.set = LINK_ATTR_MTU;
+    a.mtu = 10;
+    check("K3: MTU 10 on p0-1", set("p0-1", &a), 2);
+    check("K3: ... refused for each", g_res[0].status == -EINVAL && g_res[1].status == -EINVAL, 1);
+    check("K3: p0 MTU unchanged", kernel_attr("p0", 1), 1500);
+    check("K3: tried again", set("p0", &a) == 1 && g_res[0].changed == LINK_ATTR_MTU, 1);
+    free(g_res);
+    g_res = NULL;
+}
+
+/* -------------------------------------------------------------------------
+ * Main
+ * ------------------------------------------------------------------------- */
+
+int main(void)
+{
+    struct link_attrs a;
+    struct link_result *res = NULL;
+
+    setbuf(stdout, NULL);
+
+    printf("============================================================\n");
+    printf("  virtasic link attribute test\n");
+    printf("============================================================\n");
+
+    memset(&a, 0, sizeof(a));
+    check("A1: nothing to set", link_attr_set("p0", &a, &res), -EINVAL);
+    a.set = LINK_ATTR_MTU;
+    check("A1: MTU 0", link_attr_set("p0", &a, &res), -EINVAL);
+    a.mtu = 1500;
+    check("A1: no interface", link_attr_set(NULL, &a, &res), -EINVAL);
+    a.set = 0x8;
+    check("A1: unknown attribute", link_attr_set("p0", &a, &res), -EINVAL);
+    a.set = LINK_ATTR_ALIAS;
+    memset(a.alias, 'x', sizeof(a.alias));
+    check("A1: alias too long", link_attr_set("p0", &a, &res), -EINVAL);
+    check("A1: p0-3 is a range", link_attr_is_multi("p0-3"), 1);
+    check("A1: Ethernet* is a pattern", link_attr_is_multi("Ethernet*"), 1);
+    check("A1: Ethernet4 is one name", link_attr_is_multi("Ethernet4"), 0);
+    check("A1: veth-a is one name", link_attr_is_multi("veth-a"), 0);
+    check("A1: p3-1 is a range too", link_attr_is_multi("p3-1"), 1);
+    check("A1: no results handed out", res == NULL, 1);
+
+    if (unshare(CLONE_NEWNET) < 0 || vlan_state_init() < 0 || make_pairs() < 0)
+    {
+        printf("[SKIP] K: cannot create a network namespace with veth pairs\n");
+    }
+    else
+    {
+        test_kernel();
+        vlan_state_shutdown();
+    }
+
+    printf("============================================================\n");
+    printf("  Results: %d passed, %d failed\n", g_pass, g_fail);
+    printf("============================================================\n");
+
+    return (g_fail > 0) ? 1 : 0;
+}
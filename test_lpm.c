@@ -0,0 +1,254 @@
+/**
+ * @file test_lpm.c
+ * @brief Test for the DIR-24-8 longest-prefix-match table (lpm.c).
+ *
+ * Tests:
+ *   L1: argument checks
+ *   L2: nested prefixes from /0 to /32 resolve to the longest one
+ *   L3: a delete restores the next shorter prefix, at and below /24
+ *   L4: a /24 whose long prefixes are all gone is folded back into tbl24
+ *   L5: random prefixes, then half of them deleted, agree with a linear
+ *       reference on addresses inside and outside them
+ *   L6: a full rule table or group pool refuses the add and changes nothing
+ *   L7: burst lookup agrees with single lookups
+ *
+ * Needs no privileges.
+ */
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "lpm.h"
+
+#define NPREFIX   4000
+#define NADDR     20000
+
+/* -------------------------------------------------------------------------
+ * Helpers
+ * ------------------------------------------------------------------------- */
+
+static int g_pass = 0;
+static int g_fail = 0;
+
+static void check(const char *desc, int got, int expected)
+{
+    if (got == expected)
+    {
+        printf("[PASS] %s  (ret=%d)\n", desc, got);
+        g_pass++;
+    }
+    else
+    {
+        printf("[FAIL] %s  (expected=%d, got=%d)\n", desc, expected, got);
+        g_fail++;
+    }
+}
+
+static uint32_t ip(unsigned a, unsigned b, unsigned c, unsigned d)
+{
+    return a << 24 | b << 16 | c << 8 | d;
+}
+
+/* Next hop of @p addr, or -1. */
+static int lookup(const struct lpm *t, uint32_t addr)
+{
+    uint32_t nh;
+
+    return lpm_lookup(t, addr, &nh) == 0 ? (int)nh : -1;
+}
+
+struct ref
+{
+    uint32_t prefix;
+    unsigned depth;
+    uint32_t nh;
+    int      live;
+};
+
+static struct ref g_ref[NPREFIX];
+static uint32_t   g_addr[NADDR];
+
+static uint32_t mask(unsigned depth)
+{
+    return depth ? ~0u << (32 - depth) : 0;
+}
+
+static int ref_lookup(unsigned n, uint32_t addr)
+{
+    int best = -1;
+    unsigned i;
+
+    for (i = 0; i < n; i++)
+    {
+        if (g_ref[i].live && (addr & mask(g_ref[i].depth)) == g_ref[i].prefix &&
+            (best < 0 || g_ref[i].depth > g_ref[best].depth))
+            best = (int)i;
+    }
+    return best < 0 ? -1 : (int)g_ref[best].nh;
+}
+
+static unsigned mismatches(const struct lpm *t, unsigned n)
+{
+    unsigned i, bad = 0;
+
+    for (i = 0; i < NADDR; i++)
+        bad += lookup(t, g_addr[i]) != ref_lookup(n, g_addr[i]);
+    return bad;
+}
+
+/* -------------------------------------------------------------------------
+ * Main
+ * ------------------------------------------------------------------------- */
+
+int main(void)
+{
+    struct lpm_stats st;
+    struct lpm *t;
+    uint32_t nh[64];
+    uint64_t miss;
+    unsigned i, n, bad;
+
+    setbuf(stdout, NULL);
+    srandom(1);
+
+    printf("============================================================\n");
+    printf("  virtasic LPM table test\n");
+    printf("============================================================\n");
+
+    check("L1: lpm_create rejects no rules", lpm_create(0, 1) == NULL, 1);
+    check("L1: lpm_create rejects no groups", lpm_create(1, 0) == NULL, 1);
+    t = lpm_create(16, 4);
+    check("L1: lpm_create", t != NULL, 1);
+    if (!t)
+        return 1;
+    check("L1: depth above 32", lpm_add(t, 0, 33, 1), -EINVAL);
+    check("L1: next hop too large", lpm_add(t, 0, 8, LPM_NH_MAX + 1), -EINVAL);
+    check("L1: empty table misses", lookup(t, ip(10, 1, 2, 3)), -1);
+    check("L1: delete of a missing prefix", lpm_delete(t, ip(10, 0, 0, 0), 8), -ENOENT);
+
+    check("L2: add /0", lpm_add(t, 0, 0, 1), 0);
+    check("L2: add 10/8", lpm_add(t, ip(10, 0, 0, 0), 8, 2), 0);
+    check("L2: add 10.1/16", lpm_add(t, ip(10, 1, 0, 0), 16, 3), 0);
+    check("L2: add 10.1.2/24", lpm_add(t, ip(10, 1, 2, 0), 24, 4), 0);
+    check("L2: add 10.1.2.128/25", lpm_add(t, ip(10, 1, 2, 128), 25, 5), 0);
+    check("L2: add 10.1.2.200/32", lpm_add(t, ip(10, 1, 2, 200), 32, 6), 0);
+    check("L2: host bits ignored", lpm_add(t, ip(10, 1, 2, 129), 30, 7), 0);
+    check("L2: /0", lookup(t, ip(192, 0, 2, 1)), 1);
+    check("L2: /8", lookup(t, ip(10, 9, 9, 9)), 2);
+    check("L2: /16", lookup(t, ip(10, 1, 9, 9)), 3);
+    check("L2: /24", lookup(t, ip(10, 1, 2, 1)), 4);
+    check("L2: /25", lookup(t, ip(10, 1, 2, 199)), 5);
+    check("L2: /30", lookup(t, ip(10, 1, 2, 131)), 7);
+    check("L2: /32", lookup(t, ip(10, 1, 2, 200)), 6);
+    check("L2: next hop replaced", lpm_add(t, ip(10, 1, 0, 0), 16, 8), 0);
+    check("L2: /16 now 8", lookup(t, ip(10, 1, 9, 9)), 8);
+    check("L2: /24 unaffected", lookup(t, ip(10, 1, 2, 1)), 4);
+    lpm_get_stats(t, &st);
+    check("L2: seven rules", (int)st.rules, 7);
+    check("L2: one group in use", (int)st.groups_used, 1);
+
+    check("L3: delete 10.1.2/24", lpm_delete(t, ip(10, 1, 2, 0), 24), 0);
+    check("L3: /24 falls back to /16", lookup(t, ip(10, 1, 2, 1)), 8);
+    check("L3: /25 kept", lookup(t, ip(10, 1, 2, 199)), 5);
+    check("L3: delete the /25", lpm_delete(t, ip(10, 1, 2, 128), 25), 0);
+    check("L3: /25 falls back to /16", lookup(t, ip(10, 1, 2, 199)), 8);
+    check("L3: /30 kept", lookup(t, ip(10, 1, 2, 131)), 7);
+    check("L3: delete 10/8", lpm_delete(t, ip(10, 0, 0, 0), 8), 0);
+    check("L3: /8 falls back to /0", lookup(t, ip(10, 9, 9, 9)), 1);
+
+    check("L4: delete the /30", lpm_delete(t, ip(10, 1, 2, 128), 30), 0);
+    check("L4: delete the /32", lpm_delete(t, ip(10, 1, 2, 200), 32), 0);
+    lpm_get_stats(t, &st);
+    check("L4: group folded", (int)st.groups_used, 0);
+    check("L4: folded /24 resolves to /16", lookup(t, ip(10, 1, 2, 200)), 8);
+    check("L4: exact find", lpm_find(t, ip(10, 1, 0, 0), 16, &nh[0]) == 0 && nh[0] == 8, 1);
+
+    for (i = 0; i < 4; i++)
+        lpm_add(t, ip(20, 0, (uint8_t)i, 0), 28, 10);
+    lpm_get_stats(t, &st);
+    check("L6: group pool full", (int)st.groups_used, 4);
+    check("L6: fifth /24 refused", lpm_add(t, ip(20, 0, 9, 0), 28, 11), -ENOSPC);
+    check("L6: refused prefix absent", lookup(t, ip(20, 0, 9, 1)), 1);
+    check("L6: long prefix in a used group", lpm_add(t, ip(20, 0, 1, 64), 28, 12), 0);
+    for (n = 0; lpm_add(t, ip(30, (uint8_t)n, 0, 0), 16, 13) == 0; n++)
+        ;
+    lpm_get_stats(t, &st);
+    check("L6: rule table full", (int)st.rules, 16);
+    check("L6: refused rule absent", lookup(t, ip(30, (uint8_t)n, 0, 1)), 1);
+    lpm_destroy(t);
+
+    t = lpm_create(NPREFIX, 1024);
+    check("L5: lpm_create", t != NULL, 1);
+    if (!t)
+        return 1;
+    for (i = 0; i < NPREFIX; i++)
+    {
+        /* Mostly /16../24, some long, some very short; a few duplicates. */
+        unsigned r = (unsigned)random() % 100;
+        unsigned depth = r < 5 ? 1 + r : r < 80 ? 16 + r % 9 : 25 + r % 8;
+        uint32_t p = (uint32_t)random() & 0x0FFFFFFF;
+
+        g_ref[i].depth = depth;
+        g_ref[i].prefix = p & mask(depth);
+        g_ref[i].nh = i;
+        g_ref[i].live = 1;
+        if (lpm_find(t, g_ref[i].prefix, depth, &nh[0]) == 0)
+            g_ref[nh[0]].live = 0;
+        lpm_add(t, g_ref[i].prefix, depth, i);
+    }
+    for (i = 0; i < NADDR; i++)
+    {
+        const struct ref *r = &g_ref[(unsigned)random() % NPREFIX];
+
+        g_addr[i] = i % 4 ? r->prefix | ((uint32_t)random() & ~mask(r->depth))
+                          : (uint32_t)random();
+    }
+    bad = mismatches(t, NPREFIX);
+    check("L5: every address agrees with the reference", (int)bad, 0);
+
+    for (i = 0; i < NPREFIX; i += 2)
+    {
+        if (g_ref[i].live)
+        {
+            lpm_delete(t, g_ref[i].prefix, g_ref[i].depth);
+            g_ref[i].live = 0;
+        }
+    }
+    bad = mismatches(t, NPREFIX);
+    check("L5: agrees after deleting half", (int)bad, 0);
+
+    for (i = 0; i < NADDR; i += 64)
+    {
+        unsigned k;
+
+        n = NADDR - i < 64 ? NADDR - i : 64;
+        lpm_lookup_burst(t, &g_addr[i], n, nh, &miss);
+        for (k = 0; k < n; k++)
+        {
+            int one = lookup(t, g_addr[i + k]);
+
+            if ((miss & (1ull << k)) ? one != -1 : one != (int)nh[k])
+                bad++;
+        }
+    }
+    check("L7: burst lookup agrees", (int)bad, 0);
+
+    for (i = 1; i < NPREFIX; i += 2)
+    {
+        if (g_ref[i].live)
+            lpm_delete(t, g_ref[i].prefix, g_ref[i].depth);
+    }
+    lpm_get_stats(t, &st);
+    check("L5: empty again", (int)st.rules, 0);
+    check("L5: every group folded", (int)st.groups_used, 0);
+    lpm_destroy(t);
+
+    printf("============================================================\n");
+    printf("  Results: %d passed, %d failed\n", g_pass, g_fail);
+    printf("============================================================\n");
+
+    return (g_fail > 0) ? 1 : 0;
+}
@@ -0,0 +1,345 @@
+/**
+ * @file test_mirror.c
+ * @brief Unit test for the mirror rings and pcap-ng files (mirror.c).
+ *
+ * Tests:
+ *   R1: a ring refuses a record when full, hands records over in order
+ *       across the wrap, and accepts only power-of-two sizes
+ *   R2: a producer and a consumer thread pass 200000 records; every one is
+ *       either received in order or counted as refused
+ *   F1: records are cut to the snap length and a tag is put back after
+ *       the MAC addresses
+ *   P1: a file holds a section header, one interface block per port as it
+ *       first appears (again after a rename) and a packet block per frame
+ *       with its lengths, timestamp, interface and direction
+ *   P2: files rotate at their size limit, each with its own headers, and
+ *       their names wrap at the file count
+ *   P3: bad prefixes are refused
+ *
+ * Files are written to a temporary directory that is removed afterwards.
+ */
+
+#define _GNU_SOURCE     /* pthread_tryjoin_np */
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "mirror.h"
+
+/* -------------------------------------------------------------------------
+ * Helpers
+ * ------------------------------------------------------------------------- */
+
+static int g_pass = 0;
+static int g_fail = 0;
+
+static void check(const char *desc, int got, int expected)
+{
+    if (got == expected)
+    {
+        printf("[PASS] %s  (ret=%d)\n", desc, got);
+        g_pass++;
+    }
+    else
+    {
+        printf("[FAIL] %s  (expected=%d, got=%d)\n", desc, expected, got);
+        g_fail++;
+    }
+}
+
+static uint32_t get32(const uint8_t *p)
+{
+    uint32_t v;
+
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+/* Put a record of @p len bytes numbered @p seq into @p r; 0 or -1 if full. */
+static int put(struct mirror_ring *r, uint32_t seq, uint32_t len)
+{
+    struct mirror_rec *rec = mirror_ring_reserve(r);
+
+    if (!rec)
+        return -1;
+    rec->len = len;
+    rec->caplen = 4;
+    memcpy(rec->data, &seq, 4);
+    mirror_ring_commit(r);
+    return 0;
+}
+
+/* Sequence number of the oldest record of @p r, released; -1 if empty. */
+static long take(struct mirror_ring *r)
+{
+    const struct mirror_rec *rec = mirror_ring_peek(r);
+    uint32_t seq;
+
+    if (!rec)
+        return -1;
+    memcpy(&seq, rec->data, 4);
+    mirror_ring_release(r);
+    return seq;
+}
+
+#define R2_RECORDS  200000
+
+static struct mirror_ring *g_ring;
+static long g_refused;
+
+static void *producer(void *arg)
+{
+    uint32_t i;
+
+    (void)arg;
+    for (i = 0; i < R2_RECORDS; i++)
+    {
+        if (put(g_ring, i, 64) < 0)
+            g_refused++;
+    }
+    return NULL;
+}
+
+/* A record from port @p port in direction @p dir, @p len bytes of 0xAB. */
+static void rec_make(struct mirror_rec *rec, unsigned port, unsigned dir, unsigned len)
+{
+    static uint8_t frame[1600];
+
+    memset(frame, 0xAB, sizeof(frame));
+    mirror_rec_fill(rec, frame, len, 0, 0);
+    rec->ts_ns = 1700000000123456789ull;
+    rec->session = 0;
+    rec->dir = (uint8_t)dir;
+    rec->port = (uint16_t)port;
+}
+
+static uint8_t *slurp(const char *path, size_t *len)
+{
+    FILE *fp = fopen(path, "r");
+    uint8_t *b;
+    long n;
+
+    *len = 0;
+    if (!fp)
+        return NULL;
+    fseek(fp, 0, SEEK_END);
+    n = ftell(fp);
+    fseek(fp, 0, SEEK_SET);
+    b = malloc((size_t)n + 1);
+    if (b && fread(b, 1, (size_t)n, fp) == (size_t)n)
+        *len = (size_t)n;
+    fclose(fp);
+    return b;
+}
+
+/* Block types of the pcap-ng file at @p path, in order, into @p types;
+ * their count, or -1 if a length field is inconsistent. */
+static int blocks(const char *path, uint32_t *types, const uint8_t **at, int max)
+{
+    static uint8_t *b;
+    size_t len, off = 0;
+    int n = 0;
+
+    free(b);
+    if ((b = slurp(path, &len)) == NULL)
+        return -1;
+    while (off + 12 <= len && n < max)
+    {
+        uint32_t blen = get32(b + off + 4);
+
+        if (blen < 12 || blen % 4 || off + blen > len || get32(b + off + blen - 4) != blen)
+            return -1;
+        types[n] = get32(b + off);
+        at[n++] = b + off;
+        off += blen;
+    }
+    return off == len ? n : -1;
+}
+
+static int exists(const char *path)
+{
+    struct stat st;
+
+    return stat(path, &st) == 0;
+}
+
+/* -------------------------------------------------------------------------
+ * Main
+ * ------------------------------------------------------------------------- */
+
+int main(void)
+{
+    static uint8_t slot[MIRROR_SLOT_SIZE];
+    struct mirror_rec *rec = (struct mirror_rec *)slot;
+    struct mirror_file mf;
+    struct mirror_ring *r;
+    const uint8_t *at[32];
+    uint32_t types[32];
+    uint8_t frame[64];
+    char dir[] = "/tmp/test_mirror.XXXXXX";
+    char prefix[64], path[96];
+    pthread_t th;
+    long got, want;
+    int i, n, order;
+
+    setbuf(stdout, NULL);
+
+    printf("============================================================\n");
+    printf("  virtasic mirror test\n");
+    printf("============================================================\n");
+
+    check("R1: size 6 refused", mirror_ring_create(6) == NULL, 1);
+    r = mirror_ring_create(4);
+    check("R1: ring of 4", r != NULL, 1);
+    for (i = 0; i < 4; i++)
+        put(r, (uint32_t)i, 64);
+    check("R1: fifth record refused", put(r, 4, 64), -1);
+    check("R1: oldest first", (int)take(r), 0);
+    check("R1: room again", put(r, 4, 64), 0);
+    order = 1;
+    for (i = 1; i < 1000; i++)
+    {
+        order &= take(r) == i;
+        put(r, (uint32_t)(i + 4), 64);
+    }
+    check("R1: in order across the wrap", order, 1);
+    for (i = 0; i < 4; i++)
+        take(r);
+    check("R1: empty", (int)take(r), -1);
+    mirror_ring_destroy(r);
+
+    g_ring = mirror_ring_create(256);
+    pthread_create(&th, NULL, producer, NULL);
+    got = 0;
+    want = 0;
+    order = 1;
+    for (;;)
+    {
+        long seq = take(g_ring);
+
+        if (seq < 0)
+        {
+            if (pthread_tryjoin_np(th, NULL) == 0)
+            {
+                while ((seq = take(g_ring)) >= 0)
+                {
+                    order &= seq >= want;
+                    want = seq + 1;
+                    got++;
+                }
+                break;
+            }
+            continue;
+        }
+        order &= seq >= want;
+        want = seq + 1;
+        got++;
+    }
+    check("R2: records in order", order, 1);
+    check("R2: received + refused", (int)(got + g_refused), R2_RECORDS);
+    mirror_ring_destroy(g_ring);
+
+    for (i = 0; i < 64; i++)
+        frame[i] = (uint8_t)i;
+    check("F1: untagged, cut", (int)mirror_rec_fill(rec, frame, 64, 0, 20), 20);
+    check("F1: ... wire length kept", (int)rec->len, 64);
+    check("F1: ... bytes", memcmp(rec->data, frame, 20), 0);
+    check("F1: tagged", (int)mirror_rec_fill(rec, frame, 64, 0x200A, 0), 68);
+    check("F1: ... MACs", memcmp(rec->data, frame, 12), 0);
+    check("F1: ... tag", memcmp(rec->data + 12, (const uint8_t[]){ 0x81, 0x00, 0x20, 0x0A }, 4), 0);
+    check("F1: ... rest", memcmp(rec->data + 16, frame + 12, 52), 0);
+    check("F1: tagged, cut inside the tag", (int)mirror_rec_fill(rec, frame, 64, 0x000A, 14), 14);
+    check("F1: ... wire length", (int)rec->len, 68);
+    check("F1: ... tag start", rec->data[12] == 0x81 && rec->data[13] == 0x00, 1);
+
+    if (!mkdtemp(dir))
+    {
+        printf("[SKIP] P1..P3: cannot create a temporary directory\n");
+        goto out;
+    }
+    snprintf(prefix, sizeof(prefix), "%s/cap", dir);
+    check("P1: open", mirror_file_open(&mf, prefix, 100, 0, 0), 0);
+    rec_make(rec, 3, MIRROR_RX, 60);
+    check("P1: port 3 rx", mirror_file_write(&mf, rec, "s3"), 0);
+    rec_make(rec, 7, MIRROR_TX, 1500);
+    check("P1: port 7 tx, over the snap length", mirror_file_write(&mf, rec, "s7"), 0);
+    rec_make(rec, 3, MIRROR_TX, 61);
+    check("P1: port 3 again", mirror_file_write(&mf, rec, "s3"), 0);
+    rec_make(rec, 3, MIRROR_RX, 62);
+    check("P1: port 3 renamed", mirror_file_write(&mf, rec, "s9"), 0);
+    rec->port = MIRROR_MAX_IFS;
+    check("P1: port out of range", mirror_file_write(&mf, rec, "x"), -EINVAL);
+    check("P1: counted", (int)mf.frames, 4);
+    mirror_file_close(&mf);
+    snprintf(path, sizeof(path), "%s.0.pcapng", prefix);
+    n = blocks(path, types, at, 32);
+    check("P1: eight well-formed blocks", n, 8);
+    if (n == 8)
+    {
+        check("P1: section header, byte order",
+              types[0] == 0x0A0D0D0A && get32(at[0] + 8) == 0x1A2B3C4D, 1);
+        check("P1: interface, packet, interface, packet, packet, interface, packet",
+              types[1] == 1 && types[2] == 6 && types[3] == 1 && types[4] == 6 &&
+              types[5] == 6 && types[6] == 1 && types[7] == 6, 1);
+        check("P1: Ethernet, snap length 100",
+              (get32(at[1] + 8) & 0xFFFF) == 1 && get32(at[1] + 12) == 100, 1);
+        check("P1: interface named s3", memcmp(at[1] + 20, "s3", 2), 0);
+        check("P1: first packet on interface 0, 60 bytes",
+              get32(at[2] + 8) == 0 && get32(at[2] + 20) == 60 && get32(at[2] + 24) == 60, 1);
+        check("P1: timestamp", get32(at[2] + 12) == (uint32_t)(1700000000123456789ull >> 32) &&
+              get32(at[2] + 16) == (uint32_t)1700000000123456789ull, 1);
+        check("P1: inbound", get32(at[2] + 28 + 60 + 4), 1);
+        check("P1: second on interface 1, cut to 100 of 1500",
+              get32(at[4] + 8) == 1 && get32(at[4] + 20) == 100 && get32(at[4] + 24) == 1500, 1);
+        check("P1: outbound", get32(at[4] + 28 + 100 + 4), 2);
+        check("P1: third back on interface 0", (int)get32(at[5] + 8), 0);
+        check("P1: third padded", (int)get32(at[5] + 4), 28 + 64 + 12 + 4);
+        check("P1: renamed port described again", memcmp(at[6] + 20, "s9", 2), 0);
+        check("P1: ... as interface 2", (int)get32(at[7] + 8), 2);
+    }
+    else
+    {
+        check("P1: file readable", 0, 1);
+    }
+
+    snprintf(prefix, sizeof(prefix), "%s/rot", dir);
+    check("P2: open, 600 bytes a file, 2 files", mirror_file_open(&mf, prefix, 0, 600, 2), 0);
+    for (i = 0; i < 12; i++)
+    {
+        rec_make(rec, 1, MIRROR_RX, 100);
+        mirror_file_write(&mf, rec, "s1");
+    }
+    check("P2: every frame written", (int)mf.frames, 12);
+    check("P2: three frames a file", (int)mf.seq, 4);
+    snprintf(path, sizeof(path), "%s.1.pcapng", prefix);
+    check("P2: second name used", exists(path), 1);
+    snprintf(path, sizeof(path), "%s.2.pcapng", prefix);
+    check("P2: names wrap", exists(path), 0);
+    mirror_file_close(&mf);
+    snprintf(path, sizeof(path), "%s.0.pcapng", prefix);
+    n = blocks(path, types, at, 32);
+    check("P2: a rotated file starts with its own headers",
+          n == 5 && types[0] == 0x0A0D0D0A && types[1] == 1 && types[2] == 6, 1);
+    check("P2: ... and stays within the limit", n == 5 && at[4] + get32(at[4] + 4) - at[0] <= 600, 1);
+
+    check("P3: empty prefix", mirror_file_open(&mf, "", 0, 0, 0), -EINVAL);
+    snprintf(prefix, sizeof(prefix), "%s/missing/cap", dir);
+    check("P3: missing directory", mirror_file_open(&mf, prefix, 0, 0, 0), -ENOENT);
+
+    snprintf(path, sizeof(path), "rm -rf %s", dir);
+    if (system(path) != 0)
+        printf("cannot remove %s\n", dir);
+
+out:
+    printf("============================================================\n");
+    printf("  Results: %d passed, %d failed\n", g_pass, g_fail);
+    printf("============================================================\n");
+
+    return (g_fail > 0) ? 1 : 0;
+}
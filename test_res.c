@@ -0,0 +1,189 @@
+/**
+ * @file test_res.c
+ * @brief Test for the resource manager (res.c).
+ *
+ * Tests:
+ *   R1: every table starts empty at its limit with the default thresholds;
+ *       names parse both ways
+ *   R2: reservations stop at the capacity with -ENOSPC and reserve nothing;
+ *       freeing keeps the high-water mark
+ *   R3: the alarm is raised at the high threshold, signalled on the event
+ *       fd and reported once; it clears at the low threshold, not before
+ *   R4: the capacity cannot drop below the usage or leave [1..limit];
+ *       lowering it raises the alarm, thresholds are validated
+ *   R5: res_set_used() moves the usage, the high-water mark and the alarm
+ *   R6: four threads reserving at once never exceed the capacity
+ *
+ * Needs no privileges.
+ */
+
+#include <errno.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "res.h"
+
+/* -------------------------------------------------------------------------
+ * Helpers
+ * ------------------------------------------------------------------------- */
+
+static int g_pass = 0;
+static int g_fail = 0;
+
+static void check(const char *desc, int got, int expected)
+{
+    if (got == expected)
+    {
+        printf("[PASS] %s  (ret=%d)\n", desc, got);
+        g_pass++;
+    }
+    else
+    {
+        printf("[FAIL] %s  (expected=%d, got=%d)\n", desc, expected, got);
+        g_fail++;
+    }
+}
+
+static struct res_info info(enum res_kind kind)
+{
+    struct res_info i;
+
+    res_get(kind, &i);
+    return i;
+}
+
+static int readable(int fd)
+{
+    struct pollfd p = { .fd = fd, .events = POLLIN };
+
+    return poll(&p, 1, 0) == 1;
+}
+
+/* Last alarm res_poll_alarms() reported. */
+static int g_reported_kind = -1;
+static int g_reported_alarm = -1;
+static void on_alarm(enum res_kind kind, const struct res_info *i, void *arg)
+{
+    (void)arg;
+    g_reported_kind = (int)kind;
+    g_reported_alarm = i->alarm;
+}
+
+/* R6 workers: reserve one entry at a time until the table is full. */
+static unsigned g_got[4];
+static void *reserver(void *arg)
+{
+    unsigned *got = arg;
+
+    while (res_alloc(RES_ROUTE, 1) == 0)
+        (*got)++;
+    return NULL;
+}
+
+/* -------------------------------------------------------------------------
+ * Main
+ * ------------------------------------------------------------------------- */
+
+int main(void)
+{
+    pthread_t th[4];
+    unsigned k, ok, sum;
+    int fd;
+
+    setbuf(stdout, NULL);
+
+    printf("============================================================\n");
+    printf("  virtasic resource manager test\n");
+    printf("============================================================\n");
+
+    for (ok = 1, k = 0; k < RES_NKINDS; k++)
+    {
+        struct res_info i = info((enum res_kind)k);
+
+        ok &= i.limit > 0 && i.capacity == i.limit && i.used == 0 && i.high_water == 0 &&
+              i.high == RES_DEFAULT_HIGH && i.low == RES_DEFAULT_LOW && !i.alarm;
+        ok &= res_kind_parse(res_kind_name(k)) == (int)k;
+    }
+    check("R1: tables start empty at their limit", (int)ok, 1);
+    check("R1: VLAN limit", (int)info(RES_VLAN).limit, 4094);
+    check("R1: unknown name", res_kind_parse("tcam"), -EINVAL);
+    check("R1: unknown table", res_alloc(RES_NKINDS, 1), -EINVAL);
+
+    check("R2: capacity 10", res_set_capacity(RES_VLAN, 10), 0);
+    check("R2: reserve 8", res_alloc(RES_VLAN, 8), 0);
+    check("R2: 3 more do not fit", res_alloc(RES_VLAN, 3), -ENOSPC);
+    check("R2: ... and reserve nothing", (int)info(RES_VLAN).used, 8);
+    check("R2: 2 more fit", res_alloc(RES_VLAN, 2), 0);
+    check("R2: full", res_alloc(RES_VLAN, 1), -ENOSPC);
+    check("R2: refusals counted", (int)info(RES_VLAN).failures, 2);
+    res_free(RES_VLAN, 6);
+    check("R2: 4 used after freeing 6", (int)info(RES_VLAN).used, 4);
+    check("R2: high-water mark kept", (int)info(RES_VLAN).high_water, 10);
+    res_free(RES_VLAN, 100);
+    check("R2: freeing too much empties", (int)info(RES_VLAN).used, 0);
+
+    fd = res_event_fd();
+    check("R3: event fd", fd >= 0, 1);
+    res_poll_alarms(NULL, NULL);
+    check("R3: the alarm R2 raised cleared with the table", info(RES_VLAN).alarm, 0);
+    check("R3: capacity 20", res_set_capacity(RES_VLAN, 20), 0);
+    check("R3: 17 of 20 is under 90 %", res_alloc(RES_VLAN, 17), 0);
+    check("R3: no alarm", info(RES_VLAN).alarm || readable(fd), 0);
+    check("R3: 18 of 20", res_alloc(RES_VLAN, 1), 0);
+    check("R3: alarm raised", info(RES_VLAN).alarm, 1);
+    check("R3: event fd readable", readable(fd), 1);
+    check("R3: one table reported", res_poll_alarms(on_alarm, NULL), 1);
+    check("R3: ... VLAN raised", g_reported_kind == RES_VLAN && g_reported_alarm == 1, 1);
+    check("R3: event fd drained", readable(fd), 0);
+    check("R3: reported once", res_poll_alarms(on_alarm, NULL), 0);
+    res_free(RES_VLAN, 1);
+    check("R3: 17 of 20 keeps the alarm", info(RES_VLAN).alarm, 1);
+    res_free(RES_VLAN, 1);
+    check("R3: 16 of 20 clears it", info(RES_VLAN).alarm, 0);
+    check("R3: clear reported", res_poll_alarms(on_alarm, NULL) == 1 && g_reported_alarm == 0, 1);
+    check("R3: raised twice in all", (int)info(RES_VLAN).raised, 2);
+
+    check("R4: below the usage", res_set_capacity(RES_VLAN, 15), -EBUSY);
+    check("R4: zero", res_set_capacity(RES_VLAN, 0), -EINVAL);
+    check("R4: above the limit", res_set_capacity(RES_VLAN, 4095), -EINVAL);
+    check("R4: 16 of 16", res_set_capacity(RES_VLAN, 16), 0);
+    check("R4: raises the alarm", info(RES_VLAN).alarm, 1);
+    check("R4: high 0", res_set_threshold(RES_VLAN, 0, 0), -EINVAL);
+    check("R4: high 101", res_set_threshold(RES_VLAN, 101, 50), -EINVAL);
+    check("R4: low not below high", res_set_threshold(RES_VLAN, 50, 50), -EINVAL);
+    check("R4: a full table keeps its alarm at 100/99 %",
+          res_set_threshold(RES_VLAN, 100, 99) == 0 && info(RES_VLAN).alarm, 1);
+    res_free(RES_VLAN, 16);
+    check("R4: empty clears", info(RES_VLAN).alarm, 0);
+    res_poll_alarms(NULL, NULL);
+
+    res_set_used(RES_FDB, 1000);
+    res_set_used(RES_FDB, 700);
+    check("R5: used", (int)info(RES_FDB).used, 700);
+    check("R5: high-water mark", (int)info(RES_FDB).high_water, 1000);
+    check("R5: threshold 1 %", res_set_threshold(RES_FDB, 1, 0), 0);
+    check("R5: alarm raised", info(RES_FDB).alarm, 1);
+    res_set_used(RES_FDB, 0);
+    check("R5: cleared at 0", info(RES_FDB).alarm, 0);
+    check("R5: a crossing and back is not reported", res_poll_alarms(on_alarm, NULL), 0);
+
+    check("R6: capacity 100000", res_set_capacity(RES_ROUTE, 100000), 0);
+    for (k = 0; k < 4; k++)
+        pthread_create(&th[k], NULL, reserver, &g_got[k]);
+    for (sum = 0, k = 0; k < 4; k++)
+    {
+        pthread_join(th[k], NULL);
+        sum += g_got[k];
+    }
+    check("R6: exactly the capacity reserved", (int)sum, 100000);
+    check("R6: used", (int)info(RES_ROUTE).used, 100000);
+    check("R6: four refusals", (int)info(RES_ROUTE).failures, 4);
+
+    printf("============================================================\n");
+    printf("  Results: %d passed, %d failed\n", g_pass, g_fail);
+    printf("============================================================\n");
+
+    return (g_fail > 0) ? 1 : 0;
+}
@@ -0,0 +1,232 @@
+/**
+ * @file test_sched.c
+ * @brief Unit test for the keyed command worker pool (cmd_sched.c).
+ *
+ *   S1: jobs on the same key run in submission order
+ *   S2: a job keyed on two queues runs after its predecessors on both
+ *   S3: SCHED_KEY_ALL runs after every earlier job and before later ones
+ *   S4: queue statistics balance after sched_drain()
+ *   S5: invalid arguments are rejected with -EINVAL
+ *
+ * No kernel interaction is required.
+ */
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <unistd.h>
+
+#include "cmd_sched.h"
+
+#define TEST_WORKERS   4
+#define TEST_JOBS      400
+#define TEST_NKEYS     8
+
+/* -------------------------------------------------------------------------
+ * Helpers
+ * ------------------------------------------------------------------------- */
+
+static int g_pass = 0;
+static int g_fail = 0;
+
+static void check(const char *desc, int got, int expected)
+{
+    if (got == expected)
+    {
+        printf("[PASS] %s  (ret=%d)\n", desc, got);
+        g_pass++;
+    }
+    else
+    {
+        printf("[FAIL] %s  (expected=%d, got=%d)\n", desc, expected, got);
+        g_fail++;
+    }
+}
+
+static pthread_mutex_t g_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* Last sequence number observed per key, and ordering violations seen. */
+static int g_last_seq[TEST_NKEYS];
+static int g_violations;
+
+/* Global completion counter, used by the barrier tests. */
+static int g_completed;
+
+struct seq_job
+{
+    int key;
+    int seq;
+};
+
+static struct seq_job g_jobs[TEST_JOBS];
+
+static void seq_job_fn(void *arg)
+{
+    struct seq_job *j = arg;
+
+    /* Widen the race window so reordering would actually be observed. */
+    if ((j->seq % 7) == 0)
+        usleep(100);
+
+    pthread_mutex_lock(&g_lock);
+    if (j->seq <= g_last_seq[j->key])
+        g_violations++;
+    g_last_seq[j->key] = j->seq;
+    g_completed++;
+    pthread_mutex_unlock(&g_lock);
+}
+
+struct barrier_job
+{
+    int expect_completed;
+    int observed;
+};
+
+static void barrier_job_fn(void *arg)
+{
+    struct barrier_job *b = arg;
+
+    pthread_mutex_lock(&g_lock);
+    b->observed = g_completed;
+    g_completed++;
+    pthread_mutex_unlock(&g_lock);
+}
+
+static void slow_job_fn(void *arg)
+{
+    (void)arg;
+    usleep(2000);
+    pthread_mutex_lock(&g_lock);
+    g_completed++;
+    pthread_mutex_unlock(&g_lock);
+}
+
+/* -------------------------------------------------------------------------
+ * Tests
+ * ------------------------------------------------------------------------- */
+
+static void test_per_key_order(void)
+{
+    int i;
+
+    for (i = 0; i < TEST_NKEYS; i++)
+        g_last_seq[i] = -1;
+    g_violations = 0;
+
+    for (i = 0; i < TEST_JOBS; i++)
+    {
+        uint32_t key;
+
+        g_jobs[i].key = i % TEST_NKEYS;
+        g_jobs[i].seq = i;
+        key = sched_key_vlan((uint16_t)(100 + g_jobs[i].key));
+        sched_submit(&key, 1, seq_job_fn, &g_jobs[i]);
+    }
+    sched_drain();
+
+    check("S1: per-key submission order preserved", g_violations, 0);
+}
+
+static void test_multi_key(void)
+{
+    uint32_t k_vlan  = sched_key_vlan(10);
+    uint32_t k_iface = sched_key_iface("Ethernet0");
+    uint32_t both[2] = { k_vlan, k_iface };
+    struct barrier_job mid  = { 0, -1 };
+    struct barrier_job tail = { 0, -1 };
+
+    g_completed = 0;
+
+    sched_submit(&k_vlan, 1, slow_job_fn, NULL);
+    sched_submit(&k_iface, 1, slow_job_fn, NULL);
+    sched_submit(both, 2, barrier_job_fn, &mid);
+    sched_submit(&k_iface, 1, barrier_job_fn, &tail);
+    sched_drain();
+
+    check("S2: two-key job waits for both predecessors", mid.observed, 2);
+    check("S2: later job on second key runs after two-key job", tail.observed, 3);
+}
+
+static void test_key_all(void)
+{
+    uint32_t all = SCHED_KEY_ALL;
+    struct barrier_job b = { 0, -1 };
+    int i;
+
+    g_completed = 0;
+
+    for (i = 0; i < 16; i++)
+    {
+        uint32_t key = sched_key_vlan((uint16_t)(1 + i));
+        sched_submit(&key, 1, slow_job_fn, NULL);
+    }
+    sched_submit(&all, 1, barrier_job_fn, &b);
+    sched_drain();
+
+    check("S3: SCHED_KEY_ALL runs after all earlier jobs", b.observed, 16);
+}
+
+static void test_stats(void)
+{
+    struct sched_queue_stats st;
+    unsigned q;
+    int depth = 0;
+    int unbalanced = 0;
+
+    for (q = 0; q < sched_queue_count(); q++)
+    {
+        sched_get_stats(q, &st);
+        depth += st.depth;
+        if (st.submitted != st.completed)
+            unbalanced++;
+    }
+
+    check("S4: queue count", (int)sched_queue_count(), TEST_WORKERS);
+    check("S4: all queues empty after drain", depth, 0);
+    check("S4: submitted == completed on every queue", unbalanced, 0);
+    check("S4: out-of-range queue rejected",
+          sched_get_stats(TEST_WORKERS, &st), -EINVAL);
+}
+
+static void test_invalid(void)
+{
+    uint32_t key = 1;
+
+    check("S5: NULL fn rejected", sched_submit(&key, 1, NULL, NULL), -EINVAL);
+    check("S5: too many keys rejected",
+          sched_submit(&key, SCHED_MAX_KEYS + 1, slow_job_fn, NULL), -EINVAL);
+}
+
+/* -------------------------------------------------------------------------
+ * Main
+ * ------------------------------------------------------------------------- */
+
+int main(void)
+{
+    setbuf(stdout, NULL);
+
+    printf("============================================================\n");
+    printf("  virtasic command scheduler test\n");
+    printf("============================================================\n");
+
+    if (sched_init(TEST_WORKERS) < 0)
+    {
+        printf("[FAIL] sched_init\n");
+        return 1;
+    }
+
+    test_per_key_order();
+    test_multi_key();
+    test_key_all();
+    test_stats();
+    test_invalid();
+
+    sched_shutdown();
+
+    printf("============================================================\n");
+    printf("  Results: %d passed, %d failed\n", g_pass, g_fail);
+    printf("============================================================\n");
+
+    return (g_fail > 0) ? 1 : 0;
+}
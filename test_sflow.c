@@ -0,0 +1,191 @@
+/**
+ * @file test_sflow.c
+ * @brief Unit test for sFlow v5 datagram encoding and sampling (sflow.c).
+ *
+ * Tests:
+ *   K1: skip counts stay within [1, 2N-1], average N and cover the range;
+ *       rates 0 and 1 sample every frame
+ *   G1: a datagram header carries version 5, the IPv4 agent, sub-agent,
+ *       sequence number, uptime and its sample count
+ *   G2: a flow sample's fields, its header record (cut to the frame and
+ *       padded) and its extended switch record decode as written
+ *   G3: port and VLAN counter samples decode as written, with the counters
+ *       not kept marked unknown
+ *   G4: a full datagram refuses a sample and stays as it was
+ */
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "sflow.h"
+
+/* -------------------------------------------------------------------------
+ * Helpers
+ * ------------------------------------------------------------------------- */
+
+static int g_pass = 0;
+static int g_fail = 0;
+
+static void check(const char *desc, int got, int expected)
+{
+    if (got == expected)
+    {
+        printf("[PASS] %s  (ret=%d)\n", desc, got);
+        g_pass++;
+    }
+    else
+    {
+        printf("[FAIL] %s  (expected=%d, got=%d)\n", desc, expected, got);
+        g_fail++;
+    }
+}
+
+/* Big-endian word @p i (counted in words) of @p p. */
+static uint32_t word(const uint8_t *p, unsigned i)
+{
+    p += 4 * i;
+    return (uint32_t)p[0] << 24 | (uint32_t)p[1] << 16 | (uint32_t)p[2] << 8 | p[3];
+}
+
+static const uint8_t g_agent[4] = { 192, 0, 2, 1 };
+
+/* -------------------------------------------------------------------------
+ * Main
+ * ------------------------------------------------------------------------- */
+
+int main(void)
+{
+    struct sflow_dgram d;
+    struct sflow_flow s;
+    struct sflow_if_counters ic;
+    struct sflow_vlan_counters vc;
+    uint8_t frame[100];
+    const uint8_t *p;
+    uint32_t state = 0;
+    uint64_t sum = 0;
+    uint32_t min = ~0u, max = 0, k;
+    size_t len;
+    unsigned i;
+    int n;
+
+    setbuf(stdout, NULL);
+
+    printf("============================================================\n");
+    printf("  virtasic sFlow test\n");
+    printf("============================================================\n");
+
+    for (i = 0; i < 100000; i++)
+    {
+        k = sflow_skip(&state, 64);
+        sum += k;
+        min = k < min ? k : min;
+        max = k > max ? k : max;
+    }
+    check("K1: never below 1", (int)min, 1);
+    check("K1: never above 127", (int)max, 127);
+    check("K1: mean within 2% of 64", sum >= 6272 * 1000 && sum <= 6528 * 1000, 1);
+    check("K1: rate 1 samples every frame", (int)sflow_skip(&state, 1), 1);
+    check("K1: so does rate 0", (int)sflow_skip(&state, 0), 1);
+    state = 0;
+    sflow_skip(&state, 8);
+    check("K1: state 0 is seeded", state != 0, 1);
+
+    sflow_dgram_start(&d, g_agent, 3, 77, 123456);
+    check("G1: header length", (int)d.len, 28);
+    check("G1: version 5", (int)word(d.buf, 0), 5);
+    check("G1: IPv4 agent", (int)word(d.buf, 1), 1);
+    check("G1: agent address", memcmp(d.buf + 8, g_agent, 4), 0);
+    check("G1: sub-agent", (int)word(d.buf, 3), 3);
+    check("G1: sequence number", (int)word(d.buf, 4), 77);
+    check("G1: uptime", (int)word(d.buf, 5), 123456);
+    check("G1: no samples yet", (int)word(d.buf, 6), 0);
+
+    for (i = 0; i < sizeof(frame); i++)
+        frame[i] = (uint8_t)i;
+    memset(&s, 0, sizeof(s));
+    s.seq = 9;
+    s.source = SFLOW_SOURCE(SFLOW_DS_IFINDEX, 5);
+    s.rate = 64;
+    s.pool = 640;
+    s.drops = 2;
+    s.input = 5;
+    s.frame_len = 62;
+    s.header = frame;
+    s.header_len = SFLOW_HEADER_MAX;
+    s.vid = 10;
+    s.pcp = 5;
+    check("G2: add a flow sample", sflow_add_flow(&d, &s), 0);
+    p = d.buf + 28;
+    check("G2: sample count", (int)word(d.buf, 6), 1);
+    check("G2: flow sample tag", (int)word(p, 0), 1);
+    check("G2: its length", (int)word(p, 1), (int)(d.len - 28 - 8));
+    check("G2: sequence number", (int)word(p, 2), 9);
+    check("G2: source", (int)word(p, 3), 5);
+    check("G2: rate, pool, drops", word(p, 4) == 64 && word(p, 5) == 640 && word(p, 6) == 2, 1);
+    check("G2: input, output", word(p, 7) == 5 && word(p, 8) == 0, 1);
+    check("G2: two records", (int)word(p, 9), 2);
+    check("G2: raw header record", (int)word(p, 10), 1);
+    check("G2: its length, 62 bytes padded", (int)word(p, 11), 16 + 64);
+    check("G2: Ethernet", (int)word(p, 12), 1);
+    check("G2: frame length", (int)word(p, 13), 62);
+    check("G2: header cut to the frame", (int)word(p, 15), 62);
+    check("G2: header bytes", memcmp(p + 64, frame, 62), 0);
+    check("G2: padding zeroed", p[64 + 62] == 0 && p[64 + 63] == 0, 1);
+    p += 64 + 64;
+    check("G2: extended switch record", word(p, 0) == 1001 && word(p, 1) == 16, 1);
+    check("G2: VLAN and priority", word(p, 2) == 10 && word(p, 3) == 5 && word(p, 4) == 10, 1);
+
+    memset(&ic, 0, sizeof(ic));
+    ic.seq = 4;
+    ic.ifindex = 5;
+    ic.status = SFLOW_IF_ADMIN_UP | SFLOW_IF_OPER_UP;
+    ic.speed = 10000000000ull;
+    ic.in_octets = 0x123456789ull;
+    ic.in_packets = 1000;
+    ic.out_discards = 7;
+    len = d.len;
+    check("G3: add port counters", sflow_add_if_counters(&d, &ic), 0);
+    p = d.buf + len;
+    check("G3: counter sample tag and length", word(p, 0) == 2 && word(p, 1) == 108, 1);
+    check("G3: source", word(p, 2) == 4 && word(p, 3) == 5 && word(p, 4) == 1, 1);
+    check("G3: generic interface record", word(p, 5) == 1 && word(p, 6) == 88, 1);
+    p += 28;
+    check("G3: ifIndex, Ethernet", word(p, 0) == 5 && word(p, 1) == 6, 1);
+    check("G3: 10 Gb/s", word(p, 2) == 2 && word(p, 3) == 0x540BE400u, 1);
+    check("G3: up", (int)word(p, 5), 3);
+    check("G3: in octets", word(p, 6) == 1 && word(p, 7) == 0x23456789u, 1);
+    check("G3: in packets", (int)word(p, 8), 1000);
+    check("G3: multicast not kept", word(p, 9) == 0xFFFFFFFFu, 1);
+    check("G3: out discards", (int)word(p, 19), 7);
+
+    memset(&vc, 0, sizeof(vc));
+    vc.seq = 1;
+    vc.vid = 10;
+    vc.octets = 5000;
+    vc.packets = 50;
+    vc.discards = 3;
+    len = d.len;
+    check("G3: add VLAN counters", sflow_add_vlan_counters(&d, &vc), 0);
+    p = d.buf + len;
+    check("G3: VLAN source", (int)word(p, 3), (int)SFLOW_SOURCE(SFLOW_DS_VLAN, 10));
+    check("G3: VLAN record", word(p, 5) == 5 && word(p, 6) == 28 && word(p, 7) == 10, 1);
+    check("G3: VLAN counters", word(p, 9) == 5000 && word(p, 10) == 50 && word(p, 13) == 3, 1);
+    check("G3: three samples", (int)word(d.buf, 6), 3);
+
+    n = 3;
+    while (sflow_add_flow(&d, &s) == 0)
+        n++;
+    len = d.len;
+    check("G4: full datagram refuses", sflow_add_flow(&d, &s), -ENOSPC);
+    check("G4: ... and is unchanged", d.len == len && (int)word(d.buf, 6) == n, 1);
+    check("G4: within the size limit", d.len <= SFLOW_DGRAM_MAX, 1);
+    check("G4: counters refused too", sflow_add_if_counters(&d, &ic) == 0 || d.len == len, 1);
+
+    printf("============================================================\n");
+    printf("  Results: %d passed, %d failed\n", g_pass, g_fail);
+    printf("============================================================\n");
+
+    return (g_fail > 0) ? 1 : 0;
+}
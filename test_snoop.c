@@ -0,0 +1,614 @@
+/**
+ * @file test_snoop.c
+ * @brief Test for the timer wheel (twheel.c), the IGMP / MLD snooper
+ *        (snoop.c) and its kernel bridge MDB backend (br_mdb.c).
+ *
+ * Tests:
+ *   W1: arm, cancel and advance; timers past one turn wait for their tick
+ *   W2: a callback re-arms its own timer and cancels another due one
+ *   P1: IGMPv2 report and leave; bad checksums and link-local groups
+ *   P2: IGMPv3 records: joins, a TO_IN {} leave, a truncated record
+ *   P3: MLDv1 report behind a hop-by-hop header, MLDv2 records
+ *   J1: memberships expire after the membership interval, and after the
+ *       last member query time once a leave arrives
+ *   R1: a query makes a router port until the querier interval runs out
+ *   C1: classification and the compiled lookup table
+ *   D1: a port going down and a VLAN turned off prune what they held
+ *   K1: a report received on a bridge port becomes a permanent MDB entry,
+ *       and turning snooping off deletes it
+ *
+ * W1..D1 need no privileges; K1 runs in a private network namespace and is
+ * skipped without CAP_SYS_ADMIN / CAP_NET_ADMIN.
+ */
+
+#define _GNU_SOURCE     /* unshare */
+
+#include <errno.h>
+#include <sched.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <net/if.h>
+#include <linux/if_bridge.h>
+#include <linux/if_ether.h>
+#include <linux/if_packet.h>
+#include <linux/rtnetlink.h>
+#include <netlink/attr.h>
+#include <netlink/msg.h>
+#include <netlink/netlink.h>
+#include <netlink/route/link.h>
+#include <netlink/route/link/veth.h>
+
+#include "br_mdb.h"
+#include "snoop.h"
+#include "twheel.h"
+#include "vlan_api.h"
+#include "vlan_state.h"
+
+/* -------------------------------------------------------------------------
+ * Helpers
+ * ------------------------------------------------------------------------- */
+
+static int g_pass = 0;
+static int g_fail = 0;
+
+static void check(const char *desc, int got, int expected)
+{
+    if (got == expected)
+    {
+        printf("[PASS] %s  (ret=%d)\n", desc, got);
+        g_pass++;
+    }
+    else
+    {
+        printf("[FAIL] %s  (expected=%d, got=%d)\n", desc, expected, got);
+        g_fail++;
+    }
+}
+
+/* Timer wheel callbacks. */
+static struct twheel   g_tw;
+static struct tw_timer g_t[4];
+static unsigned        g_fired[4];
+
+static void on_fire(struct tw_timer *t, void *arg)
+{
+    (void)arg;
+    g_fired[t - g_t]++;
+}
+
+/* Fires t0 again 10 ticks later, once, and cancels t1. */
+static void on_fire_rearm(struct tw_timer *t, void *arg)
+{
+    (void)arg;
+    g_fired[t - g_t]++;
+    if (t == &g_t[0] && g_fired[0] == 1)
+    {
+        tw_arm(&g_tw, t, g_tw.now + 10);
+        tw_cancel(&g_tw, &g_t[1]);
+    }
+    else if (t == &g_t[1] && g_fired[1] == 1)
+    {
+        tw_arm(&g_tw, t, g_tw.now + 10);
+        tw_cancel(&g_tw, &g_t[0]);
+    }
+}
+
+/* Snooper change log. */
+static int g_joins, g_prunes, g_radds, g_rdels, g_last_port;
+
+static void on_change(enum snoop_op op, const struct snoop_key *k, int port, void *arg)
+{
+    (void)k;
+    (void)arg;
+    g_last_port = port;
+    switch (op)
+    {
+    case SNOOP_JOIN:        g_joins++;  break;
+    case SNOOP_PRUNE:       g_prunes++; break;
+    case SNOOP_ROUTER_ADD:  g_radds++;  break;
+    case SNOOP_ROUTER_DEL:  g_rdels++;  break;
+    }
+}
+
+static uint16_t fold(uint32_t sum)
+{
+    while (sum >> 16)
+        sum = (sum & 0xFFFF) + (sum >> 16);
+    return (uint16_t)~sum;
+}
+
+static uint32_t sum16(uint32_t sum, const uint8_t *p, size_t len)
+{
+    for (; len > 1; p += 2, len -= 2)
+        sum += (uint32_t)p[0] << 8 | p[1];
+    if (len)
+        sum += (uint32_t)p[0] << 8;
+    return sum;
+}
+
+static void put16(uint8_t *p, uint16_t v)
+{
+    p[0] = (uint8_t)(v >> 8);
+    p[1] = (uint8_t)v;
+}
+
+/*
+ * An IPv4 frame to @p dst carrying @p l4 as protocol @p proto (IGMP gets
+ * its checksum filled in unless @p bad).  @return the frame length.
+ */
+static size_t ip4_frame(uint8_t *f, const char *dst, uint8_t proto, uint8_t *l4, size_t n, int bad)
+{
+    uint8_t *ip = f + 14;
+
+    memset(f, 0, 14 + 20);
+    f[0] = 0x01;
+    f[2] = 0x5E;
+    f[6] = 0x02;
+    f[11] = 0x01;
+    f[12] = 0x08;
+    ip[0] = 0x45;
+    put16(ip + 2, (uint16_t)(20 + n));
+    ip[8] = 1;
+    ip[9] = proto;
+    ip[12] = 10;
+    ip[15] = 1;
+    inet_pton(AF_INET, dst, ip + 16);
+    if (proto == 2)
+    {
+        put16(l4 + 2, 0);
+        put16(l4 + 2, (uint16_t)(fold(sum16(0, l4, n)) ^ (bad ? 1 : 0)));
+    }
+    memcpy(ip + 20, l4, n);
+    return 14 + 20 + n;
+}
+
+/* IGMPv1/v2 message of @p type for @p group. */
+static size_t igmp2(uint8_t *f, uint8_t type, const char *group, int bad)
+{
+    uint8_t m[8] = { type };
+
+    inet_pton(AF_INET, group, m + 4);
+    return ip4_frame(f, type == 0x11 ? "224.0.0.1" : group, 2, m, sizeof(m), bad);
+}
+
+/* IGMPv3 report with one record per group; @p nsrc sources each. */
+static size_t igmp3(uint8_t *f, uint8_t rtype, unsigned nsrc, const char **groups, unsigned ngroups)
+{
+    uint8_t m[512];
+    size_t n = 8;
+    unsigned i;
+
+    memset(m, 0, sizeof(m));
+    m[0] = 0x22;
+    put16(m + 6, (uint16_t)ngroups);
+    for (i = 0; i < ngroups; i++)
+    {
+        m[n] = rtype;
+        put16(m + n + 2, (uint16_t)nsrc);
+        inet_pton(AF_INET, groups[i], m + n + 4);
+        n += 8 + nsrc * 4;
+    }
+    return ip4_frame(f, "224.0.0.22", 2, m, n, 0);
+}
+
+/*
+ * An IPv6 frame to @p dst with an MLD message @p l4 behind a hop-by-hop
+ * router alert header; the checksum is filled in.
+ */
+static size_t mld_frame(uint8_t *f, const char *dst, uint8_t *l4, size_t n)
+{
+    uint8_t *ip = f + 14;
+    uint8_t pseudo[8] = { 0 };
+    uint32_t sum;
+
+    memset(f, 0, 14 + 48);
+    f[0] = 0x33;
+    f[1] = 0x33;
+    f[6] = 0x02;
+    f[11] = 0x01;
+    f[12] = 0x86;
+    f[13] = 0xDD;
+    ip[0] = 0x60;
+    put16(ip + 4, (uint16_t)(8 + n));
+    ip[6] = 0;                          /* hop-by-hop */
+    ip[7] = 1;
+    inet_pton(AF_INET6, "fe80::1", ip + 8);
+    inet_pton(AF_INET6, dst, ip + 24);
+    ip[40] = 58;
+    ip[42] = 5;                         /* router alert: MLD */
+    ip[43] = 2;
+    ip[46] = 1;                         /* PadN */
+
+    pseudo[2] = (uint8_t)(n >> 8);
+    pseudo[3] = (uint8_t)n;
+    pseudo[7] = 58;
+    put16(l4 + 2, 0);
+    sum = sum16(0, ip + 8, 32);
+    sum = sum16(sum, pseudo, sizeof(pseudo));
+    put16(l4 + 2, fold(sum16(sum, l4, n)));
+    memcpy(ip + 48, l4, n);
+    return 14 + 48 + n;
+}
+
+static size_t mld1(uint8_t *f, uint8_t type, const char *group)
+{
+    uint8_t m[24] = { type };
+
+    inet_pton(AF_INET6, group, m + 8);
+    return mld_frame(f, type == 130 ? "ff02::1" : group, m, sizeof(m));
+}
+
+static size_t mld2(uint8_t *f, uint8_t rtype, unsigned nsrc, const char *group)
+{
+    uint8_t m[8 + 20 + 32];
+
+    memset(m, 0, sizeof(m));
+    m[0] = 143;
+    put16(m + 6, 1);
+    m[8] = rtype;
+    put16(m + 10, (uint16_t)nsrc);
+    inet_pton(AF_INET6, group, m + 12);
+    return mld_frame(f, "ff02::16", m, 8 + 20 + nsrc * 16);
+}
+
+static void key4(struct snoop_key *k, uint16_t vid, const char *group)
+{
+    memset(k, 0, sizeof(*k));
+    k->vid = vid;
+    k->family = AF_INET;
+    inet_pton(AF_INET, group, k->addr);
+}
+
+/* Listener ports of @p group in VLAN @p vid, through a fresh table. */
+static int ports_of(struct snoop *s, uint16_t vid, const char *group)
+{
+    struct snoop_table *t = snoop_compile(s);
+    struct snoop_key k;
+    int ports;
+
+    key4(&k, vid, group);
+    ports = t ? (int)snoop_lookup(t, &k) : -1;
+    snoop_table_free(t);
+    return ports;
+}
+
+/* -------------------------------------------------------------------------
+ * Kernel helpers
+ * ------------------------------------------------------------------------- */
+
+static int link_up(const char *name)
+{
+    struct ifreq ifr;
+    int fd = socket(AF_INET, SOCK_DGRAM, 0);
+    int ret = -1;
+
+    if (fd < 0)
+        return -1;
+    memset(&ifr, 0, sizeof(ifr));
+    strncpy(ifr.ifr_name, name, IFNAMSIZ - 1);
+    if (ioctl(fd, SIOCGIFFLAGS, &ifr) == 0)
+    {
+        ifr.ifr_flags |= IFF_UP;
+        ret = ioctl(fd, SIOCSIFFLAGS, &ifr);
+    }
+    close(fd);
+    return ret;
+}
+
+static int make_pair(void)
+{
+    struct nl_sock *sock = nl_socket_alloc();
+    int err;
+
+    if (!sock || nl_connect(sock, NETLINK_ROUTE) < 0)
+        return -1;
+    err = rtnl_link_veth_add(sock, "h0", "s0", getpid());
+    if (err == 0 && (link_up("h0") < 0 || link_up("s0") < 0))
+        err = -1;
+    nl_socket_free(sock);
+    return err;
+}
+
+static int send_frame(const char *name, const uint8_t *f, size_t len)
+{
+    struct sockaddr_ll sll;
+    int fd = socket(AF_PACKET, SOCK_RAW, htons(ETH_P_ALL));
+    int ret;
+
+    if (fd < 0)
+        return -1;
+    memset(&sll, 0, sizeof(sll));
+    sll.sll_family = AF_PACKET;
+    sll.sll_ifindex = (int)if_nametoindex(name);
+    ret = sendto(fd, f, len, 0, (struct sockaddr *)&sll, sizeof(sll)) == (ssize_t)len ? 0 : -1;
+    close(fd);
+    return ret;
+}
+
+/* RTM_GETMDB dump state: the entry looked for and whether it was seen. */
+static int      g_mdb_port;
+static uint32_t g_mdb_group;
+static int      g_mdb_found;
+
+static int mdb_entry_cb(struct nl_msg *msg, void *arg)
+{
+    struct nlmsghdr *nlh = nlmsg_hdr(msg);
+    struct nlattr *mdb, *ent, *info;
+    int r1, r2, r3;
+
+    (void)arg;
+    nlmsg_for_each_attr(mdb, nlh, sizeof(struct br_port_msg), r1)
+    {
+        if (nla_type(mdb) != MDBA_MDB)
+            continue;
+        nla_for_each_nested(ent, mdb, r2)
+        {
+            nla_for_each_nested(info, ent, r3)
+            {
+                struct br_mdb_entry *e = nla_data(info);
+
+                if (nla_type(info) == MDBA_MDB_ENTRY_INFO && nla_len(info) >= (int)sizeof(*e) &&
+                    e->ifindex == (uint32_t)g_mdb_port && e->addr.u.ip4 == g_mdb_group)
+                    g_mdb_found = 1;
+            }
+        }
+    }
+    return NL_OK;
+}
+
+/* 1 if the kernel has an MDB entry for @p group on port @p port. */
+static int mdb_has(const char *port, const char *group)
+{
+    struct nl_sock *sock = nl_socket_alloc();
+    struct br_port_msg bpm;
+
+    g_mdb_found = 0;
+    g_mdb_port = (int)if_nametoindex(port);
+    inet_pton(AF_INET, group, &g_mdb_group);
+    memset(&bpm, 0, sizeof(bpm));
+    bpm.family = AF_BRIDGE;
+    if (sock && nl_connect(sock, NETLINK_ROUTE) == 0 &&
+        nl_socket_modify_cb(sock, NL_CB_VALID, NL_CB_CUSTOM, mdb_entry_cb, NULL) == 0 &&
+        nl_send_simple(sock, RTM_GETMDB, NLM_F_DUMP, &bpm, sizeof(bpm)) >= 0)
+        nl_recvmsgs_default(sock);
+    nl_socket_free(sock);
+    return g_mdb_found;
+}
+
+/* Poll for up to a second until mdb_has() answers @p want. */
+static int mdb_wait(const char *port, const char *group, int want)
+{
+    int i;
+
+    for (i = 0; i < 100 && mdb_has(port, group) != want; i++)
+        usleep(10000);
+    return mdb_has(port, group);
+}
+
+static int count_entries(struct snoop_stats *st)
+{
+    return br_mdb_get_stats(st) == 0 ? (int)st->members : -1;
+}
+
+/* K1, inside the namespace with the h0/s0 pair. */
+static void test_kernel(void)
+{
+    struct snoop_stats st;
+    uint8_t f[256];
+    size_t n;
+
+    usleep(100000);             /* let the snapshot see the pair */
+    check("K1: create VLAN 10", create_vlan(10), 0);
+    check("K1: s0 joins it", add_vlan_assignment(10, "s0"), 0);
+    check("K1: Vlan10 up", link_up("Vlan10"), 0);
+    check("K1: bad VLAN", br_mdb_vlan(0, 1), -EINVAL);
+    check("K1: snooping on", br_mdb_vlan(10, 1), 0);
+    check("K1: reported enabled", br_mdb_vlan_enabled(10), 1);
+    usleep(100000);
+
+    n = igmp2(f, 0x16, "239.1.2.3", 0);
+    check("K1: report sent from h0", send_frame("h0", f, n), 0);
+    check("K1: MDB entry on s0", mdb_wait("s0", "239.1.2.3", 1), 1);
+    check("K1: one membership", count_entries(&st), 1);
+    check("K1: snooping off", br_mdb_vlan(10, 0), 0);
+    check("K1: MDB entry deleted", mdb_wait("s0", "239.1.2.3", 0), 0);
+    check("K1: no membership", count_entries(&st), 0);
+    br_mdb_shutdown();
+}
+
+/* -------------------------------------------------------------------------
+ * Main
+ * ------------------------------------------------------------------------- */
+
+int main(void)
+{
+    const char *g3[] = { "239.1.1.1", "239.1.1.2", "224.0.0.251" };
+    struct snoop_stats st;
+    struct snoop_table *t;
+    struct snoop_key k;
+    struct snoop *s;
+    uint8_t f[512];
+    uint64_t now = 1000000;
+    size_t n;
+
+    setbuf(stdout, NULL);
+
+    printf("============================================================\n");
+    printf("  virtasic IGMP/MLD snooping test\n");
+    printf("============================================================\n");
+
+    check("W1: 100 slots refused", tw_init(&g_tw, 100, 0), -EINVAL);
+    check("W1: 64 slots", tw_init(&g_tw, 64, 1000), 0);
+    tw_arm(&g_tw, &g_t[0], 1005);
+    tw_arm(&g_tw, &g_t[1], 1005 + 64);          /* same slot, next turn */
+    tw_arm(&g_tw, &g_t[2], 1010);
+    tw_arm(&g_tw, &g_t[3], 900);                /* past: next tick */
+    check("W1: four pending", (int)g_tw.npending, 4);
+    tw_cancel(&g_tw, &g_t[2]);
+    tw_cancel(&g_tw, &g_t[2]);
+    check("W1: cancel once", (int)g_tw.npending, 3);
+    check("W1: tick 1001 fires the past one", (int)tw_advance(&g_tw, 1001, on_fire, NULL), 1);
+    check("W1: tick 1005 fires t0 only", (int)tw_advance(&g_tw, 1005, on_fire, NULL), 1);
+    check("W1: ... not t1", g_fired[1], 0);
+    check("W1: t1 armed", tw_armed(&g_t[1]), 1);
+    check("W1: a long jump fires t1", (int)tw_advance(&g_tw, 5000, on_fire, NULL), 1);
+    check("W1: nothing pending", (int)g_tw.npending, 0);
+    check("W1: t0 disarmed", tw_armed(&g_t[0]), 0);
+
+    memset(g_fired, 0, sizeof(g_fired));
+    tw_arm(&g_tw, &g_t[0], 5010);
+    tw_arm(&g_tw, &g_t[1], 5010);
+    check("W2: one of two due fires", (int)tw_advance(&g_tw, 5010, on_fire_rearm, NULL), 1);
+    check("W2: the other was cancelled", g_fired[0] + g_fired[1], 1);
+    check("W2: re-armed one pending", (int)g_tw.npending, 1);
+    check("W2: it fires 10 ticks on", (int)tw_advance(&g_tw, 5020, on_fire_rearm, NULL), 1);
+    tw_destroy(&g_tw);
+
+    s = snoop_create(now, on_change, NULL);
+    check("P1: snooper created", s != NULL, 1);
+    if (!s)
+        return 1;
+    n = igmp2(f, 0x16, "239.1.1.1", 0);
+    check("P1: VLAN 10 not snooped yet", snoop_rx(s, 10, 1, f, n, now), 0);
+    check("P1: enable VLAN 10", snoop_vlan_enable(s, 10, 1), 0);
+    check("P1: bad VLAN", snoop_vlan_enable(s, 4095, 1), -EINVAL);
+    check("P1: v2 report", snoop_rx(s, 10, 1, f, n, now), 1);
+    check("P1: join reported", g_joins, 1);
+    check("P1: refresh is no new join", snoop_rx(s, 10, 1, f, n, now) + g_joins, 2);
+    check("P1: port 1 listens", ports_of(s, 10, "239.1.1.1"), 0x2);
+    check("P1: not in VLAN 20", ports_of(s, 20, "239.1.1.1"), 0);
+    n = igmp2(f, 0x16, "239.1.1.9", 1);
+    check("P1: bad checksum", snoop_rx(s, 10, 2, f, n, now), -EINVAL);
+    n = igmp2(f, 0x16, "224.0.0.251", 0);
+    check("P1: link-local group taken", snoop_rx(s, 10, 2, f, n, now), 1);
+    check("P1: ... but not tracked", g_joins, 1);
+    n = ip4_frame(f, "239.1.1.1", 17, (uint8_t[8]){ 0 }, 8, 0);
+    check("P1: UDP is not snooped", snoop_rx(s, 10, 2, f, n, now), 0);
+
+    n = igmp3(f, 4, 0, g3, 3);                  /* TO_EX {}: join */
+    check("P2: v3 report", snoop_rx(s, 10, 2, f, n, now), 1);
+    check("P2: two trackable records join", g_joins, 3);
+    check("P2: 239.1.1.1 on ports 1 and 2", ports_of(s, 10, "239.1.1.1"), 0x6);
+    n = igmp3(f, 1, 2, g3 + 1, 1);              /* IS_IN {a, b}: stays */
+    check("P2: IS_IN with sources", snoop_rx(s, 10, 2, f, n, now), 1);
+    check("P2: ... keeps the member", ports_of(s, 10, "239.1.1.2"), 0x4);
+    n = igmp3(f, 3, 0, g3 + 1, 1);              /* TO_IN {}: leave */
+    snoop_rx(s, 10, 2, f, n, now);
+    check("P2: TO_IN {} waits for the query", ports_of(s, 10, "239.1.1.2"), 0x4);
+    n = igmp3(f, 4, 3, g3, 1);
+    n -= 6;
+    f[14 + 3] = (uint8_t)(f[14 + 3] - 6);
+    put16(f + 14 + 20 + 2, 0);
+    put16(f + 14 + 20 + 2, fold(sum16(0, f + 14 + 20, n - 14 - 20)));
+    check("P2: truncated record", snoop_rx(s, 10, 2, f, n, now), -EINVAL);
+
+    check("P3: enable VLAN 30", snoop_vlan_enable(s, 30, 1), 0);
+    n = mld1(f, 131, "ff0e::101");
+    check("P3: MLDv1 report", snoop_rx(s, 30, 3, f, n, now), 1);
+    memset(&k, 0, sizeof(k));
+    k.vid = 30;
+    k.family = AF_INET6;
+    inet_pton(AF_INET6, "ff0e::101", k.addr);
+    t = snoop_compile(s);
+    check("P3: port 3 listens to ff0e::101", t ? (int)snoop_lookup(t, &k) : -1, 0x8);
+    snoop_table_free(t);
+    n = mld1(f, 131, "ff02::fb");
+    snoop_rx(s, 30, 3, f, n, now);
+    n = mld2(f, 2, 1, "ff05::2");               /* IS_EX {s}: join */
+    check("P3: MLDv2 report", snoop_rx(s, 30, 4, f, n, now), 1);
+    f[n - 1] ^= 0xFF;
+    check("P3: MLDv2 bad checksum", snoop_rx(s, 30, 4, f, n, now), -EINVAL);
+    snoop_get_stats(s, &st);
+    check("P3: four groups", (int)st.groups, 4);
+    check("P3: five memberships", (int)st.members, 5);
+    check("P3: invalid counted", (int)st.invalid, 3);
+
+    n = igmp2(f, 0x17, "239.1.1.1", 0);
+    snoop_rx(s, 10, 1, f, n, now + 1000);
+    check("J1: leave keeps port 1 for now", ports_of(s, 10, "239.1.1.1"), 0x6);
+    snoop_tick(s, now + 1000 + SNOOP_LEAVE_MS - SNOOP_TICK_MS);
+    check("J1: ... until the last member query time", ports_of(s, 10, "239.1.1.1"), 0x6);
+    snoop_tick(s, now + 1000 + SNOOP_LEAVE_MS);
+    check("J1: then it is pruned", ports_of(s, 10, "239.1.1.1"), 0x4);
+    check("J1: two prunes, the TO_IN {} one too", g_prunes, 2);
+    check("J1: 239.1.1.2 gone with its member", ports_of(s, 10, "239.1.1.2"), 0);
+    n = igmp2(f, 0x16, "239.1.1.1", 0);
+    snoop_rx(s, 10, 2, f, n, now + 100000);
+    snoop_tick(s, now + SNOOP_MEMBER_MS + 50000);
+    check("J1: a refreshed member outlives the interval", ports_of(s, 10, "239.1.1.1"), 0x4);
+    snoop_tick(s, now + SNOOP_MEMBER_MS + 100000);
+    check("J1: ... by the refresh only", ports_of(s, 10, "239.1.1.1"), 0);
+    snoop_get_stats(s, &st);
+    check("J1: everything expired", (int)st.members, 0);
+    now += SNOOP_MEMBER_MS + 100000;
+
+    n = igmp2(f, 0x11, "0.0.0.0", 0);
+    check("R1: query", snoop_rx(s, 10, 5, f, n, now), 1);
+    check("R1: router port added", g_radds == 1 && g_last_port == 5, 1);
+    n = mld1(f, 130, "::");
+    snoop_rx(s, 30, 6, f, n, now);
+    snoop_tick(s, now + SNOOP_ROUTER_MS - SNOOP_TICK_MS);
+    check("R1: still routers", g_rdels, 0);
+    snoop_tick(s, now + SNOOP_ROUTER_MS);
+    check("R1: expired", g_rdels, 2);
+    now += SNOOP_ROUTER_MS;
+
+    n = igmp2(f, 0x16, "239.2.2.2", 0);
+    snoop_rx(s, 10, 7, f, n, now);
+    check("C1: IGMP is control", snoop_classify(f, n, 10, &k), SNOOP_CONTROL);
+    n = mld1(f, 131, "ff0e::1");
+    check("C1: MLD is control", snoop_classify(f, n, 10, &k), SNOOP_CONTROL);
+    n = ip4_frame(f, "239.2.2.2", 17, (uint8_t[8]){ 0 }, 8, 0);
+    check("C1: UDP to a group is data", snoop_classify(f, n, 10, &k), SNOOP_DATA);
+    t = snoop_compile(s);
+    check("C1: ... for port 7", t ? (int)snoop_lookup(t, &k) : -1, 0x80);
+    k.vid = 11;
+    check("C1: other VLAN unregistered", t ? (int)snoop_lookup(t, &k) : -1, 0);
+    snoop_table_free(t);
+    n = ip4_frame(f, "224.0.0.251", 17, (uint8_t[8]){ 0 }, 8, 0);
+    check("C1: link-local data floods", snoop_classify(f, n, 10, &k), SNOOP_OTHER);
+    memset(f, 0xFF, 6);
+    f[12] = 0x08;
+    f[13] = 0x06;
+    check("C1: ARP floods", snoop_classify(f, 60, 10, &k), SNOOP_OTHER);
+
+    n = igmp2(f, 0x16, "239.2.2.3", 0);
+    snoop_rx(s, 10, 7, f, n, now);
+    snoop_rx(s, 10, 8, f, n, now);
+    n = igmp2(f, 0x11, "0.0.0.0", 0);
+    snoop_rx(s, 10, 7, f, n, now);
+    g_prunes = g_rdels = 0;
+    snoop_port_down(s, 7);
+    check("D1: port 7 down prunes two groups", g_prunes, 2);
+    check("D1: ... and its router port", g_rdels, 1);
+    check("D1: port 8 stays", ports_of(s, 10, "239.2.2.3"), 0x100);
+    check("D1: VLAN 10 off", snoop_vlan_enable(s, 10, 0), 0);
+    check("D1: ... prunes port 8", g_prunes, 3);
+    check("D1: ... and says so", snoop_vlan_enabled(s, 10), 0);
+    snoop_get_stats(s, &st);
+    check("D1: nothing left", (int)(st.groups + st.members + st.routers), 0);
+    n = igmp2(f, 0x16, "239.2.2.3", 0);
+    check("D1: reports ignored now", snoop_rx(s, 10, 8, f, n, now), 0);
+    snoop_destroy(s);
+
+    if (unshare(CLONE_NEWNET) < 0 || vlan_state_init() < 0 || make_pair() < 0)
+    {
+        printf("[SKIP] K: cannot create a network namespace with a veth pair\n");
+    }
+    else
+    {
+        test_kernel();
+        vlan_state_shutdown();
+    }
+
+    printf("============================================================\n");
+    printf("  Results: %d passed, %d failed\n", g_pass, g_fail);
+    printf("============================================================\n");
+
+    return (g_fail > 0) ? 1 : 0;
+}
@@ -0,0 +1,284 @@
+/**
+ * @file test_storm.c
+ * @brief Test for the storm control token buckets (storm.c) and their kernel
+ *        tc counterpart (tc_storm.c).
+ *
+ * Tests:
+ *   S1: class names and rate checks
+ *   S2: a packet bucket passes its burst, then refills at its rate
+ *   S3: over one simulated second a bucket passes rate + burst frames
+ *   S4: a byte bucket meters frame lengths; a frame that does not fit
+ *       leaves room for a smaller one behind it
+ *   S5: drop counting; a bucket turned off passes everything and restarts
+ *       its counter when turned on again
+ *   S6: two threads sharing a bucket never pass more than it holds
+ *   K1: port policers on a veth: unknown unicast refused, a broadcast storm
+ *       is cut down to the burst and the drops are read back
+ *   K2: a VLAN policer lands on the member port next to the port policer,
+ *       and removing both leaves nothing configured
+ *
+ * S1..S6 need no privileges; K1..K2 run in a private network namespace
+ * and are skipped without CAP_SYS_ADMIN / CAP_NET_ADMIN, or past the
+ * refusal checks on a kernel without cls_flower and act_police.
+ */
+
+#define _GNU_SOURCE     /* unshare */
+
+#include <errno.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <net/if.h>
+#include <linux/if_ether.h>
+#include <linux/if_packet.h>
+#include <netlink/netlink.h>
+#include <netlink/route/link.h>
+#include <netlink/route/link/veth.h>
+
+#include "storm.h"
+#include "tc_storm.h"
+#include "vlan_api.h"
+#include "vlan_state.h"
+
+#define SEC     1000000000ull
+
+/* -------------------------------------------------------------------------
+ * Helpers
+ * ------------------------------------------------------------------------- */
+
+static int g_pass = 0;
+static int g_fail = 0;
+
+static void check(const char *desc, int got, int expected)
+{
+    if (got == expected)
+    {
+        printf("[PASS] %s  (ret=%d)\n", desc, got);
+        g_pass++;
+    }
+    else
+    {
+        printf("[FAIL] %s  (expected=%d, got=%d)\n", desc, expected, got);
+        g_fail++;
+    }
+}
+
+static int popcount(uint64_t m)
+{
+    return __builtin_popcountll(m);
+}
+
+static struct storm_tb g_shared;
+static uint32_t        g_len[32];
+
+static void *claimer(void *arg)
+{
+    unsigned *passed = arg;
+    unsigned i;
+
+    for (i = 0; i < 10000; i++)
+        *passed += (unsigned)popcount(storm_tb_claim(&g_shared, SEC, g_len, 32));
+    return NULL;
+}
+
+static int link_up(const char *name)
+{
+    struct ifreq ifr;
+    int fd = socket(AF_INET, SOCK_DGRAM, 0);
+    int ret = -1;
+
+    if (fd < 0)
+        return -1;
+    memset(&ifr, 0, sizeof(ifr));
+    strncpy(ifr.ifr_name, name, IFNAMSIZ - 1);
+    if (ioctl(fd, SIOCGIFFLAGS, &ifr) == 0)
+    {
+        ifr.ifr_flags |= IFF_UP;
+        ret = ioctl(fd, SIOCSIFFLAGS, &ifr);
+    }
+    close(fd);
+    return ret;
+}
+
+static int make_pair(void)
+{
+    struct nl_sock *sock = nl_socket_alloc();
+    int err;
+
+    if (!sock || nl_connect(sock, NETLINK_ROUTE) < 0)
+        return -1;
+    err = rtnl_link_veth_add(sock, "h0", "s0", getpid());
+    if (err == 0 && (link_up("h0") < 0 || link_up("s0") < 0))
+        err = -1;
+    nl_socket_free(sock);
+    return err;
+}
+
+/* Send @p n broadcasts out of @p name. */
+static int send_bcast(const char *name, int n)
+{
+    struct sockaddr_ll sll;
+    uint8_t f[64];
+    int fd = socket(AF_PACKET, SOCK_RAW, htons(ETH_P_ALL));
+    int sent = 0;
+
+    if (fd < 0)
+        return -1;
+    memset(&sll, 0, sizeof(sll));
+    sll.sll_family = AF_PACKET;
+    sll.sll_ifindex = (int)if_nametoindex(name);
+    memset(f, 0, sizeof(f));
+    memset(f, 0xFF, 6);
+    f[6] = 0x02;
+    f[11] = 0x01;
+    f[12] = 0x88;
+    f[13] = 0xB5;
+    while (sent < n && sendto(fd, f, sizeof(f), 0, (struct sockaddr *)&sll, sizeof(sll)) > 0)
+        sent++;
+    close(fd);
+    return sent;
+}
+
+static uint64_t g_bcast_drops;
+static void count_policer(const char *iface, uint16_t vid, unsigned cls,
+                          const struct storm_rate *rate, uint64_t drops, void *arg)
+{
+    (void)vid;
+    (void)rate;
+    (void)arg;
+    if (iface && cls == STORM_BCAST)
+        g_bcast_drops = drops;
+}
+
+/* K1..K2, inside the namespace with the h0/s0 pair. */
+static void test_kernel(void)
+{
+    struct storm_rate r = { .rate = 100, .burst = 10 };
+    int ret;
+
+    usleep(100000);             /* let the snapshot see the pair */
+    check("K1: unknown unicast refused", tc_storm_port("s0", STORM_UNKNOWN, &r), -EOPNOTSUPP);
+    check("K1: absent port", tc_storm_port("nonexistent0", STORM_BCAST, &r), -ENODEV);
+    ret = tc_storm_port("s0", STORM_BCAST, &r);
+    if (ret == -ENOENT)
+    {
+        printf("[SKIP] K: kernel without the flower classifier or police action\n");
+        check("K1: failed policer not recorded", tc_storm_walk(count_policer, NULL), 0);
+        return;
+    }
+    check("K1: broadcast policer on s0", ret, 0);
+    check("K1: replace it", tc_storm_port("s0", STORM_BCAST, &r), 0);
+    check("K1: storm sent", send_bcast("h0", 200), 200);
+    check("K1: one policer", tc_storm_walk(count_policer, NULL), 1);
+    printf("  kernel drops: %llu\n", (unsigned long long)g_bcast_drops);
+    check("K1: the storm beyond the burst dropped", g_bcast_drops >= 150, 1);
+
+    check("K2: create VLAN 10", create_vlan(10), 0);
+    check("K2: s0 joins it", add_vlan_assignment(10, "s0"), 0);
+    r = (struct storm_rate){ .rate = 1000, .burst = 3000, .bytes = 1 };
+    check("K2: multicast policer on VLAN 10", tc_storm_vlan(10, STORM_MCAST, &r), 0);
+    check("K2: two policers", tc_storm_walk(count_policer, NULL), 2);
+    check("K2: still broadcast-limited", send_bcast("h0", 50), 50);
+    check("K2: remove the port policer", tc_storm_port("s0", STORM_BCAST, NULL), 0);
+    check("K2: remove the VLAN policer", tc_storm_vlan(10, STORM_MCAST, NULL), 0);
+    check("K2: nothing left", tc_storm_walk(count_policer, NULL), 0);
+}
+
+/* -------------------------------------------------------------------------
+ * Main
+ * ------------------------------------------------------------------------- */
+
+int main(void)
+{
+    struct storm_rate r;
+    struct storm_tb tb;
+    pthread_t th[2];
+    unsigned passed[2] = { 0, 0 };
+    uint64_t now;
+    unsigned i, total;
+
+    setbuf(stdout, NULL);
+
+    printf("============================================================\n");
+    printf("  virtasic storm control test\n");
+    printf("============================================================\n");
+
+    for (i = 0; i < 32; i++)
+        g_len[i] = 64;
+
+    check("S1: broadcast", storm_class_parse("broadcast"), STORM_BCAST);
+    check("S1: unknown-unicast", storm_class_parse("unknown-unicast"), STORM_UNKNOWN);
+    check("S1: bad class", storm_class_parse("anycast"), -EINVAL);
+    check("S1: name round trip", strcmp(storm_class_name(STORM_MCAST), "multicast"), 0);
+    memset(&tb, 0, sizeof(tb));
+    r = (struct storm_rate){ .rate = 1000, .burst = 0 };
+    check("S1: zero burst", storm_tb_set(&tb, &r), -EINVAL);
+    r = (struct storm_rate){ .rate = 1000, .burst = 32, .bytes = 1 };
+    check("S1: byte burst below a frame", storm_tb_set(&tb, &r), -EINVAL);
+    r = (struct storm_rate){ .rate = 2000000000ull, .burst = 10 };
+    check("S1: rate above 1 frame/ns", storm_tb_set(&tb, &r), -EINVAL);
+
+    r = (struct storm_rate){ .rate = 1000, .burst = 10 };
+    check("S2: 1000 pps, burst 10", storm_tb_set(&tb, &r), 0);
+    check("S2: burst passes", popcount(storm_tb_claim(&tb, SEC, g_len, 32)), 10);
+    check("S2: ... in order", (int)storm_tb_claim(&tb, SEC, g_len, 1), 0);
+    check("S2: 5 ms refill 5", popcount(storm_tb_claim(&tb, SEC + 5000000, g_len, 32)), 5);
+    check("S2: 1 s refills to the burst", popcount(storm_tb_claim(&tb, 3 * SEC, g_len, 32)), 10);
+
+    storm_tb_set(&tb, &r);
+    total = 0;
+    for (now = SEC; now < 2 * SEC; now += 100000)
+        total += (unsigned)popcount(storm_tb_claim(&tb, now, g_len, 32));
+    check("S3: one second passes rate + burst", total >= 1000 && total <= 1010, 1);
+
+    storm_tb_set(&tb, NULL);
+    r = (struct storm_rate){ .rate = 8000, .burst = 1500, .bytes = 1 };  /* 1 MB/s */
+    check("S4: 8000 kbit/s, burst 1500 B", storm_tb_set(&tb, &r), 0);
+    g_len[0] = 1000;
+    g_len[1] = 1000;
+    g_len[2] = 400;
+    check("S4: big, too big, small", (int)storm_tb_claim(&tb, SEC, g_len, 3), 0x5);
+    check("S4: 100 B left", (int)storm_tb_claim(&tb, SEC, g_len + 2, 1), 0);
+    check("S4: 1 ms refills 1000 B", (int)storm_tb_claim(&tb, SEC + 1000000, g_len, 1), 1);
+    for (i = 0; i < 3; i++)
+        g_len[i] = 64;
+
+    check("S5: drops counted", (int)tb.drops, 2);
+    check("S5: turn off", storm_tb_set(&tb, NULL), 0);
+    check("S5: off passes all", (int)storm_tb_claim(&tb, SEC, g_len, 32), -1);
+    check("S5: ... and 64 frames", storm_tb_claim(&tb, SEC, g_len, 64) == ~0ull, 1);
+    r = (struct storm_rate){ .rate = 1000, .burst = 10 };
+    storm_tb_set(&tb, &r);
+    check("S5: drops restart", (int)tb.drops, 0);
+
+    r = (struct storm_rate){ .rate = 1, .burst = 1000 };
+    storm_tb_set(&g_shared, &r);
+    pthread_create(&th[0], NULL, claimer, &passed[0]);
+    pthread_create(&th[1], NULL, claimer, &passed[1]);
+    pthread_join(th[0], NULL);
+    pthread_join(th[1], NULL);
+    check("S6: shared bucket passes its burst exactly", (int)(passed[0] + passed[1]), 1000);
+    check("S6: ... and drops the rest", (int)g_shared.drops, 2 * 10000 * 32 - 1000);
+
+    if (unshare(CLONE_NEWNET) < 0 || vlan_state_init() < 0 || make_pair() < 0)
+    {
+        printf("[SKIP] K: cannot create a network namespace with a veth pair\n");
+    }
+    else
+    {
+        test_kernel();
+        vlan_state_shutdown();
+    }
+
+    printf("============================================================\n");
+    printf("  Results: %d passed, %d failed\n", g_pass, g_fail);
+    printf("============================================================\n");
+
+    return (g_fail > 0) ? 1 : 0;
+}
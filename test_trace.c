@@ -0,0 +1,138 @@
+/**
+ * @file test_trace.c
+ * @brief Unit test for packet traces (trace.c).
+ *
+ * Tests:
+ *   T1: a started trace keeps the frame's length and first bytes and no
+ *       step; steps keep their stage, verdict, port and value in order
+ *   T2: every step is charged the cycles since the previous one, and the
+ *       total is their sum
+ *   T3: steps beyond TRACE_MAX_STEPS are counted, not kept; a drop ends
+ *       the trace unless it is one egress port's
+ *   T4: the counter rate is plausible and converts cycles to nanoseconds
+ *   T5: stage and verdict names, "?" out of range
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "trace.h"
+
+/* -------------------------------------------------------------------------
+ * Helpers
+ * ------------------------------------------------------------------------- */
+
+static int g_pass = 0;
+static int g_fail = 0;
+
+static void check(const char *desc, int got, int expected)
+{
+    if (got == expected)
+    {
+        printf("[PASS] %s  (ret=%d)\n", desc, got);
+        g_pass++;
+    }
+    else
+    {
+        printf("[FAIL] %s  (expected=%d, got=%d)\n", desc, expected, got);
+        g_fail++;
+    }
+}
+
+/* Spend about @p ns nanoseconds on the CPU. */
+static void spin(uint64_t ns)
+{
+    struct timespec a, b;
+
+    clock_gettime(CLOCK_MONOTONIC, &a);
+    do
+        clock_gettime(CLOCK_MONOTONIC, &b);
+    while ((uint64_t)(b.tv_sec - a.tv_sec) * 1000000000ull + (uint64_t)b.tv_nsec -
+           (uint64_t)a.tv_nsec < ns);
+}
+
+/* -------------------------------------------------------------------------
+ * Main
+ * ------------------------------------------------------------------------- */
+
+int main(void)
+{
+    struct trace t;
+    uint8_t frame[100];
+    uint64_t sum, hz, ns;
+    unsigned i;
+
+    setbuf(stdout, NULL);
+
+    printf("============================================================\n");
+    printf("  virtasic packet trace test\n");
+    printf("============================================================\n");
+
+    for (i = 0; i < sizeof(frame); i++)
+        frame[i] = (uint8_t)i;
+    memset(&t, 0xA5, sizeof(t));
+    trace_start(&t, 3, frame, sizeof(frame));
+    check("T1: ingress port", t.port, 3);
+    check("T1: frame length", (int)t.len, 100);
+    check("T1: head cut to TRACE_HEAD_LEN", t.head_len, TRACE_HEAD_LEN);
+    check("T1: ... the first bytes", memcmp(t.head, frame, TRACE_HEAD_LEN), 0);
+    check("T1: no step yet", t.nsteps == 0 && t.lost == 0 && t.cycles == 0, 1);
+    check("T1: time stamped", t.ts_ns > 0, 1);
+
+    trace_step(&t, TRACE_PARSE, TRACE_PASS, 3, 0);
+    spin(200000);
+    trace_step(&t, TRACE_CLASSIFY, TRACE_PASS, 3, 10);
+    trace_step(&t, TRACE_FORWARD, TRACE_UNICAST, 5, 10);
+    trace_step(&t, TRACE_TX, TRACE_SENT, 5, 0x200A);
+    check("T1: four steps", t.nsteps, 4);
+    check("T1: in order", t.step[0].stage == TRACE_PARSE && t.step[1].stage == TRACE_CLASSIFY &&
+          t.step[2].stage == TRACE_FORWARD && t.step[3].stage == TRACE_TX, 1);
+    check("T1: classify's VLAN", (int)t.step[1].arg, 10);
+    check("T1: forward's port and verdict", t.step[2].port == 5 && t.step[2].verdict == TRACE_UNICAST, 1);
+    check("T1: tx's TCI", (int)t.step[3].arg, 0x200A);
+
+    for (sum = 0, i = 0; i < t.nsteps; i++)
+        sum += t.step[i].cycles;
+    check("T2: total is the sum of the steps", sum == t.cycles, 1);
+    check("T2: the spin is charged to classify",
+          t.step[1].cycles > t.step[0].cycles && t.step[1].cycles > t.step[2].cycles, 1);
+    ns = trace_ns(t.step[1].cycles);
+    check("T2: ... about 200 us of it", ns >= 190000 && ns < 20000000, 1);
+
+    trace_start(&t, 0, frame, 20);
+    check("T3: short frame kept whole", t.head_len, 20);
+    for (i = 0; i < TRACE_MAX_STEPS + 5; i++)
+        trace_step(&t, TRACE_TX, TRACE_SENT, i, 0);
+    check("T3: steps kept", t.nsteps, TRACE_MAX_STEPS);
+    check("T3: the rest counted", t.lost, 5);
+    check("T3: the last kept", t.step[TRACE_MAX_STEPS - 1].port, TRACE_MAX_STEPS - 1);
+    trace_start(&t, 0, frame, 60);
+    trace_step(&t, TRACE_FORWARD, TRACE_FLOOD, 0, 10);
+    trace_step(&t, TRACE_TX, TRACE_DROP, 1, 0);
+    trace_step(&t, TRACE_TX, TRACE_SENT, 2, 0);
+    check("T3: an egress drop does not end it", t.nsteps == 3 && !t.dropped, 1);
+    trace_step(&t, TRACE_STORM, TRACE_DROP, 0, 0);
+    trace_step(&t, TRACE_TX, TRACE_SENT, 3, 0);
+    check("T3: a stage's drop does", t.nsteps == 4 && t.dropped, 1);
+
+    hz = trace_tsc_hz();
+    check("T4: rate between 100 MHz and 10 GHz", hz >= 100000000ull && hz <= 10000000000ull, 1);
+    check("T4: measured once", trace_tsc_hz() == hz, 1);
+    check("T4: one second of cycles", (int)(trace_ns(hz) / 1000), 1000000);
+    check("T4: no cycles", (int)trace_ns(0), 0);
+
+    check("T5: stage names", strcmp(trace_stage_name(TRACE_PARSE), "parse") == 0 &&
+          strcmp(trace_stage_name(TRACE_TX), "tx") == 0, 1);
+    check("T5: verdict names", strcmp(trace_verdict_name(TRACE_FLOOD), "flood") == 0 &&
+          strcmp(trace_verdict_name(TRACE_SENT), "sent") == 0, 1);
+    check("T5: out of range", strcmp(trace_stage_name(TRACE_NSTAGES), "?") == 0 &&
+          strcmp(trace_verdict_name(TRACE_NVERDICTS), "?") == 0, 1);
+
+    printf("============================================================\n");
+    printf("  Results: %d passed, %d failed\n", g_pass, g_fail);
+    printf("============================================================\n");
+
+    return (g_fail > 0) ? 1 : 0;
+}
@@ -12,6 +12,7 @@
  *    A5: add_vlan_assignment(100, NULL)     → expects -EINVAL (null iface)
  *    A6: remove_vlan_assignment(200, "lo")  → expects -ENOENT (VLAN missing)
  *    A7: remove_vlan_assignment(100, "nonexistent_if") → expects -ENOENT
+ *    A8: create_vlan(100) with the VLAN table full → expects -ENOSPC
  *
  *  Part B – Full VLAN lifecycle (requires CAP_NET_ADMIN + kernel bridge/vlan module)
  *    B1: create_vlan(100)
@@ -33,6 +34,7 @@
 #include <stdio.h>
 #include <stdint.h>
 
+#include "res.h"
 #include "vlan_api.h"
 
 #define TEST_VLAN_ID        ((uint16_t)100)
@@ -143,6 +145,18 @@ static void test_validation(void)
     /* Vlan100 doesn't exist → -ENOENT.  If by some chance it does, iface is absent → -ENOENT. */
     check("remove_vlan_assignment(absent iface)", ret, -ENOENT);
     printf("\n");
+
+    print_separator();
+    printf("A8: create_vlan(%u) with the VLAN table full  →  expect -ENOSPC\n",
+           (unsigned)TEST_VLAN_ID);
+    print_separator();
+    res_set_capacity(RES_VLAN, 1);
+    res_alloc(RES_VLAN, 1);
+    ret = create_vlan(TEST_VLAN_ID);
+    check("create_vlan(table full)", ret, -ENOSPC);
+    res_free(RES_VLAN, 1);
+    res_set_capacity(RES_VLAN, 4094);
+    printf("\n");
 }
 
 /* -------------------------------------------------------------------------
@@ -0,0 +1,229 @@
+/**
+ * @file test_vlan_state.c
+ * @brief Test for the lock-free link/VLAN snapshot (vlan_state.c).
+ *
+ *   V1: the initial snapshot contains the loopback interface
+ *   V2: vlan_state_note_add() / _master() / _del() and link attribute
+ *       notes are visible immediately
+ *   V3: readers see internally consistent snapshots while a writer churns
+ *       add/remove; the read-side latency is reported
+ *
+ * Requires only NETLINK_ROUTE dump access (no CAP_NET_ADMIN).  The churn uses
+ * synthetic ifindexes that the kernel never reports, so nothing is created.
+ */
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+
+#include "vlan_state.h"
+
+#define TEST_FAKE_IFINDEX  900000
+#define TEST_CHURN_ROUNDS  2000
+#define TEST_READERS       3
+
+/* -------------------------------------------------------------------------
+ * Helpers
+ * ------------------------------------------------------------------------- */
+
+static int g_pass = 0;
+static int g_fail = 0;
+
+static void check(const char *desc, int got, int expected)
+{
+    if (got == expected)
+    {
+        printf("[PASS] %s  (ret=%d)\n", desc, got);
+        g_pass++;
+    }
+    else
+    {
+        printf("[FAIL] %s  (expected=%d, got=%d)\n", desc, expected, got);
+        g_fail++;
+    }
+}
+
+static double now_us(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1.0e6 + ts.tv_nsec / 1.0e3;
+}
+
+/* -------------------------------------------------------------------------
+ * Tests
+ * ------------------------------------------------------------------------- */
+
+static void test_initial(void)
+{
+    check("V1: lo present in snapshot", vlan_state_lookup_ifindex("lo") > 0, 1);
+    check("V1: unknown name absent", vlan_state_lookup_ifindex("no_such_if0"), -1);
+}
+
+static void test_notes(void)
+{
+    const struct vlan_snapshot *snap;
+    const struct vs_link *l;
+    struct vs_note attrs = { VS_NOTE_LINK, TEST_FAKE_IFINDEX + 1, 0, NULL, NULL,
+                             IFF_UP, 9000, "uplink" };
+    int member_vlan = -1;
+    int bridge = -1;
+    int ok = 0;
+
+    vlan_state_note_add("Vlan4000", TEST_FAKE_IFINDEX, "bridge");
+    vlan_state_note_add("tport0", TEST_FAKE_IFINDEX + 1, "veth");
+    vlan_state_note_master(TEST_FAKE_IFINDEX + 1, TEST_FAKE_IFINDEX);
+
+    check("V2: added bridge visible", vlan_state_lookup_ifindex("Vlan4000"),
+          TEST_FAKE_IFINDEX);
+
+    snap = vlan_state_read_begin();
+    if (snap)
+    {
+        bridge = snap->bridge_ifindex[4000];
+        if ((l = vlan_snapshot_find_name(snap, "tport0")) != NULL)
+            member_vlan = l->member_vlan;
+    }
+    vlan_state_read_end();
+
+    check("V2: VLAN table maps 4000 to bridge", bridge, TEST_FAKE_IFINDEX);
+    check("V2: port reports VLAN membership", member_vlan, 4000);
+
+    vlan_state_note_many(&attrs, 1);
+    snap = vlan_state_read_begin();
+    if (snap && (l = vlan_snapshot_find_name(snap, "tport0")) != NULL)
+        ok = l->flags == IFF_UP && l->mtu == 9000 && strcmp(l->alias, "uplink") == 0 &&
+             l->master == TEST_FAKE_IFINDEX;
+    vlan_state_read_end();
+    check("V2: link attributes recorded", ok, 1);
+
+    vlan_state_note_del(TEST_FAKE_IFINDEX);
+
+    snap = vlan_state_read_begin();
+    member_vlan = -1;
+    if (snap && (l = vlan_snapshot_find_name(snap, "tport0")) != NULL)
+        member_vlan = l->member_vlan;
+    vlan_state_read_end();
+
+    check("V2: deleted bridge gone", vlan_state_lookup_ifindex("Vlan4000"), -1);
+    check("V2: member detached on bridge delete", member_vlan, 0);
+
+    vlan_state_note_del(TEST_FAKE_IFINDEX + 1);
+}
+
+static atomic_int g_stop;
+static atomic_int g_inconsistent;
+static double     g_max_read_us[TEST_READERS];
+
+static void *reader_main(void *arg)
+{
+    int id = (int)(intptr_t)arg;
+    uint64_t last_gen = 0;
+
+    while (!atomic_load(&g_stop))
+    {
+        const struct vlan_snapshot *snap;
+        double t0 = now_us();
+        double dt;
+
+        snap = vlan_state_read_begin();
+        if (snap)
+        {
+            if (snap->generation < last_gen)
+                atomic_fetch_add(&g_inconsistent, 1);
+            last_gen = snap->generation;
+
+            for (unsigned i = 0; i < snap->nlinks; i++)
+            {
+                const struct vs_link *l = &snap->links[i];
+
+                if (vlan_snapshot_find_name(snap, l->name) != l ||
+                    vlan_snapshot_find_index(snap, l->ifindex) != l)
+                {
+                    atomic_fetch_add(&g_inconsistent, 1);
+                    break;
+                }
+            }
+        }
+        vlan_state_read_end();
+
+        dt = now_us() - t0;
+        if (dt > g_max_read_us[id])
+            g_max_read_us[id] = dt;
+    }
+    return NULL;
+}
+
+static void test_churn(void)
+{
+    pthread_t readers[TEST_READERS];
+    double t0;
+    double max_read = 0;
+    int i;
+
+    for (i = 0; i < TEST_READERS; i++)
+        pthread_create(&readers[i], NULL, reader_main, (void *)(intptr_t)i);
+
+    t0 = now_us();
+    for (i = 0; i < TEST_CHURN_ROUNDS; i++)
+    {
+        char name[IFNAMSIZ];
+
+        snprintf(name, sizeof(name), "churn%d", i % 64);
+        vlan_state_note_add(name, TEST_FAKE_IFINDEX + 10 + (i % 64), "dummy");
+        if (i >= 32)
+            vlan_state_note_del(TEST_FAKE_IFINDEX + 10 + ((i - 32) % 64));
+    }
+    for (i = 0; i < 64; i++)
+        vlan_state_note_del(TEST_FAKE_IFINDEX + 10 + i);
+
+    atomic_store(&g_stop, 1);
+    for (i = 0; i < TEST_READERS; i++)
+    {
+        pthread_join(readers[i], NULL);
+        if (g_max_read_us[i] > max_read)
+            max_read = g_max_read_us[i];
+    }
+
+    printf("churn: %d writer rounds in %.1f ms, max read section %.1f us\n",
+           TEST_CHURN_ROUNDS, (now_us() - t0) / 1000.0, max_read);
+
+    check("V3: readers saw only consistent snapshots",
+          atomic_load(&g_inconsistent), 0);
+    check("V3: churned links removed", vlan_state_lookup_ifindex("churn5"), -1);
+}
+
+/* -------------------------------------------------------------------------
+ * Main
+ * ------------------------------------------------------------------------- */
+
+int main(void)
+{
+    setbuf(stdout, NULL);
+
+    printf("============================================================\n");
+    printf("  virtasic link state snapshot test\n");
+    printf("============================================================\n");
+
+    if (vlan_state_init() < 0)
+    {
+        printf("[FAIL] vlan_state_init\n");
+        return 1;
+    }
+
+    test_initial();
+    test_notes();
+    test_churn();
+
+    vlan_state_shutdown();
+
+    printf("============================================================\n");
+    printf("  Results: %d passed, %d failed\n", g_pass, g_fail);
+    printf("============================================================\n");
+
+    return (g_fail > 0) ? 1 : 0;
+}
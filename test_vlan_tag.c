@@ -0,0 +1,204 @@
+/**
+ * @file test_vlan_tag.c
+ * @brief Test for the 802.1Q burst kernels (vlan_tag.c).
+ *
+ * Every kernel the CPU supports (scalar, SSE4.2, AVX2) runs the same cases:
+ *
+ *   T1: a 64-frame burst mixing untagged, C-tagged, kernel-stripped,
+ *       S-tagged, stacked and runt frames yields the expected drop mask
+ *   T2: C-tags are popped in place with the TCI reported; other frames are
+ *       left untouched
+ *   T3: a burst that is not a multiple of the vector width (13 frames)
+ *   T4: vt_tag_copy() followed by vt_parse_burst() restores the frame
+ *
+ * Needs no privileges.
+ */
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "vlan_tag.h"
+
+#define FRAME_ROOM  128
+
+/* -------------------------------------------------------------------------
+ * Helpers
+ * ------------------------------------------------------------------------- */
+
+static int g_pass = 0;
+static int g_fail = 0;
+
+static void check(const char *desc, int got, int expected)
+{
+    if (got == expected)
+    {
+        printf("[PASS] %s  (ret=%d)\n", desc, got);
+        g_pass++;
+    }
+    else
+    {
+        printf("[FAIL] %s  (expected=%d, got=%d)\n", desc, expected, got);
+        g_fail++;
+    }
+}
+
+static uint8_t g_buf[64][FRAME_ROOM];
+
+enum kind { K_UNTAGGED, K_CTAG, K_STRIPPED, K_STAG, K_STACKED, K_RUNT };
+
+static enum kind kind_of(unsigned i)
+{
+    if (i == 5)
+        return K_RUNT;
+    switch (i % 8)
+    {
+    case 1: case 5: return K_CTAG;
+    case 2:         return K_STRIPPED;
+    case 3:         return K_STAG;
+    case 7:         return K_STACKED;
+    default:        return K_UNTAGGED;
+    }
+}
+
+/* Build frame @p i: MACs encode i, payload ethertype 0x88B5, 64 bytes. */
+static void build(struct dp_frame *f, unsigned i)
+{
+    uint8_t *p = g_buf[i];
+    unsigned off = 12;
+
+    memset(p, 0, FRAME_ROOM);
+    memset(p, (int)i, 6);
+    memset(p + 6, (int)(0x80 | i), 6);
+
+    switch (kind_of(i))
+    {
+    case K_CTAG:
+        p[off++] = 0x81; p[off++] = 0x00; p[off++] = 0x20 | (i >> 8); p[off++] = (uint8_t)i;
+        break;
+    case K_STAG:
+        p[off++] = 0x88; p[off++] = 0xA8; p[off++] = 0x00; p[off++] = (uint8_t)i;
+        break;
+    case K_STACKED:
+        p[off++] = 0x81; p[off++] = 0x00; p[off++] = 0x00; p[off++] = 10;
+        p[off++] = 0x81; p[off++] = 0x00; p[off++] = 0x00; p[off++] = 20;
+        break;
+    default:
+        break;
+    }
+    p[off++] = 0x88;
+    p[off++] = 0xB5;
+    p[off]   = (uint8_t)i;
+
+    f->data       = p;
+    f->len        = kind_of(i) == K_RUNT ? 10 : 64;
+    f->vlan_valid = kind_of(i) == K_STRIPPED;
+    f->vlan_tci   = kind_of(i) == K_STRIPPED ? 30 : 0;
+}
+
+static uint64_t expected_drop(unsigned n)
+{
+    uint64_t m = 0;
+    unsigned i;
+
+    for (i = 0; i < n; i++)
+    {
+        enum kind k = kind_of(i);
+
+        if (k == K_STAG || k == K_STACKED || k == K_RUNT)
+            m |= 1ull << i;
+    }
+    return m;
+}
+
+/* Non-zero if every kept frame is untagged in memory with the right metadata. */
+static int frames_ok(const struct dp_frame *f, unsigned n, uint64_t drop)
+{
+    unsigned i;
+
+    for (i = 0; i < n; i++)
+    {
+        const uint8_t *p = f[i].data;
+        enum kind k = kind_of(i);
+
+        if (drop & (1ull << i))
+            continue;
+        if (p[0] != i || p[5] != i || p[6] != (0x80 | i) || p[11] != (0x80 | i))
+            return 0;
+        if (p[12] != 0x88 || p[13] != 0xB5 || p[14] != i)
+            return 0;
+        if (k == K_CTAG && (!f[i].vlan_valid || f[i].vlan_tci != (0x2000 | i) ||
+                            f[i].len != 60 || p != g_buf[i] + 4))
+            return 0;
+        if (k == K_UNTAGGED && (f[i].vlan_valid || f[i].len != 64 || p != g_buf[i]))
+            return 0;
+        if (k == K_STRIPPED && (f[i].vlan_tci != 30 || f[i].len != 64))
+            return 0;
+    }
+    return 1;
+}
+
+/* -------------------------------------------------------------------------
+ * Tests
+ * ------------------------------------------------------------------------- */
+
+static void run_impl(enum vt_impl impl)
+{
+    struct dp_frame f[VT_BURST_MAX];
+    uint8_t tagged[FRAME_ROOM];
+    char desc[96];
+    uint64_t drop;
+    unsigned i;
+
+    if (vt_select(impl) == -ENOTSUP)
+    {
+        printf("[SKIP] kernel %d not supported on this CPU\n", (int)impl);
+        return;
+    }
+
+    for (i = 0; i < VT_BURST_MAX; i++)
+        build(&f[i], i);
+    drop = vt_parse_burst(f, VT_BURST_MAX);
+    snprintf(desc, sizeof(desc), "T1 [%s]: drop mask of a 64-frame burst", vt_impl_name());
+    check(desc, drop == expected_drop(VT_BURST_MAX), 1);
+    snprintf(desc, sizeof(desc), "T2 [%s]: tags popped, other frames untouched", vt_impl_name());
+    check(desc, frames_ok(f, VT_BURST_MAX, drop), 1);
+
+    for (i = 0; i < 13; i++)
+        build(&f[i], i);
+    drop = vt_parse_burst(f, 13);
+    snprintf(desc, sizeof(desc), "T3 [%s]: 13-frame burst", vt_impl_name());
+    check(desc, drop == expected_drop(13) && frames_ok(f, 13, drop), 1);
+
+    build(&f[0], 0);
+    f[0].len = vt_tag_copy(tagged, g_buf[0], f[0].len, 0xA123);
+    f[0].data = tagged;
+    drop = vt_parse_burst(f, 1);
+    snprintf(desc, sizeof(desc), "T4 [%s]: tag copy round trip", vt_impl_name());
+    check(desc, drop == 0 && f[0].vlan_valid && f[0].vlan_tci == 0xA123 && f[0].len == 64 &&
+                memcmp(f[0].data, g_buf[0], 64) == 0, 1);
+}
+
+/* -------------------------------------------------------------------------
+ * Main
+ * ------------------------------------------------------------------------- */
+
+int main(void)
+{
+    setbuf(stdout, NULL);
+
+    printf("============================================================\n");
+    printf("  virtasic 802.1Q burst kernel test\n");
+    printf("============================================================\n");
+
+    run_impl(VT_IMPL_SCALAR);
+    run_impl(VT_IMPL_SSE42);
+    run_impl(VT_IMPL_AVX2);
+
+    printf("============================================================\n");
+    printf("  Results: %d passed, %d failed\n", g_pass, g_fail);
+    printf("============================================================\n");
+
+    return (g_fail > 0) ? 1 : 0;
+}
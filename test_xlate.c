@@ -0,0 +1,241 @@
+/**
+ * @file test_xlate.c
+ * @brief Test for the VLAN translation tables (vlan_xlate.c) and their
+ *        kernel tc counterpart (tc_xlate.c).
+ *
+ * Tests:
+ *   X1: an empty table translates nothing; one mapping translates both ways
+ *   X2: a range maps C-VIDs to VIDs in order, up to the last VID
+ *   X3: remapping a C-VID frees its old VID; unmapping frees both sides,
+ *       also for C-VIDs that were not mapped; a range may move onto VIDs
+ *       its own C-VIDs give up
+ *   X4: bad ranges and a VID already taken by another C-VID are refused,
+ *       and the refusal leaves the table as it was
+ *   X5: clearing a table removes every mapping
+ *   K1: mappings on a veth become tc filters: an absent port and bad
+ *       ranges refused, a range mapped, remapped and unmapped, a conflict
+ *       refused before it reaches the kernel
+ *
+ * X1..X5 need no privileges; K1 runs in a private network namespace and
+ * is skipped without CAP_SYS_ADMIN / CAP_NET_ADMIN, or past the refusal
+ * checks on a kernel without cls_flower and act_vlan.
+ */
+
+#define _GNU_SOURCE     /* unshare */
+
+#include <errno.h>
+#include <sched.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <net/if.h>
+#include <netlink/netlink.h>
+#include <netlink/route/link.h>
+#include <netlink/route/link/veth.h>
+
+#include "tc_xlate.h"
+#include "vlan_state.h"
+#include "vlan_xlate.h"
+
+/* -------------------------------------------------------------------------
+ * Helpers
+ * ------------------------------------------------------------------------- */
+
+static int g_pass = 0;
+static int g_fail = 0;
+
+static void check(const char *desc, int got, int expected)
+{
+    if (got == expected)
+    {
+        printf("[PASS] %s  (ret=%d)\n", desc, got);
+        g_pass++;
+    }
+    else
+    {
+        printf("[FAIL] %s  (expected=%d, got=%d)\n", desc, expected, got);
+        g_fail++;
+    }
+}
+
+static int link_up(const char *name)
+{
+    struct ifreq ifr;
+    int fd = socket(AF_INET, SOCK_DGRAM, 0);
+    int ret = -1;
+
+    if (fd < 0)
+        return -1;
+    memset(&ifr, 0, sizeof(ifr));
+    strncpy(ifr.ifr_name, name, IFNAMSIZ - 1);
+    if (ioctl(fd, SIOCGIFFLAGS, &ifr) == 0)
+    {
+        ifr.ifr_flags |= IFF_UP;
+        ret = ioctl(fd, SIOCSIFFLAGS, &ifr);
+    }
+    close(fd);
+    return ret;
+}
+
+static int make_pair(void)
+{
+    struct nl_sock *sock = nl_socket_alloc();
+    int err;
+
+    if (!sock || nl_connect(sock, NETLINK_ROUTE) < 0)
+        return -1;
+    err = rtnl_link_veth_add(sock, "h0", "s0", getpid());
+    if (err == 0 && (link_up("h0") < 0 || link_up("s0") < 0))
+        err = -1;
+    nl_socket_free(sock);
+    return err;
+}
+
+/* Sum of the VIDs of the mappings walked. */
+static unsigned g_seen_vid_sum;
+static void count_mapping(const char *iface, uint16_t cvid, uint16_t vid, void *arg)
+{
+    (void)iface;
+    (void)cvid;
+    (void)arg;
+    g_seen_vid_sum += vid;
+}
+
+/* K1, inside the namespace with the h0/s0 pair. */
+static void test_kernel(void)
+{
+    int ret;
+
+    usleep(100000);             /* let the snapshot see the pair */
+    check("K1: absent port", tc_xlate_set("nonexistent0", 100, 10, 1), -ENODEV);
+    check("K1: bad range", tc_xlate_set("s0", 4000, 10, 100), -EINVAL);
+    check("K1: unmapping nothing", tc_xlate_set("s0", 100, 0, 1), 0);
+    ret = tc_xlate_set("s0", 100, 10, 100);
+    if (ret == -ENOENT)
+    {
+        printf("[SKIP] K: kernel without the flower classifier or vlan action\n");
+        check("K1: refused mappings not recorded", tc_xlate_walk(count_mapping, NULL), 0);
+        return;
+    }
+    check("K1: C-VIDs 100..199 to 10..109 on s0", ret, 0);
+    g_seen_vid_sum = 0;
+    check("K1: a hundred mappings", tc_xlate_walk(count_mapping, NULL), 100);
+    check("K1: ... to the right VIDs", (int)g_seen_vid_sum, (10 + 109) * 50);
+    check("K1: VID 10 is taken", tc_xlate_set("s0", 500, 10, 1), -EEXIST);
+    check("K1: remap C-VID 100 to 300", tc_xlate_set("s0", 100, 300, 1), 0);
+    check("K1: VID 10 is free again", tc_xlate_set("s0", 500, 10, 1), 0);
+    check("K1: still 101 mappings", tc_xlate_walk(count_mapping, NULL), 101);
+    g_seen_vid_sum = 0;
+    tc_xlate_walk(count_mapping, NULL);
+    ret = (int)g_seen_vid_sum;
+    check("K1: C-VIDs 101..199 moved up one VID", tc_xlate_set("s0", 101, 12, 99), 0);
+    g_seen_vid_sum = 0;
+    check("K1: ... still 101 mappings", tc_xlate_walk(count_mapping, NULL), 101);
+    check("K1: ... to the right VIDs", (int)g_seen_vid_sum, ret + 99);
+    check("K1: unmap the range", tc_xlate_set("s0", 100, 0, 100), 0);
+    check("K1: unmap C-VID 500", tc_xlate_set("s0", 500, 0, 1), 0);
+    check("K1: nothing left", tc_xlate_walk(count_mapping, NULL), 0);
+}
+
+/* -------------------------------------------------------------------------
+ * Main
+ * ------------------------------------------------------------------------- */
+
+int main(void)
+{
+    struct vlan_xlate *x = calloc(1, sizeof(*x));
+    unsigned i, ok;
+
+    setbuf(stdout, NULL);
+
+    printf("============================================================\n");
+    printf("  virtasic VLAN translation test\n");
+    printf("============================================================\n");
+
+    if (!x)
+        return 1;
+
+    for (ok = 1, i = 0; i < VLAN_ID_SPACE; i++)
+        ok &= vlan_xlate_in(x, (uint16_t)i) == 0 && vlan_xlate_out(x, (uint16_t)i) == 0;
+    check("X1: empty table translates nothing", (int)ok, 1);
+    check("X1: map C-VID 100 to 3100", vlan_xlate_check(x, 100, 3100, 1), 0);
+    vlan_xlate_set(x, 100, 3100, 1);
+    check("X1: ingress 100 -> 3100", vlan_xlate_in(x, 100), 3100);
+    check("X1: egress 3100 -> 100", vlan_xlate_out(x, 3100), 100);
+    check("X1: 3100 is not a C-VID", vlan_xlate_in(x, 3100), 0);
+    check("X1: one mapping", (int)x->n, 1);
+    check("X1: the TCI's priority bits are ignored", vlan_xlate_in(x, 0xE000 | 100), 3100);
+
+    check("X2: C-VIDs 1000..3999 to 1..3000", vlan_xlate_check(x, 1000, 1, 3000), 0);
+    vlan_xlate_set(x, 1000, 1, 3000);
+    for (ok = 1, i = 0; i < 3000; i++)
+        ok &= vlan_xlate_in(x, (uint16_t)(1000 + i)) == 1 + i &&
+              vlan_xlate_out(x, (uint16_t)(1 + i)) == 1000 + i;
+    check("X2: every one both ways", (int)ok, 1);
+    check("X2: 3001 mappings", (int)x->n, 3001);
+    check("X2: up to VID 4094", vlan_xlate_check(x, 4000, 4000, 95), 0);
+    check("X2: ... not beyond", vlan_xlate_check(x, 4000, 4000, 96), -EINVAL);
+
+    check("X3: remap C-VID 100 to 3500", vlan_xlate_check(x, 100, 3500, 1), 0);
+    vlan_xlate_set(x, 100, 3500, 1);
+    check("X3: ingress 100 -> 3500", vlan_xlate_in(x, 100), 3500);
+    check("X3: 3500 goes back to 100", vlan_xlate_out(x, 3500), 100);
+    check("X3: VID 3100 is free again", vlan_xlate_out(x, 3100), 0);
+    check("X3: still 3001 mappings", (int)x->n, 3001);
+    check("X3: unmap C-VIDs 3000..4094", vlan_xlate_check(x, 3000, 0, 1095), 0);
+    vlan_xlate_set(x, 3000, 0, 1095);
+    check("X3: 2001 mappings left", (int)x->n, 2001);
+    check("X3: C-VID 3999 gone", vlan_xlate_in(x, 3999), 0);
+    check("X3: ... and its VID 3000", vlan_xlate_out(x, 3000), 0);
+    check("X3: C-VID 2999 kept", vlan_xlate_in(x, 2999), 2000);
+    vlan_xlate_set(x, 10, 2500, 2);
+    check("X3: C-VIDs 10..11 from 2500.. up to 2501..", vlan_xlate_check(x, 10, 2501, 2), 0);
+    vlan_xlate_set(x, 10, 2501, 2);
+    check("X3: ... both ways",
+          vlan_xlate_in(x, 10) == 2501 && vlan_xlate_in(x, 11) == 2502 &&
+          vlan_xlate_out(x, 2501) == 10 && vlan_xlate_out(x, 2502) == 11, 1);
+    check("X3: ... VID 2500 free", vlan_xlate_out(x, 2500), 0);
+    check("X3: C-VID 10 alone onto 11's VID", vlan_xlate_check(x, 10, 2502, 1), -EEXIST);
+    check("X3: ... and back down", vlan_xlate_check(x, 10, 2500, 2), 0);
+    vlan_xlate_set(x, 10, 2500, 2);
+    check("X3: ... both ways",
+          vlan_xlate_in(x, 10) == 2500 && vlan_xlate_in(x, 11) == 2501 &&
+          vlan_xlate_out(x, 2500) == 10 && vlan_xlate_out(x, 2501) == 11, 1);
+    check("X3: ... VID 2502 free", vlan_xlate_out(x, 2502), 0);
+    vlan_xlate_set(x, 10, 0, 2);
+    check("X3: 2001 mappings again", (int)x->n, 2001);
+
+    check("X4: no mapping", vlan_xlate_check(x, 100, 10, 0), -EINVAL);
+    check("X4: C-VID 0", vlan_xlate_check(x, 0, 10, 1), -EINVAL);
+    check("X4: C-VID 4095", vlan_xlate_check(x, 4095, 10, 1), -EINVAL);
+    check("X4: VID 4095", vlan_xlate_check(x, 200, 4095, 1), -EINVAL);
+    check("X4: VID 10 taken by C-VID 1009", vlan_xlate_check(x, 200, 5, 10), -EEXIST);
+    check("X4: ... but not for C-VID 1009 itself", vlan_xlate_check(x, 1009, 10, 1), 0);
+    check("X4: table unchanged", x->n == 2001 && vlan_xlate_in(x, 200) == 0, 1);
+
+    vlan_xlate_clear(x);
+    for (ok = 1, i = 0; i < VLAN_ID_SPACE; i++)
+        ok &= vlan_xlate_in(x, (uint16_t)i) == 0 && vlan_xlate_out(x, (uint16_t)i) == 0;
+    check("X5: cleared", ok && x->n == 0, 1);
+    free(x);
+
+    if (unshare(CLONE_NEWNET) < 0 || vlan_state_init() < 0 || make_pair() < 0)
+    {
+        printf("[SKIP] K: cannot create a network namespace with a veth pair\n");
+    }
+    else
+    {
+        test_kernel();
+        vlan_state_shutdown();
+    }
+
+    printf("============================================================\n");
+    printf("  Results: %d passed, %d failed\n", g_pass, g_fail);
+    printf("============================================================\n");
+
+    return (g_fail > 0) ? 1 : 0;
+}
@@ -0,0 +1,131 @@
+/**
+ * @file trace.c
+ * @brief Packet traces (see trace.h).
+ */
+
+#include <string.h>
+
+#include "trace.h"
+
+/** Time trace_tsc_hz() measures the counter against the monotonic clock. */
+#define TRACE_CALIBRATE_NS  20000000ull
+
+static uint64_t g_tsc_hz;
+
+static uint64_t mono_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+/* ---------------------------------------------------------------------------
+ * Public API
+ * --------------------------------------------------------------------------- */
+
+/**
+ * trace_start() - Begin trace @p t of frame @p frame of @p len bytes
+ * received on port slot @p port; its first steps are timed from here.
+ */
+void trace_start(struct trace *t, unsigned port, const uint8_t *frame, uint32_t len)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_REALTIME, &ts);
+    t->ts_ns = (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+    t->cycles = 0;
+    t->port = (uint16_t)port;
+    t->len = len;
+    t->head_len = (uint16_t)(len < TRACE_HEAD_LEN ? len : TRACE_HEAD_LEN);
+    memcpy(t->head, frame, t->head_len);
+    t->nsteps = 0;
+    t->dropped = 0;
+    t->lost = 0;
+    t->mark = trace_tsc();
+}
+
+/**
+ * trace_step() - Append to @p t that stage @p stage decided @p verdict
+ * about port slot @p port and value @p arg, charging it the cycles since
+ * the previous step.  Ignored once the frame was dropped.
+ */
+void trace_step(struct trace *t, unsigned stage, unsigned verdict, unsigned port, uint32_t arg)
+{
+    uint64_t now = trace_tsc();
+    struct trace_step *s;
+
+    if (t->dropped)
+        return;
+    if (verdict == TRACE_DROP && stage != TRACE_TX)
+        t->dropped = 1;
+    t->cycles += now - t->mark;
+    if (t->nsteps == TRACE_MAX_STEPS)
+    {
+        t->lost++;
+        t->mark = trace_tsc();
+        return;
+    }
+    s = &t->step[t->nsteps++];
+    s->stage = (uint8_t)stage;
+    s->verdict = (uint8_t)verdict;
+    s->port = (uint16_t)port;
+    s->arg = arg;
+    s->cycles = now - t->mark;
+    /* The bookkeeping above is not charged to the next stage. */
+    t->mark = trace_tsc();
+}
+
+/**
+ * trace_tsc_hz() - Rate of trace_tsc(), measured once against the
+ * monotonic clock (TRACE_CALIBRATE_NS, the first call only).
+ */
+uint64_t trace_tsc_hz(void)
+{
+    uint64_t hz = __atomic_load_n(&g_tsc_hz, __ATOMIC_RELAXED);
+
+    if (hz)
+        return hz;
+#if defined(__x86_64__) || defined(__i386__)
+    {
+        struct timespec d = { 0, (long)TRACE_CALIBRATE_NS };
+        uint64_t t0 = mono_ns();
+        uint64_t c0 = trace_tsc();
+
+        nanosleep(&d, NULL);
+        hz = (trace_tsc() - c0) * 1000000000ull / (mono_ns() - t0);
+    }
+#else
+    hz = 1000000000ull;         /* trace_tsc() counts nanoseconds */
+#endif
+    if (!hz)
+        hz = 1;
+    __atomic_store_n(&g_tsc_hz, hz, __ATOMIC_RELAXED);
+    return hz;
+}
+
+/** Nanoseconds of @p cycles of trace_tsc(). */
+uint64_t trace_ns(uint64_t cycles)
+{
+    uint64_t hz = trace_tsc_hz();
+
+    return cycles / hz * 1000000000ull + cycles % hz * 1000000000ull / hz;
+}
+
+const char *trace_stage_name(unsigned stage)
+{
+    static const char *const names[TRACE_NSTAGES] = {
+        "parse", "classify", "acl", "learn", "route", "lookup", "storm", "forward", "tx",
+    };
+
+    return stage < TRACE_NSTAGES ? names[stage] : "?";
+}
+
+const char *trace_verdict_name(unsigned verdict)
+{
+    static const char *const names[TRACE_NVERDICTS] = {
+        "pass", "drop", "skip", "hit", "miss", "unicast", "flood", "filter", "sent",
+    };
+
+    return verdict < TRACE_NVERDICTS ? names[verdict] : "?";
+}
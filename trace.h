@@ -0,0 +1,108 @@
+/**
+ * @file trace.h
+ * @brief Packet traces: the decision path of one frame through the
+ *        forwarding pipeline, with the time spent in every stage.
+ *
+ * A trace is started just before a frame enters the pipeline; each stage
+ * that handles the frame then appends a step with its decision (verdict),
+ * the port and value it decided on, and the TSC cycles since the previous
+ * step.  One frame may have several TX steps, one per egress port of a
+ * flood.  A drop by any stage but TX ends the trace: stages the dropped
+ * frame still passes through on its way out of a burst add no step.  Steps
+ * beyond TRACE_MAX_STEPS are counted but not kept.
+ *
+ * Cycles are read with trace_tsc(): the time stamp counter on x86, the
+ * monotonic clock in nanoseconds elsewhere.  trace_tsc_hz() converts them.
+ */
+
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdint.h>
+#include <time.h>
+
+/** Steps kept per trace. */
+#define TRACE_MAX_STEPS    24
+/** Bytes of the traced frame kept, as it entered the pipeline. */
+#define TRACE_HEAD_LEN     64
+
+/** TRACE_PARSE's arg for a tagged frame. */
+#define TRACE_TAGGED       0x10000u
+
+/** Pipeline stages, in the order a frame meets them. */
+enum trace_stage
+{
+    TRACE_PARSE,        /**< tag parsing; arg: TRACE_TAGGED | TCI, 0 untagged */
+    TRACE_CLASSIFY,     /**< VLAN classification; arg: VLAN (of the tag if dropped) */
+    TRACE_ACL,          /**< ingress ACLs of the port and VLAN */
+    TRACE_LEARN,        /**< source learning; port: FDB port learned on */
+    TRACE_ROUTE,        /**< IPv4 routing; arg: egress VLAN */
+    TRACE_LOOKUP,       /**< FDB lookup; port: port found; arg: VLAN */
+    TRACE_STORM,        /**< storm control */
+    TRACE_FORWARD,      /**< forwarding decision; port: unicast egress; arg: VLAN */
+    TRACE_TX,           /**< tag rewrite and transmit; port: egress; arg: TCI, 0 untagged */
+    TRACE_NSTAGES
+};
+
+/** Decisions of a step. */
+enum trace_verdict
+{
+    TRACE_PASS,
+    TRACE_DROP,
+    TRACE_SKIP,         /**< stage did not apply (e.g. multicast source) */
+    TRACE_HIT,
+    TRACE_MISS,
+    TRACE_UNICAST,
+    TRACE_FLOOD,
+    TRACE_FILTER,       /**< destination is the ingress port */
+    TRACE_SENT,
+    TRACE_NVERDICTS
+};
+
+struct trace_step
+{
+    uint8_t  stage;      /**< TRACE_* stage */
+    uint8_t  verdict;    /**< TRACE_* verdict */
+    uint16_t port;       /**< port slot the step is about */
+    uint32_t arg;        /**< stage-specific, see enum trace_stage */
+    uint64_t cycles;     /**< since the previous step */
+};
+
+/** Trace of one frame. */
+struct trace
+{
+    uint64_t          ts_ns;     /**< wall clock when the frame entered */
+    uint64_t          mark;      /**< trace_tsc() at the last step */
+    uint64_t          cycles;    /**< all steps */
+    uint16_t          port;      /**< ingress port slot */
+    uint32_t          len;       /**< frame length */
+    uint16_t          head_len;
+    uint8_t           head[TRACE_HEAD_LEN];
+    uint8_t           nsteps;
+    uint8_t           dropped;   /**< a stage before TX dropped the frame */
+    uint16_t          lost;      /**< steps beyond TRACE_MAX_STEPS */
+    struct trace_step step[TRACE_MAX_STEPS];
+};
+
+/** Cycle counter of the traces. */
+static inline uint64_t trace_tsc(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+    return __builtin_ia32_rdtsc();
+#else
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+#endif
+}
+
+void        trace_start(struct trace *t, unsigned port, const uint8_t *frame, uint32_t len);
+void        trace_step(struct trace *t, unsigned stage, unsigned verdict, unsigned port,
+                       uint32_t arg);
+uint64_t    trace_tsc_hz(void);
+uint64_t    trace_ns(uint64_t cycles);
+const char *trace_stage_name(unsigned stage);
+const char *trace_verdict_name(unsigned verdict);
+
+#endif /* TRACE_H */
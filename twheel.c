@@ -0,0 +1,131 @@
+/**
+ * @file twheel.c
+ * @brief Hashed timer wheel (see twheel.h).
+ */
+
+#include <errno.h>
+#include <stdlib.h>
+
+#include "twheel.h"
+
+/**
+ * tw_init() - Set up @p tw with @p nslots slots (a power of two) at tick
+ * @p now.
+ *
+ * @return 0, -EINVAL if @p nslots is not a power of two, or -ENOMEM.
+ */
+int tw_init(struct twheel *tw, unsigned nslots, uint64_t now)
+{
+    if (nslots == 0 || (nslots & (nslots - 1)))
+        return -EINVAL;
+    tw->slot = calloc(nslots, sizeof(*tw->slot));
+    if (!tw->slot)
+        return -ENOMEM;
+    tw->mask = nslots - 1;
+    tw->now = now;
+    tw->npending = 0;
+    return 0;
+}
+
+/** tw_destroy() - Free the slots; pending timers are forgotten, not fired. */
+void tw_destroy(struct twheel *tw)
+{
+    free(tw->slot);
+    tw->slot = NULL;
+}
+
+static void unlink_timer(struct tw_timer *t)
+{
+    *t->pprev = t->next;
+    if (t->next)
+        t->next->pprev = t->pprev;
+    t->next = NULL;
+    t->pprev = NULL;
+}
+
+/**
+ * tw_arm() - (Re)arm @p t to fire at tick @p expires.
+ *
+ * A tick already past fires at the next tw_advance().
+ */
+void tw_arm(struct twheel *tw, struct tw_timer *t, uint64_t expires)
+{
+    struct tw_timer **head;
+
+    if (tw_armed(t))
+        unlink_timer(t);
+    else
+        tw->npending++;
+    if (expires <= tw->now)
+        expires = tw->now + 1;
+
+    head = &tw->slot[expires & tw->mask];
+    t->expires = expires;
+    t->next = *head;
+    t->pprev = head;
+    if (*head)
+        (*head)->pprev = &t->next;
+    *head = t;
+}
+
+/** tw_cancel() - Disarm @p t; a timer that is not armed is left alone. */
+void tw_cancel(struct twheel *tw, struct tw_timer *t)
+{
+    if (!tw_armed(t))
+        return;
+    unlink_timer(t);
+    tw->npending--;
+}
+
+/**
+ * tw_advance() - Move the wheel to tick @p now and pass every timer due by
+ * then to @p fn.
+ *
+ * Each slot of the ticks that went by is visited once, a whole turn at
+ * most.  Due timers are gathered before any callback runs and stay armed
+ * until their turn, so a callback may arm or cancel any timer, including
+ * due ones that have not fired yet.  Timers due in the same call fire in
+ * no particular order.
+ *
+ * @return the number of timers fired.
+ */
+unsigned tw_advance(struct twheel *tw, uint64_t now, tw_expire_fn fn, void *arg)
+{
+    struct tw_timer *due = NULL;
+    struct tw_timer *t, *next;
+    uint64_t ticks, k;
+    unsigned n = 0;
+
+    if (now <= tw->now)
+        return 0;
+    ticks = now - tw->now;
+    if (ticks > (uint64_t)tw->mask + 1)
+        ticks = (uint64_t)tw->mask + 1;
+
+    for (k = 1; k <= ticks; k++)
+    {
+        for (t = tw->slot[(tw->now + k) & tw->mask]; t; t = next)
+        {
+            next = t->next;
+            if (t->expires > now)
+                continue;
+            unlink_timer(t);
+            t->next = due;
+            t->pprev = &due;
+            if (due)
+                due->pprev = &t->next;
+            due = t;
+        }
+    }
+    tw->now = now;
+
+    while (due)
+    {
+        t = due;
+        unlink_timer(t);
+        tw->npending--;
+        fn(t, arg);
+        n++;
+    }
+    return n;
+}
@@ -0,0 +1,50 @@
+/**
+ * @file twheel.h
+ * @brief Hashed timer wheel: O(1) arm / cancel, expiry a slot at a time.
+ *
+ * Time is counted in ticks of a resolution chosen by the user.  A timer
+ * armed for tick T sits in slot T mod nslots; advancing the wheel visits
+ * only the slots of the ticks that went by and fires the timers in them
+ * that are due, so the cost of a tick does not depend on how many timers
+ * are pending, only on how many share its slot.  Timers further out than
+ * one turn of the wheel simply stay in their slot until a later turn.
+ *
+ * Timers are intrusive (embed a struct tw_timer) and the wheel does no
+ * allocation after tw_init().  It is not thread-safe; its user serializes.
+ */
+
+#ifndef TWHEEL_H
+#define TWHEEL_H
+
+#include <stdint.h>
+
+struct tw_timer
+{
+    struct tw_timer  *next;
+    struct tw_timer **pprev;     /* NULL while not armed */
+    uint64_t          expires;   /* tick */
+};
+
+struct twheel
+{
+    uint64_t          now;       /* last tick advanced to */
+    unsigned          mask;      /* nslots - 1 */
+    unsigned          npending;
+    struct tw_timer **slot;
+};
+
+/** tw_advance() callback; the timer is already disarmed and may be re-armed. */
+typedef void (*tw_expire_fn)(struct tw_timer *t, void *arg);
+
+int  tw_init(struct twheel *tw, unsigned nslots, uint64_t now);
+void tw_destroy(struct twheel *tw);
+void tw_arm(struct twheel *tw, struct tw_timer *t, uint64_t expires);
+void tw_cancel(struct twheel *tw, struct tw_timer *t);
+unsigned tw_advance(struct twheel *tw, uint64_t now, tw_expire_fn fn, void *arg);
+
+static inline int tw_armed(const struct tw_timer *t)
+{
+    return t->pprev != NULL;
+}
+
+#endif /* TWHEEL_H */
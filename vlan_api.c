@@ -5,12 +5,24 @@
  * Each VLAN is represented in the kernel as a bridge-type interface named
  * "Vlan<id>" (e.g. Vlan100 for VLAN ID 100).  Assigning an interface to a
  * VLAN enslaves it to that bridge via IFLA_MASTER; removing the assignment
- * un-enslaves it.  All existence checks use ioctl(SIOCGIFINDEX) so they work
- * without an Netlink cache, avoiding the rtnl_link_alloc_cache overhead on
- * every call.
+ * un-enslaves it.  Existence checks first consult the published link snapshot
+ * (vlan_state.c), which is lock-free for readers, and fall back to
+ * ioctl(SIOCGIFINDEX) so they work without a Netlink cache and avoid the
+ * rtnl_link_alloc_cache overhead on every call.  Successful changes are
+ * reported back to the snapshot so the next check sees them immediately.
+ *
+ * The vlan_batch_* variants validate the same way but only queue the request;
+ * vlan_batch_commit() sends a whole batch over one socket (nl_batch.c), which
+ * is what bulk configuration loading uses.
+ *
+ * Every bridge holds an entry of the RES_VLAN table (res.h): a create
+ * reserves one before its request is built and gives it back if the kernel
+ * refuses, so a full table fails with -ENOSPC before any Netlink traffic.
  */
 
 #include <errno.h>
+#include <stdatomic.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -23,6 +35,9 @@
 #include <netlink/route/link.h>
 
 #include "vlan_api.h"
+#include "vlan_state.h"
+#include "nl_batch.h"
+#include "res.h"
 
 /** Prefix for VLAN bridge interface names: Vlan<id> (e.g. Vlan100). */
 #define VLAN_IFACE_PREFIX "Vlan"
@@ -34,9 +49,11 @@
 /**
  * get_iface_index() - Resolve a named interface to its kernel ifindex.
  *
- * Uses ioctl(SIOCGIFINDEX) rather than Netlink cache lookup so that it works
- * even in environments where NETLINK_ROUTE queries are restricted.  Avoids
- * the net/if.h vs linux/if.h include-conflict by using the ioctl directly.
+ * Hits in the published link snapshot are answered without a syscall.  On a
+ * miss (or before the snapshot is loaded) ioctl(SIOCGIFINDEX) is used rather
+ * than a Netlink cache lookup so that it works even in environments where
+ * NETLINK_ROUTE queries are restricted.  Avoids the net/if.h vs linux/if.h
+ * include-conflict by using the ioctl directly.
  *
  * @param name  Null-terminated interface name (e.g. "eth0", "Vlan100").
  * @return      Interface index (>= 1) on success, or -1 if the interface does
@@ -45,8 +62,13 @@
 static int get_iface_index(const char *name)
 {
     struct ifreq ifr;
+    int ifindex;
     int fd;
 
+    ifindex = vlan_state_lookup_ifindex(name);
+    if (ifindex > 0)
+        return ifindex;
+
     fd = socket(AF_INET, SOCK_DGRAM, 0);
     if (fd < 0)
         return -1;
@@ -109,6 +131,7 @@ static void vlan_bridge_name(uint16_t vlan_id, char *buf, size_t bufsz)
  *    0        – success; the bridge interface "Vlan<vlan_id>" now exists. \n
  *   -EINVAL   – @p vlan_id is outside the valid range [1..4094]. \n
  *   -EEXIST   – A VLAN with this ID already exists. \n
+ *   -ENOSPC   – The VLAN table is at its configured capacity. \n
  *   -ENOMEM   – Failed to allocate a Netlink socket or link object. \n
  *   -EIO      – Netlink connect or RTM_NEWLINK failed (kernel error).
  */
@@ -136,11 +159,18 @@ int create_vlan(uint16_t vlan_id)
         return -EEXIST;
     }
 
+    if (res_alloc(RES_VLAN, 1) < 0)
+    {
+        fprintf(stderr, "create_vlan: VLAN table full, %s not created\n", vlan_name);
+        return -ENOSPC;
+    }
+
     NL_CALL_RET(sock, nl_socket_alloc(),
                 "nl_socket_alloc", "");
     if (!sock)
     {
         fprintf(stderr, "create_vlan: failed to allocate Netlink socket\n");
+        res_free(RES_VLAN, 1);
         return -ENOMEM;
     }
 
@@ -151,6 +181,7 @@ int create_vlan(uint16_t vlan_id)
         fprintf(stderr, "create_vlan: nl_connect failed: %s\n", nl_geterror(_nl_err));
         NL_CALL_VOID(nl_socket_free(sock),
                      "nl_socket_free", "sock=%p", (void *)sock);
+        res_free(RES_VLAN, 1);
         return -EIO;
     }
 
@@ -161,6 +192,7 @@ int create_vlan(uint16_t vlan_id)
         fprintf(stderr, "create_vlan: failed to allocate link object\n");
         NL_CALL_VOID(nl_socket_free(sock),
                      "nl_socket_free", "sock=%p", (void *)sock);
+        res_free(RES_VLAN, 1);
         return -ENOMEM;
     }
 
@@ -179,6 +211,7 @@ int create_vlan(uint16_t vlan_id)
                      "rtnl_link_put", "link=%p", (void *)link);
         NL_CALL_VOID(nl_socket_free(sock),
                      "nl_socket_free", "sock=%p", (void *)sock);
+        res_free(RES_VLAN, 1);
         return -EIO;
     }
 
@@ -194,10 +227,12 @@ int create_vlan(uint16_t vlan_id)
                      "rtnl_link_put", "link=%p", (void *)link);
         NL_CALL_VOID(nl_socket_free(sock),
                      "nl_socket_free", "sock=%p", (void *)sock);
+        res_free(RES_VLAN, 1);
         return -EIO;
     }
 
     printf("VLAN %u created: bridge interface %s\n", (unsigned)vlan_id, vlan_name);
+    vlan_state_note_add(vlan_name, get_iface_index(vlan_name), "bridge");
 
     NL_CALL_VOID(rtnl_link_put(link),
                  "rtnl_link_put", "link=%p", (void *)link);
@@ -299,6 +334,8 @@ int delete_vlan(uint16_t vlan_id)
 
     printf("VLAN %u deleted: bridge interface %s removed\n",
            (unsigned)vlan_id, vlan_name);
+    vlan_state_note_del(vlan_ifindex);
+    res_free(RES_VLAN, 1);
 
     NL_CALL_VOID(rtnl_link_put(link),
                  "rtnl_link_put", "link=%p", (void *)link);
@@ -441,6 +478,7 @@ int add_vlan_assignment(uint16_t vlan_id, const char *iface)
 
     printf("Interface %s assigned to VLAN %u (%s)\n",
            iface, (unsigned)vlan_id, vlan_name);
+    vlan_state_note_master(iface_ifindex, vlan_ifindex);
 
     NL_CALL_VOID(rtnl_link_put(change),
                  "rtnl_link_put", "link=%p", (void *)change);
@@ -580,6 +618,7 @@ int remove_vlan_assignment(uint16_t vlan_id, const char *iface)
 
     printf("Interface %s removed from VLAN %u (%s)\n",
            iface, (unsigned)vlan_id, vlan_name);
+    vlan_state_note_master(iface_ifindex, 0);
 
     NL_CALL_VOID(rtnl_link_put(change),
                  "rtnl_link_put", "link=%p", (void *)change);
@@ -589,3 +628,564 @@ int remove_vlan_assignment(uint16_t vlan_id, const char *iface)
                  "nl_socket_free", "sock=%p", (void *)sock);
     return 0;
 }
+
+/* ---------------------------------------------------------------------------
+ * LAG-aware assignment
+ * --------------------------------------------------------------------------- */
+
+/* Set once at startup, before any command runs. */
+static vlan_lag_fn g_lag_resolver;
+
+/* LAG changes queued but not yet run (vlan_lag_change_begin/_end). */
+static atomic_int g_lag_changes;
+
+/**
+ * vlan_set_lag_resolver() - Register the function that lists a LAG's
+ * member ports, or NULL for none.
+ */
+void vlan_set_lag_resolver(vlan_lag_fn fn)
+{
+    g_lag_resolver = fn;
+}
+
+/**
+ * vlan_lag_members() - List the member ports of LAG @p name.
+ *
+ * @param member  Receives up to @p max member names; may be NULL if @p max
+ *                is 0.
+ * @return the member count, or -ENOENT if @p name is not a LAG (or no
+ *         resolver is registered).
+ */
+int vlan_lag_members(const char *name, char (*member)[VLAN_IFNAMSIZ], unsigned max)
+{
+    if (!g_lag_resolver || !name)
+        return -ENOENT;
+    return g_lag_resolver(name, member, max);
+}
+
+/**
+ * vlan_lag_change_begin() - Note a queued command that may create or delete
+ * a LAG or change its members; call vlan_lag_change_end() once it has run.
+ */
+void vlan_lag_change_begin(void)
+{
+    atomic_fetch_add(&g_lag_changes, 1);
+}
+
+void vlan_lag_change_end(void)
+{
+    atomic_fetch_sub(&g_lag_changes, 1);
+}
+
+/**
+ * vlan_lag_maybe() - Whether @p name may be a LAG by the time a command
+ * queued now runs.
+ *
+ * While a LAG change is still queued the answer is unknown and taken as
+ * yes; otherwise it is vlan_lag_members()'s.
+ *
+ * @return 1 if @p name is or may become a LAG, 0 if it cannot.
+ */
+int vlan_lag_maybe(const char *name)
+{
+    return atomic_load(&g_lag_changes) > 0 || vlan_lag_members(name, NULL, 0) >= 0;
+}
+
+/**
+ * vlan_assign() - Assign an interface or a LAG to a VLAN, or remove it.
+ *
+ * A LAG's assignment is made for each of its member ports; anything else,
+ * including a kernel bond, is a single add_vlan_assignment() /
+ * remove_vlan_assignment().
+ *
+ * @param vlan_id  802.1Q VLAN identifier.  Valid range: 1–4094.
+ * @param iface    Interface or LAG name.
+ * @param add      1 to assign, 0 to remove.
+ *
+ * @return 0 on success, or the error of the first assignment that failed
+ *         (see add_vlan_assignment()); the other members are still tried.
+ */
+int vlan_assign(uint16_t vlan_id, const char *iface, int add)
+{
+    char member[VLAN_LAG_MAX_MEMBERS][VLAN_IFNAMSIZ];
+    int n = vlan_lag_members(iface, member, VLAN_LAG_MAX_MEMBERS);
+    int first = 0, failed = 0;
+    int i, err;
+
+    if (n < 0)
+        return add ? add_vlan_assignment(vlan_id, iface) : remove_vlan_assignment(vlan_id, iface);
+
+    if (n > VLAN_LAG_MAX_MEMBERS)
+        n = VLAN_LAG_MAX_MEMBERS;
+    for (i = 0; i < n; i++)
+    {
+        err = add ? add_vlan_assignment(vlan_id, member[i])
+                  : remove_vlan_assignment(vlan_id, member[i]);
+        if (err < 0)
+        {
+            failed++;
+            if (!first)
+                first = err;
+        }
+    }
+    printf("LAG %s: VLAN %u %s %d of %d members\n", iface, (unsigned)vlan_id,
+           add ? "added to" : "removed from", n - failed, n);
+    return first;
+}
+
+/* ---------------------------------------------------------------------------
+ * Batched VLAN API
+ * --------------------------------------------------------------------------- */
+
+enum vlan_batch_kind
+{
+    VLAN_BATCH_CREATE,
+    VLAN_BATCH_DELETE,
+    VLAN_BATCH_ADD,
+    VLAN_BATCH_REMOVE,
+};
+
+struct vlan_batch_op
+{
+    enum vlan_batch_kind kind;
+    uint16_t             vlan_id;
+    int                  vlan_ifindex;
+    int                  iface_ifindex;
+    struct nl_msg       *msg;
+    int                  kstatus;   /* kernel result, filled by nl_batch */
+    int                 *status;    /* caller's result slot */
+};
+
+struct vlan_batch
+{
+    struct nl_batch      *nl;
+    struct vlan_batch_op *ops;
+    size_t                count;
+    size_t                cap;
+    /* VIDs with a create/delete queued; other ops on them must wait. */
+    uint8_t               vid_busy[4096];
+};
+
+/**
+ * vlan_batch_alloc() - Allocate an empty VLAN batch.
+ *
+ * @return New batch, or NULL if the Netlink socket could not be set up.
+ */
+struct vlan_batch *vlan_batch_alloc(void)
+{
+    struct vlan_batch *b = calloc(1, sizeof(*b));
+
+    if (!b)
+        return NULL;
+
+    b->nl = nl_batch_alloc();
+    if (!b->nl)
+    {
+        free(b);
+        return NULL;
+    }
+    return b;
+}
+
+/**
+ * vlan_batch_free() - Release a batch; uncommitted operations are dropped.
+ */
+void vlan_batch_free(struct vlan_batch *batch)
+{
+    size_t i;
+
+    if (!batch)
+        return;
+
+    for (i = 0; i < batch->count; i++)
+    {
+        nlmsg_free(batch->ops[i].msg);
+        if (batch->ops[i].kind == VLAN_BATCH_CREATE)
+            res_free(RES_VLAN, 1);
+    }
+    free(batch->ops);
+    nl_batch_free(batch->nl);
+    free(batch);
+}
+
+/**
+ * vlan_batch_pending() - Number of operations queued since the last commit.
+ */
+size_t vlan_batch_pending(const struct vlan_batch *batch)
+{
+    return batch ? batch->count : 0;
+}
+
+/*
+ * batch_queue() - Append a built request; takes ownership of @p msg.
+ */
+static int batch_queue(struct vlan_batch *b, enum vlan_batch_kind kind,
+                       uint16_t vlan_id, int vlan_ifindex, int iface_ifindex,
+                       struct nl_msg *msg, int *status)
+{
+    struct vlan_batch_op *op;
+
+    if (b->count == b->cap)
+    {
+        size_t cap = b->cap ? b->cap * 2 : 256;
+        struct vlan_batch_op *ops = realloc(b->ops, cap * sizeof(*ops));
+
+        if (!ops)
+        {
+            nlmsg_free(msg);
+            return -ENOMEM;
+        }
+        b->ops = ops;
+        b->cap = cap;
+    }
+
+    op = &b->ops[b->count++];
+    op->kind          = kind;
+    op->vlan_id       = vlan_id;
+    op->vlan_ifindex  = vlan_ifindex;
+    op->iface_ifindex = iface_ifindex;
+    op->msg           = msg;
+    op->kstatus       = -EINPROGRESS;
+    op->status        = status;
+
+    if (kind == VLAN_BATCH_CREATE || kind == VLAN_BATCH_DELETE)
+        b->vid_busy[vlan_id] = 1;
+    if (status)
+        *status = -EINPROGRESS;
+    return 0;
+}
+
+/*
+ * batch_check_vid() - Common range / ordering checks for every batch op.
+ */
+static int batch_check_vid(struct vlan_batch *b, const char *fn, uint16_t vlan_id)
+{
+    if (!b)
+        return -EINVAL;
+
+    if (vlan_id < 1 || vlan_id > 4094)
+    {
+        fprintf(stderr, "%s: VLAN ID %u is outside valid range [1..4094]\n",
+                fn, (unsigned)vlan_id);
+        return -EINVAL;
+    }
+
+    if (b->vid_busy[vlan_id])
+        return -EAGAIN;
+    return 0;
+}
+
+/**
+ * vlan_batch_create() - Queue the creation of VLAN @p vlan_id.
+ *
+ * The VLAN's RES_VLAN entry is reserved when it is queued.
+ *
+ * @return 0 if queued (result follows in @p status), otherwise the same
+ *         validation codes as create_vlan() (-ENOSPC included), -EAGAIN or
+ *         -ENOMEM.
+ */
+int vlan_batch_create(struct vlan_batch *batch, uint16_t vlan_id, int *status)
+{
+    char vlan_name[IFNAMSIZ];
+    struct rtnl_link *link;
+    struct nl_msg *msg = NULL;
+    int err;
+
+    err = batch_check_vid(batch, "vlan_batch_create", vlan_id);
+    if (err < 0)
+        return err;
+
+    vlan_bridge_name(vlan_id, vlan_name, sizeof(vlan_name));
+    if (check_iface_exists(vlan_name))
+    {
+        fprintf(stderr, "vlan_batch_create: VLAN %u (%s) already exists\n",
+                (unsigned)vlan_id, vlan_name);
+        return -EEXIST;
+    }
+
+    if (res_alloc(RES_VLAN, 1) < 0)
+    {
+        fprintf(stderr, "vlan_batch_create: VLAN table full, %s not queued\n", vlan_name);
+        return -ENOSPC;
+    }
+
+    link = rtnl_link_alloc();
+    if (!link)
+    {
+        res_free(RES_VLAN, 1);
+        return -ENOMEM;
+    }
+
+    rtnl_link_set_name(link, vlan_name);
+    err = rtnl_link_set_type(link, "bridge");
+    if (err >= 0)
+        err = rtnl_link_build_add_request(link, NLM_F_CREATE | NLM_F_EXCL, &msg);
+    rtnl_link_put(link);
+    if (err < 0)
+    {
+        fprintf(stderr, "vlan_batch_create: cannot build RTM_NEWLINK for %s: %s\n",
+                vlan_name, nl_geterror(err));
+        res_free(RES_VLAN, 1);
+        return -EIO;
+    }
+
+    err = batch_queue(batch, VLAN_BATCH_CREATE, vlan_id, 0, 0, msg, status);
+    if (err < 0)
+        res_free(RES_VLAN, 1);
+    return err;
+}
+
+/**
+ * vlan_batch_delete() - Queue the deletion of VLAN @p vlan_id.
+ *
+ * @return 0 if queued, otherwise the validation codes of delete_vlan(),
+ *         -EAGAIN or -ENOMEM.
+ */
+int vlan_batch_delete(struct vlan_batch *batch, uint16_t vlan_id, int *status)
+{
+    char vlan_name[IFNAMSIZ];
+    struct rtnl_link *link;
+    struct nl_msg *msg = NULL;
+    int vlan_ifindex;
+    int err;
+
+    err = batch_check_vid(batch, "vlan_batch_delete", vlan_id);
+    if (err < 0)
+        return err;
+
+    vlan_bridge_name(vlan_id, vlan_name, sizeof(vlan_name));
+    vlan_ifindex = get_iface_index(vlan_name);
+    if (vlan_ifindex < 0)
+    {
+        fprintf(stderr, "vlan_batch_delete: VLAN %u (%s) does not exist\n",
+                (unsigned)vlan_id, vlan_name);
+        return -ENOENT;
+    }
+
+    link = rtnl_link_alloc();
+    if (!link)
+        return -ENOMEM;
+
+    rtnl_link_set_ifindex(link, vlan_ifindex);
+    err = rtnl_link_build_delete_request(link, &msg);
+    rtnl_link_put(link);
+    if (err < 0)
+    {
+        fprintf(stderr, "vlan_batch_delete: cannot build RTM_DELLINK for %s: %s\n",
+                vlan_name, nl_geterror(err));
+        return -EIO;
+    }
+
+    return batch_queue(batch, VLAN_BATCH_DELETE, vlan_id, vlan_ifindex, 0, msg, status);
+}
+
+/*
+ * batch_member() - Shared body of vlan_batch_add_member / _remove_member.
+ */
+static int batch_member(struct vlan_batch *b, const char *fn,
+                        enum vlan_batch_kind kind, uint16_t vlan_id,
+                        const char *iface, int *status)
+{
+    char vlan_name[IFNAMSIZ];
+    struct rtnl_link *orig;
+    struct rtnl_link *change;
+    struct nl_msg *msg = NULL;
+    int vlan_ifindex;
+    int iface_ifindex;
+    int err;
+
+    err = batch_check_vid(b, fn, vlan_id);
+    if (err < 0)
+        return err;
+
+    if (!iface)
+    {
+        fprintf(stderr, "%s: iface is NULL\n", fn);
+        return -EINVAL;
+    }
+
+    vlan_bridge_name(vlan_id, vlan_name, sizeof(vlan_name));
+    vlan_ifindex = get_iface_index(vlan_name);
+    if (vlan_ifindex < 0)
+    {
+        fprintf(stderr, "%s: VLAN %u (%s) does not exist\n",
+                fn, (unsigned)vlan_id, vlan_name);
+        return -ENOENT;
+    }
+
+    iface_ifindex = get_iface_index(iface);
+    if (iface_ifindex < 0)
+    {
+        fprintf(stderr, "%s: interface '%s' does not exist\n", fn, iface);
+        return -ENOENT;
+    }
+
+    orig   = rtnl_link_alloc();
+    change = rtnl_link_alloc();
+    if (!orig || !change)
+    {
+        if (orig)
+            rtnl_link_put(orig);
+        if (change)
+            rtnl_link_put(change);
+        return -ENOMEM;
+    }
+
+    rtnl_link_set_ifindex(orig, iface_ifindex);
+    rtnl_link_set_master(change, kind == VLAN_BATCH_ADD ? vlan_ifindex : 0);
+    err = rtnl_link_build_change_request(orig, change, 0, &msg);
+    rtnl_link_put(change);
+    rtnl_link_put(orig);
+    if (err < 0)
+    {
+        fprintf(stderr, "%s: cannot build RTM_SETLINK for %s: %s\n",
+                fn, iface, nl_geterror(err));
+        return -EIO;
+    }
+
+    return batch_queue(b, kind, vlan_id, vlan_ifindex, iface_ifindex, msg, status);
+}
+
+/**
+ * vlan_batch_add_member() - Queue the assignment of @p iface to a VLAN.
+ *
+ * @return 0 if queued, otherwise the validation codes of
+ *         add_vlan_assignment(), -EAGAIN or -ENOMEM.
+ */
+int vlan_batch_add_member(struct vlan_batch *batch, uint16_t vlan_id,
+                          const char *iface, int *status)
+{
+    return batch_member(batch, "vlan_batch_add_member", VLAN_BATCH_ADD,
+                        vlan_id, iface, status);
+}
+
+/**
+ * vlan_batch_remove_member() - Queue the removal of @p iface from a VLAN.
+ *
+ * @return 0 if queued, otherwise the validation codes of
+ *         remove_vlan_assignment(), -EAGAIN or -ENOMEM.
+ */
+int vlan_batch_remove_member(struct vlan_batch *batch, uint16_t vlan_id,
+                             const char *iface, int *status)
+{
+    return batch_member(batch, "vlan_batch_remove_member", VLAN_BATCH_REMOVE,
+                        vlan_id, iface, status);
+}
+
+/**
+ * vlan_batch_commit() - Send all queued operations and wait for the results.
+ *
+ * @details
+ *   Operations reach the kernel in the order they were queued.  A kernel
+ *   rejection is reported as -EIO in that operation's status, like the
+ *   single-shot calls do, and does not stop the remaining operations.
+ *   Successful changes are reported to the link snapshot.  The batch is empty
+ *   and reusable afterwards.
+ *
+ * @return
+ *    0        – every operation succeeded. \n
+ *   -EIO      – at least one operation failed. \n
+ *   -ENOMEM   – the batch could not be handed to the Netlink layer.
+ */
+int vlan_batch_commit(struct vlan_batch *batch)
+{
+    char vlan_name[IFNAMSIZ];
+    char (*names)[IFNAMSIZ];
+    struct vs_note *notes;
+    size_t nnotes = 0;
+    size_t failed = 0;
+    size_t i;
+    int err = 0;
+    int _nl_err;
+
+    if (!batch)
+        return -EINVAL;
+    if (batch->count == 0)
+        return 0;
+
+    /* If queueing runs out of memory, the prefix already handed over is
+     * still sent so that the kernel sees the operations in order. */
+    for (i = 0; i < batch->count; i++)
+    {
+        struct vlan_batch_op *op = &batch->ops[i];
+
+        if (err == 0)
+            err = nl_batch_add(batch->nl, op->msg, &op->kstatus);
+        else
+            nlmsg_free(op->msg);
+        op->msg = NULL;
+        if (err < 0)
+            op->kstatus = err;
+    }
+
+    NL_CALL_RET(_nl_err, nl_batch_commit(batch->nl),
+                "nl_batch_commit", "batch=%p, ops=%zu",
+                (void *)batch->nl, batch->count);
+    (void)_nl_err;
+
+    /* Report every successful change to the snapshot in one publication. */
+    notes = calloc(batch->count, sizeof(*notes));
+    names = calloc(batch->count, sizeof(*names));
+
+    for (i = 0; i < batch->count; i++)
+    {
+        struct vlan_batch_op *op = &batch->ops[i];
+        struct vs_note *nt = notes ? &notes[nnotes] : NULL;
+        int result = op->kstatus;
+
+        /* A refused create gives its reservation back, a delete frees one. */
+        if ((op->kind == VLAN_BATCH_CREATE && result < 0) ||
+            (op->kind == VLAN_BATCH_DELETE && result >= 0))
+            res_free(RES_VLAN, 1);
+
+        if (result < 0)
+        {
+            vlan_bridge_name(op->vlan_id, vlan_name, sizeof(vlan_name));
+            fprintf(stderr, "vlan_batch_commit: operation %zu on %s failed: %s\n",
+                    i, vlan_name, strerror(-result));
+            result = (result == -ENOMEM) ? -ENOMEM : -EIO;
+            failed++;
+        }
+        else if (nt && names)
+        {
+            memset(nt, 0, sizeof(*nt));
+            switch (op->kind)
+            {
+            case VLAN_BATCH_CREATE:
+                vlan_bridge_name(op->vlan_id, names[nnotes], IFNAMSIZ);
+                nt->op      = VS_NOTE_ADD;
+                nt->ifindex = get_iface_index(names[nnotes]);
+                nt->name    = names[nnotes];
+                nt->kind    = "bridge";
+                break;
+            case VLAN_BATCH_DELETE:
+                nt->op      = VS_NOTE_DEL;
+                nt->ifindex = op->vlan_ifindex;
+                break;
+            case VLAN_BATCH_ADD:
+            case VLAN_BATCH_REMOVE:
+                nt->op      = VS_NOTE_MASTER;
+                nt->ifindex = op->iface_ifindex;
+                nt->master  = op->kind == VLAN_BATCH_ADD ? op->vlan_ifindex : 0;
+                break;
+            }
+            nnotes++;
+        }
+
+        if (op->status)
+            *op->status = result;
+    }
+
+    vlan_state_note_many(notes, nnotes);
+    free(names);
+    free(notes);
+
+    printf("VLAN batch committed: %zu operations, %zu failed\n",
+           batch->count, failed);
+
+    batch->count = 0;
+    memset(batch->vid_busy, 0, sizeof(batch->vid_busy));
+    if (failed == 0)
+        return 0;
+    return err == -ENOMEM ? -ENOMEM : -EIO;
+}
@@ -11,6 +11,7 @@
 #ifndef VLAN_API_H
 #define VLAN_API_H
 
+#include <stddef.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <time.h>
@@ -58,4 +59,61 @@ int delete_vlan(uint16_t vlan_id);
 int add_vlan_assignment(uint16_t vlan_id, const char *iface);
 int remove_vlan_assignment(uint16_t vlan_id, const char *iface);
 
+/* ---------------------------------------------------------------------------
+ * LAG-aware assignment
+ *
+ * The forwarding plane switches a LAG as one port but takes VLAN membership
+ * per port from the kernel bridges, so an assignment naming one of its LAGs
+ * stands for one assignment per member port.  The daemon registers the
+ * function that lists a LAG's members with vlan_set_lag_resolver(); every
+ * path that assigns VLANs by name goes through vlan_assign(), or leaves
+ * LAG names (vlan_lag_members() >= 0) to a path that does.
+ *
+ * Commands are classified when they are queued but run later.  The commands
+ * that change LAGs are bracketed with vlan_lag_change_begin() / _end(), and
+ * vlan_lag_maybe() treats every name as a possible LAG while one of them is
+ * still queued, so a queued command is never taken for a plain port's when
+ * it will run against a LAG.
+ * --------------------------------------------------------------------------- */
+
+/** Interface name size (IFNAMSIZ) without pulling in linux/if.h here. */
+#define VLAN_IFNAMSIZ         16
+/** Members a LAG may have (LAG_MAX_MEMBERS). */
+#define VLAN_LAG_MAX_MEMBERS  16
+
+/** LAG resolver: the member count of LAG @p name, the first @p max names
+ *  copied to @p member; -ENOENT if @p name is not a LAG. */
+typedef int (*vlan_lag_fn)(const char *name, char (*member)[VLAN_IFNAMSIZ], unsigned max);
+
+void vlan_set_lag_resolver(vlan_lag_fn fn);
+int  vlan_lag_members(const char *name, char (*member)[VLAN_IFNAMSIZ], unsigned max);
+void vlan_lag_change_begin(void);
+void vlan_lag_change_end(void);
+int  vlan_lag_maybe(const char *name);
+int  vlan_assign(uint16_t vlan_id, const char *iface, int add);
+
+/* ---------------------------------------------------------------------------
+ * Batched VLAN API
+ *
+ * The vlan_batch_* calls validate an operation exactly like their single-shot
+ * counterparts above and queue it; vlan_batch_commit() then sends every
+ * queued request through one Netlink socket (see nl_batch.h).  Each queued
+ * operation reports its result through @p status, using the same codes as
+ * the single-shot call.  An operation on a VLAN whose create or delete is
+ * still queued returns -EAGAIN: commit the batch and queue it again.
+ * --------------------------------------------------------------------------- */
+
+struct vlan_batch;
+
+struct vlan_batch *vlan_batch_alloc(void);
+void   vlan_batch_free(struct vlan_batch *batch);
+int    vlan_batch_create(struct vlan_batch *batch, uint16_t vlan_id, int *status);
+int    vlan_batch_delete(struct vlan_batch *batch, uint16_t vlan_id, int *status);
+int    vlan_batch_add_member(struct vlan_batch *batch, uint16_t vlan_id,
+                             const char *iface, int *status);
+int    vlan_batch_remove_member(struct vlan_batch *batch, uint16_t vlan_id,
+                                const char *iface, int *status);
+size_t vlan_batch_pending(const struct vlan_batch *batch);
+int    vlan_batch_commit(struct vlan_batch *batch);
+
 #endif /* VLAN_API_H */
@@ -0,0 +1,789 @@
+/**
+ * @file vlan_state.c
+ * @brief Epoch-protected snapshot of the kernel interface / VLAN tables.
+ *
+ * Read side: each reader thread owns a cache-line-sized slot holding the
+ * global epoch it entered with (0 = quiescent).  Entering a section is one
+ * store plus one load; there are no locks and no shared writes.
+ *
+ * Write side: g_write_lock serialises writers.  A writer copies the current
+ * snapshot, applies its change, publishes the copy with an atomic exchange,
+ * advances the global epoch and puts the old snapshot on a retire list.  A
+ * retired snapshot is freed once no reader slot holds an epoch older than the
+ * one at which it was retired.  Writers never wait for readers.
+ *
+ * The monitor thread keeps a libnl cache manager subscribed to RTNLGRP_LINK
+ * and republishes whenever the kernel reports a change, so the snapshot also
+ * follows interfaces created or removed outside the daemon.
+ */
+
+#include <errno.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <netlink/netlink.h>
+#include <netlink/cache.h>
+#include <netlink/route/link.h>
+#include <netlink/route/link/vlan.h>
+
+#include "vlan_state.h"
+
+/** Prefix of the bridge interfaces that represent VLANs (see vlan_api.c). */
+#define VLAN_IFACE_PREFIX "Vlan"
+
+/** Monitor poll interval; bounds shutdown latency. */
+#define VS_POLL_MS        200
+
+struct vs_reader_slot
+{
+    _Atomic uint64_t epoch;           /**< 0 when outside a read section. */
+    atomic_int       used;
+    char             pad[64 - sizeof(uint64_t) - sizeof(int)];
+} __attribute__((aligned(64)));
+
+static struct vs_reader_slot g_slots[VS_MAX_READERS];
+
+static _Atomic(struct vlan_snapshot *) g_current;
+static _Atomic uint64_t g_epoch = 1;
+static uint64_t         g_generation;
+
+static pthread_mutex_t  g_write_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct vlan_snapshot *g_retired;
+
+static __thread int     t_slot = -1;
+static pthread_key_t    g_slot_key;
+static pthread_once_t   g_slot_once = PTHREAD_ONCE_INIT;
+
+static struct nl_cache_mngr *g_mngr;
+static struct nl_cache      *g_link_cache;
+static pthread_t             g_monitor;
+static atomic_int            g_stop;
+static int                   g_changed;
+static int                   g_running;
+
+/* ---------------------------------------------------------------------------
+ * Snapshot construction
+ * --------------------------------------------------------------------------- */
+
+static uint32_t name_hash(const char *s)
+{
+    uint32_t h = 2166136261u;
+
+    while (*s)
+    {
+        h ^= (uint8_t)*s++;
+        h *= 16777619u;
+    }
+    return h;
+}
+
+static int cmp_ifindex(const void *a, const void *b)
+{
+    const struct vs_link *la = a;
+    const struct vs_link *lb = b;
+
+    return (la->ifindex > lb->ifindex) - (la->ifindex < lb->ifindex);
+}
+
+/** Parse "Vlan<id>" into an ID, or return 0 if @p name is not a VLAN bridge. */
+static int parse_vlan_bridge(const char *name)
+{
+    const size_t plen = sizeof(VLAN_IFACE_PREFIX) - 1;
+    char *end;
+    long id;
+
+    if (strncmp(name, VLAN_IFACE_PREFIX, plen) != 0 || !name[plen])
+        return 0;
+
+    id = strtol(name + plen, &end, 10);
+    if (*end || id < 1 || id > 4094)
+        return 0;
+    return (int)id;
+}
+
+static void snapshot_free(struct vlan_snapshot *snap)
+{
+    if (!snap)
+        return;
+    free(snap->links);
+    free(snap->name_index);
+    free(snap);
+}
+
+/**
+ * snapshot_finish() - Sort links and rebuild the derived lookup tables.
+ *
+ * @return 0 on success, -ENOMEM if the name index cannot be allocated.
+ */
+static int snapshot_finish(struct vlan_snapshot *snap)
+{
+    unsigned size = 16;
+    unsigned i;
+
+    qsort(snap->links, snap->nlinks, sizeof(struct vs_link), cmp_ifindex);
+
+    while (size < snap->nlinks * 2)
+        size <<= 1;
+
+    free(snap->name_index);
+    snap->name_index = calloc(size, sizeof(uint32_t));
+    if (!snap->name_index)
+        return -ENOMEM;
+    snap->name_index_mask = size - 1;
+
+    memset(snap->bridge_ifindex, 0, sizeof(snap->bridge_ifindex));
+
+    for (i = 0; i < snap->nlinks; i++)
+    {
+        struct vs_link *l = &snap->links[i];
+        uint32_t pos = name_hash(l->name) & snap->name_index_mask;
+        int vid;
+
+        while (snap->name_index[pos])
+            pos = (pos + 1) & snap->name_index_mask;
+        snap->name_index[pos] = i + 1;
+
+        if (strcmp(l->kind, "bridge") == 0 && (vid = parse_vlan_bridge(l->name)))
+            snap->bridge_ifindex[vid] = l->ifindex;
+    }
+
+    for (i = 0; i < snap->nlinks; i++)
+    {
+        struct vs_link *l = &snap->links[i];
+        const struct vs_link *m;
+
+        l->member_vlan = 0;
+        if (l->master > 0 &&
+            (m = vlan_snapshot_find_index(snap, l->master)) != NULL)
+            l->member_vlan = parse_vlan_bridge(m->name);
+    }
+
+    return 0;
+}
+
+/** Deep-copy @p src with room for @p extra more links. */
+static struct vlan_snapshot *snapshot_clone(const struct vlan_snapshot *src,
+                                            unsigned extra)
+{
+    struct vlan_snapshot *snap;
+    unsigned n = src ? src->nlinks : 0;
+
+    snap = calloc(1, sizeof(*snap));
+    if (!snap)
+        return NULL;
+
+    snap->links = calloc(n + extra + 1, sizeof(struct vs_link));
+    if (!snap->links)
+    {
+        free(snap);
+        return NULL;
+    }
+
+    if (src)
+    {
+        memcpy(snap->links, src->links, n * sizeof(struct vs_link));
+        snap->nlinks = n;
+    }
+    return snap;
+}
+
+static void link_from_rtnl(struct vs_link *l, struct rtnl_link *link)
+{
+    const char *s;
+    struct nl_addr *addr;
+
+    memset(l, 0, sizeof(*l));
+    l->ifindex = rtnl_link_get_ifindex(link);
+    l->master  = rtnl_link_get_master(link);
+    l->parent  = rtnl_link_get_link(link);
+    l->flags   = rtnl_link_get_flags(link);
+    l->mtu     = rtnl_link_get_mtu(link);
+
+    if ((s = rtnl_link_get_name(link)) != NULL)
+        snprintf(l->name, sizeof(l->name), "%s", s);
+    if ((s = rtnl_link_get_type(link)) != NULL)
+        snprintf(l->kind, sizeof(l->kind), "%s", s);
+    if ((s = rtnl_link_get_ifalias(link)) != NULL)
+        snprintf(l->alias, sizeof(l->alias), "%s", s);
+
+    addr = rtnl_link_get_addr(link);
+    if (addr && nl_addr_get_len(addr) == sizeof(l->addr))
+        memcpy(l->addr, nl_addr_get_binary_addr(addr), sizeof(l->addr));
+
+    if (rtnl_link_is_vlan(link))
+    {
+        l->vlan_id    = rtnl_link_vlan_get_id(link);
+        l->vlan_flags = (uint32_t)rtnl_link_vlan_get_flags(link);
+    }
+}
+
+/** Build a fresh snapshot from the monitor's link cache. */
+static struct vlan_snapshot *snapshot_from_cache(struct nl_cache *cache)
+{
+    struct vlan_snapshot *snap;
+    struct nl_object *obj;
+    unsigned n = 0;
+    int pass;
+
+    snap = snapshot_clone(NULL, (unsigned)nl_cache_nitems(cache));
+    if (!snap)
+        return NULL;
+
+    /*
+     * The cache holds AF_BRIDGE objects next to the regular ones for bridges
+     * and their ports, and AF_INET6 ones (without link kind) for links whose
+     * IPv6 settings changed; a freshly created bridge may exist only in the
+     * AF_BRIDGE form.  Take the regular object when there is one, else the
+     * AF_BRIDGE one, else any.
+     */
+    for (pass = 0; pass < 3; pass++)
+    {
+        for (obj = nl_cache_get_first(cache); obj; obj = nl_cache_get_next(obj))
+        {
+            struct rtnl_link *link = (struct rtnl_link *)obj;
+            int family = rtnl_link_get_family(link);
+
+            if (pass == 0 ? family != AF_UNSPEC
+                          : pass == 1 ? family != AF_BRIDGE
+                                      : family == AF_UNSPEC || family == AF_BRIDGE)
+                continue;
+            if (pass > 0 && vlan_snapshot_find_index(snap, rtnl_link_get_ifindex(link)))
+                continue;
+            link_from_rtnl(&snap->links[n++], link);
+        }
+        /* Keep the links found so far sorted for vlan_snapshot_find_index(). */
+        snap->nlinks = n;
+        qsort(snap->links, n, sizeof(struct vs_link), cmp_ifindex);
+    }
+
+    if (snapshot_finish(snap) < 0)
+    {
+        snapshot_free(snap);
+        return NULL;
+    }
+    return snap;
+}
+
+/* ---------------------------------------------------------------------------
+ * Publication and reclamation (caller holds g_write_lock)
+ * --------------------------------------------------------------------------- */
+
+static uint64_t min_active_epoch(void)
+{
+    uint64_t min = UINT64_MAX;
+    unsigned i;
+
+    for (i = 0; i < VS_MAX_READERS; i++)
+    {
+        uint64_t e = atomic_load(&g_slots[i].epoch);
+        if (e && e < min)
+            min = e;
+    }
+    return min;
+}
+
+static void reclaim(void)
+{
+    struct vlan_snapshot **pp = &g_retired;
+    uint64_t min = min_active_epoch();
+
+    while (*pp)
+    {
+        struct vlan_snapshot *s = *pp;
+
+        if (s->retire_epoch <= min)
+        {
+            *pp = s->retired_next;
+            snapshot_free(s);
+        }
+        else
+        {
+            pp = &s->retired_next;
+        }
+    }
+}
+
+static void publish(struct vlan_snapshot *snap)
+{
+    struct vlan_snapshot *old;
+
+    snap->generation = ++g_generation;
+    old = atomic_exchange(&g_current, snap);
+
+    if (old)
+    {
+        /* Readers that can still see @old entered with an epoch below this. */
+        old->retire_epoch = atomic_fetch_add(&g_epoch, 1) + 1;
+        old->retired_next = g_retired;
+        g_retired = old;
+    }
+    reclaim();
+}
+
+/* ---------------------------------------------------------------------------
+ * Monitor thread
+ * --------------------------------------------------------------------------- */
+
+static void link_change_cb(struct nl_cache *cache, struct nl_object *obj,
+                           int action, void *arg)
+{
+    (void)cache;
+    (void)obj;
+    (void)action;
+    (void)arg;
+    g_changed = 1;
+}
+
+/** Drain queued notifications and republish if anything changed. */
+static void monitor_sync(void)
+{
+    struct vlan_snapshot *snap;
+
+    pthread_mutex_lock(&g_write_lock);
+
+    while (nl_cache_mngr_poll(g_mngr, 0) > 0)
+        ;
+
+    if (g_changed)
+    {
+        g_changed = 0;
+        snap = snapshot_from_cache(g_link_cache);
+        if (snap)
+            publish(snap);
+        else
+            fprintf(stderr, "vlan_state: out of memory rebuilding snapshot\n");
+    }
+
+    pthread_mutex_unlock(&g_write_lock);
+}
+
+static void *monitor_main(void *arg)
+{
+    (void)arg;
+
+    while (!atomic_load(&g_stop))
+    {
+        if (nl_cache_mngr_poll(g_mngr, VS_POLL_MS) > 0 || g_changed)
+            monitor_sync();
+    }
+    return NULL;
+}
+
+/* ---------------------------------------------------------------------------
+ * Reader slot registration
+ * --------------------------------------------------------------------------- */
+
+static void slot_release(void *arg)
+{
+    int slot = (int)(intptr_t)arg - 1;
+
+    atomic_store(&g_slots[slot].epoch, 0);
+    atomic_store(&g_slots[slot].used, 0);
+}
+
+static void slot_key_create(void)
+{
+    pthread_key_create(&g_slot_key, slot_release);
+}
+
+static int slot_claim(void)
+{
+    unsigned i;
+
+    pthread_once(&g_slot_once, slot_key_create);
+
+    for (i = 0; i < VS_MAX_READERS; i++)
+    {
+        int expected = 0;
+
+        if (atomic_compare_exchange_strong(&g_slots[i].used, &expected, 1))
+        {
+            pthread_setspecific(g_slot_key, (void *)(intptr_t)(i + 1));
+            return (int)i;
+        }
+    }
+    return -1;
+}
+
+/* ---------------------------------------------------------------------------
+ * Public API
+ * --------------------------------------------------------------------------- */
+
+/**
+ * vlan_state_init() - Load the link table and start the monitor thread.
+ *
+ * @return
+ *    0        – success; a snapshot is published. \n
+ *   -EALREADY – Already initialised. \n
+ *   -ENOMEM   – Allocation failure. \n
+ *   -EIO      – The Netlink cache manager could not be set up.
+ */
+int vlan_state_init(void)
+{
+    struct vlan_snapshot *snap;
+    int err;
+
+    if (g_running)
+        return -EALREADY;
+
+    err = nl_cache_mngr_alloc(NULL, NETLINK_ROUTE, 0, &g_mngr);
+    if (err < 0)
+    {
+        fprintf(stderr, "vlan_state_init: nl_cache_mngr_alloc failed: %s\n",
+                nl_geterror(err));
+        return -EIO;
+    }
+
+    err = nl_cache_mngr_add(g_mngr, "route/link", link_change_cb, NULL,
+                            &g_link_cache);
+    if (err < 0)
+    {
+        fprintf(stderr, "vlan_state_init: nl_cache_mngr_add(route/link) failed: %s\n",
+                nl_geterror(err));
+        nl_cache_mngr_free(g_mngr);
+        g_mngr = NULL;
+        return -EIO;
+    }
+
+    snap = snapshot_from_cache(g_link_cache);
+    if (!snap)
+    {
+        nl_cache_mngr_free(g_mngr);
+        g_mngr = NULL;
+        return -ENOMEM;
+    }
+
+    pthread_mutex_lock(&g_write_lock);
+    publish(snap);
+    pthread_mutex_unlock(&g_write_lock);
+
+    atomic_store(&g_stop, 0);
+    if (pthread_create(&g_monitor, NULL, monitor_main, NULL) != 0)
+    {
+        fprintf(stderr, "vlan_state_init: failed to start monitor thread\n");
+        vlan_state_shutdown();
+        return -ENOMEM;
+    }
+
+    g_running = 1;
+    printf("Link state snapshot loaded: %u interfaces\n", snap->nlinks);
+    return 0;
+}
+
+/**
+ * vlan_state_shutdown() - Stop the monitor and free every snapshot.
+ *
+ * The caller must ensure that no reader is inside a read-side section.
+ */
+void vlan_state_shutdown(void)
+{
+    struct vlan_snapshot *snap;
+
+    if (g_running)
+    {
+        atomic_store(&g_stop, 1);
+        pthread_join(g_monitor, NULL);
+        g_running = 0;
+    }
+
+    pthread_mutex_lock(&g_write_lock);
+    snap = atomic_exchange(&g_current, NULL);
+    snapshot_free(snap);
+    while (g_retired)
+    {
+        snap = g_retired;
+        g_retired = snap->retired_next;
+        snapshot_free(snap);
+    }
+    pthread_mutex_unlock(&g_write_lock);
+
+    if (g_mngr)
+    {
+        nl_cache_mngr_free(g_mngr);
+        g_mngr = NULL;
+        g_link_cache = NULL;
+    }
+}
+
+/**
+ * vlan_state_read_begin() - Enter a read-side section.
+ *
+ * @return  The current snapshot, valid until vlan_state_read_end(), or NULL
+ *          if no snapshot is published (the caller must still call
+ *          vlan_state_read_end()).  Sections must not nest.
+ */
+const struct vlan_snapshot *vlan_state_read_begin(void)
+{
+    if (t_slot < 0 && (t_slot = slot_claim()) < 0)
+        return NULL;
+
+    atomic_store(&g_slots[t_slot].epoch, atomic_load(&g_epoch));
+    return atomic_load(&g_current);
+}
+
+/**
+ * vlan_state_read_end() - Leave the read-side section entered last.
+ */
+void vlan_state_read_end(void)
+{
+    if (t_slot >= 0)
+        atomic_store_explicit(&g_slots[t_slot].epoch, 0, memory_order_release);
+}
+
+/**
+ * vlan_snapshot_find_name() - Look up a link by name.
+ *
+ * @return Pointer into @p snap, or NULL if absent.
+ */
+const struct vs_link *vlan_snapshot_find_name(const struct vlan_snapshot *snap,
+                                              const char *name)
+{
+    uint32_t pos;
+
+    if (!snap || !name || !snap->name_index)
+        return NULL;
+
+    pos = name_hash(name) & snap->name_index_mask;
+    while (snap->name_index[pos])
+    {
+        const struct vs_link *l = &snap->links[snap->name_index[pos] - 1];
+
+        if (strcmp(l->name, name) == 0)
+            return l;
+        pos = (pos + 1) & snap->name_index_mask;
+    }
+    return NULL;
+}
+
+/**
+ * vlan_snapshot_find_index() - Look up a link by ifindex (binary search).
+ *
+ * @return Pointer into @p snap, or NULL if absent.
+ */
+const struct vs_link *vlan_snapshot_find_index(const struct vlan_snapshot *snap,
+                                               int ifindex)
+{
+    unsigned lo = 0;
+    unsigned hi;
+
+    if (!snap)
+        return NULL;
+
+    hi = snap->nlinks;
+    while (lo < hi)
+    {
+        unsigned mid = lo + (hi - lo) / 2;
+        int v = snap->links[mid].ifindex;
+
+        if (v == ifindex)
+            return &snap->links[mid];
+        if (v < ifindex)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return NULL;
+}
+
+/**
+ * vlan_state_lookup_ifindex() - Resolve @p name through the current snapshot.
+ *
+ * @return ifindex (>= 1) if the snapshot knows the link, -1 otherwise.
+ */
+int vlan_state_lookup_ifindex(const char *name)
+{
+    const struct vlan_snapshot *snap;
+    const struct vs_link *l;
+    int ifindex = -1;
+
+    snap = vlan_state_read_begin();
+    if ((l = vlan_snapshot_find_name(snap, name)) != NULL)
+        ifindex = l->ifindex;
+    vlan_state_read_end();
+
+    return ifindex;
+}
+
+/*
+ * note_find() - Locate @p ifindex in a working copy whose first @p nsorted
+ * links are still in ifindex order and whose tail holds links added since.
+ */
+static struct vs_link *note_find(struct vlan_snapshot *snap, unsigned nsorted,
+                                 const uint8_t *dead, int ifindex)
+{
+    struct vlan_snapshot prefix = *snap;
+    const struct vs_link *l;
+    unsigned i;
+
+    prefix.nlinks = nsorted;
+    l = vlan_snapshot_find_index(&prefix, ifindex);
+    if (l && !dead[l - snap->links])
+        return (struct vs_link *)l;
+
+    for (i = nsorted; i < snap->nlinks; i++)
+    {
+        if (!dead[i] && snap->links[i].ifindex == ifindex)
+            return &snap->links[i];
+    }
+    return NULL;
+}
+
+/**
+ * vlan_state_note_many() - Apply several recorded changes in one publication.
+ *
+ * Notes are applied in order to a single copy of the current snapshot, so a
+ * batch of N changes costs one copy instead of N.  Notes that do not match
+ * the snapshot (unknown link, link already present) are ignored, as in the
+ * single-change hooks.  No-op if no snapshot is published.
+ */
+void vlan_state_note_many(const struct vs_note *notes, size_t count)
+{
+    struct vlan_snapshot *cur;
+    struct vlan_snapshot *snap;
+    struct vs_link *l;
+    uint8_t *dead;
+    unsigned nsorted;
+    unsigned extra = 0;
+    unsigned i;
+    unsigned n;
+    size_t k;
+    int ndead = 0;
+
+    if (!notes || count == 0)
+        return;
+
+    for (k = 0; k < count; k++)
+    {
+        if (notes[k].op == VS_NOTE_ADD)
+            extra++;
+    }
+
+    pthread_mutex_lock(&g_write_lock);
+
+    cur = atomic_load(&g_current);
+    if (!cur)
+    {
+        pthread_mutex_unlock(&g_write_lock);
+        return;
+    }
+
+    snap = snapshot_clone(cur, extra);
+    dead = calloc(cur->nlinks + extra + 1, 1);
+    if (!snap || !dead)
+    {
+        snapshot_free(snap);
+        free(dead);
+        pthread_mutex_unlock(&g_write_lock);
+        return;
+    }
+    nsorted = snap->nlinks;
+
+    for (k = 0; k < count; k++)
+    {
+        const struct vs_note *nt = &notes[k];
+
+        if (nt->ifindex <= 0)
+            continue;
+        l = note_find(snap, nsorted, dead, nt->ifindex);
+
+        switch (nt->op)
+        {
+        case VS_NOTE_ADD:
+            if (l || !nt->name)
+                break;
+            l = &snap->links[snap->nlinks++];
+            memset(l, 0, sizeof(*l));
+            l->ifindex = nt->ifindex;
+            snprintf(l->name, sizeof(l->name), "%s", nt->name);
+            snprintf(l->kind, sizeof(l->kind), "%s", nt->kind ? nt->kind : "");
+            break;
+
+        case VS_NOTE_DEL:
+            if (!l)
+                break;
+            dead[l - snap->links] = 1;
+            ndead++;
+            /* Ports of a deleted bridge are detached by the kernel. */
+            for (i = 0; i < snap->nlinks; i++)
+            {
+                if (snap->links[i].master == nt->ifindex)
+                    snap->links[i].master = 0;
+            }
+            break;
+
+        case VS_NOTE_MASTER:
+            if (l)
+                l->master = nt->master;
+            break;
+
+        case VS_NOTE_LINK:
+            if (!l)
+                break;
+            l->flags = nt->flags;
+            l->mtu = nt->mtu;
+            if (nt->alias)
+                snprintf(l->alias, sizeof(l->alias), "%s", nt->alias);
+            break;
+        }
+    }
+
+    if (ndead)
+    {
+        for (i = 0, n = 0; i < snap->nlinks; i++)
+        {
+            if (!dead[i])
+                snap->links[n++] = snap->links[i];
+        }
+        snap->nlinks = n;
+    }
+    free(dead);
+
+    if (snapshot_finish(snap) == 0)
+        publish(snap);
+    else
+        snapshot_free(snap);
+
+    pthread_mutex_unlock(&g_write_lock);
+}
+
+/**
+ * vlan_state_note_add() - Record a link the daemon has just created.
+ *
+ * No-op if no snapshot is published or the link is already known.
+ */
+void vlan_state_note_add(const char *name, int ifindex, const char *kind)
+{
+    struct vs_note nt = { VS_NOTE_ADD, ifindex, 0, name, kind, 0, 0, NULL };
+
+    if (!name || ifindex <= 0)
+        return;
+    vlan_state_note_many(&nt, 1);
+}
+
+/**
+ * vlan_state_note_del() - Record that the daemon has deleted link @p ifindex.
+ *
+ * Links enslaved to it lose their master, as the kernel detaches them.
+ */
+void vlan_state_note_del(int ifindex)
+{
+    struct vs_note nt = { VS_NOTE_DEL, ifindex, 0, NULL, NULL, 0, 0, NULL };
+
+    vlan_state_note_many(&nt, 1);
+}
+
+/**
+ * vlan_state_note_master() - Record a new IFLA_MASTER for link @p ifindex.
+ *
+ * @param master  Master ifindex, or 0 when the link has been un-enslaved.
+ */
+void vlan_state_note_master(int ifindex, int master)
+{
+    struct vs_note nt = { VS_NOTE_MASTER, ifindex, master, NULL, NULL, 0, 0, NULL };
+
+    vlan_state_note_many(&nt, 1);
+}
@@ -0,0 +1,107 @@
+/**
+ * @file vlan_state.h
+ * @brief Lock-free published snapshot of the kernel interface / VLAN tables.
+ *
+ * A monitor thread mirrors the kernel link table (RTNLGRP_LINK) and publishes
+ * it as an immutable struct vlan_snapshot.  Writers build the next version
+ * under a private lock and swap it in atomically; readers bracket their access
+ * with vlan_state_read_begin() / vlan_state_read_end() and never block.  Old
+ * versions are reclaimed once every reader that could still see them has left
+ * its read-side section (epoch-based reclamation).
+ *
+ * The provisioning calls in vlan_api.c report their own successful changes
+ * through the vlan_state_note_*() hooks so that a create or delete is visible
+ * to the next existence check without waiting for the kernel notification;
+ * batched provisioning reports a whole batch with vlan_state_note_many().
+ */
+
+#ifndef VLAN_STATE_H
+#define VLAN_STATE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <linux/if.h>
+
+/** Number of entries in the per-VLAN-ID tables (IDs 0..4095). */
+#define VLAN_ID_SPACE     4096
+
+/** Threads that may hold a read-side section at the same time. */
+#define VS_MAX_READERS    128
+
+#define VS_KIND_LEN       16
+#define VS_ALIAS_LEN      128
+
+/** One kernel link as seen in a snapshot. */
+struct vs_link
+{
+    int      ifindex;
+    int      master;                  /**< IFLA_MASTER ifindex, 0 if none.    */
+    int      member_vlan;             /**< ID of the Vlan<id> master, or 0.   */
+    int      parent;                  /**< IFLA_LINK ifindex, 0 if none.      */
+    int      vlan_id;                 /**< 802.1Q ID for kind "vlan", else 0. */
+    uint32_t vlan_flags;
+    unsigned flags;                   /**< IFF_* flags.                       */
+    unsigned mtu;
+    uint8_t  addr[6];
+    char     name[IFNAMSIZ];
+    char     kind[VS_KIND_LEN];       /**< "bridge", "vlan", "veth", or "".   */
+    char     alias[VS_ALIAS_LEN];
+};
+
+/** Immutable view of the interface and VLAN tables. */
+struct vlan_snapshot
+{
+    uint64_t        generation;
+    unsigned        nlinks;
+    struct vs_link *links;            /**< Sorted by ifindex.                 */
+    uint32_t       *name_index;       /**< Open-addressing hash, slot = idx+1. */
+    unsigned        name_index_mask;
+    int             bridge_ifindex[VLAN_ID_SPACE]; /**< Vlan<id> bridge or 0. */
+
+    /* Reclamation bookkeeping (writer side only). */
+    uint64_t              retire_epoch;
+    struct vlan_snapshot *retired_next;
+};
+
+int  vlan_state_init(void);
+void vlan_state_shutdown(void);
+
+const struct vlan_snapshot *vlan_state_read_begin(void);
+void vlan_state_read_end(void);
+
+const struct vs_link *vlan_snapshot_find_name(const struct vlan_snapshot *snap,
+                                              const char *name);
+const struct vs_link *vlan_snapshot_find_index(const struct vlan_snapshot *snap,
+                                               int ifindex);
+
+int  vlan_state_lookup_ifindex(const char *name);
+
+/** Kind of change recorded by a struct vs_note. */
+enum vs_note_op
+{
+    VS_NOTE_ADD,         /**< link @c ifindex created as @c name / @c kind */
+    VS_NOTE_DEL,         /**< link @c ifindex deleted */
+    VS_NOTE_MASTER,      /**< link @c ifindex now has master @c master */
+    VS_NOTE_LINK,        /**< link @c ifindex now has @c flags, @c mtu and
+                              @c alias (unless NULL) */
+};
+
+/** One change for vlan_state_note_many(); strings are copied. */
+struct vs_note
+{
+    enum vs_note_op op;
+    int             ifindex;
+    int             master;
+    const char     *name;
+    const char     *kind;
+    unsigned        flags;
+    unsigned        mtu;
+    const char     *alias;
+};
+
+void vlan_state_note_add(const char *name, int ifindex, const char *kind);
+void vlan_state_note_del(int ifindex);
+void vlan_state_note_master(int ifindex, int master);
+void vlan_state_note_many(const struct vs_note *notes, size_t count);
+
+#endif /* VLAN_STATE_H */
@@ -0,0 +1,311 @@
+/**
+ * @file vlan_tag.c
+ * @brief 802.1Q burst kernels: vectorised TPID/TCI classification, in-place
+ *        pop, tag-inserting copy.
+ *
+ * Classification reads the 32-bit word at offset 12 of every frame (TPID and
+ * TCI of an outer tag, or the ethertype of an untagged frame) and produces a
+ * C-tag mask, an S-tag mask and the byte-swapped TCIs.  The SIMD kernels do
+ * the compare and the byte swap for 4 (SSE4.2) or 8 (AVX2, using gathers)
+ * frames per step; a group containing a frame shorter than 16 bytes, and the
+ * tail of the burst, take the scalar path.  Everything that changes a frame
+ * (pop, drop decisions) is scalar and only runs for the frames the masks
+ * select, which is none in the common all-untagged burst.
+ */
+
+#include <errno.h>
+#include <string.h>
+#include <linux/if_ether.h>
+
+#include "vlan_tag.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define VT_HAVE_X86 1
+#endif
+
+/* TPIDs as they read from memory in a little-endian 16-bit load. */
+#define VT_LE_CTAG  0x0081
+#define VT_LE_STAG  0xA888
+
+typedef void (*vt_classify_fn)(const struct dp_frame *f, unsigned n,
+                               uint64_t *ctag, uint64_t *stag, uint16_t *tci);
+
+static void classify_auto(const struct dp_frame *f, unsigned n,
+                          uint64_t *ctag, uint64_t *stag, uint16_t *tci);
+
+static vt_classify_fn g_classify = classify_auto;
+static const char    *g_impl_name = "auto";
+
+/* ---------------------------------------------------------------------------
+ * Kernels
+ * --------------------------------------------------------------------------- */
+
+static inline uint32_t load32(const uint8_t *p)
+{
+    uint32_t v;
+
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static inline void classify_one(const struct dp_frame *f, unsigned i,
+                                uint64_t *ctag, uint64_t *stag, uint16_t *tci)
+{
+    const uint8_t *p = f[i].data;
+
+    if (f[i].len < 16)
+        return;
+    if (p[12] == 0x81 && p[13] == 0x00)
+        *ctag |= 1ull << i;
+    else if (p[12] == 0x88 && p[13] == 0xA8)
+        *stag |= 1ull << i;
+    tci[i] = (uint16_t)((p[14] << 8) | p[15]);
+}
+
+static void classify_scalar(const struct dp_frame *f, unsigned n,
+                            uint64_t *ctag, uint64_t *stag, uint16_t *tci)
+{
+    unsigned i;
+
+    for (i = 0; i < n; i++)
+        classify_one(f, i, ctag, stag, tci);
+}
+
+#ifdef VT_HAVE_X86
+
+static inline int group_short(const struct dp_frame *f, unsigned k)
+{
+    unsigned i;
+
+    for (i = 0; i < k; i++)
+    {
+        if (f[i].len < 16)
+            return 1;
+    }
+    return 0;
+}
+
+__attribute__((target("sse4.2")))
+static void classify_sse42(const struct dp_frame *f, unsigned n,
+                           uint64_t *ctag, uint64_t *stag, uint16_t *tci)
+{
+    const __m128i lo16 = _mm_set1_epi32(0xFFFF);
+    const __m128i ct   = _mm_set1_epi32(VT_LE_CTAG);
+    const __m128i st   = _mm_set1_epi32(VT_LE_STAG);
+    const __m128i swap = _mm_setr_epi8(3, 2, -1, -1, 7, 6, -1, -1,
+                                       11, 10, -1, -1, 15, 14, -1, -1);
+    unsigned i;
+
+    for (i = 0; i + 4 <= n; i += 4)
+    {
+        __m128i w, t, v;
+
+        if (group_short(&f[i], 4))
+        {
+            unsigned j;
+
+            for (j = i; j < i + 4; j++)
+                classify_one(f, j, ctag, stag, tci);
+            continue;
+        }
+
+        w = _mm_setr_epi32((int)load32(f[i].data + 12), (int)load32(f[i + 1].data + 12),
+                           (int)load32(f[i + 2].data + 12), (int)load32(f[i + 3].data + 12));
+        t = _mm_and_si128(w, lo16);
+        *ctag |= (uint64_t)_mm_movemask_ps(_mm_castsi128_ps(_mm_cmpeq_epi32(t, ct))) << i;
+        *stag |= (uint64_t)_mm_movemask_ps(_mm_castsi128_ps(_mm_cmpeq_epi32(t, st))) << i;
+
+        v = _mm_shuffle_epi8(w, swap);
+        _mm_storel_epi64((__m128i *)&tci[i], _mm_packus_epi32(v, v));
+    }
+    for (; i < n; i++)
+        classify_one(f, i, ctag, stag, tci);
+}
+
+__attribute__((target("avx2")))
+static void classify_avx2(const struct dp_frame *f, unsigned n,
+                          uint64_t *ctag, uint64_t *stag, uint16_t *tci)
+{
+    const __m256i lo16 = _mm256_set1_epi32(0xFFFF);
+    const __m256i ct   = _mm256_set1_epi32(VT_LE_CTAG);
+    const __m256i st   = _mm256_set1_epi32(VT_LE_STAG);
+    const __m256i swap = _mm256_setr_epi8(3, 2, -1, -1, 7, 6, -1, -1,
+                                          11, 10, -1, -1, 15, 14, -1, -1,
+                                          3, 2, -1, -1, 7, 6, -1, -1,
+                                          11, 10, -1, -1, 15, 14, -1, -1);
+    unsigned i;
+
+    for (i = 0; i + 8 <= n; i += 8)
+    {
+        const uint8_t *base = f[i].data;
+        __m256i off0, off1, w, t, v;
+
+        if (group_short(&f[i], 8))
+        {
+            unsigned j;
+
+            for (j = i; j < i + 8; j++)
+                classify_one(f, j, ctag, stag, tci);
+            continue;
+        }
+
+        /* Gather offsets are relative to the first frame of the group. */
+        off0 = _mm256_setr_epi64x(12, f[i + 1].data - base + 12,
+                                  f[i + 2].data - base + 12, f[i + 3].data - base + 12);
+        off1 = _mm256_setr_epi64x(f[i + 4].data - base + 12, f[i + 5].data - base + 12,
+                                  f[i + 6].data - base + 12, f[i + 7].data - base + 12);
+        w = _mm256_set_m128i(_mm256_i64gather_epi32((const int *)base, off1, 1),
+                             _mm256_i64gather_epi32((const int *)base, off0, 1));
+
+        t = _mm256_and_si256(w, lo16);
+        *ctag |= (uint64_t)_mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpeq_epi32(t, ct))) << i;
+        *stag |= (uint64_t)_mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpeq_epi32(t, st))) << i;
+
+        /* packus works per 128-bit lane; regroup the two halves. */
+        v = _mm256_packus_epi32(_mm256_shuffle_epi8(w, swap), _mm256_setzero_si256());
+        v = _mm256_permute4x64_epi64(v, _MM_SHUFFLE(3, 1, 2, 0));
+        _mm_storeu_si128((__m128i *)&tci[i], _mm256_castsi256_si128(v));
+    }
+    for (; i < n; i++)
+        classify_one(f, i, ctag, stag, tci);
+}
+
+#endif /* VT_HAVE_X86 */
+
+static void classify_auto(const struct dp_frame *f, unsigned n,
+                          uint64_t *ctag, uint64_t *stag, uint16_t *tci)
+{
+    vt_select(VT_IMPL_AUTO);
+    g_classify(f, n, ctag, stag, tci);
+}
+
+/* ---------------------------------------------------------------------------
+ * Public API
+ * --------------------------------------------------------------------------- */
+
+/**
+ * vt_select() - Choose the classification kernel.
+ *
+ * VT_IMPL_AUTO picks the widest one the CPU supports.  The choice is global;
+ * call it before the forwarding plane starts.
+ *
+ * @return 0, or -ENOTSUP if the CPU (or the build target) lacks the
+ *         requested instruction set.
+ */
+int vt_select(enum vt_impl impl)
+{
+#ifdef VT_HAVE_X86
+    __builtin_cpu_init();
+    if (impl == VT_IMPL_AUTO)
+        impl = __builtin_cpu_supports("avx2")   ? VT_IMPL_AVX2  :
+               __builtin_cpu_supports("sse4.2") ? VT_IMPL_SSE42 : VT_IMPL_SCALAR;
+
+    if (impl == VT_IMPL_AVX2)
+    {
+        if (!__builtin_cpu_supports("avx2"))
+            return -ENOTSUP;
+        g_classify = classify_avx2;
+        g_impl_name = "avx2";
+        return 0;
+    }
+    if (impl == VT_IMPL_SSE42)
+    {
+        if (!__builtin_cpu_supports("sse4.2"))
+            return -ENOTSUP;
+        g_classify = classify_sse42;
+        g_impl_name = "sse4.2";
+        return 0;
+    }
+#else
+    if (impl == VT_IMPL_SSE42 || impl == VT_IMPL_AVX2)
+        return -ENOTSUP;
+#endif
+    g_classify = classify_scalar;
+    g_impl_name = "scalar";
+    return 0;
+}
+
+const char *vt_impl_name(void)
+{
+    return g_impl_name;
+}
+
+/**
+ * vt_parse_burst() - Normalise the tags of up to VT_BURST_MAX frames.
+ *
+ * On return every frame not marked for dropping is untagged in memory; a
+ * C-tag found in-band has been popped (data and len adjusted) and, like a
+ * tag the kernel had already stripped, is reported in vlan_tci with
+ * vlan_valid set.
+ *
+ * @return a mask with bit i set if frame i must be dropped: shorter than
+ *         an Ethernet header, S-tagged, or carrying stacked tags.
+ */
+uint64_t vt_parse_burst(struct dp_frame *f, unsigned n)
+{
+    uint16_t tci[VT_BURST_MAX];
+    uint64_t ctag = 0;
+    uint64_t stag = 0;
+    uint64_t drop = 0;
+    uint64_t m;
+    unsigned i;
+
+    if (n > VT_BURST_MAX)
+        n = VT_BURST_MAX;
+
+    g_classify(f, n, &ctag, &stag, tci);
+
+    for (i = 0; i < n; i++)
+    {
+        if (f[i].len < ETH_HLEN)
+            drop |= 1ull << i;
+    }
+
+    /* A tag in-band behind one the kernel stripped is a stacked tag too. */
+    m = (ctag | stag) & ~drop;
+    while (m)
+    {
+        struct dp_frame *fr;
+        const uint8_t *p;
+
+        i = (unsigned)__builtin_ctzll(m);
+        m &= m - 1;
+        fr = &f[i];
+
+        if ((stag & (1ull << i)) || fr->vlan_valid || fr->len < ETH_HLEN + 4)
+        {
+            drop |= 1ull << i;
+            continue;
+        }
+
+        memmove(fr->data + 4, fr->data, 12);
+        fr->data += 4;
+        fr->len  -= 4;
+        fr->vlan_tci   = tci[i];
+        fr->vlan_valid = 1;
+
+        p = fr->data;
+        if ((p[12] == 0x81 && p[13] == 0x00) || (p[12] == 0x88 && p[13] == 0xA8))
+            drop |= 1ull << i;
+    }
+    return drop;
+}
+
+/**
+ * vt_tag_copy() - Copy an untagged frame to @p dst inserting a C-tag.
+ *
+ * @p dst must have room for @p len + 4 bytes; @p len must be at least 12.
+ *
+ * @return the length of the tagged frame.
+ */
+uint32_t vt_tag_copy(uint8_t *dst, const uint8_t *src, uint32_t len, uint16_t tci)
+{
+    memcpy(dst, src, 12);
+    dst[12] = VT_TPID_CTAG >> 8;
+    dst[13] = VT_TPID_CTAG & 0xFF;
+    dst[14] = (uint8_t)(tci >> 8);
+    dst[15] = (uint8_t)tci;
+    memcpy(dst + 16, src + 12, len - 12);
+    return len + 4;
+}
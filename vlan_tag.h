@@ -0,0 +1,45 @@
+/**
+ * @file vlan_tag.h
+ * @brief Burst 802.1Q tag classification, pop and push for the forwarding plane.
+ *
+ * vt_parse_burst() normalises a burst of received frames so that every
+ * frame is untagged in memory and its C-tag, if any, is in
+ * dp_frame.vlan_tci / vlan_valid, whether the kernel stripped the tag
+ * (TP_STATUS_VLAN_VALID) or it was still in-band.  In-band tags are popped
+ * in place by moving the MAC addresses four bytes up.  The TPID check and
+ * TCI extraction run on several frames per instruction (AVX2: 8, SSE4.2: 4)
+ * with a scalar fallback; the kernel is chosen at run time from the CPU's
+ * features, or forced with vt_select() for tests and benchmarks.
+ *
+ * vt_tag_copy() is the egress side: it copies a frame while inserting a tag,
+ * so a trunk port's copy costs no more than an untagged one.
+ */
+
+#ifndef VLAN_TAG_H
+#define VLAN_TAG_H
+
+#include <stdint.h>
+
+#include "dp_ring.h"
+
+/** Largest burst vt_parse_burst() accepts (one bit per frame in its result). */
+#define VT_BURST_MAX  64
+
+#define VT_TPID_CTAG  0x8100
+#define VT_TPID_STAG  0x88A8
+
+enum vt_impl
+{
+    VT_IMPL_AUTO,
+    VT_IMPL_SCALAR,
+    VT_IMPL_SSE42,
+    VT_IMPL_AVX2,
+};
+
+int         vt_select(enum vt_impl impl);
+const char *vt_impl_name(void);
+
+uint64_t vt_parse_burst(struct dp_frame *frames, unsigned n);
+uint32_t vt_tag_copy(uint8_t *dst, const uint8_t *src, uint32_t len, uint16_t tci);
+
+#endif /* VLAN_TAG_H */
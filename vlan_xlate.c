@@ -0,0 +1,95 @@
+/**
+ * @file vlan_xlate.c
+ * @brief Per-port VLAN translation tables (see vlan_xlate.h).
+ */
+
+#include <errno.h>
+
+#include "vlan_xlate.h"
+
+static void put(uint16_t *e, uint16_t v)
+{
+    __atomic_store_n(e, v, __ATOMIC_RELAXED);
+}
+
+/* ---------------------------------------------------------------------------
+ * Public API
+ * --------------------------------------------------------------------------- */
+
+/**
+ * vlan_xlate_check() - Check that C-VIDs @p cvid .. @p cvid + @p count - 1
+ * can be mapped to internal VIDs @p vid .. @p vid + @p count - 1 in order,
+ * or unmapped if @p vid is 0.
+ *
+ * A C-VID already mapped may be mapped again, to another internal VID,
+ * including one that another C-VID of the same range gives up: C-VIDs
+ * 10..11 on 100..101 may move to 101..102.
+ *
+ * @return
+ *    0        – the change can be applied with vlan_xlate_set(). \n
+ *   -EINVAL   – no mapping, or a VID of either range outside [1..4094]. \n
+ *   -EEXIST   – an internal VID of the range is already the translation
+ *               of a C-VID of the port outside the range.
+ */
+int vlan_xlate_check(const struct vlan_xlate *x, uint16_t cvid, uint16_t vid, unsigned count)
+{
+    unsigned i;
+
+    if (count == 0 || cvid < 1 || cvid + count - 1 > 4094)
+        return -EINVAL;
+    if (vid == 0)
+        return 0;
+    if (vid + count - 1 > 4094)
+        return -EINVAL;
+    for (i = 0; i < count; i++)
+    {
+        uint16_t c = vlan_xlate_out(x, (uint16_t)(vid + i));
+
+        if (c && (c < cvid || c >= cvid + count))
+            return -EEXIST;
+    }
+    return 0;
+}
+
+/**
+ * vlan_xlate_set() - Map C-VIDs @p cvid .. @p cvid + @p count - 1 to
+ * internal VIDs @p vid .. @p vid + @p count - 1, or unmap them if @p vid
+ * is 0.  The change must have passed vlan_xlate_check().
+ */
+void vlan_xlate_set(struct vlan_xlate *x, uint16_t cvid, uint16_t vid, unsigned count)
+{
+    unsigned i;
+
+    for (i = 0; i < count; i++)
+    {
+        uint16_t c = (uint16_t)(cvid + i);
+        uint16_t old = x->in[c];
+
+        if (old)
+        {
+            /* Unless an earlier C-VID of the range has taken it over. */
+            if (x->out[old] == c)
+                put(&x->out[old], 0);
+            x->n--;
+        }
+        put(&x->in[c], vid ? (uint16_t)(vid + i) : 0);
+        if (vid)
+        {
+            put(&x->out[vid + i], c);
+            x->n++;
+        }
+    }
+}
+
+/** vlan_xlate_clear() - Remove every mapping of @p x. */
+void vlan_xlate_clear(struct vlan_xlate *x)
+{
+    unsigned i;
+
+    for (i = 0; i < VLAN_ID_SPACE; i++)
+    {
+        put(&x->in[i], 0);
+        put(&x->out[i], 0);
+    }
+    x->n = 0;
+}
@@ -0,0 +1,49 @@
+/**
+ * @file vlan_xlate.h
+ * @brief Per-port VLAN translation tables: customer VID (C-VID) to internal
+ *        VID on ingress, and back on egress.
+ *
+ * A table is two direct-indexed arrays of VLAN_ID_SPACE entries, so a
+ * lookup in either direction is one load whatever the number of mappings.
+ * Mappings are one-to-one: a port carries an internal VLAN under one C-VID
+ * at most, which is what makes the egress direction well defined.  Entries
+ * are written with relaxed atomic stores, so readers on other threads see
+ * every entry either old or new without taking a lock.
+ *
+ * vlan_xlate_check() validates a change of a range of mappings against the
+ * table and vlan_xlate_set() applies it; the split lets a backend program
+ * the change (or refuse it) between the two.
+ */
+
+#ifndef VLAN_XLATE_H
+#define VLAN_XLATE_H
+
+#include <stdint.h>
+
+#include "vlan_state.h"    /* VLAN_ID_SPACE */
+
+/** Translation table of one port; 0 in either array: not translated. */
+struct vlan_xlate
+{
+    uint16_t in[VLAN_ID_SPACE];     /**< C-VID -> internal VID */
+    uint16_t out[VLAN_ID_SPACE];    /**< internal VID -> C-VID */
+    unsigned n;                     /**< mappings */
+};
+
+/** Internal VID of C-VID @p cvid received on the port, 0 if not mapped. */
+static inline uint16_t vlan_xlate_in(const struct vlan_xlate *x, uint16_t cvid)
+{
+    return __atomic_load_n(&x->in[cvid & 0x0FFF], __ATOMIC_RELAXED);
+}
+
+/** C-VID that internal VID @p vid is sent with, 0 if not mapped. */
+static inline uint16_t vlan_xlate_out(const struct vlan_xlate *x, uint16_t vid)
+{
+    return __atomic_load_n(&x->out[vid & 0x0FFF], __ATOMIC_RELAXED);
+}
+
+int  vlan_xlate_check(const struct vlan_xlate *x, uint16_t cvid, uint16_t vid, unsigned count);
+void vlan_xlate_set(struct vlan_xlate *x, uint16_t cvid, uint16_t vid, unsigned count);
+void vlan_xlate_clear(struct vlan_xlate *x);
+
+#endif /* VLAN_XLATE_H */